@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class PaletteFile;
+
+
+/// The names (the tooltip text) of the entries in a color table, resolved only when they are asked
+/// for, rather than stored as a CString per entry. Pass the object, along with the colors, to
+/// ColorPickerButton::SetColorTable(), and the button stores nothing but the colors: a name is
+/// looked up when the tooltip for its swatch is about to be shown, which happens for only a
+/// handful of swatches in a session, however large the table is.
+///
+/// Names can be resolved from a string table (in a specific language, for translated names), from
+/// a locale file (a palette file whose names are the translations, which is used in place), or by a
+/// callback. The most recently resolved names are kept in a small cache, so that a tooltip that is
+/// shown repeatedly does not resolve its name each time.
+class ColorNameTable
+{
+   ColorNameTable           (const ColorNameTable&) = delete;  // not copyable
+   ColorNameTable& operator=(const ColorNameTable&) = delete;  // not assignable
+
+public:
+
+   /// A function that resolves the name of the entry at the specified index.
+   using Resolver = std::function<CString(size_t index)>;
+
+   static constexpr size_t kcCacheMaxDefault = 32;  ///< number of resolved names kept, by default
+
+   /// Names each entry with a string resource: the entry at index i is named by the string with the
+   /// ID idFirst + i. The strings are loaded in the specified language (for example, one made by
+   /// MAKELANGID), or in the thread's user interface language, if it is 0. (An entry whose string
+   /// does not exist has an empty name.)
+   static std::shared_ptr<const ColorNameTable> FromStringTable(HINSTANCE hInstance,
+                                                                UINT      idFirst,
+                                                                WORD      langId    = 0,
+                                                                size_t    cCacheMax = kcCacheMaxDefault);
+
+   /// Names each entry with a name from a locale file, which is a palette file (see PaletteFile)
+   /// whose colors are ignored. The entry at index i is named by the locale file's entry keys[i],
+   /// or by its entry i, if no keys are specified. (An entry whose key is out of range has an
+   /// empty name.) Since the locale file's names are already in memory, only the key is stored.
+   static std::shared_ptr<const ColorNameTable> FromLocaleFile(std::shared_ptr<const PaletteFile> pLocaleFile,
+                                                               std::vector<UINT32>                keys      = std::vector<UINT32>(),
+                                                               size_t                             cCacheMax = kcCacheMaxDefault);
+
+   /// Names each entry by calling the specified function, which may be called on any thread that
+   /// asks for a name (normally, the thread that owns the button), but never on two at once.
+   static std::shared_ptr<const ColorNameTable> FromCallback(Resolver resolver,
+                                                             size_t   cCacheMax = kcCacheMaxDefault);
+
+
+   /// Gets the name of the entry at the specified index, from the cache, if it is there, or by
+   /// resolving it (and then adding it to the cache, evicting the least recently used name).
+   CString GetName(size_t index) const;
+
+   /// Resolves the name of the entry at the specified index, bypassing the cache (which is meant
+   /// for when every name is needed, once, so that the cache would only be thrashed).
+   CString ResolveName(size_t index) const;
+
+   /// Gets the number of bytes of memory that the table holds, including itself and its cache
+   /// (but not whatever the resolver holds, such as a locale file, which is not its own).
+   size_t GetByteSize() const;
+
+private:
+
+   struct CacheEntry
+   {
+      size_t  index;
+      CString strName;
+      UINT64  lastUse;  // (the value of m_useCounter when the entry was last used)
+   };
+
+   ColorNameTable(Resolver resolver, size_t cCacheMax);
+
+private:
+   const Resolver                  m_resolver;
+   const size_t                    m_cCacheMax;
+   mutable std::mutex              m_cacheMutex;  // (also serializes calls to the resolver)
+   mutable std::vector<CacheEntry> m_cache;       // small enough to search linearly
+   mutable UINT64                  m_useCounter;
+};
@@ -62,8 +62,31 @@
 #include <vector>
 #include <utility>
 #include <optional>
+#include <memory>
 
 class ThemeHelper;
+class ColorTableIndex;
+class DisplayOrder;
+class NameSearchIndex;
+class PaletteFile;
+class PaletteSource;
+class SharedPaletteStore;
+class ColorNameTable;
+class ColorTableDiff;
+class ColorTablePublishSlot;
+class TraceSink;
+class StatsPage;
+class InputLog;
+class InputRecorder;
+struct InputEvent;
+struct InputOutcome;
+struct InputReplayResult;
+class LatencyHistogram;
+class SessionArena;
+class ColorPickerSelection;
+class MemoryUsageCounter;
+struct StaticColorTableData;
+template <size_t N, size_t Columns> class StaticColorTable;
 
 
 enum ColorPickerButtonNotification : UINT
@@ -73,6 +96,7 @@ enum ColorPickerButtonNotification : UINT
    CPN_CLOSEUP      = 0x8002,  // close up
    CPN_SELENDOK     = 0x8003,  // okayed
    CPN_SELENDCANCEL = 0x8004,  // cancelled
+   CPN_BATCHCHANGED = 0x8005,  // selections changed during a batch update (see ColorPickerButton::BatchUpdate)
 };
 
 struct NMCOLORPICKERBUTTON
@@ -82,13 +106,20 @@ struct NMCOLORPICKERBUTTON
    COLORREF clrPrevious;  // the previous color (if applicable; otherwise, same as the current color)
 };
 
+struct NMCOLORPICKERBATCH
+{
+   NMHDR                      hdr;       // (from the first button listed, so ON_NOTIFY can route it by that button's ID)
+   size_t                     cChanges;
+   const NMCOLORPICKERBUTTON* pChanges;  // one for each button whose color changed, as CPN_SELCHANGED would have reported it
+};
+
 class ColorPickerButton : public CButton
 {
 public:
 
    ColorPickerButton();
 
-   virtual ~ColorPickerButton() = default;
+   virtual ~ColorPickerButton();
 
 
    /// Gets the currently-selected color.
@@ -107,6 +138,35 @@ public:
    void SetDefaultColor(COLORREF clr);
 
 
+   /// How the change notifications that a batch update holds back are sent when it ends.
+   enum class BatchNotification
+   {
+      PerButton,   ///< a CPN_SELCHANGED from each button whose color changed, in the order that they first changed
+      Aggregated,  ///< a single CPN_BATCHCHANGED to each parent, listing the changes of its buttons, in that order
+                   ///<   (the parents in the order that their first buttons changed)
+   };
+
+   /// Holds back the repainting and the change notifications of every button on the calling thread
+   /// while it is in scope, so that setting the colors of many buttons at once (for example, when
+   /// loading a document) costs one pass of painting and one round of notifications, rather than
+   /// one of each for every call. Each button that changed is invalidated once when the batch ends,
+   /// so that they are all painted together, and then the parents are notified, of each button's
+   /// change from its color before the batch to its color after it (a button whose color ended up
+   /// where it started is not reported). Batches may be nested; the outermost one decides how the
+   /// notifications are sent, and the work is done when it ends. A batch only holds the buttons of
+   /// its own thread, so a button must be changed and destroyed on the thread that owns its window
+   /// (as any window must be).
+   class BatchUpdate
+   {
+      BatchUpdate           (const BatchUpdate&) = delete;  // not copyable
+      BatchUpdate& operator=(const BatchUpdate&) = delete;  // not assignable
+
+   public:
+      explicit BatchUpdate(BatchNotification notification = BatchNotification::PerButton);
+      ~BatchUpdate();
+   };
+
+
    static constexpr const TCHAR* const kpszDefaultTextDefault = TEXT("&Automatic");
 
    /// Gets whether the color picker pop-up window
@@ -163,13 +223,146 @@ public:
    void SetTrackSelection(bool trackSelection);
 
 
+   /// Gets the sink, if any, that receives the timings of the phases of opening,
+   /// using, and closing the color picker pop-up window.
+   std::shared_ptr<TraceSink> GetTraceSink() const;
+
+   /// Sets the sink that receives the timings of the phases of opening, using, and closing the
+   /// color picker pop-up window (see TraceSink.hpp), or null for none. The timers are only
+   /// compiled in when COLORPICKERBUTTON_TRACE is defined; otherwise, the sink receives nothing.
+   void SetTraceSink(std::shared_ptr<TraceSink> pTraceSink);
+
+
+   /// The kinds of input whose latency is measured, from when the color picker pop-up window
+   /// receives the input until it has finished painting the result (if the input changed what
+   /// it displays). Latencies are always measured, and kept until they are reset.
+   enum class InputLatencyType
+   {
+      Hover,     ///< moving the mouse over the pop-up window
+      Keyboard,  ///< pressing keys in the pop-up window (to navigate, or to type a name)
+   };
+
+   /// Percentiles of the latencies of one kind of input, in microseconds. (They are read from
+   /// a histogram, so each is accurate to within about 3%; the maximum is exact.)
+   struct InputLatencyStats
+   {
+      UINT64 cSamples;
+      UINT32 p50;
+      UINT32 p90;
+      UINT32 p99;
+      UINT32 p999;
+      UINT32 max;
+   };
+
+   /// Gets the percentiles of the latencies of the specified kind of input,
+   /// since the button was created, or since the latencies were last reset.
+   InputLatencyStats GetInputLatencyStats(InputLatencyType type) const;
+
+   /// Gets the latency, in microseconds, that the specified percentage (from 0 to 100)
+   /// of the inputs of the specified kind took no longer than, or 0 if there were none.
+   UINT32 GetInputLatencyPercentile(InputLatencyType type, double percentile) const;
+
+   /// Discards the latencies of every kind of input (for example, at the start of a session).
+   void ResetInputLatencies();
+
+
+   /// Counts of the drawing work done by the button and its pop-up window, for checking that
+   /// a change does not make them do more work (for example, that moving the selection by one
+   /// swatch fills no more rectangles than it did before). The counts are exact, and they are
+   /// always kept, since keeping them costs an increment each.
+   struct PaintCounters
+   {
+      UINT64 cButtonPaints;       ///< times the button was drawn
+      UINT64 cPopupPaints;        ///< times the pop-up window's content was painted
+      UINT64 cFills;              ///< solid rectangles filled
+      UINT64 cThemeDraws;         ///< parts drawn with the visual styles (DrawThemeBackground)
+      UINT64 cInvalidations;      ///< times the button or the pop-up window was invalidated
+      UINT64 cNotifications;      ///< notifications sent to the parent
+      UINT64 cGdiObjectsCreated;  ///< bitmaps (for the cached faces of the buttons) and palettes created
+      UINT64 cFaceCopies;         ///< times the button was drawn by copying a cached face
+   };
+
+   /// Gets the counts of the drawing work done since the button was created,
+   /// or since the counts were last reset.
+   const PaintCounters& GetPaintCounters() const;
+
+   /// Resets the counts of the drawing work to zero.
+   void ResetPaintCounters();
+
+
+   /// Gets the page of shared memory, if any, that the button records its live statistics to.
+   std::shared_ptr<StatsPage> GetStatsPage() const;
+
+   /// Sets the page of shared memory that the button records its live statistics to, for a
+   /// monitoring tool to read (see StatsPage.hpp), or null for none. The page must be written
+   /// from the thread that owns the button.
+   void SetStatsPage(std::shared_ptr<StatsPage> pStatsPage);
+
+
+   /// Gets the recorder, if any, that receives a log of each session of input
+   /// to the color picker pop-up window.
+   std::shared_ptr<InputRecorder> GetInputRecorder() const;
+
+   /// Sets the recorder that receives a log of each session of input to the color picker
+   /// pop-up window (see InputLog.hpp), or null for none.
+   void SetInputRecorder(std::shared_ptr<InputRecorder> pInputRecorder);
+
+   /// Replays a session of input that was recorded from the color picker pop-up window, to check
+   /// that it still has the same outcome, and to measure how long each input takes. The pop-up
+   /// window is opened with the log's initial color (without animation, and without capturing the
+   /// mouse), is fed each input in turn, as fast as it can handle them, painting the result after
+   /// each one, and is closed; then the button's color is put back. The inputs are replayed at the
+   /// coordinates that they were recorded at, so the button must be configured as it was when the
+   /// session was recorded (with the same table, columns, options, and font).
+   ///
+   /// The parent is not sent the drop-down and close-up notifications (though, if the button
+   /// tracks the selection, it is notified as the selection changes, as it would be), and the
+   /// custom color dialog is not shown. Replayed inputs are not counted in the input latencies.
+   InputReplayResult ReplayInput(const InputLog& log);
+
+
+   /// The memory and GDI objects held by one button, or by every button in the process. Memory is
+   /// counted in the blocks that hold it (each vector by its capacity, and each string by its
+   /// buffer), so it is a close estimate of what is allocated, not counting the heap's overhead.
+   struct MemoryUsage
+   {
+      size_t cbPrivate;           ///< memory held by the buttons alone (including the buttons themselves)
+      size_t cbShared;            ///< memory held by tables, indexes, and rendered faces that can be shared between buttons
+      size_t cbMapped;            ///< palette files and shared palette stores mapped into memory
+      UINT   cGdiObjectsPrivate;  ///< GDI objects held by the buttons alone (their palettes)
+      UINT   cGdiObjectsShared;   ///< GDI objects that can be shared between buttons (the cached faces)
+      size_t cButtons;            ///< buttons counted
+   };
+
+   /// Gets the memory and GDI objects held by the button: those that it holds alone (its copy of
+   /// the color table, its captions, its palette, its caches, and its pop-up window, while that is
+   /// open), and those that it may share with other buttons (published tables, palette files, color
+   /// table indexes, tables of names, and the cache of rendered faces), each of which is counted in
+   /// full. Objects that belong to the application (such as trace sinks, stats pages, and input
+   /// recorders) are not counted.
+   MemoryUsage GetMemoryUsage() const;
+
+   /// Gets the memory and GDI objects held by all of the buttons in the process, counting each
+   /// shared object (and each string buffer that copies of a string share) only once, along with
+   /// the color table indexes that are cached for reuse, and the cache of rendered faces. If the
+   /// shared memory grows along with the number of buttons that display the same table, then the
+   /// table is being copied, rather than shared. This reads every button, so it must not be called
+   /// while any of them is being changed (call it on the thread that owns them).
+   static MemoryUsage GetProcessMemoryUsage();
+
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
    static constexpr size_t                       kcColorTableMax            = std::numeric_limits<decltype(LOGPALETTE().palNumEntries)>::max();
    static constexpr size_t                       kcColorTableDefault        = 48;
    static const     std::pair<COLORREF, CString> kColorTableDefault[kcColorTableDefault];
    static constexpr size_t                       kcColorTableColumnsDefault = 8;
+   static constexpr SIZE                         kszColorSwatch             = { 18, 18 };  // size of each swatch in the pop-up window
 
-   /// Gets the table of color swatches displayed in the color picker pop-up window.
-   const std::vector<std::pair<COLORREF, CString>>& GetColorTable() const;
+   /// Gets a copy of the table of color swatches displayed in the color picker pop-up window.
+   /// (A table that is not held as CStrings, such as a palette file or a static table, is built
+   /// anew by each call, and is not kept, so this is best avoided when displaying a large table.)
+   std::vector<std::pair<COLORREF, CString>> GetColorTable() const;
 
    /// Gets the number of rows and columns of color swatches
    /// displayed in the color picker pop-up window.
@@ -191,6 +384,122 @@ public:
                       size_t          cColors,
                       size_t          cColumns = kcColorTableColumnsDefault);
 
+   /// Sets the table of color swatches displayed in the color picker pop-up window to the
+   /// specified colors, with names that are only resolved when they are displayed (see
+   /// ColorNameTable), so that nothing is stored for each entry but its color.
+   /// (GetColorTable() still works, but it must resolve every name each time that it is
+   /// called, so it is best avoided when displaying a large table.)
+   void SetColorTable(std::vector<COLORREF>                 colors,
+                      std::shared_ptr<const ColorNameTable> pColorNames,
+                      size_t                                cColumns = kcColorTableColumnsDefault);
+
+   /// Sets the table of color swatches displayed in the color picker pop-up window to the
+   /// contents of a palette file, which are used in place, without being copied. If the file
+   /// does not specify a number of columns, then the default number of columns is used.
+   /// (GetColorTable() still works, but it must make a copy of the table each time that
+   /// it is called, so it is best avoided when displaying a large palette file.)
+   void SetColorTable(std::shared_ptr<const PaletteFile> pPaletteFile);
+
+   /// Sets the table of color swatches displayed in the color picker pop-up window to the table
+   /// loaded by a palette source, and keeps it up to date whenever the source's file is changed.
+   /// Each change is applied as a diff, which only touches the entries that changed. (Changes
+   /// that arrive while the pop-up window is open are applied once it closes.) If the palette
+   /// does not specify a number of columns, then the default number of columns is used.
+   void SetColorTable(std::shared_ptr<PaletteSource> pPaletteSource);
+
+   /// Sets the table of color swatches displayed in the color picker pop-up window to the current
+   /// table of a shared palette store, which is used in place, in the memory that it shares with
+   /// every other process displaying it. The button follows the store, adopting the table most
+   /// recently published to it the next time that it paints or opens its pop-up window (so call
+   /// Invalidate() to have it check). Until a table has been published, the color table is empty.
+   void SetColorTable(std::shared_ptr<const SharedPaletteStore> pPaletteStore);
+
+   /// Sets the table of color swatches displayed in the color picker pop-up window to a table
+   /// that was built at compile time, which is used in place, without being copied, and with
+   /// its precomputed lookup index and layout. The table must have static storage duration.
+   /// (As with a palette file, GetColorTable() must make a copy of the table.)
+   void SetColorTable(const StaticColorTableData& staticColorTable);
+
+   /// Sets the table of color swatches displayed in the color picker pop-up window to a table
+   /// that was built at compile time (see StaticColorTable.hpp).
+   template <size_t N, size_t Columns>
+   void SetColorTable(const StaticColorTable<N, Columns>& staticColorTable)
+   {
+      this->SetColorTable(staticColorTable.GetData());
+   }
+
+   /// Publishes a table of color swatches to be displayed in the color picker pop-up window.
+   /// Unlike SetColorTable(), this may be called from any thread (for example, the worker thread
+   /// that computed the table), and it does all of the work of preparing the table (building
+   /// its palette and its lookup index) on that thread. The button adopts the most recently
+   /// published table, which is shared rather than copied, the next time that it paints or
+   /// opens its pop-up window. An open pop-up window keeps displaying the table that it
+   /// opened with, and a table that is superseded before it is adopted is freed by whichever
+   /// thread lets go of it last. (The button must not be destroyed while it is being published to.)
+   void PublishColorTable(std::shared_ptr<const ColorTable> pColorTable,
+                          size_t                            cColumns = kcColorTableColumnsDefault);
+
+   /// Inserts an entry into the color table at the specified index (which may be the number
+   /// of entries, to append it). Like the other edits below, this only touches the entries of
+   /// the palette, the lookup index, and the display order that it affects, so its cost is
+   /// proportional to the size of the change, rather than to the size of the table. (A palette
+   /// file or a static table is copied the first time it is edited, and a table that was set
+   /// from a palette source or a shared palette store stops following it.)
+   void InsertColor(size_t index, COLORREF clr, CString strName = CString());
+
+   /// Removes the specified entry from the color table.
+   void RemoveColor(size_t index);
+
+   /// Changes the color of the specified entry in the color table.
+   void UpdateColor(size_t index, COLORREF clr);
+
+   /// Changes the name (the tooltip text) of the specified entry in the color table.
+   void RenameColor(size_t index, CString strName);
+
+   /// Gets a number that changes whenever the color table changes (whether it is replaced or
+   /// edited), for use as the key of anything that an application caches about the table.
+   UINT GetColorTableVersion() const;
+
+   /// Gets the index of the entry in the color table whose color is nearest to the
+   /// specified RGB color, or -1 if the color table is empty.
+   int GetNearestColorIndex(COLORREF clr) const;
+
+   /// Gets the index of the first entry in the color table whose color is exactly the
+   /// specified color, or -1 if there is no such entry.
+   int FindColorIndex(COLORREF clr) const;
+
+   /// Describes the regular structure, if any, that was detected in the color table when it was set.
+   /// Lookups into structured color tables are computed directly, rather than searched for.
+   enum class ColorTableStructure
+   {
+      Irregular,  ///< no regular structure
+      Lattice,    ///< every combination of some set of red, green, and blue levels (e.g., a 6x6x6 cube)
+      GrayRamp,   ///< distinct shades of gray
+   };
+
+   /// Gets the structure that was detected in the current color table.
+   ColorTableStructure GetColorTableStructure() const;
+
+
+   /// Specifies the order in which the entries in the color table are displayed in the color
+   /// picker pop-up window (which is also the order in which the arrow keys move between them).
+   /// Sorting only affects the display; the indices of the entries in the color table never change.
+   enum class ColorTableOrder
+   {
+      TableOrder,       ///< the order of the entries in the color table (the default)
+      HueBands,         ///< grays, followed by bands of similar hue, each from light to dark
+      Hilbert,          ///< along a Hilbert curve through OKLab space, keeping similar colors together
+      NearestNeighbor,  ///< a chain that repeatedly steps to the most similar remaining color
+   };
+
+   /// Gets the order in which the entries in the color table are displayed.
+   ColorTableOrder GetColorTableOrder() const;
+
+   /// Sets the order in which the entries in the color table are displayed.
+   /// (The sorted order is computed when it is first needed, and then cached
+   /// until either the order or the color table is changed.)
+   void SetColorTableOrder(ColorTableOrder order);
+
 
 private:
 
@@ -204,6 +513,96 @@ private:
    /// based on the current color table.
    void SetPaletteFromColorTable();
 
+   /// Gets the display order of the current color table, in the current sort order,
+   /// computing it if it is not already cached.
+   const DisplayOrder& GetDisplayOrder();
+
+   /// Gets the index of the names in the current color table, for the pop-up window's
+   /// typeahead search, building it if it is not already cached.
+   const NameSearchIndex& GetNameSearchIndex();
+
+   /// Gets whether any entry in the current color table has a name (so that typing a letter in
+   /// the pop-up window searches the names), without building the name search index. A table
+   /// whose names are resolved lazily is taken to have names, since finding out would resolve them.
+   bool HasColorNames() const;
+
+   /// Gets whether GetDisplayOrder() or GetNameSearchIndex() would have to rebuild what it
+   /// returns (for recording, once per pop-up session, whether the cache was up to date).
+   bool IsDisplayOrderStale() const;
+   bool IsNameSearchIndexStale() const;
+
+   /// Gets the number of entries in the current color table.
+   size_t GetColorCount() const;
+
+   /// Gets the color of the specified entry in the current color table.
+   COLORREF GetColorAt(size_t index) const;
+
+   /// Gets the name of the specified entry in the current color table
+   /// (resolving it, if the table's names are resolved lazily).
+   CString GetColorNameAt(size_t index) const;
+
+   /// Gets the index for the current color table, acquiring it first if it was deferred
+   /// (which it is for static color tables, since most buttons never need it).
+   const ColorTableIndex* GetColorTableIndex() const;
+
+   /// Applies a diff to the color table (which must be held in m_colorTable), updating only
+   /// the entries of the palette, the index, and the display order that it touches.
+   void ApplyColorTableDiff(const std::shared_ptr<const ColorTableDiff>& pDiff);
+
+   /// Prepares the color table to be edited, by copying a palette file, a static table, or a
+   /// table with lazily-resolved names into m_colorTable, and by detaching it from its palette
+   /// source or store, if any.
+   void PrepareColorTableForEdit();
+
+   /// Applies a single edit that was made through the public editing functions.
+   void EditColorTable(ColorTableDiff diff);
+
+   /// Stops following the palette source or store, if any, that the color table was set from, and
+   /// discards any table that was published, but not yet adopted, since it is being replaced.
+   void DetachColorTableSources();
+
+   /// Records the latency of an input to the pop-up window, in microseconds.
+   void RecordInputLatency(InputLatencyType type, UINT32 latency);
+
+   /// Adopts the most recently published color table, if any (unless the pop-up window is open).
+   void AdoptPublishedColorTable();
+
+   /// Adopts the current table of the shared palette store that the color table was set from,
+   /// if it has changed (unless the pop-up window is open).
+   void AdoptPaletteStoreTable();
+
+   /// Called by the palette source that the color table was set from when its table changes,
+   /// with the diff from the previous table, or null if the table was replaced.
+   void OnPaletteSourceChanged(const std::shared_ptr<const ColorTableDiff>& pDiff);
+
+   /// Applies the changes from the palette source that arrived while the pop-up window was open.
+   void ApplyDeferredSourceChanges();
+
+   /// Counts the memory and GDI objects held by the button (see GetMemoryUsage).
+   void CountMemoryUsage(MemoryUsageCounter& counter) const;
+
+   /// Draws the face of the button, in the specified state (see ButtonFaceCache), filling
+   /// the transparent parts of a themed face with the specified brush.
+   void DrawFace(HDC hDC, const RECT& rcItem, UINT state, HBRUSH hbrBackground);
+
+   /// Invalidates the button after a change to its color, or, during a batch update,
+   /// has it invalidated when the batch ends.
+   void RepaintColor();
+
+   /// Notifies the parent that the color changed from the specified color, or, during a batch
+   /// update, has it notified when the batch ends.
+   void NotifyColorChanged(COLORREF clrPrevious);
+
+   /// Adds the button to the batch update in progress on the calling thread, if it is not in it already.
+   void JoinBatch();
+
+   /// Repaints and notifies for the buttons in the batch update that has just ended on the calling thread.
+   static void EndBatch();
+
+   friend class PaletteSource;
+
+   class ColorPickerPopup;
+
 private:
 
    /// Sends a notification message to the parent dialog.
@@ -219,28 +618,59 @@ protected:
    virtual void DrawItem(LPDRAWITEMSTRUCT pDIS) override;
 
    DECLARE_MESSAGE_MAP()
-   afx_msg void OnMouseMove(UINT nFlags, CPoint point);
-   afx_msg void OnMouseLeave();
-   afx_msg void OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
-   afx_msg void OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
-   afx_msg void OnBnClicked();
+   afx_msg BOOL    OnEraseBkgnd(CDC* pDC);
+   afx_msg LRESULT OnThemeChanged();
+   afx_msg void    OnSysColorChange();
+   afx_msg void    OnSettingChange(UINT uFlags, LPCTSTR pszSection);
+   afx_msg void    OnMouseMove(UINT nFlags, CPoint point);
+   afx_msg void    OnMouseLeave();
+   afx_msg void    OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
+   afx_msg void    OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
+   afx_msg void    OnBnClicked();
 
 
 private:
 
-   COLORREF                                  m_clrCurrent;         // current color
-   COLORREF                                  m_clrDefault;         // default/automatic color
-   size_t                                    m_cColumns;
-   std::vector<std::pair<COLORREF, CString>> m_colorTable;
-   CPalette                                  m_palette;
-   CString                                   m_strDefaultText;     // default/automatic text
-   CString                                   m_strCustomText;      // custom color text
-   bool                                      m_showDefault;        // true if showing default/automatic option
-   bool                                      m_showCustom;         // true if showing custom option
-   bool                                      m_showTooltips;       // true if showing tooltips
-   bool                                      m_trackSelection;     // true if tracking selection
-   bool                                      m_isPopupActive;      // true if popup active
-   bool                                      m_isMouseOver;        // true if the mouse is over
+   COLORREF                                           m_clrCurrent;            // current color
+   COLORREF                                           m_clrDefault;            // default/automatic color
+   std::unique_ptr<ColorTablePublishSlot>             m_pPublishSlot;          // holds the table published by PublishColorTable(), until it is adopted
+   size_t                                             m_cColumns;
+   std::vector<std::pair<COLORREF, CString>>          m_colorTable;
+   std::vector<COLORREF>                              m_colors;                // the colors of a table whose names are resolved lazily
+   std::shared_ptr<const ColorNameTable>              m_pColorNames;           // if non-null, names m_colors, which is used instead of m_colorTable
+   std::shared_ptr<const PaletteFile>                 m_pPaletteFile;          // if non-null, used instead of m_colorTable
+   const StaticColorTableData*                        m_pStaticColorTable;     // if non-null, used instead of m_colorTable
+   std::shared_ptr<PaletteSource>                     m_pPaletteSource;        // if non-null, keeps m_colorTable up to date
+   std::shared_ptr<const SharedPaletteStore>          m_pPaletteStore;         // if non-null, keeps m_pPaletteFile up to date
+   UINT64                                             m_storeGeneration;       // generation of the store's table in m_pPaletteFile
+   std::shared_ptr<const ColorTable>                  m_pSharedColorTable;     // if non-null, used instead of m_colorTable (adopted from PublishColorTable())
+   std::vector<std::shared_ptr<const ColorTableDiff>> m_deferredDiffs;         // changes from the source while the pop-up window was open (null for a replacement)
+   CPalette                                           m_palette;
+   mutable std::shared_ptr<const ColorTableIndex>     m_pColorTableIndex;      // answers lookups into the color table (acquired on demand for a static table)
+   UINT                                               m_colorTableVersion;     // incremented whenever the color table changes
+   ColorTableOrder                                    m_colorTableOrder;
+   std::shared_ptr<const DisplayOrder>                m_pDisplayOrder;         // cached display order (may be stale)
+   std::shared_ptr<const NameSearchIndex>             m_pNameSearchIndex;      // cached index of the names, for typeahead search (may be stale)
+   CString                                            m_strDefaultText;        // default/automatic text
+   CString                                            m_strCustomText;         // custom color text
+   bool                                               m_showDefault;           // true if showing default/automatic option
+   bool                                               m_showCustom;            // true if showing custom option
+   bool                                               m_showTooltips;          // true if showing tooltips
+   bool                                               m_trackSelection;        // true if tracking selection
+   bool                                               m_isPopupActive;         // true if popup active
+   bool                                               m_isMouseOver;           // true if the mouse is over
+   std::optional<bool>                                m_isThemed;              // true if drawn with the visual styles (unknown until first drawn, and after the theme changes)
+   std::optional<COLORREF>                            m_clrParentBackground;   // the color of the parent's brush, behind a themed face (CLR_NONE if not solid; unknown until first drawn, and after the button is erased or the theme or colors change)
+   std::shared_ptr<TraceSink>                         m_pTraceSink;            // receives the timings of the pop-up window's phases
+   std::unique_ptr<LatencyHistogram>                  m_pInputLatencies[2];    // for each InputLatencyType (allocated when first recorded)
+   PaintCounters                                      m_paintCounters;
+   std::shared_ptr<StatsPage>                         m_pStatsPage;            // if non-null, receives live statistics
+   std::shared_ptr<InputRecorder>                     m_pInputRecorder;        // if non-null, receives a log of each session of input
+   const ColorPickerPopup*                            m_pActivePopup;          // the pop-up window, while it is open (for GetMemoryUsage)
+   bool                                               m_isInBatch;             // true if in the thread's batch update (see BatchUpdate)
+   bool                                               m_isRepaintDeferred;     // true if to be invalidated when the batch update ends
+   bool                                               m_isNotifyDeferred;      // true if to notify the parent when the batch update ends,
+   COLORREF                                           m_clrBeforeBatch;        //   of the change from this color
 
    // ---------------------------
    // ColorPickerPopup class
@@ -262,8 +692,38 @@ private:
       /// Returns true if a new color was selected, or false if the user canceled the picker.
       bool Open();
 
+      /// Displays the color picker pop-up window and replays the inputs of a session that was
+      /// recorded from it (see ColorPickerButton::ReplayInput), in place of the user's.
+      InputReplayResult Replay(const InputLog& log);
+
    private:
 
+      /// Implements Open() and Replay(): if a log is specified, its inputs are replayed,
+      /// and its result is filled in; otherwise, messages are pumped.
+      bool Run(const InputLog* pReplayLog, InputReplayResult* pReplayResult);
+
+      /// Handles an input, whether it was received from the message loop or from a log.
+      /// This is the only way into the selection process (see ColorPickerSelection, which keeps
+      /// its state, and which this drives), which otherwise only depends on the button's
+      /// configuration, so a session can be replayed exactly. Inputs that it does not handle
+      /// are dropped.
+      void HandleInput(const InputEvent& event);
+
+      /// Handles a key pressed with Alt, or F10 (WM_SYSKEYDOWN), for HandleInput.
+      void HandleSysKeyDown(UINT nChar, UINT nFlags);
+
+      /// Handles a key press (WM_KEYDOWN), for HandleInput.
+      void HandleKeyDown(UINT nChar);
+
+      /// Handles a character (WM_CHAR), for HandleInput.
+      void HandleChar(UINT nChar);
+
+      /// Gets the outcome of the selection process, once the pop-up window has closed.
+      InputOutcome GetOutcome() const;
+
+      /// Counts the memory held by the pop-up window's session (see ColorPickerButton::GetMemoryUsage).
+      void CountMemoryUsage(MemoryUsageCounter& counter) const;
+
       /// Registers the window class for the color picker pop-up window.
       static bool Register();
 
@@ -271,36 +731,61 @@ private:
       static bool Unregister();
 
 
-      /// Closes the color picker pop-up window, ends the selection process,
-      /// and updates the currently-selected color.
-      void Close();
+      /// Maps the specified index to a color value.
+      COLORREF ColorFromIndex(int index) const;
 
-      /// Closes the color picker pop-up window, ends the selection process,
-      /// and restores the previously-selected color.
-      void Cancel();
+      /// Maps the specified color to the index of the option that it is chosen with:
+      /// the default option, its swatch, or the custom option (or the invalid color index).
+      int IndexFromColor(COLORREF clr) const;
 
 
-      /// Do a hit-test, converting the specified point inside of the color picker pop-up window
-      /// into the index of a color cell or the invalid color index.
-      int HitTest(const POINT& pt) const;
+      /// Shows a change of the current selection: repaints the pop-up window, and sets the
+      /// button's color, if it is tracking the selection.
+      void ShowSelection();
 
 
-      /// Maps the specified index to a color value.
-      COLORREF ColorFromIndex(int index) const;
+      /// Gets the button's trace sink, if any (for the timers).
+      TraceSink* GetTraceSink() const;
+
+      /// Notes that an input of the specified kind, received at the specified time, has just been
+      /// handled, so that its latency is recorded when the window finishes painting the result.
+      /// (If it did not invalidate the window, there is no result to wait for.) The input is also
+      /// counted in the button's stats page, if it has one.
+      void TrackInputLatency(InputLatencyType type, double received);
+
+      /// Records an input for the button's input recorder, in the session's arena.
+      void RecordInput(const InputEvent& event);
+
+
+      /// Moves the tooltip's tool onto the specified swatch (or off of every swatch, for an invalid
+      /// index), as the mouse moves over them. (A single tool that follows the mouse is used,
+      /// rather than one for each swatch, so that opening the window adds only one.)
+      void UpdateToolTip(int index);
+
+      /// Gets the text of the tooltip for the specified swatch: its name, in place if the table
+      /// holds it as a string, or copied into the session's arena if not.
+      LPCTSTR GetToolTipText(size_t index);
+
 
+      /// Selects the default or custom option, if the specified key is its accelerator.
+      /// Returns true if it was.
+      bool HandleAccelerator(UINT nChar);
 
-      /// Set the currently-selected color in the color picker pop-up window to the specified index.
-      void ChangeSelection(int index);
+      /// Returns whether the table has names for a typeahead query to search, in which case
+      /// letters go to the query, and the accelerators need the Alt key.
+      bool HasTypeaheadNames();
 
-      /// Set the currently-selected color in the color picker pop-up window to the specified color.
-      void ChangeSelectionToColor(COLORREF clr);
+      /// Returns whether a typeahead query is being typed: one has been started,
+      /// and typing has not paused for long enough to start a new one.
+      bool IsTypingTypeahead() const;
 
-      void ChangeSelectionByOffset(int offset);
+      /// Looks up the names that match the typeahead query, and selects the best match.
+      void UpdateTypeaheadMatches();
 
+      /// Moves the selection by the specified offset in the list of the typeahead query's matches,
+      /// wrapping around at either end.
+      void ChangeTypeaheadMatch(int offset);
 
-      /// Retrieve the dimensions of the specified cell in the color picker pop-up window,
-      /// if the specified index is valid.
-      std::optional<RECT> GetSwatchRect(int index) const;
 
       struct PaintSwatchInfo
       {
@@ -336,24 +821,36 @@ private:
 
    protected:
       DECLARE_MESSAGE_MAP()
-      afx_msg void    OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
-      afx_msg void    OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
-      afx_msg void    OnLButtonDown(UINT nFlags, CPoint point);
-      afx_msg void    OnMouseMove(UINT nFlags, CPoint point);
       afx_msg void    OnPaint();
       afx_msg LRESULT OnPrintClient(WPARAM wParam, LPARAM lParam);
       afx_msg BOOL    OnQueryNewPalette();
       afx_msg void    OnPaletteChanged(CWnd* pFocusWnd);
+      afx_msg BOOL    OnToolTipGetDispInfo(UINT id, NMHDR* pNMHDR, LRESULT* pResult);
 
    private:
-      ColorPickerButton& m_wndColorPickerBtn;
-      const CSize        m_szMargins;      // margins for the color picker window
-      CRect              m_rcDefaultText;  // rectangle for the default/automatic text
-      CRect              m_rcCustomText;   // rectangle for the custom text
-      CRect              m_rcSwatches;     // rectangle for the color swatches
-      COLORREF           m_clrOriginal;    // the originally-selected color when the picker window is opened
-      int                m_iCurrentColor;  // index of the current selection in the picker window
-      int                m_iChosenColor;   // index of the user's original/final selection in the picker window
-      bool               m_okayed;         // true if the picker was OKed; false if it was canceled
+      ColorPickerButton&                    m_wndColorPickerBtn;
+      const CSize                           m_szMargins;      // margins for the color picker window
+      COLORREF                              m_clrOriginal;    // the originally-selected color when the picker window is opened
+      std::unique_ptr<ColorPickerSelection> m_pSelection;     // the layout, the current and chosen options, and whether okayed
+      bool                                  m_usePaletteIndices;  // true if painting to a palette device
+      std::unique_ptr<SessionArena>         m_pArena;             // transient data of the session, which is all freed when it ends
+      std::shared_ptr<const DisplayOrder>   m_pDisplayOrder;      // the button's display order, as of when the window opened
+      CToolTipCtrl                          m_toolTip;
+      int                                   m_iToolTipColor;      // index of the swatch that the tooltip's tool is on
+      CString                               m_strTypeahead;       // what has been typed so far, to search the names for
+      DWORD                                 m_typeaheadTime;      // tick count when the last character was typed
+      std::vector<size_t>                   m_typeaheadMatches;   // indices of the entries that match m_strTypeahead, best first
+      size_t                                m_iTypeaheadMatch;    // position of the selected entry in m_typeaheadMatches
+      std::optional<bool>                   m_hasTypeaheadNames;  // whether the table has names to search (unknown until a key needs it)
+      bool                                  m_isNameIndexCounted; // true once the lookup of the name search index has been recorded
+                                                                  //   in the stats page (or from the start, in a replay, which records none)
+      double                                m_inputsReceived[2];  // for each InputLatencyType, when the earliest input that
+                                                                  //   is waiting to be painted was received (0 if none is)
+      DWORD                                 m_inputTime;          // \ when the input being handled was received, and whether
+      bool                                  m_isShiftDown;        // /   Shift was down (from the input, so that a replay is exact)
+      bool                                  m_isTakingInput;      // true while inputs are being handled (which should never allocate)
+      InputEvent*                           m_pRecordedInputs;    // \ the inputs recorded so far (in the arena), if the
+      size_t                                m_cRecordedInputs;    //  | button has an input recorder
+      size_t                                m_cRecordedInputsMax; // /
    };
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+/// A list of edits that turns one color table into another, so that a change to a large table
+/// can be applied by touching only the entries that changed (see PaletteSource).
+///
+/// The edits are applied in order, and the index of each one refers to the table as it stands
+/// when that edit is applied (that is, after all of the edits before it), which is also how
+/// they would be made by hand.
+class ColorTableDiff
+{
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   enum class Operation
+   {
+      Insert,   ///< insert a new entry (with the color and name of the edit) at the index
+      Remove,   ///< remove the entry at the index
+      Recolor,  ///< change the color of the entry at the index
+      Rename,   ///< change the name of the entry at the index
+   };
+
+   struct Edit
+   {
+      Operation operation;
+      size_t    index;
+      COLORREF  clr;      ///< the new color (for Insert and Recolor)
+      CString   strName;  ///< the new name (for Insert and Rename)
+   };
+
+   /// The default limit on the size of a computed diff, beyond which
+   /// it is cheaper to replace the table than to edit it.
+   static constexpr size_t kcEditsMaxDefault = 256;
+
+   /// Computes a minimal diff between two tables, treating entries as equal only if both their
+   /// colors and their names are equal, and expressing a removal followed by an insertion at the
+   /// same index as a recolor and/or a rename. Tables that only differ in a few places are compared
+   /// in time proportional to their length, plus the square of the number of edits. Returns
+   /// std::nullopt if more than the specified number of edits would be required.
+   static std::optional<ColorTableDiff> Compute(const ColorTable& tableFrom,
+                                                const ColorTable& tableTo,
+                                                size_t            cEditsMax = kcEditsMaxDefault);
+
+
+   /// Creates an empty diff.
+   ColorTableDiff() = default;
+
+   /// Appends an edit that inserts an entry.
+   void Insert(size_t index, COLORREF clr, CString strName);
+
+   /// Appends an edit that removes an entry.
+   void Remove(size_t index);
+
+   /// Appends an edit that changes the color of an entry.
+   void Recolor(size_t index, COLORREF clr);
+
+   /// Appends an edit that changes the name of an entry.
+   void Rename(size_t index, CString strName);
+
+
+   /// Gets whether the diff contains no edits.
+   bool IsEmpty() const;
+
+   /// Gets the edits, in the order in which they are to be applied.
+   const std::vector<Edit>& GetEdits() const;
+
+   /// Gets the change in the number of entries that results from applying the diff.
+   ptrdiff_t GetSizeChange() const;
+
+   /// Gets the number of bytes of memory that the diff holds, including itself.
+   size_t GetByteSize() const;
+
+   /// Applies the edits to a color table.
+   void ApplyTo(ColorTable& table) const;
+
+   /// Applies the edits to a list of colors (ignoring renames).
+   void ApplyTo(std::vector<COLORREF>& colors) const;
+
+private:
+   std::vector<Edit> m_edits;
+};
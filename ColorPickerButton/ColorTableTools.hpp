@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+
+/// Operations on color tables (in the form accepted by ColorPickerButton::SetColorTable())
+/// that are useful for cleaning up palettes that were imported or combined from several sources.
+///
+/// Colors are compared by their distance in the OKLab perceptual color space (delta E). Entries
+/// are clustered greedily, in table order: each entry joins the earliest preceding cluster whose
+/// first entry is within the threshold, or else starts a new cluster. Candidates are found by
+/// hashing colors onto a grid whose cells are as wide as the threshold, so only the entries in
+/// the 27 neighboring cells ever have to be compared, and the whole pass runs in near-linear time.
+class ColorTableTools
+{
+   ColorTableTools() = delete;  // not instantiable; all members are static
+
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   /// The default threshold for considering two colors to be duplicates. A difference of about
+   /// 0.02 in OKLab is roughly the smallest that can be noticed between two adjacent swatches.
+   static constexpr float kDeltaEThresholdDefault = 0.02f;
+
+   /// A set of entries that are near-duplicates of one another.
+   struct MergeGroup
+   {
+      size_t              iKept;     // index of the entry that is kept (always the first in the table)
+      std::vector<size_t> iMerged;   // indices of the later entries that are merged into it
+   };
+
+
+   /// Finds the groups of entries in a color table whose colors are within the specified threshold
+   /// of one another, without modifying the table. Entries that have no near-duplicates are not
+   /// reported. A threshold of zero finds only exact duplicates.
+   static std::vector<MergeGroup> FindNearDuplicates(const ColorTable& colorTable,
+                                                     float             deltaE = kDeltaEThresholdDefault);
+
+   /// Returns a copy of a color table with its near-duplicates merged. Each group is replaced by its
+   /// first entry, which keeps its position, color, and name; if that entry has no name, then
+   /// it takes the first non-empty name from the other entries in its group.
+   static ColorTable RemoveNearDuplicates(const ColorTable& colorTable,
+                                          float             deltaE = kDeltaEThresholdDefault);
+
+   /// Combines several color tables into one, in order, merging any entries that are within
+   /// the specified threshold of an earlier one (in the same table or in an earlier table).
+   /// Note that the result may be larger than ColorPickerButton::kcColorTableMax.
+   static ColorTable Merge(const std::vector<const ColorTable*>& colorTables,
+                           float                                 deltaE = kDeltaEThresholdDefault);
+};
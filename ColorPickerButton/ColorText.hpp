@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+
+/// Converts colors to and from the textual forms that are used by CSS (and, therefore, by most
+/// configuration files and clipboard payloads). The supported forms are:
+///  - hexadecimal notation: #rgb, #rgba, #rrggbb, and #rrggbbaa;
+///  - functional notation: rgb(), rgba(), hsl(), and hsla(), with their arguments separated by
+///    commas or by spaces (with a slash before the alpha), and given as numbers or percentages;
+///  - the CSS named colors (other than "transparent").
+/// Parsing is not case-sensitive. Since COLORREF values have no alpha channel, an alpha
+/// component is checked for syntax, but is otherwise ignored.
+///
+/// Both narrow (ASCII or UTF-8) and wide strings are accepted, and lists of thousands of colors
+/// can be converted at once. On x86 and x64, the digits of hexadecimal colors are validated
+/// and decoded 8 characters at a time with SSE2. Named colors are found through a perfect hash,
+/// whose table is built (and checked to be collision-free) at compile time.
+class ColorText
+{
+   ColorText() = delete;  // not instantiable; all members are static
+
+public:
+
+   enum class Status
+   {
+      Ok,
+      Empty,         ///< there is no color where one was expected
+      BadHex,        ///< a '#' that is not followed by 3, 4, 6, or 8 hexadecimal digits
+      BadFunction,   ///< an unknown function, or a bad argument list (numbers, units, separators, or parentheses)
+      UnknownName,   ///< a word that is not the name of a CSS color
+      TrailingText,  ///< a color that is followed by something other than a separator
+   };
+
+   /// Describes a color in a list that could not be parsed.
+   struct Error
+   {
+      Status status;
+      size_t offset;  ///< offset of the start of the color from the start of the list, in characters
+   };
+
+   enum class Notation
+   {
+      Hex,   ///< #rrggbb
+      Rgb,   ///< rgb(r, g, b)
+      Hsl,   ///< hsl(h, s%, l%) (whole numbers, so this does not always round-trip exactly)
+      Name,  ///< the CSS name of the color, if it has one, or else #rrggbb
+   };
+
+
+   /// Parses a single color, which may be surrounded by whitespace.
+   static Status Parse(LPCWSTR pch, size_t cch, COLORREF* pclr);
+
+   /// Parses a single color, which may be surrounded by whitespace.
+   static Status Parse(LPCSTR pch, size_t cch, COLORREF* pclr);
+
+   /// Parses a list of colors that are separated by commas, semicolons, or whitespace (including
+   /// line breaks), and appends them to a vector. Colors that cannot be parsed are skipped (and
+   /// reported, if requested), so one bad entry does not prevent the rest of the list from being
+   /// read. Returns the number of colors that were appended.
+   static size_t ParseList(LPCWSTR                pch,
+                           size_t                 cch,
+                           std::vector<COLORREF>* pColors,
+                           std::vector<Error>*    pErrors = nullptr);
+
+   /// Parses a list of colors that are separated by commas, semicolons, or whitespace (including
+   /// line breaks), and appends them to a vector. Colors that cannot be parsed are skipped (and
+   /// reported, if requested), so one bad entry does not prevent the rest of the list from being
+   /// read. Returns the number of colors that were appended.
+   static size_t ParseList(LPCSTR                 pch,
+                           size_t                 cch,
+                           std::vector<COLORREF>* pColors,
+                           std::vector<Error>*    pErrors = nullptr);
+
+
+   /// Formats a color in the specified notation.
+   static CString Format(COLORREF clr, Notation notation = Notation::Hex);
+
+   /// Formats a list of colors in the specified notation, with the specified separator between them.
+   static CString FormatList(const COLORREF* pColors,
+                             size_t          cColors,
+                             Notation        notation     = Notation::Hex,
+                             LPCTSTR         pszSeparator = _T(", "));
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+
+
+/// An input handled by ColorPickerButton's pop-up window. Together, the inputs of a session are
+/// all that the pop-up window's state (its selection, and whether it was cancelled) depends on,
+/// besides the button's configuration, so a session can be replayed exactly.
+struct InputEvent
+{
+   enum class Type : BYTE
+   {
+      MouseMove,    ///< WM_MOUSEMOVE
+      LButtonDown,  ///< WM_LBUTTONDOWN
+      LButtonUp,    ///< WM_LBUTTONUP
+      KeyDown,      ///< WM_KEYDOWN
+      SysKeyDown,   ///< WM_SYSKEYDOWN
+      Char,         ///< WM_CHAR
+   };
+
+   Type   type;
+   bool   shift;   ///< whether Shift was down when the input was received
+   DWORD  time;    ///< when the input was received, in milliseconds (only the differences matter)
+   UINT32 wParam;  ///< \ as in the message (so, for mouse inputs, the point is
+   UINT32 lParam;  ///< /   in the pop-up window's client coordinates)
+};
+
+
+/// The state that a session of input left ColorPickerButton's pop-up window in.
+struct InputOutcome
+{
+   bool     okayed;  ///< true if a selection was made; false if the pop-up window was cancelled
+   bool     custom;  ///< true if the custom color option was selected (its dialog is not part of the session)
+   COLORREF clr;     ///< the color selected (CLR_DEFAULT for the default option) if okayed and not custom;
+                     ///<   otherwise, CLR_NONE
+};
+
+
+/// A log of one session of input to ColorPickerButton's pop-up window, from opening it to closing
+/// it: the color that it was opened with, each input that it handled, and the outcome. Logs are
+/// received from an InputRecorder, and replayed by ColorPickerButton::ReplayInput().
+///
+/// A log is saved in a compact binary format: a short header, then each input in a few bytes,
+/// with times and mouse positions stored as variable-length differences from the input before.
+class InputLog
+{
+public:
+
+   enum class Status
+   {
+      Ok,
+      IoError,      ///< the file could not be opened, read, or written
+      NotInputLog,  ///< the data is not a log of a compatible version, or it is truncated
+   };
+
+   InputLog();
+
+   COLORREF GetInitialColor() const;
+   void     SetInitialColor(COLORREF clr);
+
+   const InputOutcome& GetOutcome() const;
+   void                SetOutcome(const InputOutcome& outcome);
+
+   const std::vector<InputEvent>& GetEvents() const;
+
+   /// Appends an input to the log.
+   void Append(const InputEvent& event);
+
+   /// Discards the inputs, and resets the initial color and the outcome.
+   void Clear();
+
+
+   /// Encodes the log in the binary format.
+   std::vector<BYTE> Serialize() const;
+
+   /// Replaces the log with one decoded from the binary format.
+   /// On failure, the log is left unchanged.
+   Status Deserialize(const BYTE* pData, size_t cbData);
+
+   /// Writes the log to the specified file, replacing it.
+   Status Write(LPCTSTR pszPath) const;
+
+   /// Replaces the log with one read from the specified file.
+   /// On failure, the log is left unchanged.
+   Status Read(LPCTSTR pszPath);
+
+private:
+   COLORREF                m_clrInitial;
+   InputOutcome            m_outcome;
+   std::vector<InputEvent> m_events;
+};
+
+
+/// Receives a log of each session of input to ColorPickerButton's pop-up window.
+/// Pass one to ColorPickerButton::SetInputRecorder().
+class InputRecorder
+{
+public:
+
+   virtual ~InputRecorder() = default;
+
+   /// Called on the thread that owns the button, once the pop-up window has closed (before the
+   /// custom color dialog, if the custom color option was selected, is shown).
+   virtual void OnInputSession(const InputLog& log) = 0;
+};
+
+
+/// The result of replaying a session of input with ColorPickerButton::ReplayInput().
+struct InputReplayResult
+{
+   InputOutcome        outcome;
+   bool                matchesLog;  ///< whether the outcome is the one recorded in the log
+   std::vector<UINT32> eventCosts;  ///< for each input replayed, the time taken to handle it and to paint
+                                    ///<   the result, in microseconds (fewer than the log has if the pop-up
+                                    ///<   window closed before the last of them)
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+
+/// A color table stored in a binary palette file, which is designed to be used in place: the file
+/// is mapped into memory, checked, and then read directly, with no parsing and no copying. Names are
+/// stored as null-terminated UTF-16 strings, so they can be handed straight to Windows. Pass the
+/// object to ColorPickerButton::SetColorTable() to display the table without ever converting it.
+///
+/// A palette file contains a header (with a format version and a CRC-32 checksum), an array of
+/// colors, an array of offsets into a pool of names, and the pool itself. It may also contain a
+/// search index (the entries sorted by color, for exact lookups by binary search) and a precomputed
+/// display order (see ColorPickerButton::ColorTableOrder), both of which would otherwise have to
+/// be computed at run time. All values are little-endian.
+class PaletteFile
+{
+   PaletteFile           (const PaletteFile&) = delete;  // not copyable
+   PaletteFile& operator=(const PaletteFile&) = delete;  // not assignable
+
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   enum class Status
+   {
+      Ok,
+      IoError,             ///< the file could not be opened, read, mapped, or written
+      Truncated,           ///< the file is shorter than its header says it should be
+      BadMagic,            ///< the file is not a palette file
+      UnsupportedVersion,  ///< the file was written by an incompatible version of the format
+      BadChecksum,         ///< the file's contents do not match its checksum
+      Corrupt,             ///< the file's structure is invalid
+      TooManyColors,       ///< the file contains more than ColorPickerButton::kcColorTableMax colors
+   };
+
+   struct WriteOptions
+   {
+      size_t                             cColumns;            // preferred number of columns (0 for the default)
+      bool                               includeSearchIndex;  // true to include an index for exact lookups
+      ColorPickerButton::ColorTableOrder sortOrder;           // display order to precompute (TableOrder for none)
+   };
+
+   static constexpr size_t   kInvalidIndex = static_cast<size_t>(-1);
+   static constexpr UINT16   kVersionMajor = 1;  // changes whenever the format changes incompatibly
+   static constexpr UINT16   kVersionMinor = 0;  // changes whenever compatible additions are made
+
+   /// Returns the default options for writing a palette file: an index and no display order.
+   static WriteOptions DefaultWriteOptions();
+
+
+   /// Maps the specified palette file into memory and validates it, verifying its checksum
+   /// if requested. Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<const PaletteFile> Open(LPCTSTR pszPath,
+                                                  bool    verifyChecksum = true,
+                                                  Status* pStatus        = nullptr);
+
+   /// Validates a palette file that is already in memory (for example, one that was embedded
+   /// as a resource), and then refers to it in place. The memory must outlive the returned object.
+   /// Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<const PaletteFile> FromMemory(const void* pData,
+                                                        size_t      cbData,
+                                                        bool        verifyChecksum = true,
+                                                        Status*     pStatus        = nullptr);
+
+   /// Checks whether the specified memory contains a valid palette file. In addition to the
+   /// header and the checksum, this checks that every section lies within the file, that every
+   /// name is terminated, and that the search index and display order (if any) are well-formed,
+   /// so that none of the accessors below can read out of bounds.
+   static Status Validate(const void* pData, size_t cbData, bool verifyChecksum = true);
+
+
+   /// Serializes a color table to the palette file format.
+   static std::vector<BYTE> Serialize(const ColorTable& colorTable, const WriteOptions& options);
+
+   /// Serializes a color table and writes it to the specified file, replacing any existing file.
+   static Status Write(LPCTSTR pszPath, const ColorTable& colorTable, const WriteOptions& options);
+
+
+   ~PaletteFile();
+
+   /// Gets the number of colors in the table.
+   size_t GetColorCount() const;
+
+   /// Gets the preferred number of columns for displaying the table, or 0 if there is no preference.
+   size_t GetColumnCount() const;
+
+   /// Gets the colors in the table, as a contiguous array of GetColorCount() elements.
+   const COLORREF* GetColors() const;
+
+   /// Gets the color of the specified entry.
+   COLORREF GetColor(size_t index) const;
+
+   /// Gets the name of the specified entry, as a null-terminated string.
+   LPCWSTR GetName(size_t index) const;
+
+   /// Gets the length of the name of the specified entry, in characters (not counting the terminator).
+   size_t GetNameLength(size_t index) const;
+
+   /// Gets whether the file contains a search index.
+   bool HasSearchIndex() const;
+
+   /// Finds the first entry with exactly the specified color, using the search index if the file
+   /// has one, or a linear search otherwise. Returns kInvalidIndex if there is no such entry.
+   size_t FindColor(COLORREF clr) const;
+
+   /// Gets the display order that was precomputed for the file, or TableOrder if there is none.
+   ColorPickerButton::ColorTableOrder GetSortOrder() const;
+
+   /// Gets the precomputed display order (the index of the entry displayed at each position),
+   /// as an array of GetColorCount() elements, or null if there is none.
+   const UINT16* GetSortedIndices() const;
+
+   /// Gets the color table in the form used by ColorPickerButton::GetColorTable(). This is the only
+   /// accessor that copies anything; the copy is made the first time it is called, and then kept.
+   const ColorTable& GetColorTable() const;
+
+   /// Gets the number of bytes of heap memory that the object holds, including itself and the
+   /// copy of the color table, if one has been made (but not the file's contents; see GetMappedSize).
+   size_t GetByteSize() const;
+
+   /// Gets the number of bytes of the view of the file (or of the shared section) that the object
+   /// has mapped into memory, or 0 if it refers to memory that is not its own (see FromMemory).
+   size_t GetMappedSize() const;
+
+private:
+
+   friend class SharedPaletteStore;  // (which maps its sections itself)
+
+   PaletteFile(const BYTE* pData, size_t cbData, bool isMapped);
+
+private:
+   const BYTE*                  m_pData;
+   size_t                       m_cbData;
+   bool                         m_isMapped;         // true if this object owns a mapped view (of a file or a shared section)
+   mutable std::once_flag       m_materializeOnce;
+   mutable ColorTable           m_colorTable;       // materialized on demand
+   mutable std::atomic<bool>    m_isMaterialized;   // true once m_colorTable is materialized
+};
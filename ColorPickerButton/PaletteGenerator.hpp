@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+
+/// Reduces an image to a small set of representative colors, producing a color table
+/// (complete with generated names) that is ready to pass to ColorPickerButton::SetColorTable().
+///
+/// The input is first sampled (so that the cost is bounded regardless of the image size)
+/// and pre-binned into a 15-bit RGB histogram. The populated histogram bins are then
+/// clustered in the OKLab perceptual color space: the initial clusters come from either
+/// median cut or k-means++ seeding, and are then refined with weighted k-means iterations.
+/// Both the binning and the k-means assignment/reduction steps run in parallel.
+class PaletteGenerator
+{
+   PaletteGenerator() = delete;  // not instantiable; all members are static
+
+public:
+
+   enum class Seeding
+   {
+      MedianCut,       // deterministic; splits the boxes with the largest error along their widest axis
+      KMeansPlusPlus,  // randomized (with a fixed seed, so still reproducible); favors outlier colors
+   };
+
+   struct Options
+   {
+      size_t   cColors;      // the maximum number of colors to generate (at most kcColorTableMax)
+      Seeding  seeding;      // how the initial clusters are chosen
+      unsigned cIterations;  // the maximum number of k-means refinement passes (0 disables refinement)
+      size_t   cSamplesMax;  // the maximum number of pixels to sample from the input
+   };
+
+   static constexpr size_t   kcColorsDefault      = 48;
+   static constexpr unsigned kcIterationsDefault  = 8;
+   static constexpr size_t   kcSamplesMaxDefault  = 4 * 1024 * 1024;
+
+   /// Returns the default options for generating a palette of the specified size.
+   static Options DefaultOptions(size_t cColors = kcColorsDefault);
+
+
+   /// Generates a color table from a buffer of 32-bit pixels (as from a DIB section).
+   /// The alpha channel (rgbReserved) is ignored.
+   static std::vector<std::pair<COLORREF, CString>> FromPixels(const RGBQUAD* pPixels,
+                                                               size_t         cPixels,
+                                                               const Options& options);
+
+   /// Generates a color table from a device-dependent or device-independent bitmap.
+   /// The bitmap must not be selected into a device context.
+   /// Returns an empty table if the bitmap's bits could not be retrieved.
+   static std::vector<std::pair<COLORREF, CString>> FromBitmap(HBITMAP        hBitmap,
+                                                               const Options& options);
+};
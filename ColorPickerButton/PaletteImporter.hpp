@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+
+/// Reads palettes that were saved by other graphics programs, producing a color table that is
+/// ready to pass to ColorPickerButton::SetColorTable(). The supported formats are:
+///  - GIMP palettes (.gpl), which are UTF-8 text and include names;
+///  - Adobe Color Swatch files (.aco), version 1 (unnamed) and version 2 (named);
+///  - Adobe Swatch Exchange files (.ase), whose groups are flattened into a single table;
+///  - JASC (Paint Shop Pro) palettes (.pal), which are text and have no names.
+///
+/// The importer is a streaming parser: the input is fed to it in chunks of any size (for example,
+/// as it is read from a file), and each chunk is parsed as far as possible, with only an incomplete
+/// line or record held back until the next chunk arrives. The colors are kept in a single array,
+/// and the names in a single pool of null-terminated UTF-16 strings, so nothing is allocated per
+/// entry; an importer can also be reset and reused, to keep its buffers. Colors described in other
+/// models (CMYK, HSB, Lab, and grayscale) are converted to sRGB.
+///
+/// Malformed input never throws. Parsing stops at the first error, which is reported by status
+/// code, along with the offset in the input at which it was detected.
+class PaletteImporter
+{
+   PaletteImporter           (const PaletteImporter&) = delete;  // not copyable
+   PaletteImporter& operator=(const PaletteImporter&) = delete;  // not assignable
+
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   enum class Format
+   {
+      Unknown,  ///< detect the format from the first few bytes of the input
+      Gpl,
+      Aco,
+      Ase,
+      JascPal,
+   };
+
+   enum class Status
+   {
+      Ok,
+      IoError,              ///< the file could not be opened or read
+      UnknownFormat,        ///< the input is not in any of the supported formats
+      UnsupportedVersion,   ///< the input is in a version of its format that is not supported
+      UnsupportedColor,     ///< the input describes a color in a model that cannot be converted (such as a spot color library)
+      Malformed,            ///< the input does not follow its format
+      Truncated,            ///< the input ended in the middle of the palette
+      TooManyColors,        ///< the input contains more than ColorPickerButton::kcColorTableMax colors
+   };
+
+   /// Determines the format of a palette from its first few bytes (16 is always enough).
+   /// Returns Format::Unknown if the bytes do not begin any of the supported formats.
+   static Format DetectFormat(const void* pData, size_t cbData);
+
+
+   /// Creates an importer for the specified format. If the format is Format::Unknown,
+   /// then it is detected from the start of the input.
+   explicit PaletteImporter(Format format = Format::Unknown);
+
+   /// Discards the palette that was imported (but keeps the buffers that held it),
+   /// and prepares to import another one, in the specified format.
+   void Reset(Format format = Format::Unknown);
+
+   /// Parses the next chunk of the input. Returns the status so far; once an error has been
+   /// reported, any further input is ignored.
+   Status Feed(const void* pData, size_t cbData);
+
+   /// Marks the end of the input, and checks that the palette is complete. Returns the final status.
+   Status Finish();
+
+   /// Parses a complete palette that is in memory. This is equivalent to Feed() followed by Finish().
+   Status Import(const void* pData, size_t cbData);
+
+   /// Reads and parses a complete palette file, a chunk at a time.
+   Status ImportFile(LPCTSTR pszPath);
+
+
+   /// Gets the format of the input, or Format::Unknown if it has not been determined yet.
+   Format GetFormat() const;
+
+   /// Gets the current status.
+   Status GetStatus() const;
+
+   /// Gets the offset in the input, in bytes, of the line or record in which an error was detected.
+   UINT64 GetErrorOffset() const;
+
+   /// Gets the number of colors that have been imported.
+   size_t GetColorCount() const;
+
+   /// Gets the number of columns that the palette asks to be displayed in, or 0 if it does not say.
+   size_t GetColumnCount() const;
+
+   /// Gets the colors that have been imported, as a contiguous array of GetColorCount() elements.
+   const COLORREF* GetColors() const;
+
+   /// Gets the color of the specified entry.
+   COLORREF GetColor(size_t index) const;
+
+   /// Gets the name of the specified entry, as a null-terminated string (which is empty if the entry has no name).
+   LPCWSTR GetName(size_t index) const;
+
+   /// Gets the length of the name of the specified entry, in characters (not counting the terminator).
+   size_t GetNameLength(size_t index) const;
+
+   /// Builds a color table from the colors and names that have been imported.
+   ColorTable GetColorTable() const;
+
+private:
+
+   void   ParsePending(bool isFinal);
+   size_t Parse(const BYTE* pData, size_t cbData, bool isFinal);
+   size_t ParseLine(const BYTE* pData, size_t cbData, bool isFinal);
+   void   ParseGplLine(const char* pch, size_t cch);
+   void   ParseJascPalLine(const char* pch, size_t cch);
+   size_t ParseAcoRecord(const BYTE* pData, size_t cbData);
+   size_t ParseAseBlock(const BYTE* pData, size_t cbData);
+
+   bool   AddColor(COLORREF clr);
+   void   AddNameUtf8(const char* pch, size_t cch);
+   void   AddNameUtf16BE(const BYTE* pData, size_t cch);
+   void   Clear();
+   void   Fail(Status status);
+
+private:
+   Format                m_format;
+   Status                m_status;
+   int                   m_stage;        // position within the format's structure (a format-specific Stage value)
+   UINT32                m_cRemaining;   // entries, records, or blocks remaining in the current section
+   UINT64                m_cbSkip;       // bytes remaining in a block that is being skipped
+   UINT64                m_cbParsed;     // bytes of input that have been consumed
+   UINT64                m_ibError;      // offset of the line or record in which an error was detected
+   UINT16                m_version;      // version of the current section (for formats that have one)
+   size_t                m_cColumns;
+   bool                  m_isFinished;
+   std::vector<BYTE>     m_pending;      // unconsumed input, which is waiting for the rest of its line or record
+   std::vector<COLORREF> m_colors;
+   std::vector<UINT32>   m_nameOffsets;  // start of each name in the pool, plus the end of the pool
+   std::vector<WCHAR>    m_names;        // pool of null-terminated names
+};
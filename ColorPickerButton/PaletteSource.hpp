@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+
+class ColorTableDiff;
+
+
+/// A palette on disk that is watched for changes, so that every button displaying it is updated
+/// whenever it is saved. The palette may be a palette file (see PaletteFile), or a palette in any
+/// format that PaletteImporter reads. Pass the object to ColorPickerButton::SetColorTable() to
+/// display it; any number of buttons can share one source.
+///
+/// The file is watched by a worker thread, with ReadDirectoryChangesW, or by polling its size and
+/// last-write time, if the directory cannot be watched (as with some network shares). When the file
+/// changes, the worker reloads it and computes a diff against the table it last loaded (see
+/// ColorTableDiff). The diff is then delivered to the buttons on the thread that opened the source,
+/// and each button applies it in place, rebuilding only the palette and index entries that it
+/// touches. (Changes too large for a diff to pay off are delivered as a replacement of the table.)
+/// A file that cannot be read, or that changes while it is being read, leaves the table unchanged.
+///
+/// A source must be opened, used, and destroyed on a thread that has a message loop (normally, the
+/// UI thread), since that is where the updates are delivered.
+class PaletteSource
+{
+   PaletteSource           (const PaletteSource&) = delete;  // not copyable
+   PaletteSource& operator=(const PaletteSource&) = delete;  // not assignable
+
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   enum class Status
+   {
+      Ok,
+      IoError,     ///< the file could not be opened or read, or cannot be watched
+      NotPalette,  ///< the file is neither a valid palette file nor a palette that can be imported
+   };
+
+   static constexpr DWORD kPollIntervalDefault = 1000;  ///< in milliseconds, for files that cannot be watched
+
+   /// Loads the specified palette, and starts watching it for changes.
+   /// Returns null (and sets the status, if requested) if the palette cannot be loaded.
+   static std::shared_ptr<PaletteSource> Open(LPCTSTR pszPath,
+                                              DWORD   pollInterval = kPollIntervalDefault,
+                                              Status* pStatus      = nullptr);
+
+
+   /// Stops watching the file.
+   ~PaletteSource();
+
+   /// Gets the full path of the file.
+   const CString& GetPath() const;
+
+   /// Gets the color table, as most recently delivered.
+   const ColorTable& GetColorTable() const;
+
+   /// Gets the number of columns that the palette asks to be displayed in, or 0 if it does not say.
+   size_t GetColumnCount() const;
+
+   /// Gets the number of times that a changed table has been delivered since the source was opened.
+   UINT GetVersion() const;
+
+   /// Gets the status of the most recent attempt to reload the file. (If it failed,
+   /// the table that was loaded before remains in use.)
+   Status GetLoadStatus() const;
+
+   /// Gets whether the file is being polled, because its directory cannot be watched.
+   bool IsPolling() const;
+
+private:
+
+   friend class ColorPickerButton;
+
+   class NotificationWindow;
+
+   // A table (and, if it was computed, the diff to it from the previous one) that the worker
+   // loaded, waiting to be delivered.
+   struct Update
+   {
+      Status                                status;
+      std::shared_ptr<const ColorTable>     pColorTable;
+      std::shared_ptr<const ColorTableDiff> pDiff;
+      size_t                                cColumns;
+   };
+
+   // The attributes of the file that are compared to decide whether it has changed.
+   struct FileStamp
+   {
+      bool     exists;
+      FILETIME ftLastWrite;
+      UINT64   cb;
+
+      bool operator==(const FileStamp& other) const;
+      bool operator!=(const FileStamp& other) const;
+   };
+
+   PaletteSource(CString strPath, DWORD pollInterval);
+
+   // Adds and removes the buttons that are notified of changes to the table.
+   void Subscribe  (ColorPickerButton* pButton);
+   void Unsubscribe(ColorPickerButton* pButton);
+
+   static FileStamp GetFileStamp(LPCTSTR pszPath);
+   static Status    Load(LPCTSTR pszPath, FileStamp* pStamp, ColorTable* pColorTable, size_t* pcColumns);
+
+   void Watch();
+   void Poll();
+   void ReloadIfChanged();
+   void DeliverUpdates();
+
+private:
+   const CString                           m_strPath;
+   const DWORD                             m_pollInterval;
+   std::shared_ptr<const ColorTable>       m_pColorTable;    // the table as delivered (used on the UI thread)
+   size_t                                  m_cColumns;
+   UINT                                    m_version;
+   Status                                  m_loadStatus;
+   std::vector<ColorPickerButton*>         m_subscribers;
+   std::unique_ptr<NotificationWindow>     m_pNotificationWnd;
+   HWND                                    m_hwndNotification;  // (a copy of the handle, for the worker to post to)
+   HANDLE                                  m_hStopEvent;
+   std::atomic<bool>                       m_isPolling;
+   std::mutex                              m_updatesMutex;
+   std::vector<Update>                     m_updates;           // loaded by the worker, waiting to be delivered
+   std::shared_ptr<const ColorTable>       m_pLoadedTable;      // \ the table as last loaded, and the file's stamp
+   size_t                                  m_cLoadedColumns;    // |   at the time (used on the worker thread,
+   FileStamp                               m_loadedStamp;       // /   once it has been started)
+   std::thread                             m_worker;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "PaletteFile.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+
+/// A color table kept in named shared memory, so that several processes displaying the same large
+/// palette share a single copy of its colors, names, and lookup index, rather than each holding its
+/// own. One process creates the store and publishes tables to it; any number of processes open it
+/// read-only and pass it to ColorPickerButton::SetColorTable(), which displays the current table
+/// in place and follows the store as new tables are published, with no copying and no messages
+/// between the processes.
+///
+/// Each published table is serialized in the palette file format (see PaletteFile) into a section
+/// of its own, which is never modified once it is published. The store itself is a small header
+/// that names the current section, versioned by a sequence lock: the writer makes the sequence
+/// number odd while it updates the header, and even again when it is done, and readers retry
+/// until they see the same even number before and after reading it (or, if the writer exited in
+/// the middle of an update, give up and keep the table that they have). A reader that has mapped a
+/// section can keep using it for as long as it likes; the system frees it once the writer has
+/// moved on and the last reader has let go of it.
+///
+/// The name follows the rules for named kernel objects, so it may be prefixed with "Local\" (the
+/// default) or "Global\" to choose the namespace that the store is visible in.
+class SharedPaletteStore
+{
+   SharedPaletteStore           (const SharedPaletteStore&) = delete;  // not copyable
+   SharedPaletteStore& operator=(const SharedPaletteStore&) = delete;  // not assignable
+
+public:
+
+   using ColorTable = std::vector<std::pair<COLORREF, CString>>;
+
+   enum class Status
+   {
+      Ok,
+      IoError,        ///< the shared memory could not be created, opened, or mapped
+      NotFound,       ///< no store of that name exists
+      NotStore,       ///< an object of that name exists, but it is not a compatible store
+      TooManyColors,  ///< the table contains more than ColorPickerButton::kcColorTableMax colors
+   };
+
+   /// Creates the named store, to publish tables to. If a store of that name already exists (for
+   /// example, because the process that created it exited while others still had it open), then
+   /// it is taken over. A store must only have one writer at a time.
+   /// Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<SharedPaletteStore> Create(LPCTSTR pszName, Status* pStatus = nullptr);
+
+   /// Opens the named store read-only, to display the tables that are published to it.
+   /// Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<const SharedPaletteStore> Open(LPCTSTR pszName, Status* pStatus = nullptr);
+
+
+   /// Unmaps the store. (Tables obtained from it remain valid until they are released.)
+   ~SharedPaletteStore();
+
+   /// Gets the name of the store.
+   const CString& GetName() const;
+
+   /// Gets the generation of the current table, which increases each time that a table is
+   /// published, or 0 if no table has been published yet. This only reads the header, so it is
+   /// cheap enough to poll. If the writer exited in the middle of publishing a table, this never
+   /// waits for it; it returns the generation of the table that this process last mapped.
+   UINT64 GetGeneration() const;
+
+   /// Gets the current table, mapped read-only, and (if requested) its generation. Each process
+   /// maps a generation only once, however many times it is asked for. Returns null if no table
+   /// has been published yet; if the current table cannot be mapped (or the writer exited in the
+   /// middle of publishing it), returns the most recent one that could be.
+   std::shared_ptr<const PaletteFile> GetPaletteFile(UINT64* pGeneration = nullptr) const;
+
+   /// Publishes a table, which becomes the current table for every process that has the store
+   /// open. This must only be called on the store that was returned by Create().
+   Status Publish(const ColorTable&                colorTable,
+                  const PaletteFile::WriteOptions& options = PaletteFile::DefaultWriteOptions());
+
+private:
+
+   struct Header;
+
+   SharedPaletteStore(CString strName, HANDLE hHeader, Header* pHeader, bool isWriter);
+
+   static CString GetSectionName(const CString& strName, UINT64 generation);
+
+   // Reads the generation and the size of the current section, consistently. Returns false if
+   // the header stays in the middle of an update for too long (see the implementation).
+   bool ReadHeader(UINT64* pGeneration, UINT64* pcbSection) const;
+
+   // Maps the section of the specified generation, or returns null if it no longer exists.
+   std::shared_ptr<const PaletteFile> MapSection(UINT64 generation, UINT64 cbSection) const;
+
+private:
+   const CString                              m_strName;
+   HANDLE                                     m_hHeader;               // (keeps the store's name alive for as long as it is open)
+   Header*                                    m_pHeader;               // (mapped read-only, unless this is the writer)
+   const bool                                 m_isWriter;
+   HANDLE                                     m_hSections[2];          // the writer's handles to the current and previous
+                                                                       //   sections, which keep them alive for readers to open
+   mutable std::mutex                         m_snapshotMutex;
+   mutable std::shared_ptr<const PaletteFile> m_pSnapshot;             // \ the table that this process most recently
+   mutable UINT64                             m_snapshotGeneration;    // /   mapped, and its generation
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+
+
+/// The contents of a StaticColorTable, in a form that does not depend on its size, which is how
+/// ColorPickerButton refers to it. All of the arrays have cColors elements, and all of them
+/// (like the StaticColorTable that they belong to) must have static storage duration.
+struct StaticColorTableData
+{
+   static constexpr size_t kInvalidIndex = static_cast<size_t>(-1);
+
+   const COLORREF* pColors;
+   const LPCTSTR*  ppszNames;
+   const UINT16*   pSortedIndices;  ///< indices of the entries, sorted by color (and then by index)
+   const RECT*     prcSwatches;     ///< swatch of each entry in table order, relative to the swatch area
+   size_t          cColors;
+   size_t          cColumns;
+   size_t          cRows;
+
+   /// Finds the first entry with exactly the specified color, by binary search of the sorted
+   /// indices. Returns kInvalidIndex if there is no such entry.
+   constexpr size_t FindColor(COLORREF clr) const
+   {
+      size_t first = 0;
+      size_t count = cColors;
+      while (count > 0)
+      {
+         const auto half = count / 2;
+         if (pColors[pSortedIndices[first + half]] < clr)
+         {
+            first += half + 1;
+            count -= half + 1;
+         }
+         else
+         {
+            count  = half;
+         }
+      }
+      return ((first < cColors) && (pColors[pSortedIndices[first]] == clr)) ? pSortedIndices[first]
+                                                                            : kInvalidIndex;
+   }
+};
+
+
+/// A color table that is fixed at compile time, so that a button displaying it does no work at
+/// run time to parse, copy, hash, or lay out its entries. Pass the object (which must have static
+/// storage duration) to ColorPickerButton::SetColorTable() to display it.
+///
+/// A static color table is normally generated from a palette file by the PaletteCompiler tool,
+/// which emits a header that defines the colors, the names, and the sorted indices (the lookup
+/// index for exact matches) as constexpr arrays, along with a StaticColorTable that wraps them.
+/// The grid layout (the number of rows, and the rectangle of each entry's swatch, for the given
+/// number of columns) is computed by the compiler from the swatch size of the pop-up window.
+/// Tables that are too large for a color picker are rejected at compile time.
+template <size_t N, size_t Columns = ColorPickerButton::kcColorTableColumnsDefault>
+class StaticColorTable
+{
+   static_assert(N > 0,                                 "A static color table must contain at least one item.");
+   static_assert(N <= ColorPickerButton::kcColorTableMax, "The static color table contains too many items.");
+   static_assert(Columns > 0,                           "A static color table must have at least one column.");
+
+   StaticColorTable           (const StaticColorTable&) = delete;  // not copyable (refers to itself)
+   StaticColorTable& operator=(const StaticColorTable&) = delete;  // not assignable
+
+public:
+
+   static constexpr size_t kcColors  = N;
+   static constexpr size_t kcColumns = Columns;
+   static constexpr size_t kcRows    = (N / Columns) + ((N % Columns) != 0);
+
+   /// The size of the area occupied by all of the swatches.
+   static constexpr SIZE   kszSwatchArea = { static_cast<LONG>(ColorPickerButton::kszColorSwatch.cx * Columns),
+                                             static_cast<LONG>(ColorPickerButton::kszColorSwatch.cy * kcRows) };
+
+   /// Gets the rectangle of the swatch displayed at the specified position,
+   /// relative to the top-left corner of the swatch area.
+   static constexpr RECT GetSwatchRect(size_t position)
+   {
+      const auto left = static_cast<LONG>(ColorPickerButton::kszColorSwatch.cx * (position % Columns));
+      const auto top  = static_cast<LONG>(ColorPickerButton::kszColorSwatch.cy * (position / Columns));
+      return RECT{ left,
+                   top,
+                   left + ColorPickerButton::kszColorSwatch.cx,
+                   top  + ColorPickerButton::kszColorSwatch.cy };
+   }
+
+
+   /// Wraps the specified arrays, which must have static storage duration. The sorted indices
+   /// must list every entry exactly once, in order of color (and, for equal colors, of index);
+   /// IsValid() checks this, and is meant to be used in a static_assert.
+   constexpr StaticColorTable(const COLORREF (&colors)[N],
+                              const LPCTSTR  (&names)[N],
+                              const UINT16   (&sortedIndices)[N])
+      : m_rcSwatches()
+      , m_data      { colors, names, sortedIndices, m_rcSwatches, N, Columns, kcRows }
+   {
+      for (size_t i = 0; i < N; ++i)
+      {
+         m_rcSwatches[i] = GetSwatchRect(i);
+      }
+   }
+
+   /// Checks that the sorted indices are a permutation of the entries, in order of color
+   /// and then of index. (Since equal colors must be in order of index, no index can appear
+   /// twice, so N indices that are all in range must be a permutation.)
+   constexpr bool IsValid() const
+   {
+      for (size_t i = 0; i < N; ++i)
+      {
+         const size_t index = m_data.pSortedIndices[i];
+         if (index >= N)
+         {
+            return false;
+         }
+         if (i > 0)
+         {
+            const size_t previous = m_data.pSortedIndices[i - 1];
+            const auto   clr      = m_data.pColors[index];
+            const auto   clrPrev  = m_data.pColors[previous];
+            if ((clrPrev > clr) || ((clrPrev == clr) && (previous >= index)))
+            {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   /// Gets the color of the specified entry.
+   constexpr COLORREF GetColor(size_t index) const
+   {
+      return m_data.pColors[index];
+   }
+
+   /// Gets the name of the specified entry.
+   constexpr LPCTSTR GetName(size_t index) const
+   {
+      return m_data.ppszNames[index];
+   }
+
+   /// Finds the first entry with exactly the specified color.
+   /// Returns StaticColorTableData::kInvalidIndex if there is no such entry.
+   constexpr size_t FindColor(COLORREF clr) const
+   {
+      return m_data.FindColor(clr);
+   }
+
+   /// Gets the contents of the table, in the form that ColorPickerButton refers to.
+   constexpr const StaticColorTableData& GetData() const
+   {
+      return m_data;
+   }
+
+private:
+   RECT                 m_rcSwatches[N];
+   StaticColorTableData m_data;
+};
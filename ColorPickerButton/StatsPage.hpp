@@ -0,0 +1,101 @@
+#pragma once
+
+#include <memory>
+
+
+/// A page of live statistics about ColorPickerButton and its pop-up window, kept in named shared
+/// memory, so that a monitoring tool can read them from another process while the application
+/// runs, without attaching a debugger or adding logging. The application creates the page and
+/// passes it to ColorPickerButton::SetStatsPage() (one page may be shared by several buttons,
+/// whose statistics are then combined); the tool opens the page by name, read-only, and reads it
+/// as often as it likes.
+///
+/// The page is versioned by a sequence lock, as SharedPaletteStore's header is: the writer makes
+/// the sequence number odd while it updates the statistics, and even again when it is done, and
+/// readers retry until they see the same even number before and after reading them. So updating
+/// the page costs the UI thread two interlocked increments and a few stores, and it never waits
+/// for a reader, however often the page is read.
+///
+/// The name follows the rules for named kernel objects, so it may be prefixed with "Local\" (the
+/// default) or "Global\" to choose the namespace that the page is visible in.
+class StatsPage
+{
+   StatsPage           (const StatsPage&) = delete;  // not copyable
+   StatsPage& operator=(const StatsPage&) = delete;  // not assignable
+
+public:
+
+   enum class Status
+   {
+      Ok,
+      IoError,       ///< the shared memory could not be created, opened, or mapped
+      NotFound,      ///< no page of that name exists
+      NotStatsPage,  ///< an object of that name exists, but it is not a compatible page
+   };
+
+   /// The statistics, as they are laid out in the page (every field is little-endian, and the
+   /// layout only changes along with the page's version number). Times are in microseconds.
+   struct Stats
+   {
+      UINT64 cOpens;           ///< times the pop-up window was opened
+      UINT64 openTimeTotal;    ///< \ time taken to open the pop-up window, from starting to lay it out until it
+      UINT64 openTimeMax;      ///< /   is shown and accepts input (the average is openTimeTotal / cOpens)
+      UINT64 cHoverEvents;     ///< mouse moves handled by the pop-up window
+      UINT64 cKeyEvents;       ///< keys and characters handled by the pop-up window
+      UINT64 cNotifications;   ///< notifications sent to the parent
+      UINT64 cCacheHits;       ///< \ lookups of the buttons' cached display orders and name indexes that found them
+      UINT64 cCacheMisses;     ///< /   up to date, or had to rebuild them (each counted once per pop-up session)
+      UINT64 cGdiObjectsHeld;  ///< GDI objects held by the process, as of when a pop-up window last opened or closed
+   };
+
+   /// Creates the named page, to record statistics to. If a page of that name already exists
+   /// (for example, because the application was restarted while a tool still had it open), then
+   /// it is taken over, and its statistics carry on from where they were. A page must only have
+   /// one writer at a time, and it must only be written from one thread (the thread that owns
+   /// the buttons that it is set on).
+   /// Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<StatsPage> Create(LPCTSTR pszName, Status* pStatus = nullptr);
+
+   /// Opens the named page read-only, to read its statistics.
+   /// Returns null (and sets the status, if requested) on failure.
+   static std::shared_ptr<const StatsPage> Open(LPCTSTR pszName, Status* pStatus = nullptr);
+
+
+   /// Unmaps the page.
+   ~StatsPage();
+
+   /// Gets the name of the page.
+   const CString& GetName() const;
+
+   /// Reads the statistics, consistently (so, for example, the total open time always
+   /// goes with the number of opens that it was taken over).
+   Stats Read() const;
+
+   /// Sets every statistic to zero. This, and the functions that record statistics, must only
+   /// be called on the page that was returned by Create(), on the thread that writes it.
+   void Reset();
+
+   void RecordOpen(UINT64 openTime);
+   void RecordHoverEvent();
+   void RecordKeyEvent();
+   void RecordNotification();
+   void RecordCacheLookup(bool hit);
+   void SetGdiObjectsHeld(UINT64 cObjects);
+
+private:
+
+   struct Layout;
+
+   StatsPage(CString strName, HANDLE hPage, Layout* pLayout, bool isWriter);
+
+   // Applies an update to the statistics, while the sequence number is odd.
+   template <typename Update>
+   void Write(Update update);
+
+private:
+   const CString m_strName;
+   HANDLE        m_hPage;
+   Layout*       m_pLayout;         // (mapped read-only, unless this is the writer)
+   const bool    m_isWriter;
+   const DWORD   m_writerThreadId;  // the thread that created the page (checked in debug builds)
+};
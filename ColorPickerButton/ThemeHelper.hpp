@@ -34,6 +34,12 @@ public:
    //   supports themes.
    static bool ThemesEnabled();
 
+   // Gets the name of the current visual style, which identifies it, for telling whether it has changed.
+   // @return  Returns the file name, the color scheme, and the size of the visual style, separated by
+   //          semicolons, or an empty string if the theme APIs are not supported and enabled (see
+   //          ThemesEnabled()).
+   static CString GetCurrentThemeName();
+
    // If themes are supported and enabled, this function sets the theme for the specified window
    // (&agrave; la the ::SetWindowTheme() API). Otherwise, this function has no effect.
    //
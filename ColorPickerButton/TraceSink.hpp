@@ -0,0 +1,77 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/// An event recorded by the timers in ColorPickerButton and its pop-up window: either a phase
+/// (such as creating the window, or painting it) with its duration, or an instant (such as the
+/// selection changing). Times are in microseconds, from the performance counter, so they can be
+/// compared with each other, but their origin is arbitrary.
+struct TraceEvent
+{
+   enum class Type
+   {
+      Phase,    ///< a span of time, from timestamp to timestamp + duration
+      Instant,  ///< a point in time (with a duration of 0)
+   };
+
+   const char* pszName;    ///< always a string literal, so it can be kept without being copied
+   Type        type;
+   double      timestamp;  ///< when the phase began, or when the instant happened
+   double      duration;
+   DWORD       threadId;
+};
+
+
+/// Receives the events recorded by the timers in ColorPickerButton and its pop-up window.
+/// Pass one to ColorPickerButton::SetTraceSink(). The timers are only compiled in when
+/// COLORPICKERBUTTON_TRACE is defined (in the project's preprocessor definitions); otherwise,
+/// they compile to nothing, and a sink never receives any events.
+///
+/// Events are delivered on the thread that owns the button, in the order in which they end,
+/// so a phase is delivered after the phases nested inside of it.
+class TraceSink
+{
+public:
+
+   virtual ~TraceSink() = default;
+
+   /// Called for each event. This is called while the pop-up window is being used,
+   /// so it should do as little as possible (for example, just record the event).
+   virtual void OnTraceEvent(const TraceEvent& event) = 0;
+};
+
+
+/// A trace sink that collects events in memory, and writes them out in the Chrome trace-event
+/// format, which chrome://tracing and Perfetto display on a timeline (with each phase drawn
+/// beneath the phase that it is nested in).
+class ChromeTraceSink : public TraceSink
+{
+   ChromeTraceSink           (const ChromeTraceSink&) = delete;  // not copyable
+   ChromeTraceSink& operator=(const ChromeTraceSink&) = delete;  // not assignable
+
+public:
+
+   ChromeTraceSink() /* = default */;
+
+   virtual void OnTraceEvent(const TraceEvent& event) override;
+
+   /// Gets the number of events collected so far.
+   size_t GetEventCount() const;
+
+   /// Discards the events collected so far.
+   void Clear();
+
+   /// Formats the events collected so far as a JSON document in the Chrome trace-event format.
+   std::string ToJson() const;
+
+   /// Writes the events collected so far to the specified file, replacing it.
+   /// Returns false if the file cannot be written.
+   bool Write(LPCTSTR pszPath) const;
+
+private:
+   mutable std::mutex      m_eventsMutex;
+   std::vector<TraceEvent> m_events;
+};
@@ -0,0 +1,86 @@
+#include "PCH.hpp"
+#include "AllocationCheck.hpp"
+
+#if defined(COLORPICKERBUTTON_CHECK_ALLOCATIONS) && defined(_DEBUG)
+
+#include <crtdbg.h>
+
+
+namespace {
+
+// The state of the checks on each thread. (Plain thread-local variables, which the hook can
+// read and write without allocating.)
+thread_local UINT64 t_cAllocations = 0;  // counted while at least one check is active, and none is suspended
+thread_local int    t_cActive      = 0;
+thread_local int    t_cSuspended   = 0;
+
+int __cdecl CountAllocations(int                  allocType,
+                             void*                /* pvData */,
+                             size_t               /* nSize */,
+                             int                  /* nBlockUse */,
+                             long                 /* lRequest */,
+                             const unsigned char* /* szFileName */,
+                             int                  /* nLine */)
+{
+   if (((allocType == _HOOK_ALLOC) || (allocType == _HOOK_REALLOC)) &&
+       (t_cActive > 0) && (t_cSuspended == 0))
+   {
+      ++t_cAllocations;
+   }
+   return TRUE;  // (allow the allocation)
+}
+
+// Installs the hook, once, the first time that a check is started. The hook that was installed
+// before it (if any) is not chained, since the checks are only meant for debugging the control.
+void InstallHook()
+{
+   static const auto pfnPrevious = _CrtSetAllocHook(CountAllocations);
+   (void)pfnPrevious;
+}
+
+}  // anonymous namespace
+
+
+AllocationCheck::AllocationCheck(bool isEnabled, const char* pszName)
+   : m_pszName (isEnabled ? pszName : nullptr)
+   , m_cAtStart(t_cAllocations)
+{
+   if (m_pszName)
+   {
+      InstallHook();
+      ++t_cActive;
+   }
+}
+
+AllocationCheck::~AllocationCheck()
+{
+   if (m_pszName)
+   {
+      --t_cActive;
+      const auto cAllocations = t_cAllocations - m_cAtStart;
+      if (cAllocations != 0)
+      {
+         _RPTN(_CRT_ASSERT,
+               "ColorPickerButton allocated %llu time(s) while handling \"%s\", which should never allocate.\n",
+               cAllocations,
+               m_pszName);
+      }
+   }
+}
+
+/* static */ UINT64 AllocationCheck::GetAllocationCount()
+{
+   return t_cAllocations;
+}
+
+AllocationCheck::Suspension::Suspension()
+{
+   ++t_cSuspended;
+}
+
+AllocationCheck::Suspension::~Suspension()
+{
+   --t_cSuspended;
+}
+
+#endif  // defined(COLORPICKERBUTTON_CHECK_ALLOCATIONS) && defined(_DEBUG)
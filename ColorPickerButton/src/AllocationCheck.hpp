@@ -0,0 +1,59 @@
+#pragma once
+
+
+// Checks that a stretch of code makes no allocations from the CRT heap (which is where operator
+// new, malloc, and CString get their memory). The pop-up window handles hovering, navigating with
+// the arrow keys, and painting without allocating, and these checks keep it that way: each one
+// counts the allocations made on its thread while it is in scope, and asserts if there were any.
+//
+// The counting is done by a CRT allocation hook, so it is only available in debug builds, and it
+// is only compiled in when COLORPICKERBUTTON_CHECK_ALLOCATIONS is also defined; otherwise, the
+// macros below compile to nothing. Calls out to the parent's notification handler, which the
+// checks do not cover, suspend them; and nothing is checked while a trace sink is attached.
+#if defined(COLORPICKERBUTTON_CHECK_ALLOCATIONS) && defined(_DEBUG)
+
+class AllocationCheck
+{
+   AllocationCheck           (const AllocationCheck&) = delete;  // not copyable
+   AllocationCheck& operator=(const AllocationCheck&) = delete;  // not assignable
+
+public:
+
+   // Starts checking, if the condition is true, naming the check (a string literal) for the
+   // report; otherwise, does nothing.
+   AllocationCheck(bool isEnabled, const char* pszName);
+
+   // Stops checking, and asserts if there were any allocations.
+   ~AllocationCheck();
+
+   // Gets the number of allocations counted on the current thread so far, so that a test can
+   // compare the counts taken between two inputs.
+   static UINT64 GetAllocationCount();
+
+   // Suspends the checks on the current thread while in scope.
+   class Suspension
+   {
+      Suspension           (const Suspension&) = delete;  // not copyable
+      Suspension& operator=(const Suspension&) = delete;  // not assignable
+
+   public:
+      Suspension();
+      ~Suspension();
+   };
+
+private:
+   const char* const m_pszName;    // (null if the check is not enabled)
+   const UINT64      m_cAtStart;
+};
+
+// CHECK_NO_ALLOCATIONS_IF(condition, "name") checks the rest of the enclosing scope, if the
+// condition is true (it is not evaluated otherwise), and SUSPEND_ALLOCATION_CHECKS() suspends any
+// checks for the rest of the enclosing scope.
+#define ALLOCATION_CHECK_CONCAT2(a, b)             a##b
+#define ALLOCATION_CHECK_CONCAT(a, b)              ALLOCATION_CHECK_CONCAT2(a, b)
+#define CHECK_NO_ALLOCATIONS_IF(condition, pszName) const AllocationCheck ALLOCATION_CHECK_CONCAT(allocationCheck, __LINE__)((condition), (pszName))
+#define SUSPEND_ALLOCATION_CHECKS()                const AllocationCheck::Suspension ALLOCATION_CHECK_CONCAT(allocationCheckSuspension, __LINE__)
+#else
+#define CHECK_NO_ALLOCATIONS_IF(condition, pszName) ((void)0)
+#define SUSPEND_ALLOCATION_CHECKS()                ((void)0)
+#endif
@@ -0,0 +1,177 @@
+#include "PCH.hpp"
+#include "ButtonFaceCache.hpp"
+#include "ThemeHelper.hpp"
+
+
+namespace {
+
+bool IsSameKey(const ButtonFaceCache::Key& key1, const ButtonFaceCache::Key& key2)
+{
+   return (key1.size.cx       == key2.size.cx)       &&
+          (key1.size.cy       == key2.size.cy)       &&
+          (key1.state         == key2.state)         &&
+          (key1.clrSwatch     == key2.clrSwatch)     &&
+          (key1.clrBackground == key2.clrBackground) &&
+          (key1.dpi           == key2.dpi);
+}
+
+}  // anonymous namespace
+
+
+/* static */ ButtonFaceCache& ButtonFaceCache::Get()
+{
+   static ButtonFaceCache cache;
+   return cache;
+}
+
+ButtonFaceCache::ButtonFaceCache()
+   : m_mutex      ()
+   , m_hdcFace    (nullptr)
+   , m_hbmOriginal(nullptr)
+   , m_faces      ()
+   , m_appearance ()
+   , m_cUses      (0)
+{
+}
+
+ButtonFaceCache::~ButtonFaceCache()
+{
+   if (m_hdcFace)
+   {
+      ::SelectObject(m_hdcFace, m_hbmOriginal);
+      this->DeleteFaces();
+      VERIFY(::DeleteDC(m_hdcFace));
+   }
+}
+
+void ButtonFaceCache::FlushIfStale()
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   if (!m_faces.empty() && !(GetAppearance() == m_appearance))
+   {
+      ::SelectObject(m_hdcFace, m_hbmOriginal);
+      this->DeleteFaces();
+   }
+}
+
+size_t ButtonFaceCache::GetByteSize() const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   auto cb = sizeof(*this) + (m_faces.capacity() * sizeof(Face));
+   for (const auto& face : m_faces)
+   {
+      cb += face.cbBitmap;
+   }
+   return cb;
+}
+
+UINT ButtonFaceCache::GetGdiObjectCount() const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   return static_cast<UINT>(m_faces.size()) + (m_hdcFace ? 1 : 0);
+}
+
+HDC ButtonFaceCache::SelectFace(const Key& key, bool* pIsNew)
+{
+   _ASSERTE(pIsNew);
+   _ASSERTE((key.size.cx > 0) && (key.size.cy > 0));
+
+   ++m_cUses;
+   const auto it = std::find_if(m_faces.begin(), m_faces.end(), [&key](const Face& face)
+                                {
+                                   return IsSameKey(face.key, key);
+                                });
+   if (it != m_faces.end())
+   {
+      it->lastUse = m_cUses;
+      VERIFY(::SelectObject(m_hdcFace, it->hBitmap));
+      *pIsNew = false;
+      return m_hdcFace;
+   }
+
+   // The faces are made compatible with the screen, not with the DC that they are being drawn to
+   // (which may be a memory DC with a monochrome bitmap), so that they can be copied to any DC.
+   if (!m_hdcFace)
+   {
+      m_hdcFace = ::CreateCompatibleDC(nullptr);
+      if (!m_hdcFace)
+      {
+         return nullptr;
+      }
+      m_hbmOriginal = ::GetCurrentObject(m_hdcFace, OBJ_BITMAP);
+   }
+   const auto hdcScreen = ::GetDC(nullptr);
+   if (!hdcScreen)
+   {
+      return nullptr;
+   }
+   const auto hBitmap    = ::CreateCompatibleBitmap(hdcScreen, key.size.cx, key.size.cy);
+   const auto bitsPixel  = ::GetDeviceCaps(hdcScreen, BITSPIXEL) * ::GetDeviceCaps(hdcScreen, PLANES);
+   VERIFY(::ReleaseDC(nullptr, hdcScreen) == 1);
+   if (!hBitmap)
+   {
+      return nullptr;
+   }
+
+   if (m_faces.size() >= kcFacesMax)
+   {
+      const auto itOldest = std::min_element(m_faces.begin(), m_faces.end(), [](const Face& face1, const Face& face2)
+                                             {
+                                                return (face1.lastUse < face2.lastUse);
+                                             });
+      ::SelectObject(m_hdcFace, m_hbmOriginal);  // (in case it is the one that is selected)
+      VERIFY(::DeleteObject(itOldest->hBitmap));
+      *itOldest = m_faces.back();
+      m_faces.pop_back();
+   }
+
+   if (m_faces.empty())
+   {
+      m_appearance = GetAppearance();
+   }
+
+   Face face;
+   face.key      = key;
+   face.hBitmap  = hBitmap;
+   face.cbBitmap = ((((static_cast<size_t>(key.size.cx) * bitsPixel) + 31) / 32) * 4) * key.size.cy;  // (rows are padded to 32 bits)
+   face.lastUse  = m_cUses;
+   m_faces.push_back(face);
+
+   VERIFY(::SelectObject(m_hdcFace, hBitmap));
+   *pIsNew = true;
+   return m_hdcFace;
+}
+
+void ButtonFaceCache::DeleteFaces()
+{
+   for (const auto& face : m_faces)
+   {
+      VERIFY(::DeleteObject(face.hBitmap));
+   }
+   m_faces.clear();
+}
+
+bool ButtonFaceCache::Appearance::operator==(const Appearance& other) const
+{
+   return (strTheme == other.strTheme)                                             &&
+          std::equal(std::begin(sysColors), std::end(sysColors), other.sysColors) &&
+          std::equal(std::begin(metrics),   std::end(metrics),   other.metrics);
+}
+
+/* static */ ButtonFaceCache::Appearance ButtonFaceCache::GetAppearance()
+{
+   constexpr int kMetrics[] = { SM_CXBORDER, SM_CYBORDER, SM_CXEDGE, SM_CYEDGE, SM_CXFOCUSBORDER, SM_CYFOCUSBORDER };
+
+   Appearance appearance;
+   static_assert(ARRAYSIZE(kMetrics) == ARRAYSIZE(appearance.metrics), "each metric must have a place");
+   appearance.strTheme = ThemeHelper::GetCurrentThemeName();
+   for (size_t iColor = 0; iColor < ARRAYSIZE(appearance.sysColors); ++iColor)
+   {
+      appearance.sysColors[iColor] = ::GetSysColor(static_cast<int>(iColor));
+   }
+   for (size_t iMetric = 0; iMetric < ARRAYSIZE(kMetrics); ++iMetric)
+   {
+      appearance.metrics[iMetric] = ::GetSystemMetrics(kMetrics[iMetric]);
+   }
+   return appearance;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+
+// The rendered faces of the buttons, shared by every button in the process, so that painting a
+// button whose face looks like one that has been painted before (which, in a dialog or a grid full
+// of buttons, is nearly every paint) is a single BitBlt, rather than a round of theme drawing.
+//
+// Each face is a bitmap compatible with the screen, keyed by everything that its appearance
+// depends on. Once there are kcFacesMax of them, the least recently used one is discarded to make
+// room for a new one. The theme, the system colors, and the system metrics are not part of the
+// key, since they are the same for every face; instead, the cache remembers what they were when
+// its faces were drawn, and discards all of the faces when they change (see FlushIfStale()).
+class ButtonFaceCache
+{
+   ButtonFaceCache           (const ButtonFaceCache&) = delete;  // not copyable
+   ButtonFaceCache& operator=(const ButtonFaceCache&) = delete;  // not assignable
+
+public:
+
+   // The parts of a button's state that its face depends on.
+   static constexpr UINT kThemed   = 0x01;
+   static constexpr UINT kPressed  = 0x02;
+   static constexpr UINT kDisabled = 0x04;
+   static constexpr UINT kHot      = 0x08;
+   static constexpr UINT kDefault  = 0x10;
+   static constexpr UINT kFocused  = 0x20;  // (showing the focus rectangle)
+
+   struct Key
+   {
+      SIZE     size;
+      UINT     state;          // the flags above
+      COLORREF clrSwatch;      // (CLR_NONE if disabled, when the swatch is filled with a color that the theme decides)
+      COLORREF clrBackground;  // what shows through the transparent parts of a themed face (CLR_NONE if not themed)
+      int      dpi;
+   };
+
+   enum class Result
+   {
+      Copied,     // the face was cached, and was copied
+      Rendered,   // the face was not cached, so it was rendered, cached, and copied
+      NotCached,  // the face could not be cached (the system is out of GDI resources), so nothing was drawn
+   };
+
+   // Gets the cache.
+   static ButtonFaceCache& Get();
+
+   ButtonFaceCache();
+   ~ButtonFaceCache();
+
+   // Copies the face with the specified key to the top left of the specified DC, having the
+   // callback render it first (into a DC whose top left is the top left of the face) if it is not
+   // cached. The callback is called with the cache locked, so it must only draw.
+   template <typename Render>
+   Result Draw(HDC hDC, const Key& key, Render render)
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      bool       isNew;
+      const auto hdcFace = this->SelectFace(key, &isNew);
+      if (!hdcFace)
+      {
+         return Result::NotCached;
+      }
+      if (isNew)
+      {
+         render(hdcFace);
+      }
+      VERIFY(::BitBlt(hDC, 0, 0, key.size.cx, key.size.cy, hdcFace, 0, 0, SRCCOPY));
+      return isNew ? Result::Rendered : Result::Copied;
+   }
+
+   // Discards every face, if the theme, the system colors, or the system metrics have changed since
+   // the faces were drawn. Every button calls this when it is told that they may have changed, and
+   // each of them is told (not necessarily before any of the others is repainted), so the faces are
+   // discarded once for each change, rather than once for each button.
+   void FlushIfStale();
+
+   // Gets the number of bytes held by the cache, including the bits of the faces.
+   size_t GetByteSize() const;
+
+   // Gets the number of GDI objects held by the cache (the faces, and the DC that they are
+   // selected into to be drawn and copied).
+   UINT GetGdiObjectCount() const;
+
+private:
+
+   // Selects the face with the specified key into the cache's DC, first creating it (and the DC)
+   // if it is not cached, and returns the DC, or null if the face could not be created.
+   HDC SelectFace(const Key& key, bool* pIsNew);
+
+   // Deletes the faces, which must not be selected into the cache's DC.
+   void DeleteFaces();
+
+   // What every face was drawn with, besides its key.
+   struct Appearance
+   {
+      CString  strTheme;                       // (see ThemeHelper::GetCurrentThemeName())
+      COLORREF sysColors[COLOR_MENUBAR + 1];
+      int      metrics[6];                     // the sizes of the borders, the edges, and the focus rectangle
+
+      bool operator==(const Appearance& other) const;
+   };
+
+   // Gets the current appearance.
+   static Appearance GetAppearance();
+
+   struct Face
+   {
+      Key     key;
+      HBITMAP hBitmap;
+      size_t  cbBitmap;
+      UINT64  lastUse;   // (from m_cUses)
+   };
+
+   static constexpr size_t kcFacesMax = 128;
+
+private:
+   mutable std::mutex m_mutex;
+   HDC                m_hdcFace;      // (created when the first face is)
+   HGDIOBJ            m_hbmOriginal;  // the bitmap that m_hdcFace was created with
+   std::vector<Face>  m_faces;
+   Appearance         m_appearance;   // what m_faces were drawn with (read when the first of them is)
+   UINT64             m_cUses;        // a clock, for finding the least recently used face
+};
@@ -0,0 +1,115 @@
+#include "PCH.hpp"
+#include "ColorNameTable.hpp"
+#include "PaletteFile.hpp"
+#include "MemoryUsage.hpp"
+
+
+/* static */ std::shared_ptr<const ColorNameTable> ColorNameTable::FromStringTable(HINSTANCE hInstance,
+                                                                                  UINT      idFirst,
+                                                                                  WORD      langId    /* = 0 */,
+                                                                                  size_t    cCacheMax /* = kcCacheMaxDefault */)
+{
+   auto resolver = [hInstance, idFirst, langId](size_t index)
+   {
+      CString    strName;
+      const auto id = idFirst + index;
+      if (id <= UINT16_MAX)  // (string resource IDs are 16 bits)
+      {
+         if (langId != 0)
+         {
+            strName.LoadString(hInstance, static_cast<UINT>(id), langId);
+         }
+         else
+         {
+            strName.LoadString(hInstance, static_cast<UINT>(id));
+         }
+      }
+      return strName;
+   };
+   return std::shared_ptr<const ColorNameTable>(new ColorNameTable(std::move(resolver), cCacheMax));
+}
+
+/* static */ std::shared_ptr<const ColorNameTable> ColorNameTable::FromLocaleFile(std::shared_ptr<const PaletteFile> pLocaleFile,
+                                                                                 std::vector<UINT32>                keys      /* = std::vector<UINT32>() */,
+                                                                                 size_t                             cCacheMax /* = kcCacheMaxDefault */)
+{
+   _ASSERTE(pLocaleFile);
+
+   auto resolver = [pLocaleFile = std::move(pLocaleFile), keys = std::move(keys)](size_t index)
+   {
+      const auto key = keys.empty()          ? index
+                     : (index < keys.size()) ? static_cast<size_t>(keys[index])
+                                             : PaletteFile::kInvalidIndex;
+      return (key < pLocaleFile->GetColorCount()) ? CString(pLocaleFile->GetName(key)) : CString();
+   };
+   return std::shared_ptr<const ColorNameTable>(new ColorNameTable(std::move(resolver), cCacheMax));
+}
+
+/* static */ std::shared_ptr<const ColorNameTable> ColorNameTable::FromCallback(Resolver resolver,
+                                                                               size_t   cCacheMax /* = kcCacheMaxDefault */)
+{
+   _ASSERTE(resolver);
+
+   return std::shared_ptr<const ColorNameTable>(new ColorNameTable(std::move(resolver), cCacheMax));
+}
+
+
+ColorNameTable::ColorNameTable(Resolver resolver, size_t cCacheMax)
+   : m_resolver  (std::move(resolver))
+   , m_cCacheMax (std::max<size_t>(cCacheMax, 1))
+   , m_cacheMutex()
+   , m_cache     ()
+   , m_useCounter(0)
+{
+   m_cache.reserve(m_cCacheMax);
+}
+
+CString ColorNameTable::GetName(size_t index) const
+{
+   std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+   ++m_useCounter;
+   for (auto& entry : m_cache)
+   {
+      if (entry.index == index)
+      {
+         entry.lastUse = m_useCounter;
+         return entry.strName;
+      }
+   }
+
+   auto strName = m_resolver(index);
+   if (m_cache.size() < m_cCacheMax)
+   {
+      m_cache.push_back({ index, strName, m_useCounter });
+   }
+   else
+   {
+      auto& entryEvicted = *std::min_element(m_cache.begin(),
+                                             m_cache.end(),
+                                             [](const CacheEntry& entry1, const CacheEntry& entry2)
+                                             {
+                                                return entry1.lastUse < entry2.lastUse;
+                                             });
+      entryEvicted = { index, strName, m_useCounter };
+   }
+   return strName;
+}
+
+CString ColorNameTable::ResolveName(size_t index) const
+{
+   std::lock_guard<std::mutex> lock(m_cacheMutex);
+   return m_resolver(index);
+}
+
+size_t ColorNameTable::GetByteSize() const
+{
+   std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+   auto cb = sizeof(*this) + GetVectorByteSize(m_cache);
+   for (const auto& entry : m_cache)
+   {
+      cb += GetStringByteSize(entry.strName);
+   }
+   return cb;
+}
@@ -1,7 +1,29 @@
 #include "PCH.hpp"
 #include "ColorPickerButton.hpp"
 #include "ThemeHelper.hpp"
+#include "ColorTableIndex.hpp"
+#include "DisplayOrder.hpp"
+#include "NameSearchIndex.hpp"
+#include "PaletteFile.hpp"
+#include "PaletteSource.hpp"
+#include "SharedPaletteStore.hpp"
+#include "ColorNameTable.hpp"
+#include "ColorTableDiff.hpp"
+#include "ColorTablePublishSlot.hpp"
+#include "StaticColorTable.hpp"
+#include "TraceTimer.hpp"
+#include "LatencyHistogram.hpp"
+#include "StatsPage.hpp"
+#include "InputLog.hpp"
+#include "SessionArena.hpp"
+#include "AllocationCheck.hpp"
+#include "MemoryUsage.hpp"
+#include "ButtonFaceCache.hpp"
+#include "ColorPickerSelection.hpp"
 #include <memory>                 // for unique_ptr
+#include <mutex>                  // for mutex, lock_guard
+#include <unordered_map>          // for unordered_map
+#include <unordered_set>          // for unordered_set
 
 
 namespace {
@@ -83,12 +105,26 @@ CRect GetScreenRect(HWND hWnd)
 // Drawing Helper Functions
 //////////////////////////////////////////////////
 
-void FillSolidRect(HDC hDC, const RECT& rc, COLORREF clr)
+void FillSolidRect(HDC hDC, const RECT& rc, COLORREF clr, ColorPickerButton::PaintCounters& counters)
 {
+   ++counters.cFills;
    ::SetBkColor(hDC, clr);
    VERIFY(::ExtTextOut(hDC, 0, 0, ETO_OPAQUE, &rc, nullptr, 0, nullptr));
 }
 
+void DrawThemePart(const ThemeHelper&                theme,
+                   HDC                               hDC,
+                   int                               iPartId,
+                   int                               iStateId,
+                   const RECT&                       rc,
+                   ColorPickerButton::PaintCounters& counters)
+{
+   ++counters.cThemeDraws;
+   theme.DrawThemeBackground(hDC, iPartId, iStateId, rc);
+}
+
+// Draws the arrow with the DC's own brush and pen (the stock objects whose color is a property
+// of the DC), so that no brush or pen needs to be created for it.
 void DrawArrow(HDC hDC, const RECT& rc, COLORREF clrArrow)
 {
    _ASSERTE(hDC);
@@ -96,15 +132,38 @@ void DrawArrow(HDC hDC, const RECT& rc, COLORREF clrArrow)
                               { rc.right,                 rc.top    },
                               { (rc.left + rc.right) / 2, rc.bottom }
                             };
-   CBrush      brush(clrArrow);
-   CPen        pen  (PS_SOLID, 0, clrArrow);
-   const auto  hbrushOriginal = ::SelectObject(hDC, brush.m_hObject);
-   const auto  hpenOriginal   = ::SelectObject(hDC, pen  .m_hObject);
+   const auto  hbrush         = ::GetStockObject(DC_BRUSH);
+   const auto  hpen           = ::GetStockObject(DC_PEN);
+   const auto  hbrushOriginal = ::SelectObject(hDC, hbrush);
+   const auto  hpenOriginal   = ::SelectObject(hDC, hpen);
    _ASSERTE(hbrushOriginal);
    _ASSERTE(hpenOriginal);
+   const auto  clrBrushOriginal = ::SetDCBrushColor(hDC, clrArrow);
+   const auto  clrPenOriginal   = ::SetDCPenColor  (hDC, clrArrow);
    VERIFY(::Polygon(hDC, ptArrow, ARRAYSIZE(ptArrow)));
-   VERIFY(::SelectObject(hDC, hpenOriginal  ) == pen  .m_hObject);
-   VERIFY(::SelectObject(hDC, hbrushOriginal) == brush.m_hObject);
+   ::SetDCPenColor  (hDC, clrPenOriginal);
+   ::SetDCBrushColor(hDC, clrBrushOriginal);
+   VERIFY(::SelectObject(hDC, hpenOriginal  ) == hpen);
+   VERIFY(::SelectObject(hDC, hbrushOriginal) == hbrush);
+}
+
+// Gets the brush that the parent supplies for painting the background of the button.
+HBRUSH GetButtonBackgroundBrush(HWND hWnd, HDC hDC)
+{
+   const auto hwndParent = ::GetParent(hWnd);
+   auto       hbr        = hwndParent ? reinterpret_cast<HBRUSH>(::SendMessage(hwndParent,
+                                                                              WM_CTLCOLORBTN,
+                                                                              reinterpret_cast<WPARAM>(hDC),
+                                                                              reinterpret_cast<LPARAM>(hWnd)))
+                                      : nullptr;
+   if (!hbr)
+   {
+      hbr = reinterpret_cast<HBRUSH>(::DefWindowProc(hwndParent ? hwndParent : hWnd,
+                                                     WM_CTLCOLORBTN,
+                                                     reinterpret_cast<WPARAM>(hDC),
+                                                     reinterpret_cast<LPARAM>(hWnd)));
+   }
+   return hbr;
 }
 
 //////////////////////////////////////////////////
@@ -125,6 +184,72 @@ std::optional<TCHAR> GetAcceleratorCharacterFromString(const CString& str)
    }
 }
 
+// Creates a palette that contains the specified colors, which must not be empty.
+void CreatePaletteFromColors(CPalette& palette, const COLORREF* clrs, size_t cColors)
+{
+   _ASSERTE((cColors > 0) && (cColors <= ColorPickerButton::kcColorTableMax));
+   auto lp            = std::make_unique<char[]>(sizeof(LOGPALETTE) +
+                                                 (sizeof(PALETTEENTRY) * cColors));
+   auto plp           = reinterpret_cast<LOGPALETTE*>(&lp[0]);
+   plp->palVersion    = 0x300;
+   plp->palNumEntries = static_cast<decltype(plp->palNumEntries)>(cColors);
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      plp->palPalEntry[iColor].peRed   = GetRValue(clrs[iColor]);
+      plp->palPalEntry[iColor].peGreen = GetGValue(clrs[iColor]);
+      plp->palPalEntry[iColor].peBlue  = GetBValue(clrs[iColor]);
+      plp->palPalEntry[iColor].peFlags = 0;
+   }
+
+   VERIFY(palette.CreatePalette(plp));
+   _ASSERTE(palette.GetSafeHandle());
+}
+
+// The buttons that are alive in the process, for GetProcessMemoryUsage(). (Buttons may be created
+// and destroyed on any thread, each on the thread that owns it, so the set is guarded.)
+struct ButtonRegistry
+{
+   std::mutex                                   mutex;
+   std::unordered_set<const ColorPickerButton*> buttons;
+};
+
+ButtonRegistry& GetButtonRegistry()
+{
+   static ButtonRegistry registry;
+   return registry;
+}
+
+// Counts the cache of the rendered faces of the buttons, which all of them share.
+void CountFaceCache(MemoryUsageCounter& counter)
+{
+   const auto& cache = ButtonFaceCache::Get();
+   counter.AddShared(&cache, cache.GetByteSize(), cache.GetGdiObjectCount());
+}
+
+// The batch update, if any, in progress on each thread (see ColorPickerButton::BatchUpdate). A batch
+// only ever holds buttons that are owned by its thread, since only that thread may change them (or
+// destroy them, which takes them out of its batch).
+struct BatchState
+{
+   int                                  depth        = 0;
+   ColorPickerButton::BatchNotification notification = ColorPickerButton::BatchNotification::PerButton;  // (the outermost batch's)
+   std::vector<ColorPickerButton*>      buttons;  // that have work held back, in the order that they first did
+};
+
+thread_local BatchState t_batch;
+
+// Counts a color table that may be shared between buttons, and the names in it.
+void CountSharedColorTable(MemoryUsageCounter& counter, const ColorPickerButton::ColorTable& colorTable)
+{
+   if (counter.AddShared(&colorTable, sizeof(colorTable) + GetVectorByteSize(colorTable)))
+   {
+      for (const auto& entry : colorTable)
+      {
+         counter.AddString(entry.second, true);
+      }
+   }
+}
+
 }  // anonymous namespace
 
 //////////////////////////////////////////////////
@@ -201,21 +326,74 @@ static_assert(ARRAYSIZE(ColorPickerButton::kColorTableDefault) <= ColorPickerBut
 // ------------------------------
 
 ColorPickerButton::ColorPickerButton()
-   : m_clrCurrent    (CLR_DEFAULT)
-   , m_clrDefault    (kclrDefaultColorDefault)
-   , m_cColumns      ()  // \ these members are initialized
-   , m_colorTable    ()  // |   below, by a function called
-   , m_palette       ()  // /   in the constructor's body
-   , m_strDefaultText(kpszDefaultTextDefault)
-   , m_strCustomText (kpszCustomTextDefault)
-   , m_showDefault   (true)
-   , m_showCustom    (true)
-   , m_showTooltips  (true)
-   , m_trackSelection(false)
-   , m_isPopupActive (false)
-   , m_isMouseOver   (false)
+   : m_clrCurrent          (CLR_DEFAULT)
+   , m_clrDefault          (kclrDefaultColorDefault)
+   , m_pPublishSlot        (std::make_unique<ColorTablePublishSlot>())
+   , m_cColumns            ()  // \ these members are initialized
+   , m_colorTable          ()  // |   below, by a function called
+   , m_colors              ()  // |   in the constructor's body
+   , m_pColorNames         ()  // |
+   , m_pPaletteFile        ()  // |
+   , m_pStaticColorTable   ()  // |
+   , m_pPaletteSource      ()  // |
+   , m_pPaletteStore       ()  // |
+   , m_storeGeneration     ()  // |
+   , m_pSharedColorTable   ()  // |
+   , m_deferredDiffs       ()  // |
+   , m_palette             ()  // |
+   , m_pColorTableIndex    ()  // /
+   , m_colorTableVersion   (0)
+   , m_colorTableOrder     (ColorTableOrder::TableOrder)
+   , m_pDisplayOrder       ()
+   , m_pNameSearchIndex    ()
+   , m_strDefaultText      (kpszDefaultTextDefault)
+   , m_strCustomText       (kpszCustomTextDefault)
+   , m_showDefault         (true)
+   , m_showCustom          (true)
+   , m_showTooltips        (true)
+   , m_trackSelection      (false)
+   , m_isPopupActive       (false)
+   , m_isMouseOver         (false)
+   , m_isThemed            ()
+   , m_clrParentBackground ()
+   , m_pTraceSink          ()
+   , m_pInputLatencies     ()
+   , m_paintCounters       ()
+   , m_pStatsPage          ()
+   , m_pInputRecorder      ()
+   , m_pActivePopup        (nullptr)
+   , m_isInBatch           (false)
+   , m_isRepaintDeferred   (false)
+   , m_isNotifyDeferred    (false)
+   , m_clrBeforeBatch      (CLR_DEFAULT)
 {
    this->SetColorTable(kColorTableDefault, kcColorTableDefault);
+
+   auto&                       registry = GetButtonRegistry();
+   std::lock_guard<std::mutex> lock(registry.mutex);
+   registry.buttons.insert(this);
+}
+
+/* virtual */ ColorPickerButton::~ColorPickerButton()
+{
+   {
+      auto&                       registry = GetButtonRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      registry.buttons.erase(this);
+   }
+   if (m_isInBatch)
+   {
+      // (If the button is not in this thread's batch, then it is being destroyed on a thread that
+      // does not own it.)
+      auto&      buttons = t_batch.buttons;
+      const auto iButton = std::find(buttons.begin(), buttons.end(), this);
+      _ASSERTE(iButton != buttons.end());
+      if (iButton != buttons.end())
+      {
+         buttons.erase(iButton);
+      }
+   }
+   this->DetachColorTableSources();
 }
 
 // ------------------------------
@@ -233,8 +411,8 @@ void ColorPickerButton::SetColor(COLORREF clr)
    {
       const auto clrPrevious = m_clrCurrent;
       m_clrCurrent           = clr;
-      this->Invalidate(TRUE);
-      this->SendParentNotification(CPN_SELCHANGED, clr, clrPrevious);
+      this->RepaintColor();
+      this->NotifyColorChanged(clrPrevious);
    }
 }
 
@@ -249,7 +427,7 @@ void ColorPickerButton::SetDefaultColor(COLORREF clr)
    if (m_clrDefault != clr)
    {
       m_clrDefault = clr;
-      this->Invalidate(TRUE);
+      this->RepaintColor();
    }
 }
 
@@ -298,131 +476,1165 @@ void ColorPickerButton::SetCustomText(CString strText, bool show /* = true */)
 }
 
 
-bool ColorPickerButton::GetShowTooltips() const
+bool ColorPickerButton::GetShowTooltips() const
+{
+   return m_showTooltips;
+}
+
+void ColorPickerButton::SetShowTooltips(bool show)
+{
+   m_showTooltips = show;
+}
+
+
+bool ColorPickerButton::GetTrackSelection() const
+{
+   return m_trackSelection;
+}
+
+void ColorPickerButton::SetTrackSelection(bool trackSelection)
+{
+   m_trackSelection = trackSelection;
+}
+
+std::shared_ptr<TraceSink> ColorPickerButton::GetTraceSink() const
+{
+   return m_pTraceSink;
+}
+
+void ColorPickerButton::SetTraceSink(std::shared_ptr<TraceSink> pTraceSink)
+{
+   m_pTraceSink = std::move(pTraceSink);
+}
+
+ColorPickerButton::InputLatencyStats ColorPickerButton::GetInputLatencyStats(InputLatencyType type) const
+{
+   const auto&       pLatencies = m_pInputLatencies[static_cast<size_t>(type)];
+   InputLatencyStats stats      = {};
+   if (pLatencies)
+   {
+      stats.cSamples = pLatencies->GetCount();
+      stats.p50      = pLatencies->GetValueAtPercentile(50.0);
+      stats.p90      = pLatencies->GetValueAtPercentile(90.0);
+      stats.p99      = pLatencies->GetValueAtPercentile(99.0);
+      stats.p999     = pLatencies->GetValueAtPercentile(99.9);
+      stats.max      = pLatencies->GetMax();
+   }
+   return stats;
+}
+
+UINT32 ColorPickerButton::GetInputLatencyPercentile(InputLatencyType type, double percentile) const
+{
+   const auto& pLatencies = m_pInputLatencies[static_cast<size_t>(type)];
+   return pLatencies ? pLatencies->GetValueAtPercentile(percentile) : 0;
+}
+
+void ColorPickerButton::ResetInputLatencies()
+{
+   for (const auto& pLatencies : m_pInputLatencies)
+   {
+      if (pLatencies)
+      {
+         pLatencies->Reset();
+      }
+   }
+}
+
+const ColorPickerButton::PaintCounters& ColorPickerButton::GetPaintCounters() const
+{
+   return m_paintCounters;
+}
+
+void ColorPickerButton::ResetPaintCounters()
+{
+   m_paintCounters = PaintCounters();
+}
+
+std::shared_ptr<StatsPage> ColorPickerButton::GetStatsPage() const
+{
+   return m_pStatsPage;
+}
+
+void ColorPickerButton::SetStatsPage(std::shared_ptr<StatsPage> pStatsPage)
+{
+   m_pStatsPage = std::move(pStatsPage);
+}
+
+std::shared_ptr<InputRecorder> ColorPickerButton::GetInputRecorder() const
+{
+   return m_pInputRecorder;
+}
+
+void ColorPickerButton::SetInputRecorder(std::shared_ptr<InputRecorder> pInputRecorder)
+{
+   m_pInputRecorder = std::move(pInputRecorder);
+}
+
+InputReplayResult ColorPickerButton::ReplayInput(const InputLog& log)
+{
+   _ASSERTE(this->GetSafeHwnd());
+   _ASSERTE(!m_isPopupActive);
+
+   // Start from the color that the session was recorded with, and put the button's own back
+   // afterward. Neither change is the user's doing, so the parent is not notified of them.
+   const auto clrOriginal = m_clrCurrent;
+   m_clrCurrent    = log.GetInitialColor();
+   m_isPopupActive = true;
+
+   InputReplayResult result;
+   {
+      ColorPickerPopup picker(*this);
+      m_pActivePopup = &picker;
+      result         = picker.Replay(log);
+      m_pActivePopup = nullptr;
+   }
+
+   m_isPopupActive = false;
+   m_clrCurrent    = clrOriginal;
+   ++m_paintCounters.cInvalidations;
+   this->Invalidate(FALSE);
+
+   this->ApplyDeferredSourceChanges();
+   this->AdoptPublishedColorTable();
+   this->AdoptPaletteStoreTable();
+   return result;
+}
+
+ColorPickerButton::MemoryUsage ColorPickerButton::GetMemoryUsage() const
+{
+   MemoryUsageCounter counter(false);
+   this->CountMemoryUsage(counter);
+   return counter.GetUsage();
+}
+
+/* static */ ColorPickerButton::MemoryUsage ColorPickerButton::GetProcessMemoryUsage()
+{
+   MemoryUsageCounter counter(true);
+   {
+      auto&                       registry = GetButtonRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      for (const auto pButton : registry.buttons)
+      {
+         pButton->CountMemoryUsage(counter);
+      }
+   }
+
+   // Indexes are cached for as long as anything holds them, which may be longer than a button.
+   for (const auto& pIndex : ColorTableIndex::GetCachedIndexes())
+   {
+      counter.AddShared(pIndex.get(), pIndex->GetByteSize());
+   }
+   CountFaceCache(counter);  // (which holds faces for as long as it has room for them)
+   return counter.GetUsage();
+}
+
+void ColorPickerButton::RecordInputLatency(InputLatencyType type, UINT32 latency)
+{
+   auto& pLatencies = m_pInputLatencies[static_cast<size_t>(type)];
+   if (!pLatencies)
+   {
+      pLatencies = std::make_unique<LatencyHistogram>();
+   }
+   pLatencies->Record(latency);
+}
+
+
+std::vector<std::pair<COLORREF, CString>> ColorPickerButton::GetColorTable() const
+{
+   if (m_pSharedColorTable)
+   {
+      return *m_pSharedColorTable;
+   }
+   if (!m_pStaticColorTable && !m_pPaletteFile && !m_pColorNames)
+   {
+      return m_colorTable;
+   }
+
+   // The other forms of table have no CStrings of their own, so the copy is built for the caller,
+   // and not kept. (Lazily-resolved names bypass their table's cache, which would only be thrashed.)
+   const auto cColors = this->GetColorCount();
+   ColorTable colorTable(cColors);
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      colorTable[iColor].first  = this->GetColorAt(iColor);
+      colorTable[iColor].second = m_pColorNames ? m_pColorNames->ResolveName(iColor) : this->GetColorNameAt(iColor);
+   }
+   return colorTable;
+}
+
+CSize ColorPickerButton::GetColorTableGrid() const
+{
+   if (m_pStaticColorTable)
+   {
+      return CSize(static_cast<int>(m_pStaticColorTable->cRows),
+                   static_cast<int>(m_pStaticColorTable->cColumns));
+   }
+
+   return ColorPickerSelection::ComputeGrid(this->GetColorCount(), m_cColumns);
+}
+
+void ColorPickerButton::SetColorTable(std::vector<std::pair<COLORREF, CString>> colorTable,
+                                      size_t                                    cColumns /* = kcColorTableColumnsDefault */)
+{
+   if (colorTable.size() <= kcColorTableMax)
+   {
+      this->DetachColorTableSources();
+      m_cColumns          = cColumns;
+      m_colorTable        = std::move(colorTable);
+      m_pStaticColorTable = nullptr;
+      m_pPaletteFile.reset();
+      m_pSharedColorTable.reset();
+      m_pColorNames.reset();
+      m_colors.clear();
+      m_colors.shrink_to_fit();
+
+      this->SetPaletteFromColorTable();
+   }
+   else
+   {
+      _ASSERT_EXPR(false,
+                   TEXT("Too many items in color table; color table will be left unmodified."));
+   }
+}
+
+void ColorPickerButton::SetColorTable(const std::pair<COLORREF, CString>* parrColorTable,
+                                      size_t                              cColors,
+                                      size_t                              cColumns /* = kcColorTableColumnsDefault */)
+{
+   this->DetachColorTableSources();
+   m_cColumns          = cColumns;
+   m_pStaticColorTable = nullptr;
+   m_pPaletteFile.reset();
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+
+   m_colorTable.resize(cColors);
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      m_colorTable[iColor].first  = parrColorTable[iColor].first;
+      m_colorTable[iColor].second = parrColorTable[iColor].second;
+   }
+
+   this->SetPaletteFromColorTable();
+}
+
+void ColorPickerButton::SetColorTable(const COLORREF* parrColorTable,
+                                      size_t          cColors,
+                                      size_t          cColumns /* = kcColorTableColumnsDefault */)
+{
+   this->DetachColorTableSources();
+   m_cColumns          = cColumns;
+   m_pStaticColorTable = nullptr;
+   m_pPaletteFile.reset();
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+
+   m_colorTable.resize(cColors);
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      m_colorTable[iColor].first  = parrColorTable[iColor];
+      m_colorTable[iColor].second = TEXT("");
+   }
+
+   this->SetPaletteFromColorTable();
+}
+
+void ColorPickerButton::SetColorTable(std::vector<COLORREF>                 colors,
+                                      std::shared_ptr<const ColorNameTable> pColorNames,
+                                      size_t                                cColumns /* = kcColorTableColumnsDefault */)
+{
+   _ASSERTE(pColorNames);
+   if (colors.size() <= kcColorTableMax)
+   {
+      this->DetachColorTableSources();
+      m_cColumns          = cColumns;
+      m_colors            = std::move(colors);
+      m_pColorNames       = std::move(pColorNames);
+      m_pStaticColorTable = nullptr;
+      m_pPaletteFile.reset();
+      m_pSharedColorTable.reset();
+      m_colorTable.clear();
+      m_colorTable.shrink_to_fit();
+
+      this->SetPaletteFromColorTable();
+   }
+   else
+   {
+      _ASSERT_EXPR(false,
+                   TEXT("Too many items in color table; color table will be left unmodified."));
+   }
+}
+
+void ColorPickerButton::SetColorTable(std::shared_ptr<const PaletteFile> pPaletteFile)
+{
+   _ASSERTE(pPaletteFile);
+   _ASSERTE(pPaletteFile->GetColorCount() <= kcColorTableMax);  // guaranteed by PaletteFile's validation
+
+   this->DetachColorTableSources();
+   const auto cColumns = pPaletteFile->GetColumnCount();
+   m_cColumns          = (cColumns != 0) ? cColumns : kcColorTableColumnsDefault;
+   m_pPaletteFile      = std::move(pPaletteFile);
+   m_pStaticColorTable = nullptr;
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+   m_colorTable.clear();
+   m_colorTable.shrink_to_fit();
+
+   this->SetPaletteFromColorTable();
+}
+
+void ColorPickerButton::SetColorTable(const StaticColorTableData& staticColorTable)
+{
+   _ASSERTE(staticColorTable.cColors <= kcColorTableMax);  // guaranteed by StaticColorTable's static assertions
+
+   this->DetachColorTableSources();
+   m_cColumns          = staticColorTable.cColumns;
+   m_pStaticColorTable = &staticColorTable;
+   m_pPaletteFile.reset();
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+   m_colorTable.clear();
+   m_colorTable.shrink_to_fit();
+
+   this->SetPaletteFromColorTable();
+}
+
+void ColorPickerButton::SetColorTable(std::shared_ptr<PaletteSource> pPaletteSource)
+{
+   _ASSERTE(pPaletteSource);
+   _ASSERTE(pPaletteSource->GetColorTable().size() <= kcColorTableMax);  // guaranteed by the loaders
+
+   this->DetachColorTableSources();
+   const auto cColumns = pPaletteSource->GetColumnCount();
+   m_cColumns          = (cColumns != 0) ? cColumns : kcColorTableColumnsDefault;
+   m_colorTable        = pPaletteSource->GetColorTable();
+   m_pStaticColorTable = nullptr;
+   m_pPaletteFile.reset();
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+   m_pPaletteSource    = std::move(pPaletteSource);
+   m_pPaletteSource->Subscribe(this);
+
+   this->SetPaletteFromColorTable();
+}
+
+void ColorPickerButton::SetColorTable(std::shared_ptr<const SharedPaletteStore> pPaletteStore)
+{
+   _ASSERTE(pPaletteStore);
+
+   // Start with an empty table, which is replaced by the store's current table, if it has one.
+   this->DetachColorTableSources();
+   m_cColumns          = kcColorTableColumnsDefault;
+   m_pStaticColorTable = nullptr;
+   m_pPaletteFile.reset();
+   m_pSharedColorTable.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+   m_colorTable.clear();
+   m_colorTable.shrink_to_fit();
+   m_pPaletteStore     = std::move(pPaletteStore);
+   m_storeGeneration   = 0;
+
+   this->SetPaletteFromColorTable();
+   this->AdoptPaletteStoreTable();
+}
+
+void ColorPickerButton::PublishColorTable(std::shared_ptr<const ColorTable> pColorTable,
+                                          size_t                            cColumns /* = kcColorTableColumnsDefault */)
+{
+   _ASSERTE(pColorTable);
+   if (pColorTable->size() > kcColorTableMax)
+   {
+      _ASSERT_EXPR(false,
+                   TEXT("Too many items in color table; color table will not be published."));
+      return;
+   }
+
+   // Prepare everything here, on the publishing thread, so that adopting the table
+   // only swaps pointers. (GDI palettes can be used by any thread of the process,
+   // and ColorTableIndex::Acquire() is thread-safe.)
+   auto                  pPublished = std::make_shared<PublishedColorTable>();
+   std::vector<COLORREF> clrs(pColorTable->size());
+   std::transform(pColorTable->begin(), pColorTable->end(), clrs.begin(), [](const ColorTable::value_type& entry)
+   {
+      return entry.first;
+   });
+   if (!clrs.empty())
+   {
+      CreatePaletteFromColors(pPublished->palette, clrs.data(), clrs.size());
+   }
+   pPublished->pColorTableIndex = ColorTableIndex::Acquire(clrs);
+   pPublished->pColorTable      = std::move(pColorTable);
+   pPublished->cColumns         = cColumns;
+
+   // Replace whatever was published before (which, if it was never adopted, is freed here),
+   // and then ask the button to repaint, which adopts the new table.
+   m_pPublishSlot->Publish(std::move(pPublished));
+   if (const auto hWnd = this->GetSafeHwnd())
+   {
+      ::InvalidateRect(hWnd, nullptr, FALSE);
+   }
+}
+
+void ColorPickerButton::InsertColor(size_t index, COLORREF clr, CString strName /* = CString() */)
+{
+   const auto cColors = this->GetColorCount();
+   if ((index <= cColors) && (cColors < kcColorTableMax))
+   {
+      ColorTableDiff diff;
+      diff.Insert(index, clr, std::move(strName));
+      this->EditColorTable(std::move(diff));
+   }
+   else
+   {
+      _ASSERT_EXPR(false,
+                   TEXT("Invalid index, or too many items in color table; color table will be left unmodified."));
+   }
+}
+
+void ColorPickerButton::RemoveColor(size_t index)
+{
+   if (index < this->GetColorCount())
+   {
+      ColorTableDiff diff;
+      diff.Remove(index);
+      this->EditColorTable(std::move(diff));
+   }
+   else
+   {
+      _ASSERT_EXPR(false, TEXT("Invalid index; color table will be left unmodified."));
+   }
+}
+
+void ColorPickerButton::UpdateColor(size_t index, COLORREF clr)
+{
+   if (index < this->GetColorCount())
+   {
+      ColorTableDiff diff;
+      diff.Recolor(index, clr);
+      this->EditColorTable(std::move(diff));
+   }
+   else
+   {
+      _ASSERT_EXPR(false, TEXT("Invalid index; color table will be left unmodified."));
+   }
+}
+
+void ColorPickerButton::RenameColor(size_t index, CString strName)
+{
+   if (index < this->GetColorCount())
+   {
+      ColorTableDiff diff;
+      diff.Rename(index, std::move(strName));
+      this->EditColorTable(std::move(diff));
+   }
+   else
+   {
+      _ASSERT_EXPR(false, TEXT("Invalid index; color table will be left unmodified."));
+   }
+}
+
+UINT ColorPickerButton::GetColorTableVersion() const
+{
+   return m_colorTableVersion;
+}
+
+int ColorPickerButton::GetNearestColorIndex(COLORREF clr) const
+{
+   _ASSERTE((clr & 0xFF000000) == 0);  // must be an RGB value, not CLR_DEFAULT or a palette index
+   const auto pColorTableIndex = this->GetColorTableIndex();
+   return pColorTableIndex ? static_cast<int>(pColorTableIndex->FindNearest(clr))
+                           : -1;
+}
+
+int ColorPickerButton::FindColorIndex(COLORREF clr) const
+{
+   // A static table's lookup index was built at compile time.
+   if (m_pStaticColorTable)
+   {
+      const auto index = m_pStaticColorTable->FindColor(clr);
+      return (index != StaticColorTableData::kInvalidIndex) ? static_cast<int>(index) : -1;
+   }
+
+   // A palette file's own search index avoids having to build a hash table of the colors,
+   // but a structured table's lookups are computed directly, which is faster still.
+   if (m_pPaletteFile && m_pPaletteFile->HasSearchIndex() &&
+       (this->GetColorTableStructure() == ColorTableStructure::Irregular))
+   {
+      const auto index = m_pPaletteFile->FindColor(clr);
+      return (index != PaletteFile::kInvalidIndex) ? static_cast<int>(index) : -1;
+   }
+
+   if (const auto pColorTableIndex = this->GetColorTableIndex())
+   {
+      const auto index = pColorTableIndex->FindExact(clr);
+      if (index != ColorTableIndex::kInvalidIndex)
+      {
+         return static_cast<int>(index);
+      }
+   }
+   return -1;
+}
+
+ColorPickerButton::ColorTableStructure ColorPickerButton::GetColorTableStructure() const
+{
+   if (const auto pColorTableIndex = this->GetColorTableIndex())
+   {
+      switch (pColorTableIndex->GetStructure().GetKind())
+      {
+         case StructuredLookup::Kind::Lattice:
+            return ColorTableStructure::Lattice;
+         case StructuredLookup::Kind::GrayRamp:
+            return ColorTableStructure::GrayRamp;
+         default:
+            break;
+      }
+   }
+   return ColorTableStructure::Irregular;
+}
+
+
+ColorPickerButton::ColorTableOrder ColorPickerButton::GetColorTableOrder() const
+{
+   return m_colorTableOrder;
+}
+
+void ColorPickerButton::SetColorTableOrder(ColorTableOrder order)
+{
+   m_colorTableOrder = order;
+}
+
+bool ColorPickerButton::IsDisplayOrderStale() const
+{
+   return !m_pDisplayOrder ||
+          (m_pDisplayOrder->GetVersion() != m_colorTableVersion) ||
+          (m_pDisplayOrder->GetOrder()   != m_colorTableOrder);
+}
+
+bool ColorPickerButton::IsNameSearchIndexStale() const
+{
+   return !m_pNameSearchIndex || (m_pNameSearchIndex->GetVersion() != m_colorTableVersion);
+}
+
+bool ColorPickerButton::HasColorNames() const
+{
+   if (!this->IsNameSearchIndexStale())
+   {
+      return !m_pNameSearchIndex->IsEmpty();
+   }
+   if (m_pColorNames)
+   {
+      return true;
+   }
+
+   // Look for a name in whichever form the table holds them, without copying any of them.
+   const auto cColors = this->GetColorCount();
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      const auto hasName = m_pStaticColorTable ? (m_pStaticColorTable->ppszNames[iColor] && (*m_pStaticColorTable->ppszNames[iColor] != TEXT('\0')))
+                         : m_pSharedColorTable ? !(*m_pSharedColorTable)[iColor].second.IsEmpty()
+                         : m_pPaletteFile      ? (m_pPaletteFile->GetNameLength(iColor) != 0)
+                                               : !m_colorTable[iColor].second.IsEmpty();
+      if (hasName)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+const DisplayOrder& ColorPickerButton::GetDisplayOrder()
+{
+   // (The pop-up window records whether the cache was up to date in the stats page, when it opens.)
+   if (this->IsDisplayOrderStale())
+   {
+      // Use the palette file's precomputed order, if it has the one that we want.
+      if (m_pPaletteFile && (m_pPaletteFile->GetSortOrder() == m_colorTableOrder) && m_pPaletteFile->GetSortedIndices())
+      {
+         m_pDisplayOrder = std::make_shared<const DisplayOrder>(m_pPaletteFile->GetSortedIndices(),
+                                                                m_pPaletteFile->GetColorCount(),
+                                                                m_colorTableOrder,
+                                                                m_colorTableVersion);
+      }
+      else
+      {
+         const auto            cColors = this->GetColorCount();
+         std::vector<COLORREF> clrs(cColors);
+         for (size_t iColor = 0; iColor < cColors; ++iColor)
+         {
+            clrs[iColor] = this->GetColorAt(iColor);
+         }
+         m_pDisplayOrder = std::make_shared<const DisplayOrder>(clrs, m_colorTableOrder, m_colorTableVersion);
+      }
+   }
+   return *m_pDisplayOrder;
+}
+
+const NameSearchIndex& ColorPickerButton::GetNameSearchIndex()
+{
+   // (As with the display order, the lookup is recorded by the pop-up window, once per session.)
+   if (this->IsNameSearchIndexStale())
+   {
+      // Every name is needed once, so lazily-resolved names bypass their table's cache. (The
+      // index copies each name into its own pool as it is resolved, so none of them is kept.)
+      const auto getName = [this](size_t iColor)
+      {
+         return m_pColorNames ? m_pColorNames->ResolveName(iColor) : this->GetColorNameAt(iColor);
+      };
+      m_pNameSearchIndex = std::make_shared<const NameSearchIndex>(this->GetColorCount(), getName, m_colorTableVersion);
+   }
+   return *m_pNameSearchIndex;
+}
+
+size_t ColorPickerButton::GetColorCount() const
+{
+   return m_pStaticColorTable ? m_pStaticColorTable->cColors
+        : m_pSharedColorTable ? m_pSharedColorTable->size()
+        : m_pPaletteFile      ? m_pPaletteFile->GetColorCount()
+        : m_pColorNames       ? m_colors.size()
+                              : m_colorTable.size();
+}
+
+COLORREF ColorPickerButton::GetColorAt(size_t index) const
+{
+   return m_pStaticColorTable ? m_pStaticColorTable->pColors[index]
+        : m_pSharedColorTable ? (*m_pSharedColorTable)[index].first
+        : m_pPaletteFile      ? m_pPaletteFile->GetColor(index)
+        : m_pColorNames       ? m_colors[index]
+                              : m_colorTable[index].first;
+}
+
+CString ColorPickerButton::GetColorNameAt(size_t index) const
+{
+   return m_pStaticColorTable ? CString(m_pStaticColorTable->ppszNames[index])
+        : m_pSharedColorTable ? (*m_pSharedColorTable)[index].second
+        : m_pPaletteFile      ? CString(m_pPaletteFile->GetName(index))
+        : m_pColorNames       ? m_pColorNames->GetName(index)
+                              : m_colorTable[index].second;
+}
+
+const ColorTableIndex* ColorPickerButton::GetColorTableIndex() const
+{
+   if (!m_pColorTableIndex && m_pStaticColorTable)
+   {
+      m_pColorTableIndex = ColorTableIndex::Acquire(*m_pStaticColorTable);
+   }
+   return m_pColorTableIndex.get();
+}
+
+
+const CPalette& ColorPickerButton::GetPalette() const
+{
+   return m_palette;
+}
+
+CPalette& ColorPickerButton::GetPalette()
+{
+   return m_palette;
+}
+
+void ColorPickerButton::SetPaletteFromColorTable()
+{
+   // This is called whenever the color table changes, so any cached display order is now stale.
+   ++m_colorTableVersion;
+
+   // Delete the existing CPalette object, if any.
+   if (m_palette.GetSafeHandle())
+   {
+      VERIFY(m_palette.DeleteObject());
+   }
+   _ASSERTE(!m_palette.GetSafeHandle());
+
+   // Gather the colors. (These are read through the accessors, rather than from GetColorTable(),
+   // so that a mapped palette file is never copied into a table of CStrings. A static table's
+   // colors are already in an array, so they are used where they are.)
+   const auto            cColors = this->GetColorCount();
+   std::vector<COLORREF> clrsGathered;
+   if (!m_pStaticColorTable)
+   {
+      clrsGathered.resize(cColors);
+      for (size_t iColor = 0; iColor < cColors; ++iColor)
+      {
+         clrsGathered[iColor] = this->GetColorAt(iColor);
+      }
+   }
+   const auto clrs = m_pStaticColorTable ? m_pStaticColorTable->pColors : clrsGathered.data();
+
+   // Create a new CPalette object.
+   _ASSERTE(cColors <= kcColorTableMax);
+   if (cColors > 0)
+   {
+      CreatePaletteFromColors(m_palette, clrs, cColors);
+      ++m_paintCounters.cGdiObjectsCreated;
+   }
+
+   // Acquire the index for the color table. This detects any regular structure in the table
+   // (so that lookups can be computed directly), but otherwise defers building anything until
+   // it is needed. It will be shared with any other buttons that are using the same colors.
+   // A static table has its own lookup index, so even acquiring one is put off until needed.
+   if (m_pStaticColorTable)
+   {
+      m_pColorTableIndex.reset();
+   }
+   else
+   {
+      m_pColorTableIndex = ColorTableIndex::Acquire(clrsGathered);
+   }
+}
+
+void ColorPickerButton::ApplyColorTableDiff(const std::shared_ptr<const ColorTableDiff>& pDiff)
+{
+   _ASSERTE(pDiff);
+   _ASSERTE(!m_pStaticColorTable && !m_pPaletteFile && !m_pSharedColorTable && !m_pColorNames);
+
+   const auto cColorsOld = m_colorTable.size();
+   pDiff->ApplyTo(m_colorTable);
+   const auto cColors    = m_colorTable.size();
+   _ASSERTE(cColors <= kcColorTableMax);
+
+   // A palette cannot be resized to or from being empty, so that takes a full rebuild.
+   if (!m_palette.GetSafeHandle() || (cColors == 0))
+   {
+      this->SetPaletteFromColorTable();
+      return;
+   }
+
+   // The cached display order is now stale, but if it was up to date, it can be edited along with
+   // the table below. (The nearest-neighbor order cannot be edited, so it is left to be recomputed.)
+   const auto canEditDisplayOrder = m_pDisplayOrder                                          &&
+                                    (m_pDisplayOrder->GetVersion() == m_colorTableVersion)   &&
+                                    (m_pDisplayOrder->GetOrder()   == m_colorTableOrder)     &&
+                                    (m_colorTableOrder != ColorTableOrder::NearestNeighbor);
+   ++m_colorTableVersion;
+
+   // Entries from the first insertion or removal onward have moved, so they must all be rewritten,
+   // but recolored entries before that can be rewritten one at a time. (No insertion or removal
+   // moves an entry that comes before it, so the indices of those recolors are still correct.)
+   auto iFirstMoved = cColors;
+   for (const auto& edit : pDiff->GetEdits())
+   {
+      if ((edit.operation == ColorTableDiff::Operation::Insert) ||
+          (edit.operation == ColorTableDiff::Operation::Remove))
+      {
+         iFirstMoved = std::min(iFirstMoved, edit.index);
+      }
+   }
+   const auto ToPaletteEntry = [](COLORREF clr)
+   {
+      return PALETTEENTRY{ GetRValue(clr), GetGValue(clr), GetBValue(clr), 0 };
+   };
+   for (const auto& edit : pDiff->GetEdits())
+   {
+      if ((edit.operation == ColorTableDiff::Operation::Recolor) && (edit.index < iFirstMoved))
+      {
+         auto entry = ToPaletteEntry(m_colorTable[edit.index].first);
+         VERIFY(m_palette.SetPaletteEntries(static_cast<UINT>(edit.index), 1, &entry) == 1);
+      }
+   }
+   if (cColors != cColorsOld)
+   {
+      VERIFY(m_palette.ResizePalette(static_cast<UINT>(cColors)));
+   }
+   if (iFirstMoved < cColors)
+   {
+      std::vector<PALETTEENTRY> entries(cColors - iFirstMoved);
+      for (size_t iColor = iFirstMoved; iColor < cColors; ++iColor)
+      {
+         entries[iColor - iFirstMoved] = ToPaletteEntry(m_colorTable[iColor].first);
+      }
+      VERIFY(m_palette.SetPaletteEntries(static_cast<UINT>(iFirstMoved),
+                                         static_cast<UINT>(entries.size()),
+                                         entries.data()) == entries.size());
+   }
+
+   // Derive the new index from the old one, which edits its hash of exact colors in place
+   // (or rather, in a copy), instead of rebuilding it from scratch.
+   m_pColorTableIndex = ColorTableIndex::Update(m_pColorTableIndex, pDiff);
+
+   if (canEditDisplayOrder)
+   {
+      _ASSERTE(m_pColorTableIndex);  // (since the table is not empty)
+      m_pDisplayOrder = std::make_shared<const DisplayOrder>(*m_pDisplayOrder,
+                                                             *pDiff,
+                                                             m_pColorTableIndex->GetColors(),
+                                                             m_colorTableVersion);
+   }
+}
+
+void ColorPickerButton::PrepareColorTableForEdit()
+{
+   this->DetachColorTableSources();
+   if (m_pStaticColorTable || m_pPaletteFile || m_pSharedColorTable || m_pColorNames)
+   {
+      // Acquire the index first (which is deferred for a static table), so that it can be
+      // updated by the edit. This, and the copy, are only needed the first time.
+      this->GetColorTableIndex();
+      m_colorTable = this->GetColorTable();
+      m_pStaticColorTable = nullptr;
+      m_pPaletteFile.reset();
+      m_pSharedColorTable.reset();
+      m_pColorNames.reset();
+      m_colors.clear();
+      m_colors.shrink_to_fit();
+   }
+}
+
+void ColorPickerButton::EditColorTable(ColorTableDiff diff)
+{
+   _ASSERTE(!m_isPopupActive);  // the pop-up window refers to the entries by index
+
+   this->PrepareColorTableForEdit();
+   this->ApplyColorTableDiff(std::make_shared<const ColorTableDiff>(std::move(diff)));
+}
+
+void ColorPickerButton::DetachColorTableSources()
+{
+   if (m_pPaletteSource)
+   {
+      m_pPaletteSource->Unsubscribe(this);
+      m_pPaletteSource.reset();
+   }
+   m_pPaletteStore.reset();
+   m_storeGeneration = 0;
+   m_deferredDiffs.clear();
+   m_pPublishSlot->Clear();
+}
+
+void ColorPickerButton::AdoptPublishedColorTable()
+{
+   // The pop-up window keeps the table that it opened with; it is adopted once the window closes.
+   if (m_isPopupActive || m_pPublishSlot->IsEmpty())
+   {
+      return;
+   }
+
+   // Take the table out of the slot, which leaves this thread as its only owner.
+   const auto pPublished = m_pPublishSlot->Take();
+   if (!pPublished)
+   {
+      return;
+   }
+
+   // (This does not call DetachColorTableSources(), which would discard any table
+   // that was published since this one was taken out of the slot.)
+   if (m_pPaletteSource)
+   {
+      m_pPaletteSource->Unsubscribe(this);
+      m_pPaletteSource.reset();
+      m_deferredDiffs.clear();
+   }
+   m_pPaletteStore.reset();
+   m_storeGeneration   = 0;
+   m_cColumns          = pPublished->cColumns;
+   m_pSharedColorTable = std::move(pPublished->pColorTable);
+   m_pStaticColorTable = nullptr;
+   m_pPaletteFile.reset();
+   m_pColorNames.reset();
+   m_colors.clear();
+   m_colors.shrink_to_fit();
+   m_colorTable.clear();
+   m_colorTable.shrink_to_fit();
+
+   // This does the work of SetPaletteFromColorTable(), with what was prepared in advance.
+   ++m_colorTableVersion;
+   if (m_palette.GetSafeHandle())
+   {
+      VERIFY(m_palette.DeleteObject());
+   }
+   if (pPublished->palette.GetSafeHandle())
+   {
+      VERIFY(m_palette.Attach(pPublished->palette.Detach()));
+   }
+   m_pColorTableIndex = std::move(pPublished->pColorTableIndex);
+}
+
+void ColorPickerButton::AdoptPaletteStoreTable()
 {
-   return m_showTooltips;
+   // The pop-up window keeps the table that it opened with; it is adopted once the window closes.
+   // (Checking the generation first only reads the store's header, so this is cheap when nothing
+   // has changed, which is almost every time that the button paints.)
+   if (!m_pPaletteStore || m_isPopupActive || (m_pPaletteStore->GetGeneration() == m_storeGeneration))
+   {
+      return;
+   }
+
+   // If the table cannot be mapped, then the one that is displayed is kept, and it is tried again
+   // the next time around.
+   UINT64 generation;
+   auto   pPaletteFile = m_pPaletteStore->GetPaletteFile(&generation);
+   if (!pPaletteFile || (generation == m_storeGeneration))
+   {
+      return;
+   }
+   _ASSERTE(pPaletteFile->GetColorCount() <= kcColorTableMax);  // guaranteed by PaletteFile's validation
+
+   const auto cColumns = pPaletteFile->GetColumnCount();
+   m_cColumns          = (cColumns != 0) ? cColumns : kcColorTableColumnsDefault;
+   m_pPaletteFile      = std::move(pPaletteFile);
+   m_storeGeneration   = generation;
+
+   this->SetPaletteFromColorTable();
 }
 
-void ColorPickerButton::SetShowTooltips(bool show)
+void ColorPickerButton::OnPaletteSourceChanged(const std::shared_ptr<const ColorTableDiff>& pDiff)
 {
-   m_showTooltips = show;
-}
+   _ASSERTE(m_pPaletteSource);
 
+   // The pop-up window refers to the color table by index, so it must not change underneath it.
+   if (m_isPopupActive)
+   {
+      m_deferredDiffs.push_back(pDiff);
+      return;
+   }
 
-bool ColorPickerButton::GetTrackSelection() const
-{
-   return m_trackSelection;
+   const auto cColumns = m_pPaletteSource->GetColumnCount();
+   m_cColumns          = (cColumns != 0) ? cColumns : kcColorTableColumnsDefault;
+   if (pDiff)
+   {
+      this->ApplyColorTableDiff(pDiff);
+   }
+   else
+   {
+      m_colorTable = m_pPaletteSource->GetColorTable();
+      this->SetPaletteFromColorTable();
+   }
 }
 
-void ColorPickerButton::SetTrackSelection(bool trackSelection)
+void ColorPickerButton::ApplyDeferredSourceChanges()
 {
-   m_trackSelection = trackSelection;
+   if (m_deferredDiffs.empty())
+   {
+      return;
+   }
+
+   // If the table was replaced at any point, then it is simplest to take the latest table
+   // (which already includes all of the changes); otherwise, apply the diffs in order.
+   const auto wasReplaced = std::find(m_deferredDiffs.begin(), m_deferredDiffs.end(), nullptr) != m_deferredDiffs.end();
+   auto       diffs       = std::move(m_deferredDiffs);
+   m_deferredDiffs.clear();
+   if (wasReplaced)
+   {
+      this->OnPaletteSourceChanged(nullptr);
+   }
+   else
+   {
+      for (const auto& pDiff : diffs)
+      {
+         this->OnPaletteSourceChanged(pDiff);
+      }
+   }
 }
 
+// ------------------------------
+// Batch Updates
+// ------------------------------
 
-const std::vector<std::pair<COLORREF, CString>>& ColorPickerButton::GetColorTable() const
+ColorPickerButton::BatchUpdate::BatchUpdate(BatchNotification notification)
 {
-   return m_colorTable;
+   if (t_batch.depth++ == 0)
+   {
+      t_batch.notification = notification;
+   }
 }
 
-CSize ColorPickerButton::GetColorTableGrid() const
+ColorPickerButton::BatchUpdate::~BatchUpdate()
 {
-   const auto cColors  = this->GetColorTable().size();
-   const auto cColumns = m_cColumns;
-   const auto cRows    = ((cColors / cColumns) + ((cColors % cColumns) != 0));
-   return CSize(cRows, cColumns);
+   _ASSERTE(t_batch.depth > 0);
+   if (--t_batch.depth == 0)
+   {
+      ColorPickerButton::EndBatch();
+   }
 }
 
-void ColorPickerButton::SetColorTable(std::vector<std::pair<COLORREF, CString>> colorTable,
-                                      size_t                                    cColumns /* = kcColorTableColumnsDefault */)
+void ColorPickerButton::RepaintColor()
 {
-   if (colorTable.size() <= kcColorTableMax)
+   if (t_batch.depth > 0)
    {
-      m_cColumns   = cColumns;
-      m_colorTable = std::move(colorTable);
-
-      this->SetPaletteFromColorTable();
+      this->JoinBatch();
+      m_isRepaintDeferred = true;
    }
    else
    {
-      _ASSERT_EXPR(false,
-                   TEXT("Too many items in color table; color table will be left unmodified."));
+      ++m_paintCounters.cInvalidations;
+      this->Invalidate(FALSE);
    }
 }
 
-void ColorPickerButton::SetColorTable(const std::pair<COLORREF, CString>* parrColorTable,
-                                      size_t                              cColors,
-                                      size_t                              cColumns /* = kcColorTableColumnsDefault */)
+void ColorPickerButton::NotifyColorChanged(COLORREF clrPrevious)
 {
-   m_cColumns = cColumns;
-
-   m_colorTable.resize(cColors);
-   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   if (t_batch.depth > 0)
    {
-      m_colorTable[iColor].first  = parrColorTable[iColor].first;
-      m_colorTable[iColor].second = parrColorTable[iColor].second;
+      this->JoinBatch();
+      if (!m_isNotifyDeferred)
+      {
+         m_isNotifyDeferred = true;
+         m_clrBeforeBatch   = clrPrevious;
+      }
+   }
+   else
+   {
+      this->SendParentNotification(CPN_SELCHANGED, m_clrCurrent, clrPrevious);
    }
-
-   this->SetPaletteFromColorTable();
 }
 
-void ColorPickerButton::SetColorTable(const COLORREF* parrColorTable,
-                                      size_t          cColors,
-                                      size_t          cColumns /* = kcColorTableColumnsDefault */)
+void ColorPickerButton::JoinBatch()
 {
-   m_cColumns = cColumns;
+   _ASSERTE(!m_hWnd || (::GetWindowThreadProcessId(m_hWnd, nullptr) == ::GetCurrentThreadId()));
 
-   m_colorTable.resize(cColors);
-   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   if (!m_isInBatch)
    {
-      m_colorTable[iColor].first  = parrColorTable[iColor];
-      m_colorTable[iColor].second = TEXT("");
+      m_isInBatch = true;
+      t_batch.buttons.push_back(this);
    }
-
-   this->SetPaletteFromColorTable();
-}
-
-
-const CPalette& ColorPickerButton::GetPalette() const
-{
-   return m_palette;
 }
 
-CPalette& ColorPickerButton::GetPalette()
+/* static */ void ColorPickerButton::EndBatch()
 {
-   return m_palette;
-}
+   // Take the buttons out of the batch before doing anything that could call back into them
+   // (a parent's handler may well start another batch, or destroy some of the buttons).
+   const auto buttons      = std::move(t_batch.buttons);
+   const auto notification = t_batch.notification;
+   t_batch.buttons.clear();
 
-void ColorPickerButton::SetPaletteFromColorTable()
-{
-   // Delete the existing CPalette object, if any.
-   if (m_palette.GetSafeHandle())
+   // Invalidate each button that changed, once. Nothing is painted yet: the buttons are
+   // all painted together, in the next pass of the message loop.
+   struct Change
    {
-      VERIFY(m_palette.DeleteObject());
+      ColorPickerButton* pButton;
+      HWND               hwndButton;
+      HWND               hwndParent;
+      size_t             iParent;
+      COLORREF           clrCurrent;
+      COLORREF           clrPrevious;
+   };
+   SUSPEND_ALLOCATION_CHECKS();  // (a batch is ended by the caller's code, not by the pop-up window's input)
+   std::vector<Change>              changes;
+   std::unordered_map<HWND, size_t> parents;  // (each parent, with the order in which its first button changed)
+   for (const auto pButton : buttons)
+   {
+      pButton->m_isInBatch = false;
+      if (!pButton->GetSafeHwnd())
+      {
+         // (The window was destroyed during the batch; there is nothing left to repaint or notify.)
+         pButton->m_isRepaintDeferred = false;
+         pButton->m_isNotifyDeferred  = false;
+         continue;
+      }
+      if (pButton->m_isRepaintDeferred)
+      {
+         pButton->m_isRepaintDeferred = false;
+         ++pButton->m_paintCounters.cInvalidations;
+         pButton->Invalidate(FALSE);
+      }
+      if (pButton->m_isNotifyDeferred)
+      {
+         pButton->m_isNotifyDeferred = false;
+         if (pButton->m_clrCurrent != pButton->m_clrBeforeBatch)
+         {
+            const auto hwndParent = ::GetParent(pButton->m_hWnd);
+            changes.push_back({ pButton,
+                                pButton->m_hWnd,
+                                hwndParent,
+                                parents.emplace(hwndParent, parents.size()).first->second,
+                                pButton->m_clrCurrent,
+                                pButton->m_clrBeforeBatch });
+         }
+      }
    }
-   _ASSERTE(!m_palette.GetSafeHandle());
 
-   const auto& colors  = this->GetColorTable();
-   const auto  cColors = colors.size();
-   _ASSERTE(cColors <= kcColorTableMax);
-   if (cColors > 0)
+   // Then notify the parents. (A button that was destroyed by the handler of an earlier
+   // notification is skipped, since there is no one left to notify on its behalf.)
+   switch (notification)
    {
-      auto lp            = std::make_unique<char[]>(sizeof(LOGPALETTE) +
-                                                    (sizeof(PALETTEENTRY) * cColors));
-      auto plp           = reinterpret_cast<LOGPALETTE*>(&lp[0]);
-      plp->palVersion    = 0x300;
-      plp->palNumEntries = static_cast<decltype(plp->palNumEntries)>(cColors);
-      for (size_t iColor = 0; iColor < cColors; ++iColor)
+      case BatchNotification::PerButton:
       {
-         plp->palPalEntry[iColor].peRed   = GetRValue(colors[iColor].first);
-         plp->palPalEntry[iColor].peGreen = GetGValue(colors[iColor].first);
-         plp->palPalEntry[iColor].peBlue  = GetBValue(colors[iColor].first);
-         plp->palPalEntry[iColor].peFlags = 0;
+         for (const auto& change : changes)
+         {
+            if (CWnd::FromHandlePermanent(change.hwndButton) == change.pButton)
+            {
+               change.pButton->SendParentNotification(CPN_SELCHANGED, change.clrCurrent, change.clrPrevious);
+            }
+         }
+         break;
       }
+      case BatchNotification::Aggregated:
+      {
+         // Send each parent one notification, listing the changes to its buttons. The changes are
+         // grouped by parent (keeping each parent's in the order that they were made, and the parents
+         // in the order that their first buttons changed, rather than in the arbitrary order of their
+         // handles), and each notification is sent from the first of its buttons, so that the parent
+         // can route it by that button's ID, as it would route CPN_SELCHANGED.
+         std::stable_sort(changes.begin(), changes.end(), [](const Change& change1, const Change& change2)
+                          {
+                             return change1.iParent < change2.iParent;
+                          });
+         std::vector<NMCOLORPICKERBUTTON> nmcpbs;
+         nmcpbs.reserve(changes.size());
+         for (auto iChange = changes.begin(); iChange != changes.end(); )
+         {
+            const auto hwndParent = iChange->hwndParent;
+            const auto iEnd       = std::find_if(iChange, changes.end(), [hwndParent](const Change& change)
+                                                 {
+                                                    return change.hwndParent != hwndParent;
+                                                 });
+
+            nmcpbs.clear();
+            ColorPickerButton* pSender = nullptr;
+            for (; iChange != iEnd; ++iChange)
+            {
+               const auto& change = *iChange;
+               if (hwndParent && (CWnd::FromHandlePermanent(change.hwndButton) == change.pButton))
+               {
+                  NMCOLORPICKERBUTTON nmcpb;
+                  nmcpb.hdr.code     = CPN_SELCHANGED;
+                  nmcpb.hdr.hwndFrom = change.hwndButton;
+                  nmcpb.hdr.idFrom   = ::GetDlgCtrlID(change.hwndButton);
+                  nmcpb.clrCurrent   = change.clrCurrent;
+                  nmcpb.clrPrevious  = change.clrPrevious;
+                  nmcpbs.push_back(nmcpb);
+                  if (!pSender)
+                  {
+                     pSender = change.pButton;
+                  }
+               }
+            }
+            if (nmcpbs.empty())
+            {
+               continue;
+            }
 
-      // Create a new CPalette object.
-      VERIFY(m_palette.CreatePalette(plp));
-      _ASSERTE(m_palette.GetSafeHandle());
+            // One message is sent, so it is counted once, by the button that sends it (before it is
+            // sent, since the parent's handler may destroy the button).
+            ++pSender->m_paintCounters.cNotifications;
+            if (pSender->m_pStatsPage)
+            {
+               pSender->m_pStatsPage->RecordNotification();
+            }
+
+            NMCOLORPICKERBATCH nmcpbatch;
+            nmcpbatch.hdr.code     = CPN_BATCHCHANGED;
+            nmcpbatch.hdr.hwndFrom = nmcpbs.front().hdr.hwndFrom;
+            nmcpbatch.hdr.idFrom   = nmcpbs.front().hdr.idFrom;
+            nmcpbatch.cChanges     = nmcpbs.size();
+            nmcpbatch.pChanges     = nmcpbs.data();
+            ::SendMessage(hwndParent,
+                          WM_NOTIFY,
+                          static_cast<WPARAM>(nmcpbatch.hdr.idFrom),
+                          reinterpret_cast<LPARAM>(&nmcpbatch));
+         }
+         break;
+      }
    }
 }
 
@@ -430,13 +1642,110 @@ void ColorPickerButton::SetPaletteFromColorTable()
 // Helper Methods
 // ------------------------------
 
+void ColorPickerButton::CountMemoryUsage(MemoryUsageCounter& counter) const
+{
+   counter.AddButton();
+   counter.AddPrivate(sizeof(*this), (m_palette.GetSafeHandle() ? 1 : 0));
+
+   // The color table, in whichever form the button holds it. (A static table is part of the
+   // module's image, so it takes up no memory of its own.)
+   counter.AddPrivate(GetVectorByteSize(m_colorTable) + GetVectorByteSize(m_colors));
+   for (const auto& entry : m_colorTable)
+   {
+      counter.AddString(entry.second);
+   }
+   if (m_pColorNames)
+   {
+      counter.AddShared(m_pColorNames.get(), m_pColorNames->GetByteSize());
+   }
+   if (m_pPaletteFile && counter.AddShared(m_pPaletteFile.get(), m_pPaletteFile->GetByteSize()))
+   {
+      counter.AddMapped(m_pPaletteFile->GetMappedSize());
+   }
+   if (m_pSharedColorTable)
+   {
+      CountSharedColorTable(counter, *m_pSharedColorTable);
+   }
+   if (m_pPaletteSource && counter.AddShared(m_pPaletteSource.get(), sizeof(PaletteSource)) && m_pPaletteSource->m_pColorTable)
+   {
+      CountSharedColorTable(counter, *m_pPaletteSource->m_pColorTable);
+   }
+   if (m_pPaletteStore)
+   {
+      counter.AddShared(m_pPaletteStore.get(), sizeof(SharedPaletteStore));
+   }
+   counter.AddPrivate(sizeof(ColorTablePublishSlot));
+   if (const auto pPublished = m_pPublishSlot->Peek())
+   {
+      counter.AddPrivate(sizeof(PublishedColorTable), (pPublished->palette.GetSafeHandle() ? 1 : 0));
+      if (pPublished->pColorTable)
+      {
+         CountSharedColorTable(counter, *pPublished->pColorTable);
+      }
+      if (pPublished->pColorTableIndex)
+      {
+         counter.AddShared(pPublished->pColorTableIndex.get(), pPublished->pColorTableIndex->GetByteSize());
+      }
+   }
+   counter.AddPrivate(GetVectorByteSize(m_deferredDiffs));
+   for (const auto& pDiff : m_deferredDiffs)
+   {
+      if (pDiff)
+      {
+         counter.AddShared(pDiff.get(), pDiff->GetByteSize());
+      }
+   }
+
+   // What the button has computed from the table.
+   if (m_pColorTableIndex)
+   {
+      counter.AddShared(m_pColorTableIndex.get(), m_pColorTableIndex->GetByteSize());
+   }
+   if (m_pDisplayOrder)
+   {
+      counter.AddPrivate(m_pDisplayOrder->GetByteSize());
+   }
+   if (m_pNameSearchIndex)
+   {
+      counter.AddPrivate(m_pNameSearchIndex->GetByteSize());
+   }
+
+   // Everything else.
+   counter.AddString(m_strDefaultText);
+   counter.AddString(m_strCustomText);
+   for (const auto& pLatencies : m_pInputLatencies)
+   {
+      if (pLatencies)
+      {
+         counter.AddPrivate(sizeof(LatencyHistogram));
+      }
+   }
+   if (m_pActivePopup)
+   {
+      m_pActivePopup->CountMemoryUsage(counter);
+   }
+   if (m_hWnd)
+   {
+      CountFaceCache(counter);
+   }
+}
+
 void ColorPickerButton::SendParentNotification(ColorPickerButtonNotification notificationCode,
                                                COLORREF                clrCurrent,
                                                COLORREF                clrPrevious)
 {
+   TRACE_PHASE(m_pTraceSink.get(), "SendParentNotification");
+   SUSPEND_ALLOCATION_CHECKS();  // (the parent's handler, and MFC's temporary CWnd, are not ours to check)
+
    const CWnd* const pwndParent = this->GetParent();
    if (pwndParent)
    {
+      ++m_paintCounters.cNotifications;
+      if (m_pStatsPage)
+      {
+         m_pStatsPage->RecordNotification();
+      }
+
       NMCOLORPICKERBUTTON nmcpb;
       nmcpb.hdr.code     = notificationCode;
       nmcpb.hdr.hwndFrom = this->m_hWnd;
@@ -463,59 +1772,180 @@ void ColorPickerButton::PreSubclassWindow()
    CButton::PreSubclassWindow();
 
    this->ModifyStyle(0, BS_OWNERDRAW);
+   m_isThemed.reset();
+   m_clrParentBackground.reset();
 }
 
 void ColorPickerButton::DrawItem(LPDRAWITEMSTRUCT pDIS)
 {
+   this->AdoptPublishedColorTable();
+   this->AdoptPaletteStoreTable();
+
+   auto& counters = m_paintCounters;
+   ++counters.cButtonPaints;
+
+   // Work out what the face looks like, which is also its key in the cache.
+   if (!m_isThemed.has_value())
+   {
+      m_isThemed = ThemeHelper(m_hWnd, VSCLASS_BUTTON).IsThemed();
+   }
+   const CRect          rcItem(pDIS->rcItem);
+   ButtonFaceCache::Key key;
+   key.size  = rcItem.Size();
+   key.state = (*m_isThemed ? ButtonFaceCache::kThemed : 0);
+   if (((pDIS->itemState & ODS_SELECTED) != 0) || m_isPopupActive)
+   {
+      key.state |= ButtonFaceCache::kPressed;
+   }
+   if ((pDIS->itemState & ODS_DISABLED) != 0)
+   {
+      key.state |= ButtonFaceCache::kDisabled;
+   }
+   if (((pDIS->itemState & ODS_HOTLIGHT) != 0) || m_isMouseOver)
+   {
+      key.state |= ButtonFaceCache::kHot;
+   }
+   if ((pDIS->itemState & ODS_DEFAULT) != 0)
+   {
+      key.state |= ButtonFaceCache::kDefault;
+   }
+   if ((((pDIS->itemState & ODS_FOCUS) != 0) || m_isPopupActive) &&
+       !((pDIS->itemState & ODS_NOFOCUSRECT) == ODS_NOFOCUSRECT))
+   {
+      key.state |= ButtonFaceCache::kFocused;
+   }
+   key.clrSwatch     = ((key.state & ButtonFaceCache::kDisabled) == 0) ? this->GetColor() : CLR_NONE;
+   key.clrBackground = CLR_NONE;
+   key.dpi           = ::GetDeviceCaps(pDIS->hDC, LOGPIXELSY);
+
+   // A themed face is not opaque, so it is drawn over the background that the parent supplies
+   // for the button (as the button control itself does, when it erases an owner-drawn button).
+   // Only faces drawn over a solid color can be cached. The parent is only asked for its brush
+   // when the button has not yet learned its color (see m_clrParentBackground), so copying a
+   // cached face sends the parent nothing.
+   HBRUSH hbrBackground = nullptr;
+   if (*m_isThemed)
+   {
+      if (!m_clrParentBackground.has_value())
+      {
+         hbrBackground = GetButtonBackgroundBrush(m_hWnd, pDIS->hDC);
+         LOGBRUSH lb;
+         m_clrParentBackground = ((::GetObject(hbrBackground, sizeof(lb), &lb) == sizeof(lb)) && (lb.lbStyle == BS_SOLID))
+                                 ? lb.lbColor
+                                 : CLR_NONE;
+      }
+      key.clrBackground = *m_clrParentBackground;
+   }
+
+   // Copy the face from the cache, if it can be cached; otherwise, draw it directly. (Faces are
+   // drawn at the top left of the DC, and are not cached for printing, since they are bitmaps
+   // compatible with the screen.)
+   const auto isCacheable = (key.size.cx > 0) && (key.size.cy > 0)                &&
+                            (rcItem.TopLeft() == CPoint(0, 0))                     &&
+                            (!*m_isThemed || (key.clrBackground != CLR_NONE))      &&
+                            (::GetDeviceCaps(pDIS->hDC, TECHNOLOGY) == DT_RASDISPLAY);
+   auto result = ButtonFaceCache::Result::NotCached;
+   if (isCacheable)
+   {
+      result = ButtonFaceCache::Get().Draw(pDIS->hDC, key, [&](HDC hdcFace)
+      {
+         // (A themed face is drawn over the color in its key, which is the color of the parent's brush.)
+         if (*m_isThemed)
+         {
+            const auto clrBrushOriginal = ::SetDCBrushColor(hdcFace, key.clrBackground);
+            this->DrawFace(hdcFace, rcItem, key.state, static_cast<HBRUSH>(::GetStockObject(DC_BRUSH)));
+            ::SetDCBrushColor(hdcFace, clrBrushOriginal);
+         }
+         else
+         {
+            this->DrawFace(hdcFace, rcItem, key.state, nullptr);
+         }
+      });
+   }
+   switch (result)
+   {
+      case ButtonFaceCache::Result::Copied:
+      {
+         ++counters.cFaceCopies;
+         break;
+      }
+      case ButtonFaceCache::Result::Rendered:
+      {
+         ++counters.cGdiObjectsCreated;
+         break;
+      }
+      case ButtonFaceCache::Result::NotCached:
+      {
+         if (*m_isThemed && !hbrBackground)
+         {
+            hbrBackground = GetButtonBackgroundBrush(m_hWnd, pDIS->hDC);
+         }
+         this->DrawFace(pDIS->hDC, rcItem, key.state, hbrBackground);
+         break;
+      }
+   }
+}
+
+void ColorPickerButton::DrawFace(HDC hDC, const RECT& rcItem, UINT state, HBRUSH hbrBackground)
+{
+   auto& counters = m_paintCounters;
+
    const CSize szBorder(::GetSystemMetrics(SM_CXBORDER),
                         ::GetSystemMetrics(SM_CYBORDER));
    const CSize szEdge  (::GetSystemMetrics(SM_CXEDGE),
                         ::GetSystemMetrics(SM_CYEDGE));
-   CRect       rcDraw(pDIS->rcItem);
+   CRect       rcDraw(rcItem);
 
    // Determine if we are themed.
    ThemeHelper theme(this->m_hWnd, VSCLASS_BUTTON);
    if (theme.IsThemed())
    {
+      // Fill what shows through the transparent parts of the background (its rounded corners).
+      if (hbrBackground)
+      {
+         ++counters.cFills;
+         VERIFY(::FillRect(hDC, &rcDraw, hbrBackground));
+      }
+
       // Draw the background, which includes the outer edge.
       const auto iPartId  = BP_PUSHBUTTON;
       auto       iStateId = 0;
-      if (((pDIS->itemState & ODS_SELECTED) != 0) || m_isPopupActive)
+      if ((state & ButtonFaceCache::kPressed) != 0)
       {
          iStateId |= PBS_PRESSED;
       }
-      if ((pDIS->itemState & ODS_DISABLED) != 0)
+      if ((state & ButtonFaceCache::kDisabled) != 0)
       {
          iStateId |= PBS_DISABLED;
       }
-      if (((pDIS->itemState & ODS_HOTLIGHT) != 0) || m_isMouseOver)
+      if ((state & ButtonFaceCache::kHot) != 0)
       {
          iStateId |= PBS_HOT;
       }
-      if ((pDIS->itemState & ODS_DEFAULT) != 0)
+      if ((state & ButtonFaceCache::kDefault) != 0)
       {
          iStateId |= PBS_DEFAULTED;
       }
-      theme.DrawThemeBackground(pDIS->hDC, iPartId, iStateId, rcDraw);
-      rcDraw = theme.GetThemeBackgroundContentRect(pDIS->hDC, iPartId, iStateId, rcDraw);
+      DrawThemePart(theme, hDC, iPartId, iStateId, rcDraw, counters);
+      rcDraw = theme.GetThemeBackgroundContentRect(hDC, iPartId, iStateId, rcDraw);
    }
    else
    {
       // Draw the outer edge.
       auto nState = DFCS_BUTTONPUSH | DFCS_ADJUSTRECT;
-      if (((pDIS->itemState & ODS_SELECTED) != 0) || (m_isPopupActive))
+      if ((state & ButtonFaceCache::kPressed) != 0)
       {
          nState |= DFCS_PUSHED;
       }
-      if ((pDIS->itemState & ODS_DISABLED) != 0)
+      if ((state & ButtonFaceCache::kDisabled) != 0)
       {
          nState |= DFCS_INACTIVE;
       }
-      if (((pDIS->itemState & ODS_HOTLIGHT) != 0) || m_isMouseOver)
+      if ((state & ButtonFaceCache::kHot) != 0)
       {
          nState |= DFCS_HOT;
       }
-      VERIFY(::DrawFrameControl(pDIS->hDC, &rcDraw, DFC_BUTTON, nState));
+      VERIFY(::DrawFrameControl(hDC, &rcDraw, DFC_BUTTON, nState));
 
       // Apply a little visual fix-up.
       rcDraw.bottom -= 1;
@@ -545,9 +1975,9 @@ void ColorPickerButton::DrawItem(LPDRAWITEMSTRUCT pDIS)
       rcArrow.bottom = rcArrow.top + 14;
 
       const auto iPartId   = CP_DROPDOWNBUTTONRIGHT;
-      const auto iStateId  = ((pDIS->itemState & ODS_DISABLED) == 0) ? 0 : CBXSR_DISABLED;
-      rcArrow = themeCBX.GetThemeBackgroundContentRect(pDIS->hDC, iPartId, iStateId, rcArrow);
-      themeCBX.DrawThemeBackground(pDIS->hDC, iPartId, iStateId, rcArrow);
+      const auto iStateId  = ((state & ButtonFaceCache::kDisabled) == 0) ? 0 : CBXSR_DISABLED;
+      rcArrow = themeCBX.GetThemeBackgroundContentRect(hDC, iPartId, iStateId, rcArrow);
+      DrawThemePart(themeCBX, hDC, iPartId, iStateId, rcArrow, counters);
 
       rcDraw.right = (rcArrow.left - (szEdge.cx / 2));
    }
@@ -560,18 +1990,18 @@ void ColorPickerButton::DrawItem(LPDRAWITEMSTRUCT pDIS)
       rcArrow.right  = rcDraw.right - szEdge.cx;
       rcArrow.left   = rcArrow.right - 6;
       rcArrow.bottom = rcArrow.top   + 3;
-      if ((pDIS->itemState & ODS_DISABLED) == 0)
+      if ((state & ButtonFaceCache::kDisabled) == 0)
       {
-         DrawArrow(pDIS->hDC, rcArrow, ::GetSysColor(COLOR_BTNTEXT));
+         DrawArrow(hDC, rcArrow, ::GetSysColor(COLOR_BTNTEXT));
       }
       else
       {
          // Draw an "etched"-looking triangle, like Windows does for disabled comboboxes.
          // (We could probably also do this using ::DrawState(), but that's harder.)
          rcArrow.OffsetRect(1, 1);
-         DrawArrow(pDIS->hDC, rcArrow, ::GetSysColor(COLOR_BTNHIGHLIGHT));
+         DrawArrow(hDC, rcArrow, ::GetSysColor(COLOR_BTNHIGHLIGHT));
          rcArrow.OffsetRect(-1, -1);
-         DrawArrow(pDIS->hDC, rcArrow, ::GetSysColor(COLOR_BTNSHADOW));
+         DrawArrow(hDC, rcArrow, ::GetSysColor(COLOR_BTNSHADOW));
       }
 
       rcDraw.right = rcArrow.left - szEdge.cx;
@@ -584,42 +2014,45 @@ void ColorPickerButton::DrawItem(LPDRAWITEMSTRUCT pDIS)
    // Otherwise, if the button is disabled, instead of filling it with the selected color, fill
    // with a dark shadow color to make the disabled state more obvious. (Of course, the actual
    // dark shadow color is different depending on whether or not we're themed.)
-   const auto clr = ((pDIS->itemState & ODS_DISABLED) == 0)
+   const auto clr = ((state & ButtonFaceCache::kDisabled) == 0)
                      ? this->GetColor()
                      : theme.IsThemed() ? theme.GetThemeColor(BP_PUSHBUTTON, 0, TMT_EDGESHADOWCOLOR)
                                         : ::GetSysColor(COLOR_BTNSHADOW);
-   FillSolidRect(pDIS->hDC, rcDraw, clr);
+   FillSolidRect(hDC, rcDraw, clr, counters);
 
    // Draw the border around the color swatch.
-   if ((pDIS->itemState & ODS_DISABLED) == 0)
+   if ((state & ButtonFaceCache::kDisabled) == 0)
    {
       const auto uEdge  = BDR_RAISEDOUTER;
       const auto nFlags = BF_RECT | BF_MONO;
       if (theme.IsThemed())
       {
-         theme.DrawThemeEdge(pDIS->hDC, BP_PUSHBUTTON, 0, rcDraw, uEdge, nFlags);
+         theme.DrawThemeEdge(hDC, BP_PUSHBUTTON, 0, rcDraw, uEdge, nFlags);
       }
       else
       {
-         VERIFY(::DrawEdge(pDIS->hDC, &rcDraw, uEdge, nFlags));
+         VERIFY(::DrawEdge(hDC, &rcDraw, uEdge, nFlags));
       }
    }
 
    // Draw the focus rectangle.
-   if ((((pDIS->itemState & ODS_FOCUS) != 0) || m_isPopupActive) &&
-       !((pDIS->itemState & ODS_NOFOCUSRECT) == ODS_NOFOCUSRECT))
+   if ((state & ButtonFaceCache::kFocused) != 0)
    {
       // Reset the DC's color attributes.
-      ::SetBkColor  (pDIS->hDC, RGB(255, 255, 255));
-      ::SetTextColor(pDIS->hDC, RGB(0, 0, 0));
+      ::SetBkColor  (hDC, RGB(255, 255, 255));
+      ::SetTextColor(hDC, RGB(0, 0, 0));
 
       rcDraw.InflateRect(std::max(1, (::GetSystemMetrics(SM_CXFOCUSBORDER) / 2)),
                          std::max(1, (::GetSystemMetrics(SM_CYFOCUSBORDER) / 2)));
-      VERIFY(::DrawFocusRect(pDIS->hDC, &rcDraw));
+      VERIFY(::DrawFocusRect(hDC, &rcDraw));
    }
 }
 
 BEGIN_MESSAGE_MAP(ColorPickerButton, CButton)
+   ON_WM_ERASEBKGND()
+   ON_WM_THEMECHANGED()
+   ON_WM_SYSCOLORCHANGE()
+   ON_WM_SETTINGCHANGE()
    ON_WM_MOUSEMOVE()
    ON_WM_MOUSELEAVE()
    ON_WM_KEYDOWN()
@@ -627,6 +2060,42 @@ BEGIN_MESSAGE_MAP(ColorPickerButton, CButton)
    ON_CONTROL_REFLECT(BN_CLICKED, &ColorPickerButton::OnBnClicked)
 END_MESSAGE_MAP()
 
+BOOL ColorPickerButton::OnEraseBkgnd(CDC* /* pDC */)
+{
+   // DrawItem() paints every pixel of the button (including what shows through a themed face),
+   // so erasing the background first would only make it flicker. The button never asks to be
+   // erased, so this comes from outside of it (such as from a parent that has changed its
+   // background and repainted its children), and the parent's brush is asked for again.
+   m_clrParentBackground.reset();
+   return TRUE;
+}
+
+LRESULT ColorPickerButton::OnThemeChanged()
+{
+   // The cached faces were drawn with the old theme.
+   m_isThemed.reset();
+   m_clrParentBackground.reset();
+   ButtonFaceCache::Get().FlushIfStale();
+   return CButton::OnThemeChanged();
+}
+
+void ColorPickerButton::OnSysColorChange()
+{
+   CButton::OnSysColorChange();
+
+   // The cached faces were drawn with the old system colors (as, perhaps, was the parent's brush).
+   m_clrParentBackground.reset();
+   ButtonFaceCache::Get().FlushIfStale();
+}
+
+void ColorPickerButton::OnSettingChange(UINT uFlags, LPCTSTR pszSection)
+{
+   CButton::OnSettingChange(uFlags, pszSection);
+
+   // The cached faces may have been drawn with old system metrics (such as the size of the edges).
+   ButtonFaceCache::Get().FlushIfStale();
+}
+
 void ColorPickerButton::OnMouseMove(UINT nFlags, CPoint point)
 {
    CButton::OnMouseMove(nFlags, point);
@@ -641,7 +2110,8 @@ void ColorPickerButton::OnMouseMove(UINT nFlags, CPoint point)
       tme.hwndTrack = m_hWnd;
       VERIFY(::_TrackMouseEvent(&tme));
 
-      this->Invalidate(TRUE);
+      ++m_paintCounters.cInvalidations;
+      this->Invalidate(FALSE);
    }
 }
 
@@ -652,7 +2122,8 @@ void ColorPickerButton::OnMouseLeave()
    if (m_isMouseOver)
    {
       m_isMouseOver = false;
-      this->Invalidate(TRUE);
+      ++m_paintCounters.cInvalidations;
+      this->Invalidate(FALSE);
    }
 }
 
@@ -686,6 +2157,12 @@ void ColorPickerButton::OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
 
 void ColorPickerButton::OnBnClicked()
 {
+   TRACE_PHASE(m_pTraceSink.get(), "OnBnClicked");
+
+   // Pick up the latest published table, if any, before the pop-up window takes its snapshot.
+   this->AdoptPublishedColorTable();
+   this->AdoptPaletteStoreTable();
+
    // Mark the button as active.
    m_isPopupActive = true;
 
@@ -695,17 +2172,33 @@ void ColorPickerButton::OnBnClicked()
    // Send the drop-down notification to the parent.
    this->SendParentNotification(CPN_DROPDOWN, m_clrCurrent, clrOriginal);
 
-   this->Invalidate(TRUE);
+   ++m_paintCounters.cInvalidations;
+   this->Invalidate(FALSE);
 
    // Create and display the color picker pop-up window.
    ColorPickerPopup picker(*this);
+   m_pActivePopup    = &picker;
    const auto okayed = picker.Open();
+   m_pActivePopup    = nullptr;
+   if (m_pStatsPage)
+   {
+      m_pStatsPage->SetGdiObjectsHeld(::GetGuiResources(::GetCurrentProcess(), GR_GDIOBJECTS));
+   }
 
-   this->Invalidate(TRUE);
+   ++m_paintCounters.cInvalidations;
+   this->Invalidate(FALSE);
 
    // Cancel the pop-up window.
    m_isPopupActive = false;
 
+   // Catch up with any changes to the color table that arrived while the pop-up window was open.
+   {
+      TRACE_PHASE(m_pTraceSink.get(), "ApplyDeferredChanges");
+      this->ApplyDeferredSourceChanges();
+      this->AdoptPublishedColorTable();
+      this->AdoptPaletteStoreTable();
+   }
+
    // Check to see if the picker was cancelled without a selection.
    if (!okayed)
    {
@@ -760,9 +2253,13 @@ namespace {
 
 constexpr const TCHAR* const kpszClassName = TEXT("ColorPickerPopup");
 
-constexpr int kDefaultColorIndex = -3;
-constexpr int kCustomColorIndex  = -2;
-constexpr int kInvalidColorIndex = -1;
+constexpr int kDefaultColorIndex = ColorPickerSelection::kDefaultIndex;
+constexpr int kCustomColorIndex  = ColorPickerSelection::kCustomIndex;
+constexpr int kInvalidColorIndex = ColorPickerSelection::kInvalidIndex;
+
+constexpr DWORD kTypeaheadTimeout = 1000;  // ms after which the next character typed starts a new query
+
+constexpr UINT_PTR kToolTipId = 1;  // of the tooltip's only tool (which cannot be 0, since it has a rectangle)
 
 // The exact same sizing rules apply to all elements in the color picker pop-up window.
 // Each element is defined by 3 features: its core size, the size of its highlight border,
@@ -783,25 +2280,89 @@ constexpr SIZE kszSwatchMargin  { 0,  0};  // X and Y must be the same
 constexpr SIZE kszSwatchCore    {14, 14};
 constexpr SIZE kszSwatch        {kszSwatchCore.cx + (kszSwatchHiBorder.cx + kszSwatchMargin.cx) * 2,
                                  kszSwatchCore.cy + (kszSwatchHiBorder.cy + kszSwatchMargin.cy) * 2};
+static_assert((kszSwatch.cx == ColorPickerButton::kszColorSwatch.cx) &&
+              (kszSwatch.cy == ColorPickerButton::kszColorSwatch.cy),
+              "The published swatch size (used to lay out static color tables) is out of date.");
+
+// Maps a message to the input that it is to the pop-up window, if it is one that it handles itself.
+std::optional<InputEvent::Type> InputTypeFromMessage(UINT message)
+{
+   switch (message)
+   {
+      case WM_MOUSEMOVE:
+      {
+         return InputEvent::Type::MouseMove;
+      }
+      case WM_LBUTTONDOWN:
+      {
+         return InputEvent::Type::LButtonDown;
+      }
+      case WM_LBUTTONUP:
+      {
+         return InputEvent::Type::LButtonUp;
+      }
+      case WM_KEYDOWN:
+      {
+         return InputEvent::Type::KeyDown;
+      }
+      case WM_SYSKEYDOWN:
+      {
+         return InputEvent::Type::SysKeyDown;
+      }
+      case WM_CHAR:
+      {
+         return InputEvent::Type::Char;
+      }
+      default:
+      {
+         return std::nullopt;
+      }
+   }
+}
+
+// Returns true if the specified key moves the selection around the swatches.
+constexpr bool IsNavigationKey(UINT vk)
+{
+   return (vk == VK_LEFT) || (vk == VK_RIGHT) || (vk == VK_UP) || (vk == VK_DOWN) || (vk == VK_PRIOR) || (vk == VK_NEXT);
+}
 
 }  // anonymous namespace
 
 ColorPickerButton::ColorPickerPopup::ColorPickerPopup(ColorPickerButton& colorPickerButton)
-   : m_wndColorPickerBtn(colorPickerButton)
-   , m_szMargins        (::GetSystemMetrics(SM_CXEDGE),
-                         ::GetSystemMetrics(SM_CYEDGE))
-   , m_rcDefaultText    ()
-   , m_rcCustomText     ()
-   , m_rcSwatches       ()
-   , m_clrOriginal      ()  /* must be set later, when the picker is opened */
-   , m_iCurrentColor    (kInvalidColorIndex)
-   , m_iChosenColor     (kInvalidColorIndex)
-   , m_okayed           (false)
-{
+   : m_wndColorPickerBtn (colorPickerButton)
+   , m_szMargins         (::GetSystemMetrics(SM_CXEDGE),
+                          ::GetSystemMetrics(SM_CYEDGE))
+   , m_clrOriginal       ()  /* must be set later, when the picker is opened */
+   , m_pSelection        (std::make_unique<ColorPickerSelection>())
+   , m_usePaletteIndices (false)
+   , m_pArena            (std::make_unique<SessionArena>())
+   , m_pDisplayOrder     ()
+   , m_toolTip           ()
+   , m_iToolTipColor     (kInvalidColorIndex)
+   , m_strTypeahead      ()
+   , m_typeaheadTime     (0)
+   , m_typeaheadMatches  ()
+   , m_iTypeaheadMatch   (0)
+   , m_hasTypeaheadNames ()
+   , m_isNameIndexCounted(false)
+   , m_inputsReceived    ()
+   , m_inputTime         (0)
+   , m_isShiftDown       (false)
+   , m_isTakingInput     (false)
+   , m_pRecordedInputs   (nullptr)
+   , m_cRecordedInputs   (0)
+   , m_cRecordedInputsMax(0)
+{
+   TRACE_PHASE(this->GetTraceSink(), "CreatePopup");
+
    // Register the window class.
-   VERIFY(this->Register());
+   {
+      TRACE_PHASE(this->GetTraceSink(), "Register");
+      VERIFY(this->Register());
+   }
 
    // Create the window.
+   TRACE_PHASE(this->GetTraceSink(), "CreateEx");
    VERIFY(this->CreateEx(WS_EX_TOOLWINDOW | WS_EX_TOPMOST,
                          kpszClassName,
                          TEXT(""),
@@ -852,14 +2413,41 @@ bool ColorPickerButton::ColorPickerPopup::Unregister()
 
 bool ColorPickerButton::ColorPickerPopup::Open()
 {
-   // Initialize our state.
-   m_clrOriginal   = m_wndColorPickerBtn.GetColor();
-   m_iCurrentColor = kInvalidColorIndex;
-   m_iChosenColor  = kInvalidColorIndex;
+   return this->Run(nullptr, nullptr);
+}
+
+InputReplayResult ColorPickerButton::ColorPickerPopup::Replay(const InputLog& log)
+{
+   InputReplayResult result = {};
+   this->Run(&log, &result);
+   return result;
+}
+
+bool ColorPickerButton::ColorPickerPopup::Run(const InputLog* pReplayLog, InputReplayResult* pReplayResult)
+{
+   _ASSERTE(!pReplayLog == !pReplayResult);
+
+   TRACE_PHASE(this->GetTraceSink(), (pReplayLog ? "Replay" : "Open"));
+   const auto opening = TraceTimer::GetTimestamp();
+
+   // Initialize our state. (Whether the display order is cached is noted before anything uses it.)
+   const auto isDisplayOrderCached = !m_wndColorPickerBtn.IsDisplayOrderStale();
+   m_clrOriginal        = m_wndColorPickerBtn.GetColor();
+   m_isNameIndexCounted = (pReplayLog != nullptr);
+   m_hasTypeaheadNames.reset();
+
+   // Take the display order now (building it, if it is not cached), so that hit-testing, navigating,
+   // and painting never have to build it, which would allocate. If the sort order is changed while
+   // the window is open, the change is seen the next time that it opens.
+   m_wndColorPickerBtn.GetDisplayOrder();
+   m_pDisplayOrder = m_wndColorPickerBtn.m_pDisplayOrder;
 
    // Set the window size.
-   auto dropDown = true;  // true if dropping down; false if dropping up
+   auto                         dropDown = true;  // true if dropping down; false if dropping up
+   ColorPickerSelection::Layout layout   = {};
    {
+      TRACE_PHASE(this->GetTraceSink(), "Layout");
+
       CSize szText(0, 0);
 
       // If we are showing a default/automatic or custom text area, get the font and text size.
@@ -867,6 +2455,8 @@ bool ColorPickerButton::ColorPickerPopup::Open()
       const auto customText  = m_wndColorPickerBtn.GetShowCustom();
       if (defaultText || customText)
       {
+         TRACE_PHASE(this->GetTraceSink(), "MeasureText");
+
          CClientDC  dc(this);
          const auto pFont         = m_wndColorPickerBtn.GetFont();
          const auto pfontOriginal = (pFont ? dc.SelectObject(pFont) : nullptr);
@@ -901,41 +2491,25 @@ bool ColorPickerButton::ColorPickerPopup::Open()
          }
       }
 
-      const auto colorTableGrid = m_wndColorPickerBtn.GetColorTableGrid();
-
-      // Compute the minimum width.
-      const auto cxTotalBoxWidth = colorTableGrid.cy * kszSwatch.cx;
-      auto       cxMinWidth      = cxTotalBoxWidth;
-      if (cxMinWidth < szText.cx)
-      {
-         cxMinWidth = szText.cx;
-      }
-
-      // Create the rectangle for the default text.
-      m_rcDefaultText.SetRect(0, 0, cxMinWidth, defaultText ? szText.cy : 0);
-
-      // Initialize the color box rectangle.
-      m_rcSwatches = CRect(CPoint((cxMinWidth - cxTotalBoxWidth) / 2, m_rcDefaultText.bottom),
-                           CSize(cxTotalBoxWidth, colorTableGrid.cx * kszSwatch.cy));
-
-      // Create the rectangle for the custom text.
-      m_rcCustomText = CRect(CPoint(0, m_rcSwatches.bottom),
-                             CSize(cxMinWidth, customText ? szText.cy : 0));
+      // Lay out the options. (A static table's swatches were laid out at compile time,
+      // for display in table order.)
+      const auto pStaticColorTable = m_wndColorPickerBtn.m_pStaticColorTable;
+      layout.grid              = m_wndColorPickerBtn.GetColorTableGrid();
+      layout.cColors           = m_wndColorPickerBtn.GetColorCount();
+      layout.pDisplayOrder     = m_pDisplayOrder.get();
+      layout.prcStaticSwatches = (pStaticColorTable && (m_wndColorPickerBtn.GetColorTableOrder() == ColorTableOrder::TableOrder))
+                                 ? pStaticColorTable->prcSwatches
+                                 : nullptr;
+      layout.showDefault       = defaultText;
+      layout.showCustom        = customText;
+      layout.Arrange(szText, m_szMargins);
 
       // Determine the window's position and size, based on the parent button.
-      CRect rcWindow(m_rcDefaultText.TopLeft(),
-                     m_rcCustomText.BottomRight());
+      CRect rcWindow(CPoint(0, 0), layout.szClient);
       CRect rcButton;
       m_wndColorPickerBtn.GetWindowRect(&rcButton);
       rcWindow.OffsetRect(rcButton.left, rcButton.bottom);
 
-      // Adjust the rectangles for the border.
-      rcWindow.right  += (m_szMargins.cx * 2);
-      rcWindow.bottom += (m_szMargins.cy * 2);
-      m_rcDefaultText.OffsetRect(m_szMargins);
-      m_rcSwatches   .OffsetRect(m_szMargins);
-      m_rcCustomText .OffsetRect(m_szMargins);
-
       // Make sure that the window will fit on the screen.
       const auto rcScreen = GetScreenRect(this->m_hWnd);
       if (rcWindow.right > rcScreen.right)
@@ -971,33 +2545,28 @@ bool ColorPickerButton::ColorPickerPopup::Open()
    // relaying mouse event messages to the tooltip control. This way, the client can
    // change their mind any time about displaying tooltips, even while the color picker
    // pop-up window is visible.)
-   CToolTipCtrl toolTip;
-   if (toolTip.Create(this))
-   {
-      // Add a tip for each color swatch.
-      // (The ID of a tooltip cannot be 0 if a rectangle is specified, but our color indices
-      // start at 0, so we add a 1 to the color index to ensure that it is non-zero.)
-      const auto& colorTable = m_wndColorPickerBtn.GetColorTable();
-      const auto  cColors    = colorTable.size();
-      for (size_t i = 0; i < cColors; ++i)
-      {
-         const auto orcSwatch = this->GetSwatchRect(i);
-         if (orcSwatch)
-         {
-            toolTip.AddTool(this,
-                            static_cast<LPCTSTR>(colorTable[i].second),
-                            &(*orcSwatch),
-                            (i + 1));
-         }
-      }
+   if (m_toolTip.Create(this))
+   {
+      TRACE_PHASE(this->GetTraceSink(), "CreateToolTips");
+
+      // Add a single tip, which is moved onto whichever swatch the mouse is over (see UpdateToolTip),
+      // and whose text is only asked for when it is about to be shown. It starts out covering nothing.
+      m_iToolTipColor = kInvalidColorIndex;
+      VERIFY(m_toolTip.AddTool(this,
+                               LPSTR_TEXTCALLBACK,  // (see OnToolTipGetDispInfo)
+                               CRect(0, 0, 0, 0),
+                               kToolTipId));
    }
 
-   // Select the swatch, if any, that corresponds to the initial color.
-   this->ChangeSelectionToColor(m_wndColorPickerBtn.m_clrCurrent);
+   // Start the selection process, with the swatch, if any, that corresponds to the initial color
+   // chosen.
+   m_pSelection->Start(layout, this->IndexFromColor(m_wndColorPickerBtn.m_clrCurrent));
 
-   // Show the window.
-   if (AreComboBoxAnimationsEnabled())
+   // Show the window. (A replay skips the animation, which is not part of any input's cost.)
+   if (!pReplayLog && AreComboBoxAnimationsEnabled())
    {
+      TRACE_PHASE(this->GetTraceSink(), "AnimateWindow");
+
       // The leaked Windows 2000 source code (see <../ntos/w32/ntuser/client/combo.c> for the
       // implementation of the combobox) uses a constant named CMS_QANIMATION for the time of
       // ::AnimateWindow(). This is #defined in the file <../ntos/w32/ntuser/inc/user.h>.
@@ -1006,94 +2575,177 @@ bool ColorPickerButton::ColorPickerPopup::Open()
    }
    else
    {
+      TRACE_PHASE(this->GetTraceSink(), "ShowWindow");
       this->ShowWindow(SW_SHOWNA);
    }
 
    // Purge the message queue of paint messages.
    MSG msg;
-   while (::PeekMessage(&msg, NULL, WM_PAINT, WM_PAINT, PM_NOREMOVE))
    {
-      if (!::GetMessage(&msg, NULL, WM_PAINT, WM_PAINT))
+      TRACE_PHASE(this->GetTraceSink(), "PurgePaintMessages");
+      while (::PeekMessage(&msg, NULL, WM_PAINT, WM_PAINT, PM_NOREMOVE))
       {
-         return false;
+         if (!::GetMessage(&msg, NULL, WM_PAINT, WM_PAINT))
+         {
+            return false;
+         }
+         ::DispatchMessage(&msg);
       }
-      ::DispatchMessage(&msg);
    }
 
-   // Set capture to the window.
-   this->SetCapture();
-   _ASSERTE(::GetCapture() == this->m_hWnd);
+   // The pop-up window is now shown, and ready for input.
+   if (const auto pStatsPage = (pReplayLog ? nullptr : m_wndColorPickerBtn.m_pStatsPage.get()))
+   {
+      pStatsPage->RecordOpen(static_cast<UINT64>(TraceTimer::GetTimestamp() - opening));
+      pStatsPage->RecordCacheLookup(isDisplayOrderCached);
+      pStatsPage->SetGdiObjectsHeld(::GetGuiResources(::GetCurrentProcess(), GR_GDIOBJECTS));
+   }
 
-   // Pump messages until capture is lost or the pop-up window is dismissed.
-   while (::GetCapture() == this->m_hWnd)
+   // Record the session, if there is a recorder for it, and make sure that recording the latency
+   // of the inputs has nowhere left to allocate, before the first one comes in.
+   const auto pInputRecorder = (pReplayLog ? nullptr : m_wndColorPickerBtn.m_pInputRecorder.get());
+   if (!pReplayLog)
    {
-      if (!::GetMessage(&msg, NULL, 0, 0))
+      for (auto& pLatencies : m_wndColorPickerBtn.m_pInputLatencies)
       {
-         ::PostQuitMessage(msg.wParam);
-         break;
+         if (!pLatencies)
+         {
+            pLatencies = std::make_unique<LatencyHistogram>();
+         }
       }
+   }
 
-      if (m_wndColorPickerBtn.GetShowTooltips())
+   m_isTakingInput = true;
+   if (pReplayLog)
+   {
+      // Replay the inputs as fast as they can be handled, painting the result of each one
+      // before going on to the next, as the message loop would, until the picker is closed.
+      const auto& events = pReplayLog->GetEvents();
+      pReplayResult->eventCosts.reserve(events.size());
+      for (const auto& event : events)
       {
-         toolTip.RelayEvent(&msg);
+         if (m_pSelection->IsClosed())
+         {
+            break;
+         }
+         const auto started = TraceTimer::GetTimestamp();
+         this->HandleInput(event);
+         this->UpdateWindow();
+         pReplayResult->eventCosts.push_back(static_cast<UINT32>(TraceTimer::GetTimestamp() - started));
       }
+   }
+   else
+   {
+      // Set capture to the window.
+      this->SetCapture();
+      _ASSERTE(::GetCapture() == this->m_hWnd);
 
-      switch (msg.message)
+      // Pump messages until capture is lost or the pop-up window is dismissed.
+      while (::GetCapture() == this->m_hWnd)
       {
-         case WM_LBUTTONUP:
+         if (!::GetMessage(&msg, NULL, 0, 0))
          {
-            this->OnLButtonUp(msg.wParam,
-                              CPoint(GET_X_LPARAM(msg.lParam),
-                                     GET_Y_LPARAM(msg.lParam)));
+            ::PostQuitMessage(msg.wParam);
             break;
          }
-         case WM_MOUSEMOVE:
+
+         if (m_wndColorPickerBtn.GetShowTooltips())
          {
-            this->OnMouseMove(msg.wParam,
-                              CPoint(GET_X_LPARAM(msg.lParam),
-                                     GET_Y_LPARAM(msg.lParam)));
-            break;
+            m_toolTip.RelayEvent(&msg);
          }
-         case WM_KEYUP:
+
+         const auto otype = InputTypeFromMessage(msg.message);
+         if (!otype)
          {
-            break;
+            // Just dispatch the rest of the messages that we don't need special handling for.
+            // (Key releases are swallowed, though, as the presses were.)
+            if (msg.message != WM_KEYUP)
+            {
+               ::DispatchMessage(&msg);
+            }
+            continue;
          }
-         case WM_SYSKEYDOWN:
+
+         const auto received = TraceTimer::GetTimestamp();
+         if (msg.message == WM_KEYDOWN)
          {
-            this->OnSysKeyDown(msg.wParam,
-                               LOWORD(msg.lParam),
-                               HIWORD(msg.lParam));
-            break;
+            ::TranslateMessage(&msg);  // (for the characters of a typeahead query)
          }
-         case WM_KEYDOWN:
+         const InputEvent event = { *otype,
+                                    (::GetKeyState(VK_SHIFT) < 0),
+                                    msg.time,
+                                    static_cast<UINT32>(msg.wParam),
+                                    static_cast<UINT32>(msg.lParam) };
+         if (pInputRecorder)
          {
-            this->OnKeyDown(msg.wParam,
-                            LOWORD(msg.lParam),
-                            HIWORD(msg.lParam));
-            break;
+            this->RecordInput(event);
          }
-         default:
+         this->HandleInput(event);
+
+         switch (event.type)
          {
-            // Just dispatch the rest of the messages that we don't need special handling for.
-            ::DispatchMessage(&msg);
-            break;
+            case InputEvent::Type::MouseMove:
+            {
+               this->TrackInputLatency(InputLatencyType::Hover, received);
+               break;
+            }
+            case InputEvent::Type::KeyDown:
+            case InputEvent::Type::Char:
+            {
+               this->TrackInputLatency(InputLatencyType::Keyboard, received);
+               break;
+            }
+            default:
+            {
+               break;
+            }
          }
       }
+      VERIFY(::ReleaseCapture());
+   }
+   m_isTakingInput = false;
+   {
+      TRACE_PHASE(this->GetTraceSink(), "DestroyWindow");
+      VERIFY(this->DestroyWindow());
+   }
+
+   // Report the outcome: to the replay, which goes no further, or to the recorder.
+   if (pReplayLog)
+   {
+      const auto& outcomeLogged = pReplayLog->GetOutcome();
+      pReplayResult->outcome    = this->GetOutcome();
+      pReplayResult->matchesLog = (pReplayResult->outcome.okayed == outcomeLogged.okayed) &&
+                                  (pReplayResult->outcome.custom == outcomeLogged.custom) &&
+                                  (pReplayResult->outcome.clr    == outcomeLogged.clr);
+      return m_pSelection->IsOkayed();
+   }
+   if (pInputRecorder)
+   {
+      InputLog sessionLog;
+      sessionLog.SetInitialColor(m_clrOriginal);
+      for (size_t iInput = 0; iInput < m_cRecordedInputs; ++iInput)
+      {
+         sessionLog.Append(m_pRecordedInputs[iInput]);
+      }
+      sessionLog.SetOutcome(this->GetOutcome());
+      pInputRecorder->OnInputSession(sessionLog);
    }
-   VERIFY(::ReleaseCapture());
-   VERIFY(this->DestroyWindow());
 
    // If needed, show the custom color picker.
    // Note that we do not assume the custom color picker will know how to map CLR_DEFAULT
    // to the default/automatic color, so we do the mapping ourselves first, always passing
    // it a legitimate COLORREF value.
-   if (m_okayed)
+   auto       okayed   = m_pSelection->IsOkayed();
+   const auto iCurrent = m_pSelection->GetCurrent();
+   if (okayed)
    {
-      if (m_iCurrentColor == kCustomColorIndex)
+      if (iCurrent == kCustomColorIndex)
       {
-         const auto clrCurrent   = (m_iChosenColor == kDefaultColorIndex)
+         TRACE_PHASE(this->GetTraceSink(), "CustomColorPicker");
+
+         const auto clrCurrent   = (m_pSelection->GetChosen() == kDefaultColorIndex)
                                    ? m_wndColorPickerBtn.GetDefaultColor()
-                                   : this->ColorFromIndex(m_iCurrentColor);
+                                   : this->ColorFromIndex(iCurrent);
          const auto oclrSelected = m_wndColorPickerBtn.DisplayCustomColorPicker(clrCurrent);
          if (oclrSelected)
          {
@@ -1101,71 +2753,161 @@ bool ColorPickerButton::ColorPickerPopup::Open()
          }
          else
          {
-            m_okayed = false;
+            okayed = false;
          }
       }
       else
       {
-         m_wndColorPickerBtn.SetColor(this->ColorFromIndex(m_iCurrentColor));
+         m_wndColorPickerBtn.SetColor(this->ColorFromIndex(iCurrent));
       }
    }
-   return m_okayed;
+   return okayed;
 }
 
-void ColorPickerButton::ColorPickerPopup::Close()
+void ColorPickerButton::ColorPickerPopup::HandleInput(const InputEvent& event)
 {
-   if (m_iCurrentColor == kInvalidColorIndex)
+   // Hovering and navigating with the keys never allocate. (Nor does painting; see OnPaint.)
+   // Trace sinks can do what they like, so a traced session is not checked.
+   CHECK_NO_ALLOCATIONS_IF(!this->GetTraceSink() &&
+                           ((event.type == InputEvent::Type::MouseMove) ||
+                            ((event.type == InputEvent::Type::KeyDown) && IsNavigationKey(event.wParam))),
+                           "HandleInput");
+
+   auto& selection = *m_pSelection;
+   if (selection.IsClosed())
    {
-      this->Cancel();
+      return;
    }
-   else
+
+   m_inputTime   = event.time;
+   m_isShiftDown = event.shift;
+
+   // The keys and the characters go to the typeahead query and the accelerators first (since they
+   // need the names and the texts), and what those leave goes to the selection, as the mouse does.
+   // Whatever none of them handles is dropped, as the key releases are. The selection only keeps
+   // the state, so whatever it changed is then shown here.
+   const auto iPrevious = selection.GetCurrent();
+   switch (event.type)
+   {
+      case InputEvent::Type::KeyDown:
+      {
+         this->HandleKeyDown(event.wParam);
+         break;
+      }
+      case InputEvent::Type::SysKeyDown:
+      {
+         this->HandleSysKeyDown(event.wParam, HIWORD(event.lParam));
+         break;
+      }
+      case InputEvent::Type::Char:
+      {
+         this->HandleChar(event.wParam);
+         break;
+      }
+      default:
+      {
+         selection.HandleInput(event);
+         break;
+      }
+   }
+
+   if (selection.GetCurrent() != iPrevious)
+   {
+      this->ShowSelection();
+   }
+   if (event.type == InputEvent::Type::MouseMove)
+   {
+      this->UpdateToolTip(selection.GetCurrent());
+   }
+   if (selection.IsClosed())
    {
+      TRACE_INSTANT(this->GetTraceSink(), (selection.IsOkayed() ? "Close" : "Cancel"));
       VERIFY(::ReleaseCapture());
-      m_okayed = true;
    }
 }
 
-void ColorPickerButton::ColorPickerPopup::Cancel()
+void ColorPickerButton::ColorPickerPopup::RecordInput(const InputEvent& event)
 {
-   VERIFY(::ReleaseCapture());
-   m_okayed = false;
+   // The inputs are kept in an array in the arena, which is reallocated (leaving the old one
+   // behind, until the session ends) when it fills up. Doubling its size keeps that rare.
+   if (m_cRecordedInputs == m_cRecordedInputsMax)
+   {
+      const auto cMax       = (m_cRecordedInputsMax != 0) ? (m_cRecordedInputsMax * 2) : 256;
+      const auto pRecording = m_pArena->AllocateArray<InputEvent>(cMax);
+      if (!pRecording)
+      {
+         return;  // (the rest of the session goes unrecorded)
+      }
+      if (m_cRecordedInputs != 0)
+      {
+         memcpy(pRecording, m_pRecordedInputs, m_cRecordedInputs * sizeof(InputEvent));
+      }
+      m_pRecordedInputs    = pRecording;
+      m_cRecordedInputsMax = cMax;
+   }
+   m_pRecordedInputs[m_cRecordedInputs++] = event;
 }
 
-int ColorPickerButton::ColorPickerPopup::HitTest(const POINT& pt) const
+void ColorPickerButton::ColorPickerPopup::UpdateToolTip(int index)
 {
-   // If in the custom text rectangle, return that index.
-   if (m_rcCustomText.PtInRect(pt))
+   if ((index == m_iToolTipColor) || !m_toolTip.GetSafeHwnd())
    {
-      return kCustomColorIndex;
+      return;
    }
+   m_iToolTipColor = index;
+
+   // Hide the tip for the swatch that the mouse has left, and move the tool onto the new one,
+   // if it is a swatch. (The default and custom areas have no tips.)
+   m_toolTip.Pop();
+   const auto  orcSwatch = (index >= 0) ? m_pSelection->GetSwatchRect(index) : std::nullopt;
+   const CRect rcTool    = orcSwatch ? CRect(*orcSwatch) : CRect(0, 0, 0, 0);
+   m_toolTip.SetToolRect(this, kToolTipId, &rcTool);
+}
 
-   // If in the default/automatic text rectangle, return that index.
-   if (m_rcDefaultText.PtInRect(pt))
+LPCTSTR ColorPickerButton::ColorPickerPopup::GetToolTipText(size_t index)
+{
+   // Names that the table holds as strings are shown as they are. The rest are copied into
+   // the arena, where they stay until the window is closed, which is as long as the tip needs them.
+   const auto& button = m_wndColorPickerBtn;
+   if (button.m_pStaticColorTable)
    {
-      return kDefaultColorIndex;
+      return button.m_pStaticColorTable->ppszNames[index];
    }
-
-   // If the point isn't in the rectangle containing the color swatches, return an invalid color.
-   if (!m_rcSwatches.PtInRect(pt))
+   if (button.m_pSharedColorTable)
    {
-      return kInvalidColorIndex;
+      return (*button.m_pSharedColorTable)[index].second;
    }
-
-   // Convert the point to a specific color index.
-   const auto cColors        = static_cast<int>(m_wndColorPickerBtn.GetColorTable().size());
-   const auto colorTableGrid = m_wndColorPickerBtn.GetColorTableGrid();
-   const auto row            = (pt.y - m_rcSwatches.top)  / kszSwatch.cy;
-   const auto col            = (pt.x - m_rcSwatches.left) / kszSwatch.cx;
-   if ((row < 0) || (row >= colorTableGrid.cx) ||
-       (col < 0) || (col >= colorTableGrid.cy))
+#ifdef _UNICODE
+   if (button.m_pPaletteFile)
    {
-      return kInvalidColorIndex;
+      return button.m_pPaletteFile->GetName(index);
    }
-   else
+#endif
+   if (!button.m_pColorNames && !button.m_pPaletteFile)
    {
-      const auto index = row * colorTableGrid.cy + col;
-      return (index < cColors) ? index : kInvalidColorIndex;
+      return button.m_colorTable[index].second;
    }
+
+   const auto strName = button.GetColorNameAt(index);
+   const auto pszName = m_pArena->CopyString(strName, strName.GetLength());
+   return pszName ? pszName : TEXT("");
+}
+
+void ColorPickerButton::ColorPickerPopup::CountMemoryUsage(MemoryUsageCounter& counter) const
+{
+   // (The window object itself is on the stack of the button's message handler.)
+   counter.AddPrivate(sizeof(SessionArena) + m_pArena->GetBytesReserved() + GetVectorByteSize(m_typeaheadMatches));
+   counter.AddString(m_strTypeahead);
+}
+
+InputOutcome ColorPickerButton::ColorPickerPopup::GetOutcome() const
+{
+   const auto   iCurrent = m_pSelection->GetCurrent();
+   InputOutcome outcome;
+   outcome.okayed = m_pSelection->IsOkayed();
+   outcome.custom = outcome.okayed && (iCurrent == kCustomColorIndex);
+   outcome.clr    = (outcome.okayed && !outcome.custom) ? this->ColorFromIndex(iCurrent) : CLR_NONE;
+   return outcome;
 }
 
 COLORREF ColorPickerButton::ColorPickerPopup::ColorFromIndex(int index) const
@@ -1180,8 +2922,9 @@ COLORREF ColorPickerButton::ColorPickerPopup::ColorFromIndex(int index) const
       {
          // If the chosen color can be mapped to an actual color, then return that color.
          // Otherwise, the chosen color is a custom color, so return that one.
-         return (m_iChosenColor != kCustomColorIndex) ? this->ColorFromIndex(m_iChosenColor)
-                                                      : m_clrOriginal;
+         const auto iChosen = m_pSelection->GetChosen();
+         return (iChosen != kCustomColorIndex) ? this->ColorFromIndex(iChosen)
+                                               : m_clrOriginal;
       }
       case kInvalidColorIndex:
       {
@@ -1189,157 +2932,140 @@ COLORREF ColorPickerButton::ColorPickerPopup::ColorFromIndex(int index) const
       }
       default:
       {
-         return m_wndColorPickerBtn.GetColorTable()[index].first;
+         return m_wndColorPickerBtn.GetColorAt(index);
       }
    }
 }
 
-void ColorPickerButton::ColorPickerPopup::ChangeSelection(int index)
+int ColorPickerButton::ColorPickerPopup::IndexFromColor(COLORREF clr) const
 {
-   // Ensure that the specified index is in range.
-   const auto cColors = m_wndColorPickerBtn.GetColorTable().size();
-   _ASSERTE(index < static_cast<int>(cColors));
+   if ((clr == CLR_DEFAULT) && (m_wndColorPickerBtn.GetShowDefault()))
+   {
+      return kDefaultColorIndex;
+   }
 
-   // Set the current selection.
-   m_iCurrentColor = index;
+   const auto index = m_wndColorPickerBtn.FindColorIndex(clr);
+   if (index >= 0)
+   {
+      return index;
+   }
+   return (m_wndColorPickerBtn.GetShowCustom()) ? kCustomColorIndex
+                                                : kInvalidColorIndex;
+}
+
+void ColorPickerButton::ColorPickerPopup::ShowSelection()
+{
+   TRACE_INSTANT(this->GetTraceSink(), "ChangeSelection");
 
    // If the parent button control is tracking the selection, and we have a valid selection,
    // set its color to reflect this latest update.
    if (m_wndColorPickerBtn.GetTrackSelection())
    {
-      const auto clr = this->ColorFromIndex((m_iCurrentColor != kInvalidColorIndex) ? m_iCurrentColor
-                                                                                    : m_iChosenColor);
+      const auto iCurrent = m_pSelection->GetCurrent();
+      const auto clr      = this->ColorFromIndex((iCurrent != kInvalidColorIndex) ? iCurrent
+                                                                                  : m_pSelection->GetChosen());
       m_wndColorPickerBtn.SetColor(clr);
    }
 
    // Repaint in order to ensure that the old swatch is deselected and the new swatch is selected.
+   ++m_wndColorPickerBtn.m_paintCounters.cInvalidations;
    this->Invalidate(TRUE);
 }
 
-void ColorPickerButton::ColorPickerPopup::ChangeSelectionToColor(COLORREF clr)
+TraceSink* ColorPickerButton::ColorPickerPopup::GetTraceSink() const
 {
-   if ((clr == CLR_DEFAULT) && (m_wndColorPickerBtn.GetShowDefault()))
-   {
-      m_iChosenColor = kDefaultColorIndex;
-   }
-   else
-   {
-      const auto& colors  = m_wndColorPickerBtn.GetColorTable();
-      const auto  cColors = colors.size();
-      for (size_t i = 0; i < cColors; ++i)
-      {
-         if (colors[i].first == clr)
-         {
-            m_iChosenColor = i;
-            return;
-         }
-      }
-      m_iChosenColor = (m_wndColorPickerBtn.GetShowCustom()) ? kCustomColorIndex
-                                                             : kInvalidColorIndex;
-   }
+   return m_wndColorPickerBtn.m_pTraceSink.get();
 }
 
-void ColorPickerButton::ColorPickerPopup::ChangeSelectionByOffset(int offset)
+void ColorPickerButton::ColorPickerPopup::TrackInputLatency(InputLatencyType type, double received)
 {
-   _ASSERTE(offset != 0);
-
-   const auto cColors = static_cast<int>(m_wndColorPickerBtn.GetColorTable().size());
-
-   // Based on our current position, compute a new position.
-   int iNewSelection;
-   if (m_iCurrentColor == kInvalidColorIndex)
-   {
-      iNewSelection = m_iChosenColor;
-   }
-   else if (m_iCurrentColor == kDefaultColorIndex)
-   {
-      iNewSelection = (offset > 0) ? 0
-                                   : kCustomColorIndex;
-   }
-   else if (m_iCurrentColor == kCustomColorIndex)
-   {
-      iNewSelection = (offset > 0) ? kDefaultColorIndex
-                                   : (cColors - 1);
-   }
-   else
+   if (const auto pStatsPage = m_wndColorPickerBtn.m_pStatsPage.get())
    {
-      iNewSelection = m_iCurrentColor + offset;
-      if (iNewSelection < 0)
+      if (type == InputLatencyType::Hover)
       {
-         iNewSelection = kDefaultColorIndex;
+         pStatsPage->RecordHoverEvent();
       }
-      else if (iNewSelection >= cColors)
+      else
       {
-         iNewSelection = kCustomColorIndex;
+         pStatsPage->RecordKeyEvent();
       }
    }
 
-   // For simplicity, the previous code blindly set default/custom indexes without caring
-   // if we really have those boxes. Now, the following code ensures that we actually map
-   // those values into their proper locations. This loop will run *at most* twice.
-   for (;;)
+   // If inputs arrive faster than they are painted, the paint is late for the earliest of them.
+   auto& inputReceived = m_inputsReceived[static_cast<size_t>(type)];
+   if ((inputReceived == 0.0) && this->GetUpdateRect(nullptr, FALSE))
    {
-      if ((iNewSelection == kDefaultColorIndex) && !(m_wndColorPickerBtn.GetShowDefault()))
-      {
-         iNewSelection = (offset > 0) ? 0
-                                      : kCustomColorIndex;
-      }
-      else if ((iNewSelection == kCustomColorIndex) && !(m_wndColorPickerBtn.GetShowCustom()))
+      inputReceived = received;
+   }
+}
+
+bool ColorPickerButton::ColorPickerPopup::HandleAccelerator(UINT nChar)
+{
+   if (m_wndColorPickerBtn.GetShowDefault())
+   {
+      const auto ochAccel = GetAcceleratorCharacterFromString(m_wndColorPickerBtn.GetDefaultText());
+      if (ochAccel && (nChar == *ochAccel))
       {
-         iNewSelection = (offset > 0) ? kDefaultColorIndex
-                                      : (cColors - 1);
+         m_pSelection->Select(kDefaultColorIndex);
+         m_pSelection->Close();  // finalize the new selection
+         return true;
       }
-      else
+   }
+   if (m_wndColorPickerBtn.GetShowCustom())
+   {
+      const auto ochAccel = GetAcceleratorCharacterFromString(m_wndColorPickerBtn.GetCustomText());
+      if (ochAccel && (nChar == *ochAccel))
       {
-         break;
+         m_pSelection->Select(kCustomColorIndex);
+         m_pSelection->Close();  // finalize the new selection
+         return true;
       }
    }
-
-   // Set the new location.
-   this->ChangeSelection(iNewSelection);
+   return false;
 }
 
-std::optional<RECT> ColorPickerButton::ColorPickerPopup::GetSwatchRect(int index) const
+bool ColorPickerButton::ColorPickerPopup::HasTypeaheadNames()
 {
-   if (index == kCustomColorIndex)
-   {
-      return m_rcCustomText;
-   }
-   else if (index == kDefaultColorIndex)
+   if (!m_hasTypeaheadNames)
    {
-      return m_rcDefaultText;
+      m_hasTypeaheadNames = m_wndColorPickerBtn.HasColorNames();
    }
-   else
+   return *m_hasTypeaheadNames;
+}
+
+bool ColorPickerButton::ColorPickerPopup::IsTypingTypeahead() const
+{
+   return !m_strTypeahead.IsEmpty() && ((m_inputTime - m_typeaheadTime) <= kTypeaheadTimeout);
+}
+
+void ColorPickerButton::ColorPickerPopup::UpdateTypeaheadMatches()
+{
+   m_typeaheadMatches = m_wndColorPickerBtn.GetNameSearchIndex().Find(m_strTypeahead);
+   m_iTypeaheadMatch  = 0;
+   if (!m_typeaheadMatches.empty())
    {
-      // The specified index should correspond to one of the color swatches;
-      // validate the range.
-      const auto cColors  = static_cast<LONG>(m_wndColorPickerBtn.GetColorTable().size());
-      const auto cColumns = m_wndColorPickerBtn.GetColorTableGrid().cy;
-      if ((index >= 0) && (index < cColors))
-      {
-         CRect rcSwatch;
-         rcSwatch.left   = m_rcSwatches.left + (kszSwatch.cx * (index % cColumns));
-         rcSwatch.top    = m_rcSwatches.top  + (kszSwatch.cy * (index / cColumns));
-         rcSwatch.right  = rcSwatch.left + kszSwatch.cx;
-         rcSwatch.bottom = rcSwatch.top  + kszSwatch.cy;
-         return rcSwatch;
-      }
-      else
-      {
-         return std::nullopt;
-      }
+      m_pSelection->Select(static_cast<int>(m_typeaheadMatches.front()));
    }
 }
 
+void ColorPickerButton::ColorPickerPopup::ChangeTypeaheadMatch(int offset)
+{
+   _ASSERTE(!m_typeaheadMatches.empty());
+
+   const auto cMatches = static_cast<int>(m_typeaheadMatches.size());
+   m_iTypeaheadMatch   = static_cast<size_t>(((static_cast<int>(m_iTypeaheadMatch) + offset) % cMatches + cMatches) % cMatches);
+   m_pSelection->Select(static_cast<int>(m_typeaheadMatches[m_iTypeaheadMatch]));
+}
+
 std::optional<ColorPickerButton::ColorPickerPopup::PaintSwatchInfo>
    ColorPickerButton::ColorPickerPopup::GetPaintSwatchInfo(int index) const
 {
-   const auto orcSwatch = this->GetSwatchRect(index);
+   const auto orcSwatch = m_pSelection->GetSwatchRect(index);
    if (orcSwatch)
    {
       PaintSwatchInfo info;
-      info.hot      = (index == m_iCurrentColor);
-      info.selected = (index == m_iChosenColor);
+      info.hot      = (index == m_pSelection->GetCurrent());
+      info.selected = (index == m_pSelection->GetChosen());
       info.rc       = *orcSwatch;
       switch (index)
       {
@@ -1362,7 +3088,8 @@ std::optional<ColorPickerButton::ColorPickerPopup::PaintSwatchInfo>
             info.szMargin   = kszSwatchMargin;
             info.szHiBorder = kszSwatchHiBorder;
             info.pstrText   = nullptr;
-            info.clr        = m_wndColorPickerBtn.GetColorTable()[index].first;
+            info.clr        = m_usePaletteIndices ? PALETTEINDEX(index)
+                                                  : m_wndColorPickerBtn.GetColorAt(index);
             break;
          }
       }
@@ -1383,7 +3110,8 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchUnthemed(int      index,
                                                               COLORREF clrHighlightText,
                                                               COLORREF clrLowlight)
 {
-   auto oSwatch = this->GetPaintSwatchInfo(index);
+   auto& counters = m_wndColorPickerBtn.m_paintCounters;
+   auto  oSwatch  = this->GetPaintSwatchInfo(index);
    if (oSwatch)
    {
       // Draw the outline of the swatch cell.
@@ -1394,25 +3122,25 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchUnthemed(int      index,
          // Draw the background margin (if there is one).
          if ((oSwatch->szMargin.cx > 0) || (oSwatch->szMargin.cy > 0))
          {
-            FillSolidRect(dc.m_hDC, oSwatch->rc, clrBackground);
+            FillSolidRect(dc.m_hDC, oSwatch->rc, clrBackground, counters);
             oSwatch->rc.InflateRect(-oSwatch->szMargin.cx,
                                     -oSwatch->szMargin.cy);
          }
 
          // Draw the selection rectangle.
-         FillSolidRect(dc.m_hDC, oSwatch->rc, clrHighlightBorder);
+         FillSolidRect(dc.m_hDC, oSwatch->rc, clrHighlightBorder, counters);
          oSwatch->rc.InflateRect(-1, -1);
 
          // Draw the inner coloring.
          FillSolidRect(dc.m_hDC, oSwatch->rc, (oSwatch->hot ? clrHighlight
-                                                            : clrLowlight));
+                                                            : clrLowlight), counters);
          oSwatch->rc.InflateRect(-(oSwatch->szHiBorder.cx - 1),
                                  -(oSwatch->szHiBorder.cy - 1));
       }
       else
       {
          // Otherwise, the swatch is not selected, so just fill the background.
-         FillSolidRect(dc.m_hDC, oSwatch->rc, clrBackground);
+         FillSolidRect(dc.m_hDC, oSwatch->rc, clrBackground, counters);
          oSwatch->rc.InflateRect(-(oSwatch->szMargin.cx + oSwatch->szHiBorder.cx),
                                  -(oSwatch->szMargin.cy + oSwatch->szHiBorder.cy));
       }
@@ -1432,9 +3160,9 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchUnthemed(int      index,
       else
       {
          // Draw the color.
-         FillSolidRect(dc.m_hDC, oSwatch->rc, ::GetSysColor(COLOR_3DSHADOW));
+         FillSolidRect(dc.m_hDC, oSwatch->rc, ::GetSysColor(COLOR_3DSHADOW), counters);
          oSwatch->rc.InflateRect(-1, -1);
-         FillSolidRect(dc.m_hDC, oSwatch->rc, m_wndColorPickerBtn.GetColorTable()[index].first);
+         FillSolidRect(dc.m_hDC, oSwatch->rc, oSwatch->clr, counters);
       }
    }
 }
@@ -1444,7 +3172,8 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchThemed(int                i
                                                             const ThemeHelper& theme,
                                                             const MARGINS&     marginsBorder)
 {
-   auto oSwatch = this->GetPaintSwatchInfo(index);
+   auto& counters = m_wndColorPickerBtn.m_paintCounters;
+   auto  oSwatch  = this->GetPaintSwatchInfo(index);
    if (oSwatch)
    {
       // Draw the outline of the swatch cell.
@@ -1454,7 +3183,7 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchThemed(int                i
                                  -(oSwatch->szMargin.cy - 1),
                                  -(oSwatch->szMargin.cx - 1),
                                  -(oSwatch->szMargin.cy));  // to match the hot outline
-         theme.DrawThemeBackground(dc.m_hDC, MENU_BARITEM, MBI_PUSHED, oSwatch->rc);
+         DrawThemePart(theme, dc.m_hDC, MENU_BARITEM, MBI_PUSHED, oSwatch->rc, counters);
          oSwatch->rc.InflateRect(-1, -1, -1, 0);
       }
       if (oSwatch->hot)
@@ -1473,7 +3202,7 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchThemed(int                i
             oSwatch->rc.InflateRect(-oSwatch->szMargin.cx,
                                     -oSwatch->szMargin.cy);
          }
-         theme.DrawThemeBackground(dc.m_hDC, MENU_POPUPITEM, MPI_HOT, oSwatch->rc);
+         DrawThemePart(theme, dc.m_hDC, MENU_POPUPITEM, MPI_HOT, oSwatch->rc, counters);
       }
 
       // Draw the contents of the swatch cell.
@@ -1494,38 +3223,47 @@ void ColorPickerButton::ColorPickerPopup::PaintSwatchThemed(int                i
          // Draw the color.
          oSwatch->rc.InflateRect(-(oSwatch->szMargin.cx + oSwatch->szHiBorder.cx),
                                  -(oSwatch->szMargin.cy + oSwatch->szHiBorder.cy));
-         theme.DrawThemeBackground(dc.m_hDC, MENU_POPUPBORDERS, 0, oSwatch->rc);
+         DrawThemePart(theme, dc.m_hDC, MENU_POPUPBORDERS, 0, oSwatch->rc, counters);
          oSwatch->rc.InflateRect(-marginsBorder.cxLeftWidth,
                                  -marginsBorder.cyTopHeight,
                                  -marginsBorder.cxRightWidth,
                                  -marginsBorder.cyBottomHeight);
-         FillSolidRect(dc.m_hDC, oSwatch->rc, m_wndColorPickerBtn.GetColorTable()[index].first);
+         FillSolidRect(dc.m_hDC, oSwatch->rc, oSwatch->clr, counters);
       }
    }
 }
 
 void ColorPickerButton::ColorPickerPopup::PaintContent(CDC& dc)
 {
-   const auto cColors = m_wndColorPickerBtn.GetColorTable().size();
+   TRACE_PHASE(this->GetTraceSink(), "PaintContent");
+
+   auto& counters = m_wndColorPickerBtn.m_paintCounters;
+   ++counters.cPopupPaints;
+
+   const auto cColors = m_wndColorPickerBtn.GetColorCount();
 
    // Save the DC state.
    const auto iDCSaved = dc.SaveDC();
    _ASSERTE(iDCSaved > 0);
 
-   // If we have a palette, select and realize it.
+   // If we have a palette, select and realize it. While it is realized, the swatches are
+   // filled using palette indices, so that GDI does not have to search for the nearest entries.
    auto& palette = m_wndColorPickerBtn.GetPalette();
-   if (palette.m_hObject &&
-       ((dc.GetDeviceCaps(RASTERCAPS) & RC_PALETTE) == RC_PALETTE))
+   m_usePaletteIndices = (palette.m_hObject &&
+                          ((dc.GetDeviceCaps(RASTERCAPS) & RC_PALETTE) == RC_PALETTE));
+   if (m_usePaletteIndices)
    {
-      dc.SelectPalette(&palette, FALSE);
-      VERIFY(dc.RealizePalette() != GDI_ERROR);
+      // (The handles are selected directly, since CDC would wrap the ones that it returns in
+      // temporary objects, which are allocated.)
+      ::SelectPalette(dc.m_hDC, static_cast<HPALETTE>(palette.m_hObject), FALSE);
+      VERIFY(::RealizePalette(dc.m_hDC) != GDI_ERROR);
    }
 
    // Select the font.
-   const auto pFont = m_wndColorPickerBtn.GetFont();
-   if (pFont)
+   const auto hFont = reinterpret_cast<HFONT>(m_wndColorPickerBtn.SendMessage(WM_GETFONT));
+   if (hFont)
    {
-      dc.SelectObject(pFont);
+      ::SelectObject(dc.m_hDC, hFont);
    }
 
    // Get the client rectangle.
@@ -1544,14 +3282,14 @@ void ColorPickerButton::ColorPickerPopup::PaintContent(CDC& dc)
                                                 rc);
 
       // Draw the pop-up window's border.
-      theme.DrawThemeBackground(dc.m_hDC, MENU_POPUPBORDERS, 0, rc);
+      DrawThemePart(theme, dc.m_hDC, MENU_POPUPBORDERS, 0, rc, counters);
       rc.DeflateRect(border.cxLeftWidth,
                      border.cyTopHeight,
                      border.cxRightWidth,
                      border.cyBottomHeight);
 
       // Then, draw the pop-up window's background inside of that border.
-      theme.DrawThemeBackground(dc.m_hDC, MENU_POPUPBACKGROUND, 0, rc);
+      DrawThemePart(theme, dc.m_hDC, MENU_POPUPBACKGROUND, 0, rc, counters);
 
       // Draw the default/automatic color area.
       if (m_wndColorPickerBtn.GetShowDefault())
@@ -1581,9 +3319,15 @@ void ColorPickerButton::ColorPickerPopup::PaintContent(CDC& dc)
       const auto clrHighlightBorder = ::GetSysColor(COLOR_HIGHLIGHT);
       const auto clrHighlight       = (flatMenus) ? ::GetSysColor(COLOR_MENUHILIGHT) : clrHighlightBorder;
       const auto clrHighlightText   = ::GetSysColor(COLOR_HIGHLIGHTTEXT);
-      const auto clrLowlight        = RGB((GetRValue(clrBackground) * (255 - kAlpha) + GetRValue(clrHighlightBorder) * kAlpha) >> 8,
+      auto       clrLowlight        = RGB((GetRValue(clrBackground) * (255 - kAlpha) + GetRValue(clrHighlightBorder) * kAlpha) >> 8,
                                           (GetGValue(clrBackground) * (255 - kAlpha) + GetGValue(clrHighlightBorder) * kAlpha) >> 8,
                                           (GetBValue(clrBackground) * (255 - kAlpha) + GetBValue(clrHighlightBorder) * kAlpha) >> 8);
+      if (m_usePaletteIndices)
+      {
+         // The blended color is unlikely to be in the system palette, so rather than letting
+         // it be dithered, snap it to the nearest entry in our own (realized) palette.
+         clrLowlight = PALETTEINDEX(m_wndColorPickerBtn.GetColorTableIndex()->LookupNearest(clrLowlight));
+      }
 
       // Draw the pop-up window's border.
       if (flatMenus)
@@ -1640,135 +3384,150 @@ void ColorPickerButton::ColorPickerPopup::PaintContent(CDC& dc)
 }
 
 BEGIN_MESSAGE_MAP(ColorPickerButton::ColorPickerPopup, CWnd)
-   ON_WM_SYSKEYDOWN()
-   ON_WM_KEYDOWN()
-   ON_WM_LBUTTONDOWN()
-   ON_WM_MOUSEMOVE()
    ON_WM_PAINT()
    ON_MESSAGE(WM_PRINTCLIENT, OnPrintClient)
    ON_WM_QUERYNEWPALETTE()
    ON_WM_PALETTECHANGED()
+   ON_NOTIFY_EX_RANGE(TTN_GETDISPINFO, 0, UINT_MAX, OnToolTipGetDispInfo)
 END_MESSAGE_MAP()
 
-void ColorPickerButton::ColorPickerPopup::OnSysKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
+void ColorPickerButton::ColorPickerPopup::HandleSysKeyDown(UINT nChar, UINT nFlags)
 {
    const auto altKeyDown = ((nFlags & (1U << 13U)) == (1U << 13U));  // check the 13th bit
    if (nChar == VK_MENU)
    {
       // If the Alt key is pressed, then show keyboard accelerators (in case they are not already).
       m_wndColorPickerBtn.SendMessage(WM_CHANGEUISTATE, MAKEWPARAM(UIS_CLEAR, UISF_HIDEACCEL), 0);
+      ++m_wndColorPickerBtn.m_paintCounters.cInvalidations;
       this->Invalidate(TRUE);
    }
-   else if (((nChar == VK_DOWN) || (nChar == VK_UP)) && (altKeyDown))
-   {
-      // Alt+Down Arrow and Alt+Up Arrow should close the picker, just as they opened it.
-      this->Close();
-   }
-   else
+   else if (!m_pSelection->HandleKey(nChar, altKeyDown))  // (Alt+Down Arrow and Alt+Up Arrow close the picker)
    {
-      CWnd::OnSysKeyDown(nChar, nRepCnt, nFlags);
+      this->HandleAccelerator(nChar);  // (Alt+letter always chooses an accelerator, even while typing)
    }
 }
 
-void ColorPickerButton::ColorPickerPopup::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
+void ColorPickerButton::ColorPickerPopup::HandleKeyDown(UINT nChar)
 {
+   // The keys that edit the typeahead query, or step through its matches, go to it while it is
+   // being typed, before the selection sees them.
    switch (nChar)
    {
       case VK_ESCAPE:
       {
-         this->Cancel();
-         return;
+         // Escape abandons the typeahead query, if one is being typed, before the picker.
+         if (this->IsTypingTypeahead())
+         {
+            m_strTypeahead.Empty();
+            m_typeaheadMatches.clear();
+            return;
+         }
+         break;
       }
-      case VK_RETURN:
       case VK_SPACE:
-      case VK_F4:
       {
-         this->Close();
-         return;
-      }
-      case VK_LEFT:  // left arrow
-      {
-         this->ChangeSelectionByOffset(-1);
-         return;
-      }
-      case VK_RIGHT:  // right arrow
-      {
-         this->ChangeSelectionByOffset(1);
-         return;
+         if (this->IsTypingTypeahead())
+         {
+            return;  // the space is part of the query (see HandleChar)
+         }
+         break;
       }
-      case VK_UP:     // up arrow
-      case VK_PRIOR:  // page up
+      case VK_BACK:  // backspace
       {
-         this->ChangeSelectionByOffset(-m_wndColorPickerBtn.GetColorTableGrid().cy);
-         return;
+         if (this->IsTypingTypeahead())
+         {
+            m_strTypeahead.Delete(m_strTypeahead.GetLength() - 1);
+            m_typeaheadTime = m_inputTime;
+            this->UpdateTypeaheadMatches();
+            return;
+         }
+         break;
       }
-      case VK_DOWN:  // down arrow
-      case VK_NEXT:  // page down
+      case VK_TAB:
+      case VK_F3:
       {
-         this->ChangeSelectionByOffset(m_wndColorPickerBtn.GetColorTableGrid().cy);
-         return;
+         // Step through the typeahead query's matches, forwards, or backwards with Shift.
+         if (!m_typeaheadMatches.empty())
+         {
+            this->ChangeTypeaheadMatch(m_isShiftDown ? -1 : 1);
+            return;
+         }
+         break;
       }
       default:
       {
-         // Handle accelerators, if any.
-         if (m_wndColorPickerBtn.GetShowDefault())
-         {
-            const auto ochAccel = GetAcceleratorCharacterFromString(m_wndColorPickerBtn.GetDefaultText());
-            if (ochAccel && (nChar == *ochAccel))
-            {
-               this->ChangeSelection(kDefaultColorIndex);
-               this->Close();  // finalize the new selection
-               return;
-            }
-         }
-         if (m_wndColorPickerBtn.GetShowCustom())
-         {
-            const auto ochAccel = GetAcceleratorCharacterFromString(m_wndColorPickerBtn.GetCustomText());
-            if (ochAccel && (nChar == *ochAccel))
-            {
-               this->ChangeSelection(kCustomColorIndex);
-               this->Close();  // finalize the new selection
-               return;
-            }
-         }
          break;
       }
    }
 
-   CWnd::OnKeyDown(nChar, nRepCnt, nFlags);
-}
-
-void ColorPickerButton::ColorPickerPopup::OnLButtonDown(UINT /* nFlags */, CPoint point)
-{
-   // Perform a hit-test to see what the pointer was on when the button was released.
-   // If it is a valid location that corresponds to a different color
-   // than the currently-selected color, then change the selection.
-   const auto iNewSelection = this->HitTest(point);
-   if (iNewSelection != m_iCurrentColor)
+   // The arrow keys move the selection, and Enter, Space, F4, and Escape close the picker.
+   if (m_pSelection->HandleKey(nChar, false))
    {
-      this->ChangeSelection(iNewSelection);
+      return;
    }
 
-   this->Close();
+   // Handle accelerators, if any, unless the table has names, in which case every letter
+   // belongs to a typeahead query (see HandleChar), since a name such as "Amber" may start with
+   // an accelerator's letter. (Accelerators with the Alt key always work; see HandleSysKeyDown.)
+   // Whether there are names is found without building the name search index, so that it
+   // is not built until a query is actually started.
+   if (!this->HasTypeaheadNames())
+   {
+      this->HandleAccelerator(nChar);
+   }
 }
 
-void ColorPickerButton::ColorPickerPopup::OnMouseMove(UINT /* nFlags */, CPoint point)
+void ColorPickerButton::ColorPickerPopup::HandleChar(UINT nChar)
 {
-   // Perform a hit-test to get the row and column of the currently-hovered color
-   // (or one of the special IDs for the default/automatic color or a custom color).
-   // If it is a valid location that corresponds to a different color than the
-   // currently-selected color, then change the selection.
-   const auto iNewSelection = this->HitTest(point);
-   if (iNewSelection != m_iCurrentColor)
+   // Control characters (from Backspace, Tab, Enter, and Escape) are handled as keys, by HandleKeyDown.
+   // Anything else starts or continues a typeahead query, so this is where the name search index
+   // is first needed (and built, if the table has changed since it last was), and where the lookup
+   // of the cached index is recorded, once per session.
+   if (nChar < TEXT(' '))
+   {
+      return;
+   }
+   if (!m_isNameIndexCounted)
+   {
+      m_isNameIndexCounted = true;
+      if (const auto pStatsPage = m_wndColorPickerBtn.m_pStatsPage.get())
+      {
+         pStatsPage->RecordCacheLookup(!m_wndColorPickerBtn.IsNameSearchIndexStale());
+      }
+   }
+   if (m_wndColorPickerBtn.GetNameSearchIndex().IsEmpty())
+   {
+      return;
+   }
+
+   // Add the character to the query, starting a new query after a pause in typing,
+   // as a list box does, and select the best match.
+   if (!this->IsTypingTypeahead())
    {
-      this->ChangeSelection(iNewSelection);
+      m_strTypeahead.Empty();
    }
+   m_typeaheadTime = m_inputTime;
+   m_strTypeahead.AppendChar(static_cast<TCHAR>(nChar));
+   this->UpdateTypeaheadMatches();
 }
 
 void ColorPickerButton::ColorPickerPopup::OnPaint()
 {
    CPaintDC dc(this);
+   CHECK_NO_ALLOCATIONS_IF(m_isTakingInput && !this->GetTraceSink(), "OnPaint");
    this->PaintContent(dc);
+
+   // Record the latency of the inputs, if any, that this paint displays the result of.
+   const auto painted = TraceTimer::GetTimestamp();
+   for (size_t iType = 0; iType < ARRAYSIZE(m_inputsReceived); ++iType)
+   {
+      if (m_inputsReceived[iType] != 0.0)
+      {
+         const auto latency = std::min(painted - m_inputsReceived[iType], static_cast<double>(UINT32_MAX));
+         m_wndColorPickerBtn.RecordInputLatency(static_cast<InputLatencyType>(iType), static_cast<UINT32>(latency));
+         m_inputsReceived[iType] = 0.0;
+      }
+   }
 }
 
 LRESULT ColorPickerButton::ColorPickerPopup::OnPrintClient(WPARAM wParam, LPARAM /* lParam */)
@@ -1787,6 +3546,7 @@ LRESULT ColorPickerButton::ColorPickerPopup::OnPrintClient(WPARAM wParam, LPARAM
 BOOL ColorPickerButton::ColorPickerPopup::OnQueryNewPalette()
 {
    const auto result = CWnd::OnQueryNewPalette();
+   ++m_wndColorPickerBtn.m_paintCounters.cInvalidations;
    this->Invalidate(TRUE);
    return result;
 }
@@ -1796,6 +3556,25 @@ void ColorPickerButton::ColorPickerPopup::OnPaletteChanged(CWnd* pFocusWnd)
    CWnd::OnPaletteChanged(pFocusWnd);
    if (pFocusWnd && (pFocusWnd->m_hWnd != this->m_hWnd))
    {
+      ++m_wndColorPickerBtn.m_paintCounters.cInvalidations;
       this->Invalidate(TRUE);
    }
 }
+
+BOOL ColorPickerButton::ColorPickerPopup::OnToolTipGetDispInfo(UINT /* id */, NMHDR* pNMHDR, LRESULT* pResult)
+{
+   // Look up the name of the swatch only now, since it may be resolved lazily
+   // (see ColorNameTable). The tooltip's tool is on the swatch that the mouse is over.
+   if ((pNMHDR->idFrom != kToolTipId) ||
+       (m_iToolTipColor < 0)          ||
+       (static_cast<size_t>(m_iToolTipColor) >= m_wndColorPickerBtn.GetColorCount()))
+   {
+      return FALSE;
+   }
+
+   const auto pInfo = reinterpret_cast<NMTTDISPINFO*>(pNMHDR);
+   pInfo->lpszText  = const_cast<LPTSTR>(this->GetToolTipText(static_cast<size_t>(m_iToolTipColor)));
+   pInfo->hinst     = nullptr;
+   *pResult         = 0;
+   return TRUE;
+}
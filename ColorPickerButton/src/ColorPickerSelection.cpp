@@ -0,0 +1,359 @@
+#include "PCH.hpp"
+#include "ColorPickerSelection.hpp"
+#include "ColorPickerButton.hpp"
+#include "DisplayOrder.hpp"
+
+
+namespace {
+
+constexpr SIZE kszSwatch = ColorPickerButton::kszColorSwatch;
+
+}  // anonymous namespace
+
+
+void ColorPickerSelection::Layout::Arrange(CSize szText, CSize szMargins)
+{
+   // Compute the minimum width.
+   const auto cxTotalBoxWidth = grid.cy * kszSwatch.cx;
+   auto       cxMinWidth      = cxTotalBoxWidth;
+   if (cxMinWidth < szText.cx)
+   {
+      cxMinWidth = szText.cx;
+   }
+
+   // Create the rectangle for the default text.
+   rcDefaultText.SetRect(0, 0, cxMinWidth, showDefault ? szText.cy : 0);
+
+   // Initialize the color box rectangle.
+   rcSwatches = CRect(CPoint((cxMinWidth - cxTotalBoxWidth) / 2, rcDefaultText.bottom),
+                      CSize(cxTotalBoxWidth, grid.cx * kszSwatch.cy));
+
+   // Create the rectangle for the custom text.
+   rcCustomText = CRect(CPoint(0, rcSwatches.bottom),
+                        CSize(cxMinWidth, showCustom ? szText.cy : 0));
+
+   // Adjust the rectangles for the border.
+   szClient = CSize(cxMinWidth + (szMargins.cx * 2), rcCustomText.bottom + (szMargins.cy * 2));
+   rcDefaultText.OffsetRect(szMargins);
+   rcSwatches   .OffsetRect(szMargins);
+   rcCustomText .OffsetRect(szMargins);
+}
+
+/* static */ CSize ColorPickerSelection::ComputeGrid(size_t cColors, size_t cColumns)
+{
+   _ASSERTE(cColumns > 0);
+
+   const auto cRows = ((cColors / cColumns) + ((cColors % cColumns) != 0));
+   return CSize(static_cast<int>(cRows), static_cast<int>(cColumns));
+}
+
+
+ColorPickerSelection::ColorPickerSelection()
+   : m_layout  ()
+   , m_iCurrent(kInvalidIndex)
+   , m_iChosen (kInvalidIndex)
+   , m_isOkayed(false)
+   , m_isClosed(false)
+{ }
+
+void ColorPickerSelection::Start(const Layout& layout, int iChosen)
+{
+   _ASSERTE(layout.pDisplayOrder);
+   _ASSERTE(iChosen < static_cast<int>(layout.cColors));
+
+   m_layout   = layout;
+   m_iCurrent = kInvalidIndex;
+   m_iChosen  = iChosen;
+   m_isOkayed = false;
+   m_isClosed = false;
+}
+
+const ColorPickerSelection::Layout& ColorPickerSelection::GetLayout() const
+{
+   return m_layout;
+}
+
+int ColorPickerSelection::GetCurrent() const
+{
+   return m_iCurrent;
+}
+
+int ColorPickerSelection::GetChosen() const
+{
+   return m_iChosen;
+}
+
+bool ColorPickerSelection::IsClosed() const
+{
+   return m_isClosed;
+}
+
+bool ColorPickerSelection::IsOkayed() const
+{
+   return m_isOkayed;
+}
+
+int ColorPickerSelection::HitTest(const POINT& pt) const
+{
+   // If in the custom text rectangle, return that index.
+   if (m_layout.rcCustomText.PtInRect(pt))
+   {
+      return kCustomIndex;
+   }
+
+   // If in the default/automatic text rectangle, return that index.
+   if (m_layout.rcDefaultText.PtInRect(pt))
+   {
+      return kDefaultIndex;
+   }
+
+   // If the point isn't in the rectangle containing the color swatches, return an invalid color.
+   if (!m_layout.rcSwatches.PtInRect(pt))
+   {
+      return kInvalidIndex;
+   }
+
+   // Convert the point to a display position, and then to a specific color index.
+   const auto cColors = static_cast<int>(m_layout.cColors);
+   const auto row     = (pt.y - m_layout.rcSwatches.top)  / kszSwatch.cy;
+   const auto col     = (pt.x - m_layout.rcSwatches.left) / kszSwatch.cx;
+   if ((row < 0) || (row >= m_layout.grid.cx) ||
+       (col < 0) || (col >= m_layout.grid.cy))
+   {
+      return kInvalidIndex;
+   }
+   else
+   {
+      const auto position = row * m_layout.grid.cy + col;
+      return (position < cColors) ? static_cast<int>(m_layout.pDisplayOrder->IndexFromPosition(position))
+                                  : kInvalidIndex;
+   }
+}
+
+std::optional<RECT> ColorPickerSelection::GetSwatchRect(int index) const
+{
+   if (index == kCustomIndex)
+   {
+      return m_layout.rcCustomText;
+   }
+   else if (index == kDefaultIndex)
+   {
+      return m_layout.rcDefaultText;
+   }
+   else if ((index >= 0) && (index < static_cast<int>(m_layout.cColors)))
+   {
+      // A static table's swatches were laid out at compile time, for display in table order.
+      if (m_layout.prcStaticSwatches)
+      {
+         CRect rcSwatch(m_layout.prcStaticSwatches[index]);
+         rcSwatch.OffsetRect(m_layout.rcSwatches.TopLeft());
+         return rcSwatch;
+      }
+
+      const auto cColumns = m_layout.grid.cy;
+      const auto position = static_cast<LONG>(m_layout.pDisplayOrder->PositionFromIndex(index));
+      CRect      rcSwatch;
+      rcSwatch.left   = m_layout.rcSwatches.left + (kszSwatch.cx * (position % cColumns));
+      rcSwatch.top    = m_layout.rcSwatches.top  + (kszSwatch.cy * (position / cColumns));
+      rcSwatch.right  = rcSwatch.left + kszSwatch.cx;
+      rcSwatch.bottom = rcSwatch.top  + kszSwatch.cy;
+      return rcSwatch;
+   }
+   else
+   {
+      return std::nullopt;
+   }
+}
+
+bool ColorPickerSelection::HandleInput(const InputEvent& event)
+{
+   if (m_isClosed)
+   {
+      return false;
+   }
+
+   const CPoint point(GET_X_LPARAM(event.lParam), GET_Y_LPARAM(event.lParam));
+   switch (event.type)
+   {
+      case InputEvent::Type::MouseMove:
+      {
+         // Whatever is under the pointer becomes current (or nothing does, if it is off of them).
+         this->Select(this->HitTest(point));
+         return true;
+      }
+      case InputEvent::Type::LButtonDown:
+      {
+         // A click chooses whatever is under the pointer, or cancels, if it is off of them.
+         this->Select(this->HitTest(point));
+         this->Close();
+         return true;
+      }
+      case InputEvent::Type::KeyDown:
+      {
+         return this->HandleKey(event.wParam, false);
+      }
+      case InputEvent::Type::SysKeyDown:
+      {
+         return this->HandleKey(event.wParam, ((HIWORD(event.lParam) & KF_ALTDOWN) == KF_ALTDOWN));
+      }
+      default:
+      {
+         // (Releasing the button does nothing, since pressing it already chose, and characters
+         // are for the typeahead query.)
+         return false;
+      }
+   }
+}
+
+bool ColorPickerSelection::HandleKey(UINT nChar, bool isAltDown)
+{
+   if (m_isClosed)
+   {
+      return false;
+   }
+
+   if (isAltDown)
+   {
+      // Alt+Down Arrow and Alt+Up Arrow should close the picker, just as they opened it.
+      if ((nChar == VK_DOWN) || (nChar == VK_UP))
+      {
+         this->Close();
+         return true;
+      }
+      return false;
+   }
+
+   switch (nChar)
+   {
+      case VK_ESCAPE:
+      {
+         this->Cancel();
+         return true;
+      }
+      case VK_SPACE:
+      case VK_RETURN:
+      case VK_F4:
+      {
+         this->Close();
+         return true;
+      }
+      case VK_LEFT:   // left arrow
+      {
+         this->SelectByOffset(-1);
+         return true;
+      }
+      case VK_RIGHT:  // right arrow
+      {
+         this->SelectByOffset(1);
+         return true;
+      }
+      case VK_UP:     // up arrow
+      case VK_PRIOR:  // page up
+      {
+         this->SelectByOffset(-m_layout.grid.cy);
+         return true;
+      }
+      case VK_DOWN:   // down arrow
+      case VK_NEXT:   // page down
+      {
+         this->SelectByOffset(m_layout.grid.cy);
+         return true;
+      }
+      default:
+      {
+         return false;
+      }
+   }
+}
+
+void ColorPickerSelection::Select(int index)
+{
+   // Ensure that the specified index is in range.
+   _ASSERTE(index >= kDefaultIndex);
+   _ASSERTE(index < static_cast<int>(m_layout.cColors));
+   _ASSERTE(!m_isClosed);
+
+   m_iCurrent = index;
+}
+
+void ColorPickerSelection::SelectByOffset(int offset)
+{
+   _ASSERTE(offset != 0);
+
+   const auto  cColors      = static_cast<int>(m_layout.cColors);
+   const auto& displayOrder = *m_layout.pDisplayOrder;
+
+   // Based on our current position, compute a new position. Color swatches are visited in the
+   // order in which they are displayed, which is not necessarily the order of their indices.
+   int iNewSelection;
+   if (m_iCurrent == kInvalidIndex)
+   {
+      iNewSelection = m_iChosen;
+   }
+   else if (m_iCurrent == kDefaultIndex)
+   {
+      iNewSelection = (offset > 0) ? static_cast<int>(displayOrder.IndexFromPosition(0))
+                                   : kCustomIndex;
+   }
+   else if (m_iCurrent == kCustomIndex)
+   {
+      iNewSelection = (offset > 0) ? kDefaultIndex
+                                   : static_cast<int>(displayOrder.IndexFromPosition(cColors - 1));
+   }
+   else
+   {
+      const auto newPosition = static_cast<int>(displayOrder.PositionFromIndex(m_iCurrent)) + offset;
+      if (newPosition < 0)
+      {
+         iNewSelection = kDefaultIndex;
+      }
+      else if (newPosition >= cColors)
+      {
+         iNewSelection = kCustomIndex;
+      }
+      else
+      {
+         iNewSelection = static_cast<int>(displayOrder.IndexFromPosition(newPosition));
+      }
+   }
+
+   // For simplicity, the previous code blindly set default/custom indexes without caring
+   // if we really have those boxes. Now, the following code ensures that we actually map
+   // those values into their proper locations. This loop will run *at most* twice.
+   for (;;)
+   {
+      if ((iNewSelection == kDefaultIndex) && !m_layout.showDefault)
+      {
+         iNewSelection = (offset > 0) ? static_cast<int>(displayOrder.IndexFromPosition(0))
+                                      : kCustomIndex;
+      }
+      else if ((iNewSelection == kCustomIndex) && !m_layout.showCustom)
+      {
+         iNewSelection = (offset > 0) ? kDefaultIndex
+                                      : static_cast<int>(displayOrder.IndexFromPosition(cColors - 1));
+      }
+      else
+      {
+         break;
+      }
+   }
+
+   // Set the new location.
+   this->Select(iNewSelection);
+}
+
+void ColorPickerSelection::Close()
+{
+   _ASSERTE(!m_isClosed);
+
+   m_isOkayed = (m_iCurrent != kInvalidIndex);
+   m_isClosed = true;
+}
+
+void ColorPickerSelection::Cancel()
+{
+   _ASSERTE(!m_isClosed);
+
+   m_isOkayed = false;
+   m_isClosed = true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "InputLog.hpp"
+#include <optional>
+
+class DisplayOrder;
+
+
+// The selection process of the popup: which option is current (hovered, or moved to with the keys),
+// which one was chosen when the popup opened, and whether the popup was okayed or cancelled. It only
+// knows the popup by its layout, so it can be driven, and tested, without a window. The popup drives
+// it from the inputs that it receives or replays, handling the typeahead query and the accelerators
+// itself (since they need the names and the texts), and repaints whatever the selection changes.
+//
+// The options are identified by the index of their table entry, or by one of the special indices.
+class ColorPickerSelection
+{
+public:
+
+   static constexpr int kDefaultIndex = -3;  // the default/automatic option
+   static constexpr int kCustomIndex  = -2;  // the custom option
+   static constexpr int kInvalidIndex = -1;  // no option
+
+   // Where the options are in the popup's client area, and what the selection needs to know
+   // to move between them.
+   struct Layout
+   {
+      CRect               rcDefaultText;      // the default/automatic option's text (empty if it is not shown)
+      CRect               rcSwatches;         // the swatches
+      CRect               rcCustomText;       // the custom option's text (empty if it is not shown)
+      CSize               szClient;           // the whole client area, with the margins around the options
+      CSize               grid;               // rows (cx) and columns (cy) of swatches, as from GetColorTableGrid
+      size_t              cColors;
+      const DisplayOrder* pDisplayOrder;      // where each entry is displayed (must outlive the selection's use of it)
+      const RECT*         prcStaticSwatches;  // if non-null, the swatch of each entry, relative to rcSwatches
+                                              //   (for a static table that is displayed in table order)
+      bool                showDefault;
+      bool                showCustom;
+
+      // Computes the rectangles, for the other members and the specified size of the text areas:
+      // the default option's text across the top, the swatches centered below it, and the custom
+      // option's text across the bottom, all within the specified margins. The client area is as
+      // wide as the wider of the text and the swatches.
+      void Arrange(CSize szText, CSize szMargins);
+   };
+
+   // Computes the rows (cx) and columns (cy) of the grid that a table of the specified number of
+   // colors is displayed in, with the specified number of columns.
+   static CSize ComputeGrid(size_t cColors, size_t cColumns);
+
+   ColorPickerSelection();
+
+   // Starts a session, with the specified layout, with the specified option chosen (the one that
+   // matches the button's color, if any), and with nothing current.
+   void Start(const Layout& layout, int iChosen);
+
+   const Layout& GetLayout() const;
+
+   int  GetCurrent() const;
+   int  GetChosen() const;
+   bool IsClosed() const;
+   bool IsOkayed() const;   // (false until the session is closed)
+
+   // Returns the option at the specified point, or kInvalidIndex if there is none there.
+   int HitTest(const POINT& pt) const;
+
+   // Returns the rectangle of the specified option, if the index is a valid one.
+   std::optional<RECT> GetSwatchRect(int index) const;
+
+   // Handles the inputs that depend only on the layout: moving and clicking the mouse, moving with
+   // the arrow keys, and okaying or cancelling with the keys. Returns false if the input is not one
+   // of these (or the session is closed), in which case nothing is changed.
+   bool HandleInput(const InputEvent& event);
+
+   // Handles a key, pressed with Alt (as in WM_SYSKEYDOWN) or without. Returns false if it is not
+   // one that the selection handles (or the session is closed), in which case nothing is changed.
+   bool HandleKey(UINT nChar, bool isAltDown);
+
+   // Makes the specified option current (kInvalidIndex for none).
+   void Select(int index);
+
+   // Moves the current option by the specified number of display positions, on to the default and
+   // custom options (if they are shown) past either end of the swatches. With nothing current,
+   // the chosen option becomes current.
+   void SelectByOffset(int offset);
+
+   // Closes the session, okaying the current option, or cancelling it if there is none.
+   void Close();
+
+   // Closes the session, cancelling it.
+   void Cancel();
+
+private:
+   Layout m_layout;
+   int    m_iCurrent;  // the current option
+   int    m_iChosen;   // the option that was chosen when the session started
+   bool   m_isOkayed;
+   bool   m_isClosed;
+};
@@ -0,0 +1,101 @@
+#include "PCH.hpp"
+#include "ColorSpace.hpp"
+#include <array>
+#include <cmath>
+
+
+namespace {
+
+// The sRGB transfer function is expensive (it calls pow), but there are only 256 possible inputs,
+// so decode through a table that is built once, on first use.
+const std::array<float, 256>& GetLinearizationTable()
+{
+   static const auto table = []
+   {
+      std::array<float, 256> result;
+      for (size_t i = 0; i < result.size(); ++i)
+      {
+         const auto v = static_cast<double>(i) / 255.0;
+         result[i]    = static_cast<float>((v <= 0.04045) ? (v / 12.92)
+                                                          : std::pow((v + 0.055) / 1.055, 2.4));
+      }
+      return result;
+   }();
+   return table;
+}
+
+BYTE EncodeSRGB(float linear)
+{
+   const auto v       = std::min(std::max(static_cast<double>(linear), 0.0), 1.0);
+   const auto encoded = (v <= 0.0031308) ? (v * 12.92)
+                                         : ((1.055 * std::pow(v, 1.0 / 2.4)) - 0.055);
+   return static_cast<BYTE>(std::lround(encoded * 255.0));
+}
+
+constexpr float kPi = 3.14159265358979323846f;
+
+}  // anonymous namespace
+
+namespace ColorSpace {
+
+Lab ToOKLab(BYTE r, BYTE g, BYTE b)
+{
+   const auto& linear = GetLinearizationTable();
+   const auto  lr     = linear[r];
+   const auto  lg     = linear[g];
+   const auto  lb     = linear[b];
+
+   const auto l = std::cbrt((0.4122214708f * lr) + (0.5363325363f * lg) + (0.0514459929f * lb));
+   const auto m = std::cbrt((0.2119034982f * lr) + (0.6806995451f * lg) + (0.1073969566f * lb));
+   const auto s = std::cbrt((0.0883024619f * lr) + (0.2817188376f * lg) + (0.6299787005f * lb));
+
+   return Lab{ (0.2104542553f * l) + (0.7936177850f * m) - (0.0040720468f * s),
+               (1.9779984951f * l) - (2.4285922050f * m) + (0.4505937099f * s),
+               (0.0259040371f * l) + (0.7827717662f * m) - (0.8086757660f * s) };
+}
+
+COLORREF FromOKLab(const Lab& lab)
+{
+   const auto l_ = lab.L + (0.3963377774f * lab.a) + (0.2158037573f * lab.b);
+   const auto m_ = lab.L - (0.1055613458f * lab.a) - (0.0638541728f * lab.b);
+   const auto s_ = lab.L - (0.0894841775f * lab.a) - (1.2914855480f * lab.b);
+
+   const auto l = l_ * l_ * l_;
+   const auto m = m_ * m_ * m_;
+   const auto s = s_ * s_ * s_;
+
+   return RGB(EncodeSRGB(( 4.0767416621f * l) - (3.3077115913f * m) + (0.2309699292f * s)),
+              EncodeSRGB((-1.2684380046f * l) + (2.6097574011f * m) - (0.3413193965f * s)),
+              EncodeSRGB((-0.0041960863f * l) - (0.7034186147f * m) + (1.7076147010f * s)));
+}
+
+COLORREF FromCIELab(float L, float a, float b)
+{
+   const auto finv = [](float t)
+   {
+      constexpr float kDelta = 6.0f / 29.0f;
+      return (t > kDelta) ? (t * t * t) : ((3.0f * kDelta * kDelta) * (t - (4.0f / 29.0f)));
+   };
+   const auto fy = (L + 16.0f) / 116.0f;
+   const auto x  = 0.9642f * finv(fy + (a / 500.0f));
+   const auto y  =           finv(fy);
+   const auto z  = 0.8251f * finv(fy - (b / 200.0f));
+
+   // XYZ (D50) to linear sRGB (D65), including the Bradford chromatic adaptation.
+   return RGB(EncodeSRGB(( 3.1338561f * x) - (1.6168667f * y) - (0.4906146f * z)),
+              EncodeSRGB((-0.9787684f * x) + (1.9161415f * y) + (0.0334540f * z)),
+              EncodeSRGB(( 0.0719453f * x) - (0.2289914f * y) + (1.4052427f * z)));
+}
+
+float Chroma(const Lab& lab)
+{
+   return std::sqrt((lab.a * lab.a) + (lab.b * lab.b));
+}
+
+float Hue(const Lab& lab)
+{
+   const auto degrees = std::atan2(lab.b, lab.a) * (180.0f / kPi);
+   return (degrees < 0.0f) ? (degrees + 360.0f) : degrees;
+}
+
+}  // namespace ColorSpace
@@ -0,0 +1,47 @@
+#pragma once
+
+
+// Conversions between 8-bit sRGB colors (COLORREF values) and the OKLab perceptual color space
+// (see https://bottosson.github.io/posts/oklab/). OKLab is used by the palette-processing code
+// because Euclidean distances within it track perceived color differences far better than
+// distances in sRGB do, yet it is nearly as cheap to convert to as linear RGB.
+namespace ColorSpace {
+
+struct Lab
+{
+   float L;  // perceived lightness, [0, 1]
+   float a;  // green (-) to red (+)
+   float b;  // blue (-) to yellow (+)
+};
+
+// Converts an 8-bit sRGB color to OKLab.
+Lab ToOKLab(BYTE r, BYTE g, BYTE b);
+
+inline Lab ToOKLab(COLORREF clr)
+{
+   return ToOKLab(GetRValue(clr), GetGValue(clr), GetBValue(clr));
+}
+
+// Converts an OKLab color to the closest 8-bit sRGB color, clamping out-of-gamut values.
+COLORREF FromOKLab(const Lab& lab);
+
+// Converts a CIELAB color (relative to the D50 white point, as used by print-oriented software
+// such as Photoshop) to the closest 8-bit sRGB color, clamping out-of-gamut values.
+COLORREF FromCIELab(float L, float a, float b);
+
+// Returns the squared Euclidean distance between two OKLab colors.
+inline float DistanceSquared(const Lab& x, const Lab& y)
+{
+   const auto dL = x.L - y.L;
+   const auto da = x.a - y.a;
+   const auto db = x.b - y.b;
+   return (dL * dL) + (da * da) + (db * db);
+}
+
+// Returns the chroma (colorfulness) of an OKLab color.
+float Chroma(const Lab& lab);
+
+// Returns the hue angle of an OKLab color, in degrees, in the range [0, 360).
+float Hue(const Lab& lab);
+
+}  // namespace ColorSpace
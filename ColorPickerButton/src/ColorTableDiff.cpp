@@ -0,0 +1,291 @@
+#include "PCH.hpp"
+#include "ColorTableDiff.hpp"
+#include "MemoryUsage.hpp"
+
+
+namespace {
+
+using ColorTable = ColorTableDiff::ColorTable;
+
+enum class Move
+{
+   Keep,    // the entries are equal
+   Delete,  // an entry of the old table is not in the new one
+   Insert,  // an entry of the new table is not in the old one
+};
+
+bool AreEntriesEqual(const ColorTable::value_type& entryFrom, const ColorTable::value_type& entryTo)
+{
+   return (entryFrom.first == entryTo.first) && (entryFrom.second == entryTo.second);
+}
+
+// Finds a shortest sequence of moves that turns tableFrom[first, first + cFrom) into
+// tableTo[first, first + cTo), using Myers' O(ND) algorithm. Returns false if more than
+// dMax deletions and insertions would be required.
+bool FindShortestMoves(const ColorTable&  tableFrom,
+                       const ColorTable&  tableTo,
+                       size_t             first,
+                       size_t             cFrom,
+                       size_t             cTo,
+                       size_t             dMax,
+                       std::vector<Move>& moves)
+{
+   const auto n      = static_cast<ptrdiff_t>(cFrom);
+   const auto m      = static_cast<ptrdiff_t>(cTo);
+   const auto max    = static_cast<ptrdiff_t>(std::min(cFrom + cTo, dMax));
+   const auto offset = max + 1;
+
+   // v[offset + k] is the furthest x reached on diagonal k (where y = x - k). A snapshot of
+   // the diagonals that each step reads is kept, so that the path can be traced back.
+   std::vector<ptrdiff_t>              v(2 * offset + 1, 0);
+   std::vector<std::vector<ptrdiff_t>> trace;
+   for (ptrdiff_t d = 0; d <= max; ++d)
+   {
+      trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+      for (ptrdiff_t k = -d; k <= d; k += 2)
+      {
+         auto x = ((k == -d) || ((k != d) && (v[offset + k - 1] < v[offset + k + 1]))) ? v[offset + k + 1]
+                                                                                      : v[offset + k - 1] + 1;
+         auto y = x - k;
+         while ((x < n) && (y < m) && AreEntriesEqual(tableFrom[first + x], tableTo[first + y]))
+         {
+            ++x;
+            ++y;
+         }
+         v[offset + k] = x;
+
+         if ((x >= n) && (y >= m))
+         {
+            // Trace the path back from the end, collecting the moves in reverse.
+            for (ptrdiff_t dBack = d; dBack > 0; --dBack)
+            {
+               const auto& vBack = trace[dBack];  // the diagonals as they were at the start of step dBack
+               const auto  kBack = x - y;
+               const auto  at    = [&vBack, dBack](ptrdiff_t kAt) { return vBack[kAt + dBack]; };
+               const auto  kPrev = ((kBack == -dBack) || ((kBack != dBack) && (at(kBack - 1) < at(kBack + 1)))) ? kBack + 1
+                                                                                                             : kBack - 1;
+               const auto  xPrev = at(kPrev);
+               const auto  yPrev = xPrev - kPrev;
+               while ((x > xPrev) && (y > yPrev))
+               {
+                  moves.push_back(Move::Keep);
+                  --x;
+                  --y;
+               }
+               moves.push_back((x == xPrev) ? Move::Insert : Move::Delete);
+               x = xPrev;
+               y = yPrev;
+            }
+            while ((x > 0) && (y > 0))
+            {
+               moves.push_back(Move::Keep);
+               --x;
+               --y;
+            }
+            std::reverse(moves.begin(), moves.end());
+            return true;
+         }
+      }
+   }
+   return false;
+}
+
+}  // anonymous namespace
+
+/* static */ std::optional<ColorTableDiff> ColorTableDiff::Compute(const ColorTable& tableFrom,
+                                                                   const ColorTable& tableTo,
+                                                                   size_t            cEditsMax /* = kcEditsMaxDefault */)
+{
+   // Most changes touch only a few entries, so skip the common prefix and suffix,
+   // which leaves the search for the edits with only the region that changed.
+   const auto cFrom  = tableFrom.size();
+   const auto cTo    = tableTo.size();
+   size_t     first  = 0;
+   while ((first < cFrom) && (first < cTo) && AreEntriesEqual(tableFrom[first], tableTo[first]))
+   {
+      ++first;
+   }
+   size_t     cLast  = 0;
+   while (((first + cLast) < cFrom) && ((first + cLast) < cTo) &&
+          AreEntriesEqual(tableFrom[cFrom - cLast - 1], tableTo[cTo - cLast - 1]))
+   {
+      ++cLast;
+   }
+   const auto cMiddleFrom = cFrom - first - cLast;
+   const auto cMiddleTo   = cTo   - first - cLast;
+
+   ColorTableDiff diff;
+   if ((cMiddleFrom == 0) && (cMiddleTo == 0))
+   {
+      return diff;
+   }
+
+   // Every edit accounts for at most two moves (a recolor and a rename together
+   // replace one deletion and one insertion).
+   std::vector<Move> moves;
+   if (!FindShortestMoves(tableFrom, tableTo, first, cMiddleFrom, cMiddleTo, cEditsMax * 2, moves))
+   {
+      return std::nullopt;
+   }
+
+   // Convert the moves into edits. Each run of deletions and insertions between two kept entries
+   // pairs off its deletions with its insertions, as changes to the entries in place; whatever is
+   // left over is removed or inserted. The index tracks the position in the table as it is edited.
+   auto   index = first;
+   size_t iFrom = first;
+   size_t iTo   = first;
+   for (size_t iMove = 0; iMove < moves.size(); )
+   {
+      if (moves[iMove] == Move::Keep)
+      {
+         ++index;
+         ++iFrom;
+         ++iTo;
+         ++iMove;
+         continue;
+      }
+
+      size_t cDeleted  = 0;
+      size_t cInserted = 0;
+      for (; (iMove < moves.size()) && (moves[iMove] != Move::Keep); ++iMove)
+      {
+         ++((moves[iMove] == Move::Delete) ? cDeleted : cInserted);
+      }
+
+      const auto cChanged = std::min(cDeleted, cInserted);
+      for (size_t i = 0; i < cChanged; ++i, ++index)
+      {
+         const auto& entryFrom = tableFrom[iFrom + i];
+         const auto& entryTo   = tableTo  [iTo   + i];
+         if (entryFrom.first != entryTo.first)
+         {
+            diff.Recolor(index, entryTo.first);
+         }
+         if (entryFrom.second != entryTo.second)
+         {
+            diff.Rename(index, entryTo.second);
+         }
+      }
+      for (size_t i = cChanged; i < cDeleted; ++i)
+      {
+         diff.Remove(index);
+      }
+      for (size_t i = cChanged; i < cInserted; ++i, ++index)
+      {
+         diff.Insert(index, tableTo[iTo + i].first, tableTo[iTo + i].second);
+      }
+      iFrom += cDeleted;
+      iTo   += cInserted;
+
+      if (diff.m_edits.size() > cEditsMax)
+      {
+         return std::nullopt;
+      }
+   }
+   _ASSERTE((iFrom == (cFrom - cLast)) && (iTo == (cTo - cLast)));
+   return diff;
+}
+
+
+void ColorTableDiff::Insert(size_t index, COLORREF clr, CString strName)
+{
+   m_edits.push_back({ Operation::Insert, index, clr, std::move(strName) });
+}
+
+void ColorTableDiff::Remove(size_t index)
+{
+   m_edits.push_back({ Operation::Remove, index, CLR_NONE, CString() });
+}
+
+void ColorTableDiff::Recolor(size_t index, COLORREF clr)
+{
+   m_edits.push_back({ Operation::Recolor, index, clr, CString() });
+}
+
+void ColorTableDiff::Rename(size_t index, CString strName)
+{
+   m_edits.push_back({ Operation::Rename, index, CLR_NONE, std::move(strName) });
+}
+
+
+bool ColorTableDiff::IsEmpty() const
+{
+   return m_edits.empty();
+}
+
+const std::vector<ColorTableDiff::Edit>& ColorTableDiff::GetEdits() const
+{
+   return m_edits;
+}
+
+size_t ColorTableDiff::GetByteSize() const
+{
+   auto cb = sizeof(*this) + GetVectorByteSize(m_edits);
+   for (const auto& edit : m_edits)
+   {
+      cb += GetStringByteSize(edit.strName);
+   }
+   return cb;
+}
+
+ptrdiff_t ColorTableDiff::GetSizeChange() const
+{
+   ptrdiff_t change = 0;
+   for (const auto& edit : m_edits)
+   {
+      change += (edit.operation == Operation::Insert) ?  1
+              : (edit.operation == Operation::Remove) ? -1
+                                                      :  0;
+   }
+   return change;
+}
+
+void ColorTableDiff::ApplyTo(ColorTable& table) const
+{
+   for (const auto& edit : m_edits)
+   {
+      switch (edit.operation)
+      {
+         case Operation::Insert:
+            _ASSERTE(edit.index <= table.size());
+            table.emplace(table.begin() + edit.index, edit.clr, edit.strName);
+            break;
+         case Operation::Remove:
+            _ASSERTE(edit.index < table.size());
+            table.erase(table.begin() + edit.index);
+            break;
+         case Operation::Recolor:
+            _ASSERTE(edit.index < table.size());
+            table[edit.index].first = edit.clr;
+            break;
+         case Operation::Rename:
+            _ASSERTE(edit.index < table.size());
+            table[edit.index].second = edit.strName;
+            break;
+      }
+   }
+}
+
+void ColorTableDiff::ApplyTo(std::vector<COLORREF>& colors) const
+{
+   for (const auto& edit : m_edits)
+   {
+      switch (edit.operation)
+      {
+         case Operation::Insert:
+            _ASSERTE(edit.index <= colors.size());
+            colors.insert(colors.begin() + edit.index, edit.clr);
+            break;
+         case Operation::Remove:
+            _ASSERTE(edit.index < colors.size());
+            colors.erase(colors.begin() + edit.index);
+            break;
+         case Operation::Recolor:
+            _ASSERTE(edit.index < colors.size());
+            colors[edit.index] = edit.clr;
+            break;
+         case Operation::Rename:
+            break;
+      }
+   }
+}
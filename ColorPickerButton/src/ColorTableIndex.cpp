@@ -0,0 +1,439 @@
+#include "PCH.hpp"
+#include "ColorTableIndex.hpp"
+#include "ColorTableDiff.hpp"
+#include "MemoryUsage.hpp"
+#include "StaticColorTable.hpp"
+#include <unordered_map>
+
+
+namespace {
+
+// The live indexes, keyed by a hash of their colors (or, for static color tables, by the
+// address of the table). Only weak references are held, so that each index is destroyed as
+// soon as the last button using it lets go of it.
+struct ColorTableIndexCache
+{
+   std::mutex                                                                            mutex;
+   std::unordered_multimap<size_t, std::weak_ptr<const ColorTableIndex>>                 indexes;
+   std::unordered_map<const StaticColorTableData*, std::weak_ptr<const ColorTableIndex>> staticIndexes;
+};
+
+ColorTableIndexCache& GetCache()
+{
+   static ColorTableIndexCache cache;
+   return cache;
+}
+
+size_t HashColors(const std::vector<COLORREF>& colors)
+{
+   // FNV-1a
+   UINT64 hash = 14695981039346656037ULL;
+   for (const auto clr : colors)
+   {
+      hash ^= clr;
+      hash *= 1099511628211ULL;
+   }
+   return static_cast<size_t>(hash);
+}
+
+// The most edits for which the hash of exact colors is carried over to an updated index.
+// (Each insertion or removal renumbers every slot, so a larger diff is better served by
+// building the hash again, if and when it is needed.)
+constexpr size_t kcEditsToCarryMax = 32;
+
+}  // anonymous namespace
+
+/* static */ std::shared_ptr<const ColorTableIndex> ColorTableIndex::Acquire(const std::vector<COLORREF>& colors)
+{
+   if (colors.empty())
+   {
+      return nullptr;
+   }
+
+   const auto                  hash  = HashColors(colors);
+   auto&                       cache = GetCache();
+   std::lock_guard<std::mutex> lock(cache.mutex);
+
+   const auto range = cache.indexes.equal_range(hash);
+   for (auto it = range.first; it != range.second; ++it)
+   {
+      auto pIndex = it->second.lock();
+      if (pIndex && (pIndex->m_colors == colors))
+      {
+         return pIndex;
+      }
+   }
+
+   // Not found, so create a new index. Take the opportunity to drop any dead entries.
+   for (auto it = cache.indexes.begin(); it != cache.indexes.end(); )
+   {
+      it = it->second.expired() ? cache.indexes.erase(it) : std::next(it);
+   }
+   auto pIndex = std::make_shared<const ColorTableIndex>(colors);
+   cache.indexes.emplace(hash, pIndex);
+   return pIndex;
+}
+
+/* static */ std::shared_ptr<const ColorTableIndex> ColorTableIndex::Acquire(const StaticColorTableData& staticColorTable)
+{
+   // A static table has static storage duration, so its address identifies its contents, and
+   // there is no need to hash (or compare) its colors to find an existing index for it.
+   _ASSERTE(staticColorTable.cColors > 0);
+   auto&                       cache = GetCache();
+   std::lock_guard<std::mutex> lock(cache.mutex);
+
+   auto& pCached = cache.staticIndexes[&staticColorTable];
+   auto  pIndex  = pCached.lock();
+   if (!pIndex)
+   {
+      const auto pColors = staticColorTable.pColors;
+      pIndex  = std::make_shared<const ColorTableIndex>(std::vector<COLORREF>(pColors, pColors + staticColorTable.cColors),
+                                                        &staticColorTable);
+      pCached = pIndex;
+   }
+   return pIndex;
+}
+
+/* static */ std::shared_ptr<const ColorTableIndex> ColorTableIndex::Update(const std::shared_ptr<const ColorTableIndex>& pIndex,
+                                                                           const std::shared_ptr<const ColorTableDiff>&  pDiff)
+{
+   _ASSERTE(pDiff);
+   if (!pIndex)
+   {
+      std::vector<COLORREF> colors;
+      pDiff->ApplyTo(colors);
+      return Acquire(colors);
+   }
+
+   // Renaming entries does not change the colors, so the index still applies.
+   const auto& edits = pDiff->GetEdits();
+   if (std::all_of(edits.begin(), edits.end(), [](const ColorTableDiff::Edit& edit)
+                   {
+                      return edit.operation == ColorTableDiff::Operation::Rename;
+                   }))
+   {
+      return pIndex;
+   }
+
+   // If another button has already applied this diff to this index, share its result.
+   std::lock_guard<std::mutex> lock(pIndex->m_successorMutex);
+   auto pSuccessor = pIndex->m_pSuccessor.lock();
+   if (pSuccessor && (pIndex->m_pSuccessorDiff.lock() == pDiff))
+   {
+      return pSuccessor;
+   }
+
+   // The updated index is not entered into the cache: that would mean hashing all of the
+   // colors, and the buttons that need to share it find it through the original instead.
+   auto                colors     = pIndex->m_colors;
+   std::vector<UINT64> exactSlots;
+   const auto          carryExact = pIndex->m_hasExact.load(std::memory_order_acquire) &&
+                                    (pDiff->GetEdits().size() <= kcEditsToCarryMax);
+   if (carryExact)
+   {
+      exactSlots = pIndex->m_exactSlots;
+      ApplyToSlots(exactSlots, colors, *pDiff);
+   }
+   else
+   {
+      pDiff->ApplyTo(colors);
+   }
+   if (colors.empty())
+   {
+      return nullptr;
+   }
+
+   auto pUpdated = std::make_shared<ColorTableIndex>(std::move(colors));
+   if (carryExact && (pUpdated->m_structure.GetKind() == StructuredLookup::Kind::Irregular))
+   {
+      std::call_once(pUpdated->m_exactOnce, [&]
+      {
+         pUpdated->m_exactSlots = std::move(exactSlots);
+         pUpdated->m_hasExact.store(true, std::memory_order_release);
+      });
+   }
+   pIndex->m_pSuccessorDiff = pDiff;
+   pIndex->m_pSuccessor     = pUpdated;
+   return pUpdated;
+}
+
+ColorTableIndex::ColorTableIndex(std::vector<COLORREF>       colors,
+                                 const StaticColorTableData* pStaticColorTable)
+   : m_colors           (std::move(colors))
+   , m_pStaticColorTable(pStaticColorTable)
+   , m_structure        (m_colors)
+   , m_exactOnce        ()
+   , m_exactSlots       ()
+   , m_hasExact         (false)
+   , m_inverseOnce      ()
+   , m_pInverseMap      ()
+   , m_hasInverse       (false)
+   , m_successorMutex   ()
+   , m_pSuccessorDiff   ()
+   , m_pSuccessor       ()
+{
+   _ASSERTE(!m_colors.empty());
+   _ASSERTE(!m_pStaticColorTable || (m_pStaticColorTable->cColors == m_colors.size()));
+}
+
+const std::vector<COLORREF>& ColorTableIndex::GetColors() const
+{
+   return m_colors;
+}
+
+const StructuredLookup& ColorTableIndex::GetStructure() const
+{
+   return m_structure;
+}
+
+const InverseColorMap& ColorTableIndex::GetInverseMap() const
+{
+   std::call_once(m_inverseOnce, [this]
+   {
+      m_pInverseMap = std::make_unique<const InverseColorMap>(m_colors);
+      m_hasInverse.store(true, std::memory_order_release);
+   });
+   return *m_pInverseMap;
+}
+
+size_t ColorTableIndex::FindExact(COLORREF clr) const
+{
+   if ((clr & 0xFF000000) != 0)
+   {
+      return kInvalidIndex;
+   }
+
+   if (m_structure.GetKind() != StructuredLookup::Kind::Irregular)
+   {
+      return m_structure.FindExact(clr);
+   }
+
+   if (m_pStaticColorTable)
+   {
+      return m_pStaticColorTable->FindColor(clr);
+   }
+
+   const auto& slots = this->GetExactSlots();
+   const auto  slot  = slots[FindSlot(slots, clr)];
+   return (slot != kEmptySlot) ? static_cast<size_t>(slot & 0xFFFF) : kInvalidIndex;
+}
+
+size_t ColorTableIndex::FindNearest(COLORREF clr) const
+{
+   _ASSERTE((clr & 0xFF000000) == 0);
+   return (m_structure.GetKind() != StructuredLookup::Kind::Irregular) ? m_structure.FindNearest(clr)
+                                                                     : this->GetInverseMap().FindNearest(clr);
+}
+
+size_t ColorTableIndex::LookupNearest(COLORREF clr) const
+{
+   _ASSERTE((clr & 0xFF000000) == 0);
+   return (m_structure.GetKind() != StructuredLookup::Kind::Irregular) ? m_structure.FindNearest(clr)
+                                                                     : this->GetInverseMap().LookupNearest(clr);
+}
+
+size_t ColorTableIndex::GetByteSize() const
+{
+   // (The lazily-built structures are only looked at once they are known to have been built.)
+   auto cb = sizeof(*this) + GetVectorByteSize(m_colors) + m_structure.GetExternalByteSize();
+   if (m_hasExact.load(std::memory_order_acquire))
+   {
+      cb += GetVectorByteSize(m_exactSlots);
+   }
+   if (m_hasInverse.load(std::memory_order_acquire))
+   {
+      cb += m_pInverseMap->GetByteSize();
+   }
+   return cb;
+}
+
+/* static */ std::vector<std::shared_ptr<const ColorTableIndex>> ColorTableIndex::GetCachedIndexes()
+{
+   auto&                       cache = GetCache();
+   std::lock_guard<std::mutex> lock(cache.mutex);
+
+   std::vector<std::shared_ptr<const ColorTableIndex>> indexes;
+   indexes.reserve(cache.indexes.size() + cache.staticIndexes.size());
+   for (const auto& entry : cache.indexes)
+   {
+      if (auto pIndex = entry.second.lock())
+      {
+         indexes.push_back(std::move(pIndex));
+      }
+   }
+   for (const auto& entry : cache.staticIndexes)
+   {
+      if (auto pIndex = entry.second.lock())
+      {
+         indexes.push_back(std::move(pIndex));
+      }
+   }
+   return indexes;
+}
+
+const std::vector<UINT64>& ColorTableIndex::GetExactSlots() const
+{
+   std::call_once(m_exactOnce, [this]
+   {
+      m_exactSlots = BuildExactSlots(m_colors);
+      m_hasExact.store(true, std::memory_order_release);
+   });
+   return m_exactSlots;
+}
+
+/* static */ std::vector<UINT64> ColorTableIndex::BuildExactSlots(const std::vector<COLORREF>& colors)
+{
+   // Keep the table at most half full (counting every entry, even duplicates), so that probe
+   // sequences stay short, and so that it never needs to grow while it is being built.
+   size_t cSlots = 16;
+   while (cSlots < (colors.size() * 2))
+   {
+      cSlots *= 2;
+   }
+   std::vector<UINT64> slots(cSlots, kEmptySlot);
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      auto& slot = slots[FindSlot(slots, colors[i])];
+      if (slot == kEmptySlot)  // keeps the first index of duplicates
+      {
+         slot = (static_cast<UINT64>(colors[i]) << 16) | i;
+      }
+   }
+   return slots;
+}
+
+/* static */ size_t ColorTableIndex::FindSlot(const std::vector<UINT64>& slots, COLORREF clr)
+{
+   // Returns the slot that holds the color, or else the empty slot where it would go.
+   const auto mask = slots.size() - 1;
+   auto       iSlot = static_cast<size_t>((static_cast<UINT64>(clr) * 0x9E3779B97F4A7C15ULL) >> 40) & mask;
+   while ((slots[iSlot] != kEmptySlot) && (static_cast<COLORREF>(slots[iSlot] >> 16) != clr))
+   {
+      iSlot = (iSlot + 1) & mask;
+   }
+   return iSlot;
+}
+
+/* static */ void ColorTableIndex::SetSlot(std::vector<UINT64>& slots, COLORREF clr, size_t index)
+{
+   slots[FindSlot(slots, clr)] = (static_cast<UINT64>(clr) << 16) | index;
+}
+
+/* static */ void ColorTableIndex::EraseSlot(std::vector<UINT64>& slots, COLORREF clr)
+{
+   // Remove the slot, and then shift back any later slots in the same run that would
+   // no longer be reachable from their home slots (so that no tombstones are needed).
+   const auto mask  = slots.size() - 1;
+   auto       iHole = FindSlot(slots, clr);
+   if (slots[iHole] == kEmptySlot)
+   {
+      return;
+   }
+   slots[iHole] = kEmptySlot;
+   for (auto iSlot = (iHole + 1) & mask; slots[iSlot] != kEmptySlot; iSlot = (iSlot + 1) & mask)
+   {
+      const auto clrSlot = static_cast<COLORREF>(slots[iSlot] >> 16);
+      const auto iHome   = static_cast<size_t>((static_cast<UINT64>(clrSlot) * 0x9E3779B97F4A7C15ULL) >> 40) & mask;
+      const auto cFromHomeToSlot = (iSlot - iHome) & mask;
+      const auto cFromHoleToSlot = (iSlot - iHole) & mask;
+      if (cFromHomeToSlot >= cFromHoleToSlot)
+      {
+         slots[iHole] = slots[iSlot];
+         slots[iSlot] = kEmptySlot;
+         iHole        = iSlot;
+      }
+   }
+}
+
+/* static */ void ColorTableIndex::ApplyToSlots(std::vector<UINT64>&   slots,
+                                                std::vector<COLORREF>& colors,
+                                                const ColorTableDiff&  diff)
+{
+   // Renumbers the entries at or after the specified index.
+   const auto renumber = [&slots](size_t iFirst, int delta)
+   {
+      for (auto& slot : slots)
+      {
+         if ((slot != kEmptySlot) && ((slot & 0xFFFF) >= iFirst))
+         {
+            slot = static_cast<UINT64>(static_cast<INT64>(slot) + delta);
+         }
+      }
+   };
+
+   // Points the slot for a color that is leaving the specified index at the next entry with
+   // that color, or erases it if there is none. (Its index is only in the slot if this was
+   // the first entry with the color.)
+   const auto release = [&slots, &colors](COLORREF clr, size_t index, size_t iSearchFrom, size_t bias)
+   {
+      const auto iSlot = FindSlot(slots, clr);
+      if ((slots[iSlot] != kEmptySlot) && ((slots[iSlot] & 0xFFFF) == index))
+      {
+         const auto it = std::find(colors.begin() + iSearchFrom, colors.end(), clr);
+         if (it != colors.end())
+         {
+            SetSlot(slots, clr, (it - colors.begin()) + bias);
+         }
+         else
+         {
+            EraseSlot(slots, clr);
+         }
+      }
+   };
+
+   // Points the slot for a color that is arriving at the specified index at that index,
+   // unless an earlier entry already has the color.
+   const auto claim = [&slots](COLORREF clr, size_t index)
+   {
+      const auto slot = slots[FindSlot(slots, clr)];
+      if ((slot == kEmptySlot) || ((slot & 0xFFFF) > index))
+      {
+         SetSlot(slots, clr, index);
+      }
+   };
+
+   for (const auto& edit : diff.GetEdits())
+   {
+      const auto index = edit.index;
+      switch (edit.operation)
+      {
+         case ColorTableDiff::Operation::Insert:
+         {
+            colors.insert(colors.begin() + index, edit.clr);
+            if ((colors.size() * 2) > slots.size())
+            {
+               slots = BuildExactSlots(colors);
+            }
+            else
+            {
+               renumber(index, +1);
+               claim(edit.clr, index);
+            }
+            break;
+         }
+         case ColorTableDiff::Operation::Remove:
+         {
+            const auto clr = colors[index];
+            colors.erase(colors.begin() + index);
+            release(clr, index, index, 1);  // (the entries after this one are renumbered below)
+            renumber(index + 1, -1);
+            break;
+         }
+         case ColorTableDiff::Operation::Recolor:
+         {
+            const auto clrOld = colors[index];
+            if (clrOld != edit.clr)
+            {
+               colors[index] = edit.clr;
+               release(clrOld, index, index + 1, 0);
+               claim(edit.clr, index);
+            }
+            break;
+         }
+         case ColorTableDiff::Operation::Rename:
+         {
+            break;
+         }
+      }
+   }
+}
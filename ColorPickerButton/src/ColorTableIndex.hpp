@@ -0,0 +1,110 @@
+#pragma once
+
+#include "InverseColorMap.hpp"
+#include "StructuredLookup.hpp"
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class ColorTableDiff;
+struct StaticColorTableData;
+
+
+// Answers exact and nearest-color queries against a color table.
+//
+// When the table has a regular structure (see StructuredLookup), both kinds of query are
+// computed in closed form. Otherwise, exact queries go through a hash of the table's colors,
+// and nearest queries go through an InverseColorMap. Those general-purpose structures are
+// only built the first time that they are needed.
+//
+// Instances are immutable (aside from the lazy building, which is thread-safe) and are shared
+// between all buttons whose color tables contain the same sequence of colors. Use Acquire()
+// to obtain one, or Update() to obtain one for a table that has been edited.
+//
+// An index for a static color table is keyed by the table itself (rather than by a hash of its
+// colors), and answers exact queries through the table's precomputed sorted indices, so that the
+// hash of exact colors is never built for it.
+class ColorTableIndex
+{
+   ColorTableIndex           (const ColorTableIndex&) = delete;  // not copyable
+   ColorTableIndex& operator=(const ColorTableIndex&) = delete;  // not assignable
+
+public:
+
+   static constexpr size_t kInvalidIndex = static_cast<size_t>(-1);
+
+   // Returns the (possibly shared) index for the specified colors.
+   // Returns null if there are no colors.
+   static std::shared_ptr<const ColorTableIndex> Acquire(const std::vector<COLORREF>& colors);
+
+   // Returns the (possibly shared) index for a static color table.
+   static std::shared_ptr<const ColorTableIndex> Acquire(const StaticColorTableData& staticColorTable);
+
+   // Returns the index for the colors that result from applying a diff to the colors of an
+   // existing index. The hash of exact colors is carried over and edited, rather than rebuilt,
+   // if it had been built and the diff is small. Every button that applies the same diff to
+   // the same index gets the same result, so buttons that shared an index keep sharing it.
+   // Returns null if there are no colors.
+   static std::shared_ptr<const ColorTableIndex> Update(const std::shared_ptr<const ColorTableIndex>& pIndex,
+                                                        const std::shared_ptr<const ColorTableDiff>&  pDiff);
+
+   // Returns the colors that this index was built from.
+   const std::vector<COLORREF>& GetColors() const;
+
+   // Returns the regular structure, if any, that was detected in the colors.
+   const StructuredLookup& GetStructure() const;
+
+   // Returns the index of the first entry with exactly the specified RGB color,
+   // or kInvalidIndex if there is none (or if the color is not an RGB color).
+   size_t FindExact(COLORREF clr) const;
+
+   // Returns the index of the entry that is truly nearest to the specified RGB color
+   // (with ties resolved in favor of the lower index).
+   size_t FindNearest(COLORREF clr) const;
+
+   // Returns the index of an entry near to the specified RGB color, as quickly as possible.
+   // This is exact for structured tables, and otherwise exact to within an RGB555 cell.
+   size_t LookupNearest(COLORREF clr) const;
+
+   // Returns the number of bytes of memory that the index holds, including itself (which grows
+   // as its lazily-built structures are built).
+   size_t GetByteSize() const;
+
+   // Returns every index in the cache that is still alive, for accounting for the memory that
+   // they hold. (Indexes made by Update() are not cached; they are only held by the buttons.)
+   static std::vector<std::shared_ptr<const ColorTableIndex>> GetCachedIndexes();
+
+   explicit ColorTableIndex(std::vector<COLORREF>       colors,
+                            const StaticColorTableData* pStaticColorTable = nullptr);  // use Acquire() instead
+
+private:
+
+   const InverseColorMap& GetInverseMap() const;
+
+   // The hash of exact colors is open-addressed, so that it can be copied as a block. Each slot
+   // holds a color in its upper bits and the first index of that color in its lower 16 bits.
+   static constexpr UINT64 kEmptySlot = ~UINT64(0);
+
+   static std::vector<UINT64> BuildExactSlots(const std::vector<COLORREF>& colors);
+   static size_t              FindSlot   (const std::vector<UINT64>& slots, COLORREF clr);
+   static void                SetSlot    (std::vector<UINT64>& slots, COLORREF clr, size_t index);
+   static void                EraseSlot  (std::vector<UINT64>& slots, COLORREF clr);
+   static void                ApplyToSlots(std::vector<UINT64>& slots, std::vector<COLORREF>& colors, const ColorTableDiff& diff);
+
+   const std::vector<UINT64>& GetExactSlots() const;
+
+private:
+   std::vector<COLORREF>                              m_colors;
+   const StaticColorTableData*                        m_pStaticColorTable;  // (if built for a static table)
+   StructuredLookup                                   m_structure;
+   mutable std::once_flag                             m_exactOnce;
+   mutable std::vector<UINT64>                        m_exactSlots;   // first index of each distinct color
+   mutable std::atomic<bool>                          m_hasExact;     // true once m_exactSlots is built
+   mutable std::once_flag                             m_inverseOnce;
+   mutable std::unique_ptr<const InverseColorMap>     m_pInverseMap;
+   mutable std::atomic<bool>                          m_hasInverse;   // true once m_pInverseMap is built
+   mutable std::mutex                                 m_successorMutex;
+   mutable std::weak_ptr<const ColorTableDiff>        m_pSuccessorDiff;  // the last diff applied to this index,
+   mutable std::weak_ptr<const ColorTableIndex>       m_pSuccessor;      //   and the index that it produced
+};
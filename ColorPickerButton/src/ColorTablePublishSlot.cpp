@@ -0,0 +1,38 @@
+#include "PCH.hpp"
+#include "ColorTablePublishSlot.hpp"
+
+
+ColorTablePublishSlot::ColorTablePublishSlot()
+   : m_pPublished()
+{ }
+
+void ColorTablePublishSlot::Publish(std::shared_ptr<PublishedColorTable> pPublished)
+{
+   _ASSERTE(pPublished);
+   std::atomic_store(&m_pPublished, std::move(pPublished));
+}
+
+std::shared_ptr<PublishedColorTable> ColorTablePublishSlot::Take()
+{
+   // (Checking first keeps an empty slot from being written to, which is the usual case.)
+   if (!std::atomic_load(&m_pPublished))
+   {
+      return nullptr;
+   }
+   return std::atomic_exchange(&m_pPublished, std::shared_ptr<PublishedColorTable>());
+}
+
+void ColorTablePublishSlot::Clear()
+{
+   std::atomic_store(&m_pPublished, std::shared_ptr<PublishedColorTable>());
+}
+
+bool ColorTablePublishSlot::IsEmpty() const
+{
+   return !std::atomic_load(&m_pPublished);
+}
+
+std::shared_ptr<const PublishedColorTable> ColorTablePublishSlot::Peek() const
+{
+   return std::atomic_load(&m_pPublished);
+}
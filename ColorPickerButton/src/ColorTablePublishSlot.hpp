@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+#include <memory>
+
+class ColorTableIndex;
+
+
+// A color table that was published by ColorPickerButton::PublishColorTable(), along with
+// everything that the button needs to display it, all prepared by the publishing thread.
+struct PublishedColorTable
+{
+   std::shared_ptr<const ColorPickerButton::ColorTable> pColorTable;
+   size_t                                               cColumns;
+   std::shared_ptr<const ColorTableIndex>               pColorTableIndex;
+   CPalette                                             palette;
+};
+
+
+// Hands published color tables from any number of publishing threads to the thread that owns a
+// button. The slot holds at most one table: publishing replaces whatever was published before
+// (which, if it was never taken, is freed by whichever thread lets go of it last), and taking
+// empties the slot, which leaves the taking thread as the table's only owner.
+//
+// All of the members may be called concurrently, from any thread.
+class ColorTablePublishSlot
+{
+   ColorTablePublishSlot           (const ColorTablePublishSlot&) = delete;  // not copyable
+   ColorTablePublishSlot& operator=(const ColorTablePublishSlot&) = delete;  // not assignable
+
+public:
+
+   ColorTablePublishSlot();
+
+   // Puts the specified table into the slot, replacing whatever was there.
+   void Publish(std::shared_ptr<PublishedColorTable> pPublished);
+
+   // Takes the table out of the slot. Returns null if the slot is empty.
+   std::shared_ptr<PublishedColorTable> Take();
+
+   // Discards whatever is in the slot.
+   void Clear();
+
+   // Returns whether the slot is empty (which is cheap, for checking before taking).
+   bool IsEmpty() const;
+
+   // Returns the table in the slot, without taking it (for counting its memory).
+   // Returns null if the slot is empty.
+   std::shared_ptr<const PublishedColorTable> Peek() const;
+
+private:
+   std::shared_ptr<PublishedColorTable> m_pPublished;  // (accessed only atomically)
+};
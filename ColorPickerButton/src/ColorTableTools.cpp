@@ -0,0 +1,181 @@
+#include "PCH.hpp"
+#include "ColorTableTools.hpp"
+#include "ColorSpace.hpp"
+#include <cmath>                  // for floor
+#include <unordered_map>
+#include <ppl.h>                  // for parallel_for
+
+
+namespace {
+
+// The grid must be fine enough to separate exact duplicates from their nearest neighbors
+// when the threshold is zero, yet coarse enough that cell coordinates fit in 21 bits.
+constexpr float kCellSizeMin = 1.0f / 4096;
+
+// Clusters colors in order, as described in the class comment. Returns, for each color,
+// the index of the first color in its cluster (which is its own index for cluster leaders).
+std::vector<size_t> ClusterColors(const std::vector<COLORREF>& colors, float deltaE)
+{
+   const auto                   cColors = colors.size();
+   std::vector<ColorSpace::Lab> labs(cColors);
+   concurrency::parallel_for(size_t(0), cColors, [&](size_t i)
+   {
+      labs[i] = ColorSpace::ToOKLab(colors[i]);
+   });
+
+   const auto cellSize  = std::max(deltaE, kCellSizeMin);
+   const auto threshold = deltaE * deltaE;
+   const auto cellOf    = [cellSize](float value)
+   {
+      return static_cast<INT64>(std::floor(value / cellSize));
+   };
+   const auto keyOf     = [](INT64 l, INT64 a, INT64 b)
+   {
+      constexpr INT64 kBias = INT64(1) << 20;
+      constexpr INT64 kMask = (INT64(1) << 21) - 1;
+      return (static_cast<UINT64>((l + kBias) & kMask) << 42)
+           | (static_cast<UINT64>((a + kBias) & kMask) << 21)
+           |  static_cast<UINT64>((b + kBias) & kMask);
+   };
+
+   // Only the first entry of each cluster (its leader) is placed into the grid, so that every
+   // member of a cluster is within the threshold of its leader, and clusters cannot chain.
+   // Each cell is a singly-linked list threaded through an array, to avoid an allocation per cell.
+   constexpr UINT32                   kEnd = static_cast<UINT32>(-1);
+   std::unordered_map<UINT64, UINT32> grid;   // first leader in each cell
+   std::vector<UINT32>                next(cColors, kEnd);
+   std::vector<size_t>                leaders(cColors);
+   grid.reserve(cColors);
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      const auto& lab    = labs[i];
+      const auto  l      = cellOf(lab.L);
+      const auto  a      = cellOf(lab.a);
+      const auto  b      = cellOf(lab.b);
+      auto        leader = i;
+      for (INT64 dl = -1; dl <= 1; ++dl)
+      {
+         for (INT64 da = -1; da <= 1; ++da)
+         {
+            for (INT64 db = -1; db <= 1; ++db)
+            {
+               const auto it = grid.find(keyOf(l + dl, a + da, b + db));
+               if (it == grid.end())
+               {
+                  continue;
+               }
+               for (auto j = it->second; j != kEnd; j = next[j])
+               {
+                  if ((j < leader) && (ColorSpace::DistanceSquared(lab, labs[j]) <= threshold))
+                  {
+                     leader = j;
+                  }
+               }
+            }
+         }
+      }
+
+      leaders[i] = leader;
+      if (leader == i)
+      {
+         const auto result = grid.emplace(keyOf(l, a, b), static_cast<UINT32>(i));
+         if (!result.second)
+         {
+            next[i]              = result.first->second;
+            result.first->second = static_cast<UINT32>(i);
+         }
+      }
+   }
+   return leaders;
+}
+
+std::vector<COLORREF> ColorsFromTable(const ColorTableTools::ColorTable& colorTable)
+{
+   std::vector<COLORREF> colors(colorTable.size());
+   for (size_t i = 0; i < colorTable.size(); ++i)
+   {
+      colors[i] = colorTable[i].first;
+   }
+   return colors;
+}
+
+// Builds a table containing only the cluster leaders, each of which
+// takes the first non-empty name from among the members of its cluster.
+ColorTableTools::ColorTable ApplyClusters(const ColorTableTools::ColorTable& colorTable,
+                                          const std::vector<size_t>&         leaders)
+{
+   std::vector<size_t>         outputIndex(colorTable.size());  // index of each leader in the result
+   ColorTableTools::ColorTable result;
+   for (size_t i = 0; i < colorTable.size(); ++i)
+   {
+      const auto leader = leaders[i];
+      if (leader == i)
+      {
+         outputIndex[i] = result.size();
+         result.push_back(colorTable[i]);
+      }
+      else
+      {
+         auto& name = result[outputIndex[leader]].second;
+         if (name.IsEmpty())
+         {
+            name = colorTable[i].second;
+         }
+      }
+   }
+   return result;
+}
+
+}  // anonymous namespace
+
+/* static */ std::vector<ColorTableTools::MergeGroup> ColorTableTools::FindNearDuplicates(const ColorTable& colorTable,
+                                                                                          float             deltaE /* = kDeltaEThresholdDefault */)
+{
+   _ASSERTE(deltaE >= 0.0f);
+
+   const auto              leaders = ClusterColors(ColorsFromTable(colorTable), deltaE);
+   std::vector<MergeGroup> groups;
+   std::vector<size_t>     groupIndex(colorTable.size(), static_cast<size_t>(-1));
+   for (size_t i = 0; i < leaders.size(); ++i)
+   {
+      const auto leader = leaders[i];
+      if (leader != i)
+      {
+         if (groupIndex[leader] == static_cast<size_t>(-1))
+         {
+            groupIndex[leader] = groups.size();
+            groups.push_back(MergeGroup{ leader, {} });
+         }
+         groups[groupIndex[leader]].iMerged.push_back(i);
+      }
+   }
+   return groups;
+}
+
+/* static */ ColorTableTools::ColorTable ColorTableTools::RemoveNearDuplicates(const ColorTable& colorTable,
+                                                                               float             deltaE /* = kDeltaEThresholdDefault */)
+{
+   _ASSERTE(deltaE >= 0.0f);
+   return ApplyClusters(colorTable, ClusterColors(ColorsFromTable(colorTable), deltaE));
+}
+
+/* static */ ColorTableTools::ColorTable ColorTableTools::Merge(const std::vector<const ColorTable*>& colorTables,
+                                                                float                                 deltaE /* = kDeltaEThresholdDefault */)
+{
+   _ASSERTE(deltaE >= 0.0f);
+
+   size_t cColors = 0;
+   for (const auto pColorTable : colorTables)
+   {
+      _ASSERTE(pColorTable);
+      cColors += pColorTable->size();
+   }
+
+   ColorTable combined;
+   combined.reserve(cColors);
+   for (const auto pColorTable : colorTables)
+   {
+      combined.insert(combined.end(), pColorTable->begin(), pColorTable->end());
+   }
+   return RemoveNearDuplicates(combined, deltaE);
+}
@@ -0,0 +1,978 @@
+#include "PCH.hpp"
+#include "ColorText.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>                  // for pow, fmod, lround
+#include <numeric>                // for iota
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>            // for SSE2 intrinsics
+#define COLORTEXT_USE_SSE2 1
+#endif  // defined(_M_IX86) || defined(_M_X64)
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Named Colors
+//////////////////////////////////////////////////
+
+struct NamedColor
+{
+   const char* pszName;  // in lowercase
+   COLORREF    clr;
+};
+
+// The named colors of CSS Color Module Level 4, in alphabetical order.
+// (Where two names share a color, the first is used for formatting.)
+constexpr NamedColor kNamedColors[] =
+{
+   { "aliceblue",            RGB(0xF0, 0xF8, 0xFF) },
+   { "antiquewhite",         RGB(0xFA, 0xEB, 0xD7) },
+   { "aqua",                 RGB(0x00, 0xFF, 0xFF) },
+   { "aquamarine",           RGB(0x7F, 0xFF, 0xD4) },
+   { "azure",                RGB(0xF0, 0xFF, 0xFF) },
+   { "beige",                RGB(0xF5, 0xF5, 0xDC) },
+   { "bisque",               RGB(0xFF, 0xE4, 0xC4) },
+   { "black",                RGB(0x00, 0x00, 0x00) },
+   { "blanchedalmond",       RGB(0xFF, 0xEB, 0xCD) },
+   { "blue",                 RGB(0x00, 0x00, 0xFF) },
+   { "blueviolet",           RGB(0x8A, 0x2B, 0xE2) },
+   { "brown",                RGB(0xA5, 0x2A, 0x2A) },
+   { "burlywood",            RGB(0xDE, 0xB8, 0x87) },
+   { "cadetblue",            RGB(0x5F, 0x9E, 0xA0) },
+   { "chartreuse",           RGB(0x7F, 0xFF, 0x00) },
+   { "chocolate",            RGB(0xD2, 0x69, 0x1E) },
+   { "coral",                RGB(0xFF, 0x7F, 0x50) },
+   { "cornflowerblue",       RGB(0x64, 0x95, 0xED) },
+   { "cornsilk",             RGB(0xFF, 0xF8, 0xDC) },
+   { "crimson",              RGB(0xDC, 0x14, 0x3C) },
+   { "cyan",                 RGB(0x00, 0xFF, 0xFF) },
+   { "darkblue",             RGB(0x00, 0x00, 0x8B) },
+   { "darkcyan",             RGB(0x00, 0x8B, 0x8B) },
+   { "darkgoldenrod",        RGB(0xB8, 0x86, 0x0B) },
+   { "darkgray",             RGB(0xA9, 0xA9, 0xA9) },
+   { "darkgreen",            RGB(0x00, 0x64, 0x00) },
+   { "darkgrey",             RGB(0xA9, 0xA9, 0xA9) },
+   { "darkkhaki",            RGB(0xBD, 0xB7, 0x6B) },
+   { "darkmagenta",          RGB(0x8B, 0x00, 0x8B) },
+   { "darkolivegreen",       RGB(0x55, 0x6B, 0x2F) },
+   { "darkorange",           RGB(0xFF, 0x8C, 0x00) },
+   { "darkorchid",           RGB(0x99, 0x32, 0xCC) },
+   { "darkred",              RGB(0x8B, 0x00, 0x00) },
+   { "darksalmon",           RGB(0xE9, 0x96, 0x7A) },
+   { "darkseagreen",         RGB(0x8F, 0xBC, 0x8F) },
+   { "darkslateblue",        RGB(0x48, 0x3D, 0x8B) },
+   { "darkslategray",        RGB(0x2F, 0x4F, 0x4F) },
+   { "darkslategrey",        RGB(0x2F, 0x4F, 0x4F) },
+   { "darkturquoise",        RGB(0x00, 0xCE, 0xD1) },
+   { "darkviolet",           RGB(0x94, 0x00, 0xD3) },
+   { "deeppink",             RGB(0xFF, 0x14, 0x93) },
+   { "deepskyblue",          RGB(0x00, 0xBF, 0xFF) },
+   { "dimgray",              RGB(0x69, 0x69, 0x69) },
+   { "dimgrey",              RGB(0x69, 0x69, 0x69) },
+   { "dodgerblue",           RGB(0x1E, 0x90, 0xFF) },
+   { "firebrick",            RGB(0xB2, 0x22, 0x22) },
+   { "floralwhite",          RGB(0xFF, 0xFA, 0xF0) },
+   { "forestgreen",          RGB(0x22, 0x8B, 0x22) },
+   { "fuchsia",              RGB(0xFF, 0x00, 0xFF) },
+   { "gainsboro",            RGB(0xDC, 0xDC, 0xDC) },
+   { "ghostwhite",           RGB(0xF8, 0xF8, 0xFF) },
+   { "gold",                 RGB(0xFF, 0xD7, 0x00) },
+   { "goldenrod",            RGB(0xDA, 0xA5, 0x20) },
+   { "gray",                 RGB(0x80, 0x80, 0x80) },
+   { "green",                RGB(0x00, 0x80, 0x00) },
+   { "greenyellow",          RGB(0xAD, 0xFF, 0x2F) },
+   { "grey",                 RGB(0x80, 0x80, 0x80) },
+   { "honeydew",             RGB(0xF0, 0xFF, 0xF0) },
+   { "hotpink",              RGB(0xFF, 0x69, 0xB4) },
+   { "indianred",            RGB(0xCD, 0x5C, 0x5C) },
+   { "indigo",               RGB(0x4B, 0x00, 0x82) },
+   { "ivory",                RGB(0xFF, 0xFF, 0xF0) },
+   { "khaki",                RGB(0xF0, 0xE6, 0x8C) },
+   { "lavender",             RGB(0xE6, 0xE6, 0xFA) },
+   { "lavenderblush",        RGB(0xFF, 0xF0, 0xF5) },
+   { "lawngreen",            RGB(0x7C, 0xFC, 0x00) },
+   { "lemonchiffon",         RGB(0xFF, 0xFA, 0xCD) },
+   { "lightblue",            RGB(0xAD, 0xD8, 0xE6) },
+   { "lightcoral",           RGB(0xF0, 0x80, 0x80) },
+   { "lightcyan",            RGB(0xE0, 0xFF, 0xFF) },
+   { "lightgoldenrodyellow", RGB(0xFA, 0xFA, 0xD2) },
+   { "lightgray",            RGB(0xD3, 0xD3, 0xD3) },
+   { "lightgreen",           RGB(0x90, 0xEE, 0x90) },
+   { "lightgrey",            RGB(0xD3, 0xD3, 0xD3) },
+   { "lightpink",            RGB(0xFF, 0xB6, 0xC1) },
+   { "lightsalmon",          RGB(0xFF, 0xA0, 0x7A) },
+   { "lightseagreen",        RGB(0x20, 0xB2, 0xAA) },
+   { "lightskyblue",         RGB(0x87, 0xCE, 0xFA) },
+   { "lightslategray",       RGB(0x77, 0x88, 0x99) },
+   { "lightslategrey",       RGB(0x77, 0x88, 0x99) },
+   { "lightsteelblue",       RGB(0xB0, 0xC4, 0xDE) },
+   { "lightyellow",          RGB(0xFF, 0xFF, 0xE0) },
+   { "lime",                 RGB(0x00, 0xFF, 0x00) },
+   { "limegreen",            RGB(0x32, 0xCD, 0x32) },
+   { "linen",                RGB(0xFA, 0xF0, 0xE6) },
+   { "magenta",              RGB(0xFF, 0x00, 0xFF) },
+   { "maroon",               RGB(0x80, 0x00, 0x00) },
+   { "mediumaquamarine",     RGB(0x66, 0xCD, 0xAA) },
+   { "mediumblue",           RGB(0x00, 0x00, 0xCD) },
+   { "mediumorchid",         RGB(0xBA, 0x55, 0xD3) },
+   { "mediumpurple",         RGB(0x93, 0x70, 0xDB) },
+   { "mediumseagreen",       RGB(0x3C, 0xB3, 0x71) },
+   { "mediumslateblue",      RGB(0x7B, 0x68, 0xEE) },
+   { "mediumspringgreen",    RGB(0x00, 0xFA, 0x9A) },
+   { "mediumturquoise",      RGB(0x48, 0xD1, 0xCC) },
+   { "mediumvioletred",      RGB(0xC7, 0x15, 0x85) },
+   { "midnightblue",         RGB(0x19, 0x19, 0x70) },
+   { "mintcream",            RGB(0xF5, 0xFF, 0xFA) },
+   { "mistyrose",            RGB(0xFF, 0xE4, 0xE1) },
+   { "moccasin",             RGB(0xFF, 0xE4, 0xB5) },
+   { "navajowhite",          RGB(0xFF, 0xDE, 0xAD) },
+   { "navy",                 RGB(0x00, 0x00, 0x80) },
+   { "oldlace",              RGB(0xFD, 0xF5, 0xE6) },
+   { "olive",                RGB(0x80, 0x80, 0x00) },
+   { "olivedrab",            RGB(0x6B, 0x8E, 0x23) },
+   { "orange",               RGB(0xFF, 0xA5, 0x00) },
+   { "orangered",            RGB(0xFF, 0x45, 0x00) },
+   { "orchid",               RGB(0xDA, 0x70, 0xD6) },
+   { "palegoldenrod",        RGB(0xEE, 0xE8, 0xAA) },
+   { "palegreen",            RGB(0x98, 0xFB, 0x98) },
+   { "paleturquoise",        RGB(0xAF, 0xEE, 0xEE) },
+   { "palevioletred",        RGB(0xDB, 0x70, 0x93) },
+   { "papayawhip",           RGB(0xFF, 0xEF, 0xD5) },
+   { "peachpuff",            RGB(0xFF, 0xDA, 0xB9) },
+   { "peru",                 RGB(0xCD, 0x85, 0x3F) },
+   { "pink",                 RGB(0xFF, 0xC0, 0xCB) },
+   { "plum",                 RGB(0xDD, 0xA0, 0xDD) },
+   { "powderblue",           RGB(0xB0, 0xE0, 0xE6) },
+   { "purple",               RGB(0x80, 0x00, 0x80) },
+   { "rebeccapurple",        RGB(0x66, 0x33, 0x99) },
+   { "red",                  RGB(0xFF, 0x00, 0x00) },
+   { "rosybrown",            RGB(0xBC, 0x8F, 0x8F) },
+   { "royalblue",            RGB(0x41, 0x69, 0xE1) },
+   { "saddlebrown",          RGB(0x8B, 0x45, 0x13) },
+   { "salmon",               RGB(0xFA, 0x80, 0x72) },
+   { "sandybrown",           RGB(0xF4, 0xA4, 0x60) },
+   { "seagreen",             RGB(0x2E, 0x8B, 0x57) },
+   { "seashell",             RGB(0xFF, 0xF5, 0xEE) },
+   { "sienna",               RGB(0xA0, 0x52, 0x2D) },
+   { "silver",               RGB(0xC0, 0xC0, 0xC0) },
+   { "skyblue",              RGB(0x87, 0xCE, 0xEB) },
+   { "slateblue",            RGB(0x6A, 0x5A, 0xCD) },
+   { "slategray",            RGB(0x70, 0x80, 0x90) },
+   { "slategrey",            RGB(0x70, 0x80, 0x90) },
+   { "snow",                 RGB(0xFF, 0xFA, 0xFA) },
+   { "springgreen",          RGB(0x00, 0xFF, 0x7F) },
+   { "steelblue",            RGB(0x46, 0x82, 0xB4) },
+   { "tan",                  RGB(0xD2, 0xB4, 0x8C) },
+   { "teal",                 RGB(0x00, 0x80, 0x80) },
+   { "thistle",              RGB(0xD8, 0xBF, 0xD8) },
+   { "tomato",               RGB(0xFF, 0x63, 0x47) },
+   { "turquoise",            RGB(0x40, 0xE0, 0xD0) },
+   { "violet",               RGB(0xEE, 0x82, 0xEE) },
+   { "wheat",                RGB(0xF5, 0xDE, 0xB3) },
+   { "white",                RGB(0xFF, 0xFF, 0xFF) },
+   { "whitesmoke",           RGB(0xF5, 0xF5, 0xF5) },
+   { "yellow",               RGB(0xFF, 0xFF, 0x00) },
+   { "yellowgreen",          RGB(0x9A, 0xCD, 0x32) },
+};
+constexpr size_t kcNamedColors = ARRAYSIZE(kNamedColors);
+constexpr size_t kcchNameMax   = 20;  // "lightgoldenrodyellow"
+
+// Names are hashed (with FNV-1a, after being folded to lowercase) into a table of 1024 slots, each
+// of which holds the index of the only name that can be stored there. The seed was found by trying
+// seeds in turn until one gave no collisions, which is checked at compile time, below; if a name is
+// ever added, then a new seed may be needed.
+constexpr UINT32 kNameHashSeed = 0xD7E1;
+constexpr UINT32 kNameSlotBits = 10;
+constexpr UINT8  kNoName       = 0xFF;
+
+using NameSlots = std::array<UINT8, size_t(1) << kNameSlotBits>;
+
+constexpr size_t NameSlotFromHash(const char* pch, size_t cch)
+{
+   UINT32 hash = kNameHashSeed;
+   for (size_t i = 0; i < cch; ++i)
+   {
+      hash = (hash ^ static_cast<UINT8>(pch[i])) * 16777619u;
+   }
+   hash ^= (hash >> 15);
+   return hash & ((1u << kNameSlotBits) - 1);
+}
+
+constexpr size_t NameLength(const char* pszName)
+{
+   size_t cch = 0;
+   while (pszName[cch] != '\0')
+   {
+      ++cch;
+   }
+   return cch;
+}
+
+constexpr NameSlots MakeNameSlots()
+{
+   NameSlots slots = {};
+   for (size_t i = 0; i < slots.size(); ++i)
+   {
+      slots[i] = kNoName;
+   }
+   for (size_t i = 0; i < kcNamedColors; ++i)
+   {
+      slots[NameSlotFromHash(kNamedColors[i].pszName, NameLength(kNamedColors[i].pszName))] = static_cast<UINT8>(i);
+   }
+   return slots;
+}
+
+// The hash is perfect if no name was overwritten by a later one.
+constexpr bool IsPerfectHash(const NameSlots& slots)
+{
+   for (size_t i = 0; i < kcNamedColors; ++i)
+   {
+      const auto cch = NameLength(kNamedColors[i].pszName);
+      if ((cch > kcchNameMax) || (slots[NameSlotFromHash(kNamedColors[i].pszName, cch)] != i))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+constexpr NameSlots kNameSlots = MakeNameSlots();
+static_assert(kcNamedColors < kNoName,    "There are too many named colors to index with a byte.");
+static_assert(IsPerfectHash(kNameSlots),  "The named colors collide in the hash table; a new kNameHashSeed is needed.");
+
+// Looks up a name, which must already be in lowercase.
+bool FindNamedColor(const char* pch, size_t cch, COLORREF* pclr)
+{
+   const auto index = kNameSlots[NameSlotFromHash(pch, cch)];
+   if (index == kNoName)
+   {
+      return false;
+   }
+   const auto& entry = kNamedColors[index];
+   if ((NameLength(entry.pszName) != cch) || (std::memcmp(entry.pszName, pch, cch) != 0))
+   {
+      return false;
+   }
+   *pclr = entry.clr;
+   return true;
+}
+
+// Finds the name of a color, or returns null if it has none.
+const char* FindColorName(COLORREF clr)
+{
+   // The names, sorted by their colors (stably, so that the first of several synonyms is found first).
+   static const auto byColor = []
+   {
+      std::array<UINT8, kcNamedColors> indices;
+      std::iota(indices.begin(), indices.end(), UINT8(0));
+      std::stable_sort(indices.begin(), indices.end(), [](UINT8 i, UINT8 j)
+      {
+         return kNamedColors[i].clr < kNamedColors[j].clr;
+      });
+      return indices;
+   }();
+
+   const auto it = std::lower_bound(byColor.begin(), byColor.end(), clr, [](UINT8 i, COLORREF value)
+   {
+      return kNamedColors[i].clr < value;
+   });
+   return ((it != byColor.end()) && (kNamedColors[*it].clr == clr)) ? kNamedColors[*it].pszName : nullptr;
+}
+
+
+//////////////////////////////////////////////////
+// Characters
+//////////////////////////////////////////////////
+
+template <typename CharT>
+bool IsWhitespace(CharT ch)
+{
+   return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n') || (ch == '\f') || (ch == '\v');
+}
+
+template <typename CharT>
+bool IsSeparator(CharT ch)
+{
+   return (ch == ',') || (ch == ';') || IsWhitespace(ch);
+}
+
+template <typename CharT>
+bool IsAsciiLetter(CharT ch)
+{
+   return ((ch >= 'a') && (ch <= 'z')) || ((ch >= 'A') && (ch <= 'Z'));
+}
+
+template <typename CharT>
+char ToLowerAscii(CharT ch)
+{
+   return static_cast<char>(((ch >= 'A') && (ch <= 'Z')) ? (ch + ('a' - 'A')) : ch);
+}
+
+// Returns the value of a hexadecimal digit, or 16 if the character is not one.
+template <typename CharT>
+unsigned HexDigitValue(CharT ch)
+{
+   if ((ch >= '0') && (ch <= '9'))
+   {
+      return static_cast<unsigned>(ch - '0');
+   }
+   if ((ch >= 'a') && (ch <= 'f'))
+   {
+      return static_cast<unsigned>(ch - 'a') + 10;
+   }
+   if ((ch >= 'A') && (ch <= 'F'))
+   {
+      return static_cast<unsigned>(ch - 'A') + 10;
+   }
+   return 16;
+}
+
+template <typename CharT>
+void SkipWhitespace(const CharT*& p, const CharT* pEnd)
+{
+   while ((p < pEnd) && IsWhitespace(*p))
+   {
+      ++p;
+   }
+}
+
+
+//////////////////////////////////////////////////
+// Hexadecimal Notation
+//////////////////////////////////////////////////
+
+#ifdef COLORTEXT_USE_SSE2
+
+// Loads 8 characters into the low 8 bytes of a vector. Wide characters are narrowed
+// with unsigned saturation, which turns any non-ASCII character into 0 or 0xFF,
+// neither of which is a hexadecimal digit.
+inline __m128i LoadEightChars(const char* pch)
+{
+   return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pch));
+}
+
+inline __m128i LoadEightChars(const wchar_t* pch)
+{
+   return _mm_packus_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pch)), _mm_setzero_si128());
+}
+
+// Classifies 8 characters (in the low 8 bytes of a vector) as hexadecimal digits or not, and
+// computes their values. Returns a mask with bit i set if character i is a hexadecimal digit.
+// The ranges are tested with unsigned minimums: after subtracting '0', a character is a decimal
+// digit only if it is at most 9; after also folding it to lowercase and subtracting 'a',
+// it is a letter digit only if it is at most 5. Anything else wraps around to a large value.
+inline int ClassifyHexDigits(__m128i chars, __m128i* pValues)
+{
+   const auto digits   = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+   const auto letters  = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+   const auto isDigit  = _mm_cmpeq_epi8(_mm_min_epu8(digits,  _mm_set1_epi8(9)), digits);
+   const auto isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letters, _mm_set1_epi8(5)), letters);
+   *pValues = _mm_or_si128(_mm_and_si128(isDigit,  digits),
+                           _mm_and_si128(isLetter, _mm_add_epi8(letters, _mm_set1_epi8(10))));
+   return _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) & 0xFF;
+}
+
+// Combines the values of 6 hexadecimal digits (in the low 6 bytes of a vector) into a COLORREF.
+// Each pair of digits forms one 16-bit lane (with the high-order digit in its low byte), which is
+// reduced to a byte, and then the lanes are packed together, giving the red, green, and blue bytes
+// in the same order as they are in a COLORREF.
+inline COLORREF PackHexDigits(__m128i values)
+{
+   const auto bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 4),
+                                   _mm_srli_epi16(values, 8));
+   return static_cast<COLORREF>(_mm_cvtsi128_si32(_mm_packus_epi16(bytes, bytes))) & 0x00FFFFFF;
+}
+
+#endif  // COLORTEXT_USE_SSE2
+
+// Parses a color in hexadecimal notation, starting at the '#'.
+template <typename CharT>
+ColorText::Status ParseHex(const CharT*& p, const CharT* pEnd, COLORREF* pclr)
+{
+   _ASSERTE((p < pEnd) && (*p == '#'));
+
+   const auto pDigits = p + 1;
+#ifdef COLORTEXT_USE_SSE2
+   // The common case, #rrggbb, is handled with a single load whenever there are at least 8
+   // characters left to read. It is taken if there are exactly 6 digits before the next non-digit.
+   if ((sizeof(CharT) <= sizeof(UINT16)) && (pEnd - pDigits >= 8))
+   {
+      __m128i    values;
+      const auto mask = ClassifyHexDigits(LoadEightChars(pDigits), &values);
+      if ((mask & 0x7F) == 0x3F)
+      {
+         *pclr = PackHexDigits(values);
+         p     = pDigits + 6;
+         return ColorText::Status::Ok;
+      }
+   }
+#endif  // COLORTEXT_USE_SSE2
+
+   unsigned digits[8];
+   size_t   cDigits = 0;
+   while (pDigits + cDigits < pEnd)
+   {
+      const auto value = HexDigitValue(pDigits[cDigits]);
+      if (value > 15)
+      {
+         break;
+      }
+      if (cDigits == ARRAYSIZE(digits))
+      {
+         return ColorText::Status::BadHex;
+      }
+      digits[cDigits++] = value;
+   }
+
+   switch (cDigits)
+   {
+      case 3:
+      case 4:
+         *pclr = RGB(digits[0] * 0x11, digits[1] * 0x11, digits[2] * 0x11);
+         break;
+      case 6:
+      case 8:
+         *pclr = RGB((digits[0] << 4) | digits[1], (digits[2] << 4) | digits[3], (digits[4] << 4) | digits[5]);
+         break;
+      default:
+         return ColorText::Status::BadHex;
+   }
+   p = pDigits + cDigits;
+   return ColorText::Status::Ok;
+}
+
+
+//////////////////////////////////////////////////
+// Functional Notation
+//////////////////////////////////////////////////
+
+enum class Unit
+{
+   None,
+   Percent,
+   Degrees,
+   Radians,
+   Gradians,
+   Turns,
+};
+
+// Parses a CSS number (with an optional sign, fraction, and exponent), followed by an optional unit.
+template <typename CharT>
+bool ParseNumber(const CharT*& p, const CharT* pEnd, double* pValue, Unit* pUnit)
+{
+   auto q        = p;
+   auto negative = false;
+   if ((q < pEnd) && ((*q == '+') || (*q == '-')))
+   {
+      negative = (*q == '-');
+      ++q;
+   }
+
+   double value   = 0.0;
+   size_t cDigits = 0;
+   for (; (q < pEnd) && (*q >= '0') && (*q <= '9'); ++q, ++cDigits)
+   {
+      value = (value * 10.0) + (*q - '0');
+   }
+   if ((q < pEnd) && (*q == '.'))
+   {
+      ++q;
+      double scale = 0.1;
+      for (; (q < pEnd) && (*q >= '0') && (*q <= '9'); ++q, ++cDigits, scale *= 0.1)
+      {
+         value += (*q - '0') * scale;
+      }
+   }
+   if (cDigits == 0)
+   {
+      return false;
+   }
+   if ((q < pEnd) && ((*q == 'e') || (*q == 'E')))
+   {
+      auto r           = q + 1;
+      auto negativeExp = false;
+      if ((r < pEnd) && ((*r == '+') || (*r == '-')))
+      {
+         negativeExp = (*r == '-');
+         ++r;
+      }
+      int    exponent = 0;
+      size_t cExpDigits = 0;
+      for (; (r < pEnd) && (*r >= '0') && (*r <= '9'); ++r, ++cExpDigits)
+      {
+         exponent = std::min((exponent * 10) + (*r - '0'), 1000);
+      }
+      if (cExpDigits > 0)  // otherwise, the 'e' is the start of a unit
+      {
+         value *= std::pow(10.0, negativeExp ? -exponent : exponent);
+         q      = r;
+      }
+   }
+
+   char   unit[5];
+   size_t cchUnit = 0;
+   if ((q < pEnd) && (*q == '%'))
+   {
+      unit[cchUnit++] = '%';
+      ++q;
+   }
+   else
+   {
+      for (; (q < pEnd) && IsAsciiLetter(*q); ++q)
+      {
+         if (cchUnit == ARRAYSIZE(unit))
+         {
+            return false;
+         }
+         unit[cchUnit++] = ToLowerAscii(*q);
+      }
+   }
+
+   const auto isUnit = [&](const char* pszUnit)
+   {
+      return (NameLength(pszUnit) == cchUnit) && (std::memcmp(pszUnit, unit, cchUnit) == 0);
+   };
+   if      (cchUnit == 0)   { *pUnit = Unit::None;     }
+   else if (isUnit("%"))    { *pUnit = Unit::Percent;  }
+   else if (isUnit("deg"))  { *pUnit = Unit::Degrees;  }
+   else if (isUnit("rad"))  { *pUnit = Unit::Radians;  }
+   else if (isUnit("grad")) { *pUnit = Unit::Gradians; }
+   else if (isUnit("turn")) { *pUnit = Unit::Turns;    }
+   else
+   {
+      return false;
+   }
+
+   *pValue = negative ? -value : value;
+   p       = q;
+   return true;
+}
+
+BYTE ByteFromChannel(double value)
+{
+   return static_cast<BYTE>(std::lround(std::min(std::max(value, 0.0), 255.0)));
+}
+
+// Converts HSL to RGB, as specified by CSS. The hue is in degrees; the saturation and lightness are in [0, 1].
+COLORREF FromHSL(double hue, double saturation, double lightness)
+{
+   hue = std::fmod(hue, 360.0);
+   if (hue < 0.0)
+   {
+      hue += 360.0;
+   }
+   saturation = std::min(std::max(saturation, 0.0), 1.0);
+   lightness  = std::min(std::max(lightness,  0.0), 1.0);
+
+   const auto a       = saturation * std::min(lightness, 1.0 - lightness);
+   const auto channel = [=](double n)
+   {
+      const auto k = std::fmod(n + (hue / 30.0), 12.0);
+      return 255.0 * (lightness - (a * std::max(-1.0, std::min(std::min(k - 3.0, 9.0 - k), 1.0))));
+   };
+   return RGB(ByteFromChannel(channel(0.0)), ByteFromChannel(channel(8.0)), ByteFromChannel(channel(4.0)));
+}
+
+// Parses the arguments of an rgb(), rgba(), hsl(), or hsla() function, starting after the '('.
+template <typename CharT>
+ColorText::Status ParseFunction(bool isHsl, const CharT*& p, const CharT* pEnd, COLORREF* pclr)
+{
+   double values[4];
+   Unit   units[4];
+   size_t cArgs = 0;
+   auto   q     = p;
+   SkipWhitespace(q, pEnd);
+   for (;;)
+   {
+      if ((cArgs == ARRAYSIZE(values)) || !ParseNumber(q, pEnd, &values[cArgs], &units[cArgs]))
+      {
+         return ColorText::Status::BadFunction;
+      }
+      ++cArgs;
+
+      SkipWhitespace(q, pEnd);
+      if (q == pEnd)
+      {
+         return ColorText::Status::BadFunction;
+      }
+      if (*q == ')')
+      {
+         ++q;
+         break;
+      }
+      if ((*q == ',') || ((*q == '/') && (cArgs == 3)))
+      {
+         ++q;
+         SkipWhitespace(q, pEnd);
+      }
+   }
+   if ((cArgs < 3) || ((cArgs == 4) && (units[3] != Unit::None) && (units[3] != Unit::Percent)))
+   {
+      return ColorText::Status::BadFunction;
+   }
+
+   if (isHsl)
+   {
+      auto hue = values[0];
+      switch (units[0])
+      {
+         case Unit::None:
+         case Unit::Degrees:                                       break;
+         case Unit::Radians:  hue *= 180.0 / 3.14159265358979323846; break;
+         case Unit::Gradians: hue *= 0.9;                           break;
+         case Unit::Turns:    hue *= 360.0;                         break;
+         default:             return ColorText::Status::BadFunction;
+      }
+      if (((units[1] != Unit::None) && (units[1] != Unit::Percent)) ||
+          ((units[2] != Unit::None) && (units[2] != Unit::Percent)))
+      {
+         return ColorText::Status::BadFunction;
+      }
+      *pclr = FromHSL(hue, values[1] / 100.0, values[2] / 100.0);
+   }
+   else
+   {
+      BYTE channels[3];
+      for (size_t i = 0; i < 3; ++i)
+      {
+         switch (units[i])
+         {
+            case Unit::None:    channels[i] = ByteFromChannel(values[i]);                break;
+            case Unit::Percent: channels[i] = ByteFromChannel(values[i] * 255.0 / 100.0); break;
+            default:            return ColorText::Status::BadFunction;
+         }
+      }
+      *pclr = RGB(channels[0], channels[1], channels[2]);
+   }
+   p = q;
+   return ColorText::Status::Ok;
+}
+
+// Parses a named color, or a color in functional notation, starting at its first letter.
+template <typename CharT>
+ColorText::Status ParseWord(const CharT*& p, const CharT* pEnd, COLORREF* pclr)
+{
+   char   word[kcchNameMax + 1];
+   size_t cch = 0;
+   auto   q   = p;
+   for (; (q < pEnd) && IsAsciiLetter(*q); ++q, ++cch)
+   {
+      if (cch < ARRAYSIZE(word))
+      {
+         word[cch] = ToLowerAscii(*q);
+      }
+   }
+
+   if ((q < pEnd) && (*q == '('))
+   {
+      const auto isFunction = [&](const char* pszName)
+      {
+         return (NameLength(pszName) == cch) && (std::memcmp(pszName, word, cch) == 0);
+      };
+      const auto isRgb = isFunction("rgb") || isFunction("rgba");
+      const auto isHsl = isFunction("hsl") || isFunction("hsla");
+      if (!isRgb && !isHsl)
+      {
+         return ColorText::Status::BadFunction;
+      }
+      ++q;
+      const auto status = ParseFunction(isHsl, q, pEnd, pclr);
+      if (status == ColorText::Status::Ok)
+      {
+         p = q;
+      }
+      return status;
+   }
+
+   if ((cch > kcchNameMax) || !FindNamedColor(word, cch, pclr))
+   {
+      return ColorText::Status::UnknownName;
+   }
+   p = q;
+   return ColorText::Status::Ok;
+}
+
+
+//////////////////////////////////////////////////
+// Parsing
+//////////////////////////////////////////////////
+
+// Parses the color that starts at the specified position, and if it is valid, advances past it.
+template <typename CharT>
+ColorText::Status ParseColor(const CharT*& p, const CharT* pEnd, COLORREF* pclr)
+{
+   if (p == pEnd)
+   {
+      return ColorText::Status::Empty;
+   }
+   if (*p == '#')
+   {
+      return ParseHex(p, pEnd, pclr);
+   }
+   if (IsAsciiLetter(*p))
+   {
+      return ParseWord(p, pEnd, pclr);
+   }
+   return ColorText::Status::Empty;
+}
+
+template <typename CharT>
+ColorText::Status ParseOne(const CharT* pch, size_t cch, COLORREF* pclr)
+{
+   _ASSERTE(pch || (cch == 0));
+   _ASSERTE(pclr);
+
+   auto       p    = pch;
+   const auto pEnd = pch + cch;
+   SkipWhitespace(p, pEnd);
+   const auto status = ParseColor(p, pEnd, pclr);
+   if (status != ColorText::Status::Ok)
+   {
+      return status;
+   }
+   SkipWhitespace(p, pEnd);
+   return (p == pEnd) ? ColorText::Status::Ok : ColorText::Status::TrailingText;
+}
+
+// Skips past an entry in a list that could not be parsed: up to the next separator that is not
+// within parentheses, or to the end of the line, so that an unclosed parenthesis cannot swallow
+// the rest of the list.
+template <typename CharT>
+const CharT* SkipEntry(const CharT* p, const CharT* pEnd)
+{
+   size_t depth = 0;
+   for (; p < pEnd; ++p)
+   {
+      if ((*p == '\n') || ((depth == 0) && IsSeparator(*p)))
+      {
+         break;
+      }
+      if (*p == '(')
+      {
+         ++depth;
+      }
+      else if ((*p == ')') && (depth > 0))
+      {
+         --depth;
+      }
+   }
+   return p;
+}
+
+template <typename CharT>
+size_t ParseMany(const CharT*                    pch,
+                 size_t                          cch,
+                 std::vector<COLORREF>*          pColors,
+                 std::vector<ColorText::Error>*  pErrors)
+{
+   _ASSERTE(pch || (cch == 0));
+   _ASSERTE(pColors);
+
+   const auto pEnd    = pch + cch;
+   auto       p       = pch;
+   size_t     cColors = 0;
+   for (;;)
+   {
+      while ((p < pEnd) && IsSeparator(*p))
+      {
+         ++p;
+      }
+      if (p == pEnd)
+      {
+         break;
+      }
+
+      const auto pStart = p;
+      COLORREF   clr;
+      auto       status = ParseColor(p, pEnd, &clr);
+      if ((status == ColorText::Status::Ok) && (p < pEnd) && !IsSeparator(*p))
+      {
+         status = ColorText::Status::TrailingText;
+      }
+      if (status == ColorText::Status::Ok)
+      {
+         pColors->push_back(clr);
+         ++cColors;
+      }
+      else
+      {
+         if (pErrors)
+         {
+            pErrors->push_back(ColorText::Error{ status, static_cast<size_t>(pStart - pch) });
+         }
+         p = SkipEntry(pStart, pEnd);
+      }
+   }
+   return cColors;
+}
+
+
+//////////////////////////////////////////////////
+// Formatting
+//////////////////////////////////////////////////
+
+constexpr size_t kcchFormattedMax = 20;  // "hsl(360, 100%, 100%)" and "lightgoldenrodyellow"
+
+TCHAR* AppendText(TCHAR* pch, const char* psz)
+{
+   while (*psz != '\0')
+   {
+      *pch++ = static_cast<TCHAR>(*psz++);
+   }
+   return pch;
+}
+
+TCHAR* AppendNumber(TCHAR* pch, unsigned value)
+{
+   _ASSERTE(value <= 999);
+   if (value >= 100)
+   {
+      *pch++ = static_cast<TCHAR>('0' + (value / 100));
+   }
+   if (value >= 10)
+   {
+      *pch++ = static_cast<TCHAR>('0' + ((value / 10) % 10));
+   }
+   *pch++ = static_cast<TCHAR>('0' + (value % 10));
+   return pch;
+}
+
+TCHAR* AppendHex(TCHAR* pch, COLORREF clr)
+{
+   static constexpr char kDigits[] = "0123456789abcdef";
+   const BYTE            channels[] = { GetRValue(clr), GetGValue(clr), GetBValue(clr) };
+   *pch++ = _T('#');
+   for (const auto channel : channels)
+   {
+      *pch++ = static_cast<TCHAR>(kDigits[channel >> 4]);
+      *pch++ = static_cast<TCHAR>(kDigits[channel & 0xF]);
+   }
+   return pch;
+}
+
+TCHAR* AppendHsl(TCHAR* pch, COLORREF clr)
+{
+   const auto r     = GetRValue(clr) / 255.0;
+   const auto g     = GetGValue(clr) / 255.0;
+   const auto b     = GetBValue(clr) / 255.0;
+   const auto max   = std::max({ r, g, b });
+   const auto min   = std::min({ r, g, b });
+   const auto delta = max - min;
+   const auto l     = (max + min) / 2.0;
+   auto       h     = 0.0;
+   auto       s     = 0.0;
+   if (delta > 0.0)
+   {
+      s = delta / (1.0 - std::abs((2.0 * l) - 1.0));
+      if      (max == r) { h = std::fmod((g - b) / delta, 6.0); }
+      else if (max == g) { h = ((b - r) / delta) + 2.0;         }
+      else               { h = ((r - g) / delta) + 4.0;         }
+      h *= 60.0;
+      if (h < 0.0)
+      {
+         h += 360.0;
+      }
+   }
+
+   pch = AppendText  (pch, "hsl(");
+   pch = AppendNumber(pch, static_cast<unsigned>(std::lround(h)) % 360);
+   pch = AppendText  (pch, ", ");
+   pch = AppendNumber(pch, static_cast<unsigned>(std::lround(s * 100.0)));
+   pch = AppendText  (pch, "%, ");
+   pch = AppendNumber(pch, static_cast<unsigned>(std::lround(l * 100.0)));
+   return AppendText (pch, "%)");
+}
+
+// Writes a formatted color, and returns a pointer past its end.
+// There must be room for at least kcchFormattedMax characters.
+TCHAR* AppendColor(TCHAR* pch, COLORREF clr, ColorText::Notation notation)
+{
+   switch (notation)
+   {
+      case ColorText::Notation::Rgb:
+         pch = AppendText  (pch, "rgb(");
+         pch = AppendNumber(pch, GetRValue(clr));
+         pch = AppendText  (pch, ", ");
+         pch = AppendNumber(pch, GetGValue(clr));
+         pch = AppendText  (pch, ", ");
+         pch = AppendNumber(pch, GetBValue(clr));
+         return AppendText (pch, ")");
+
+      case ColorText::Notation::Hsl:
+         return AppendHsl(pch, clr);
+
+      case ColorText::Notation::Name:
+      {
+         const auto pszName = FindColorName(clr & 0x00FFFFFF);
+         return pszName ? AppendText(pch, pszName) : AppendHex(pch, clr);
+      }
+
+      default:
+         _ASSERTE(notation == ColorText::Notation::Hex);
+         return AppendHex(pch, clr);
+   }
+}
+
+}  // anonymous namespace
+
+/* static */ ColorText::Status ColorText::Parse(LPCWSTR pch, size_t cch, COLORREF* pclr)
+{
+   return ParseOne(pch, cch, pclr);
+}
+
+/* static */ ColorText::Status ColorText::Parse(LPCSTR pch, size_t cch, COLORREF* pclr)
+{
+   return ParseOne(pch, cch, pclr);
+}
+
+/* static */ size_t ColorText::ParseList(LPCWSTR                pch,
+                                         size_t                 cch,
+                                         std::vector<COLORREF>* pColors,
+                                         std::vector<Error>*    pErrors /* = nullptr */)
+{
+   return ParseMany(pch, cch, pColors, pErrors);
+}
+
+/* static */ size_t ColorText::ParseList(LPCSTR                 pch,
+                                         size_t                 cch,
+                                         std::vector<COLORREF>* pColors,
+                                         std::vector<Error>*    pErrors /* = nullptr */)
+{
+   return ParseMany(pch, cch, pColors, pErrors);
+}
+
+/* static */ CString ColorText::Format(COLORREF clr, Notation notation /* = Notation::Hex */)
+{
+   TCHAR      buffer[kcchFormattedMax];
+   const auto pchEnd = AppendColor(buffer, clr, notation);
+   return CString(buffer, static_cast<int>(pchEnd - buffer));
+}
+
+/* static */ CString ColorText::FormatList(const COLORREF* pColors,
+                                           size_t          cColors,
+                                           Notation        notation     /* = Notation::Hex */,
+                                           LPCTSTR         pszSeparator /* = _T(", ") */)
+{
+   _ASSERTE(pColors || (cColors == 0));
+   _ASSERTE(pszSeparator);
+
+   // Write straight into the string's buffer, which is sized for the longest possible result.
+   CString    result;
+   const auto cchSeparator = _tcslen(pszSeparator);
+   const auto cchMax       = cColors * (kcchFormattedMax + cchSeparator);
+   const auto pchStart     = result.GetBuffer(static_cast<int>(cchMax));
+   auto       pch          = pchStart;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      if (i > 0)
+      {
+         std::copy(pszSeparator, pszSeparator + cchSeparator, pch);
+         pch += cchSeparator;
+      }
+      pch = AppendColor(pch, pColors[i], notation);
+   }
+   result.ReleaseBuffer(static_cast<int>(pch - pchStart));
+   return result;
+}
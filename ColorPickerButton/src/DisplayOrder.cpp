@@ -0,0 +1,511 @@
+#include "PCH.hpp"
+#include "DisplayOrder.hpp"
+#include "ColorSpace.hpp"
+#include "ColorTableDiff.hpp"
+#include "MemoryUsage.hpp"
+#include <cfloat>                 // for FLT_MAX
+#include <cmath>                  // for cbrt, floor
+#include <memory>                 // for unique_ptr
+#include <numeric>                // for iota
+#include <ppl.h>                  // for parallel_for, parallel_sort
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Sort Keys
+//////////////////////////////////////////////////
+
+// Each of the sorting orders works by computing a 64-bit key for each entry and then sorting
+// the keys. The low 16 bits of every key hold the entry's table index, which both makes the keys
+// unique (so the result is deterministic, even with an unstable parallel sort) and lets the
+// sorted permutation be read directly back out of the sorted keys. The sorted keys are kept,
+// so that the order can be edited along with the table.
+constexpr unsigned kIndexBits = 16;
+constexpr UINT64   kIndexMask = (UINT64(1) << kIndexBits) - 1;
+
+UINT64 Quantize(float value, float lo, float hi, unsigned bits)
+{
+   const auto scale = static_cast<float>((1U << bits) - 1);
+   const auto t     = (std::min(std::max(value, lo), hi) - lo) / (hi - lo);
+   return static_cast<UINT64>((t * scale) + 0.5f);
+}
+
+// Grays (in order of decreasing lightness), followed by twelve bands of similar hue
+// (starting with red), each of which is again in order of decreasing lightness.
+UINT64 HueBandKey(const ColorSpace::Lab& lab)
+{
+   constexpr float    kChromaGrayMax = 0.03f;
+   constexpr unsigned kcHueBands     = 12;
+   constexpr float    kHueBandWidth  = 360.0f / kcHueBands;
+
+   UINT64 band = 0;
+   if (ColorSpace::Chroma(lab) >= kChromaGrayMax)
+   {
+      // OKLab puts pure red at a hue of about 29 degrees, so center the first band
+      // on it (rather than starting at 0) in order to keep the reds together.
+      const auto hue = std::fmod(ColorSpace::Hue(lab) + 360.0f - 15.0f, 360.0f);
+      band = 1 + (static_cast<UINT64>(hue / kHueBandWidth) % kcHueBands);
+   }
+   const auto darkness = Quantize(1.0f - lab.L, 0.0f, 1.0f, 16);
+   const auto hue      = Quantize(ColorSpace::Hue(lab), 0.0f, 360.0f, 16);
+   return (band << 32) | (darkness << 16) | hue;
+}
+
+// The position of a point along a 3-D Hilbert curve with the specified number of bits per axis,
+// using John Skilling's transposition algorithm ("Programming the Hilbert Curve", 2004).
+UINT64 HilbertIndex(UINT32 x[3], unsigned bits)
+{
+   const UINT32 m = 1U << (bits - 1);
+
+   // Inverse undo excess work.
+   for (UINT32 q = m; q > 1; q >>= 1)
+   {
+      const UINT32 p = q - 1;
+      for (int i = 0; i < 3; ++i)
+      {
+         if (x[i] & q)
+         {
+            x[0] ^= p;
+         }
+         else
+         {
+            const auto t = (x[0] ^ x[i]) & p;
+            x[0] ^= t;
+            x[i] ^= t;
+         }
+      }
+   }
+
+   // Gray encode.
+   x[1] ^= x[0];
+   x[2] ^= x[1];
+   UINT32 t = 0;
+   for (UINT32 q = m; q > 1; q >>= 1)
+   {
+      if (x[2] & q)
+      {
+         t ^= q - 1;
+      }
+   }
+   for (int i = 0; i < 3; ++i)
+   {
+      x[i] ^= t;
+   }
+
+   // Interleave the transposed bits to form the index.
+   UINT64 h = 0;
+   for (int b = static_cast<int>(bits) - 1; b >= 0; --b)
+   {
+      for (int i = 0; i < 3; ++i)
+      {
+         h = (h << 1) | ((x[i] >> b) & 1);
+      }
+   }
+   return h;
+}
+
+// Position along a Hilbert curve through OKLab space. The a and b axes are given the same
+// scale as the L axis, so that the curve follows perceptual distance equally in all directions.
+UINT64 HilbertKey(const ColorSpace::Lab& lab)
+{
+   constexpr unsigned kBits = 10;
+   UINT32 x[3] = { static_cast<UINT32>(Quantize(lab.L,  0.0f, 1.0f, kBits)),
+                   static_cast<UINT32>(Quantize(lab.a, -0.5f, 0.5f, kBits)),
+                   static_cast<UINT32>(Quantize(lab.b, -0.5f, 0.5f, kBits)) };
+   return HilbertIndex(x, kBits);
+}
+
+// The sort key of an entry, in either of the orders that sort by a key.
+UINT64 MakeKey(DisplayOrder::Order order, COLORREF clr, size_t index)
+{
+   const auto lab = ColorSpace::ToOKLab(clr);
+   const auto key = (order == DisplayOrder::Order::HueBands) ? HueBandKey(lab)
+                                                             : HilbertKey(lab);
+   return (key << kIndexBits) | index;
+}
+
+std::vector<UINT64> SortByKey(const std::vector<COLORREF>& colors, DisplayOrder::Order order)
+{
+   const auto          cColors = colors.size();
+   std::vector<UINT64> keys(cColors);
+   concurrency::parallel_for(size_t(0), cColors, [&](size_t i)
+   {
+      keys[i] = MakeKey(order, colors[i], i);
+   });
+   concurrency::parallel_sort(keys.begin(), keys.end());
+   return keys;
+}
+
+std::vector<UINT16> IndicesFromKeys(const std::vector<UINT64>& keys)
+{
+   std::vector<UINT16> indices(keys.size());
+   for (size_t i = 0; i < keys.size(); ++i)
+   {
+      indices[i] = static_cast<UINT16>(keys[i] & kIndexMask);
+   }
+   return indices;
+}
+
+void InsertKey(std::vector<UINT64>& keys, UINT64 key)
+{
+   keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+}
+
+void EraseKeyOfIndex(std::vector<UINT64>& keys, size_t index)
+{
+   const auto it = std::find_if(keys.begin(), keys.end(), [index](UINT64 key) { return (key & kIndexMask) == index; });
+   _ASSERTE(it != keys.end());
+   keys.erase(it);
+}
+
+// Adds one to, or subtracts one from, the index in each key whose index is at least the specified
+// index. This never changes the order of the keys, since it preserves the order of the indices.
+void RenumberKeys(std::vector<UINT64>& keys, size_t indexFirst, bool increment)
+{
+   for (auto& key : keys)
+   {
+      if ((key & kIndexMask) >= indexFirst)
+      {
+         key = increment ? (key + 1) : (key - 1);
+      }
+   }
+}
+
+
+//////////////////////////////////////////////////
+// Nearest-Neighbor Chain
+//////////////////////////////////////////////////
+
+// A uniform grid over the OKLab bounding box of some subset of a set of colors,
+// supporting nearest-neighbor queries and removal of points as they are visited.
+class NeighborGrid
+{
+public:
+
+   NeighborGrid(const std::vector<ColorSpace::Lab>& points, const std::vector<UINT16>& members)
+      : m_points  (points)
+      , m_cellSize()
+      , m_origin  ()
+      , m_dims    ()
+      , m_cells   ()
+      , m_cMembers(members.size())
+   {
+      // Choose cubic cells that would hold one point each, on average, if the points were
+      // spread evenly through their bounding box. (They never are; the sRGB gamut fills only
+      // a fraction of its bounding box in OKLab, so the occupied cells hold several points.)
+      float lo[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+      float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      for (const auto i : members)
+      {
+         const auto& point = points[i];
+         const float c[3]  = { point.L, point.a, point.b };
+         for (int axis = 0; axis < 3; ++axis)
+         {
+            lo[axis] = std::min(lo[axis], c[axis]);
+            hi[axis] = std::max(hi[axis], c[axis]);
+         }
+      }
+      constexpr float kExtentMin = 1.0f / 1024;
+      const auto      volume     = std::max(hi[0] - lo[0], kExtentMin)
+                                 * std::max(hi[1] - lo[1], kExtentMin)
+                                 * std::max(hi[2] - lo[2], kExtentMin);
+      m_cellSize = static_cast<float>(std::cbrt(volume / static_cast<double>(members.size())));
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         m_origin[axis] = lo[axis];
+         m_dims  [axis] = static_cast<int>((hi[axis] - lo[axis]) / m_cellSize) + 1;
+      }
+
+      m_cells.resize(static_cast<size_t>(m_dims[0]) * m_dims[1] * m_dims[2]);
+      for (const auto i : members)
+      {
+         int c[3];
+         this->CellFromPoint(points[i], c);
+         m_cells[this->CellIndex(c)].push_back(i);
+      }
+   }
+
+   // Returns the number of points that the grid was built with.
+   size_t GetMemberCount() const
+   {
+      return m_cMembers;
+   }
+
+   void Remove(size_t iPoint)
+   {
+      int c[3];
+      this->CellFromPoint(m_points[iPoint], c);
+      auto&      cell = m_cells[this->CellIndex(c)];
+      const auto it   = std::find(cell.begin(), cell.end(), static_cast<UINT16>(iPoint));
+      _ASSERTE(it != cell.end());
+      *it = cell.back();
+      cell.pop_back();
+   }
+
+   // Returns the remaining point nearest to the specified point (with ties resolved in favor
+   // of the lower index), searching outward in shells of cells around the point's own cell.
+   // The point itself need not lie within the grid; if it lies outside, then the search starts
+   // from the nearest cell on the boundary, and the distance bound for each shell still holds.
+   size_t FindNearest(const ColorSpace::Lab& point) const
+   {
+      int q[3];
+      this->CellFromPoint(point, q);
+      const auto rMax  = std::max({ m_dims[0], m_dims[1], m_dims[2] });
+      size_t     best  = static_cast<size_t>(-1);
+      auto       dBest = FLT_MAX;
+      for (int r = 0; r < rMax; ++r)
+      {
+         for (int x = std::max(q[0] - r, 0); x <= std::min(q[0] + r, m_dims[0] - 1); ++x)
+         {
+            for (int y = std::max(q[1] - r, 0); y <= std::min(q[1] + r, m_dims[1] - 1); ++y)
+            {
+               // Only visit the cells on the surface of the shell; the interior was already searched.
+               const auto onSurface = (std::abs(x - q[0]) == r) || (std::abs(y - q[1]) == r);
+               const auto zStep     = onSurface ? 1 : std::max(2 * r, 1);
+               for (int z = q[2] - r; z <= q[2] + r; z += zStep)
+               {
+                  if ((z < 0) || (z >= m_dims[2]))
+                  {
+                     continue;
+                  }
+                  const int c[3] = { x, y, z };
+                  for (const auto i : m_cells[this->CellIndex(c)])
+                  {
+                     const auto d = ColorSpace::DistanceSquared(point, m_points[i]);
+                     if ((d < dBest) || ((d == dBest) && (i < best)))
+                     {
+                        dBest = d;
+                        best  = i;
+                     }
+                  }
+               }
+            }
+         }
+
+         // Any point in a farther shell is at least r cells away.
+         const auto dShell = r * m_cellSize;
+         if ((best != static_cast<size_t>(-1)) && (dBest < (dShell * dShell)))
+         {
+            break;
+         }
+      }
+      return best;
+   }
+
+private:
+
+   void CellFromPoint(const ColorSpace::Lab& point, int c[3]) const
+   {
+      const float p[3] = { point.L, point.a, point.b };
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         const auto cell = static_cast<int>(std::floor((p[axis] - m_origin[axis]) / m_cellSize));
+         c[axis] = std::min(std::max(cell, 0), m_dims[axis] - 1);
+      }
+   }
+
+   size_t CellIndex(const int c[3]) const
+   {
+      return ((static_cast<size_t>(c[0]) * m_dims[1]) + c[1]) * m_dims[2] + c[2];
+   }
+
+private:
+   const std::vector<ColorSpace::Lab>& m_points;
+   float                               m_cellSize;
+   float                               m_origin[3];
+   int                                 m_dims[3];
+   std::vector<std::vector<UINT16>>    m_cells;
+   size_t                              m_cMembers;
+};
+
+// Starting from the darkest color, repeatedly steps to the most similar color not yet visited.
+std::vector<UINT16> ChainNearestNeighbors(const std::vector<COLORREF>& colors)
+{
+   const auto                   cColors = colors.size();
+   std::vector<ColorSpace::Lab> points(cColors);
+   concurrency::parallel_for(size_t(0), cColors, [&](size_t i)
+   {
+      points[i] = ColorSpace::ToOKLab(colors[i]);
+   });
+
+   size_t current = 0;
+   for (size_t i = 1; i < cColors; ++i)
+   {
+      if (points[i].L < points[current].L)
+      {
+         current = i;
+      }
+   }
+
+   // As points are removed, the grid becomes sparse, and searches have to cross more and more
+   // empty cells. To keep the cost of each search bounded, rebuild the grid over the remaining
+   // points whenever half of them have been visited (which costs O(n) in total).
+   std::vector<UINT16> remaining(cColors);
+   std::iota(remaining.begin(), remaining.end(), UINT16(0));
+   std::vector<bool>   visited(cColors);
+   std::vector<UINT16> indices;
+   indices.reserve(cColors);
+   auto pGrid = std::make_unique<NeighborGrid>(points, remaining);
+   for (;;)
+   {
+      indices.push_back(static_cast<UINT16>(current));
+      visited[current] = true;
+      pGrid->Remove(current);
+      const auto cRemaining = cColors - indices.size();
+      if (cRemaining == 0)
+      {
+         break;
+      }
+      if (cRemaining <= (pGrid->GetMemberCount() / 2))
+      {
+         remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [&](UINT16 i) { return visited[i]; }),
+                         remaining.end());
+         pGrid = std::make_unique<NeighborGrid>(points, remaining);
+      }
+      current = pGrid->FindNearest(points[current]);
+   }
+   return indices;
+}
+
+}  // anonymous namespace
+
+
+DisplayOrder::DisplayOrder(const std::vector<COLORREF>& colors, Order order, UINT version)
+   : m_order    (order)
+   , m_version  (version)
+   , m_indices  ()
+   , m_positions()
+   , m_keys     ()
+{
+   _ASSERTE(colors.size() <= (std::numeric_limits<UINT16>::max() + size_t(1)));
+   if (colors.empty())
+   {
+      return;
+   }
+
+   switch (order)
+   {
+      case Order::HueBands:
+      case Order::Hilbert:
+         m_keys    = SortByKey(colors, order);
+         m_indices = IndicesFromKeys(m_keys);
+         break;
+      case Order::NearestNeighbor:
+         m_indices = ChainNearestNeighbors(colors);
+         break;
+      default:
+         return;
+   }
+   this->ComputePositions();
+}
+
+DisplayOrder::DisplayOrder(const UINT16* pIndices, size_t cIndices, Order order, UINT version)
+   : m_order    (order)
+   , m_version  (version)
+   , m_indices  (pIndices, pIndices + cIndices)
+   , m_positions()
+   , m_keys     ()
+{
+   this->ComputePositions();
+}
+
+DisplayOrder::DisplayOrder(const DisplayOrder&          previous,
+                           const ColorTableDiff&        diff,
+                           const std::vector<COLORREF>& colors,
+                           UINT                         version)
+   : m_order    (previous.m_order)
+   , m_version  (version)
+   , m_indices  ()
+   , m_positions()
+   , m_keys     ()
+{
+   _ASSERTE(colors.size() <= (std::numeric_limits<UINT16>::max() + size_t(1)));
+   switch (m_order)
+   {
+      case Order::HueBands:
+      case Order::Hilbert:
+      {
+         // An order that was adopted from a palette file has no keys, so compute it from scratch.
+         if (previous.m_keys.size() != previous.m_indices.size())
+         {
+            m_keys = SortByKey(colors, m_order);
+         }
+         else
+         {
+            // Only the edited entries need new keys (the others just need their indices renumbered),
+            // so this takes a few passes over the integer keys, but no color conversions and no sort.
+            m_keys = previous.m_keys;
+            for (const auto& edit : diff.GetEdits())
+            {
+               switch (edit.operation)
+               {
+                  case ColorTableDiff::Operation::Insert:
+                     RenumberKeys(m_keys, edit.index, true);
+                     InsertKey(m_keys, MakeKey(m_order, edit.clr, edit.index));
+                     break;
+                  case ColorTableDiff::Operation::Remove:
+                     EraseKeyOfIndex(m_keys, edit.index);
+                     RenumberKeys(m_keys, edit.index + 1, false);
+                     break;
+                  case ColorTableDiff::Operation::Recolor:
+                     EraseKeyOfIndex(m_keys, edit.index);
+                     InsertKey(m_keys, MakeKey(m_order, edit.clr, edit.index));
+                     break;
+                  case ColorTableDiff::Operation::Rename:
+                     break;
+               }
+            }
+            _ASSERTE(m_keys.size() == colors.size());
+         }
+         m_indices = IndicesFromKeys(m_keys);
+         break;
+      }
+      case Order::NearestNeighbor:
+         if (!colors.empty())
+         {
+            m_indices = ChainNearestNeighbors(colors);
+         }
+         break;
+      default:
+         return;
+   }
+   this->ComputePositions();
+}
+
+DisplayOrder::Order DisplayOrder::GetOrder() const
+{
+   return m_order;
+}
+
+UINT DisplayOrder::GetVersion() const
+{
+   return m_version;
+}
+
+size_t DisplayOrder::IndexFromPosition(size_t position) const
+{
+   return m_indices.empty() ? position : m_indices[position];
+}
+
+size_t DisplayOrder::PositionFromIndex(size_t index) const
+{
+   return m_positions.empty() ? index : m_positions[index];
+}
+
+size_t DisplayOrder::GetByteSize() const
+{
+   return sizeof(*this)                   +
+          GetVectorByteSize(m_indices)    +
+          GetVectorByteSize(m_positions)  +
+          GetVectorByteSize(m_keys);
+}
+
+void DisplayOrder::ComputePositions()
+{
+   m_positions.resize(m_indices.size());
+   for (size_t position = 0; position < m_indices.size(); ++position)
+   {
+      m_positions[m_indices[position]] = static_cast<UINT16>(position);
+   }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+#include <vector>
+
+class ColorTableDiff;
+
+
+// A permutation of a color table that determines where each entry is displayed in the popup
+// (and, therefore, the order in which the arrow keys visit the entries). The entries in the
+// color table itself are never moved, so that indices returned to callers stay stable.
+//
+// Each instance records the table version and sort order that it was computed for,
+// so that the button can tell when it has gone stale and needs to be recomputed.
+class DisplayOrder
+{
+public:
+
+   using Order = ColorPickerButton::ColorTableOrder;
+
+   // Computes the display order of the specified colors.
+   DisplayOrder(const std::vector<COLORREF>& colors, Order order, UINT version);
+
+   // Adopts a display order that was computed in advance (for example, one stored in a palette
+   // file), given as the index of the entry displayed at each position.
+   DisplayOrder(const UINT16* pIndices, size_t cIndices, Order order, UINT version);
+
+   // Computes the display order of a color table that has been edited, from the display order
+   // of the table before the edits. Orders that sort by a key only need to move the edited
+   // entries; the nearest-neighbor order is global, so it is computed again from the colors.
+   DisplayOrder(const DisplayOrder&          previous,
+                const ColorTableDiff&        diff,
+                const std::vector<COLORREF>& colors,
+                UINT                         version);
+
+   Order GetOrder() const;
+   UINT  GetVersion() const;
+
+   // Returns the index of the table entry that is displayed at the specified position.
+   size_t IndexFromPosition(size_t position) const;
+
+   // Returns the position at which the specified table entry is displayed.
+   size_t PositionFromIndex(size_t index) const;
+
+   // Returns the number of bytes of memory that the order holds, including itself.
+   size_t GetByteSize() const;
+
+private:
+
+   // Computes the position of each table index from the index at each position.
+   void ComputePositions();
+
+private:
+   Order               m_order;
+   UINT                m_version;
+   std::vector<UINT16> m_indices;    // table index at each position (empty if in table order)
+   std::vector<UINT16> m_positions;  // position of each table index (empty if in table order)
+   std::vector<UINT64> m_keys;       // sorted keys, for orders that sort by a key (see SortByKey)
+};
@@ -0,0 +1,304 @@
+#include "PCH.hpp"
+#include "InputLog.hpp"
+
+
+namespace {
+
+// The binary format is a fixed header (all little-endian), followed by the inputs. Each input is
+// a byte holding its type (in the low bits) and whether Shift was down, then the difference in
+// time from the input before it, then its wParam, then either the difference in position from
+// the mouse input before it (for mouse inputs, whose lParam is a point), or its lParam. Each of
+// these is a variable-length integer, 7 bits to a byte, with the high bit set on all but the last
+// byte; signed differences are zigzag-encoded, so that small ones are small either way.
+#pragma pack(push, 1)
+struct Header
+{
+   UINT32 magic;
+   UINT32 version;
+   UINT32 clrInitial;
+   BYTE   outcomeFlags;
+   UINT32 clrOutcome;
+};
+#pragma pack(pop)
+static_assert(sizeof(Header) == 17, "The input log header has the wrong size.");
+
+constexpr UINT32 kMagic         = 0x4C495043;  // "CPIL", little-endian
+constexpr UINT32 kVersion       = 1;           // changes whenever the format changes
+constexpr BYTE   kOutcomeOkayed = 0x01;
+constexpr BYTE   kOutcomeCustom = 0x02;
+constexpr BYTE   kTypeMask      = 0x07;
+constexpr BYTE   kShift         = 0x08;
+
+bool IsMouseInput(InputEvent::Type type)
+{
+   return (type == InputEvent::Type::MouseMove)   ||
+          (type == InputEvent::Type::LButtonDown) ||
+          (type == InputEvent::Type::LButtonUp);
+}
+
+void AppendVarint(std::vector<BYTE>& data, UINT32 value)
+{
+   while (value >= 0x80)
+   {
+      data.push_back(static_cast<BYTE>(value | 0x80));
+      value >>= 7;
+   }
+   data.push_back(static_cast<BYTE>(value));
+}
+
+bool ReadVarint(const BYTE*& pData, const BYTE* pEnd, UINT32* pValue)
+{
+   UINT32 value = 0;
+   for (int shift = 0; (shift < 35) && (pData < pEnd); shift += 7)
+   {
+      const auto b = *pData++;
+      value |= static_cast<UINT32>(b & 0x7F) << shift;
+      if ((b & 0x80) == 0)
+      {
+         *pValue = value;
+         return true;
+      }
+   }
+   return false;
+}
+
+UINT32 ZigZagEncode(int value)
+{
+   return (static_cast<UINT32>(value) << 1) ^ static_cast<UINT32>(-static_cast<int>(value < 0));
+}
+
+int ZigZagDecode(UINT32 value)
+{
+   return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+}
+
+}  // anonymous namespace
+
+
+InputLog::InputLog()
+   : m_clrInitial(CLR_DEFAULT)
+   , m_outcome   { false, false, CLR_NONE }
+   , m_events    ()
+{
+}
+
+COLORREF InputLog::GetInitialColor() const
+{
+   return m_clrInitial;
+}
+
+void InputLog::SetInitialColor(COLORREF clr)
+{
+   m_clrInitial = clr;
+}
+
+const InputOutcome& InputLog::GetOutcome() const
+{
+   return m_outcome;
+}
+
+void InputLog::SetOutcome(const InputOutcome& outcome)
+{
+   m_outcome = outcome;
+}
+
+const std::vector<InputEvent>& InputLog::GetEvents() const
+{
+   return m_events;
+}
+
+void InputLog::Append(const InputEvent& event)
+{
+   m_events.push_back(event);
+}
+
+void InputLog::Clear()
+{
+   m_clrInitial = CLR_DEFAULT;
+   m_outcome    = { false, false, CLR_NONE };
+   m_events.clear();
+}
+
+
+std::vector<BYTE> InputLog::Serialize() const
+{
+   Header header;
+   header.magic        = kMagic;
+   header.version      = kVersion;
+   header.clrInitial   = m_clrInitial;
+   header.outcomeFlags = static_cast<BYTE>((m_outcome.okayed ? kOutcomeOkayed : 0) |
+                                           (m_outcome.custom ? kOutcomeCustom : 0));
+   header.clrOutcome   = m_outcome.clr;
+
+   std::vector<BYTE> data(reinterpret_cast<const BYTE*>(&header),
+                          reinterpret_cast<const BYTE*>(&header) + sizeof(header));
+   data.reserve(data.size() + 5 + (m_events.size() * 5));
+   AppendVarint(data, static_cast<UINT32>(m_events.size()));
+
+   auto  timePrevious = m_events.empty() ? 0 : m_events.front().time;
+   POINT ptPrevious   = { 0, 0 };
+   for (const auto& event : m_events)
+   {
+      data.push_back(static_cast<BYTE>(static_cast<BYTE>(event.type) | (event.shift ? kShift : 0)));
+      AppendVarint(data, event.time - timePrevious);  // (wraps around along with the tick count)
+      AppendVarint(data, event.wParam);
+      if (IsMouseInput(event.type))
+      {
+         const POINT pt = { GET_X_LPARAM(event.lParam), GET_Y_LPARAM(event.lParam) };
+         AppendVarint(data, ZigZagEncode(pt.x - ptPrevious.x));
+         AppendVarint(data, ZigZagEncode(pt.y - ptPrevious.y));
+         ptPrevious = pt;
+      }
+      else
+      {
+         AppendVarint(data, event.lParam);
+      }
+      timePrevious = event.time;
+   }
+   return data;
+}
+
+InputLog::Status InputLog::Deserialize(const BYTE* pData, size_t cbData)
+{
+   _ASSERTE(pData || (cbData == 0));
+
+   Header header;
+   if (cbData < sizeof(header))
+   {
+      return Status::NotInputLog;
+   }
+   memcpy(&header, pData, sizeof(header));
+   if ((header.magic != kMagic) || (header.version != kVersion))
+   {
+      return Status::NotInputLog;
+   }
+
+   const auto* p    = pData + sizeof(header);
+   const auto  pEnd = pData + cbData;
+   UINT32      cEvents;
+   if (!ReadVarint(p, pEnd, &cEvents) || (cEvents > static_cast<size_t>(pEnd - p)))  // (each input takes at least 4 bytes)
+   {
+      return Status::NotInputLog;
+   }
+
+   std::vector<InputEvent> events;
+   events.reserve(cEvents);
+   DWORD time       = 0;
+   POINT ptPrevious = { 0, 0 };
+   for (UINT32 iEvent = 0; iEvent < cEvents; ++iEvent)
+   {
+      if (p >= pEnd)
+      {
+         return Status::NotInputLog;
+      }
+      const auto typeAndFlags = *p++;
+      const auto type         = static_cast<InputEvent::Type>(typeAndFlags & kTypeMask);
+      if ((type > InputEvent::Type::Char) || ((typeAndFlags & ~(kTypeMask | kShift)) != 0))
+      {
+         return Status::NotInputLog;
+      }
+
+      UINT32 timeDelta;
+      UINT32 wParam;
+      UINT32 lParam;
+      if (!ReadVarint(p, pEnd, &timeDelta) || !ReadVarint(p, pEnd, &wParam))
+      {
+         return Status::NotInputLog;
+      }
+      if (IsMouseInput(type))
+      {
+         UINT32 dx;
+         UINT32 dy;
+         if (!ReadVarint(p, pEnd, &dx) || !ReadVarint(p, pEnd, &dy))
+         {
+            return Status::NotInputLog;
+         }
+         ptPrevious.x += ZigZagDecode(dx);
+         ptPrevious.y += ZigZagDecode(dy);
+         lParam        = static_cast<UINT32>(MAKELPARAM(ptPrevious.x, ptPrevious.y));
+      }
+      else if (!ReadVarint(p, pEnd, &lParam))
+      {
+         return Status::NotInputLog;
+      }
+
+      time += timeDelta;
+      const InputEvent event = { type, ((typeAndFlags & kShift) != 0), time, wParam, lParam };
+      events.push_back(event);
+   }
+   if (p != pEnd)
+   {
+      return Status::NotInputLog;
+   }
+
+   m_clrInitial     = header.clrInitial;
+   m_outcome.okayed = ((header.outcomeFlags & kOutcomeOkayed) != 0);
+   m_outcome.custom = ((header.outcomeFlags & kOutcomeCustom) != 0);
+   m_outcome.clr    = header.clrOutcome;
+   m_events         = std::move(events);
+   return Status::Ok;
+}
+
+InputLog::Status InputLog::Write(LPCTSTR pszPath) const
+{
+   _ASSERTE(pszPath);
+
+   const auto data  = this->Serialize();
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_WRITE,
+                                   0,
+                                   nullptr,
+                                   CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      return Status::IoError;
+   }
+
+   DWORD      cbDone    = 0;
+   const auto succeeded = (::WriteFile(hFile, data.data(), static_cast<DWORD>(data.size()), &cbDone, nullptr) != FALSE) &&
+                          (cbDone == data.size());
+   VERIFY(::CloseHandle(hFile));
+   if (!succeeded)
+   {
+      VERIFY(::DeleteFile(pszPath));
+      return Status::IoError;
+   }
+   return Status::Ok;
+}
+
+InputLog::Status InputLog::Read(LPCTSTR pszPath)
+{
+   _ASSERTE(pszPath);
+
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      return Status::IoError;
+   }
+
+   // Logs are small (a few bytes for each input), so the whole file is read at once.
+   LARGE_INTEGER     cbFile;
+   std::vector<BYTE> data;
+   auto              succeeded = (::GetFileSizeEx(hFile, &cbFile) != FALSE) && (cbFile.QuadPart <= MAXDWORD);
+   if (succeeded)
+   {
+      data.resize(static_cast<size_t>(cbFile.QuadPart));
+      DWORD cbRead = 0;
+      succeeded = (::ReadFile(hFile, data.data(), static_cast<DWORD>(data.size()), &cbRead, nullptr) != FALSE) &&
+                  (cbRead == data.size());
+   }
+   VERIFY(::CloseHandle(hFile));
+   if (!succeeded)
+   {
+      return Status::IoError;
+   }
+   return this->Deserialize(data.data(), data.size());
+}
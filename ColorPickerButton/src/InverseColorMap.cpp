@@ -0,0 +1,173 @@
+#include "PCH.hpp"
+#include "InverseColorMap.hpp"
+#include "MemoryUsage.hpp"
+
+
+namespace {
+
+UINT32 DistanceSquared(int r1, int g1, int b1, COLORREF clr)
+{
+   const auto dr = r1 - GetRValue(clr);
+   const auto dg = g1 - GetGValue(clr);
+   const auto db = b1 - GetBValue(clr);
+   return static_cast<UINT32>((dr * dr) + (dg * dg) + (db * db));
+}
+
+}  // anonymous namespace
+
+InverseColorMap::InverseColorMap(const std::vector<COLORREF>& colors)
+   : m_colors    (colors)
+   , m_cells     (kcCells)
+   , m_candidates(kcBoxes)
+   , m_filled    ()
+   , m_mutex     ()
+{
+   _ASSERTE(!m_colors.empty());
+   _ASSERTE(m_colors.size() <= (std::numeric_limits<UINT16>::max() + size_t(1)));
+   for (auto& filled : m_filled)
+   {
+      filled.store(false, std::memory_order_relaxed);
+   }
+}
+
+size_t InverseColorMap::GetColorCount() const
+{
+   return m_colors.size();
+}
+
+size_t InverseColorMap::GetByteSize() const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);  // (the candidates are added to as boxes are filled)
+
+   auto cb = sizeof(*this) + GetVectorByteSize(m_cells) + GetVectorByteSize(m_candidates);
+   for (const auto& candidates : m_candidates)
+   {
+      cb += GetVectorByteSize(candidates);
+   }
+   return cb;
+}
+
+/* static */ size_t InverseColorMap::BoxFromColor(COLORREF clr)
+{
+   constexpr auto kShift = 8 - kBoxBits;
+   return (static_cast<size_t>(GetRValue(clr) >> kShift) << (kBoxBits * 2))
+        | (static_cast<size_t>(GetGValue(clr) >> kShift) <<  kBoxBits)
+        |  static_cast<size_t>(GetBValue(clr) >> kShift);
+}
+
+/* static */ size_t InverseColorMap::CellFromColor(COLORREF clr)
+{
+   constexpr auto kShift = 8 - kCellBits;
+   return (static_cast<size_t>(GetRValue(clr) >> kShift) << (kCellBits * 2))
+        | (static_cast<size_t>(GetGValue(clr) >> kShift) <<  kCellBits)
+        |  static_cast<size_t>(GetBValue(clr) >> kShift);
+}
+
+void InverseColorMap::FillBox(size_t iBox) const
+{
+   // Determine the range of 8-bit channel values covered by the box.
+   constexpr auto kBoxSpan  = 1 << (8 - kBoxBits);
+   constexpr auto kCellSpan = 1 << (8 - kCellBits);
+   const int      lo[3]     = { static_cast<int>((iBox >> (kBoxBits * 2)) & ((1 << kBoxBits) - 1)) * kBoxSpan,
+                                static_cast<int>((iBox >>  kBoxBits)      & ((1 << kBoxBits) - 1)) * kBoxSpan,
+                                static_cast<int>( iBox                    & ((1 << kBoxBits) - 1)) * kBoxSpan };
+   const int      hi[3]     = { lo[0] + kBoxSpan - 1, lo[1] + kBoxSpan - 1, lo[2] + kBoxSpan - 1 };
+
+   // For each entry, find the minimum and maximum distance from it to any point in the box.
+   // The entry nearest to any point in the box can be no farther from that point than the
+   // smallest of the maximum distances, so only entries whose minimum distance is within
+   // that bound need to be considered (the same approach that libjpeg takes).
+   const auto          cColors = m_colors.size();
+   std::vector<UINT32> minDists(cColors);
+   auto                minMaxDist = std::numeric_limits<UINT32>::max();
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      const int c[3]    = { GetRValue(m_colors[i]), GetGValue(m_colors[i]), GetBValue(m_colors[i]) };
+      UINT32    minDist = 0;
+      UINT32    maxDist = 0;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         const auto dMin = (c[axis] < lo[axis]) ? (lo[axis] - c[axis])
+                         : (c[axis] > hi[axis]) ? (c[axis] - hi[axis])
+                                                : 0;
+         const auto dMax = std::max(std::abs(c[axis] - lo[axis]), std::abs(c[axis] - hi[axis]));
+         minDist += static_cast<UINT32>(dMin * dMin);
+         maxDist += static_cast<UINT32>(dMax * dMax);
+      }
+      minDists[i] = minDist;
+      minMaxDist  = std::min(minMaxDist, maxDist);
+   }
+
+   auto& candidates = m_candidates[iBox];
+   candidates.clear();
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      if (minDists[i] <= minMaxDist)
+      {
+         candidates.push_back(static_cast<UINT16>(i));
+      }
+   }
+   _ASSERTE(!candidates.empty());
+
+   // Resolve each cell within the box to the candidate nearest to the cell's center.
+   for (int r = lo[0]; r <= hi[0]; r += kCellSpan)
+   {
+      for (int g = lo[1]; g <= hi[1]; g += kCellSpan)
+      {
+         for (int b = lo[2]; b <= hi[2]; b += kCellSpan)
+         {
+            const auto center = RGB(r + (kCellSpan / 2), g + (kCellSpan / 2), b + (kCellSpan / 2));
+            auto       best   = candidates.front();
+            auto       dBest  = std::numeric_limits<UINT32>::max();
+            for (const auto i : candidates)
+            {
+               const auto d = DistanceSquared(GetRValue(center), GetGValue(center), GetBValue(center), m_colors[i]);
+               if (d < dBest)
+               {
+                  dBest = d;
+                  best  = i;
+               }
+            }
+            m_cells[CellFromColor(center)] = best;
+         }
+      }
+   }
+}
+
+void InverseColorMap::EnsureBoxFilled(size_t iBox) const
+{
+   if (!m_filled[iBox].load(std::memory_order_acquire))
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_filled[iBox].load(std::memory_order_relaxed))
+      {
+         this->FillBox(iBox);
+         m_filled[iBox].store(true, std::memory_order_release);
+      }
+   }
+}
+
+size_t InverseColorMap::LookupNearest(COLORREF clr) const
+{
+   this->EnsureBoxFilled(BoxFromColor(clr));
+   return m_cells[CellFromColor(clr)];
+}
+
+size_t InverseColorMap::FindNearest(COLORREF clr) const
+{
+   const auto iBox = BoxFromColor(clr);
+   this->EnsureBoxFilled(iBox);
+
+   size_t best  = kInvalidIndex;
+   auto   dBest = std::numeric_limits<UINT32>::max();
+   for (const auto i : m_candidates[iBox])
+   {
+      const auto d = DistanceSquared(GetRValue(clr), GetGValue(clr), GetBValue(clr), m_colors[i]);
+      if (d < dBest)
+      {
+         dBest = d;
+         best  = i;
+      }
+   }
+   return best;
+}
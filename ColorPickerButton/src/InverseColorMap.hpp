@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+// Maps arbitrary colors onto the entries of a color table (and therefore onto the entries of the
+// logical palette that is built from it), in the manner of an inverse colormap.
+//
+// RGB space is divided into 32 x 32 x 32 cells (i.e., RGB555), and each cell stores the index of
+// the table entry nearest to its center, so that a lookup is a single table read. The cells are
+// grouped into 8 x 8 x 8 boxes, which are filled in lazily, the first time that any color inside of
+// them is looked up; filling a box only has to consider the handful of table entries that could
+// possibly be nearest to some point within it. As a result, building a map is nearly free, and
+// only the regions of color space that are actually used are ever computed.
+//
+// Instances are immutable (aside from the lazy filling, which is thread-safe). Each one is owned
+// by the ColorTableIndex for its color table, and refers to (but does not copy) that table's colors.
+class InverseColorMap
+{
+   InverseColorMap           (const InverseColorMap&) = delete;  // not copyable
+   InverseColorMap& operator=(const InverseColorMap&) = delete;  // not assignable
+
+public:
+
+   static constexpr size_t kInvalidIndex = static_cast<size_t>(-1);
+
+   // Creates a map for the specified colors, which must outlive the map.
+   explicit InverseColorMap(const std::vector<COLORREF>& colors);
+
+   // Returns the number of colors in the table that this map was built from.
+   size_t GetColorCount() const;
+
+   // Returns the index of the table entry nearest to the center of the RGB555 cell that contains
+   // the specified color. This is an O(1) operation, and is exact for all colors whose
+   // channels are multiples of 8 (plus 4); otherwise, it is exact to within the cell size.
+   size_t LookupNearest(COLORREF clr) const;
+
+   // Returns the index of the table entry that is truly nearest to the specified color
+   // (with ties resolved in favor of the lower index). This examines only the few
+   // candidate entries for the box containing the color.
+   size_t FindNearest(COLORREF clr) const;
+
+   // Returns the number of bytes of memory that the map holds, including itself (which grows
+   // as boxes are filled).
+   size_t GetByteSize() const;
+
+private:
+
+   static constexpr unsigned kCellBits    = 5;                                // bits per channel in a cell index
+   static constexpr unsigned kBoxBits     = 3;                                // bits per channel in a box index
+   static constexpr unsigned kCellsPerBox = 1U << (kCellBits - kBoxBits);     // cells per channel in a box
+   static constexpr size_t   kcCells      = size_t(1) << (kCellBits * 3);
+   static constexpr size_t   kcBoxes      = size_t(1) << (kBoxBits  * 3);
+
+   static size_t BoxFromColor(COLORREF clr);
+   static size_t CellFromColor(COLORREF clr);
+
+   void FillBox(size_t iBox) const;
+   void EnsureBoxFilled(size_t iBox) const;
+
+private:
+   const std::vector<COLORREF>&                   m_colors;
+   mutable std::vector<UINT16>                    m_cells;       // nearest entry for each cell
+   mutable std::vector<std::vector<UINT16>>       m_candidates;  // entries that may be nearest within each box
+   mutable std::array<std::atomic<bool>, kcBoxes> m_filled;      // true once a box has been filled
+   mutable std::mutex                             m_mutex;       // serializes the filling of boxes
+};
@@ -0,0 +1,90 @@
+#include "PCH.hpp"
+#include "LatencyHistogram.hpp"
+#include <cmath>
+#include <intrin.h>
+
+
+LatencyHistogram::LatencyHistogram()
+   : m_counts  ()
+   , m_cSamples(0)
+   , m_max     (0)
+{
+}
+
+void LatencyHistogram::Record(UINT32 value)
+{
+   auto& count = m_counts[BucketFromValue(value)];
+   if (count < UINT32_MAX)  // (saturate, rather than wrap around)
+   {
+      ++count;
+   }
+   ++m_cSamples;
+   m_max = std::max(m_max, value);
+}
+
+void LatencyHistogram::Reset()
+{
+   m_counts.fill(0);
+   m_cSamples = 0;
+   m_max      = 0;
+}
+
+UINT64 LatencyHistogram::GetCount() const
+{
+   return m_cSamples;
+}
+
+UINT32 LatencyHistogram::GetMax() const
+{
+   return m_max;
+}
+
+UINT32 LatencyHistogram::GetValueAtPercentile(double percentile) const
+{
+   if (m_cSamples == 0)
+   {
+      return 0;
+   }
+
+   // Find the bucket that holds the sample of the specified rank (counting from 1).
+   const auto fraction = std::min(std::max(percentile, 0.0), 100.0) / 100.0;
+   const auto rank     = std::max<UINT64>(static_cast<UINT64>(std::ceil(fraction * static_cast<double>(m_cSamples))), 1);
+   UINT64     cSeen    = 0;
+   for (size_t iBucket = 0; iBucket < kcBuckets; ++iBucket)
+   {
+      cSeen += m_counts[iBucket];
+      if (cSeen >= rank)
+      {
+         return std::min(HighestValueInBucket(iBucket), m_max);
+      }
+   }
+   return m_max;  // (only if some bucket's count saturated)
+}
+
+
+/* static */ size_t LatencyHistogram::BucketFromValue(UINT32 value)
+{
+   if (value < kcSubBuckets)
+   {
+      return value;
+   }
+
+   // Shift the value so that its top bit lands in the top half of the sub-buckets,
+   // which then places it within its power of two.
+   unsigned long iTopBit;
+   VERIFY(_BitScanReverse(&iTopBit, value));
+   const auto shift = static_cast<size_t>(iTopBit) - (kcSubBucketBits - 1);
+   return kcSubBuckets + ((shift - 1) * kcHalfBuckets) + ((value >> shift) - kcHalfBuckets);
+}
+
+/* static */ UINT32 LatencyHistogram::HighestValueInBucket(size_t iBucket)
+{
+   if (iBucket < kcSubBuckets)
+   {
+      return static_cast<UINT32>(iBucket);
+   }
+
+   const auto shift     = ((iBucket - kcSubBuckets) / kcHalfBuckets) + 1;
+   const auto subBucket = ((iBucket - kcSubBuckets) % kcHalfBuckets) + kcHalfBuckets;
+   return static_cast<UINT32>(((static_cast<UINT64>(subBucket) + 1) << shift) - 1);
+}
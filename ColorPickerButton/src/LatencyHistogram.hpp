@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+
+
+// A histogram of latencies, in microseconds, from which percentiles can be read, in the style of
+// an HDR histogram: values below 64 each have their own bucket, and every power of two above that
+// is split into 32 buckets, so any value is reported to within about 3% of what was recorded, up to
+// the largest value that fits in 32 bits (over an hour). The buckets are a fixed array, so recording
+// a sample never allocates, and costs a bit scan and an increment, however many samples there are.
+//
+// Not thread-safe; each histogram belongs to the thread that owns the button.
+class LatencyHistogram
+{
+public:
+
+   LatencyHistogram();
+
+   // Records a sample.
+   void Record(UINT32 value);
+
+   // Discards every sample.
+   void Reset();
+
+   UINT64 GetCount() const;
+
+   // Returns the largest sample (exactly), or 0 if there are none.
+   UINT32 GetMax() const;
+
+   // Returns the value that the specified percentage (from 0 to 100) of the samples are no larger
+   // than (rounded up to the largest value in its bucket), or 0 if there are no samples.
+   UINT32 GetValueAtPercentile(double percentile) const;
+
+private:
+
+   static constexpr int    kcSubBucketBits = 6;
+   static constexpr size_t kcSubBuckets    = size_t(1) << kcSubBucketBits;                    // (64) buckets of single values
+   static constexpr size_t kcHalfBuckets   = kcSubBuckets / 2;                                // (32) buckets for each power of two above
+   static constexpr size_t kcBuckets       = kcSubBuckets + ((32 - kcSubBucketBits) * kcHalfBuckets);
+
+   static size_t BucketFromValue(UINT32 value);
+   static UINT32 HighestValueInBucket(size_t iBucket);
+
+private:
+   std::array<UINT32, kcBuckets> m_counts;
+   UINT64                        m_cSamples;
+   UINT32                        m_max;
+};
@@ -0,0 +1,64 @@
+#include "PCH.hpp"
+#include "MemoryUsage.hpp"
+
+
+size_t GetStringByteSize(const CString& str)
+{
+   return str.IsEmpty() ? 0
+                        : (sizeof(ATL::CStringData) + ((static_cast<size_t>(str.GetAllocLength()) + 1) * sizeof(TCHAR)));
+}
+
+
+MemoryUsageCounter::MemoryUsageCounter(bool countSharedOnce)
+   : m_countSharedOnce(countSharedOnce)
+   , m_counted        ()
+   , m_usage          ()
+{
+}
+
+void MemoryUsageCounter::AddButton()
+{
+   ++m_usage.cButtons;
+}
+
+void MemoryUsageCounter::AddPrivate(size_t cb, UINT cGdiObjects)
+{
+   m_usage.cbPrivate          += cb;
+   m_usage.cGdiObjectsPrivate += cGdiObjects;
+}
+
+void MemoryUsageCounter::AddString(const CString& str, bool isShared)
+{
+   if (!str.IsEmpty() && this->IsFirstSighting(static_cast<LPCTSTR>(str)))
+   {
+      (isShared ? m_usage.cbShared : m_usage.cbPrivate) += GetStringByteSize(str);
+   }
+}
+
+bool MemoryUsageCounter::AddShared(const void* pObject, size_t cb, UINT cGdiObjects)
+{
+   _ASSERTE(pObject);
+
+   if (!this->IsFirstSighting(pObject))
+   {
+      return false;
+   }
+   m_usage.cbShared          += cb;
+   m_usage.cGdiObjectsShared += cGdiObjects;
+   return true;
+}
+
+void MemoryUsageCounter::AddMapped(size_t cb)
+{
+   m_usage.cbMapped += cb;
+}
+
+const ColorPickerButton::MemoryUsage& MemoryUsageCounter::GetUsage() const
+{
+   return m_usage;
+}
+
+bool MemoryUsageCounter::IsFirstSighting(const void* pObject)
+{
+   return !m_countSharedOnce || m_counted.insert(pObject).second;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ColorPickerButton.hpp"
+#include <unordered_set>
+#include <vector>
+
+
+// Gets the number of bytes in the heap block held by a vector (its capacity, not its size).
+template <typename T>
+size_t GetVectorByteSize(const std::vector<T>& v)
+{
+   return v.capacity() * sizeof(T);
+}
+
+// Gets the number of bytes in the heap block held by a CString (none for an empty string,
+// which refers to a static block).
+size_t GetStringByteSize(const CString& str);
+
+
+// Tallies what ColorPickerButton::GetMemoryUsage() reports, for one button or for all of them.
+// When all of them are being counted, each shared object (and each CString buffer, which copies
+// of a string share) is counted only the first time it is seen, keyed by its address.
+class MemoryUsageCounter
+{
+   MemoryUsageCounter           (const MemoryUsageCounter&) = delete;  // not copyable
+   MemoryUsageCounter& operator=(const MemoryUsageCounter&) = delete;  // not assignable
+
+public:
+
+   explicit MemoryUsageCounter(bool countSharedOnce);
+
+   // Counts a button.
+   void AddButton();
+
+   // Counts memory, and GDI objects, held by one button alone.
+   void AddPrivate(size_t cb, UINT cGdiObjects = 0);
+
+   // Counts the buffer of a string, held either by one button alone or by a shared object
+   // (which AddShared() has just counted).
+   void AddString(const CString& str, bool isShared = false);
+
+   // Counts an object that may be shared between buttons, which holds the specified number of
+   // bytes (and GDI objects) in all. Returns false, having counted nothing, if the object has
+   // already been counted.
+   bool AddShared(const void* pObject, size_t cb, UINT cGdiObjects = 0);
+
+   // Counts views of files or sections that are mapped into the process. (These are always held
+   // by a shared object, so this is only called if AddShared() has just counted that object.)
+   void AddMapped(size_t cb);
+
+   const ColorPickerButton::MemoryUsage& GetUsage() const;
+
+private:
+
+   // Returns true if the specified object has not been counted yet (and notes that it now has been).
+   bool IsFirstSighting(const void* pObject);
+
+private:
+   const bool                      m_countSharedOnce;
+   std::unordered_set<const void*> m_counted;          // (only when counting shared objects once)
+   ColorPickerButton::MemoryUsage  m_usage;
+};
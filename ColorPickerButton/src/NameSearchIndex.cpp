@@ -0,0 +1,303 @@
+#include "PCH.hpp"
+#include "NameSearchIndex.hpp"
+#include "MemoryUsage.hpp"
+#include <type_traits>
+
+
+namespace {
+
+constexpr UINT64 kIndexMask     = 0xFFFF;  // (the low 16 bits of an entry in the list of trigrams, or of a rank key)
+constexpr int    kcIndexBits    = 16;
+constexpr UINT   kSimilarityMax = 1024;    // similarity of a misspelling that shares all of its trigrams
+
+using UTCHAR = std::make_unsigned_t<TCHAR>;
+
+// Returns whether the character separates words (as spaces, hyphens, and parentheses do).
+bool IsSeparator(TCHAR ch)
+{
+   return !::IsCharAlphaNumeric(ch);
+}
+
+// Folds a string to lowercase, in place. The names and the queries are folded in the same way.
+void Fold(TCHAR* pch, size_t cch)
+{
+   if (cch > 0)
+   {
+      ::CharLowerBuff(pch, static_cast<DWORD>(cch));
+   }
+}
+
+// Packs the three characters at the specified position into a trigram (of 48 bits).
+UINT64 MakeTrigram(const TCHAR* pch)
+{
+   return (static_cast<UINT64>(static_cast<UTCHAR>(pch[0])) << 32) |
+          (static_cast<UINT64>(static_cast<UTCHAR>(pch[1])) << 16) |
+          (static_cast<UINT64>(static_cast<UTCHAR>(pch[2]))      );
+}
+
+// Packs the first four characters of a null-terminated string (padded with zeros, if it is shorter)
+// into a key that orders strings in the same way as their first four characters do.
+UINT64 MakeSortKey(const TCHAR* pch)
+{
+   UINT64 key = 0;
+   for (int ich = 0; ich < 4; ++ich)
+   {
+      key = (key << 16) | static_cast<UTCHAR>(*pch);
+      pch += (*pch != TEXT('\0')) ? 1 : 0;
+   }
+   return key;
+}
+
+// Compares the text at a position with a query, only up to the length of the query,
+// so that text that starts with the query compares equal to it.
+int ComparePrefix(const TCHAR* pchText, const TCHAR* pchQuery, size_t cchQuery)
+{
+   return _tcsncmp(pchText, pchQuery, cchQuery);
+}
+
+}  // anonymous namespace
+
+
+NameSearchIndex::NameSearchIndex(size_t cNames, const NameGetter& getName, UINT version)
+   : m_version   (version)
+   , m_pool      ()
+   , m_offsets   ()
+   , m_wordStarts()
+   , m_trigrams  ()
+{
+   _ASSERTE(cNames <= (kIndexMask + 1));
+
+   // Pack the names into a pool, as each one is gotten (so that no more than one of them is held
+   // as a string at a time), and fold them all at once.
+   m_offsets.reserve(cNames + 1);
+   for (size_t index = 0; index < cNames; ++index)
+   {
+      const auto strName = getName(index);
+      const auto pszName = static_cast<LPCTSTR>(strName);
+      m_offsets.push_back(static_cast<UINT32>(m_pool.size()));
+      m_pool.insert(m_pool.end(), pszName, pszName + strName.GetLength());
+      m_pool.push_back(TEXT('\0'));
+   }
+   m_offsets.push_back(static_cast<UINT32>(m_pool.size()));
+   m_pool.shrink_to_fit();
+   Fold(m_pool.data(), m_pool.size());
+
+   // Find the start of each word, and each trigram, in each name. The word starts are sorted by a key
+   // made of their first four characters, so that their text only needs to be compared on a tie.
+   std::vector<std::pair<UINT64, WordStart>> wordStarts;
+   for (size_t index = 0; index < cNames; ++index)
+   {
+      const auto first = m_offsets[index];
+      const auto last  = m_offsets[index + 1] - 1;  // (the position of the terminator)
+      for (auto position = first; position < last; ++position)
+      {
+         if (!IsSeparator(m_pool[position]) && ((position == first) || IsSeparator(m_pool[position - 1])))
+         {
+            const WordStart wordStart = { position, static_cast<UINT32>(index) };
+            wordStarts.emplace_back(MakeSortKey(&m_pool[position]), wordStart);
+         }
+         if ((position + 3) <= last)
+         {
+            m_trigrams.push_back((MakeTrigram(&m_pool[position]) << kcIndexBits) | index);
+         }
+      }
+   }
+   std::sort(wordStarts.begin(),
+             wordStarts.end(),
+             [this](const std::pair<UINT64, WordStart>& wordStart1, const std::pair<UINT64, WordStart>& wordStart2)
+             {
+                if (wordStart1.first != wordStart2.first)
+                {
+                   return (wordStart1.first < wordStart2.first);
+                }
+                return _tcscmp(&m_pool[wordStart1.second.position], &m_pool[wordStart2.second.position]) < 0;
+             });
+   m_wordStarts.reserve(wordStarts.size());
+   for (const auto& wordStart : wordStarts)
+   {
+      m_wordStarts.push_back(wordStart.second);
+   }
+   std::sort(m_trigrams.begin(), m_trigrams.end());
+   m_trigrams.erase(std::unique(m_trigrams.begin(), m_trigrams.end()), m_trigrams.end());
+}
+
+NameSearchIndex::NameSearchIndex(const std::vector<CString>& names, UINT version)
+   : NameSearchIndex(names.size(), [&names](size_t index) { return names[index]; }, version)
+{ }
+
+UINT NameSearchIndex::GetVersion() const
+{
+   return m_version;
+}
+
+bool NameSearchIndex::IsEmpty() const
+{
+   return m_wordStarts.empty();
+}
+
+size_t NameSearchIndex::GetByteSize() const
+{
+   return sizeof(*this)                   +
+          GetVectorByteSize(m_pool)       +
+          GetVectorByteSize(m_offsets)    +
+          GetVectorByteSize(m_wordStarts) +
+          GetVectorByteSize(m_trigrams);
+}
+
+std::vector<size_t> NameSearchIndex::Find(const CString& strQuery) const
+{
+   std::vector<TCHAR> query(static_cast<LPCTSTR>(strQuery), static_cast<LPCTSTR>(strQuery) + strQuery.GetLength());
+   Fold(query.data(), query.size());
+   query.push_back(TEXT('\0'));
+   const auto pchQuery = query.data();
+   const auto cchQuery = query.size() - 1;
+   if ((cchQuery == 0) || this->IsEmpty())
+   {
+      return std::vector<size_t>();
+   }
+
+   // The matches are collected one tier at a time, best first, and each tier is ranked by the
+   // length of the names (so that the closest matches come first), and then by index. Once there
+   // are enough matches, the worse tiers are never looked at, so that a short query, which matches
+   // a great many names, costs no more than ranking the ones that it matches best.
+   std::vector<size_t> matches;
+   std::vector<bool>   isMatched(m_offsets.size() - 1);  // (set as each match is added to a tier)
+   const auto rankTier = [&matches](std::vector<UINT32>& tier)  // (of rank keys)
+   {
+      const auto cTaken = std::min(tier.size(), kcMatchesMax - matches.size());
+      std::partial_sort(tier.begin(), tier.begin() + cTaken, tier.end());
+      for (size_t iMatch = 0; iMatch < cTaken; ++iMatch)
+      {
+         matches.push_back(static_cast<size_t>(tier[iMatch] & kIndexMask));
+      }
+      return (matches.size() < kcMatchesMax);  // (whether the next tier is needed)
+   };
+
+   // Find the names and the words that start with the query, which are all together in the
+   // sorted word starts. (A name that starts with the query may have other words that do, too.)
+   const auto itFirst = std::lower_bound(m_wordStarts.begin(),
+                                         m_wordStarts.end(),
+                                         pchQuery,
+                                         [this, cchQuery](const WordStart& wordStart, const TCHAR* pch)
+                                         {
+                                            return ComparePrefix(&m_pool[wordStart.position], pch, cchQuery) < 0;
+                                         });
+   const auto itLast  = std::upper_bound(itFirst,
+                                         m_wordStarts.end(),
+                                         pchQuery,
+                                         [this, cchQuery](const TCHAR* pch, const WordStart& wordStart)
+                                         {
+                                            return ComparePrefix(&m_pool[wordStart.position], pch, cchQuery) > 0;
+                                         });
+   std::vector<UINT32> tierNamePrefix;
+   for (auto it = itFirst; it != itLast; ++it)
+   {
+      if (it->position == m_offsets[it->index])
+      {
+         isMatched[it->index] = true;
+         tierNamePrefix.push_back(this->GetRankKey(it->index));
+      }
+   }
+   std::vector<UINT32> tierWordPrefix;  // (without the names that start with the query, or repeats)
+   for (auto it = itFirst; it != itLast; ++it)
+   {
+      if (!isMatched[it->index])
+      {
+         isMatched[it->index] = true;
+         tierWordPrefix.push_back(this->GetRankKey(it->index));
+      }
+   }
+   if (!rankTier(tierNamePrefix) || !rankTier(tierWordPrefix))
+   {
+      return matches;
+   }
+
+   // The rest of the search works with the query's trigrams, so it needs at least one.
+   std::vector<UINT64> queryTrigrams;
+   for (size_t position = 0; (position + 3) <= cchQuery; ++position)
+   {
+      queryTrigrams.push_back(MakeTrigram(pchQuery + position));
+   }
+   std::sort(queryTrigrams.begin(), queryTrigrams.end());
+   queryTrigrams.erase(std::unique(queryTrigrams.begin(), queryTrigrams.end()), queryTrigrams.end());
+   if (queryTrigrams.empty())
+   {
+      return matches;
+   }
+   std::vector<std::pair<TrigramIterator, TrigramIterator>> postings;
+   postings.reserve(queryTrigrams.size());
+   for (const auto trigram : queryTrigrams)
+   {
+      postings.emplace_back(std::lower_bound(m_trigrams.begin(), m_trigrams.end(), (trigram       << kcIndexBits)),
+                            std::lower_bound(m_trigrams.begin(), m_trigrams.end(), ((trigram + 1) << kcIndexBits)));
+   }
+
+   // Find the names that contain the query elsewhere, among the names that contain its rarest trigram.
+   const auto& postingsRarest = *std::min_element(postings.begin(),
+                                                  postings.end(),
+                                                  [](const std::pair<TrigramIterator, TrigramIterator>& postings1,
+                                                     const std::pair<TrigramIterator, TrigramIterator>& postings2)
+                                                  {
+                                                     return (postings1.second - postings1.first) < (postings2.second - postings2.first);
+                                                  });
+   std::vector<UINT32> tierSubstring;
+   for (auto it = postingsRarest.first; it != postingsRarest.second; ++it)
+   {
+      const auto index = static_cast<size_t>(*it & kIndexMask);
+      if (!isMatched[index] && _tcsstr(&m_pool[m_offsets[index]], pchQuery))
+      {
+         isMatched[index] = true;
+         tierSubstring.push_back(this->GetRankKey(index));
+      }
+   }
+   if (!rankTier(tierSubstring) || (queryTrigrams.size() < 2))
+   {
+      return matches;  // (a query with only one trigram is found exactly, or not at all)
+   }
+
+   // Look for misspellings: names that contain at least half of the query's trigrams, ranked by
+   // the share of the trigrams in either the name or the query that are in both.
+   std::vector<UINT16> cSharedTrigrams(isMatched.size());
+   std::vector<size_t> sharing;
+   for (const auto& postingsTrigram : postings)
+   {
+      for (auto it = postingsTrigram.first; it != postingsTrigram.second; ++it)
+      {
+         const auto index = static_cast<size_t>(*it & kIndexMask);
+         if (!isMatched[index] && (cSharedTrigrams[index]++ == 0))
+         {
+            sharing.push_back(index);
+         }
+      }
+   }
+   std::vector<UINT64> tierFuzzy;  // (dissimilarity, above the rank key, so that the most similar sort first)
+   for (const auto index : sharing)
+   {
+      const size_t cShared = cSharedTrigrams[index];
+      if ((cShared * 2) >= queryTrigrams.size())
+      {
+         const auto cNameTrigrams = std::max<size_t>(this->GetNameLength(index), 2) - 2;
+         const auto cUnion        = std::max(queryTrigrams.size() + cNameTrigrams, cShared * 2) - cShared;
+         const auto similarity    = static_cast<UINT64>((kSimilarityMax * cShared) / cUnion);
+         tierFuzzy.push_back(((kSimilarityMax - similarity) << 32) | this->GetRankKey(index));
+      }
+   }
+   const auto cTaken = std::min(tierFuzzy.size(), kcMatchesMax - matches.size());
+   std::partial_sort(tierFuzzy.begin(), tierFuzzy.begin() + cTaken, tierFuzzy.end());
+   for (size_t iMatch = 0; iMatch < cTaken; ++iMatch)
+   {
+      matches.push_back(static_cast<size_t>(tierFuzzy[iMatch] & kIndexMask));
+   }
+   return matches;
+}
+
+size_t NameSearchIndex::GetNameLength(size_t index) const
+{
+   return m_offsets[index + 1] - m_offsets[index] - 1;
+}
+
+UINT32 NameSearchIndex::GetRankKey(size_t index) const
+{
+   const auto cchName = std::min<size_t>(this->GetNameLength(index), 0xFFFF);
+   return static_cast<UINT32>((cchName << kcIndexBits) | index);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+
+// An index of the names in a color table, for the popup's typeahead search, which finds the entries
+// whose names match what has been typed so far, ignoring case. Names that start with the query rank
+// first, then names with a word that starts with it, and then names that contain it (if it is at
+// least three characters long). A query that matches too few names in those ways (perhaps because
+// it is misspelled) also finds the names that share most of its trigrams (runs of three characters).
+// Within each of those tiers, shorter names rank first, so a name that is the query ranks first.
+//
+// Prefixes are found by binary search in the start of every word, sorted by the text that follows,
+// and substrings and misspellings are found through the list of the names that contain each trigram,
+// so a query only looks at names that share something with it, however large the table, and it
+// stops looking once it has found enough matches in the better tiers.
+//
+// Like DisplayOrder, each instance records the table version that it was built for,
+// so that the button can tell when it has gone stale and needs to be rebuilt.
+class NameSearchIndex
+{
+public:
+
+   static constexpr size_t kcMatchesMax = 64;  // most matches returned by a query
+
+   // A function that gets the name of the entry at the specified index.
+   using NameGetter = std::function<CString(size_t index)>;
+
+   // Builds the index of the names of the specified number of entries, getting each name once,
+   // in order. (Only the index keeps the names, so that a table whose names are resolved lazily
+   // never holds them all as strings.)
+   NameSearchIndex(size_t cNames, const NameGetter& getName, UINT version);
+
+   // Builds the index of the specified names (one for each entry in the color table).
+   NameSearchIndex(const std::vector<CString>& names, UINT version);
+
+   UINT GetVersion() const;
+
+   // Returns whether no entry has a name, in which case there is nothing to search.
+   bool IsEmpty() const;
+
+   // Returns the indices of the entries whose names match the query, best match first.
+   std::vector<size_t> Find(const CString& strQuery) const;
+
+   // Returns the number of bytes of memory that the index holds, including itself.
+   size_t GetByteSize() const;
+
+private:
+
+   struct WordStart
+   {
+      UINT32 position;  // in the pool
+      UINT32 index;     // of the entry whose name the word is in
+   };
+
+   using TrigramIterator = std::vector<UINT64>::const_iterator;
+
+   // Returns the length of the name of the specified entry.
+   size_t GetNameLength(size_t index) const;
+
+   // Returns a key that ranks the specified entry within its tier: by the length of its name,
+   // and then by its index.
+   UINT32 GetRankKey(size_t index) const;
+
+private:
+   UINT                   m_version;
+   std::vector<TCHAR>     m_pool;        // the names, folded to lowercase, each null-terminated
+   std::vector<UINT32>    m_offsets;     // position in the pool of each entry's name (plus one past the end)
+   std::vector<WordStart> m_wordStarts;  // the start of each word of each name, sorted by what follows it
+   std::vector<UINT64>    m_trigrams;    // each distinct trigram of each name, in the high 48 bits, above
+                                         //   the entry's index, sorted (so that equal trigrams are together)
+};
@@ -0,0 +1,637 @@
+#include "PCH.hpp"
+#include "PaletteFile.hpp"
+#include "DisplayOrder.hpp"
+#include "MemoryUsage.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>                // for offsetof
+#include <cstring>                // for memcpy
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// File Layout
+//////////////////////////////////////////////////
+
+// A range of bytes within the file. Offsets are from the start of the file.
+struct Section
+{
+   UINT64 offset;
+   UINT64 cb;
+};
+
+// The header, which is always at the start of the file. Every section that follows it begins
+// on an 8-byte boundary, so that the arrays within them are naturally aligned when mapped.
+struct Header
+{
+   UINT32  magic;          // kMagic
+   UINT16  versionMajor;   // PaletteFile::kVersionMajor
+   UINT16  versionMinor;   // PaletteFile::kVersionMinor
+   UINT32  cbHeader;       // size of this header (later minor versions may extend it)
+   UINT32  flags;          // kFlag* values, describing which optional sections are present
+   UINT64  cbFile;         // size of the whole file
+   UINT32  cColors;        // number of entries in the color table
+   UINT32  cColumns;       // preferred number of columns, or 0
+   UINT32  sortOrder;      // ColorTableOrder that the display order section was computed for
+   UINT32  checksum;       // CRC-32 of the whole file, computed with this field set to zero
+   Section colors;         // COLORREF[cColors]
+   Section nameOffsets;    // UINT32[cColors + 1]: start of each name in the string pool, in WCHARs
+   Section strings;        // WCHAR[]: the names, each followed by a null terminator
+   Section searchIndex;    // UINT16[cColors]: entry indices, sorted by color and then by index
+   Section sortedIndices;  // UINT16[cColors]: entry index at each display position
+};
+static_assert(sizeof(Header) == 120, "The palette file header has the wrong size.");
+
+constexpr UINT32 kMagic                = 0x50425043;  // "CPBP"
+constexpr UINT32 kFlagHasSearchIndex   = 0x00000001;
+constexpr UINT32 kFlagHasSortedIndices = 0x00000002;
+constexpr size_t kSectionAlignment     = 8;
+
+const Header& HeaderOf(const BYTE* pData)
+{
+   return *reinterpret_cast<const Header*>(pData);
+}
+
+template <typename T>
+const T* SectionData(const BYTE* pData, const Section& section)
+{
+   return reinterpret_cast<const T*>(pData + section.offset);
+}
+
+
+//////////////////////////////////////////////////
+// Checksum
+//////////////////////////////////////////////////
+
+// The standard (IEEE 802.3) CRC-32, as used by zip and PNG. Since the checksum is verified every
+// time that a file is opened, it uses the "slicing-by-8" method, which consumes 8 bytes per step
+// by way of 8 lookup tables (built at compile time): table[0] is the usual bytewise table, and
+// table[k] gives the effect of a byte followed by k zero bytes.
+using Crc32Tables = std::array<std::array<UINT32, 256>, 8>;
+
+constexpr Crc32Tables MakeCrc32Tables()
+{
+   Crc32Tables tables = {};
+   for (UINT32 i = 0; i < 256; ++i)
+   {
+      UINT32 crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+         crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+      }
+      tables[0][i] = crc;
+   }
+   for (size_t k = 1; k < tables.size(); ++k)
+   {
+      for (UINT32 i = 0; i < 256; ++i)
+      {
+         const auto previous = tables[k - 1][i];
+         tables[k][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+      }
+   }
+   return tables;
+}
+
+constexpr Crc32Tables kCrc32Tables = MakeCrc32Tables();
+
+UINT32 UpdateCrc32(UINT32 crc, const BYTE* pData, size_t cbData)
+{
+   const auto& t = kCrc32Tables;
+   for (; cbData >= 8; cbData -= 8, pData += 8)
+   {
+      UINT32 lo;
+      UINT32 hi;
+      std::memcpy(&lo, pData,     sizeof(lo));
+      std::memcpy(&hi, pData + 4, sizeof(hi));
+      lo ^= crc;
+      crc = t[7][ lo        & 0xFF] ^ t[6][(lo >>  8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+          ^ t[3][ hi        & 0xFF] ^ t[2][(hi >>  8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+   }
+   for (; cbData > 0; --cbData, ++pData)
+   {
+      crc = t[0][(crc ^ *pData) & 0xFF] ^ (crc >> 8);
+   }
+   return crc;
+}
+
+UINT32 ComputeChecksum(const BYTE* pData, size_t cbData)
+{
+   constexpr size_t kChecksumOffset        = offsetof(Header, checksum);
+   constexpr BYTE   kZeros[sizeof(UINT32)] = {};
+
+   auto crc = ~UINT32(0);
+   crc = UpdateCrc32(crc, pData,                                   kChecksumOffset);
+   crc = UpdateCrc32(crc, kZeros,                                  sizeof(kZeros));
+   crc = UpdateCrc32(crc, pData + kChecksumOffset + sizeof(kZeros), cbData - kChecksumOffset - sizeof(kZeros));
+   return ~crc;
+}
+
+
+//////////////////////////////////////////////////
+// Validation
+//////////////////////////////////////////////////
+
+bool IsSectionValid(const Header& header, const Section& section, UINT64 cbExpected)
+{
+   return (section.offset >= header.cbHeader)
+       && ((section.offset % kSectionAlignment) == 0)
+       && (section.cb == cbExpected)
+       && (section.offset <= header.cbFile)
+       && (section.cb <= (header.cbFile - section.offset));
+}
+
+bool IsOptionalSectionValid(const Header& header, const Section& section, UINT32 flag, UINT64 cbExpected)
+{
+   return (header.flags & flag) ? IsSectionValid(header, section, cbExpected)
+                                : ((section.offset == 0) && (section.cb == 0));
+}
+
+PaletteFile::Status ValidateContents(const BYTE* pData)
+{
+   const auto& header  = HeaderOf(pData);
+   const auto  cColors = static_cast<size_t>(header.cColors);
+
+   // Colors must be plain RGB values.
+   const auto pColors = SectionData<COLORREF>(pData, header.colors);
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      if ((pColors[i] & 0xFF000000) != 0)
+      {
+         return PaletteFile::Status::Corrupt;
+      }
+   }
+
+   // Each name must lie within the string pool and be followed by a terminator.
+   const auto pOffsets = SectionData<UINT32>(pData, header.nameOffsets);
+   const auto pStrings = SectionData<WCHAR>(pData, header.strings);
+   const auto cchPool  = header.strings.cb / sizeof(WCHAR);
+   if ((pOffsets[0] != 0) || (pOffsets[cColors] != cchPool))
+   {
+      return PaletteFile::Status::Corrupt;
+   }
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      if ((pOffsets[i + 1] <= pOffsets[i]) || (pOffsets[i + 1] > cchPool) || (pStrings[pOffsets[i + 1] - 1] != L'\0'))
+      {
+         return PaletteFile::Status::Corrupt;
+      }
+   }
+
+   // The search index must hold every index, in order of (color, index). Since that ordering is
+   // strict, and every element is in range, the index must also be a permutation of the entries.
+   if (header.flags & kFlagHasSearchIndex)
+   {
+      const auto pIndex = SectionData<UINT16>(pData, header.searchIndex);
+      for (size_t i = 0; i < cColors; ++i)
+      {
+         if (pIndex[i] >= cColors)
+         {
+            return PaletteFile::Status::Corrupt;
+         }
+         if ((i > 0) && !((pColors[pIndex[i - 1]] <  pColors[pIndex[i]]) ||
+                          ((pColors[pIndex[i - 1]] == pColors[pIndex[i]]) && (pIndex[i - 1] < pIndex[i]))))
+         {
+            return PaletteFile::Status::Corrupt;
+         }
+      }
+   }
+
+   // The display order must be a permutation of the entries.
+   if (header.flags & kFlagHasSortedIndices)
+   {
+      const auto        pSorted = SectionData<UINT16>(pData, header.sortedIndices);
+      std::vector<bool> seen(cColors);
+      for (size_t i = 0; i < cColors; ++i)
+      {
+         if ((pSorted[i] >= cColors) || seen[pSorted[i]])
+         {
+            return PaletteFile::Status::Corrupt;
+         }
+         seen[pSorted[i]] = true;
+      }
+   }
+
+   return PaletteFile::Status::Ok;
+}
+
+
+//////////////////////////////////////////////////
+// Serialization
+//////////////////////////////////////////////////
+
+size_t AlignSection(size_t offset)
+{
+   return (offset + (kSectionAlignment - 1)) & ~(kSectionAlignment - 1);
+}
+
+Section AllocateSection(size_t& cbFile, size_t cb)
+{
+   const auto offset = AlignSection(cbFile);
+   cbFile = offset + cb;
+   return Section{ offset, cb };
+}
+
+void SetStatus(PaletteFile::Status* pStatus, PaletteFile::Status status)
+{
+   if (pStatus)
+   {
+      *pStatus = status;
+   }
+}
+
+}  // anonymous namespace
+
+
+/* static */ PaletteFile::WriteOptions PaletteFile::DefaultWriteOptions()
+{
+   WriteOptions options;
+   options.cColumns           = 0;
+   options.includeSearchIndex = true;
+   options.sortOrder          = ColorPickerButton::ColorTableOrder::TableOrder;
+   return options;
+}
+
+/* static */ PaletteFile::Status PaletteFile::Validate(const void* pData, size_t cbData, bool verifyChecksum /* = true */)
+{
+   _ASSERTE(pData || (cbData == 0));
+
+   // Check the magic first, so that data that is too short to be a palette file
+   // (such as a text palette of a few bytes) is reported as not being one at all.
+   const auto pBytes = static_cast<const BYTE*>(pData);
+   UINT32     magic  = 0;
+   if (cbData >= sizeof(magic))
+   {
+      std::memcpy(&magic, pBytes, sizeof(magic));
+   }
+   if (magic != kMagic)
+   {
+      return Status::BadMagic;
+   }
+
+   // Check the header.
+   if (cbData < sizeof(Header))
+   {
+      return Status::Truncated;
+   }
+   const auto& header = HeaderOf(pBytes);
+   if (header.versionMajor != kVersionMajor)
+   {
+      return Status::UnsupportedVersion;
+   }
+   if (header.cbFile > cbData)
+   {
+      return Status::Truncated;
+   }
+   if ((header.cbFile != cbData) || (header.cbHeader < sizeof(Header)) || (header.cbHeader > header.cbFile))
+   {
+      return Status::Corrupt;
+   }
+   if (header.cColors > ColorPickerButton::kcColorTableMax)
+   {
+      return Status::TooManyColors;
+   }
+
+   // Check that each section lies within the file and has the size that it should.
+   const auto cColors = static_cast<UINT64>(header.cColors);
+   if (!IsSectionValid(header, header.colors,      cColors * sizeof(COLORREF))                                        ||
+       !IsSectionValid(header, header.nameOffsets, (cColors + 1) * sizeof(UINT32))                                    ||
+       !IsSectionValid(header, header.strings,     header.strings.cb - (header.strings.cb % sizeof(WCHAR)))           ||
+       !IsOptionalSectionValid(header, header.searchIndex,   kFlagHasSearchIndex,   cColors * sizeof(UINT16))         ||
+       !IsOptionalSectionValid(header, header.sortedIndices, kFlagHasSortedIndices, cColors * sizeof(UINT16)))
+   {
+      return Status::Corrupt;
+   }
+
+   // A display order is only stored for one of the sorted orders, since the table order needs none.
+   if ((header.flags & kFlagHasSortedIndices) &&
+       ((header.sortOrder == static_cast<UINT32>(ColorPickerButton::ColorTableOrder::TableOrder)) ||
+        (header.sortOrder >  static_cast<UINT32>(ColorPickerButton::ColorTableOrder::NearestNeighbor))))
+   {
+      return Status::Corrupt;
+   }
+
+   // Verify the checksum before looking at the contents of the sections, since
+   // a mismatch is a more useful diagnosis than whatever the damage looks like.
+   if (verifyChecksum && (ComputeChecksum(pBytes, cbData) != header.checksum))
+   {
+      return Status::BadChecksum;
+   }
+
+   return ValidateContents(pBytes);
+}
+
+/* static */ std::shared_ptr<const PaletteFile> PaletteFile::FromMemory(const void* pData,
+                                                                        size_t      cbData,
+                                                                        bool        verifyChecksum /* = true */,
+                                                                        Status*     pStatus        /* = nullptr */)
+{
+   const auto status = Validate(pData, cbData, verifyChecksum);
+   SetStatus(pStatus, status);
+   if (status != Status::Ok)
+   {
+      return nullptr;
+   }
+   return std::shared_ptr<const PaletteFile>(new PaletteFile(static_cast<const BYTE*>(pData), cbData, false));
+}
+
+/* static */ std::shared_ptr<const PaletteFile> PaletteFile::Open(LPCTSTR pszPath,
+                                                                  bool    verifyChecksum /* = true */,
+                                                                  Status* pStatus        /* = nullptr */)
+{
+   _ASSERTE(pszPath);
+
+   SetStatus(pStatus, Status::IoError);
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      return nullptr;
+   }
+
+   // Map a view of the whole file. (The view remains valid after the handles to the file and
+   // the mapping are closed, and is only released once it is unmapped.)
+   LARGE_INTEGER cbFile;
+   const BYTE*   pView = nullptr;
+   if (::GetFileSizeEx(hFile, &cbFile) && (cbFile.QuadPart > 0) && (static_cast<ULONGLONG>(cbFile.QuadPart) <= SIZE_MAX))
+   {
+      const auto hMapping = ::CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (hMapping)
+      {
+         pView = static_cast<const BYTE*>(::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+         VERIFY(::CloseHandle(hMapping));
+      }
+   }
+   VERIFY(::CloseHandle(hFile));
+   if (!pView)
+   {
+      return nullptr;
+   }
+
+   const auto cbData = static_cast<size_t>(cbFile.QuadPart);
+   const auto status = Validate(pView, cbData, verifyChecksum);
+   SetStatus(pStatus, status);
+   if (status != Status::Ok)
+   {
+      VERIFY(::UnmapViewOfFile(pView));
+      return nullptr;
+   }
+   return std::shared_ptr<const PaletteFile>(new PaletteFile(pView, cbData, true));
+}
+
+/* static */ std::vector<BYTE> PaletteFile::Serialize(const ColorTable& colorTable, const WriteOptions& options)
+{
+   _ASSERTE(colorTable.size() <= ColorPickerButton::kcColorTableMax);
+
+   const auto cColors = colorTable.size();
+   size_t     cchPool = 0;
+   for (const auto& entry : colorTable)
+   {
+      cchPool += static_cast<size_t>(entry.second.GetLength()) + 1;
+   }
+
+   // Lay out the file.
+   Header header       = {};
+   size_t cbFile       = sizeof(Header);
+   header.magic        = kMagic;
+   header.versionMajor = kVersionMajor;
+   header.versionMinor = kVersionMinor;
+   header.cbHeader     = sizeof(Header);
+   header.cColors      = static_cast<UINT32>(cColors);
+   header.cColumns     = static_cast<UINT32>(options.cColumns);
+   header.sortOrder    = static_cast<UINT32>(ColorPickerButton::ColorTableOrder::TableOrder);
+   header.colors       = AllocateSection(cbFile, cColors * sizeof(COLORREF));
+   header.nameOffsets  = AllocateSection(cbFile, (cColors + 1) * sizeof(UINT32));
+   header.strings      = AllocateSection(cbFile, cchPool * sizeof(WCHAR));
+   if (options.includeSearchIndex)
+   {
+      header.flags      |= kFlagHasSearchIndex;
+      header.searchIndex = AllocateSection(cbFile, cColors * sizeof(UINT16));
+   }
+   if (options.sortOrder != ColorPickerButton::ColorTableOrder::TableOrder)
+   {
+      header.flags        |= kFlagHasSortedIndices;
+      header.sortOrder     = static_cast<UINT32>(options.sortOrder);
+      header.sortedIndices = AllocateSection(cbFile, cColors * sizeof(UINT16));
+   }
+   cbFile        = AlignSection(cbFile);
+   header.cbFile = cbFile;
+
+   // Fill it in.
+   std::vector<BYTE> data(cbFile);
+   const auto        pData    = data.data();
+   const auto        pColors  = reinterpret_cast<COLORREF*>(pData + header.colors.offset);
+   const auto        pOffsets = reinterpret_cast<UINT32*>  (pData + header.nameOffsets.offset);
+   const auto        pStrings = reinterpret_cast<WCHAR*>   (pData + header.strings.offset);
+   UINT32            ichPool  = 0;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      const auto& entry   = colorTable[i];
+      const auto  cchName = static_cast<size_t>(entry.second.GetLength());
+      pColors [i] = entry.first & 0x00FFFFFF;
+      pOffsets[i] = ichPool;
+      std::memcpy(pStrings + ichPool, static_cast<LPCWSTR>(entry.second), cchName * sizeof(WCHAR));
+      ichPool += static_cast<UINT32>(cchName + 1);  // the terminator is already zero
+   }
+   pOffsets[cColors] = ichPool;
+
+   if (header.flags & kFlagHasSearchIndex)
+   {
+      const auto pIndex = reinterpret_cast<UINT16*>(pData + header.searchIndex.offset);
+      for (size_t i = 0; i < cColors; ++i)
+      {
+         pIndex[i] = static_cast<UINT16>(i);
+      }
+      std::sort(pIndex, pIndex + cColors, [pColors](UINT16 i, UINT16 j)
+      {
+         return (pColors[i] < pColors[j]) || ((pColors[i] == pColors[j]) && (i < j));
+      });
+   }
+
+   if (header.flags & kFlagHasSortedIndices)
+   {
+      const std::vector<COLORREF> colors(pColors, pColors + cColors);
+      const DisplayOrder          order(colors, options.sortOrder, 0);
+      const auto                  pSorted = reinterpret_cast<UINT16*>(pData + header.sortedIndices.offset);
+      for (size_t position = 0; position < cColors; ++position)
+      {
+         pSorted[position] = static_cast<UINT16>(order.IndexFromPosition(position));
+      }
+   }
+
+   std::memcpy(pData, &header, sizeof(header));
+   const auto checksum = ComputeChecksum(pData, cbFile);
+   std::memcpy(pData + offsetof(Header, checksum), &checksum, sizeof(checksum));
+   return data;
+}
+
+/* static */ PaletteFile::Status PaletteFile::Write(LPCTSTR             pszPath,
+                                                    const ColorTable&   colorTable,
+                                                    const WriteOptions& options)
+{
+   _ASSERTE(pszPath);
+
+   const auto data  = Serialize(colorTable, options);
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_WRITE,
+                                   0,
+                                   nullptr,
+                                   CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      return Status::IoError;
+   }
+
+   auto   succeeded = true;
+   size_t cbWritten = 0;
+   while (succeeded && (cbWritten < data.size()))
+   {
+      const auto cbChunk = static_cast<DWORD>(std::min<size_t>(data.size() - cbWritten, 64 * 1024 * 1024));
+      DWORD      cbDone  = 0;
+      succeeded  = (::WriteFile(hFile, data.data() + cbWritten, cbChunk, &cbDone, nullptr) != FALSE) && (cbDone == cbChunk);
+      cbWritten += cbDone;
+   }
+   VERIFY(::CloseHandle(hFile));
+   if (!succeeded)
+   {
+      VERIFY(::DeleteFile(pszPath));
+      return Status::IoError;
+   }
+   return Status::Ok;
+}
+
+
+PaletteFile::PaletteFile(const BYTE* pData, size_t cbData, bool isMapped)
+   : m_pData          (pData)
+   , m_cbData         (cbData)
+   , m_isMapped       (isMapped)
+   , m_materializeOnce()
+   , m_colorTable     ()
+   , m_isMaterialized (false)
+{
+   _ASSERTE(Validate(m_pData, m_cbData, false) == Status::Ok);
+}
+
+PaletteFile::~PaletteFile()
+{
+   if (m_isMapped)
+   {
+      VERIFY(::UnmapViewOfFile(m_pData));
+   }
+}
+
+size_t PaletteFile::GetColorCount() const
+{
+   return HeaderOf(m_pData).cColors;
+}
+
+size_t PaletteFile::GetColumnCount() const
+{
+   return HeaderOf(m_pData).cColumns;
+}
+
+const COLORREF* PaletteFile::GetColors() const
+{
+   return SectionData<COLORREF>(m_pData, HeaderOf(m_pData).colors);
+}
+
+COLORREF PaletteFile::GetColor(size_t index) const
+{
+   _ASSERTE(index < this->GetColorCount());
+   return this->GetColors()[index];
+}
+
+LPCWSTR PaletteFile::GetName(size_t index) const
+{
+   _ASSERTE(index < this->GetColorCount());
+   const auto& header = HeaderOf(m_pData);
+   return SectionData<WCHAR>(m_pData, header.strings) + SectionData<UINT32>(m_pData, header.nameOffsets)[index];
+}
+
+size_t PaletteFile::GetNameLength(size_t index) const
+{
+   _ASSERTE(index < this->GetColorCount());
+   const auto pOffsets = SectionData<UINT32>(m_pData, HeaderOf(m_pData).nameOffsets);
+   return pOffsets[index + 1] - pOffsets[index] - 1;
+}
+
+bool PaletteFile::HasSearchIndex() const
+{
+   return (HeaderOf(m_pData).flags & kFlagHasSearchIndex) != 0;
+}
+
+size_t PaletteFile::FindColor(COLORREF clr) const
+{
+   const auto pColors = this->GetColors();
+   const auto cColors = this->GetColorCount();
+   if (this->HasSearchIndex())
+   {
+      const auto pIndex = SectionData<UINT16>(m_pData, HeaderOf(m_pData).searchIndex);
+      const auto it     = std::lower_bound(pIndex, pIndex + cColors, clr, [pColors](UINT16 i, COLORREF value)
+      {
+         return pColors[i] < value;
+      });
+      return ((it != (pIndex + cColors)) && (pColors[*it] == clr)) ? *it : kInvalidIndex;
+   }
+   else
+   {
+      const auto it = std::find(pColors, pColors + cColors, clr);
+      return (it != (pColors + cColors)) ? static_cast<size_t>(it - pColors) : kInvalidIndex;
+   }
+}
+
+ColorPickerButton::ColorTableOrder PaletteFile::GetSortOrder() const
+{
+   const auto& header = HeaderOf(m_pData);
+   return (header.flags & kFlagHasSortedIndices) ? static_cast<ColorPickerButton::ColorTableOrder>(header.sortOrder)
+                                                 : ColorPickerButton::ColorTableOrder::TableOrder;
+}
+
+const UINT16* PaletteFile::GetSortedIndices() const
+{
+   const auto& header = HeaderOf(m_pData);
+   return (header.flags & kFlagHasSortedIndices) ? SectionData<UINT16>(m_pData, header.sortedIndices)
+                                                 : nullptr;
+}
+
+const PaletteFile::ColorTable& PaletteFile::GetColorTable() const
+{
+   std::call_once(m_materializeOnce, [this]
+   {
+      const auto cColors = this->GetColorCount();
+      m_colorTable.resize(cColors);
+      for (size_t i = 0; i < cColors; ++i)
+      {
+         m_colorTable[i].first  = this->GetColor(i);
+         m_colorTable[i].second = CString(this->GetName(i), static_cast<int>(this->GetNameLength(i)));
+      }
+      m_isMaterialized.store(true, std::memory_order_release);
+   });
+   return m_colorTable;
+}
+
+size_t PaletteFile::GetByteSize() const
+{
+   auto cb = sizeof(*this);
+   if (m_isMaterialized.load(std::memory_order_acquire))
+   {
+      cb += GetVectorByteSize(m_colorTable);
+      for (const auto& entry : m_colorTable)
+      {
+         cb += GetStringByteSize(entry.second);
+      }
+   }
+   return cb;
+}
+
+size_t PaletteFile::GetMappedSize() const
+{
+   return m_isMapped ? m_cbData : 0;
+}
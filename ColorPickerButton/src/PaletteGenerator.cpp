@@ -0,0 +1,725 @@
+#include "PCH.hpp"
+#include "PaletteGenerator.hpp"
+#include "ColorPickerButton.hpp"
+#include "ColorSpace.hpp"
+#include <cfloat>                 // for FLT_MAX
+#include <cmath>                  // for sqrt, ceil
+#include <map>
+#include <numeric>                // for iota
+#include <queue>                  // for priority_queue
+#include <random>                 // for mt19937
+#include <ppl.h>                  // for parallel_for, combinable
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>            // for SSE2 intrinsics
+#define PALETTEGENERATOR_USE_SSE2 1
+#endif  // defined(_M_IX86) || defined(_M_X64)
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Histogram
+//////////////////////////////////////////////////
+
+// Pixels are pre-binned into a histogram with 5 bits per channel before any clustering is done.
+// Each bin keeps the sum of the exact colors that fell into it, so the quantization only limits
+// how finely colors can be told apart, not the accuracy of the resulting averages.
+constexpr unsigned kBinBits  = 5;
+constexpr unsigned kBinShift = 8 - kBinBits;
+constexpr size_t   kcBins    = size_t(1) << (kBinBits * 3);
+
+// Work is handed out to the thread pool in chunks of this many samples (or rows).
+constexpr size_t   kcSamplesPerChunk = 64 * 1024;
+constexpr size_t   kcRowsPerBand     = 256;
+
+struct BinTotals
+{
+   UINT64 count;
+   UINT64 r;
+   UINT64 g;
+   UINT64 b;
+};
+
+typedef std::vector<BinTotals> Histogram;
+
+void AccumulatePixel(Histogram& histogram, const RGBQUAD& px)
+{
+   const auto iBin = (static_cast<size_t>(px.rgbRed   >> kBinShift) << (kBinBits * 2))
+                   | (static_cast<size_t>(px.rgbGreen >> kBinShift) <<  kBinBits)
+                   |  static_cast<size_t>(px.rgbBlue  >> kBinShift);
+   auto& bin = histogram[iBin];
+   ++bin.count;
+   bin.r += px.rgbRed;
+   bin.g += px.rgbGreen;
+   bin.b += px.rgbBlue;
+}
+
+// Builds a histogram in parallel: each worker thread accumulates into its own private
+// histogram, and the private histograms are only summed once all of the input has been seen.
+class HistogramBuilder
+{
+public:
+
+   HistogramBuilder()
+      : m_local([] { return Histogram(kcBins, BinTotals()); })
+   { }
+
+   // Accumulates every step-th pixel of a contiguous buffer.
+   void Add(const RGBQUAD* pPixels, size_t cPixels, size_t step)
+   {
+      const auto cSamples = (cPixels + step - 1) / step;
+      const auto cChunks  = (cSamples + kcSamplesPerChunk - 1) / kcSamplesPerChunk;
+      concurrency::parallel_for(size_t(0), cChunks, [&](size_t iChunk)
+      {
+         auto&      histogram = m_local.local();
+         const auto iBegin    = iChunk * kcSamplesPerChunk;
+         const auto iEnd      = std::min(iBegin + kcSamplesPerChunk, cSamples);
+         for (auto i = iBegin; i < iEnd; ++i)
+         {
+            AccumulatePixel(histogram, pPixels[i * step]);
+         }
+      });
+   }
+
+   // Accumulates every step-th pixel of each of the specified rows.
+   void AddRows(const RGBQUAD* pRows, size_t cx, size_t cRows, size_t step)
+   {
+      concurrency::parallel_for(size_t(0), cRows, [&](size_t iRow)
+      {
+         auto&      histogram = m_local.local();
+         const auto pRow      = pRows + (iRow * cx);
+         for (size_t x = 0; x < cx; x += step)
+         {
+            AccumulatePixel(histogram, pRow[x]);
+         }
+      });
+   }
+
+   Histogram Finish()
+   {
+      Histogram result(kcBins, BinTotals());
+      m_local.combine_each([&result](const Histogram& histogram)
+      {
+         for (size_t i = 0; i < kcBins; ++i)
+         {
+            result[i].count += histogram[i].count;
+            result[i].r     += histogram[i].r;
+            result[i].g     += histogram[i].g;
+            result[i].b     += histogram[i].b;
+         }
+      });
+      return result;
+   }
+
+private:
+   concurrency::combinable<Histogram> m_local;
+};
+
+//////////////////////////////////////////////////
+// Weighted Points and Centroids
+//////////////////////////////////////////////////
+
+// The populated histogram bins, converted to OKLab and weighted by their pixel counts.
+// (Stored as a structure of arrays, so that the hot loops touch only what they need.)
+struct WeightedPoints
+{
+   std::vector<float> L;
+   std::vector<float> a;
+   std::vector<float> b;
+   std::vector<float> w;
+
+   size_t size() const { return w.size(); }
+
+   ColorSpace::Lab At(size_t i) const { return ColorSpace::Lab{ L[i], a[i], b[i] }; }
+};
+
+WeightedPoints PointsFromHistogram(const Histogram& histogram)
+{
+   WeightedPoints points;
+   for (const auto& bin : histogram)
+   {
+      if (bin.count > 0)
+      {
+         const auto half = bin.count / 2;
+         const auto lab  = ColorSpace::ToOKLab(static_cast<BYTE>((bin.r + half) / bin.count),
+                                               static_cast<BYTE>((bin.g + half) / bin.count),
+                                               static_cast<BYTE>((bin.b + half) / bin.count));
+         points.L.push_back(lab.L);
+         points.a.push_back(lab.a);
+         points.b.push_back(lab.b);
+         points.w.push_back(static_cast<float>(bin.count));
+      }
+   }
+   return points;
+}
+
+// Cluster centers, stored as a structure of arrays that is padded out to a multiple of 4
+// so that distances can be evaluated against 4 centers at a time. The padding lanes hold
+// a coordinate so far away from the gamut that they can never be the nearest center.
+class Centroids
+{
+public:
+
+   explicit Centroids(const std::vector<ColorSpace::Lab>& centers)
+      : m_cCenters(centers.size())
+      , m_L       (((centers.size() + 3) / 4) * 4, kFar)
+      , m_a       (m_L.size(), kFar)
+      , m_b       (m_L.size(), kFar)
+   {
+      for (size_t i = 0; i < m_cCenters; ++i)
+      {
+         this->Set(i, centers[i]);
+      }
+   }
+
+   size_t size() const { return m_cCenters; }
+
+   ColorSpace::Lab Get(size_t i) const { return ColorSpace::Lab{ m_L[i], m_a[i], m_b[i] }; }
+
+   void Set(size_t i, const ColorSpace::Lab& lab)
+   {
+      m_L[i] = lab.L;
+      m_a[i] = lab.a;
+      m_b[i] = lab.b;
+   }
+
+   // Returns the index of the center closest to the specified color.
+   // (Ties are broken in favor of the lower index.)
+   size_t FindNearest(const ColorSpace::Lab& lab) const
+   {
+#ifdef PALETTEGENERATOR_USE_SSE2
+      const auto vL        = _mm_set1_ps(lab.L);
+      const auto va        = _mm_set1_ps(lab.a);
+      const auto vb        = _mm_set1_ps(lab.b);
+      const auto vFour     = _mm_set1_epi32(4);
+      auto       vIndex    = _mm_setr_epi32(0, 1, 2, 3);
+      auto       vBestDist = _mm_set1_ps(FLT_MAX);
+      auto       vBestIdx  = _mm_setzero_si128();
+      for (size_t i = 0; i < m_L.size(); i += 4)
+      {
+         const auto dL    = _mm_sub_ps(_mm_loadu_ps(&m_L[i]), vL);
+         const auto da    = _mm_sub_ps(_mm_loadu_ps(&m_a[i]), va);
+         const auto db    = _mm_sub_ps(_mm_loadu_ps(&m_b[i]), vb);
+         const auto vDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dL, dL),
+                                                  _mm_mul_ps(da, da)),
+                                       _mm_mul_ps(db, db));
+         const auto vLess = _mm_castps_si128(_mm_cmplt_ps(vDist, vBestDist));
+         vBestDist = _mm_min_ps(vDist, vBestDist);
+         vBestIdx  = _mm_or_si128(_mm_and_si128   (vLess, vIndex),
+                                  _mm_andnot_si128(vLess, vBestIdx));
+         vIndex    = _mm_add_epi32(vIndex, vFour);
+      }
+
+      // Reduce the 4 lanes down to a single result.
+      alignas(16) float   dists  [4];
+      alignas(16) INT32   indices[4];
+      _mm_store_ps   (dists, vBestDist);
+      _mm_store_si128(reinterpret_cast<__m128i*>(indices), vBestIdx);
+      size_t iBest = 0;
+      for (size_t lane = 1; lane < 4; ++lane)
+      {
+         if ((dists[lane] < dists[iBest]) ||
+             ((dists[lane] == dists[iBest]) && (indices[lane] < indices[iBest])))
+         {
+            iBest = lane;
+         }
+      }
+      return static_cast<size_t>(indices[iBest]);
+#else
+      auto   bestDist = FLT_MAX;
+      size_t iBest    = 0;
+      for (size_t i = 0; i < m_cCenters; ++i)
+      {
+         const auto dist = ColorSpace::DistanceSquared(lab, this->Get(i));
+         if (dist < bestDist)
+         {
+            bestDist = dist;
+            iBest    = i;
+         }
+      }
+      return iBest;
+#endif  // PALETTEGENERATOR_USE_SSE2
+   }
+
+private:
+   static constexpr float kFar = 1.0e6f;
+
+   size_t             m_cCenters;
+   std::vector<float> m_L;
+   std::vector<float> m_a;
+   std::vector<float> m_b;
+};
+
+//////////////////////////////////////////////////
+// Seeding
+//////////////////////////////////////////////////
+
+struct MedianCutBox
+{
+   size_t          iBegin;  // \ range of indices into the
+   size_t          iEnd;    // /   ordering of the points
+   ColorSpace::Lab mean;
+   double          error;   // total weighted squared error
+   int             axis;    // axis with the greatest spread (0 = L, 1 = a, 2 = b)
+
+   bool operator<(const MedianCutBox& other) const { return (error < other.error); }
+};
+
+MedianCutBox MeasureBox(const WeightedPoints& points, const std::vector<UINT32>& order, size_t iBegin, size_t iEnd)
+{
+   double sumW = 0.0;
+   double sum  [3] = { };
+   double sumSq[3] = { };
+   for (auto i = iBegin; i < iEnd; ++i)
+   {
+      const auto   iPoint = order[i];
+      const double w      = points.w[iPoint];
+      const double v[3]   = { points.L[iPoint], points.a[iPoint], points.b[iPoint] };
+      sumW += w;
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         sum  [axis] += w * v[axis];
+         sumSq[axis] += w * v[axis] * v[axis];
+      }
+   }
+
+   MedianCutBox box;
+   box.iBegin = iBegin;
+   box.iEnd   = iEnd;
+   box.error  = 0.0;
+   box.axis   = 0;
+   double mean [3];
+   double worst = -1.0;
+   for (int axis = 0; axis < 3; ++axis)
+   {
+      mean[axis] = sum[axis] / sumW;
+      const auto error = std::max(0.0, sumSq[axis] - (sum[axis] * mean[axis]));
+      box.error += error;
+      if (error > worst)
+      {
+         worst    = error;
+         box.axis = axis;
+      }
+   }
+   box.mean = ColorSpace::Lab{ static_cast<float>(mean[0]),
+                               static_cast<float>(mean[1]),
+                               static_cast<float>(mean[2]) };
+   return box;
+}
+
+std::vector<ColorSpace::Lab> SeedMedianCut(const WeightedPoints& points, size_t cColors)
+{
+   std::vector<UINT32> order(points.size());
+   std::iota(order.begin(), order.end(), 0);
+
+   std::vector<MedianCutBox>         finished;
+   std::priority_queue<MedianCutBox> pending;
+   pending.push(MeasureBox(points, order, 0, order.size()));
+   while (!pending.empty() && ((pending.size() + finished.size()) < cColors))
+   {
+      const auto box = pending.top();
+      pending.pop();
+      if (((box.iEnd - box.iBegin) < 2) || (box.error <= 0.0))
+      {
+         finished.push_back(box);
+         continue;
+      }
+
+      // Sort the box's points along its widest axis, then split it at the weighted median.
+      const auto& coordinate = (box.axis == 0) ? points.L
+                             : (box.axis == 1) ? points.a
+                                               : points.b;
+      std::sort(order.begin() + box.iBegin,
+                order.begin() + box.iEnd,
+                [&coordinate](UINT32 x, UINT32 y) { return coordinate[x] < coordinate[y]; });
+
+      double total = 0.0;
+      for (auto i = box.iBegin; i < box.iEnd; ++i)
+      {
+         total += points.w[order[i]];
+      }
+      auto   iSplit  = box.iBegin;
+      double running = 0.0;
+      while ((iSplit < (box.iEnd - 1)) && ((running + points.w[order[iSplit]]) <= (total / 2.0)))
+      {
+         running += points.w[order[iSplit]];
+         ++iSplit;
+      }
+      iSplit = std::max(iSplit, box.iBegin + 1);  // both halves must be non-empty
+
+      pending.push(MeasureBox(points, order, box.iBegin, iSplit));
+      pending.push(MeasureBox(points, order, iSplit,     box.iEnd));
+   }
+
+   std::vector<ColorSpace::Lab> centers;
+   centers.reserve(pending.size() + finished.size());
+   for (const auto& box : finished)
+   {
+      centers.push_back(box.mean);
+   }
+   for (; !pending.empty(); pending.pop())
+   {
+      centers.push_back(pending.top().mean);
+   }
+   return centers;
+}
+
+std::vector<ColorSpace::Lab> SeedKMeansPlusPlus(const WeightedPoints& points, size_t cColors)
+{
+   const auto                             cPoints = points.size();
+   std::mt19937                           rng(0x5EED);  // fixed, so that the results are reproducible
+   std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+   // Picks a point with probability proportional to its weight times the specified factor.
+   const auto pick = [&](const std::vector<float>& factor) -> size_t
+   {
+      double total = 0.0;
+      for (size_t i = 0; i < cPoints; ++i)
+      {
+         total += static_cast<double>(points.w[i]) * factor[i];
+      }
+      auto target = uniform(rng) * total;
+      for (size_t i = 0; i < cPoints; ++i)
+      {
+         target -= static_cast<double>(points.w[i]) * factor[i];
+         if (target <= 0.0)
+         {
+            return i;
+         }
+      }
+      return (cPoints - 1);
+   };
+
+   std::vector<ColorSpace::Lab> centers;
+   std::vector<float>           distances(cPoints, 1.0f);  // uniform factor for the first pick
+   while (centers.size() < cColors)
+   {
+      const auto iCenter = pick(distances);
+      const auto center  = points.At(iCenter);
+      centers.push_back(center);
+
+      // Update each point's squared distance to its closest center.
+      const auto first = (centers.size() == 1);
+      concurrency::parallel_for(size_t(0), cPoints, kcSamplesPerChunk / 16, [&](size_t iBegin)
+      {
+         const auto iEnd = std::min(iBegin + (kcSamplesPerChunk / 16), cPoints);
+         for (auto i = iBegin; i < iEnd; ++i)
+         {
+            const auto dist = ColorSpace::DistanceSquared(points.At(i), center);
+            distances[i]    = first ? dist : std::min(distances[i], dist);
+         }
+      });
+
+      // If every remaining point coincides with a center, no more useful centers can be chosen.
+      if (std::all_of(distances.begin(), distances.end(), [](float d) { return (d <= 0.0f); }))
+      {
+         break;
+      }
+   }
+   return centers;
+}
+
+//////////////////////////////////////////////////
+// Refinement
+//////////////////////////////////////////////////
+
+struct ClusterTotals
+{
+   double L;
+   double a;
+   double b;
+   double w;
+};
+
+// Runs weighted k-means (Lloyd's algorithm), in which each pass assigns every point to its nearest
+// center in parallel and then moves each center to the mean of the points assigned to it.
+// Returns the total weight (population) of each cluster after the final assignment pass.
+std::vector<double> RefineKMeans(const WeightedPoints& points, Centroids& centroids, unsigned cIterations)
+{
+   const auto          cPoints   = points.size();
+   const auto          cClusters = centroids.size();
+   const auto          cPerChunk = kcSamplesPerChunk / 16;
+   std::vector<UINT32> assignments(cPoints, UINT32_MAX);
+   for (unsigned pass = 0; ; ++pass)
+   {
+      concurrency::combinable<std::vector<ClusterTotals>> partials([cClusters]
+      {
+         return std::vector<ClusterTotals>(cClusters, ClusterTotals());
+      });
+      concurrency::combinable<size_t> changes;
+      concurrency::parallel_for(size_t(0), cPoints, cPerChunk, [&](size_t iBegin)
+      {
+         auto&      totals = partials.local();
+         auto&      moved  = changes.local();
+         const auto iEnd   = std::min(iBegin + cPerChunk, cPoints);
+         for (auto i = iBegin; i < iEnd; ++i)
+         {
+            const auto lab      = points.At(i);
+            const auto iCluster = static_cast<UINT32>(centroids.FindNearest(lab));
+            if (assignments[i] != iCluster)
+            {
+               assignments[i] = iCluster;
+               ++moved;
+            }
+            const double w = points.w[i];
+            totals[iCluster].L += w * lab.L;
+            totals[iCluster].a += w * lab.a;
+            totals[iCluster].b += w * lab.b;
+            totals[iCluster].w += w;
+         }
+      });
+
+      std::vector<ClusterTotals> totals(cClusters, ClusterTotals());
+      partials.combine_each([&totals](const std::vector<ClusterTotals>& partial)
+      {
+         for (size_t i = 0; i < totals.size(); ++i)
+         {
+            totals[i].L += partial[i].L;
+            totals[i].a += partial[i].a;
+            totals[i].b += partial[i].b;
+            totals[i].w += partial[i].w;
+         }
+      });
+      const auto cChanges = changes.combine([](size_t x, size_t y) { return (x + y); });
+
+      if ((pass >= cIterations) || (cChanges == 0))
+      {
+         std::vector<double> population(cClusters);
+         for (size_t i = 0; i < cClusters; ++i)
+         {
+            population[i] = totals[i].w;
+         }
+         return population;
+      }
+
+      // Move each center to the mean of its cluster. (Empty clusters keep their old center.)
+      for (size_t i = 0; i < cClusters; ++i)
+      {
+         if (totals[i].w > 0.0)
+         {
+            centroids.Set(i, ColorSpace::Lab{ static_cast<float>(totals[i].L / totals[i].w),
+                                              static_cast<float>(totals[i].a / totals[i].w),
+                                              static_cast<float>(totals[i].b / totals[i].w) });
+         }
+      }
+   }
+}
+
+//////////////////////////////////////////////////
+// Naming
+//////////////////////////////////////////////////
+
+struct HueName
+{
+   float        hueMax;  // exclusive upper bound of the hue range, in degrees
+   const TCHAR* pszName;
+};
+
+// Hue ranges (in OKLab hue angle) for the names used by the default color table.
+constexpr HueName kHueNames[] =
+{
+   {  15.0f, TEXT("Rose")      },
+   {  45.0f, TEXT("Red")       },
+   {  80.0f, TEXT("Orange")    },
+   { 120.0f, TEXT("Yellow")    },
+   { 135.0f, TEXT("Lime")      },
+   { 165.0f, TEXT("Green")     },
+   { 190.0f, TEXT("Teal")      },
+   { 215.0f, TEXT("Turquoise") },
+   { 250.0f, TEXT("Sky Blue")  },
+   { 280.0f, TEXT("Blue")      },
+   { 305.0f, TEXT("Purple")    },
+   { 340.0f, TEXT("Magenta")   },
+   { 360.0f, TEXT("Rose")      },
+};
+
+constexpr float kGrayChromaMax = 0.03f;
+
+// Generates a short, human-readable description of a color, in the style of the default color table.
+CString DescribeColor(COLORREF clr)
+{
+   const auto lab    = ColorSpace::ToOKLab(clr);
+   const auto chroma = ColorSpace::Chroma(lab);
+   CString    name;
+   if (chroma < kGrayChromaMax)
+   {
+      const auto sum      = GetRValue(clr) + GetGValue(clr) + GetBValue(clr);
+      const auto darkness = 100 - (((sum * 100) + ((3 * 255) / 2)) / (3 * 255));
+      if (darkness <= 0)
+      {
+         name = TEXT("White");
+      }
+      else if (darkness >= 100)
+      {
+         name = TEXT("Black");
+      }
+      else
+      {
+         name.Format(TEXT("%d%% Gray"), darkness);
+      }
+      return name;
+   }
+
+   const auto hue = ColorSpace::Hue(lab);
+   if ((hue >= 45.0f) && (hue < 80.0f) && (lab.L < 0.5f))
+   {
+      return TEXT("Brown");
+   }
+   if ((hue >= 80.0f) && (hue < 135.0f) && (lab.L < 0.55f))
+   {
+      return TEXT("Olive");
+   }
+
+   const TCHAR* pszHue = kHueNames[ARRAYSIZE(kHueNames) - 1].pszName;
+   for (const auto& hueName : kHueNames)
+   {
+      if (hue < hueName.hueMax)
+      {
+         pszHue = hueName.pszName;
+         break;
+      }
+   }
+   if (lab.L < 0.4f)
+   {
+      name = TEXT("Dark ");
+   }
+   else if (lab.L > 0.75f)
+   {
+      name = (chroma < 0.08f) ? TEXT("Pale ") : TEXT("Light ");
+   }
+   name += pszHue;
+   return name;
+}
+
+//////////////////////////////////////////////////
+// Driver
+//////////////////////////////////////////////////
+
+std::vector<std::pair<COLORREF, CString>> GeneratePalette(const Histogram&                 histogram,
+                                                          const PaletteGenerator::Options& options)
+{
+   const auto points  = PointsFromHistogram(histogram);
+   const auto cColors = std::min({ options.cColors, points.size(), ColorPickerButton::kcColorTableMax });
+   if (cColors == 0)
+   {
+      return { };
+   }
+
+   Centroids  centroids((options.seeding == PaletteGenerator::Seeding::KMeansPlusPlus)
+                        ? SeedKMeansPlusPlus(points, cColors)
+                        : SeedMedianCut     (points, cColors));
+   const auto population = RefineKMeans(points, centroids, options.cIterations);
+
+   // Order the clusters from most to least populous, dropping any that ended up empty.
+   std::vector<size_t> order;
+   for (size_t i = 0; i < centroids.size(); ++i)
+   {
+      if (population[i] > 0.0)
+      {
+         order.push_back(i);
+      }
+   }
+   std::stable_sort(order.begin(), order.end(), [&population](size_t x, size_t y)
+   {
+      return (population[x] > population[y]);
+   });
+
+   // Convert back to sRGB, merging any clusters whose centers round to the same color,
+   // and give each color a unique name.
+   std::vector<std::pair<COLORREF, CString>> colorTable;
+   std::vector<COLORREF>                     seen;
+   std::map<CString, unsigned>               nameCounts;
+   for (const auto i : order)
+   {
+      const auto clr = ColorSpace::FromOKLab(centroids.Get(i));
+      if (std::find(seen.begin(), seen.end(), clr) != seen.end())
+      {
+         continue;
+      }
+      seen.push_back(clr);
+
+      auto       name  = DescribeColor(clr);
+      const auto count = ++nameCounts[name];
+      if (count > 1)
+      {
+         name.AppendFormat(TEXT(" %u"), count);
+      }
+      colorTable.emplace_back(clr, std::move(name));
+   }
+   return colorTable;
+}
+
+}  // anonymous namespace
+
+/* static */ PaletteGenerator::Options PaletteGenerator::DefaultOptions(size_t cColors /* = kcColorsDefault */)
+{
+   Options options;
+   options.cColors     = cColors;
+   options.seeding     = Seeding::MedianCut;
+   options.cIterations = kcIterationsDefault;
+   options.cSamplesMax = kcSamplesMaxDefault;
+   return options;
+}
+
+/* static */ std::vector<std::pair<COLORREF, CString>> PaletteGenerator::FromPixels(const RGBQUAD* pPixels,
+                                                                                  size_t         cPixels,
+                                                                                  const Options& options)
+{
+   _ASSERTE(pPixels || (cPixels == 0));
+
+   const auto       cSamplesMax = std::max(options.cSamplesMax, size_t(1));
+   const auto       step        = (cPixels + cSamplesMax - 1) / cSamplesMax;
+   HistogramBuilder builder;
+   builder.Add(pPixels, cPixels, std::max(step, size_t(1)));
+   return GeneratePalette(builder.Finish(), options);
+}
+
+/* static */ std::vector<std::pair<COLORREF, CString>> PaletteGenerator::FromBitmap(HBITMAP        hBitmap,
+                                                                                  const Options& options)
+{
+   BITMAP bm;
+   if (!hBitmap || (::GetObject(hBitmap, sizeof(bm), &bm) == 0) || (bm.bmWidth <= 0) || (bm.bmHeight == 0))
+   {
+      return { };
+   }
+   const auto cx = static_cast<size_t>(bm.bmWidth);
+   const auto cy = static_cast<size_t>(std::abs(bm.bmHeight));
+
+   // Sample a regular lattice of rows and columns, so that only the sampled scan lines
+   // ever have to be retrieved (and converted) from the bitmap.
+   const auto cSamplesMax = std::max(options.cSamplesMax, size_t(1));
+   const auto step        = std::max(static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(cx * cy) /
+                                                                              static_cast<double>(cSamplesMax)))),
+                                     size_t(1));
+
+   BITMAPINFO bmi              = { };
+   bmi.bmiHeader.biSize        = sizeof(bmi.bmiHeader);
+   bmi.bmiHeader.biWidth       = bm.bmWidth;
+   bmi.bmiHeader.biHeight      = static_cast<LONG>(cy);
+   bmi.bmiHeader.biPlanes      = 1;
+   bmi.bmiHeader.biBitCount    = 32;
+   bmi.bmiHeader.biCompression = BI_RGB;
+
+   const auto           hDC = ::GetDC(NULL);
+   HistogramBuilder     builder;
+   std::vector<RGBQUAD> band(cx * kcRowsPerBand);
+   auto                 succeeded = true;
+   for (size_t y = 0; (y < cy) && succeeded; )
+   {
+      size_t cRows = 0;
+      for (; (cRows < kcRowsPerBand) && (y < cy); ++cRows, y += step)
+      {
+         if (::GetDIBits(hDC, hBitmap, static_cast<UINT>(y), 1, &band[cRows * cx], &bmi, DIB_RGB_COLORS) != 1)
+         {
+            succeeded = false;
+            break;
+         }
+      }
+      builder.AddRows(band.data(), cx, cRows, step);
+   }
+   VERIFY(::ReleaseDC(NULL, hDC) == 1);
+
+   return succeeded ? GeneratePalette(builder.Finish(), options)
+                    : std::vector<std::pair<COLORREF, CString>>();
+}
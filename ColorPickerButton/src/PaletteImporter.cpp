@@ -0,0 +1,1097 @@
+#include "PCH.hpp"
+#include "PaletteImporter.hpp"
+#include "ColorPickerButton.hpp"
+#include "ColorSpace.hpp"
+#include <algorithm>
+#include <cmath>                  // for isfinite, lround
+#include <cstring>                // for memcmp, memcpy, strlen
+
+
+namespace {
+
+// Where the parser is within the structure of its format.
+enum Stage : int
+{
+   kStageDetect,        // waiting for enough input to detect the format
+
+   kStageGplHeader,     // expecting the "GIMP Palette" line
+   kStageGplBody,       // expecting attributes, comments, and entries
+
+   kStageJascHeader,    // expecting the "JASC-PAL" line
+   kStageJascVersion,   // expecting the version line
+   kStageJascCount,     // expecting the number of entries
+   kStageJascEntries,   // expecting entries (m_cRemaining of them)
+   kStageJascEnd,       // expecting nothing more
+
+   kStageAcoHeader,     // expecting the header of a version 1 or version 2 section
+   kStageAcoEntries,    // expecting entries (m_cRemaining of them)
+   kStageAcoEnd,        // expecting nothing more
+
+   kStageAseHeader,     // expecting the file header
+   kStageAseBlocks,     // expecting blocks (m_cRemaining of them)
+   kStageAseSkip,       // within a block that is being skipped (m_cbSkip bytes remain)
+   kStageAseEnd,        // expecting nothing more
+};
+
+// Lines in text formats, and records in binary formats, are held back until they are complete.
+// These limits bound how much can be held back, so that malformed input cannot make it grow forever.
+constexpr size_t kcbLineMax     = 64 * 1024;
+constexpr size_t kcchNameMax    = 0xFFFF;
+constexpr size_t kcbAseBlockMax = 2 + (kcchNameMax * sizeof(UINT16)) + 4 + (4 * sizeof(float)) + 2;
+
+constexpr size_t kcbDetect      = 16;         // enough to see any of the signatures (after a byte order mark)
+constexpr DWORD  kcbReadChunk   = 64 * 1024;
+
+constexpr UINT16 kAseBlockColor = 0x0001;     // other block types (such as groups) are skipped
+
+Stage InitialStage(PaletteImporter::Format format)
+{
+   switch (format)
+   {
+      case PaletteImporter::Format::Gpl:     return kStageGplHeader;
+      case PaletteImporter::Format::Aco:     return kStageAcoHeader;
+      case PaletteImporter::Format::Ase:     return kStageAseHeader;
+      case PaletteImporter::Format::JascPal: return kStageJascHeader;
+      default:                               return kStageDetect;
+   }
+}
+
+
+//////////////////////////////////////////////////
+// Input
+//////////////////////////////////////////////////
+
+// Both of the Adobe formats are big-endian, and store names as UTF-16.
+UINT16 ReadBE16(const BYTE* pData)
+{
+   return static_cast<UINT16>((pData[0] << 8) | pData[1]);
+}
+
+UINT32 ReadBE32(const BYTE* pData)
+{
+   return (static_cast<UINT32>(pData[0]) << 24)
+        | (static_cast<UINT32>(pData[1]) << 16)
+        | (static_cast<UINT32>(pData[2]) <<  8)
+        |  static_cast<UINT32>(pData[3]);
+}
+
+float ReadBEFloat(const BYTE* pData)
+{
+   const auto bits  = ReadBE32(pData);
+   float      value;
+   std::memcpy(&value, &bits, sizeof(value));
+   return value;
+}
+
+bool IsSpace(char ch)
+{
+   return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\v') || (ch == '\f');
+}
+
+void SkipSpaces(const char*& pch, size_t& cch)
+{
+   while ((cch > 0) && IsSpace(*pch))
+   {
+      ++pch;
+      --cch;
+   }
+}
+
+void TrimSpaces(const char*& pch, size_t& cch)
+{
+   SkipSpaces(pch, cch);
+   while ((cch > 0) && IsSpace(pch[cch - 1]))
+   {
+      --cch;
+   }
+}
+
+bool StartsWith(const char* pch, size_t cch, const char* pszPrefix)
+{
+   const auto cchPrefix = std::strlen(pszPrefix);
+   return (cch >= cchPrefix) && (std::memcmp(pch, pszPrefix, cchPrefix) == 0);
+}
+
+bool Equals(const char* pch, size_t cch, const char* psz)
+{
+   return (cch == std::strlen(psz)) && (std::memcmp(pch, psz, cch) == 0);
+}
+
+// Parses a decimal integer (no larger than the specified maximum) from the start of a line,
+// skipping any whitespace before it, and advancing past it. The integer must be followed by
+// whitespace or by the end of the line.
+bool ParseInteger(const char*& pch, size_t& cch, UINT32 maximum, UINT32* pValue)
+{
+   SkipSpaces(pch, cch);
+   UINT64 value   = 0;
+   size_t cDigits = 0;
+   while ((cch > 0) && (*pch >= '0') && (*pch <= '9'))
+   {
+      value = (value * 10) + static_cast<UINT64>(*pch - '0');
+      if (value > maximum)
+      {
+         return false;
+      }
+      ++pch;
+      --cch;
+      ++cDigits;
+   }
+   *pValue = static_cast<UINT32>(value);
+   return (cDigits > 0) && ((cch == 0) || IsSpace(*pch));
+}
+
+bool ParseRGB(const char*& pch, size_t& cch, COLORREF* pclr)
+{
+   UINT32 r, g, b;
+   if (!ParseInteger(pch, cch, 255, &r) ||
+       !ParseInteger(pch, cch, 255, &g) ||
+       !ParseInteger(pch, cch, 255, &b))
+   {
+      return false;
+   }
+   *pclr = RGB(r, g, b);
+   return true;
+}
+
+
+//////////////////////////////////////////////////
+// Color Models
+//////////////////////////////////////////////////
+
+// Converts a fraction in [0, 1] to a byte, clamping values (including NaNs) that are out of range.
+BYTE ByteFromUnit(double value)
+{
+   if (!(value > 0.0))
+   {
+      return 0;
+   }
+   if (value >= 1.0)
+   {
+      return 255;
+   }
+   return static_cast<BYTE>(std::lround(value * 255.0));
+}
+
+double Clamp(double value)
+{
+   return (value > 0.0) ? ((value < 1.0) ? value : 1.0) : 0.0;
+}
+
+// The naive conversion, which is all that can be done without the color profile
+// that the colors were specified for. (All components are amounts of ink, in [0, 1].)
+COLORREF FromCMYK(double c, double m, double y, double k)
+{
+   const auto white = 1.0 - Clamp(k);
+   return RGB(ByteFromUnit((1.0 - Clamp(c)) * white),
+              ByteFromUnit((1.0 - Clamp(m)) * white),
+              ByteFromUnit((1.0 - Clamp(y)) * white));
+}
+
+// Converts a color from HSB (also known as HSV). All components are in [0, 1].
+COLORREF FromHSB(double h, double s, double v)
+{
+   const auto sector = Clamp(h) * 6.0;
+   const auto i      = std::min(static_cast<int>(sector), 5);
+   const auto f      = sector - i;
+   const auto p      = v * (1.0 - s);
+   const auto q      = v * (1.0 - (s * f));
+   const auto t      = v * (1.0 - (s * (1.0 - f)));
+   switch (i)
+   {
+      case 0:  return RGB(ByteFromUnit(v), ByteFromUnit(t), ByteFromUnit(p));
+      case 1:  return RGB(ByteFromUnit(q), ByteFromUnit(v), ByteFromUnit(p));
+      case 2:  return RGB(ByteFromUnit(p), ByteFromUnit(v), ByteFromUnit(t));
+      case 3:  return RGB(ByteFromUnit(p), ByteFromUnit(q), ByteFromUnit(v));
+      case 4:  return RGB(ByteFromUnit(t), ByteFromUnit(p), ByteFromUnit(v));
+      default: return RGB(ByteFromUnit(v), ByteFromUnit(p), ByteFromUnit(q));
+   }
+}
+
+// Converts the color in an .aco record (a color space ID followed by four 16-bit components).
+// Returns false if the color is in a color space that cannot be converted (that is, a spot color library).
+bool ColorFromAco(const BYTE* pRecord, COLORREF* pclr)
+{
+   const auto w = ReadBE16(pRecord + 2);
+   const auto x = ReadBE16(pRecord + 4);
+   const auto y = ReadBE16(pRecord + 6);
+   const auto z = ReadBE16(pRecord + 8);
+   switch (ReadBE16(pRecord))
+   {
+      case 0:  // RGB, [0, 65535]
+         *pclr = RGB(ByteFromUnit(w / 65535.0), ByteFromUnit(x / 65535.0), ByteFromUnit(y / 65535.0));
+         return true;
+      case 1:  // HSB, [0, 65535]
+         *pclr = FromHSB(w / 65536.0, x / 65535.0, y / 65535.0);
+         return true;
+      case 2:  // CMYK, [0, 65535], where 0 is full ink
+         *pclr = FromCMYK(1.0 - (w / 65535.0), 1.0 - (x / 65535.0), 1.0 - (y / 65535.0), 1.0 - (z / 65535.0));
+         return true;
+      case 7:  // Lab, with L in [0, 10000], and a and b signed in [-12800, 12700]
+         *pclr = ColorSpace::FromCIELab(w / 100.0f,
+                                        static_cast<INT16>(x) / 100.0f,
+                                        static_cast<INT16>(y) / 100.0f);
+         return true;
+      case 8:  // grayscale, [0, 10000], where 10000 is full ink
+      {
+         const auto gray = ByteFromUnit(1.0 - (w / 10000.0));
+         *pclr = RGB(gray, gray, gray);
+         return true;
+      }
+      case 9:  // wide CMYK, [0, 10000], where 10000 is full ink
+         *pclr = FromCMYK(w / 10000.0, x / 10000.0, y / 10000.0, z / 10000.0);
+         return true;
+      default:
+         return false;
+   }
+}
+
+}  // anonymous namespace
+
+/* static */ PaletteImporter::Format PaletteImporter::DetectFormat(const void* pData, size_t cbData)
+{
+   _ASSERTE(pData || (cbData == 0));
+
+   auto       pch = static_cast<const char*>(pData);
+   const auto cch = cbData;
+   if ((cch >= 4) && (std::memcmp(pch, "ASEF", 4) == 0))
+   {
+      return Format::Ase;
+   }
+   if ((cch >= 4) && (pch[0] == 0) && ((pch[1] == 1) || (pch[1] == 2)))
+   {
+      return Format::Aco;
+   }
+
+   auto cchText = cch;
+   if (StartsWith(pch, cchText, "\xEF\xBB\xBF"))
+   {
+      pch     += 3;
+      cchText -= 3;
+   }
+   if (StartsWith(pch, cchText, "GIMP Palette"))
+   {
+      return Format::Gpl;
+   }
+   if (StartsWith(pch, cchText, "JASC-PAL"))
+   {
+      return Format::JascPal;
+   }
+   return Format::Unknown;
+}
+
+
+PaletteImporter::PaletteImporter(Format format /* = Format::Unknown */)
+   : m_format     (format)
+   , m_status     (Status::Ok)
+   , m_stage      (InitialStage(format))
+   , m_cRemaining (0)
+   , m_cbSkip     (0)
+   , m_cbParsed   (0)
+   , m_ibError    (0)
+   , m_version    (0)
+   , m_cColumns   (0)
+   , m_isFinished (false)
+   , m_pending    ()
+   , m_colors     ()
+   , m_nameOffsets(1, 0)
+   , m_names      ()
+{ }
+
+void PaletteImporter::Reset(Format format /* = Format::Unknown */)
+{
+   m_format     = format;
+   m_status     = Status::Ok;
+   m_stage      = InitialStage(format);
+   m_cRemaining = 0;
+   m_cbSkip     = 0;
+   m_cbParsed   = 0;
+   m_ibError    = 0;
+   m_version    = 0;
+   m_cColumns   = 0;
+   m_isFinished = false;
+   m_pending.clear();
+   this->Clear();
+}
+
+PaletteImporter::Status PaletteImporter::Feed(const void* pData, size_t cbData)
+{
+   _ASSERTE(pData || (cbData == 0));
+   _ASSERTE(!m_isFinished);
+
+   if ((m_status != Status::Ok) || (cbData == 0))
+   {
+      return m_status;
+   }
+
+   // Parse straight from the caller's buffer when nothing is held back, so that the input is
+   // only copied when a line or record straddles two chunks (or the format is still unknown).
+   const auto pBytes = static_cast<const BYTE*>(pData);
+   if (m_pending.empty() && (m_format != Format::Unknown))
+   {
+      const auto cbUsed = this->Parse(pBytes, cbData, false);
+      if (m_status == Status::Ok)
+      {
+         m_pending.assign(pBytes + cbUsed, pBytes + cbData);
+      }
+   }
+   else
+   {
+      m_pending.insert(m_pending.end(), pBytes, pBytes + cbData);
+      this->ParsePending(false);
+   }
+   return m_status;
+}
+
+PaletteImporter::Status PaletteImporter::Finish()
+{
+   _ASSERTE(!m_isFinished);
+
+   m_isFinished = true;
+   if (m_status != Status::Ok)
+   {
+      return m_status;
+   }
+
+   this->ParsePending(true);
+   if (m_status != Status::Ok)
+   {
+      return m_status;
+   }
+   if (!m_pending.empty())
+   {
+      this->Fail(Status::Truncated);
+      return m_status;
+   }
+
+   switch (m_stage)
+   {
+      case kStageDetect:
+         this->Fail(Status::UnknownFormat);
+         break;
+      case kStageGplBody:
+      case kStageJascEnd:
+      case kStageAcoEnd:
+      case kStageAseEnd:
+         break;
+      case kStageAcoHeader:
+         // The version 2 section is optional, but the version 1 section is not.
+         if (m_version == 0)
+         {
+            this->Fail(Status::Truncated);
+         }
+         break;
+      default:
+         this->Fail(Status::Truncated);
+         break;
+   }
+   return m_status;
+}
+
+PaletteImporter::Status PaletteImporter::Import(const void* pData, size_t cbData)
+{
+   this->Feed(pData, cbData);
+   return this->Finish();
+}
+
+PaletteImporter::Status PaletteImporter::ImportFile(LPCTSTR pszPath)
+{
+   _ASSERTE(pszPath);
+   _ASSERTE(!m_isFinished);
+
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_READ,
+                                   FILE_SHARE_READ,
+                                   nullptr,
+                                   OPEN_EXISTING,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      this->Fail(Status::IoError);
+      return this->Finish();
+   }
+
+   std::vector<BYTE> buffer(kcbReadChunk);
+   auto              succeeded = true;
+   while (m_status == Status::Ok)
+   {
+      DWORD cbRead = 0;
+      succeeded = (::ReadFile(hFile, buffer.data(), kcbReadChunk, &cbRead, nullptr) != FALSE);
+      if (!succeeded || (cbRead == 0))
+      {
+         break;
+      }
+      this->Feed(buffer.data(), cbRead);
+   }
+   VERIFY(::CloseHandle(hFile));
+   if (!succeeded)
+   {
+      this->Fail(Status::IoError);
+   }
+   return this->Finish();
+}
+
+
+PaletteImporter::Format PaletteImporter::GetFormat() const
+{
+   return m_format;
+}
+
+PaletteImporter::Status PaletteImporter::GetStatus() const
+{
+   return m_status;
+}
+
+UINT64 PaletteImporter::GetErrorOffset() const
+{
+   return m_ibError;
+}
+
+size_t PaletteImporter::GetColorCount() const
+{
+   return m_colors.size();
+}
+
+size_t PaletteImporter::GetColumnCount() const
+{
+   return m_cColumns;
+}
+
+const COLORREF* PaletteImporter::GetColors() const
+{
+   return m_colors.data();
+}
+
+COLORREF PaletteImporter::GetColor(size_t index) const
+{
+   _ASSERTE(index < m_colors.size());
+   return m_colors[index];
+}
+
+LPCWSTR PaletteImporter::GetName(size_t index) const
+{
+   _ASSERTE(index < m_colors.size());
+   return m_names.data() + m_nameOffsets[index];
+}
+
+size_t PaletteImporter::GetNameLength(size_t index) const
+{
+   _ASSERTE(index < m_colors.size());
+   return m_nameOffsets[index + 1] - m_nameOffsets[index] - 1;
+}
+
+PaletteImporter::ColorTable PaletteImporter::GetColorTable() const
+{
+   ColorTable colorTable;
+   colorTable.reserve(m_colors.size());
+   for (size_t i = 0; i < m_colors.size(); ++i)
+   {
+      colorTable.emplace_back(m_colors[i], CString(this->GetName(i), static_cast<int>(this->GetNameLength(i))));
+   }
+   return colorTable;
+}
+
+
+void PaletteImporter::ParsePending(bool isFinal)
+{
+   if (m_format == Format::Unknown)
+   {
+      if ((m_pending.size() < kcbDetect) && !isFinal)
+      {
+         return;
+      }
+      m_format = DetectFormat(m_pending.data(), m_pending.size());
+      if (m_format == Format::Unknown)
+      {
+         if (!m_pending.empty())
+         {
+            this->Fail(Status::UnknownFormat);
+         }
+         return;
+      }
+      m_stage = InitialStage(m_format);
+   }
+
+   const auto cbUsed = this->Parse(m_pending.data(), m_pending.size(), isFinal);
+   m_pending.erase(m_pending.begin(), m_pending.begin() + cbUsed);
+}
+
+// Consumes as many complete lines or records as possible, and returns the number of bytes consumed.
+size_t PaletteImporter::Parse(const BYTE* pData, size_t cbData, bool isFinal)
+{
+   size_t ib = 0;
+   while ((m_status == Status::Ok) && (ib < cbData))
+   {
+      size_t cbUsed = 0;
+      switch (m_format)
+      {
+         case Format::Gpl:
+         case Format::JascPal:
+            cbUsed = this->ParseLine(pData + ib, cbData - ib, isFinal);
+            break;
+         case Format::Aco:
+            cbUsed = this->ParseAcoRecord(pData + ib, cbData - ib);
+            break;
+         case Format::Ase:
+            cbUsed = this->ParseAseBlock(pData + ib, cbData - ib);
+            break;
+         default:
+            _ASSERTE(false);
+            break;
+      }
+      if (cbUsed == 0)
+      {
+         break;  // waiting for more input (or failed)
+      }
+      ib         += cbUsed;
+      m_cbParsed += cbUsed;
+   }
+   return ib;
+}
+
+
+//////////////////////////////////////////////////
+// Text Formats
+//////////////////////////////////////////////////
+
+// Consumes one line (terminated by CR, LF, or CR LF), if it is complete.
+size_t PaletteImporter::ParseLine(const BYTE* pData, size_t cbData, bool isFinal)
+{
+   size_t cbLine = 0;
+   while ((cbLine < cbData) && (pData[cbLine] != '\n') && (pData[cbLine] != '\r'))
+   {
+      ++cbLine;
+   }
+   if ((cbLine == cbData) && !isFinal)
+   {
+      if (cbData > kcbLineMax)
+      {
+         this->Fail(Status::Malformed);
+      }
+      return 0;
+   }
+
+   // A CR LF pair is consumed as a unit when both are present; if the LF has not arrived yet,
+   // then it is later seen as an empty line, which both formats ignore.
+   auto cbUsed = cbLine;
+   if (cbUsed < cbData)
+   {
+      cbUsed += ((pData[cbUsed] == '\r') && (cbUsed + 1 < cbData) && (pData[cbUsed + 1] == '\n')) ? 2 : 1;
+   }
+
+   auto pch = reinterpret_cast<const char*>(pData);
+   auto cch = cbLine;
+   if ((m_cbParsed == 0) && StartsWith(pch, cch, "\xEF\xBB\xBF"))
+   {
+      pch += 3;
+      cch -= 3;
+   }
+   TrimSpaces(pch, cch);
+   if (m_format == Format::Gpl)
+   {
+      this->ParseGplLine(pch, cch);
+   }
+   else
+   {
+      this->ParseJascPalLine(pch, cch);
+   }
+   return cbUsed;
+}
+
+// A GIMP palette is a "GIMP Palette" line, followed by optional "Name:" and "Columns:" attributes,
+// followed by entries, each of which has the red, green, and blue components (as decimal integers)
+// and an optional name, all separated by whitespace. Empty lines and lines beginning with '#' are
+// ignored.
+void PaletteImporter::ParseGplLine(const char* pch, size_t cch)
+{
+   if (m_stage == kStageGplHeader)
+   {
+      if (Equals(pch, cch, "GIMP Palette"))
+      {
+         m_stage = kStageGplBody;
+      }
+      else
+      {
+         this->Fail(Status::Malformed);
+      }
+      return;
+   }
+
+   _ASSERTE(m_stage == kStageGplBody);
+   if ((cch == 0) || (*pch == '#') || StartsWith(pch, cch, "Name:"))
+   {
+      return;
+   }
+   if (StartsWith(pch, cch, "Columns:"))
+   {
+      pch += 8;
+      cch -= 8;
+      UINT32 cColumns;
+      if (!ParseInteger(pch, cch, static_cast<UINT32>(ColorPickerButton::kcColorTableMax), &cColumns))
+      {
+         this->Fail(Status::Malformed);
+         return;
+      }
+      m_cColumns = cColumns;
+      return;
+   }
+
+   COLORREF clr;
+   if (!ParseRGB(pch, cch, &clr))
+   {
+      this->Fail(Status::Malformed);
+      return;
+   }
+   if (this->AddColor(clr))
+   {
+      SkipSpaces(pch, cch);
+      this->AddNameUtf8(pch, cch);
+   }
+}
+
+// A JASC palette is a "JASC-PAL" line, a "0100" (version) line, a line with the number of entries,
+// and then the entries, each of which has the red, green, and blue components (as decimal integers)
+// and, in some variants, an alpha component, which is ignored. Empty lines are ignored.
+void PaletteImporter::ParseJascPalLine(const char* pch, size_t cch)
+{
+   if (cch == 0)
+   {
+      return;
+   }
+
+   switch (m_stage)
+   {
+      case kStageJascHeader:
+         if (!Equals(pch, cch, "JASC-PAL"))
+         {
+            this->Fail(Status::Malformed);
+            return;
+         }
+         m_stage = kStageJascVersion;
+         break;
+
+      case kStageJascVersion:
+         if (!Equals(pch, cch, "0100"))
+         {
+            this->Fail(Status::UnsupportedVersion);
+            return;
+         }
+         m_stage = kStageJascCount;
+         break;
+
+      case kStageJascCount:
+      {
+         UINT32 cColors;
+         if (!ParseInteger(pch, cch, UINT32_MAX, &cColors) || (cch != 0))
+         {
+            this->Fail(Status::Malformed);
+            return;
+         }
+         if (cColors > ColorPickerButton::kcColorTableMax)
+         {
+            this->Fail(Status::TooManyColors);
+            return;
+         }
+         m_cRemaining = cColors;
+         m_colors.reserve(cColors);
+         m_nameOffsets.reserve(cColors + 1);
+         m_names.reserve(cColors);
+         m_stage = (cColors > 0) ? kStageJascEntries : kStageJascEnd;
+         break;
+      }
+
+      case kStageJascEntries:
+      {
+         COLORREF clr;
+         UINT32   alpha;
+         if (!ParseRGB(pch, cch, &clr) || ((cch != 0) && (!ParseInteger(pch, cch, 255, &alpha) || (cch != 0))))
+         {
+            this->Fail(Status::Malformed);
+            return;
+         }
+         if (this->AddColor(clr))
+         {
+            this->AddNameUtf8(nullptr, 0);
+            if (--m_cRemaining == 0)
+            {
+               m_stage = kStageJascEnd;
+            }
+         }
+         break;
+      }
+
+      default:
+         _ASSERTE(m_stage == kStageJascEnd);
+         this->Fail(Status::Malformed);
+         break;
+   }
+}
+
+
+//////////////////////////////////////////////////
+// Binary Formats
+//////////////////////////////////////////////////
+
+// An .aco file has a version 1 section, optionally followed by a version 2 section that repeats
+// the same colors, with names. Each section is a version and a count (both 16-bit), followed by
+// that many records, each of which is a color space ID and four 16-bit components. In version 2,
+// each record is followed by a 32-bit length (in characters, including the terminator) and a name.
+// If there is a version 2 section, then the colors from the version 1 section are replaced.
+size_t PaletteImporter::ParseAcoRecord(const BYTE* pData, size_t cbData)
+{
+   constexpr size_t kcbHeader  = 4;
+   constexpr size_t kcbColor   = 10;
+   constexpr size_t kcbNameLen = 4;
+
+   switch (m_stage)
+   {
+      case kStageAcoHeader:
+      {
+         if (cbData < kcbHeader)
+         {
+            return 0;
+         }
+         const auto version = ReadBE16(pData);
+         const auto cColors = ReadBE16(pData + 2);
+         if ((version != 1) && (version != 2))
+         {
+            this->Fail((m_version == 0) ? Status::UnsupportedVersion : Status::Malformed);
+            return 0;
+         }
+         if (version <= m_version)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         if (version == 2)
+         {
+            this->Clear();
+         }
+         m_version    = version;
+         m_cRemaining = cColors;
+         m_colors.reserve(cColors);
+         m_nameOffsets.reserve(static_cast<size_t>(cColors) + 1);
+         m_stage = (cColors > 0) ? kStageAcoEntries : ((version == 2) ? kStageAcoEnd : kStageAcoHeader);
+         return kcbHeader;
+      }
+
+      case kStageAcoEntries:
+      {
+         size_t cbRecord = kcbColor;
+         size_t cchName  = 0;
+         if (m_version == 2)
+         {
+            if (cbData < kcbColor + kcbNameLen)
+            {
+               return 0;
+            }
+            const auto cchNameRaw = ReadBE32(pData + kcbColor);
+            if (cchNameRaw > kcchNameMax)
+            {
+               this->Fail(Status::Malformed);
+               return 0;
+            }
+            cchName  = cchNameRaw;
+            cbRecord = kcbColor + kcbNameLen + (cchName * sizeof(UINT16));
+         }
+         if (cbData < cbRecord)
+         {
+            return 0;
+         }
+
+         COLORREF clr;
+         if (!ColorFromAco(pData, &clr))
+         {
+            this->Fail(Status::UnsupportedColor);
+            return 0;
+         }
+         if (!this->AddColor(clr))
+         {
+            return 0;
+         }
+         this->AddNameUtf16BE(pData + kcbColor + kcbNameLen, cchName);
+         if (--m_cRemaining == 0)
+         {
+            m_stage = (m_version == 1) ? kStageAcoHeader : kStageAcoEnd;
+         }
+         return cbRecord;
+      }
+
+      default:
+         _ASSERTE(m_stage == kStageAcoEnd);
+         this->Fail(Status::Malformed);
+         return 0;
+   }
+}
+
+// An .ase file has a header ("ASEF", a 16-bit major and minor version, and a 32-bit block count),
+// followed by blocks, each of which has a 16-bit type and a 32-bit length. A color entry block
+// contains a 16-bit name length (in characters, including the terminator), the name, a 4-character
+// color model, the components (as 32-bit floats), and a 16-bit color type (global, spot, or normal),
+// which is ignored. Group start and end blocks are skipped, which flattens the groups.
+size_t PaletteImporter::ParseAseBlock(const BYTE* pData, size_t cbData)
+{
+   constexpr size_t kcbHeader      = 12;
+   constexpr size_t kcbBlockHeader = 6;
+
+   const auto endBlock = [this]
+   {
+      m_stage = (--m_cRemaining == 0) ? kStageAseEnd : kStageAseBlocks;
+   };
+
+   switch (m_stage)
+   {
+      case kStageAseHeader:
+      {
+         if (cbData < kcbHeader)
+         {
+            return 0;
+         }
+         if (std::memcmp(pData, "ASEF", 4) != 0)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         m_version = ReadBE16(pData + 4);
+         if (m_version != 1)
+         {
+            this->Fail(Status::UnsupportedVersion);
+            return 0;
+         }
+         m_cRemaining = ReadBE32(pData + 8);
+         m_colors.reserve(std::min<size_t>(m_cRemaining, ColorPickerButton::kcColorTableMax));
+         m_nameOffsets.reserve(std::min<size_t>(m_cRemaining, ColorPickerButton::kcColorTableMax) + 1);
+         m_stage = (m_cRemaining > 0) ? kStageAseBlocks : kStageAseEnd;
+         return kcbHeader;
+      }
+
+      case kStageAseBlocks:
+      {
+         if (cbData < kcbBlockHeader)
+         {
+            return 0;
+         }
+         const auto type    = ReadBE16(pData);
+         const auto cbBlock = ReadBE32(pData + 2);
+         if (type != kAseBlockColor)
+         {
+            // Skip the block without holding it back, however large it may be.
+            m_cbSkip = cbBlock;
+            if (m_cbSkip > 0)
+            {
+               m_stage = kStageAseSkip;
+            }
+            else
+            {
+               endBlock();
+            }
+            return kcbBlockHeader;
+         }
+         if (cbBlock > kcbAseBlockMax)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         if (cbData < kcbBlockHeader + cbBlock)
+         {
+            return 0;
+         }
+
+         // Check that each part of the entry fits within the block before reading it.
+         const auto pBlock  = pData + kcbBlockHeader;
+         size_t     ib      = 2;
+         if (cbBlock < ib)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         const size_t cchName = ReadBE16(pBlock);
+         const auto   pName   = pBlock + ib;
+         ib += (cchName * sizeof(UINT16)) + 4;
+         if (cbBlock < ib)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         const auto pModel = pBlock + ib - 4;
+         size_t     cComponents;
+         if      (std::memcmp(pModel, "RGB ", 4) == 0) { cComponents = 3; }
+         else if (std::memcmp(pModel, "CMYK", 4) == 0) { cComponents = 4; }
+         else if (std::memcmp(pModel, "LAB ", 4) == 0) { cComponents = 3; }
+         else if (std::memcmp(pModel, "Gray", 4) == 0) { cComponents = 1; }
+         else
+         {
+            this->Fail(Status::UnsupportedColor);
+            return 0;
+         }
+         if (cbBlock < ib + (cComponents * sizeof(float)) + 2)
+         {
+            this->Fail(Status::Malformed);
+            return 0;
+         }
+         float components[4];
+         for (size_t i = 0; i < cComponents; ++i)
+         {
+            components[i] = ReadBEFloat(pBlock + ib + (i * sizeof(float)));
+            if (!std::isfinite(components[i]))
+            {
+               this->Fail(Status::Malformed);
+               return 0;
+            }
+         }
+
+         COLORREF clr;
+         switch (pModel[0])
+         {
+            case 'R':  // [0, 1]
+               clr = RGB(ByteFromUnit(components[0]), ByteFromUnit(components[1]), ByteFromUnit(components[2]));
+               break;
+            case 'C':  // [0, 1], where 1 is full ink
+               clr = FromCMYK(components[0], components[1], components[2], components[3]);
+               break;
+            case 'L':  // L in [0, 1], and a and b in [-128, 127]
+               clr = ColorSpace::FromCIELab(components[0] * 100.0f, components[1], components[2]);
+               break;
+            default:   // [0, 1], where 1 is white
+            {
+               const auto gray = ByteFromUnit(components[0]);
+               clr = RGB(gray, gray, gray);
+               break;
+            }
+         }
+         if (!this->AddColor(clr))
+         {
+            return 0;
+         }
+         this->AddNameUtf16BE(pName, cchName);
+         endBlock();
+         return kcbBlockHeader + cbBlock;
+      }
+
+      case kStageAseSkip:
+      {
+         const auto cbUsed = static_cast<size_t>(std::min<UINT64>(m_cbSkip, cbData));
+         m_cbSkip -= cbUsed;
+         if (m_cbSkip == 0)
+         {
+            endBlock();
+         }
+         return cbUsed;
+      }
+
+      default:
+         _ASSERTE(m_stage == kStageAseEnd);
+         this->Fail(Status::Malformed);
+         return 0;
+   }
+}
+
+
+//////////////////////////////////////////////////
+// Output
+//////////////////////////////////////////////////
+
+// Appends a color to the table. Each call must be followed by exactly one call to add a name.
+bool PaletteImporter::AddColor(COLORREF clr)
+{
+   if (m_colors.size() >= ColorPickerButton::kcColorTableMax)
+   {
+      this->Fail(Status::TooManyColors);
+      return false;
+   }
+   m_colors.push_back(clr);
+   return true;
+}
+
+// Appends a name to the pool, decoding it from UTF-8. Invalid sequences (and nulls, which would
+// terminate the name early) are replaced by U+FFFD, the Unicode replacement character.
+void PaletteImporter::AddNameUtf8(const char* pch, size_t cch)
+{
+   constexpr WCHAR kReplacement = 0xFFFD;
+
+   const auto pb = reinterpret_cast<const BYTE*>(pch);
+   size_t     i  = 0;
+   while (i < cch)
+   {
+      UINT32 cp = pb[i];
+      if ((cp > 0) && (cp < 0x80))
+      {
+         m_names.push_back(static_cast<WCHAR>(cp));
+         ++i;
+         continue;
+      }
+
+      size_t cbSequence;
+      UINT32 cpMin;
+      if      ((cp & 0xE0) == 0xC0) { cbSequence = 2; cp &= 0x1F; cpMin = 0x80;    }
+      else if ((cp & 0xF0) == 0xE0) { cbSequence = 3; cp &= 0x0F; cpMin = 0x800;   }
+      else if ((cp & 0xF8) == 0xF0) { cbSequence = 4; cp &= 0x07; cpMin = 0x10000; }
+      else                          { cbSequence = 0;             cpMin = 0;       }
+
+      auto isValid = (cbSequence > 0) && (i + cbSequence <= cch);
+      for (size_t j = 1; isValid && (j < cbSequence); ++j)
+      {
+         isValid = ((pb[i + j] & 0xC0) == 0x80);
+         cp      = (cp << 6) | (pb[i + j] & 0x3F);
+      }
+      if (!isValid || (cp < cpMin) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+      {
+         m_names.push_back(kReplacement);
+         ++i;
+         continue;
+      }
+
+      if (cp >= 0x10000)
+      {
+         cp -= 0x10000;
+         m_names.push_back(static_cast<WCHAR>(0xD800 + (cp >> 10)));
+         m_names.push_back(static_cast<WCHAR>(0xDC00 + (cp & 0x3FF)));
+      }
+      else
+      {
+         m_names.push_back(static_cast<WCHAR>(cp));
+      }
+      i += cbSequence;
+   }
+   m_names.push_back(L'\0');
+   m_nameOffsets.push_back(static_cast<UINT32>(m_names.size()));
+}
+
+// Appends a name to the pool, decoding it from big-endian UTF-16. The name ends at the
+// first null (both Adobe formats count the terminator in the length).
+void PaletteImporter::AddNameUtf16BE(const BYTE* pData, size_t cch)
+{
+   const auto ichStart = m_names.size();
+   m_names.resize(ichStart + cch + 1);
+   auto pchName = m_names.data() + ichStart;
+   for (size_t i = 0; i < cch; ++i)
+   {
+      const auto ch = static_cast<WCHAR>(ReadBE16(pData + (i * sizeof(UINT16))));
+      if (ch == L'\0')
+      {
+         break;
+      }
+      *pchName++ = ch;
+   }
+   *pchName++ = L'\0';
+   m_names.resize(static_cast<size_t>(pchName - m_names.data()));
+   m_nameOffsets.push_back(static_cast<UINT32>(m_names.size()));
+}
+
+void PaletteImporter::Clear()
+{
+   m_colors.clear();
+   m_names.clear();
+   m_nameOffsets.assign(1, 0);
+}
+
+// Records the first error, along with where it was found. Later errors are ignored.
+void PaletteImporter::Fail(Status status)
+{
+   _ASSERTE(status != Status::Ok);
+   if (m_status == Status::Ok)
+   {
+      m_status  = status;
+      m_ibError = m_cbParsed;
+   }
+}
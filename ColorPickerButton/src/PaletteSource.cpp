@@ -0,0 +1,446 @@
+#include "PCH.hpp"
+#include "PaletteSource.hpp"
+#include "ColorTableDiff.hpp"
+#include "PaletteFile.hpp"
+#include "PaletteImporter.hpp"
+
+
+namespace {
+
+constexpr UINT  kmsgUpdatesReady     = WM_APP;       // posted by the worker to the notification window
+constexpr DWORD kSettleDelay         = 100;          // time to let a burst of writes finish, in milliseconds
+constexpr int   kcLoadAttemptsMax    = 3;            // times to retry a file that changes while being read
+constexpr DWORD kcbChangeBuffer      = 16 * 1024;    // size of the buffer for directory change records
+constexpr DWORD kChangeFilter        = FILE_NOTIFY_CHANGE_FILE_NAME  |  // (to see files saved by renaming a temporary file)
+                                       FILE_NOTIFY_CHANGE_SIZE       |
+                                       FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+void SetStatus(PaletteSource::Status* pStatus, PaletteSource::Status status)
+{
+   if (pStatus)
+   {
+      *pStatus = status;
+   }
+}
+
+// Checks whether any of the change records in the buffer refers to the specified file.
+bool DoChangesNameFile(const BYTE* pBuffer, const CStringW& strFileName)
+{
+   for (auto pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(pBuffer); ; )
+   {
+      if (::CompareStringOrdinal(pInfo->FileName,
+                                 static_cast<int>(pInfo->FileNameLength / sizeof(WCHAR)),
+                                 strFileName,
+                                 strFileName.GetLength(),
+                                 TRUE) == CSTR_EQUAL)
+      {
+         return true;
+      }
+      if (pInfo->NextEntryOffset == 0)
+      {
+         return false;
+      }
+      pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const BYTE*>(pInfo) + pInfo->NextEntryOffset);
+   }
+}
+
+}  // anonymous namespace
+
+
+//////////////////////////////////////////////////
+// Notification Window
+//////////////////////////////////////////////////
+
+// A message-only window that the worker posts to when it has loaded a table,
+// so that the table is delivered on the thread that opened the source.
+class PaletteSource::NotificationWindow : public CWnd
+{
+public:
+
+   explicit NotificationWindow(PaletteSource& source)
+      : m_source(source)
+   { }
+
+protected:
+
+   virtual LRESULT WindowProc(UINT message, WPARAM wParam, LPARAM lParam) override
+   {
+      if (message == kmsgUpdatesReady)
+      {
+         m_source.DeliverUpdates();
+         return 0;
+      }
+      return CWnd::WindowProc(message, wParam, lParam);
+   }
+
+private:
+   PaletteSource& m_source;
+};
+
+
+//////////////////////////////////////////////////
+// PaletteSource
+//////////////////////////////////////////////////
+
+bool PaletteSource::FileStamp::operator==(const FileStamp& other) const
+{
+   return (exists                        == other.exists)                        &&
+          (ftLastWrite.dwLowDateTime     == other.ftLastWrite.dwLowDateTime)     &&
+          (ftLastWrite.dwHighDateTime    == other.ftLastWrite.dwHighDateTime)    &&
+          (cb                            == other.cb);
+}
+
+bool PaletteSource::FileStamp::operator!=(const FileStamp& other) const
+{
+   return !(*this == other);
+}
+
+
+/* static */ std::shared_ptr<PaletteSource> PaletteSource::Open(LPCTSTR pszPath,
+                                                                DWORD   pollInterval /* = kPollIntervalDefault */,
+                                                                Status* pStatus      /* = nullptr */)
+{
+   _ASSERTE(pszPath);
+
+   // The worker outlives any change to the current directory, so it needs the full path.
+   CString    strPath;
+   const auto cchPath = ::GetFullPathName(pszPath, 0, nullptr, nullptr);
+   if ((cchPath == 0) ||
+       (::GetFullPathName(pszPath, cchPath, strPath.GetBuffer(cchPath), nullptr) == 0))
+   {
+      SetStatus(pStatus, Status::IoError);
+      return nullptr;
+   }
+   strPath.ReleaseBuffer();
+
+   auto       pSource = std::shared_ptr<PaletteSource>(new PaletteSource(std::move(strPath), pollInterval));
+   ColorTable colorTable;
+   const auto status  = Load(pSource->m_strPath, &pSource->m_loadedStamp, &colorTable, &pSource->m_cLoadedColumns);
+   SetStatus(pStatus, status);
+   if (status != Status::Ok)
+   {
+      return nullptr;
+   }
+   pSource->m_pLoadedTable = std::make_shared<const ColorTable>(std::move(colorTable));
+   pSource->m_pColorTable  = pSource->m_pLoadedTable;
+   pSource->m_cColumns     = pSource->m_cLoadedColumns;
+
+   pSource->m_pNotificationWnd = std::make_unique<NotificationWindow>(*pSource);
+   pSource->m_hStopEvent       = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+   if (!pSource->m_hStopEvent ||
+       !pSource->m_pNotificationWnd->CreateEx(0, AfxRegisterWndClass(0), nullptr, 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr))
+   {
+      SetStatus(pStatus, Status::IoError);
+      return nullptr;
+   }
+   pSource->m_hwndNotification = pSource->m_pNotificationWnd->GetSafeHwnd();
+
+   pSource->m_worker = std::thread(&PaletteSource::Watch, pSource.get());
+   return pSource;
+}
+
+PaletteSource::PaletteSource(CString strPath, DWORD pollInterval)
+   : m_strPath         (std::move(strPath))
+   , m_pollInterval    (pollInterval)
+   , m_pColorTable     ()
+   , m_cColumns        (0)
+   , m_version         (0)
+   , m_loadStatus      (Status::Ok)
+   , m_subscribers     ()
+   , m_pNotificationWnd()
+   , m_hwndNotification(nullptr)
+   , m_hStopEvent      (nullptr)
+   , m_isPolling       (false)
+   , m_updatesMutex    ()
+   , m_updates         ()
+   , m_pLoadedTable    ()
+   , m_cLoadedColumns  (0)
+   , m_loadedStamp     ()
+   , m_worker          ()
+{ }
+
+PaletteSource::~PaletteSource()
+{
+   // The buttons hold references to the source, so none of them can still be subscribed.
+   _ASSERTE(m_subscribers.empty());
+
+   if (m_worker.joinable())
+   {
+      VERIFY(::SetEvent(m_hStopEvent));
+      m_worker.join();
+   }
+   if (m_pNotificationWnd && m_pNotificationWnd->GetSafeHwnd())
+   {
+      VERIFY(m_pNotificationWnd->DestroyWindow());  // (discarding any updates that were not delivered)
+   }
+   if (m_hStopEvent)
+   {
+      VERIFY(::CloseHandle(m_hStopEvent));
+   }
+}
+
+
+const CString& PaletteSource::GetPath() const
+{
+   return m_strPath;
+}
+
+const PaletteSource::ColorTable& PaletteSource::GetColorTable() const
+{
+   return *m_pColorTable;
+}
+
+size_t PaletteSource::GetColumnCount() const
+{
+   return m_cColumns;
+}
+
+UINT PaletteSource::GetVersion() const
+{
+   return m_version;
+}
+
+PaletteSource::Status PaletteSource::GetLoadStatus() const
+{
+   return m_loadStatus;
+}
+
+bool PaletteSource::IsPolling() const
+{
+   return m_isPolling;
+}
+
+
+void PaletteSource::Subscribe(ColorPickerButton* pButton)
+{
+   _ASSERTE(pButton);
+   _ASSERTE(std::find(m_subscribers.begin(), m_subscribers.end(), pButton) == m_subscribers.end());
+   m_subscribers.push_back(pButton);
+}
+
+void PaletteSource::Unsubscribe(ColorPickerButton* pButton)
+{
+   const auto iter = std::find(m_subscribers.begin(), m_subscribers.end(), pButton);
+   _ASSERTE(iter != m_subscribers.end());
+   if (iter != m_subscribers.end())
+   {
+      m_subscribers.erase(iter);
+   }
+}
+
+
+/* static */ PaletteSource::FileStamp PaletteSource::GetFileStamp(LPCTSTR pszPath)
+{
+   WIN32_FILE_ATTRIBUTE_DATA attributes;
+   if (!::GetFileAttributesEx(pszPath, GetFileExInfoStandard, &attributes))
+   {
+      return FileStamp{ false, FILETIME{ }, 0 };
+   }
+   return FileStamp{ true,
+                     attributes.ftLastWriteTime,
+                     (static_cast<UINT64>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow };
+}
+
+/* static */ PaletteSource::Status PaletteSource::Load(LPCTSTR     pszPath,
+                                                       FileStamp*  pStamp,
+                                                       ColorTable* pColorTable,
+                                                       size_t*     pcColumns)
+{
+   // A file that is being saved may be read half-written, so it is only trusted
+   // if its stamp is the same after it has been read as it was before.
+   auto status = Status::IoError;
+   for (int attempt = 0; attempt < kcLoadAttemptsMax; ++attempt)
+   {
+      const auto stampBefore = GetFileStamp(pszPath);
+
+      // Try the palette file format first, since it can be recognized by its header.
+      auto paletteFileStatus = PaletteFile::Status::Ok;
+      if (const auto pPaletteFile = PaletteFile::Open(pszPath, true, &paletteFileStatus))
+      {
+         *pColorTable = pPaletteFile->GetColorTable();
+         *pcColumns   = pPaletteFile->GetColumnCount();
+         status       = Status::Ok;
+      }
+      else if ((paletteFileStatus != PaletteFile::Status::BadMagic) &&
+               (paletteFileStatus != PaletteFile::Status::IoError))
+      {
+         // It has the magic number, so it is a palette file, but a broken one.
+         status = Status::NotPalette;
+      }
+      else
+      {
+         // Anything else (including a file that could not be mapped, such as an empty one)
+         // may be a palette in another format, so it is handed to the importer, which will
+         // report an I/O error itself if the file cannot be read.
+         PaletteImporter importer;
+         const auto      importStatus = importer.ImportFile(pszPath);
+         if (importStatus == PaletteImporter::Status::Ok)
+         {
+            *pColorTable = importer.GetColorTable();
+            *pcColumns   = importer.GetColumnCount();
+         }
+         status = (importStatus == PaletteImporter::Status::Ok)      ? Status::Ok
+                : (importStatus == PaletteImporter::Status::IoError) ? Status::IoError
+                                                                     : Status::NotPalette;
+      }
+
+      *pStamp = GetFileStamp(pszPath);
+      if (*pStamp == stampBefore)
+      {
+         return status;
+      }
+   }
+   return (status == Status::Ok) ? Status::IoError : status;
+}
+
+
+void PaletteSource::Watch()
+{
+   // Watch the directory, since a file that is saved by replacing it would not be seen
+   // by a handle to the file itself. If it cannot be watched, fall back to polling.
+   const auto iSeparator = m_strPath.ReverseFind(_T('\\'));
+   const auto hDirectory = ::CreateFile(m_strPath.Left(iSeparator + 1),
+                                        FILE_LIST_DIRECTORY,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                        nullptr,
+                                        OPEN_EXISTING,
+                                        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                        nullptr);
+   const auto hChangedEvent = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+   if ((hDirectory == INVALID_HANDLE_VALUE) || !hChangedEvent)
+   {
+      if (hDirectory != INVALID_HANDLE_VALUE)
+      {
+         VERIFY(::CloseHandle(hDirectory));
+      }
+      this->Poll();
+      return;
+   }
+
+   const CStringW strFileName(m_strPath.Mid(iSeparator + 1));
+   std::vector<DWORD> buffer(kcbChangeBuffer / sizeof(DWORD));  // (change records must be DWORD-aligned)
+   auto isStopping = false;
+   while (!isStopping)
+   {
+      OVERLAPPED overlapped = { };
+      overlapped.hEvent     = hChangedEvent;
+      if (!::ReadDirectoryChangesW(hDirectory, buffer.data(), kcbChangeBuffer, FALSE, kChangeFilter, nullptr, &overlapped, nullptr))
+      {
+         break;
+      }
+
+      const HANDLE handles[] = { m_hStopEvent, hChangedEvent };
+      DWORD        cbChanges = 0;
+      if (::WaitForMultipleObjects(ARRAYSIZE(handles), handles, FALSE, INFINITE) != (WAIT_OBJECT_0 + 1))
+      {
+         VERIFY(::CancelIo(hDirectory));
+         ::GetOverlappedResult(hDirectory, &overlapped, &cbChanges, TRUE);  // (wait for the cancellation)
+         isStopping = true;
+         break;
+      }
+      if (!::GetOverlappedResult(hDirectory, &overlapped, &cbChanges, FALSE))
+      {
+         break;  // (for example, the directory was deleted)
+      }
+
+      // An empty result means that there were too many changes to record, any of which might
+      // have been to our file. Otherwise, only changes that name our file are of interest.
+      if ((cbChanges == 0) || DoChangesNameFile(reinterpret_cast<const BYTE*>(buffer.data()), strFileName))
+      {
+         // Give a burst of writes a chance to finish, so that the file is read once.
+         // (Changes made in the meantime are queued for the next read of the directory.)
+         isStopping = (::WaitForSingleObject(m_hStopEvent, kSettleDelay) == WAIT_OBJECT_0);
+         if (!isStopping)
+         {
+            this->ReloadIfChanged();
+         }
+      }
+   }
+
+   VERIFY(::CloseHandle(hChangedEvent));
+   VERIFY(::CloseHandle(hDirectory));
+   if (!isStopping)
+   {
+      this->Poll();
+   }
+}
+
+void PaletteSource::Poll()
+{
+   m_isPolling = true;
+   while (::WaitForSingleObject(m_hStopEvent, m_pollInterval) == WAIT_TIMEOUT)
+   {
+      this->ReloadIfChanged();
+   }
+}
+
+void PaletteSource::ReloadIfChanged()
+{
+   if (GetFileStamp(m_strPath) == m_loadedStamp)
+   {
+      return;
+   }
+
+   ColorTable colorTable;
+   size_t     cColumns = 0;
+   Update     update   = { Load(m_strPath, &m_loadedStamp, &colorTable, &cColumns), nullptr, nullptr, 0 };
+   if (update.status == Status::Ok)
+   {
+      // Diff against the table as it was last loaded, which is what the buttons have, once
+      // the updates that are waiting have been delivered. A file that was saved without
+      // changing does not need to be delivered at all.
+      auto diff = ColorTableDiff::Compute(*m_pLoadedTable, colorTable);
+      if (diff && diff->IsEmpty() && (cColumns == m_cLoadedColumns))
+      {
+         return;
+      }
+      if (diff)
+      {
+         update.pDiff = std::make_shared<const ColorTableDiff>(std::move(*diff));
+      }
+      update.pColorTable = std::make_shared<const ColorTable>(std::move(colorTable));
+      update.cColumns    = cColumns;
+      m_pLoadedTable     = update.pColorTable;
+      m_cLoadedColumns   = cColumns;
+   }
+
+   // Only post when the queue was empty, since a single message delivers everything in it.
+   bool wasEmpty;
+   {
+      std::lock_guard<std::mutex> lock(m_updatesMutex);
+      wasEmpty = m_updates.empty();
+      m_updates.push_back(std::move(update));
+   }
+   if (wasEmpty)
+   {
+      VERIFY(::PostMessage(m_hwndNotification, kmsgUpdatesReady, 0, 0));
+   }
+}
+
+void PaletteSource::DeliverUpdates()
+{
+   std::vector<Update> updates;
+   {
+      std::lock_guard<std::mutex> lock(m_updatesMutex);
+      updates.swap(m_updates);
+   }
+
+   for (auto& update : updates)
+   {
+      m_loadStatus = update.status;
+      if (update.status != Status::Ok)
+      {
+         continue;
+      }
+      m_pColorTable = std::move(update.pColorTable);
+      m_cColumns    = update.cColumns;
+      ++m_version;
+
+      // (The list is indexed, rather than iterated, in case a button
+      // responds to the change by subscribing another button.)
+      for (size_t iSubscriber = 0; iSubscriber < m_subscribers.size(); ++iSubscriber)
+      {
+         m_subscribers[iSubscriber]->OnPaletteSourceChanged(update.pDiff);
+      }
+   }
+}
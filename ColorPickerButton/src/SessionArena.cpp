@@ -0,0 +1,80 @@
+#include "PCH.hpp"
+#include "SessionArena.hpp"
+
+
+// The header at the start of each block.
+struct SessionArena::Block
+{
+   Block* pPrevious;
+   size_t cb;         // of the whole block, including this header
+   BYTE   padding[16 - ((2 * sizeof(void*)) % 16)];  // (so that the space after the header is 16-byte aligned)
+};
+
+
+SessionArena::SessionArena()
+   : m_pBlock    (nullptr)
+   , m_pNext     (nullptr)
+   , m_pEnd      (nullptr)
+   , m_cbReserved(0)
+{
+   static_assert((sizeof(Block) % 16) == 0, "The arena's block header breaks the alignment of its blocks.");
+}
+
+SessionArena::~SessionArena()
+{
+   while (m_pBlock)
+   {
+      const auto pPrevious = m_pBlock->pPrevious;
+      VERIFY(::VirtualFree(m_pBlock, 0, MEM_RELEASE));
+      m_pBlock = pPrevious;
+   }
+}
+
+void* SessionArena::Allocate(size_t cb, size_t alignment)
+{
+   _ASSERTE((alignment != 0) && ((alignment & (alignment - 1)) == 0) && (alignment <= 16));
+
+   auto p = reinterpret_cast<BYTE*>((reinterpret_cast<UINT_PTR>(m_pNext) + (alignment - 1)) & ~static_cast<UINT_PTR>(alignment - 1));
+   if (!m_pNext || (cb > static_cast<size_t>(m_pEnd - p)))
+   {
+      // Start a new block, big enough for this allocation. (The rest of the current one is
+      // abandoned; at worst, that wastes half of the arena, when allocations are growing.)
+      if (cb > (SIZE_MAX - sizeof(Block) - kcbBlock))
+      {
+         return nullptr;
+      }
+      const auto cbBlock = ((sizeof(Block) + cb + (kcbBlock - 1)) / kcbBlock) * kcbBlock;
+      const auto pBlock  = static_cast<Block*>(::VirtualAlloc(nullptr, cbBlock, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+      if (!pBlock)
+      {
+         return nullptr;
+      }
+      pBlock->pPrevious = m_pBlock;
+      pBlock->cb        = cbBlock;
+      m_pBlock          = pBlock;
+      m_pNext           = reinterpret_cast<BYTE*>(pBlock + 1);
+      m_pEnd            = reinterpret_cast<BYTE*>(pBlock) + cbBlock;
+      m_cbReserved     += cbBlock;
+      p                 = m_pNext;  // (already aligned to 16 bytes)
+   }
+   m_pNext = p + cb;
+   return p;
+}
+
+LPCTSTR SessionArena::CopyString(LPCTSTR psz, size_t cch)
+{
+   _ASSERTE(psz || (cch == 0));
+
+   const auto pszCopy = this->AllocateArray<TCHAR>(cch + 1);
+   if (pszCopy)
+   {
+      memcpy(pszCopy, psz, cch * sizeof(TCHAR));
+      pszCopy[cch] = TEXT('\0');
+   }
+   return pszCopy;
+}
+
+size_t SessionArena::GetBytesReserved() const
+{
+   return m_cbReserved;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <type_traits>
+
+
+// A bump allocator for the transient data of one session of the pop-up window (such as the inputs
+// being recorded for an InputRecorder, and the text of tooltips), all of which is freed at once,
+// when the session ends. Allocating is a pointer bump. The memory comes from ::VirtualAlloc, not
+// the heap, a block at a time: blocks are a whole allocation granule (64 KB), which holds a few
+// thousand inputs, and the first one is only allocated when it is first needed. Each block's
+// header is kept in the block itself, so the arena never touches the heap at all.
+//
+// Only trivially destructible objects can be allocated, since nothing is ever destroyed.
+class SessionArena
+{
+   SessionArena           (const SessionArena&) = delete;  // not copyable
+   SessionArena& operator=(const SessionArena&) = delete;  // not assignable
+
+public:
+
+   SessionArena();
+   ~SessionArena();
+
+   // Allocates the specified number of bytes, aligned as specified (which must be a power of 2,
+   // no larger than 16). Allocations larger than a block get a block of their own. Returns null
+   // only if the system is out of memory.
+   void* Allocate(size_t cb, size_t alignment);
+
+   // Allocates an array of the specified number of (uninitialized) objects.
+   template <typename T>
+   T* AllocateArray(size_t count)
+   {
+      static_assert(std::is_trivially_destructible<T>::value, "An arena never destroys what it holds.");
+      return (count <= (SIZE_MAX / sizeof(T))) ? static_cast<T*>(this->Allocate(sizeof(T) * count, alignof(T)))
+                                               : nullptr;
+   }
+
+   // Copies a string (of the specified length, not including its terminator), terminating the copy.
+   // Returns null only if the system is out of memory.
+   LPCTSTR CopyString(LPCTSTR psz, size_t cch);
+
+   // Gets the number of bytes obtained from the system for the blocks.
+   size_t GetBytesReserved() const;
+
+private:
+
+   struct Block;
+
+   static constexpr size_t kcbBlock = 64 * 1024;
+
+private:
+   Block* m_pBlock;      // the current block (which links to the ones before it)
+   BYTE*  m_pNext;       // \ the free space in the current block
+   BYTE*  m_pEnd;        // /
+   size_t m_cbReserved;
+};
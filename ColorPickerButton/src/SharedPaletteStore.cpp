@@ -0,0 +1,354 @@
+#include "PCH.hpp"
+#include "SharedPaletteStore.hpp"
+
+
+// The header of a store, which is all that the store's own mapping holds. The writer only changes
+// the generation and the size of the current section while the sequence number is odd.
+struct SharedPaletteStore::Header
+{
+   UINT32        magic;
+   UINT32        version;
+   volatile LONG sequence;    // (a LONG, rather than a 64-bit value, so that it is read atomically on x86, too)
+   UINT32        cbHeader;    // size of the header, which is how big the store's mapping was created
+   UINT64        generation;  // of the current section (0 if no table has been published)
+   UINT64        cbSection;   // size of the current section's palette file, in bytes
+};
+
+
+namespace {
+
+constexpr UINT32 kMagic              = 0x53505043;  // "CPPS", little-endian
+constexpr UINT32 kVersion            = 2;           // changes whenever the layout of the header changes
+constexpr int    kcMapAttemptsMax    = 3;           // times to retry a section that is replaced before it can be mapped
+constexpr int    kcReadAttemptsMax   = 1024;        // times to retry a header that is being updated, before giving up on it
+constexpr int    kcReadSpinsMax      = 64;          // of those, times to spin before yielding to other threads
+constexpr int    kcCreateAttemptsMax = 16;          // times to skip a generation whose section is still held by a reader
+
+void SetStatus(SharedPaletteStore::Status* pStatus, SharedPaletteStore::Status status)
+{
+   if (pStatus)
+   {
+      *pStatus = status;
+   }
+}
+
+}  // anonymous namespace
+
+
+/* static */ std::shared_ptr<SharedPaletteStore> SharedPaletteStore::Create(LPCTSTR pszName,
+                                                                            Status* pStatus /* = nullptr */)
+{
+   _ASSERTE(pszName);
+
+   SetStatus(pStatus, Status::IoError);
+   const auto hHeader = ::CreateFileMapping(INVALID_HANDLE_VALUE,
+                                            nullptr,
+                                            PAGE_READWRITE,
+                                            0,
+                                            sizeof(Header),
+                                            pszName);
+   if (!hHeader)
+   {
+      return nullptr;
+   }
+   const auto existed = (::GetLastError() == ERROR_ALREADY_EXISTS);
+   const auto pHeader = static_cast<Header*>(::MapViewOfFile(hHeader, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(Header)));
+   if (!pHeader)
+   {
+      VERIFY(::CloseHandle(hHeader));
+      return nullptr;
+   }
+
+   // A new mapping is zero-filled. The magic number is written last, so that a reader
+   // never sees a header that claims to be a store before it has been initialized.
+   if (!existed || (pHeader->magic == 0))
+   {
+      pHeader->version  = kVersion;
+      pHeader->cbHeader = sizeof(Header);
+      ::MemoryBarrier();
+      pHeader->magic    = kMagic;
+   }
+   else if ((pHeader->magic != kMagic) || (pHeader->version != kVersion) || (pHeader->cbHeader != sizeof(Header)))
+   {
+      VERIFY(::UnmapViewOfFile(pHeader));
+      VERIFY(::CloseHandle(hHeader));
+      SetStatus(pStatus, Status::NotStore);
+      return nullptr;
+   }
+   else if ((pHeader->sequence & 1) != 0)
+   {
+      // The previous writer exited in the middle of an update, which would leave readers
+      // waiting for it forever. Its next publication will replace whatever it left behind.
+      ::InterlockedIncrement(&pHeader->sequence);
+   }
+
+   SetStatus(pStatus, Status::Ok);
+   return std::shared_ptr<SharedPaletteStore>(new SharedPaletteStore(pszName, hHeader, pHeader, true));
+}
+
+/* static */ std::shared_ptr<const SharedPaletteStore> SharedPaletteStore::Open(LPCTSTR pszName,
+                                                                                Status* pStatus /* = nullptr */)
+{
+   _ASSERTE(pszName);
+
+   const auto hHeader = ::OpenFileMapping(FILE_MAP_READ, FALSE, pszName);
+   if (!hHeader)
+   {
+      SetStatus(pStatus, (::GetLastError() == ERROR_FILE_NOT_FOUND) ? Status::NotFound : Status::IoError);
+      return nullptr;
+   }
+
+   // Check that the view is large enough to look at, since it may be any object of that name. (The
+   // view is rounded up to whole pages, so this only makes reading the header safe; the size that
+   // the mapping was created with is the one that the header records, which is checked below.)
+   const auto                pHeader = static_cast<Header*>(::MapViewOfFile(hHeader, FILE_MAP_READ, 0, 0, 0));
+   MEMORY_BASIC_INFORMATION  mbi;
+   if (!pHeader || (::VirtualQuery(pHeader, &mbi, sizeof(mbi)) != sizeof(mbi)))
+   {
+      if (pHeader)
+      {
+         VERIFY(::UnmapViewOfFile(pHeader));
+      }
+      VERIFY(::CloseHandle(hHeader));
+      SetStatus(pStatus, Status::IoError);
+      return nullptr;
+   }
+   if ((mbi.RegionSize < sizeof(Header)) ||
+       (pHeader->magic    != kMagic)         ||
+       (pHeader->version  != kVersion)       ||
+       (pHeader->cbHeader != sizeof(Header)))
+   {
+      VERIFY(::UnmapViewOfFile(pHeader));
+      VERIFY(::CloseHandle(hHeader));
+      SetStatus(pStatus, Status::NotStore);
+      return nullptr;
+   }
+
+   SetStatus(pStatus, Status::Ok);
+   return std::shared_ptr<const SharedPaletteStore>(new SharedPaletteStore(pszName, hHeader, pHeader, false));
+}
+
+
+SharedPaletteStore::SharedPaletteStore(CString strName, HANDLE hHeader, Header* pHeader, bool isWriter)
+   : m_strName           (std::move(strName))
+   , m_hHeader           (hHeader)
+   , m_pHeader           (pHeader)
+   , m_isWriter          (isWriter)
+   , m_hSections         { nullptr, nullptr }
+   , m_snapshotMutex     ()
+   , m_pSnapshot         ()
+   , m_snapshotGeneration(0)
+{
+   _ASSERTE(m_hHeader);
+   _ASSERTE(m_pHeader);
+}
+
+SharedPaletteStore::~SharedPaletteStore()
+{
+   for (const auto hSection : m_hSections)
+   {
+      if (hSection)
+      {
+         VERIFY(::CloseHandle(hSection));
+      }
+   }
+   VERIFY(::UnmapViewOfFile(m_pHeader));
+   VERIFY(::CloseHandle(m_hHeader));
+}
+
+const CString& SharedPaletteStore::GetName() const
+{
+   return m_strName;
+}
+
+UINT64 SharedPaletteStore::GetGeneration() const
+{
+   UINT64 generation;
+   UINT64 cbSection;
+   if (!this->ReadHeader(&generation, &cbSection))
+   {
+      std::lock_guard<std::mutex> lock(m_snapshotMutex);
+      return m_snapshotGeneration;
+   }
+   return generation;
+}
+
+std::shared_ptr<const PaletteFile> SharedPaletteStore::GetPaletteFile(UINT64* pGeneration /* = nullptr */) const
+{
+   std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+   // The section that the header names may be replaced (and freed) before it can be opened,
+   // if the writer publishes twice in the meantime, in which case the header is read again.
+   for (int attempt = 0; attempt < kcMapAttemptsMax; ++attempt)
+   {
+      UINT64 generation;
+      UINT64 cbSection;
+      if (!this->ReadHeader(&generation, &cbSection) || (generation == 0) || (generation == m_snapshotGeneration))
+      {
+         break;
+      }
+
+      auto pPaletteFile = this->MapSection(generation, cbSection);
+      if (pPaletteFile)
+      {
+         m_pSnapshot          = std::move(pPaletteFile);
+         m_snapshotGeneration = generation;
+         break;
+      }
+   }
+
+   if (pGeneration)
+   {
+      *pGeneration = m_snapshotGeneration;
+   }
+   return m_pSnapshot;
+}
+
+SharedPaletteStore::Status SharedPaletteStore::Publish(const ColorTable&                colorTable,
+                                                       const PaletteFile::WriteOptions& options /* = PaletteFile::DefaultWriteOptions() */)
+{
+   _ASSERTE(m_isWriter);
+
+   if (colorTable.size() > ColorPickerButton::kcColorTableMax)
+   {
+      return Status::TooManyColors;
+   }
+   const auto data      = PaletteFile::Serialize(colorTable, options);
+   const auto cbSection = static_cast<UINT64>(data.size());
+
+   // Create the section for the next generation. (The section of a generation that was published
+   // by a writer that has since gone may still be held open by a reader, so it cannot be reused.)
+   auto   generation = m_pHeader->generation;  // (only the writer changes it, so it can be read directly)
+   HANDLE hSection   = nullptr;
+   for (int attempt = 0; (attempt < kcCreateAttemptsMax) && !hSection; ++attempt)
+   {
+      ++generation;
+      hSection = ::CreateFileMapping(INVALID_HANDLE_VALUE,
+                                     nullptr,
+                                     PAGE_READWRITE,
+                                     static_cast<DWORD>(cbSection >> 32),
+                                     static_cast<DWORD>(cbSection),
+                                     GetSectionName(m_strName, generation));
+      if (!hSection)
+      {
+         return Status::IoError;
+      }
+      if (::GetLastError() == ERROR_ALREADY_EXISTS)
+      {
+         VERIFY(::CloseHandle(hSection));
+         hSection = nullptr;
+      }
+   }
+   if (!hSection)
+   {
+      return Status::IoError;
+   }
+
+   const auto pView = ::MapViewOfFile(hSection, FILE_MAP_WRITE, 0, 0, 0);
+   if (!pView)
+   {
+      VERIFY(::CloseHandle(hSection));
+      return Status::IoError;
+   }
+   memcpy(pView, data.data(), data.size());
+   VERIFY(::UnmapViewOfFile(pView));
+
+   // Point the header at the new section. The interlocked increments are full barriers, so the
+   // section's contents are written before the header names it, and the header's fields are only
+   // written while the sequence number is odd.
+   ::InterlockedIncrement(&m_pHeader->sequence);
+   m_pHeader->generation = generation;
+   m_pHeader->cbSection  = cbSection;
+   ::InterlockedIncrement(&m_pHeader->sequence);
+
+   // Keep the previous section alive, too, for any reader that read the header just before it
+   // changed, and let go of the one before that, which the system frees once no reader has it.
+   if (m_hSections[1])
+   {
+      VERIFY(::CloseHandle(m_hSections[1]));
+   }
+   m_hSections[1] = m_hSections[0];
+   m_hSections[0] = hSection;
+   return Status::Ok;
+}
+
+
+/* static */ CString SharedPaletteStore::GetSectionName(const CString& strName, UINT64 generation)
+{
+   CString strSectionName;
+   strSectionName.Format(TEXT("%s.%I64u"), static_cast<LPCTSTR>(strName), generation);
+   return strSectionName;
+}
+
+bool SharedPaletteStore::ReadHeader(UINT64* pGeneration, UINT64* pcbSection) const
+{
+   _ASSERTE(pGeneration);
+   _ASSERTE(pcbSection);
+
+   // Readers have the header mapped read-only, so they cannot use interlocked operations, which
+   // write; instead, they read the sequence number directly, with barriers to keep the reads of
+   // the fields between the two reads of it.
+   //
+   // An update only takes a few stores, so a reader that keeps finding one in progress has most
+   // likely caught a writer that exited partway through. Rather than wait for it forever, the
+   // reader gives up, and the caller carries on with the table that it already has, until a new
+   // writer takes over the store (which, in Create(), completes the abandoned update).
+   for (int attempt = 0; attempt < kcReadAttemptsMax; ++attempt)
+   {
+      const auto sequence = m_pHeader->sequence;
+      if ((sequence & 1) == 0)
+      {
+         ::MemoryBarrier();
+         *pGeneration = m_pHeader->generation;
+         *pcbSection  = m_pHeader->cbSection;
+         ::MemoryBarrier();
+         if (m_pHeader->sequence == sequence)
+         {
+            return true;
+         }
+      }
+      if (attempt < kcReadSpinsMax)
+      {
+         ::YieldProcessor();
+      }
+      else
+      {
+         ::SwitchToThread();  // (in case the writer was preempted in the middle of an update)
+      }
+   }
+   return false;
+}
+
+std::shared_ptr<const PaletteFile> SharedPaletteStore::MapSection(UINT64 generation, UINT64 cbSection) const
+{
+   if (cbSection > SIZE_MAX)
+   {
+      return nullptr;
+   }
+
+   const auto hSection = ::OpenFileMapping(FILE_MAP_READ, FALSE, GetSectionName(m_strName, generation));
+   if (!hSection)
+   {
+      return nullptr;
+   }
+   const auto pView = static_cast<const BYTE*>(::MapViewOfFile(hSection, FILE_MAP_READ, 0, 0, 0));
+   VERIFY(::CloseHandle(hSection));  // (the view keeps the section alive)
+   if (!pView)
+   {
+      return nullptr;
+   }
+
+   // Validate the structure of the palette file, so that nothing a writer puts in the section
+   // can make the accessors read out of bounds. The checksum is not verified, since a section is
+   // never modified once it is published, and verifying it would read the whole table up front.
+   const auto               cbData = static_cast<size_t>(cbSection);
+   MEMORY_BASIC_INFORMATION mbi;
+   if ((::VirtualQuery(pView, &mbi, sizeof(mbi)) != sizeof(mbi)) ||
+       (mbi.RegionSize < cbData)                                ||
+       (PaletteFile::Validate(pView, cbData, false) != PaletteFile::Status::Ok))
+   {
+      VERIFY(::UnmapViewOfFile(pView));
+      return nullptr;
+   }
+   return std::shared_ptr<const PaletteFile>(new PaletteFile(pView, cbData, true));
+}
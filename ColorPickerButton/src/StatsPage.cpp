@@ -0,0 +1,233 @@
+#include "PCH.hpp"
+#include "StatsPage.hpp"
+
+
+// The layout of a page. The writer only changes the statistics while the sequence number is odd.
+struct StatsPage::Layout
+{
+   UINT32        magic;
+   UINT32        version;
+   volatile LONG sequence;  // (a LONG, rather than a 64-bit value, so that it is read atomically on x86, too)
+   UINT32        reserved;
+   Stats         stats;
+};
+
+
+namespace {
+
+constexpr UINT32 kMagic   = 0x53545043;  // "CPTS", little-endian
+constexpr UINT32 kVersion = 1;           // changes whenever the layout of the page changes
+
+void SetStatus(StatsPage::Status* pStatus, StatsPage::Status status)
+{
+   if (pStatus)
+   {
+      *pStatus = status;
+   }
+}
+
+}  // anonymous namespace
+
+
+/* static */ std::shared_ptr<StatsPage> StatsPage::Create(LPCTSTR pszName, Status* pStatus /* = nullptr */)
+{
+   _ASSERTE(pszName);
+
+   SetStatus(pStatus, Status::IoError);
+   const auto hPage = ::CreateFileMapping(INVALID_HANDLE_VALUE,
+                                          nullptr,
+                                          PAGE_READWRITE,
+                                          0,
+                                          sizeof(Layout),
+                                          pszName);
+   if (!hPage)
+   {
+      return nullptr;
+   }
+   const auto existed = (::GetLastError() == ERROR_ALREADY_EXISTS);
+   const auto pLayout = static_cast<Layout*>(::MapViewOfFile(hPage, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(Layout)));
+   if (!pLayout)
+   {
+      VERIFY(::CloseHandle(hPage));
+      return nullptr;
+   }
+
+   // A new mapping is zero-filled. The magic number is written last, so that a reader
+   // never sees a page that claims to be one before it has been initialized.
+   if (!existed || (pLayout->magic == 0))
+   {
+      pLayout->version = kVersion;
+      ::MemoryBarrier();
+      pLayout->magic   = kMagic;
+   }
+   else if ((pLayout->magic != kMagic) || (pLayout->version != kVersion))
+   {
+      VERIFY(::UnmapViewOfFile(pLayout));
+      VERIFY(::CloseHandle(hPage));
+      SetStatus(pStatus, Status::NotStatsPage);
+      return nullptr;
+   }
+   else if ((pLayout->sequence & 1) != 0)
+   {
+      // The previous writer exited in the middle of an update, which would leave readers
+      // waiting for it forever. At worst, one of the statistics is off by one.
+      ::InterlockedIncrement(&pLayout->sequence);
+   }
+
+   SetStatus(pStatus, Status::Ok);
+   return std::shared_ptr<StatsPage>(new StatsPage(pszName, hPage, pLayout, true));
+}
+
+/* static */ std::shared_ptr<const StatsPage> StatsPage::Open(LPCTSTR pszName, Status* pStatus /* = nullptr */)
+{
+   _ASSERTE(pszName);
+
+   const auto hPage = ::OpenFileMapping(FILE_MAP_READ, FALSE, pszName);
+   if (!hPage)
+   {
+      SetStatus(pStatus, (::GetLastError() == ERROR_FILE_NOT_FOUND) ? Status::NotFound : Status::IoError);
+      return nullptr;
+   }
+
+   // Check the size of the mapping before looking at it, since it may be any object of that name.
+   const auto               pLayout = static_cast<Layout*>(::MapViewOfFile(hPage, FILE_MAP_READ, 0, 0, 0));
+   MEMORY_BASIC_INFORMATION mbi;
+   if (!pLayout || (::VirtualQuery(pLayout, &mbi, sizeof(mbi)) != sizeof(mbi)))
+   {
+      if (pLayout)
+      {
+         VERIFY(::UnmapViewOfFile(pLayout));
+      }
+      VERIFY(::CloseHandle(hPage));
+      SetStatus(pStatus, Status::IoError);
+      return nullptr;
+   }
+   if ((mbi.RegionSize < sizeof(Layout)) || (pLayout->magic != kMagic) || (pLayout->version != kVersion))
+   {
+      VERIFY(::UnmapViewOfFile(pLayout));
+      VERIFY(::CloseHandle(hPage));
+      SetStatus(pStatus, Status::NotStatsPage);
+      return nullptr;
+   }
+
+   SetStatus(pStatus, Status::Ok);
+   return std::shared_ptr<const StatsPage>(new StatsPage(pszName, hPage, pLayout, false));
+}
+
+
+StatsPage::StatsPage(CString strName, HANDLE hPage, Layout* pLayout, bool isWriter)
+   : m_strName       (std::move(strName))
+   , m_hPage         (hPage)
+   , m_pLayout       (pLayout)
+   , m_isWriter      (isWriter)
+   , m_writerThreadId(isWriter ? ::GetCurrentThreadId() : 0)
+{
+   _ASSERTE(m_hPage);
+   _ASSERTE(m_pLayout);
+}
+
+StatsPage::~StatsPage()
+{
+   VERIFY(::UnmapViewOfFile(m_pLayout));
+   VERIFY(::CloseHandle(m_hPage));
+}
+
+const CString& StatsPage::GetName() const
+{
+   return m_strName;
+}
+
+StatsPage::Stats StatsPage::Read() const
+{
+   // Readers have the page mapped read-only, so they cannot use interlocked operations, which
+   // write; instead, they read the sequence number directly, with barriers to keep the reads of
+   // the statistics between the two reads of it.
+   for (;;)
+   {
+      const auto sequence = m_pLayout->sequence;
+      if ((sequence & 1) == 0)
+      {
+         ::MemoryBarrier();
+         Stats stats;
+         memcpy(&stats, &m_pLayout->stats, sizeof(stats));
+         ::MemoryBarrier();
+         if (m_pLayout->sequence == sequence)
+         {
+            return stats;
+         }
+      }
+      ::YieldProcessor();
+   }
+}
+
+void StatsPage::Reset()
+{
+   this->Write([](Stats& stats)
+   {
+      stats = Stats();
+   });
+}
+
+void StatsPage::RecordOpen(UINT64 openTime)
+{
+   this->Write([openTime](Stats& stats)
+   {
+      ++stats.cOpens;
+      stats.openTimeTotal += openTime;
+      stats.openTimeMax    = std::max(stats.openTimeMax, openTime);
+   });
+}
+
+void StatsPage::RecordHoverEvent()
+{
+   this->Write([](Stats& stats)
+   {
+      ++stats.cHoverEvents;
+   });
+}
+
+void StatsPage::RecordKeyEvent()
+{
+   this->Write([](Stats& stats)
+   {
+      ++stats.cKeyEvents;
+   });
+}
+
+void StatsPage::RecordNotification()
+{
+   this->Write([](Stats& stats)
+   {
+      ++stats.cNotifications;
+   });
+}
+
+void StatsPage::RecordCacheLookup(bool hit)
+{
+   this->Write([hit](Stats& stats)
+   {
+      ++(hit ? stats.cCacheHits : stats.cCacheMisses);
+   });
+}
+
+void StatsPage::SetGdiObjectsHeld(UINT64 cObjects)
+{
+   this->Write([cObjects](Stats& stats)
+   {
+      stats.cGdiObjectsHeld = cObjects;
+   });
+}
+
+
+template <typename Update>
+void StatsPage::Write(Update update)
+{
+   _ASSERTE(m_isWriter);
+   _ASSERTE(::GetCurrentThreadId() == m_writerThreadId);
+
+   // The interlocked increments are full barriers, so the statistics are only written while the
+   // sequence number is odd. There is only one writer, so the statistics can be read directly.
+   ::InterlockedIncrement(&m_pLayout->sequence);
+   update(m_pLayout->stats);
+   ::InterlockedIncrement(&m_pLayout->sequence);
+}
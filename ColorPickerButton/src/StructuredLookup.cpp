@@ -0,0 +1,279 @@
+#include "PCH.hpp"
+#include "StructuredLookup.hpp"
+#include "MemoryUsage.hpp"
+#include <climits>                // for CHAR_BIT
+
+
+namespace {
+
+constexpr UINT16 kNoEntry = 0xFFFF;
+
+// Builds the sorted list of distinct values that are present in the specified 256-entry mask.
+std::vector<BYTE> LevelsFromMask(const std::array<bool, 256>& present)
+{
+   std::vector<BYTE> levels;
+   for (size_t value = 0; value < present.size(); ++value)
+   {
+      if (present[value])
+      {
+         levels.push_back(static_cast<BYTE>(value));
+      }
+   }
+   return levels;
+}
+
+}  // anonymous namespace
+
+StructuredLookup::StructuredLookup(const std::vector<COLORREF>& colors)
+   : m_kind       (Kind::Irregular)
+   , m_channels   ()
+   , m_indexOfCell()
+   , m_grayNearest()
+   , m_grayTied   ()
+{
+   _ASSERTE(colors.size() <= kNoEntry);  // the largest index must be less than kNoEntry
+   if (!colors.empty())
+   {
+      if (this->DetectLattice(colors))
+      {
+         m_kind = Kind::Lattice;
+      }
+      else if (this->DetectGrayRamp(colors))
+      {
+         m_kind = Kind::GrayRamp;
+      }
+   }
+}
+
+StructuredLookup::Kind StructuredLookup::GetKind() const
+{
+   return m_kind;
+}
+
+size_t StructuredLookup::GetExternalByteSize() const
+{
+   auto cb = GetVectorByteSize(m_indexOfCell) + GetVectorByteSize(m_grayNearest) + (m_grayTied.capacity() / CHAR_BIT);
+   for (const auto& channel : m_channels)
+   {
+      cb += GetVectorByteSize(channel.levels);
+   }
+   return cb;
+}
+
+std::array<size_t, 3> StructuredLookup::GetLevelCounts() const
+{
+   switch (m_kind)
+   {
+      case Kind::Lattice:
+         return { m_channels[0].levels.size(), m_channels[1].levels.size(), m_channels[2].levels.size() };
+      case Kind::GrayRamp:
+         return { m_channels[0].levels.size(), m_channels[0].levels.size(), m_channels[0].levels.size() };
+      default:
+         return { 0, 0, 0 };
+   }
+}
+
+/* static */ void StructuredLookup::TabulateNearestLevels(Channel& channel)
+{
+   // Map each value of the channel onto the nearest level. A value that lies exactly halfway
+   // between two levels maps to the lower one, and is flagged so that lookups can consider both.
+   size_t k = 0;
+   for (int value = 0; value < 256; ++value)
+   {
+      while (((k + 1) < channel.levels.size())
+          && (std::abs(channel.levels[k + 1] - value) < std::abs(channel.levels[k] - value)))
+      {
+         ++k;
+      }
+      channel.nearest[value] = static_cast<BYTE>(k);
+      channel.tied   [value] = ((k + 1) < channel.levels.size())
+                            && (std::abs(channel.levels[k + 1] - value) == std::abs(channel.levels[k] - value));
+   }
+}
+
+void StructuredLookup::Clear()
+{
+   m_channels = {};
+   std::vector<UINT16>().swap(m_indexOfCell);
+}
+
+size_t StructuredLookup::CellFromLevels(size_t r, size_t g, size_t b) const
+{
+   return (((r * m_channels[1].levels.size()) + g) * m_channels[2].levels.size()) + b;
+}
+
+bool StructuredLookup::DetectLattice(const std::vector<COLORREF>& colors)
+{
+   // Find the distinct levels used by each channel. The table can only be a lattice
+   // if it has exactly as many entries as there are combinations of those levels.
+   std::array<std::array<bool, 256>, 3> present = {};
+   for (const auto clr : colors)
+   {
+      present[0][GetRValue(clr)] = true;
+      present[1][GetGValue(clr)] = true;
+      present[2][GetBValue(clr)] = true;
+   }
+   for (size_t axis = 0; axis < m_channels.size(); ++axis)
+   {
+      m_channels[axis].levels = LevelsFromMask(present[axis]);
+   }
+   const auto cCells = m_channels[0].levels.size() * m_channels[1].levels.size() * m_channels[2].levels.size();
+   if (cCells != colors.size())
+   {
+      this->Clear();
+      return false;
+   }
+
+   for (auto& channel : m_channels)
+   {
+      TabulateNearestLevels(channel);
+   }
+
+   // Assign each entry to its cell. Since the number of cells equals the number of entries,
+   // the table is a lattice if (and only if) no two entries fall into the same cell.
+   m_indexOfCell.assign(cCells, kNoEntry);
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      const auto clr  = colors[i];
+      const auto cell = this->CellFromLevels(m_channels[0].nearest[GetRValue(clr)],
+                                             m_channels[1].nearest[GetGValue(clr)],
+                                             m_channels[2].nearest[GetBValue(clr)]);
+      if (m_indexOfCell[cell] != kNoEntry)
+      {
+         this->Clear();
+         return false;
+      }
+      m_indexOfCell[cell] = static_cast<UINT16>(i);
+   }
+   return true;
+}
+
+bool StructuredLookup::DetectGrayRamp(const std::vector<COLORREF>& colors)
+{
+   // Every entry must be a distinct shade of gray.
+   std::array<bool, 256>   present = {};
+   std::array<UINT16, 256> indices;
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      const auto clr   = colors[i];
+      const auto value = GetRValue(clr);
+      if ((GetGValue(clr) != value) || (GetBValue(clr) != value) || present[value])
+      {
+         return false;
+      }
+      present[value] = true;
+      indices[value] = static_cast<UINT16>(i);
+   }
+
+   auto& channel  = m_channels[0];
+   channel.levels = LevelsFromMask(present);
+   TabulateNearestLevels(channel);
+   m_indexOfCell.clear();
+   for (const auto level : channel.levels)
+   {
+      m_indexOfCell.push_back(indices[level]);
+   }
+
+   // The squared distance from (r, g, b) to the gray (v, v, v) is 3v^2 - 2v(r + g + b) + C,
+   // which is minimized by the gray nearest to (r + g + b) / 3. Tabulate the nearest level
+   // (and whether the next level up is equally near) for each possible sum of the channels.
+   constexpr int kcSums = (255 * 3) + 1;
+   m_grayNearest.resize(kcSums);
+   m_grayTied   .resize(kcSums);
+   size_t k = 0;
+   for (int sum = 0; sum < kcSums; ++sum)
+   {
+      while (((k + 1) < channel.levels.size())
+          && (std::abs((3 * channel.levels[k + 1]) - sum) < std::abs((3 * channel.levels[k]) - sum)))
+      {
+         ++k;
+      }
+      m_grayNearest[sum] = static_cast<UINT16>(k);
+      m_grayTied   [sum] = ((k + 1) < channel.levels.size())
+                        && (std::abs((3 * channel.levels[k + 1]) - sum) == std::abs((3 * channel.levels[k]) - sum));
+   }
+   return true;
+}
+
+size_t StructuredLookup::FindExact(COLORREF clr) const
+{
+   _ASSERTE(m_kind != Kind::Irregular);
+   switch (m_kind)
+   {
+      case Kind::Lattice:
+      {
+         const size_t k[3] = { m_channels[0].nearest[GetRValue(clr)],
+                               m_channels[1].nearest[GetGValue(clr)],
+                               m_channels[2].nearest[GetBValue(clr)] };
+         if ((m_channels[0].levels[k[0]] == GetRValue(clr))
+          && (m_channels[1].levels[k[1]] == GetGValue(clr))
+          && (m_channels[2].levels[k[2]] == GetBValue(clr)))
+         {
+            return m_indexOfCell[this->CellFromLevels(k[0], k[1], k[2])];
+         }
+         return kInvalidIndex;
+      }
+      case Kind::GrayRamp:
+      {
+         const auto value = GetRValue(clr);
+         if ((GetGValue(clr) == value) && (GetBValue(clr) == value))
+         {
+            const auto k = m_channels[0].nearest[value];
+            if (m_channels[0].levels[k] == value)
+            {
+               return m_indexOfCell[k];
+            }
+         }
+         return kInvalidIndex;
+      }
+      default:
+         return kInvalidIndex;
+   }
+}
+
+size_t StructuredLookup::FindNearest(COLORREF clr) const
+{
+   _ASSERTE(m_kind != Kind::Irregular);
+   switch (m_kind)
+   {
+      case Kind::Lattice:
+      {
+         const BYTE values[3] = { GetRValue(clr), GetGValue(clr), GetBValue(clr) };
+         size_t     k[3];
+         size_t     cAlternatives[3];
+         for (size_t axis = 0; axis < 3; ++axis)
+         {
+            k[axis]             = m_channels[axis].nearest[values[axis]];
+            cAlternatives[axis] = m_channels[axis].tied[values[axis]] ? 2 : 1;
+         }
+
+         // In the common case, each channel has a single nearest level. Otherwise, every combination
+         // of the tied levels is equally near, so choose whichever comes first in the table.
+         auto best = static_cast<size_t>(m_indexOfCell[this->CellFromLevels(k[0], k[1], k[2])]);
+         for (size_t dr = 0; dr < cAlternatives[0]; ++dr)
+         {
+            for (size_t dg = 0; dg < cAlternatives[1]; ++dg)
+            {
+               for (size_t db = 0; db < cAlternatives[2]; ++db)
+               {
+                  best = std::min(best, static_cast<size_t>(m_indexOfCell[this->CellFromLevels(k[0] + dr, k[1] + dg, k[2] + db)]));
+               }
+            }
+         }
+         return best;
+      }
+      case Kind::GrayRamp:
+      {
+         const auto sum  = GetRValue(clr) + GetGValue(clr) + GetBValue(clr);
+         const auto k    = m_grayNearest[sum];
+         auto       best = static_cast<size_t>(m_indexOfCell[k]);
+         if (m_grayTied[sum])
+         {
+            best = std::min(best, static_cast<size_t>(m_indexOfCell[k + 1]));
+         }
+         return best;
+      }
+      default:
+         return kInvalidIndex;
+   }
+}
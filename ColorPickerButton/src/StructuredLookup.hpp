@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+
+// Detects structurally regular color tables and, for those tables, answers exact and nearest-color
+// queries with closed-form index arithmetic instead of a search. Two structures are recognized:
+//
+//  - Lattices: tables that contain every combination of some set of red, green, and blue levels
+//    exactly once, in any order (for example, the 6 x 6 x 6 "web-safe" cube or the 8 x 8 x 4
+//    "3-3-2" set). Since a lattice is separable, the nearest entry (by Euclidean distance in RGB)
+//    is found by independently choosing the nearest level for each channel.
+//  - Gray ramps: tables whose entries are all distinct shades of gray. The nearest gray to any
+//    color is the one nearest to the mean of its channels.
+//
+// Both lookups resolve ties in favor of the lower table index, so they agree exactly with
+// a brute-force search of the table.
+class StructuredLookup
+{
+public:
+
+   enum class Kind
+   {
+      Irregular,  // no usable structure; queries must use a general index
+      Lattice,
+      GrayRamp,
+   };
+
+   static constexpr size_t kInvalidIndex = static_cast<size_t>(-1);
+
+   // Examines the specified colors for regular structure.
+   explicit StructuredLookup(const std::vector<COLORREF>& colors);
+
+   // Returns the kind of structure that was detected.
+   Kind GetKind() const;
+
+   // Returns the number of distinct levels in each channel (red, green, blue) for a lattice,
+   // or the number of shades in each channel for a gray ramp, or zeros for irregular tables.
+   std::array<size_t, 3> GetLevelCounts() const;
+
+   // Returns the index of the entry with exactly the specified color, or kInvalidIndex if there
+   // is none. Must not be called for irregular tables.
+   size_t FindExact(COLORREF clr) const;
+
+   // Returns the index of the entry nearest to the specified color.
+   // Must not be called for irregular tables.
+   size_t FindNearest(COLORREF clr) const;
+
+   // Returns the number of bytes of memory that the lookup holds outside of itself.
+   size_t GetExternalByteSize() const;
+
+private:
+
+   // The distinct values taken by a channel, along with a table mapping
+   // each possible value of the channel to the nearest of those levels.
+   struct Channel
+   {
+      std::vector<BYTE>      levels;   // sorted in ascending order
+      std::array<BYTE, 256>  nearest;  // index of the nearest level (the lower one, on a tie)
+      std::array<bool, 256>  tied;     // true if the next-higher level is equally near
+   };
+
+   static void TabulateNearestLevels(Channel& channel);
+
+   // Each of these detects a structure, and records it if it is found. Otherwise, nothing is recorded
+   // (whatever had been worked out before the structure was ruled out is discarded).
+   bool DetectLattice (const std::vector<COLORREF>& colors);
+   bool DetectGrayRamp(const std::vector<COLORREF>& colors);
+
+   // Discards the levels of every channel, and the cells.
+   void Clear();
+
+   size_t CellFromLevels(size_t r, size_t g, size_t b) const;
+
+private:
+   Kind                   m_kind;
+   std::array<Channel, 3> m_channels;       // red, green, and blue (only red is used for gray ramps)
+   std::vector<UINT16>    m_indexOfCell;    // table index of each lattice cell or gray level
+   std::vector<UINT16>    m_grayNearest;    // nearest gray level for each possible sum of the channels
+   std::vector<bool>      m_grayTied;       // true if the next-higher gray level is equally near
+};
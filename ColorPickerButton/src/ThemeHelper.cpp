@@ -58,6 +58,36 @@ HTHEME Internal_OpenTheme(HMODULE hModule, HWND hWnd, LPCTSTR pszClassList)
    return false;
 }
 
+/* static */ CString ThemeHelper::GetCurrentThemeName()
+{
+   CString strName;
+   if (IsWinXPOrLater())
+   {
+      const auto hModule = ::LoadLibrary(kpszUxThemeDll);
+      if (hModule)
+      {
+         if (Internal_IsThemed(hModule))
+         {
+            typedef HRESULT (WINAPI * pfGetCurrentThemeName)(LPWSTR, int, LPWSTR, int, LPWSTR, int);
+            const auto pfGCTN = reinterpret_cast<pfGetCurrentThemeName>(::GetProcAddress(hModule, _CRT_STRINGIZE(GetCurrentThemeName)));
+            _ASSERTE(pfGCTN);  // if the UxTheme module is available, this function should be, too
+
+            WCHAR szFile [MAX_PATH];
+            WCHAR szColor[MAX_PATH];
+            WCHAR szSize [MAX_PATH];
+            if (pfGCTN && SUCCEEDED(pfGCTN(szFile,  ARRAYSIZE(szFile),
+                                           szColor, ARRAYSIZE(szColor),
+                                           szSize,  ARRAYSIZE(szSize))))
+            {
+               strName.Format(_T("%ls;%ls;%ls"), szFile, szColor, szSize);
+            }
+         }
+         VERIFY(::FreeLibrary(hModule) != FALSE);
+      }
+   }
+   return strName;
+}
+
 /* static */ void ThemeHelper::SafeSetWindowTheme(HWND hWnd, LPCTSTR pszSubAppName, LPCTSTR pszSubIdList)
 {
    _ASSERTE(hWnd && (::IsWindow(hWnd)));
@@ -0,0 +1,127 @@
+#include "PCH.hpp"
+#include "TraceSink.hpp"
+#include <cstdio>
+
+
+namespace {
+
+// Appends a string to a JSON document, as a string literal.
+void AppendJsonString(std::string& json, const char* psz)
+{
+   json += '"';
+   for (; *psz; ++psz)
+   {
+      const auto ch = static_cast<unsigned char>(*psz);
+      if ((ch == '"') || (ch == '\\'))
+      {
+         json += '\\';
+         json += static_cast<char>(ch);
+      }
+      else if (ch < 0x20)
+      {
+         char szEscape[8];
+         std::snprintf(szEscape, sizeof(szEscape), "\\u%04x", ch);
+         json += szEscape;
+      }
+      else
+      {
+         json += static_cast<char>(ch);
+      }
+   }
+   json += '"';
+}
+
+}  // anonymous namespace
+
+
+ChromeTraceSink::ChromeTraceSink()
+   : m_eventsMutex()
+   , m_events     ()
+{
+}
+
+void ChromeTraceSink::OnTraceEvent(const TraceEvent& event)
+{
+   std::lock_guard<std::mutex> lock(m_eventsMutex);
+   m_events.push_back(event);
+}
+
+size_t ChromeTraceSink::GetEventCount() const
+{
+   std::lock_guard<std::mutex> lock(m_eventsMutex);
+   return m_events.size();
+}
+
+void ChromeTraceSink::Clear()
+{
+   std::lock_guard<std::mutex> lock(m_eventsMutex);
+   m_events.clear();
+}
+
+std::string ChromeTraceSink::ToJson() const
+{
+   std::lock_guard<std::mutex> lock(m_eventsMutex);
+
+   // Phases are "complete" events (with a duration), and instants are thread-scoped instant events.
+   const auto  processId = ::GetCurrentProcessId();
+   std::string json;
+   json.reserve(64 + (m_events.size() * 128));
+   json += "{\"traceEvents\":[";
+   for (size_t iEvent = 0; iEvent < m_events.size(); ++iEvent)
+   {
+      const auto& event = m_events[iEvent];
+      json += (iEvent == 0) ? "\n" : ",\n";
+      json += "{\"name\":";
+      AppendJsonString(json, event.pszName);
+
+      char szFields[160];
+      if (event.type == TraceEvent::Type::Phase)
+      {
+         std::snprintf(szFields, sizeof(szFields),
+                       ",\"cat\":\"ColorPickerButton\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+                       event.timestamp,
+                       event.duration,
+                       static_cast<unsigned long>(processId),
+                       static_cast<unsigned long>(event.threadId));
+      }
+      else
+      {
+         std::snprintf(szFields, sizeof(szFields),
+                       ",\"cat\":\"ColorPickerButton\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+                       event.timestamp,
+                       static_cast<unsigned long>(processId),
+                       static_cast<unsigned long>(event.threadId));
+      }
+      json += szFields;
+   }
+   json += "\n],\"displayTimeUnit\":\"ms\"}\n";
+   return json;
+}
+
+bool ChromeTraceSink::Write(LPCTSTR pszPath) const
+{
+   _ASSERTE(pszPath);
+
+   const auto json  = this->ToJson();
+   const auto hFile = ::CreateFile(pszPath,
+                                   GENERIC_WRITE,
+                                   0,
+                                   nullptr,
+                                   CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                   nullptr);
+   if (hFile == INVALID_HANDLE_VALUE)
+   {
+      return false;
+   }
+
+   DWORD      cbDone    = 0;
+   const auto succeeded = (::WriteFile(hFile, json.data(), static_cast<DWORD>(json.size()), &cbDone, nullptr) != FALSE) &&
+                          (cbDone == json.size());
+   VERIFY(::CloseHandle(hFile));
+   if (!succeeded)
+   {
+      VERIFY(::DeleteFile(pszPath));
+   }
+   return succeeded;
+}
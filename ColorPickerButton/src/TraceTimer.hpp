@@ -0,0 +1,86 @@
+#pragma once
+
+#include "TraceSink.hpp"
+
+
+// Times a phase, from its construction to its destruction, and reports it to a trace sink.
+// With no sink, it does nothing at all, not even read the performance counter. Use it through
+// the macros below, which compile to nothing unless COLORPICKERBUTTON_TRACE is defined.
+class TraceTimer
+{
+   TraceTimer           (const TraceTimer&) = delete;  // not copyable
+   TraceTimer& operator=(const TraceTimer&) = delete;  // not assignable
+
+public:
+
+   TraceTimer(TraceSink* pSink, const char* pszName)
+      : m_pSink  (pSink)
+      , m_pszName(pszName)
+      , m_start  (pSink ? GetTimestamp() : 0.0)
+   {
+   }
+
+   ~TraceTimer()
+   {
+      if (m_pSink)
+      {
+         const TraceEvent event = { m_pszName,
+                                    TraceEvent::Type::Phase,
+                                    m_start,
+                                    GetTimestamp() - m_start,
+                                    ::GetCurrentThreadId() };
+         m_pSink->OnTraceEvent(event);
+      }
+   }
+
+   // Reports an instant to a trace sink, if there is one.
+   static void Mark(TraceSink* pSink, const char* pszName)
+   {
+      if (pSink)
+      {
+         const TraceEvent event = { pszName,
+                                    TraceEvent::Type::Instant,
+                                    GetTimestamp(),
+                                    0.0,
+                                    ::GetCurrentThreadId() };
+         pSink->OnTraceEvent(event);
+      }
+   }
+
+   // Gets the current time, in microseconds, from the performance counter.
+   static double GetTimestamp()
+   {
+      static const auto frequency = []()
+      {
+         LARGE_INTEGER li;
+         VERIFY(::QueryPerformanceFrequency(&li));
+         return li.QuadPart;
+      }();
+
+      // (Split into whole seconds and the remainder, so that the multiplication cannot lose precision.)
+      LARGE_INTEGER counter;
+      VERIFY(::QueryPerformanceCounter(&counter));
+      const auto seconds = counter.QuadPart / frequency;
+      const auto ticks   = counter.QuadPart % frequency;
+      return (static_cast<double>(seconds) * 1e6) + ((static_cast<double>(ticks) * 1e6) / static_cast<double>(frequency));
+   }
+
+private:
+   TraceSink* const  m_pSink;
+   const char* const m_pszName;
+   const double      m_start;
+};
+
+
+// TRACE_PHASE(pSink, "name") times the rest of the enclosing scope as a phase of that name, and
+// TRACE_INSTANT(pSink, "name") records an instant. Either one evaluates its sink argument only
+// if tracing is compiled in, so the sink may be looked up by an expression with no side effects.
+#ifdef COLORPICKERBUTTON_TRACE
+#define TRACE_PHASE_CONCAT2(a, b)     a##b
+#define TRACE_PHASE_CONCAT(a, b)      TRACE_PHASE_CONCAT2(a, b)
+#define TRACE_PHASE(pSink, pszName)   const TraceTimer TRACE_PHASE_CONCAT(traceTimer, __LINE__)((pSink), (pszName))
+#define TRACE_INSTANT(pSink, pszName) TraceTimer::Mark((pSink), (pszName))
+#else
+#define TRACE_PHASE(pSink, pszName)   ((void)0)
+#define TRACE_INSTANT(pSink, pszName) ((void)0)
+#endif
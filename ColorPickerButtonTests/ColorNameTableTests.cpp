@@ -0,0 +1,131 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorNameTable.hpp"
+#include "PaletteFile.hpp"
+
+
+namespace {
+
+// Names entry i "Color i" (with three digits, so that every name is the same length).
+CString MakeName(size_t index)
+{
+   CString strName;
+   strName.Format(TEXT("Color %03zu"), index);
+   return strName;
+}
+
+// A resolver that names the entries with MakeName(), and counts how many times each one was resolved.
+struct CountingResolver
+{
+   std::shared_ptr<std::vector<size_t>> pcResolved = std::make_shared<std::vector<size_t>>(100);
+
+   ColorNameTable::Resolver Get() const
+   {
+      return [pcResolved = pcResolved](size_t index)
+      {
+         ++(*pcResolved)[index];
+         return MakeName(index);
+      };
+   }
+
+   size_t GetCount(size_t index) const
+   {
+      return (*pcResolved)[index];
+   }
+};
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorNameTable, ResolvesNamesFromACallback)
+{
+   const CountingResolver resolver;
+   const auto             pNames = ColorNameTable::FromCallback(resolver.Get());
+   CHECK(pNames->GetName(7)     == TEXT("Color 007"));
+   CHECK(pNames->ResolveName(8) == TEXT("Color 008"));
+   CHECK(pNames->GetName(0)     == TEXT("Color 000"));
+}
+
+TEST_CASE(ColorNameTable, ResolvesNamesFromALocaleFile)
+{
+   const ColorPickerButton::ColorTable locale = { { RGB(0, 0, 0), TEXT("Noir")  },
+                                                  { RGB(1, 1, 1), TEXT("Blanc") },
+                                                  { RGB(2, 2, 2), TEXT("Rouge") } };
+   const auto data        = PaletteFile::Serialize(locale, PaletteFile::DefaultWriteOptions());
+   const auto pLocaleFile = PaletteFile::FromMemory(data.data(), data.size());
+   REQUIRE(pLocaleFile);
+
+   // By index, and then by key (where a key out of range, or an entry without a key, has no name).
+   const auto pByIndex = ColorNameTable::FromLocaleFile(pLocaleFile);
+   CHECK(pByIndex->GetName(0) == TEXT("Noir"));
+   CHECK(pByIndex->GetName(2) == TEXT("Rouge"));
+   CHECK(pByIndex->GetName(3).IsEmpty());
+
+   const auto pByKey = ColorNameTable::FromLocaleFile(pLocaleFile, { 2, 0, 9 });
+   CHECK(pByKey->GetName(0) == TEXT("Rouge"));
+   CHECK(pByKey->GetName(1) == TEXT("Noir"));
+   CHECK(pByKey->GetName(2).IsEmpty());
+   CHECK(pByKey->GetName(3).IsEmpty());
+}
+
+TEST_CASE(ColorNameTable, CachesTheMostRecentlyUsedNames)
+{
+   const CountingResolver resolver;
+   const auto             pNames = ColorNameTable::FromCallback(resolver.Get(), 2);
+
+   pNames->GetName(0);
+   pNames->GetName(0);
+   CHECK(resolver.GetCount(0) == 1);
+
+   // With room for two names, using 0 again makes 1 the least recently used, so 2 evicts it.
+   pNames->GetName(1);
+   pNames->GetName(0);
+   pNames->GetName(2);
+   CHECK(resolver.GetCount(1) == 1);
+   CHECK(resolver.GetCount(2) == 1);
+   pNames->GetName(0);
+   pNames->GetName(2);
+   CHECK(resolver.GetCount(0) == 1);
+   CHECK(resolver.GetCount(2) == 1);
+   pNames->GetName(1);
+   CHECK(resolver.GetCount(1) == 2);
+}
+
+TEST_CASE(ColorNameTable, ResolvingBypassesTheCache)
+{
+   const CountingResolver resolver;
+   const auto             pNames = ColorNameTable::FromCallback(resolver.Get(), 2);
+   pNames->GetName(0);
+   pNames->GetName(1);
+   const auto cbCached = pNames->GetByteSize();
+
+   // Resolving every name neither finds them in the cache nor evicts what is there.
+   for (size_t index = 0; index < 50; ++index)
+   {
+      CHECK(pNames->ResolveName(index) == MakeName(index));
+   }
+   CHECK(resolver.GetCount(0) == 2);
+   CHECK(pNames->GetByteSize() == cbCached);
+   pNames->GetName(0);
+   pNames->GetName(1);
+   CHECK(resolver.GetCount(0) == 2);
+   CHECK(resolver.GetCount(1) == 2);
+}
+
+TEST_CASE(ColorNameTable, HoldsNoMoreThanItsCache)
+{
+   const CountingResolver resolver;
+   const auto             pNames  = ColorNameTable::FromCallback(resolver.Get(), 4);
+   const auto             cbEmpty = pNames->GetByteSize();
+   for (size_t index = 0; index < 4; ++index)
+   {
+      pNames->GetName(index);
+   }
+   const auto cbFull = pNames->GetByteSize();
+   CHECK(cbFull > cbEmpty);
+   for (size_t index = 4; index < 100; ++index)
+   {
+      pNames->GetName(index);
+   }
+   CHECK(pNames->GetByteSize() == cbFull);
+}
@@ -0,0 +1,949 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorPickerButton.hpp"
+#include "AllocationCheck.hpp"
+#include "ColorNameTable.hpp"
+#include "InputLog.hpp"
+#include "PaletteFile.hpp"
+#include "StatsPage.hpp"
+#include <functional>
+#include <random>
+
+
+// These tests and benchmarks drive a real button, in a hidden window, so they only run on Windows.
+// The pop-up window is driven with ColorPickerButton::ReplayInput(), which opens it, feeds it each
+// input, and paints the result after each one, so the hover and navigation cases time the hit-test
+// or the change of selection together with the painting that it causes.
+
+namespace {
+
+using ColorTable = ColorPickerButton::ColorTable;
+
+//////////////////////////////////////////////////
+// Windows
+//////////////////////////////////////////////////
+
+// A hidden top-level window, which passes the notifications that it receives to a handler, and
+// counts the times that its buttons ask it for their background.
+class HostWindow : public CWnd
+{
+public:
+   std::function<void(WPARAM, const NMHDR&)> onNotify;
+   UINT                                      cCtlColorButtons = 0;
+
+protected:
+   LRESULT WindowProc(UINT message, WPARAM wParam, LPARAM lParam) override
+   {
+      if (message == WM_CTLCOLORBTN)
+      {
+         ++cCtlColorButtons;
+      }
+      return CWnd::WindowProc(message, wParam, lParam);
+   }
+
+   BOOL OnNotify(WPARAM wParam, LPARAM lParam, LRESULT* pResult) override
+   {
+      if (onNotify)
+      {
+         onNotify(wParam, *reinterpret_cast<const NMHDR*>(lParam));
+      }
+      return CWnd::OnNotify(wParam, lParam, pResult);
+   }
+};
+
+// A hidden top-level window that holds a button, for the cases that need a real one.
+class ButtonHost
+{
+   ButtonHost           (const ButtonHost&) = delete;  // not copyable
+   ButtonHost& operator=(const ButtonHost&) = delete;  // not assignable
+
+public:
+
+   static constexpr UINT kidButton = 1000;
+
+   ButtonHost()
+   {
+      VERIFY(m_wndParent.CreateEx(0,
+                                  AfxRegisterWndClass(0),
+                                  _T("ColorPickerButtonTests"),
+                                  WS_POPUP,
+                                  CRect(0, 0, 200, 100),
+                                  nullptr,
+                                  0));
+      VERIFY(m_button.Create(_T("Color"),
+                             WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                             CRect(10, 10, 110, 34),
+                             &m_wndParent,
+                             kidButton));
+
+      // The swatches are the whole of the pop-up window, so that inputs can be placed on them.
+      m_button.SetShowDefault(false);
+      m_button.SetShowCustom(false);
+      m_button.SetShowTooltips(false);
+   }
+
+   ~ButtonHost()
+   {
+      for (const auto& pButton : m_otherButtons)
+      {
+         VERIFY(pButton->DestroyWindow());
+      }
+      VERIFY(m_button.DestroyWindow());
+      VERIFY(m_wndParent.DestroyWindow());
+   }
+
+   ColorPickerButton& GetButton()
+   {
+      return m_button;
+   }
+
+   // Creates another button in the window, with the specified ID, for the cases that need several.
+   ColorPickerButton& AddButton(UINT id)
+   {
+      m_otherButtons.push_back(std::make_unique<ColorPickerButton>());
+      auto& button = *m_otherButtons.back();
+      VERIFY(button.Create(_T("Color"),
+                           WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                           CRect(10, 40, 110, 64),
+                           &m_wndParent,
+                           id));
+      return button;
+   }
+
+   // Sets the handler for the notifications that the button sends its parent.
+   void SetNotifyHandler(std::function<void(WPARAM, const NMHDR&)> onNotify)
+   {
+      m_wndParent.onNotify = std::move(onNotify);
+   }
+
+   // Gets the number of times that the buttons have asked the window for their background.
+   UINT GetCtlColorButtonCount() const
+   {
+      return m_wndParent.cCtlColorButtons;
+   }
+
+private:
+   HostWindow                                      m_wndParent;
+   ColorPickerButton                               m_button;
+   std::vector<std::unique_ptr<ColorPickerButton>> m_otherButtons;
+};
+
+// A device context that draws into a bitmap in memory, as big as the button.
+class MemoryCanvas
+{
+   MemoryCanvas           (const MemoryCanvas&) = delete;  // not copyable
+   MemoryCanvas& operator=(const MemoryCanvas&) = delete;  // not assignable
+
+public:
+
+   explicit MemoryCanvas(CWnd& wnd)
+   {
+      CRect rcClient;
+      wnd.GetClientRect(&rcClient);
+      CClientDC dcWindow(&wnd);
+      VERIFY(m_dc.CreateCompatibleDC(&dcWindow));
+      VERIFY(m_bitmap.CreateCompatibleBitmap(&dcWindow, rcClient.Width(), rcClient.Height()));
+      m_pbitmapOriginal = m_dc.SelectObject(&m_bitmap);
+   }
+
+   ~MemoryCanvas()
+   {
+      m_dc.SelectObject(m_pbitmapOriginal);
+   }
+
+   HDC GetSafeHdc() const
+   {
+      return m_dc.GetSafeHdc();
+   }
+
+private:
+   CDC      m_dc;
+   CBitmap  m_bitmap;
+   CBitmap* m_pbitmapOriginal;
+};
+
+// Paints the button into the canvas, as it would be painted on the screen.
+void PaintInto(ColorPickerButton& button, const MemoryCanvas& canvas)
+{
+   button.SendMessage(WM_PRINTCLIENT, reinterpret_cast<WPARAM>(canvas.GetSafeHdc()), PRF_CLIENT);
+}
+
+//////////////////////////////////////////////////
+// Tables and Inputs
+//////////////////////////////////////////////////
+
+ColorTable MakeTable(size_t cColors, unsigned seed)
+{
+   std::mt19937 random(seed);
+   ColorTable   colorTable;
+   colorTable.reserve(cColors);
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      CString name;
+      name.Format(_T("Color %zu"), i);
+      colorTable.emplace_back(random() & 0x00FFFFFF, name);
+   }
+   return colorTable;
+}
+
+std::vector<COLORREF> ColorsOf(const ColorTable& colorTable)
+{
+   std::vector<COLORREF> colors;
+   colors.reserve(colorTable.size());
+   for (const auto& entry : colorTable)
+   {
+      colors.push_back(entry.first);
+   }
+   return colors;
+}
+
+InputEvent MakeEvent(InputEvent::Type type, DWORD time, UINT32 wParam, UINT32 lParam = 0)
+{
+   InputEvent event;
+   event.type   = type;
+   event.shift  = false;
+   event.time   = time;
+   event.wParam = wParam;
+   event.lParam = lParam;
+   return event;
+}
+
+// Gets the point at the center of the swatch at the specified position in the pop-up window,
+// in its client coordinates (when neither the default nor the custom option is shown).
+CPoint GetSwatchCenter(const ColorPickerButton& button, size_t position)
+{
+   const auto cColumns = static_cast<size_t>(button.GetColorTableGrid().cy);
+   return CPoint(::GetSystemMetrics(SM_CXEDGE) + static_cast<int>(position % cColumns) * ColorPickerButton::kszColorSwatch.cx + (ColorPickerButton::kszColorSwatch.cx / 2),
+                 ::GetSystemMetrics(SM_CYEDGE) + static_cast<int>(position / cColumns) * ColorPickerButton::kszColorSwatch.cy + (ColorPickerButton::kszColorSwatch.cy / 2));
+}
+
+// Makes a session that moves the mouse onto each of the swatches at the specified positions in
+// turn, and then cancels.
+InputLog MakeMoveLog(const ColorPickerButton& button, const std::vector<size_t>& positions)
+{
+   InputLog log;
+   log.SetInitialColor(CLR_DEFAULT);
+   DWORD time = 0;
+   for (const auto position : positions)
+   {
+      const auto point = GetSwatchCenter(button, position);
+      log.Append(MakeEvent(InputEvent::Type::MouseMove, time, 0, MAKELPARAM(point.x, point.y)));
+      time += 16;
+   }
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, time, VK_ESCAPE));
+   return log;
+}
+
+// Makes a session that hovers over the specified number of swatches, chosen at random from those
+// whose positions fit in the coordinates of a mouse message, and then cancels.
+InputLog MakeHoverLog(const ColorPickerButton& button, size_t cMoves, unsigned seed)
+{
+   const auto          cColumns   = static_cast<size_t>(button.GetColorTableGrid().cy);
+   const auto          cRowsMax   = static_cast<size_t>((SHRT_MAX / ColorPickerButton::kszColorSwatch.cy) - 1);
+   const auto          cPositions = std::min(button.GetColorCount(), cColumns * cRowsMax);
+   std::mt19937        random(seed);
+   std::vector<size_t> positions;
+   for (size_t i = 0; i < cMoves; ++i)
+   {
+      positions.push_back(random() % cPositions);
+   }
+   return MakeMoveLog(button, positions);
+}
+
+// Makes a list of positions that alternates between two swatches, so that every move changes
+// the selection.
+std::vector<size_t> Alternate(size_t position1, size_t position2, size_t cMoves)
+{
+   std::vector<size_t> positions;
+   for (size_t i = 0; i < cMoves; ++i)
+   {
+      positions.push_back(((i % 2) == 0) ? position1 : position2);
+   }
+   return positions;
+}
+
+// Replays a session, and returns the drawing work that it did.
+ColorPickerButton::PaintCounters CountReplay(ColorPickerButton& button, const InputLog& log)
+{
+   button.ResetPaintCounters();
+   button.ReplayInput(log);
+   return button.GetPaintCounters();
+}
+
+// Makes a session that moves the selection with the arrow keys, and then cancels.
+InputLog MakeNavigationLog(size_t cKeys, unsigned seed)
+{
+   const UINT   keys[] = { VK_RIGHT, VK_DOWN, VK_LEFT, VK_UP, VK_NEXT, VK_PRIOR };
+   std::mt19937 random(seed);
+   InputLog     log;
+   log.SetInitialColor(CLR_DEFAULT);
+   for (size_t i = 0; i < cKeys; ++i)
+   {
+      log.Append(MakeEvent(InputEvent::Type::KeyDown, static_cast<DWORD>(i * 16), keys[random() % ARRAYSIZE(keys)]));
+   }
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, static_cast<DWORD>(cKeys * 16), VK_ESCAPE));
+   return log;
+}
+
+//////////////////////////////////////////////////
+// Allocations
+//////////////////////////////////////////////////
+
+#if defined(_DEBUG)
+
+// The allocations from the CRT heap (which is where operator new, malloc, and CString get their
+// memory) made on each thread while it is counting them. (Only debug builds have the hook.)
+thread_local UINT64 t_cAllocations    = 0;
+thread_local bool   t_isCounting      = false;
+_CRT_ALLOC_HOOK     s_pfnPreviousHook = nullptr;
+
+int __cdecl CountAllocations(int                  allocType,
+                             void*                pvData,
+                             size_t               nSize,
+                             int                  nBlockUse,
+                             long                 lRequest,
+                             const unsigned char* szFileName,
+                             int                  nLine)
+{
+   if (t_isCounting && ((allocType == _HOOK_ALLOC) || (allocType == _HOOK_REALLOC)))
+   {
+      ++t_cAllocations;
+   }
+   return s_pfnPreviousHook ? s_pfnPreviousHook(allocType, pvData, nSize, nBlockUse, lRequest, szFileName, nLine)
+                            : TRUE;
+}
+
+// Replays a session, and returns the number of allocations that it made on this thread.
+UINT64 CountReplayAllocations(ColorPickerButton& button, const InputLog& log)
+{
+   // The control's own allocation checks (if they are compiled in) install a hook that does not
+   // chain to the one before it, when they are first used, so they are used before this one is.
+   static const auto isInstalled = []
+   {
+      {
+         CHECK_NO_ALLOCATIONS_IF(true, "CountReplayAllocations");
+      }
+      s_pfnPreviousHook = _CrtSetAllocHook(CountAllocations);
+      return true;
+   }();
+   (void)isInstalled;
+
+   t_cAllocations = 0;
+   t_isCounting   = true;
+   button.ReplayInput(log);
+   t_isCounting   = false;
+   return t_cAllocations;
+}
+
+#endif  // defined(_DEBUG)
+
+// The sizes of table, and the numbers of columns, that the benchmarks are run over.
+const size_t kTableSizes[]   = { 48, 1024, 16384, 65535 };
+const size_t kColumnCounts[] = { 8, 32, 256 };
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorPickerButton, HarnessDrivesARealButton)
+{
+   // (This checks the assumptions that the benchmarks below make about the harness.)
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColorTable(MakeTable(100, 1), 10);
+   CHECK(button.GetColorCount()     == 100);
+   CHECK(button.GetColorTableGrid() == CSize(10, 10));
+
+   // Printing the button into memory draws it.
+   MemoryCanvas canvas(button);
+   button.ResetPaintCounters();
+   PaintInto(button, canvas);
+   CHECK(button.GetPaintCounters().cButtonPaints == 1);
+
+   // Each input is replayed, at the swatch that it was placed on.
+   const auto log    = MakeHoverLog(button, 20, 2);
+   const auto result = button.ReplayInput(log);
+   CHECK(result.eventCosts.size() == log.GetEvents().size());
+   CHECK(!result.outcome.okayed);
+
+   InputLog click;
+   const auto point = GetSwatchCenter(button, 37);
+   click.SetInitialColor(CLR_DEFAULT);
+   click.Append(MakeEvent(InputEvent::Type::LButtonDown, 0, MK_LBUTTON, MAKELPARAM(point.x, point.y)));
+   const auto clicked = button.ReplayInput(click);
+   CHECK(clicked.outcome.okayed);
+   CHECK(clicked.outcome.clr == button.GetColorAt(37));
+}
+
+
+TEST_CASE(ColorPickerButton, HoverStaysWithinItsPaintBudget)
+{
+   // Each move onto another swatch must invalidate the pop-up window once and repaint it once,
+   // doing the same work as every other such repaint. A change that paints twice, invalidates
+   // the button as well, or draws more for each swatch, changes these counts. (They are compared
+   // with those of a session that only opens and closes, which the theme and the font decide.)
+   ButtonHost host;
+   auto&      button  = host.GetButton();
+   const auto cColors = size_t(100);
+   button.SetColorTable(MakeTable(cColors, 12), 10);
+   REQUIRE(button.GetColorAt(11) != button.GetColorAt(22));
+
+   const auto opened  = CountReplay(button, MakeMoveLog(button, {}));
+   const auto hovered = CountReplay(button, MakeMoveLog(button, { 11 }));
+   const auto moved   = CountReplay(button, MakeMoveLog(button, Alternate(11, 22, 20)));
+
+   const auto cFillsPerMove      = hovered.cFills      - opened.cFills;
+   const auto cThemeDrawsPerMove = hovered.cThemeDraws - opened.cThemeDraws;
+   CHECK(hovered.cPopupPaints   - opened.cPopupPaints   == 1);
+   CHECK(hovered.cInvalidations - opened.cInvalidations == 1);
+
+   // Unthemed, a swatch takes three fills (its background, its shadow, and its color), and the
+   // hot one takes two more for its highlight; themed, each takes one fill and one theme draw.
+   CHECK(cFillsPerMove      <= ((3 * cColors) + 2));
+   CHECK(cThemeDrawsPerMove <= (cColors + 3));
+
+   CHECK(moved.cPopupPaints       - opened.cPopupPaints   == 20);
+   CHECK(moved.cInvalidations     - opened.cInvalidations == 20);
+   CHECK(moved.cFills             - opened.cFills         == (20 * cFillsPerMove));
+   CHECK(moved.cThemeDraws        - opened.cThemeDraws    == (20 * cThemeDrawsPerMove));
+   CHECK(moved.cNotifications     == opened.cNotifications);      // (the selection is not tracked)
+   CHECK(moved.cGdiObjectsCreated == opened.cGdiObjectsCreated);
+   CHECK(moved.cButtonPaints      == opened.cButtonPaints);
+}
+
+TEST_CASE(ColorPickerButton, TrackingTheSelectionNotifiesOncePerMove)
+{
+   // While the selection is tracked, each move also sets the button's color, which notifies the
+   // parent once and invalidates the button once. (Both sessions end with a tracked color, which
+   // cancelling puts back, so that is left out of the difference.)
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColorTable(MakeTable(100, 13), 10);
+   button.SetTrackSelection(true);
+   REQUIRE(button.GetColorAt(11) != button.GetColorAt(22));
+
+   const auto moved2  = CountReplay(button, MakeMoveLog(button, Alternate(11, 22, 2)));
+   const auto moved22 = CountReplay(button, MakeMoveLog(button, Alternate(11, 22, 22)));
+   CHECK(moved22.cNotifications - moved2.cNotifications == 20);
+   CHECK(moved22.cInvalidations - moved2.cInvalidations == 40);
+   CHECK(moved22.cPopupPaints   - moved2.cPopupPaints   == 20);
+}
+
+TEST_CASE(ColorPickerButton, RepaintingTheButtonCopiesItsFace)
+{
+   // Once a face has been rendered into the cache, drawing it again is a single copy, with no
+   // fills, no theme draws, no new bitmaps, and no asking the parent for the background. Being
+   // told of a change to the system colors or settings, when nothing has actually changed, does
+   // not discard the face. (A face that cannot be cached is drawn directly, with the same work
+   // each time.)
+   ButtonHost   host;
+   auto&        button = host.GetButton();
+   MemoryCanvas canvas(button);
+   button.SetColor(RGB(12, 34, 56));
+
+   button.ResetPaintCounters();
+   PaintInto(button, canvas);
+   const auto first = button.GetPaintCounters();
+   button.ResetPaintCounters();
+   const auto cCtlColorButtons = host.GetCtlColorButtonCount();
+   PaintInto(button, canvas);
+   const auto again        = button.GetPaintCounters();
+   const auto isBackground = (host.GetCtlColorButtonCount() != cCtlColorButtons);
+   button.SendMessage(WM_SYSCOLORCHANGE);
+   button.SendMessage(WM_SETTINGCHANGE);
+   button.ResetPaintCounters();
+   PaintInto(button, canvas);
+   const auto afterChange = button.GetPaintCounters();
+
+   CHECK(first.cButtonPaints      == 1);
+   CHECK(again.cButtonPaints      == 1);
+   CHECK(again.cGdiObjectsCreated == 0);
+   CHECK(again.cInvalidations     == 0);
+   CHECK(again.cNotifications     == 0);
+   if ((first.cFaceCopies + first.cGdiObjectsCreated) == 1)
+   {
+      CHECK(again.cFaceCopies       == 1);
+      CHECK(again.cFills            == 0);
+      CHECK(again.cThemeDraws       == 0);
+      CHECK(!isBackground);
+      CHECK(afterChange.cFaceCopies == 1);
+   }
+   else
+   {
+      CHECK(again.cFaceCopies == 0);
+      CHECK(again.cFills      == first.cFills);
+      CHECK(again.cThemeDraws == first.cThemeDraws);
+   }
+}
+
+TEST_CASE(ColorPickerButton, HoverRecordsNoCacheLookups)
+{
+   // Hit-testing and painting look up the cached display order for every swatch, so looking it up
+   // must not write to the stats page (which a replay, unlike a real session, records nothing in).
+   CString strName;
+   strName.Format(_T("Local\\ColorPickerButtonTests.Hover.%lu"), ::GetCurrentProcessId());
+   const auto pStatsPage = StatsPage::Create(strName);
+   REQUIRE(pStatsPage);
+
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColorTable(MakeTable(1000, 14), 32);
+   button.SetStatsPage(pStatsPage);
+   button.ReplayInput(MakeHoverLog(button, 50, 15));
+   button.ReplayInput(MakeNavigationLog(50, 16));
+
+   const auto stats = pStatsPage->Read();
+   CHECK(stats.cCacheHits   == 0);
+   CHECK(stats.cCacheMisses == 0);
+   button.SetStatsPage(nullptr);
+}
+
+TEST_CASE(ColorPickerButton, ReplayReproducesTheOutcome)
+{
+   // Opened on the first swatch, the first arrow key selects it, and the rest move from there.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColorTable(MakeTable(100, 17), 10);
+   button.SetColor(RGB(1, 2, 3));
+
+   InputLog log;
+   log.SetInitialColor(button.GetColorAt(0));
+   log.Append(MakeEvent(InputEvent::Type::KeyDown,  0, VK_RIGHT));
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, 16, VK_RIGHT));
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, 32, VK_DOWN));
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, 48, VK_RETURN));
+   log.Append(MakeEvent(InputEvent::Type::KeyDown, 64, VK_LEFT));   // (after the window has closed)
+   log.SetOutcome({ true, false, button.GetColorAt(11) });
+
+   const auto result = button.ReplayInput(log);
+   CHECK(result.matchesLog);
+   CHECK(result.outcome.okayed);
+   CHECK(!result.outcome.custom);
+   CHECK(result.outcome.clr       == button.GetColorAt(11));
+   CHECK(result.eventCosts.size() == 4);
+   CHECK(button.GetColor()        == RGB(1, 2, 3));  // (a replay puts the button's color back)
+
+   // A log that went through its binary format replays the same, every time.
+   InputLog   decoded;
+   const auto data = log.Serialize();
+   REQUIRE(decoded.Deserialize(data.data(), data.size()) == InputLog::Status::Ok);
+   for (int i = 0; i < 3; ++i)
+   {
+      const auto again = button.ReplayInput(decoded);
+      CHECK(again.matchesLog);
+      CHECK(again.eventCosts.size() == 4);
+   }
+
+   // A session that no longer has the outcome that was recorded is reported as such (here,
+   // because Down moves further in a wider grid).
+   button.SetColorTable(MakeTable(100, 17), 20);
+   const auto wider = button.ReplayInput(log);
+   CHECK(!wider.matchesLog);
+   CHECK(wider.outcome.clr == button.GetColorAt(21));
+}
+
+TEST_CASE(ColorPickerButton, LettersSearchTheNamesBeforeTheAccelerators)
+{
+   // The default captions are "&Automatic" and "&More Colors...", so without the Alt key, the
+   // first letter of "Amber" or "Magenta" must start a query, rather than choose an option.
+   const ColorTable named = { { RGB(255,   0, 255), TEXT("Magenta") },
+                              { RGB(255, 191,   0), TEXT("Amber")   },
+                              { RGB(  0, 255, 255), TEXT("Aqua")    } };
+   ButtonHost       host;
+   auto&            button = host.GetButton();
+   button.SetColorTable(named, 3);
+   const auto typing = [](std::initializer_list<TCHAR> letters)
+   {
+      InputLog log;
+      log.SetInitialColor(CLR_DEFAULT);
+      DWORD time = 0;
+      for (const auto ch : letters)
+      {
+         log.Append(MakeEvent(InputEvent::Type::KeyDown, time,     static_cast<UINT32>(_totupper(ch))));
+         log.Append(MakeEvent(InputEvent::Type::Char,    time + 1, static_cast<UINT32>(ch)));
+         time += 16;
+      }
+      log.Append(MakeEvent(InputEvent::Type::KeyDown, time, VK_RETURN));
+      return log;
+   };
+
+   const auto amber = button.ReplayInput(typing({ 'a', 'm' }));
+   CHECK(amber.outcome.okayed);
+   CHECK(!amber.outcome.custom);
+   CHECK(amber.outcome.clr == RGB(255, 191, 0));
+
+   const auto magenta = button.ReplayInput(typing({ 'm', 'a', 'g' }));
+   CHECK(magenta.outcome.okayed);
+   CHECK(!magenta.outcome.custom);
+   CHECK(magenta.outcome.clr == RGB(255, 0, 255));
+
+   // With the Alt key, the accelerator is chosen, even though a name starts with its letter.
+   InputLog alt;
+   alt.SetInitialColor(RGB(0, 255, 255));
+   alt.Append(MakeEvent(InputEvent::Type::SysKeyDown, 0, 'A', (1U << 29U)));
+   const auto automatic = button.ReplayInput(alt);
+   CHECK(automatic.outcome.okayed);
+   CHECK(automatic.outcome.clr == CLR_DEFAULT);
+
+   // A table without names has nothing to search, so the letter alone chooses the accelerator.
+   const COLORREF colors[] = { RGB(255, 0, 255), RGB(255, 191, 0), RGB(0, 255, 255) };
+   button.SetColorTable(colors, ARRAYSIZE(colors), 3);
+   const auto unnamed = button.ReplayInput(typing({ 'm' }));
+   CHECK(unnamed.outcome.custom);
+}
+
+TEST_CASE(ColorPickerButton, AggregatedBatchesNotifyFromAButton)
+{
+   // The parent must be able to route CPN_BATCHCHANGED by control ID (with ON_NOTIFY), as it
+   // routes CPN_SELCHANGED, so it comes from the first button that changed.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColor(RGB(1, 2, 3));
+
+   UINT                cBatches = 0;
+   WPARAM              wParam   = 0;
+   NMHDR               hdr      = { };
+   NMCOLORPICKERBUTTON change   = { };
+   host.SetNotifyHandler([&](WPARAM wParamNotify, const NMHDR& hdrNotify)
+                         {
+                            if (hdrNotify.code == CPN_BATCHCHANGED)
+                            {
+                               const auto& nmcpbatch = reinterpret_cast<const NMCOLORPICKERBATCH&>(hdrNotify);
+                               ++cBatches;
+                               wParam = wParamNotify;
+                               hdr    = hdrNotify;
+                               CHECK(nmcpbatch.cChanges == 1);
+                               if (nmcpbatch.cChanges > 0)
+                               {
+                                  change = nmcpbatch.pChanges[0];
+                               }
+                            }
+                         });
+   {
+      ColorPickerButton::BatchUpdate batch(ColorPickerButton::BatchNotification::Aggregated);
+      button.SetColor(RGB(4, 5, 6));
+      button.SetColor(RGB(7, 8, 9));
+      CHECK(cBatches == 0);
+   }
+   CHECK(cBatches           == 1);
+   CHECK(hdr.hwndFrom       == button.GetSafeHwnd());
+   CHECK(hdr.idFrom         == ButtonHost::kidButton);
+   CHECK(wParam             == ButtonHost::kidButton);
+   CHECK(change.hdr.idFrom  == ButtonHost::kidButton);
+   CHECK(change.clrCurrent  == RGB(7, 8, 9));
+   CHECK(change.clrPrevious == RGB(1, 2, 3));
+}
+
+TEST_CASE(ColorPickerButton, AggregatedBatchesCountOneNotificationEach)
+{
+   // Two buttons that change in a batch send their parent one message, which is counted once,
+   // by the button that sends it.
+   ButtonHost host;
+   auto&      first  = host.GetButton();
+   auto&      second = host.AddButton(ButtonHost::kidButton + 1);
+   first.SetColor(RGB(1, 2, 3));
+   second.SetColor(RGB(1, 2, 3));
+
+   UINT   cBatches = 0;
+   size_t cChanges = 0;
+   host.SetNotifyHandler([&](WPARAM, const NMHDR& hdr)
+                         {
+                            if (hdr.code == CPN_BATCHCHANGED)
+                            {
+                               ++cBatches;
+                               cChanges += reinterpret_cast<const NMCOLORPICKERBATCH&>(hdr).cChanges;
+                            }
+                         });
+   const auto cFirstBefore  = first.GetPaintCounters().cNotifications;
+   const auto cSecondBefore = second.GetPaintCounters().cNotifications;
+   {
+      ColorPickerButton::BatchUpdate batch(ColorPickerButton::BatchNotification::Aggregated);
+      first.SetColor(RGB(4, 5, 6));
+      second.SetColor(RGB(7, 8, 9));
+   }
+   CHECK(cBatches == 1);
+   CHECK(cChanges == 2);
+   CHECK(first.GetPaintCounters().cNotifications  == cFirstBefore + 1);
+   CHECK(second.GetPaintCounters().cNotifications == cSecondBefore);
+}
+
+TEST_CASE(ColorPickerButton, AggregatedBatchesNotifyTheParentsInOrder)
+{
+   // Each parent is notified in the order that its first button changed (whatever the order of
+   // their handles), so a batch that changes them the other way around notifies them the other way.
+   ButtonHost host1;
+   ButtonHost host2;
+   auto&      button1 = host1.GetButton();
+   auto&      button2 = host2.GetButton();
+   button1.SetColor(RGB(1, 2, 3));
+   button2.SetColor(RGB(1, 2, 3));
+
+   std::vector<HWND> senders;
+   const auto        record = [&senders](WPARAM, const NMHDR& hdr)
+   {
+      if (hdr.code == CPN_BATCHCHANGED)
+      {
+         senders.push_back(hdr.hwndFrom);
+      }
+   };
+   host1.SetNotifyHandler(record);
+   host2.SetNotifyHandler(record);
+
+   const auto changeInOrder = [&senders](ColorPickerButton& first, ColorPickerButton& second, COLORREF clr)
+   {
+      senders.clear();
+      {
+         ColorPickerButton::BatchUpdate batch(ColorPickerButton::BatchNotification::Aggregated);
+         first.SetColor(clr);
+         second.SetColor(clr);
+      }
+      return (senders == std::vector<HWND>{ first.GetSafeHwnd(), second.GetSafeHwnd() });
+   };
+   CHECK(changeInOrder(button1, button2, RGB(4, 5, 6)));
+   CHECK(changeInOrder(button2, button1, RGB(7, 8, 9)));
+}
+
+TEST_CASE(ColorPickerButton, MemoryUsageFollowsTheTable)
+{
+   // The button's own memory grows with its table. A table with lazily-resolved names holds only
+   // the colors, so it takes less than one with a string per entry, and copying it out of the
+   // button (which resolves every name) leaves nothing behind.
+   constexpr size_t kcSmall = 100;
+   constexpr size_t kcLarge = 10000;
+
+   ButtonHost host;
+   auto&      button = host.GetButton();
+
+   button.SetColorTable(MakeTable(kcSmall, 24));
+   const auto small = button.GetMemoryUsage();
+   const auto table = MakeTable(kcLarge, 25);
+   button.SetColorTable(table);
+   const auto large = button.GetMemoryUsage();
+   CHECK(small.cButtons == 1);
+   CHECK(large.cButtons == 1);
+   CHECK(large.cbPrivate >= small.cbPrivate + ((kcLarge - kcSmall) * sizeof(ColorTable::value_type)));
+
+   const auto pNames = ColorNameTable::FromCallback([&table](size_t index) { return table[index].second; });
+   button.SetColorTable(ColorsOf(table), pNames);
+   const auto lazy = button.GetMemoryUsage();
+   CHECK(lazy.cbPrivate + (kcLarge * sizeof(CString)) <= large.cbPrivate);
+   CHECK(lazy.cbShared >= pNames->GetByteSize());
+
+   CHECK(button.GetColorTable() == table);
+   const auto copied = button.GetMemoryUsage();
+   CHECK(copied.cbPrivate          == lazy.cbPrivate);
+   CHECK(copied.cbShared           == lazy.cbShared);
+   CHECK(copied.cGdiObjectsPrivate == lazy.cGdiObjectsPrivate);
+   CHECK(copied.cGdiObjectsShared  == lazy.cGdiObjectsShared);
+}
+
+#if defined(_DEBUG)
+TEST_CASE(ColorPickerButton, HandlingInputsNeverAllocates)
+{
+   // Hovering and navigating with the arrow keys must not allocate, however many inputs there
+   // are, so a session of many inputs must make as many allocations as a session of a few (which
+   // are those of opening and closing the window). Here, the parent also changes the sort order
+   // every time that the selection changes, which must not make the window rebuild the display
+   // order while it is open. (This needs the CRT's allocation hook, so it only runs in debug builds.)
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   button.SetColorTable(MakeTable(1000, 19), 32);
+   button.SetTrackSelection(true);
+   auto isSorted = false;
+   host.SetNotifyHandler([&button, &isSorted](WPARAM, const NMHDR& hdr)
+                         {
+                            if (hdr.code == CPN_SELCHANGED)
+                            {
+                               isSorted = !isSorted;
+                               button.SetColorTableOrder(isSorted ? ColorPickerButton::ColorTableOrder::HueBands
+                                                                  : ColorPickerButton::ColorTableOrder::TableOrder);
+                            }
+                         });
+
+   // Each session opens with a display order to build, so that they all start out the same.
+   const auto countAllocations = [&button, &isSorted](const InputLog& log)
+   {
+      isSorted = false;
+      button.SetColorTableOrder(ColorPickerButton::ColorTableOrder::HueBands);
+      button.ReplayInput(InputLog());
+      button.SetColorTableOrder(ColorPickerButton::ColorTableOrder::TableOrder);
+      return CountReplayAllocations(button, log);
+   };
+
+   const auto hoverFew  = MakeHoverLog(button, 10, 20);
+   const auto hoverMany = MakeHoverLog(button, 200, 21);
+   countAllocations(hoverFew);  // (so that anything done only once is done)
+   CHECK(countAllocations(hoverMany) == countAllocations(hoverFew));
+
+   const auto navigateFew  = MakeNavigationLog(10, 22);
+   const auto navigateMany = MakeNavigationLog(200, 23);
+   CHECK(countAllocations(navigateMany) == countAllocations(navigateFew));
+}
+#endif  // defined(_DEBUG)
+
+BENCHMARK(ColorPickerButton, SetColorTable)
+{
+   // Each call alternates between two tables, so that nothing is left over from the call before
+   // (the lookup index of the table being replaced is still held when the new one is acquired).
+   // The table is passed by value to the first overload, so its case includes the copy.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   for (const auto cColors : kTableSizes)
+   {
+      const ColorTable            tables[] = { MakeTable(cColors, 1), MakeTable(cColors, 2) };
+      const std::vector<COLORREF> colors[] = { ColorsOf(tables[0]),   ColorsOf(tables[1])   };
+      std::vector<BYTE>           files [2];
+      for (size_t i = 0; i < 2; ++i)
+      {
+         files[i] = PaletteFile::Serialize(tables[i], PaletteFile::DefaultWriteOptions());
+      }
+      size_t iTable = 0;
+
+      benchmark.Run(benchmark.Case("colors=%zu/overload=vector", cColors), cColors, [&]
+                    {
+                       button.SetColorTable(tables[iTable ^= 1]);
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/overload=pairs", cColors), cColors, [&]
+                    {
+                       iTable ^= 1;
+                       button.SetColorTable(tables[iTable].data(), tables[iTable].size());
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/overload=colors", cColors), cColors, [&]
+                    {
+                       iTable ^= 1;
+                       button.SetColorTable(colors[iTable].data(), colors[iTable].size());
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/overload=palette-file", cColors), cColors, [&]
+                    {
+                       iTable ^= 1;
+                       button.SetColorTable(PaletteFile::FromMemory(files[iTable].data(), files[iTable].size(), false));
+                    });
+   }
+}
+
+BENCHMARK(ColorPickerButton, GetColorTableGrid)
+{
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colors = ColorsOf(MakeTable(cColors, 3));
+      for (const auto cColumns : kColumnCounts)
+      {
+         button.SetColorTable(colors.data(), colors.size(), cColumns);
+         benchmark.Run(benchmark.Case("colors=%zu/columns=%zu", cColors, cColumns), 1, [&button]
+                       {
+                          Test::DoNotOptimize(button.GetColorTableGrid());
+                       });
+      }
+   }
+}
+
+BENCHMARK(ColorPickerButton, Lookup)
+{
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colors = ColorsOf(MakeTable(cColors, 4));
+      const auto probes = ColorsOf(MakeTable(1024, 5));
+      button.SetColorTable(colors.data(), colors.size());
+      benchmark.Run(benchmark.Case("colors=%zu/nearest", cColors), probes.size(), [&button, &probes]
+                    {
+                       for (const auto clr : probes)
+                       {
+                          Test::DoNotOptimize(button.GetNearestColorIndex(clr));
+                       }
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/exact", cColors), colors.size(), [&button, &colors]
+                    {
+                       for (const auto clr : colors)
+                       {
+                          Test::DoNotOptimize(button.FindColorIndex(clr));
+                       }
+                    });
+   }
+}
+
+BENCHMARK(ColorPickerButton, Open)
+{
+   // Opening the pop-up window with a color that is in the table lays it out, finds the swatch
+   // to select (IndexFromColor), and paints it, and then it is closed at once.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colorTable = MakeTable(cColors, 6);
+      for (const auto cColumns : kColumnCounts)
+      {
+         button.SetColorTable(colorTable, cColumns);
+         InputLog log;
+         log.SetInitialColor(colorTable.back().first);
+         benchmark.Run(benchmark.Case("colors=%zu/columns=%zu", cColors, cColumns), 1, [&button, &log]
+                       {
+                          Test::DoNotOptimize(button.ReplayInput(log));
+                       });
+      }
+   }
+}
+
+BENCHMARK(ColorPickerButton, Hover)
+{
+   // Each move is hit-tested (ColorPickerSelection::HitTest and GetSwatchRect), changes the selection, and is painted.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colorTable = MakeTable(cColors, 7);
+      for (const auto cColumns : kColumnCounts)
+      {
+         button.SetColorTable(colorTable, cColumns);
+         const auto log = MakeHoverLog(button, 256, 8);
+         benchmark.Run(benchmark.Case("colors=%zu/columns=%zu", cColors, cColumns), log.GetEvents().size(), [&button, &log]
+                       {
+                          Test::DoNotOptimize(button.ReplayInput(log));
+                       });
+      }
+   }
+}
+
+BENCHMARK(ColorPickerButton, Navigate)
+{
+   // Each key moves the selection (ColorPickerSelection::SelectByOffset), and is painted.
+   ButtonHost host;
+   auto&      button = host.GetButton();
+   const auto log    = MakeNavigationLog(256, 9);
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colorTable = MakeTable(cColors, 10);
+      for (const auto cColumns : kColumnCounts)
+      {
+         button.SetColorTable(colorTable, cColumns);
+         benchmark.Run(benchmark.Case("colors=%zu/columns=%zu", cColors, cColumns), log.GetEvents().size(), [&button, &log]
+                       {
+                          Test::DoNotOptimize(button.ReplayInput(log));
+                       });
+      }
+   }
+}
+
+BENCHMARK(ColorPickerButton, PaintButton)
+{
+   // The button is drawn into a bitmap in memory. Drawing the same face again copies it from the
+   // cache of rendered faces; changing the color every time renders a new face each time.
+   ButtonHost   host;
+   auto&        button = host.GetButton();
+   MemoryCanvas canvas(button);
+   button.SetColorTable(MakeTable(48, 11));
+   benchmark.Run("face=cached", 1, [&button, &canvas]
+                 {
+                    PaintInto(button, canvas);
+                 });
+
+   COLORREF clr = 0;
+   benchmark.Run("face=new", 1, [&button, &canvas, &clr]
+                 {
+                    clr = (clr + 0x010203) & 0x00FFFFFF;
+                    button.SetColor(clr);
+                    PaintInto(button, canvas);
+                 });
+}
@@ -0,0 +1,470 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorPickerSelection.hpp"
+#include "DisplayOrder.hpp"
+#include "InputLog.hpp"
+#include <climits>                // for SHRT_MAX
+#include <random>
+
+
+// The selection only knows the pop-up window by its layout, so these cases drive it directly,
+// with no window (and so they run wherever the rest of the library does).
+
+namespace {
+
+using Layout = ColorPickerSelection::Layout;
+
+constexpr int  kDefault  = ColorPickerSelection::kDefaultIndex;
+constexpr int  kCustom   = ColorPickerSelection::kCustomIndex;
+constexpr int  kNone     = ColorPickerSelection::kInvalidIndex;
+constexpr SIZE kszSwatch = ColorPickerButton::kszColorSwatch;
+
+std::vector<COLORREF> MakeRandomColors(size_t cColors, unsigned seed)
+{
+   std::mt19937          random(seed);
+   std::vector<COLORREF> colors(cColors);
+   for (auto& clr : colors)
+   {
+      clr = random() & 0x00FFFFFF;
+   }
+   return colors;
+}
+
+// Lays out a table in the specified display order, with text areas as big as the specified size.
+Layout MakeLayout(const DisplayOrder& displayOrder,
+                  size_t              cColors,
+                  size_t              cColumns,
+                  bool                showDefault,
+                  bool                showCustom,
+                  CSize               szText = CSize(100, 20))
+{
+   Layout layout            = {};
+   layout.grid              = ColorPickerSelection::ComputeGrid(cColors, cColumns);
+   layout.cColors           = cColors;
+   layout.pDisplayOrder     = &displayOrder;
+   layout.prcStaticSwatches = nullptr;
+   layout.showDefault       = showDefault;
+   layout.showCustom        = showCustom;
+   layout.Arrange(szText, CSize(2, 2));
+   return layout;
+}
+
+// Gets the point at the center of the swatch at the specified display position.
+CPoint GetSwatchCenter(const Layout& layout, size_t position)
+{
+   const auto cColumns = static_cast<size_t>(layout.grid.cy);
+   return CPoint(layout.rcSwatches.left + static_cast<LONG>(position % cColumns) * kszSwatch.cx + (kszSwatch.cx / 2),
+                 layout.rcSwatches.top  + static_cast<LONG>(position / cColumns) * kszSwatch.cy + (kszSwatch.cy / 2));
+}
+
+InputEvent MakeEvent(InputEvent::Type type, UINT32 wParam, UINT32 lParam = 0)
+{
+   InputEvent event;
+   event.type   = type;
+   event.shift  = false;
+   event.time   = 0;
+   event.wParam = wParam;
+   event.lParam = lParam;
+   return event;
+}
+
+InputEvent MakeMouseEvent(InputEvent::Type type, const POINT& pt)
+{
+   return MakeEvent(type, (type == InputEvent::Type::MouseMove) ? 0 : MK_LBUTTON,
+                    static_cast<UINT32>(MAKELPARAM(pt.x, pt.y)));
+}
+
+InputEvent MakeKeyEvent(UINT nChar, bool isAltDown = false)
+{
+   return isAltDown ? MakeEvent(InputEvent::Type::SysKeyDown, nChar, static_cast<UINT32>(MAKELPARAM(1, KF_ALTDOWN)))
+                    : MakeEvent(InputEvent::Type::KeyDown,    nChar, static_cast<UINT32>(MAKELPARAM(1, 0)));
+}
+
+// The sizes of table, and the numbers of columns, that the benchmarks are run over (as for the
+// button's own benchmarks, which time the same work through a real pop-up window, with painting).
+const size_t kTableSizes[]   = { 48, 1024, 16384, 65535 };
+const size_t kColumnCounts[] = { 8, 32, 256 };
+
+// The display orders that the benchmarks are run over: the table order, which maps positions to
+// indices directly, and a sorted one, which looks them up.
+const std::pair<const char*, DisplayOrder::Order> kOrders[] =
+{
+   { "table",     DisplayOrder::Order::TableOrder },
+   { "hue-bands", DisplayOrder::Order::HueBands   },
+};
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorPickerSelection, ComputesTheGrid)
+{
+   CHECK(ColorPickerSelection::ComputeGrid(100, 10) == CSize(10, 10));
+   CHECK(ColorPickerSelection::ComputeGrid(101, 10) == CSize(11, 10));
+   CHECK(ColorPickerSelection::ComputeGrid(5,   8)  == CSize(1,  8));
+   CHECK(ColorPickerSelection::ComputeGrid(0,   8)  == CSize(0,  8));
+}
+
+TEST_CASE(ColorPickerSelection, ArrangesTheOptionsFromTopToBottom)
+{
+   // The default text runs across the top, the swatches are centered below it, and the custom
+   // text runs across the bottom, all within the margins.
+   const DisplayOrder displayOrder(MakeRandomColors(20, 1), DisplayOrder::Order::TableOrder, 1);
+   const auto         layout = MakeLayout(displayOrder, 20, 8, true, true, CSize(200, 20));
+   const auto xSwatches = 2 + ((200 - (8 * kszSwatch.cx)) / 2);
+   CHECK(layout.rcDefaultText == CRect(2, 2, 202, 22));
+   CHECK(layout.rcSwatches    == CRect(xSwatches, 22, xSwatches + (8 * kszSwatch.cx), 22 + (3 * kszSwatch.cy)));
+   CHECK(layout.rcCustomText  == CRect(2, layout.rcSwatches.bottom, 202, layout.rcSwatches.bottom + 20));
+   CHECK(layout.szClient      == CSize(204, layout.rcCustomText.bottom + 2));
+
+   // A hidden option's area has no height (so nothing is ever in it), and the swatches are as
+   // wide as the window, less its margins, when they are wider than the text.
+   const auto bare = MakeLayout(displayOrder, 20, 8, false, false, CSize(0, 0));
+   CHECK(bare.rcDefaultText.IsRectEmpty());
+   CHECK(bare.rcCustomText .IsRectEmpty());
+   CHECK(bare.rcSwatches == CRect(2, 2, 2 + (8 * kszSwatch.cx), 2 + (3 * kszSwatch.cy)));
+   CHECK(bare.szClient   == CSize((8 * kszSwatch.cx) + 4, (3 * kszSwatch.cy) + 4));
+}
+
+TEST_CASE(ColorPickerSelection, HitTestAgreesWithTheSwatchRects)
+{
+   const size_t cColors = 61;
+   const auto   colors  = MakeRandomColors(cColors, 2);
+   for (const auto order : { DisplayOrder::Order::TableOrder, DisplayOrder::Order::HueBands })
+   {
+      const DisplayOrder   displayOrder(colors, order, 1);
+      ColorPickerSelection selection;
+      selection.Start(MakeLayout(displayOrder, cColors, 8, true, true), kNone);
+      const auto& layout = selection.GetLayout();
+
+      // Every point of every swatch hits it (and the swatches are where the display order puts them).
+      for (int index = 0; index < static_cast<int>(cColors); ++index)
+      {
+         const auto orcSwatch = selection.GetSwatchRect(index);
+         REQUIRE(orcSwatch);
+         const CRect rcSwatch(*orcSwatch);
+         CHECK(rcSwatch.PtInRect(GetSwatchCenter(layout, displayOrder.PositionFromIndex(index))));
+         CHECK(selection.HitTest(rcSwatch.TopLeft())                             == index);
+         CHECK(selection.HitTest(CPoint(rcSwatch.right - 1, rcSwatch.bottom - 1)) == index);
+      }
+      CHECK(selection.HitTest(CPoint(layout.rcDefaultText.left, layout.rcDefaultText.top)) == kDefault);
+      CHECK(selection.HitTest(CPoint(layout.rcCustomText.left,  layout.rcCustomText.top))  == kCustom);
+      CHECK(CRect(*selection.GetSwatchRect(kDefault)) == layout.rcDefaultText);
+      CHECK(CRect(*selection.GetSwatchRect(kCustom))  == layout.rcCustomText);
+
+      // Nothing is hit past the last swatch in the last row, or outside of the options.
+      CHECK(selection.HitTest(GetSwatchCenter(layout, cColors))                         == kNone);
+      CHECK(selection.HitTest(GetSwatchCenter(layout, 63))                              == kNone);
+      CHECK(selection.HitTest(CPoint(0, 0))                                             == kNone);
+      CHECK(selection.HitTest(CPoint(layout.rcSwatches.left - 1, layout.rcSwatches.top)) == kNone);
+      CHECK(!selection.GetSwatchRect(kNone));
+      CHECK(!selection.GetSwatchRect(static_cast<int>(cColors)));
+   }
+}
+
+TEST_CASE(ColorPickerSelection, UsesTheStaticSwatchRects)
+{
+   // A static table's swatches are wherever it put them, relative to the swatch area.
+   const RECT         rcSwatches[] = { { 0, 0, 18, 18 }, { 18, 0, 36, 18 }, { 0, 18, 18, 36 } };
+   const DisplayOrder displayOrder(MakeRandomColors(3, 3), DisplayOrder::Order::TableOrder, 1);
+   auto               layout = MakeLayout(displayOrder, 3, 2, false, false);
+   layout.prcStaticSwatches = rcSwatches;
+
+   ColorPickerSelection selection;
+   selection.Start(layout, kNone);
+   const auto  rcSwatch = CRect(*selection.GetSwatchRect(2));
+   const auto& rcArea   = layout.rcSwatches;
+   CHECK(rcSwatch == CRect(rcArea.left, rcArea.top + 18, rcArea.left + 18, rcArea.top + 36));
+}
+
+TEST_CASE(ColorPickerSelection, TheMouseSelectsWhatIsUnderIt)
+{
+   const DisplayOrder   displayOrder(MakeRandomColors(20, 4), DisplayOrder::Order::TableOrder, 1);
+   ColorPickerSelection selection;
+   selection.Start(MakeLayout(displayOrder, 20, 5, true, true), 7);
+   const auto& layout = selection.GetLayout();
+   CHECK(selection.GetCurrent() == kNone);
+   CHECK(selection.GetChosen()  == 7);
+
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::MouseMove, GetSwatchCenter(layout, 12))));
+   CHECK(selection.GetCurrent() == 12);
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::MouseMove, layout.rcCustomText.TopLeft())));
+   CHECK(selection.GetCurrent() == kCustom);
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::MouseMove, CPoint(0, 0))));
+   CHECK(selection.GetCurrent() == kNone);
+
+   // Releasing the button does nothing (pressing it already chose), and neither do characters.
+   CHECK(!selection.HandleInput(MakeMouseEvent(InputEvent::Type::LButtonUp, GetSwatchCenter(layout, 3))));
+   CHECK(!selection.HandleInput(MakeEvent(InputEvent::Type::Char, 'a')));
+   CHECK(selection.GetCurrent() == kNone);
+   CHECK(!selection.IsClosed());
+   CHECK(selection.GetChosen()  == 7);
+}
+
+TEST_CASE(ColorPickerSelection, ClickingChoosesOrCancels)
+{
+   const DisplayOrder   displayOrder(MakeRandomColors(20, 5), DisplayOrder::Order::TableOrder, 1);
+   ColorPickerSelection selection;
+   const auto           layout = MakeLayout(displayOrder, 20, 5, true, true);
+
+   selection.Start(layout, kNone);
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::LButtonDown, GetSwatchCenter(layout, 9))));
+   CHECK(selection.IsClosed());
+   CHECK(selection.IsOkayed());
+   CHECK(selection.GetCurrent() == 9);
+
+   // Once closed, it takes no more inputs.
+   CHECK(!selection.HandleInput(MakeMouseEvent(InputEvent::Type::MouseMove, GetSwatchCenter(layout, 3))));
+   CHECK(!selection.HandleKey(VK_RETURN, false));
+   CHECK(selection.GetCurrent() == 9);
+
+   // A click off of the options cancels, even after hovering over one.
+   selection.Start(layout, 4);
+   CHECK(selection.GetCurrent() == kNone);
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::MouseMove,   GetSwatchCenter(layout, 9))));
+   CHECK(selection.HandleInput(MakeMouseEvent(InputEvent::Type::LButtonDown, CPoint(0, 0))));
+   CHECK(selection.IsClosed());
+   CHECK(!selection.IsOkayed());
+}
+
+TEST_CASE(ColorPickerSelection, TheArrowKeysFollowTheDisplayOrder)
+{
+   const size_t       cColors = 30;
+   const DisplayOrder displayOrder(MakeRandomColors(cColors, 6), DisplayOrder::Order::Hilbert, 1);
+   const auto         indexAt = [&displayOrder](size_t position)
+   {
+      return static_cast<int>(displayOrder.IndexFromPosition(position));
+   };
+
+   // With nothing current, the first key moves to the chosen option, wherever it goes.
+   ColorPickerSelection selection;
+   selection.Start(MakeLayout(displayOrder, cColors, 6, true, true), indexAt(7));
+   CHECK(selection.HandleKey(VK_LEFT, false));
+   CHECK(selection.GetCurrent() == indexAt(7));
+
+   CHECK(selection.HandleKey(VK_RIGHT, false));
+   CHECK(selection.GetCurrent() == indexAt(8));
+   CHECK(selection.HandleKey(VK_DOWN, false));
+   CHECK(selection.GetCurrent() == indexAt(14));
+   CHECK(selection.HandleKey(VK_PRIOR, false));
+   CHECK(selection.GetCurrent() == indexAt(8));
+   CHECK(selection.HandleKey(VK_UP, false));
+   CHECK(selection.GetCurrent() == indexAt(2));
+
+   // Past the first swatch is the default option, and before that, the custom option, and then
+   // the last swatch; and the other way around.
+   CHECK(selection.HandleKey(VK_UP, false));
+   CHECK(selection.GetCurrent() == kDefault);
+   CHECK(selection.HandleKey(VK_LEFT, false));
+   CHECK(selection.GetCurrent() == kCustom);
+   CHECK(selection.HandleKey(VK_LEFT, false));
+   CHECK(selection.GetCurrent() == indexAt(cColors - 1));
+   CHECK(selection.HandleKey(VK_NEXT, false));
+   CHECK(selection.GetCurrent() == kCustom);
+   CHECK(selection.HandleKey(VK_RIGHT, false));
+   CHECK(selection.GetCurrent() == kDefault);
+   CHECK(selection.HandleKey(VK_RIGHT, false));
+   CHECK(selection.GetCurrent() == indexAt(0));
+
+   // Options that are not shown are skipped.
+   selection.Start(MakeLayout(displayOrder, cColors, 6, false, false), kNone);
+   selection.Select(indexAt(cColors - 1));
+   CHECK(selection.HandleKey(VK_RIGHT, false));
+   CHECK(selection.GetCurrent() == indexAt(0));
+   CHECK(selection.HandleKey(VK_LEFT, false));
+   CHECK(selection.GetCurrent() == indexAt(cColors - 1));
+   CHECK(!selection.IsClosed());
+}
+
+TEST_CASE(ColorPickerSelection, TheKeysOkayOrCancel)
+{
+   const DisplayOrder displayOrder(MakeRandomColors(20, 7), DisplayOrder::Order::TableOrder, 1);
+   const auto         layout = MakeLayout(displayOrder, 20, 5, true, true);
+
+   // Enter, Space, and F4 okay the current option; Escape cancels.
+   for (const auto nChar : { VK_RETURN, VK_SPACE, VK_F4, VK_ESCAPE })
+   {
+      ColorPickerSelection selection;
+      selection.Start(layout, 3);
+      CHECK(selection.HandleInput(MakeKeyEvent(VK_RIGHT)));
+      CHECK(selection.HandleInput(MakeKeyEvent(nChar)));
+      CHECK(selection.IsClosed());
+      CHECK(selection.IsOkayed() == (nChar != VK_ESCAPE));
+      CHECK(selection.GetCurrent() == 3);
+   }
+
+   // With nothing current, okaying cancels.
+   ColorPickerSelection selection;
+   selection.Start(layout, 3);
+   CHECK(selection.HandleInput(MakeKeyEvent(VK_RETURN)));
+   CHECK(selection.IsClosed());
+   CHECK(!selection.IsOkayed());
+
+   // Alt+Down and Alt+Up close, as they opened; other keys with Alt are not the selection's.
+   selection.Start(layout, 3);
+   CHECK(!selection.HandleInput(MakeKeyEvent('A', true)));
+   CHECK(!selection.HandleInput(MakeKeyEvent(VK_LEFT, true)));
+   CHECK(!selection.HandleInput(MakeKeyEvent('A')));
+   CHECK(selection.GetCurrent() == kNone);
+   CHECK(selection.HandleInput(MakeKeyEvent(VK_DOWN)));
+   CHECK(selection.GetCurrent() == 3);
+   CHECK(selection.HandleInput(MakeKeyEvent(VK_DOWN, true)));
+   CHECK(selection.IsClosed());
+   CHECK(selection.IsOkayed());
+   CHECK(selection.GetCurrent() == 3);
+}
+
+TEST_CASE(ColorPickerSelection, ReplaysARecordedSession)
+{
+   // A session's inputs replay to the same outcome every time, with no window, as the pop-up
+   // window replays them (up to the input that closes it).
+   const DisplayOrder displayOrder(MakeRandomColors(100, 8), DisplayOrder::Order::HueBands, 1);
+   const auto         layout = MakeLayout(displayOrder, 100, 10, true, true);
+
+   InputLog log;
+   log.Append(MakeMouseEvent(InputEvent::Type::MouseMove, GetSwatchCenter(layout, 55)));
+   log.Append(MakeKeyEvent(VK_DOWN));
+   log.Append(MakeKeyEvent(VK_LEFT));
+   log.Append(MakeKeyEvent(VK_RETURN));
+   log.Append(MakeKeyEvent(VK_RIGHT));  // (after closing, so it is not replayed)
+
+   for (int pass = 0; pass < 2; ++pass)
+   {
+      ColorPickerSelection selection;
+      selection.Start(layout, kNone);
+      size_t cReplayed = 0;
+      for (const auto& event : log.GetEvents())
+      {
+         if (selection.IsClosed())
+         {
+            break;
+         }
+         selection.HandleInput(event);
+         ++cReplayed;
+      }
+      CHECK(cReplayed == 4);
+      CHECK(selection.IsOkayed());
+      CHECK(selection.GetCurrent() == static_cast<int>(displayOrder.IndexFromPosition(64)));
+   }
+}
+
+
+BENCHMARK(ColorPickerSelection, Layout)
+{
+   // The grid and the rectangles are computed each time that the pop-up window opens.
+   constexpr size_t kcLayouts = 1024;
+   benchmark.Run(benchmark.Case("method=grid"), kcLayouts, []
+                 {
+                    LONG sum = 0;
+                    for (size_t i = 0; i < kcLayouts; ++i)
+                    {
+                       sum += ColorPickerSelection::ComputeGrid((i * 64) + 1, kColumnCounts[i % ARRAYSIZE(kColumnCounts)]).cx;
+                    }
+                    Test::DoNotOptimize(sum);
+                 });
+
+   const DisplayOrder displayOrder(MakeRandomColors(kTableSizes[0], 9), DisplayOrder::Order::TableOrder, 1);
+   auto               layout = MakeLayout(displayOrder, kTableSizes[0], kColumnCounts[0], true, true);
+   benchmark.Run(benchmark.Case("method=arrange"), kcLayouts, [&layout]
+                 {
+                    for (size_t i = 0; i < kcLayouts; ++i)
+                    {
+                       layout.Arrange(CSize(static_cast<LONG>(i % 256), 20), CSize(2, 2));
+                    }
+                    Test::DoNotOptimize(layout.szClient.cx);
+                 });
+}
+
+BENCHMARK(ColorPickerSelection, HitTest)
+{
+   // Each move of the mouse is hit-tested, and the swatch that it lands on is looked up again
+   // to be painted (and to move the tooltip onto it).
+   constexpr size_t kcQueries = 4096;
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colors = MakeRandomColors(cColors, 10);
+      for (const auto& order : kOrders)
+      {
+         const DisplayOrder displayOrder(colors, order.second, 1);
+         for (const auto cColumns : kColumnCounts)
+         {
+            ColorPickerSelection selection;
+            selection.Start(MakeLayout(displayOrder, cColors, cColumns, true, true), kNone);
+
+            std::mt19937        random(11);
+            std::vector<CPoint> points(kcQueries);
+            std::vector<int>    indices(kcQueries);
+            for (size_t i = 0; i < kcQueries; ++i)
+            {
+               points[i]  = GetSwatchCenter(selection.GetLayout(), random() % cColors);
+               indices[i] = static_cast<int>(random() % cColors);
+            }
+
+            benchmark.Run(benchmark.Case("order=%s/colors=%zu/columns=%zu/method=hit-test", order.first, cColors, cColumns), kcQueries, [&selection, &points]
+                          {
+                             int sum = 0;
+                             for (const auto& pt : points)
+                             {
+                                sum += selection.HitTest(pt);
+                             }
+                             Test::DoNotOptimize(sum);
+                          });
+            benchmark.Run(benchmark.Case("order=%s/colors=%zu/columns=%zu/method=swatch-rect", order.first, cColors, cColumns), kcQueries, [&selection, &indices]
+                          {
+                             LONG sum = 0;
+                             for (const auto index : indices)
+                             {
+                                sum += selection.GetSwatchRect(index)->left;
+                             }
+                             Test::DoNotOptimize(sum);
+                          });
+         }
+      }
+   }
+}
+
+BENCHMARK(ColorPickerSelection, HandleInput)
+{
+   // The state machine itself, without the painting that the pop-up window does after each input:
+   // moves of the mouse onto swatches at random, and presses of the arrow keys at random.
+   constexpr size_t kcInputs = 4096;
+   const UINT       keys[]   = { VK_RIGHT, VK_DOWN, VK_LEFT, VK_UP, VK_NEXT, VK_PRIOR };
+   for (const auto cColors : kTableSizes)
+   {
+      const auto colors = MakeRandomColors(cColors, 12);
+      for (const auto& order : kOrders)
+      {
+         const DisplayOrder displayOrder(colors, order.second, 1);
+         for (const auto cColumns : kColumnCounts)
+         {
+            const auto layout = MakeLayout(displayOrder, cColors, cColumns, true, true);
+
+            // (Only the swatches whose centers fit in the coordinates of a mouse message are hovered.)
+            const auto              cRowsMax   = static_cast<size_t>((SHRT_MAX / kszSwatch.cy) - 1);
+            const auto              cPositions = std::min(cColors, cColumns * cRowsMax);
+            std::mt19937            random(13);
+            std::vector<InputEvent> moves;
+            std::vector<InputEvent> presses;
+            for (size_t i = 0; i < kcInputs; ++i)
+            {
+               moves  .push_back(MakeMouseEvent(InputEvent::Type::MouseMove, GetSwatchCenter(layout, random() % cPositions)));
+               presses.push_back(MakeKeyEvent(keys[random() % ARRAYSIZE(keys)]));
+            }
+
+            for (const auto pInputs : { &moves, &presses })
+            {
+               const auto pszInputs = (pInputs == &moves) ? "hover" : "navigate";
+               benchmark.Run(benchmark.Case("order=%s/colors=%zu/columns=%zu/inputs=%s", order.first, cColors, cColumns, pszInputs), kcInputs, [&layout, pInputs]
+                             {
+                                ColorPickerSelection selection;
+                                selection.Start(layout, 0);
+                                for (const auto& event : *pInputs)
+                                {
+                                   selection.HandleInput(event);
+                                }
+                                Test::DoNotOptimize(selection.GetCurrent());
+                             });
+            }
+         }
+      }
+   }
+}
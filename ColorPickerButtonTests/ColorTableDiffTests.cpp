@@ -0,0 +1,206 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorTableDiff.hpp"
+#include <random>
+
+
+namespace {
+
+using ColorTable = ColorTableDiff::ColorTable;
+using Operation  = ColorTableDiff::Operation;
+
+ColorTable MakeTable(size_t cColors, unsigned seed)
+{
+   std::mt19937 random(seed);
+   ColorTable   colorTable;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      CString name;
+      name.Format(_T("c%zu"), i);
+      colorTable.emplace_back(random() & 0x00FFFFFF, name);
+   }
+   return colorTable;
+}
+
+// Makes the specified number of random edits to a copy of the table, as a designer would.
+ColorTable EditTable(ColorTable colorTable, size_t cEdits, std::mt19937& random)
+{
+   for (size_t i = 0; i < cEdits; ++i)
+   {
+      const auto index = colorTable.empty() ? 0 : (random() % colorTable.size());
+      switch (colorTable.empty() ? 0 : (random() % 4))
+      {
+         case 0:
+         {
+            CString name;
+            name.Format(_T("new%zu"), i);
+            colorTable.emplace(colorTable.begin() + index, random() & 0x00FFFFFF, name);
+            break;
+         }
+         case 1:
+            colorTable.erase(colorTable.begin() + index);
+            break;
+         case 2:
+            colorTable[index].first ^= 0x000101;
+            break;
+         case 3:
+            colorTable[index].second += _T("!");
+            break;
+      }
+   }
+   return colorTable;
+}
+
+std::vector<COLORREF> ColorsOf(const ColorTable& colorTable)
+{
+   std::vector<COLORREF> colors;
+   for (const auto& entry : colorTable)
+   {
+      colors.push_back(entry.first);
+   }
+   return colors;
+}
+
+// Computes the diff from one table to another, and checks that applying it gives the other.
+ColorTableDiff CheckDiff(const ColorTable& tableFrom, const ColorTable& tableTo)
+{
+   const auto diff = ColorTableDiff::Compute(tableFrom, tableTo, tableFrom.size() + tableTo.size());
+   REQUIRE(diff.has_value());
+
+   auto table = tableFrom;
+   diff->ApplyTo(table);
+   CHECK(table == tableTo);
+
+   auto colors = ColorsOf(tableFrom);
+   diff->ApplyTo(colors);
+   CHECK(colors == ColorsOf(tableTo));
+
+   CHECK(diff->GetSizeChange() == (static_cast<ptrdiff_t>(tableTo.size()) - static_cast<ptrdiff_t>(tableFrom.size())));
+   return *diff;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorTableDiff, IdenticalTablesNeedNoEdits)
+{
+   const auto colorTable = MakeTable(100, 1);
+   CHECK(CheckDiff(colorTable,   colorTable).IsEmpty());
+   CHECK(CheckDiff(ColorTable(), ColorTable()).IsEmpty());
+}
+
+TEST_CASE(ColorTableDiff, ExpressesSingleChangesAsSingleEdits)
+{
+   const auto original = MakeTable(1000, 2);
+
+   auto table = original;
+   table[500].first = RGB(1, 2, 3);
+   auto edits = CheckDiff(original, table).GetEdits();
+   REQUIRE(edits.size() == 1);
+   CHECK(edits[0].operation == Operation::Recolor);
+   CHECK(edits[0].index     == 500);
+   CHECK(edits[0].clr       == RGB(1, 2, 3));
+
+   table = original;
+   table[0].second = _T("Renamed");
+   edits = CheckDiff(original, table).GetEdits();
+   REQUIRE(edits.size() == 1);
+   CHECK(edits[0].operation == Operation::Rename);
+   CHECK(edits[0].index     == 0);
+
+   table = original;
+   table.emplace(table.begin() + 999, RGB(4, 5, 6), _T("Inserted"));
+   edits = CheckDiff(original, table).GetEdits();
+   REQUIRE(edits.size() == 1);
+   CHECK(edits[0].operation == Operation::Insert);
+   CHECK(edits[0].index     == 999);
+
+   table = original;
+   table.erase(table.begin());
+   edits = CheckDiff(original, table).GetEdits();
+   REQUIRE(edits.size() == 1);
+   CHECK(edits[0].operation == Operation::Remove);
+   CHECK(edits[0].index     == 0);
+
+   // Changing both the color and the name of an entry changes it in place.
+   table = original;
+   table[10] = { RGB(7, 8, 9), _T("Replaced") };
+   edits = CheckDiff(original, table).GetEdits();
+   REQUIRE(edits.size() == 2);
+   CHECK(edits[0].operation == Operation::Recolor);
+   CHECK(edits[1].operation == Operation::Rename);
+}
+
+TEST_CASE(ColorTableDiff, TurnsOneTableIntoTheOther)
+{
+   const auto   cTrials = Test::IsExhaustive() ? 2000 : 200;
+   std::mt19937 random(3);
+   for (int trial = 0; trial < cTrials; ++trial)
+   {
+      const auto tableFrom = MakeTable(random() % 64, random());
+      const auto cEdits    = random() % 16;
+      const auto tableTo   = EditTable(tableFrom, cEdits, random);
+      const auto diff      = CheckDiff(tableFrom, tableTo);
+
+      // A recolor and a rename of the same entry are two edits for one change.
+      CHECK(diff.GetEdits().size() <= (cEdits * 2));
+   }
+
+   // Tables with nothing in common are replaced wholesale.
+   CheckDiff(MakeTable(50, 4), MakeTable(30, 5));
+   CheckDiff(MakeTable(50, 6), ColorTable());
+   CheckDiff(ColorTable(),     MakeTable(50, 7));
+}
+
+TEST_CASE(ColorTableDiff, GivesUpBeyondTheLimit)
+{
+   const auto original = MakeTable(1000, 8);
+   auto       table    = original;
+   for (size_t i = 0; i < 10; ++i)
+   {
+      table[i * 100].first ^= 0x010000;
+   }
+   CHECK(ColorTableDiff::Compute(original, table, 10).has_value());
+   CHECK(!ColorTableDiff::Compute(original, table, 9).has_value());
+   CHECK(!ColorTableDiff::Compute(original, MakeTable(1000, 9)).has_value());
+}
+
+
+BENCHMARK(ColorTableDiff, Compute)
+{
+   // Reloading a large table after a one-entry change should cost little more than comparing the
+   // tables, rather than the rebuild that replacing the table would cause.
+   for (const size_t cColors : { size_t(48), size_t(4096), size_t(65535) })
+   {
+      const auto tableFrom = MakeTable(cColors, 10);
+      auto       tableTo   = tableFrom;
+      tableTo[cColors / 2].first ^= 0x000100;
+      benchmark.Run(benchmark.Case("colors=%zu/edits=1", cColors), cColors, [&tableFrom, &tableTo]
+                    {
+                       Test::DoNotOptimize(ColorTableDiff::Compute(tableFrom, tableTo));
+                    });
+
+      std::mt19937 random(11);
+      const auto   tableEdited = EditTable(tableFrom, 32, random);
+      benchmark.Run(benchmark.Case("colors=%zu/edits=32", cColors), cColors, [&tableFrom, &tableEdited]
+                    {
+                       Test::DoNotOptimize(ColorTableDiff::Compute(tableFrom, tableEdited));
+                    });
+   }
+}
+
+BENCHMARK(ColorTableDiff, ApplyTo)
+{
+   for (const size_t cColors : { size_t(4096), size_t(65535) })
+   {
+      const auto tableFrom = MakeTable(cColors, 12);
+      auto       tableTo   = tableFrom;
+      tableTo[cColors / 2].first ^= 0x000100;
+      const auto diff      = *ColorTableDiff::Compute(tableFrom, tableTo);
+      auto       colors    = ColorsOf(tableFrom);
+      benchmark.Run(benchmark.Case("colors=%zu/edits=1", cColors), 1, [&diff, &colors]
+                    {
+                       diff.ApplyTo(colors);
+                    });
+   }
+}
@@ -0,0 +1,287 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorTableIndex.hpp"
+#include "ColorTableDiff.hpp"
+#include "ColorTablePublishSlot.hpp"
+#include "StaticColorTable.hpp"
+#include <atomic>
+#include <numeric>                // for iota
+#include <random>
+#include <thread>
+
+
+namespace {
+
+// Random colors, with every fifth one repeating an earlier entry (so that duplicates must
+// resolve to their first index).
+std::vector<COLORREF> MakeColors(size_t cColors, unsigned seed)
+{
+   std::mt19937          random(seed);
+   std::vector<COLORREF> colors;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      colors.push_back(((i % 5) == 4) ? colors[random() % i] : (random() & 0x00FFFFFF));
+   }
+   return colors;
+}
+
+// The sorted indices that the PaletteCompiler emits for a static color table.
+std::vector<UINT16> SortIndices(const std::vector<COLORREF>& colors)
+{
+   std::vector<UINT16> indices(colors.size());
+   std::iota(indices.begin(), indices.end(), UINT16(0));
+   std::stable_sort(indices.begin(), indices.end(), [&colors](UINT16 a, UINT16 b)
+                    {
+                       return colors[a] < colors[b];
+                    });
+   return indices;
+}
+
+// Checks an index's answers for a sample of its own colors, as a pop-up window reading its
+// snapshot of the table would. Returns false if any of them is wrong.
+bool CheckLookups(const ColorTableIndex& index, const std::vector<COLORREF>& colors, std::mt19937& random)
+{
+   auto isCorrect = (index.GetColors() == colors);
+   for (int i = 0; i < 8; ++i)
+   {
+      const auto iColor = random() % colors.size();
+      const auto iExact = index.FindExact(colors[iColor]);
+      isCorrect = isCorrect && (iExact <= iColor) && (colors[iExact] == colors[iColor]);
+      isCorrect = isCorrect && (index.LookupNearest(colors[iColor]) < colors.size());
+      isCorrect = isCorrect && (colors[index.FindNearest(colors[iColor])] == colors[iColor]);
+   }
+   return isCorrect;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorTableIndex, StaticTableUsesItsSortedIndices)
+{
+   const auto colors        = MakeColors(1000, 1);
+   const auto sortedIndices = SortIndices(colors);
+   const StaticColorTableData data = { colors.data(), nullptr, sortedIndices.data(), nullptr, colors.size(), 10, 100 };
+
+   const auto pStatic = ColorTableIndex::Acquire(data);
+   const auto pHashed = ColorTableIndex::Acquire(colors);
+   REQUIRE(pStatic);
+   REQUIRE(pHashed);
+   CHECK(pStatic != pHashed);
+   CHECK(pStatic->GetColors() == colors);
+
+   // The same table gets the same index, for as long as it is alive.
+   CHECK(ColorTableIndex::Acquire(data) == pStatic);
+
+   std::mt19937 random(2);
+   for (size_t i = 0; i < 5000; ++i)
+   {
+      const COLORREF clr = (i < colors.size()) ? colors[i] : (random() & 0x00FFFFFF);
+      CHECK(pStatic->FindExact(clr)   == pHashed->FindExact(clr));
+      CHECK(pStatic->FindNearest(clr) == pHashed->FindNearest(clr));
+   }
+   CHECK(pStatic->FindExact(0x01000000 | colors[0]) == ColorTableIndex::kInvalidIndex);
+
+   // Only the hashed index builds the hash of exact colors.
+   CHECK(pStatic->GetByteSize() < pHashed->GetByteSize());
+}
+
+
+TEST_CASE(ColorTableIndex, UpdateMatchesFreshIndex)
+{
+   // An updated index edits the hash of exact colors in place (when it has been built and the
+   // diff is small), so its answers must be the same as those of an index built from scratch.
+   std::mt19937 random(4);
+   for (const size_t cEdits : { size_t(1), size_t(8), size_t(64) })
+   {
+      for (const auto buildExactFirst : { false, true })
+      {
+         auto colors = MakeColors(500, static_cast<unsigned>(cEdits));
+         auto pIndex = ColorTableIndex::Acquire(colors);
+         if (buildExactFirst)
+         {
+            Test::DoNotOptimize(pIndex->FindExact(colors[0]));
+         }
+
+         // (Each edit's index refers to the table as the edits before it have left it.)
+         auto   pDiff    = std::make_shared<ColorTableDiff>();
+         size_t cCurrent = colors.size();
+         for (size_t i = 0; i < cEdits; ++i)
+         {
+            const auto clr = colors[random() % colors.size()];  // (so that duplicates come and go)
+            switch (random() % 3)
+            {
+               case 0:
+                  pDiff->Insert(random() % (cCurrent + 1), clr, CString());
+                  ++cCurrent;
+                  break;
+               case 1:
+                  pDiff->Remove(random() % cCurrent);
+                  --cCurrent;
+                  break;
+               case 2:
+                  pDiff->Recolor(random() % cCurrent, clr);
+                  break;
+            }
+         }
+         const auto pUpdated = ColorTableIndex::Update(pIndex, pDiff);
+         pDiff->ApplyTo(colors);
+         REQUIRE(pUpdated);
+         CHECK(pUpdated->GetColors() == colors);
+
+         // Buttons that apply the same diff to the same index share the result.
+         CHECK(ColorTableIndex::Update(pIndex, pDiff) == pUpdated);
+
+         const auto pFresh = std::make_shared<const ColorTableIndex>(colors);
+         for (const auto clr : MakeColors(1000, static_cast<unsigned>(cEdits)))
+         {
+            CHECK(pUpdated->FindExact(clr) == pFresh->FindExact(clr));
+         }
+      }
+   }
+}
+
+TEST_CASE(ColorTableIndex, SurvivesConcurrentPublishing)
+{
+   // Worker threads prepare tables (acquiring their shared indexes) and publish them into the
+   // slot that ColorPickerButton::PublishColorTable() publishes into, while this thread, playing
+   // the UI thread, takes the newest one out of the slot and reads it as a snapshot, as
+   // AdoptPublishedColorTable() does. Several workers publish the same few tables, so that they
+   // race to share indexes and to build their lazy structures. Every table must be reclaimed at
+   // the end.
+   using WeakIndexes = std::vector<std::weak_ptr<const ColorTableIndex>>;
+
+   const auto               cPublishes = Test::IsExhaustive() ? 20000 : 2000;
+   const unsigned           cWorkers   = std::max(4u, std::thread::hardware_concurrency());
+   ColorTablePublishSlot    slot;
+   std::atomic<unsigned>    cRunning(cWorkers);
+   std::atomic<unsigned>    cFailures(0);
+   std::vector<WeakIndexes> indexesSeen(cWorkers);
+   std::vector<std::thread> workers;
+   for (unsigned iWorker = 0; iWorker < cWorkers; ++iWorker)
+   {
+      workers.emplace_back([&, iWorker]
+      {
+         std::mt19937 random(iWorker);
+         for (int i = 0; i < cPublishes; ++i)
+         {
+            // Half of the tables are one of a few shared ones; the rest are new.
+            const auto seed        = ((random() % 2) == 0) ? (random() % 4) : (1000 + (iWorker * cPublishes) + i);
+            const auto colors      = MakeColors(64 + (seed % 64), seed);
+            auto       pColorTable = std::make_shared<ColorPickerButton::ColorTable>();
+            for (const auto clr : colors)
+            {
+               pColorTable->emplace_back(clr, CString());
+            }
+            auto pPublished              = std::make_shared<PublishedColorTable>();
+            pPublished->pColorTable      = std::move(pColorTable);
+            pPublished->cColumns         = 8;
+            pPublished->pColorTableIndex = ColorTableIndex::Acquire(colors);
+            if (!CheckLookups(*pPublished->pColorTableIndex, colors, random))
+            {
+               ++cFailures;
+            }
+            indexesSeen[iWorker].push_back(pPublished->pColorTableIndex);
+            slot.Publish(std::move(pPublished));
+         }
+         --cRunning;
+      });
+   }
+
+   std::mt19937                         random(cWorkers);
+   std::shared_ptr<PublishedColorTable> pCurrent;
+   std::vector<COLORREF>                colors;
+   size_t                               cAdopted = 0;
+   do
+   {
+      if (auto pTaken = slot.Take())
+      {
+         pCurrent = std::move(pTaken);
+         colors.clear();
+         for (const auto& entry : *pCurrent->pColorTable)
+         {
+            colors.push_back(entry.first);
+         }
+         ++cAdopted;
+      }
+      if (pCurrent && !CheckLookups(*pCurrent->pColorTableIndex, colors, random))
+      {
+         ++cFailures;
+      }
+   } while (cRunning.load() > 0);
+   for (auto& worker : workers)
+   {
+      worker.join();
+   }
+
+   CHECK(cFailures.load() == 0);
+   CHECK(cAdopted > 0);
+   pCurrent.reset();
+   slot.Clear();
+   CHECK(slot.IsEmpty());
+   for (const auto& indexes : indexesSeen)
+   {
+      CHECK(std::all_of(indexes.begin(), indexes.end(), [](const std::weak_ptr<const ColorTableIndex>& pIndex)
+                        {
+                           return pIndex.expired();
+                        }));
+   }
+}
+
+TEST_CASE(ColorTableIndex, PublishSlotKeepsOnlyTheNewestTable)
+{
+   ColorTablePublishSlot slot;
+   CHECK(slot.IsEmpty());
+   CHECK(!slot.Take());
+
+   auto pFirst  = std::make_shared<PublishedColorTable>();
+   auto pSecond = std::make_shared<PublishedColorTable>();
+   const std::weak_ptr<PublishedColorTable> pFirstWeak = pFirst;
+   slot.Publish(std::move(pFirst));
+   slot.Publish(pSecond);
+   CHECK(pFirstWeak.expired());  // (superseded before it was taken)
+   CHECK(slot.Peek() == pSecond);
+   CHECK(!slot.IsEmpty());
+
+   CHECK(slot.Take() == pSecond);
+   CHECK(slot.IsEmpty());
+   CHECK(!slot.Take());
+}
+
+BENCHMARK(ColorTableIndex, FindExact)
+{
+   // The first lookup pays for acquiring the index (which, for colors in a vector, means hashing
+   // them all to find it in the cache) and for building whatever the lookup needs. After that, a
+   // static table's binary search is slower per lookup than the hash, which the second pair of
+   // cases measures.
+   for (const size_t cColors : { size_t(48), size_t(4096), size_t(65535) })
+   {
+      const auto                 colors        = MakeColors(cColors, 3);
+      const auto                 sortedIndices = SortIndices(colors);
+      const StaticColorTableData data          = { colors.data(), nullptr, sortedIndices.data(), nullptr, colors.size(), 10, 0 };
+      benchmark.Run(benchmark.Case("colors=%zu/static/first", cColors), 1, [&]
+                    {
+                       Test::DoNotOptimize(ColorTableIndex::Acquire(data)->FindExact(colors.back()));
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/hashed/first", cColors), 1, [&]
+                    {
+                       Test::DoNotOptimize(ColorTableIndex::Acquire(colors)->FindExact(colors.back()));
+                    });
+
+      const auto pStatic = ColorTableIndex::Acquire(data);
+      const auto pHashed = ColorTableIndex::Acquire(colors);
+      benchmark.Run(benchmark.Case("colors=%zu/static/all", cColors), cColors, [&]
+                    {
+                       for (const auto clr : colors)
+                       {
+                          Test::DoNotOptimize(pStatic->FindExact(clr));
+                       }
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/hashed/all", cColors), cColors, [&]
+                    {
+                       for (const auto clr : colors)
+                       {
+                          Test::DoNotOptimize(pHashed->FindExact(clr));
+                       }
+                    });
+   }
+}
@@ -0,0 +1,201 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorTableTools.hpp"
+#include "ColorSpace.hpp"
+#include <cmath>                  // for sqrt
+#include <random>
+
+
+namespace {
+
+using ColorTable = ColorTableTools::ColorTable;
+
+// Makes a table of random colors, with every nth one replaced by a slightly perturbed copy of an
+// earlier entry (so that there are near-duplicates to find), named "c0", "c1", and so on.
+ColorTable MakeTable(size_t cColors, size_t duplicateEvery, unsigned seed)
+{
+   std::mt19937 random(seed);
+   ColorTable   colorTable;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      COLORREF clr = random() & 0x00FFFFFF;
+      if ((duplicateEvery != 0) && (i != 0) && ((i % duplicateEvery) == 0))
+      {
+         const auto original = colorTable[random() % i].first;
+         clr = RGB(std::min(GetRValue(original) + 1, 255),
+                   GetGValue(original),
+                   std::max(GetBValue(original) - 1, 0));
+      }
+      CString name;
+      name.Format(_T("c%zu"), i);
+      colorTable.emplace_back(clr, name);
+   }
+   return colorTable;
+}
+
+// Clusters the colors in the way that the class comment describes, by comparing each entry with
+// every earlier cluster leader. Returns the leader of each entry.
+std::vector<size_t> ClusterByBruteForce(const ColorTable& colorTable, float deltaE)
+{
+   std::vector<ColorSpace::Lab> labs;
+   for (const auto& entry : colorTable)
+   {
+      labs.push_back(ColorSpace::ToOKLab(entry.first));
+   }
+
+   std::vector<size_t> leaders(colorTable.size());
+   for (size_t i = 0; i < colorTable.size(); ++i)
+   {
+      leaders[i] = i;
+      for (size_t j = 0; j < i; ++j)
+      {
+         if ((leaders[j] == j) && (ColorSpace::DistanceSquared(labs[i], labs[j]) <= (deltaE * deltaE)))
+         {
+            leaders[i] = j;
+            break;
+         }
+      }
+   }
+   return leaders;
+}
+
+std::vector<size_t> LeadersFromGroups(const std::vector<ColorTableTools::MergeGroup>& groups, size_t cColors)
+{
+   std::vector<size_t> leaders(cColors);
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      leaders[i] = i;
+   }
+   for (const auto& group : groups)
+   {
+      for (const auto iMerged : group.iMerged)
+      {
+         leaders[iMerged] = group.iKept;
+      }
+   }
+   return leaders;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorTableTools, FindsExactDuplicates)
+{
+   const ColorTable colorTable = { { RGB(255, 0, 0), _T("Red")     },
+                                   { RGB(0, 0, 255), _T("Blue")    },
+                                   { RGB(255, 0, 0), _T("Scarlet") },
+                                   { RGB(254, 0, 0), _T("Nearly")  },
+                                   { RGB(255, 0, 0), _T("Crimson") } };
+   const auto groups = ColorTableTools::FindNearDuplicates(colorTable, 0.0f);
+   REQUIRE(groups.size() == 1);
+   CHECK(groups[0].iKept == 0);
+   CHECK((groups[0].iMerged == std::vector<size_t>{ 2, 4 }));
+
+   // With the default threshold, the off-by-one red joins them.
+   const auto nearGroups = ColorTableTools::FindNearDuplicates(colorTable);
+   REQUIRE(nearGroups.size() == 1);
+   CHECK((nearGroups[0].iMerged == std::vector<size_t>{ 2, 3, 4 }));
+}
+
+TEST_CASE(ColorTableTools, ReportsNothingForDistinctColors)
+{
+   const ColorTable colorTable = { { RGB(0, 0, 0),       _T("Black") },
+                                   { RGB(255, 255, 255), _T("White") },
+                                   { RGB(0, 128, 0),     _T("Green") } };
+   CHECK(ColorTableTools::FindNearDuplicates(colorTable).empty());
+   CHECK(ColorTableTools::RemoveNearDuplicates(colorTable) == colorTable);
+   CHECK(ColorTableTools::FindNearDuplicates(ColorTable()).empty());
+}
+
+TEST_CASE(ColorTableTools, KeepsFirstEntryAndFirstName)
+{
+   const ColorTable colorTable = { { RGB(10, 20, 30), CString()      },
+                                   { RGB(90, 90, 90), _T("Gray")     },
+                                   { RGB(11, 20, 30), CString()      },
+                                   { RGB(10, 21, 30), _T("Midnight") },
+                                   { RGB(10, 20, 29), _T("Ink")      } };
+   const auto result = ColorTableTools::RemoveNearDuplicates(colorTable);
+   REQUIRE(result.size() == 2);
+   CHECK(result[0].first  == RGB(10, 20, 30));
+   CHECK(result[0].second == _T("Midnight"));
+   CHECK(result[1]        == colorTable[1]);
+}
+
+TEST_CASE(ColorTableTools, ClustersDoNotChain)
+{
+   // A ramp of grays, each within the threshold of its neighbors, but not of the ones two away:
+   // every other gray must be kept, rather than the whole ramp collapsing into its first entry.
+   ColorTable colorTable;
+   for (int value = 100; value <= 120; value += 2)
+   {
+      colorTable.emplace_back(RGB(value, value, value), CString());
+   }
+   const auto step   = std::sqrt(ColorSpace::DistanceSquared(ColorSpace::ToOKLab(colorTable[0].first),
+                                                             ColorSpace::ToOKLab(colorTable[1].first)));
+   const auto result = ColorTableTools::RemoveNearDuplicates(colorTable, step * 1.5f);
+   CHECK(result.size() == (colorTable.size() + 1) / 2);
+}
+
+TEST_CASE(ColorTableTools, AgreesWithBruteForce)
+{
+   for (const auto deltaE : { 0.0f, 0.005f, ColorTableTools::kDeltaEThresholdDefault, 0.08f })
+   {
+      const auto colorTable = MakeTable(3000, 5, 1);
+      const auto groups     = ColorTableTools::FindNearDuplicates(colorTable, deltaE);
+      CHECK(LeadersFromGroups(groups, colorTable.size()) == ClusterByBruteForce(colorTable, deltaE));
+
+      size_t cMerged = 0;
+      for (const auto& group : groups)
+      {
+         CHECK(!group.iMerged.empty());
+         CHECK(std::is_sorted(group.iMerged.begin(), group.iMerged.end()));
+         CHECK(group.iKept < group.iMerged.front());
+         cMerged += group.iMerged.size();
+      }
+      CHECK(ColorTableTools::RemoveNearDuplicates(colorTable, deltaE).size() == (colorTable.size() - cMerged));
+   }
+}
+
+TEST_CASE(ColorTableTools, MergeAddsOnlyNewColors)
+{
+   const ColorTable first  = { { RGB(255, 0, 0), _T("Red")  },
+                               { RGB(0, 0, 255), _T("Blue") } };
+   const ColorTable second = { { RGB(254, 1, 0), _T("Rouge") },
+                               { RGB(0, 255, 0), _T("Vert")  },
+                               { RGB(0, 255, 0), _T("Verde") } };
+   const auto merged = ColorTableTools::Merge({ &first, &second });
+   REQUIRE(merged.size() == 3);
+   CHECK(merged[0] == first[0]);
+   CHECK(merged[1] == first[1]);
+   CHECK(merged[2] == second[1]);
+
+   CHECK(ColorTableTools::Merge({}).empty());
+   CHECK(ColorTableTools::Merge({ &first }) == first);
+}
+
+
+BENCHMARK(ColorTableTools, RemoveNearDuplicates)
+{
+   // Up to the largest table that the button accepts, where a quadratic pass would be noticeable.
+   for (const size_t cColors : { size_t(256), size_t(4096), size_t(65535) })
+   {
+      const auto colorTable = MakeTable(cColors, 4, 2);
+      benchmark.Run(benchmark.Case("colors=%zu", cColors), cColors, [&colorTable]
+                    {
+                       Test::DoNotOptimize(ColorTableTools::RemoveNearDuplicates(colorTable));
+                    });
+   }
+}
+
+BENCHMARK(ColorTableTools, Merge)
+{
+   for (const size_t cColors : { size_t(256), size_t(4096), size_t(32768) })
+   {
+      const auto first  = MakeTable(cColors, 0, 3);
+      const auto second = MakeTable(cColors, 0, 4);
+      benchmark.Run(benchmark.Case("colors=%zu+%zu", cColors, cColors), cColors * 2, [&first, &second]
+                    {
+                       Test::DoNotOptimize(ColorTableTools::Merge({ &first, &second }));
+                    });
+   }
+}
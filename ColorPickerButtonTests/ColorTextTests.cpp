@@ -0,0 +1,430 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "ColorText.hpp"
+#include <cctype>                 // for isalpha, toupper
+#include <cstdlib>                // for abs
+#include <random>
+#include <string>
+
+
+namespace {
+
+using Status   = ColorText::Status;
+using Notation = ColorText::Notation;
+
+// The named colors of CSS Color Module Level 4.
+const char* const kNames[] =
+{
+   "aliceblue", "antiquewhite", "aqua", "aquamarine", "azure", "beige", "bisque", "black",
+   "blanchedalmond", "blue", "blueviolet", "brown", "burlywood", "cadetblue", "chartreuse",
+   "chocolate", "coral", "cornflowerblue", "cornsilk", "crimson", "cyan", "darkblue", "darkcyan",
+   "darkgoldenrod", "darkgray", "darkgreen", "darkgrey", "darkkhaki", "darkmagenta",
+   "darkolivegreen", "darkorange", "darkorchid", "darkred", "darksalmon", "darkseagreen",
+   "darkslateblue", "darkslategray", "darkslategrey", "darkturquoise", "darkviolet", "deeppink",
+   "deepskyblue", "dimgray", "dimgrey", "dodgerblue", "firebrick", "floralwhite", "forestgreen",
+   "fuchsia", "gainsboro", "ghostwhite", "gold", "goldenrod", "gray", "green", "greenyellow",
+   "grey", "honeydew", "hotpink", "indianred", "indigo", "ivory", "khaki", "lavender",
+   "lavenderblush", "lawngreen", "lemonchiffon", "lightblue", "lightcoral", "lightcyan",
+   "lightgoldenrodyellow", "lightgray", "lightgreen", "lightgrey", "lightpink", "lightsalmon",
+   "lightseagreen", "lightskyblue", "lightslategray", "lightslategrey", "lightsteelblue",
+   "lightyellow", "lime", "limegreen", "linen", "magenta", "maroon", "mediumaquamarine",
+   "mediumblue", "mediumorchid", "mediumpurple", "mediumseagreen", "mediumslateblue",
+   "mediumspringgreen", "mediumturquoise", "mediumvioletred", "midnightblue", "mintcream",
+   "mistyrose", "moccasin", "navajowhite", "navy", "oldlace", "olive", "olivedrab", "orange",
+   "orangered", "orchid", "palegoldenrod", "palegreen", "paleturquoise", "palevioletred",
+   "papayawhip", "peachpuff", "peru", "pink", "plum", "powderblue", "purple", "rebeccapurple",
+   "red", "rosybrown", "royalblue", "saddlebrown", "salmon", "sandybrown", "seagreen", "seashell",
+   "sienna", "silver", "skyblue", "slateblue", "slategray", "slategrey", "snow", "springgreen",
+   "steelblue", "tan", "teal", "thistle", "tomato", "turquoise", "violet", "wheat", "white",
+   "whitesmoke", "yellow", "yellowgreen"
+};
+
+Status Parse(const std::string& str, COLORREF* pclr)
+{
+   return ColorText::Parse(str.c_str(), str.length(), pclr);
+}
+
+Status Parse(const std::wstring& str, COLORREF* pclr)
+{
+   return ColorText::Parse(str.c_str(), str.length(), pclr);
+}
+
+COLORREF ParseOrFail(const std::string& str)
+{
+   COLORREF clr = CLR_INVALID;
+   CHECK(Parse(str, &clr) == Status::Ok);
+   return clr;
+}
+
+std::string ToUpper(std::string str)
+{
+   for (auto& ch : str)
+   {
+      ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+   }
+   return str;
+}
+
+std::wstring Widen(const std::string& str)
+{
+   return std::wstring(str.begin(), str.end());
+}
+
+std::string Narrow(const CString& str)
+{
+   return std::string(static_cast<LPCTSTR>(str), static_cast<LPCTSTR>(str) + str.GetLength());
+}
+
+int HexDigitValue(char ch)
+{
+   if ((ch >= '0') && (ch <= '9')) { return ch - '0';        }
+   if ((ch >= 'a') && (ch <= 'f')) { return ch - 'a' + 10;   }
+   if ((ch >= 'A') && (ch <= 'F')) { return ch - 'A' + 10;   }
+   return -1;
+}
+
+bool IsSeparator(char ch)
+{
+   return (ch == ',') || (ch == ';') || (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n') || (ch == '\f') || (ch == '\v');
+}
+
+// Parses a list of colors in hexadecimal notation one character at a time, in the way that
+// ColorText::ParseList() is documented to, as a reference for its vectorized path. Any other
+// entry that starts with a letter is taken to be an unknown name (so the list must not contain
+// real names or functions), and one that starts with anything else, to be empty.
+size_t ParseHexListByScalar(const char*                    pch,
+                            size_t                         cch,
+                            std::vector<COLORREF>*         pColors,
+                            std::vector<ColorText::Error>* pErrors)
+{
+   size_t cColors = 0;
+   size_t i       = 0;
+   for (;;)
+   {
+      while ((i < cch) && IsSeparator(pch[i]))
+      {
+         ++i;
+      }
+      if (i == cch)
+      {
+         return cColors;
+      }
+
+      const auto iStart = i;
+      int        digits[9];
+      size_t     cDigits = 0;
+      auto       status  = Status::Ok;
+      if (pch[i] != '#')
+      {
+         status = std::isalpha(static_cast<unsigned char>(pch[i])) ? Status::UnknownName : Status::Empty;
+      }
+      else
+      {
+         for (++i; (i < cch) && (HexDigitValue(pch[i]) >= 0) && (cDigits < ARRAYSIZE(digits)); ++i)
+         {
+            digits[cDigits++] = HexDigitValue(pch[i]);
+         }
+         if ((cDigits != 3) && (cDigits != 4) && (cDigits != 6) && (cDigits != 8))
+         {
+            status = Status::BadHex;
+         }
+         else if ((i < cch) && !IsSeparator(pch[i]))
+         {
+            status = Status::TrailingText;
+         }
+      }
+
+      if (status == Status::Ok)
+      {
+         pColors->push_back((cDigits < 6) ? RGB(digits[0] * 0x11, digits[1] * 0x11, digits[2] * 0x11)
+                                          : RGB((digits[0] << 4) | digits[1], (digits[2] << 4) | digits[3], (digits[4] << 4) | digits[5]));
+         ++cColors;
+      }
+      else
+      {
+         if (pErrors)
+         {
+            pErrors->push_back(ColorText::Error{ status, iStart });
+         }
+         for (i = iStart; (i < cch) && !IsSeparator(pch[i]); ++i)
+         {
+         }
+      }
+   }
+}
+
+// Converts errors to pairs, which can be compared.
+std::vector<std::pair<Status, size_t>> Describe(const std::vector<ColorText::Error>& errors)
+{
+   std::vector<std::pair<Status, size_t>> descriptions;
+   for (const auto& error : errors)
+   {
+      descriptions.emplace_back(error.status, error.offset);
+   }
+   return descriptions;
+}
+
+std::string MakeHexList(size_t cColors, unsigned seed)
+{
+   std::mt19937 random(seed);
+   std::string  str;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      str += Narrow(ColorText::Format(random() & 0x00FFFFFF));
+      str += (i % 8 == 7) ? "\n" : ", ";
+   }
+   return str;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(ColorText, ParsesHexNotation)
+{
+   CHECK(ParseOrFail("#f00")      == RGB(0xFF, 0x00, 0x00));
+   CHECK(ParseOrFail("#F00A")     == RGB(0xFF, 0x00, 0x00));
+   CHECK(ParseOrFail("#12aB3c")   == RGB(0x12, 0xAB, 0x3C));
+   CHECK(ParseOrFail("#12ab3c80") == RGB(0x12, 0xAB, 0x3C));
+   CHECK(ParseOrFail("  #abc \t") == RGB(0xAA, 0xBB, 0xCC));
+
+   COLORREF clr;
+   for (const auto psz : { "#", "#12", "#12345", "#1234567", "#123456789", "#12345g" })
+   {
+      CHECK(Parse(std::string(psz), &clr) == Status::BadHex);
+   }
+   CHECK(Parse(std::string("#123456 x"), &clr) == Status::TrailingText);
+}
+
+TEST_CASE(ColorText, ParsesFunctionalNotation)
+{
+   CHECK(ParseOrFail("rgb(255, 0, 128)")           == RGB(255, 0, 128));
+   CHECK(ParseOrFail("RGBA(255,0,128,0.5)")        == RGB(255, 0, 128));
+   CHECK(ParseOrFail("rgb(255 0 128 / 50%)")       == RGB(255, 0, 128));
+   CHECK(ParseOrFail("rgb(100%, 50%, 0%)")         == RGB(255, 128, 0));
+   CHECK(ParseOrFail("rgb(300, -5, 1e2)")          == RGB(255, 0, 100));
+   CHECK(ParseOrFail("hsl(0, 100%, 50%)")          == RGB(255, 0, 0));
+   CHECK(ParseOrFail("hsl(120deg 100% 25%)")       == RGB(0, 128, 0));
+   CHECK(ParseOrFail("hsla(0.5turn, 100%, 50%, 1)") == RGB(0, 255, 255));
+   CHECK(ParseOrFail("hsl(-120, 100%, 50%)")       == RGB(0, 0, 255));
+
+   COLORREF clr;
+   for (const auto psz : { "rgb(1, 2)", "rgb(1, 2, 3", "rgb(1, 2, 3, 4, 5)", "rgb(1deg, 2, 3)", "rgb(1,,2,3)",
+                           "cmyk(1, 2, 3, 4)", "hsl(1, 2em, 3)", "rgb(1, 2, 3 / 4deg)" })
+   {
+      CHECK(Parse(std::string(psz), &clr) == Status::BadFunction);
+   }
+}
+
+TEST_CASE(ColorText, ParsesEveryNamedColor)
+{
+   // Every name must be found through the perfect hash (in any case), and formatting its color by
+   // name must give a name for the same color (which is not always the same name, since some colors
+   // have two).
+   for (const auto pszName : kNames)
+   {
+      const auto clr = ParseOrFail(pszName);
+      CHECK(ParseOrFail(ToUpper(pszName)) == clr);
+      CHECK(ParseOrFail(Narrow(ColorText::Format(clr, Notation::Name))) == clr);
+
+      COLORREF clrWide;
+      CHECK(Parse(Widen(pszName), &clrWide) == Status::Ok);
+      CHECK(clrWide == clr);
+   }
+   CHECK(ParseOrFail("rebeccapurple")        == RGB(0x66, 0x33, 0x99));
+   CHECK(ParseOrFail("LightGoldenrodYellow") == RGB(0xFA, 0xFA, 0xD2));
+   CHECK(ColorText::Format(RGB(128, 128, 128), Notation::Name) == _T("gray"));
+   CHECK(ColorText::Format(RGB(1, 2, 3),       Notation::Name) == _T("#010203"));
+}
+
+TEST_CASE(ColorText, RejectsUnknownNames)
+{
+   // Words that hash to the slot of a real name must still be rejected, so these include prefixes,
+   // extensions, and misspellings of real names, as well as names that are too long to be one.
+   COLORREF clr;
+   for (const auto pszName : { "re", "redd", "gren", "transparent", "x", "lightgoldenrodyellows",
+                               "aliceblueeeeeeeeeeeeeeeeeeeeeeeeeeeee", "currentcolor" })
+   {
+      CHECK(Parse(std::string(pszName), &clr) == Status::UnknownName);
+   }
+   for (const auto pszName : kNames)
+   {
+      std::string str(pszName);
+      str.back() = (str.back() == 'z') ? 'y' : 'z';
+      CHECK(Parse(str, &clr) == Status::UnknownName);
+   }
+   CHECK(Parse(std::string("   "), &clr) == Status::Empty);
+   CHECK(Parse(std::string("42"),  &clr) == Status::Empty);
+}
+
+TEST_CASE(ColorText, RoundTrips)
+{
+   // Hex, rgb(), and name notation must round-trip exactly, and hsl() to within rounding: half of a
+   // degree of hue, and half of a percent of saturation and of lightness, can together move a channel
+   // by up to 5 steps. Every color is checked by --exhaustive.
+   const auto isNear = [](COLORREF clr1, COLORREF clr2)
+   {
+      return (std::abs(GetRValue(clr1) - GetRValue(clr2)) <= 5) &&
+             (std::abs(GetGValue(clr1) - GetGValue(clr2)) <= 5) &&
+             (std::abs(GetBValue(clr1) - GetBValue(clr2)) <= 5);
+   };
+   const auto step        = Test::IsExhaustive() ? 1 : 5;
+   size_t     cMismatches = 0;
+   for (int r = 0; r < 256; r += step)
+   {
+      for (int g = 0; g < 256; g += step)
+      {
+         for (int b = 0; b < 256; b += step)
+         {
+            const auto clr = RGB(r, g, b);
+            for (const auto notation : { Notation::Hex, Notation::Rgb, Notation::Name, Notation::Hsl })
+            {
+               const auto str       = ColorText::Format(clr, notation);
+               COLORREF   clrParsed = CLR_INVALID;
+               if ((ColorText::Parse(static_cast<LPCTSTR>(str), str.GetLength(), &clrParsed) != Status::Ok) ||
+                   ((notation == Notation::Hsl) ? !isNear(clrParsed, clr) : (clrParsed != clr)))
+               {
+                  ++cMismatches;
+               }
+            }
+         }
+      }
+   }
+   CHECK(cMismatches == 0);
+}
+
+TEST_CASE(ColorText, ParsesListsAndReportsErrors)
+{
+   const std::string             str = "#f00, rgb(0, 1, 2); bogus\n#12 hsl(0 0% 100%)\r\n\tgreen rgb(1, 2,\n#000";
+   std::vector<COLORREF>         colors;
+   std::vector<ColorText::Error> errors;
+   CHECK(ColorText::ParseList(str.c_str(), str.length(), &colors, &errors) == 5);
+   CHECK((colors == std::vector<COLORREF>{ RGB(255, 0, 0), RGB(0, 1, 2), RGB(255, 255, 255), RGB(0, 128, 0), RGB(0, 0, 0) }));
+   REQUIRE(errors.size() == 3);
+   CHECK((Describe(errors) == std::vector<std::pair<Status, size_t>>{ { Status::UnknownName, str.find("bogus") },
+                                                                     { Status::BadHex,      str.find("#12")   },
+                                                                     { Status::BadFunction, str.find("rgb(1") } }));
+
+   // The wide form must give the same results, at the same offsets.
+   const auto                    wstr = Widen(str);
+   std::vector<COLORREF>         wideColors;
+   std::vector<ColorText::Error> wideErrors;
+   CHECK(ColorText::ParseList(wstr.c_str(), wstr.length(), &wideColors, &wideErrors) == 5);
+   CHECK(wideColors == colors);
+   CHECK(Describe(wideErrors) == Describe(errors));
+
+   // Colors are appended, and errors are optional.
+   CHECK(ColorText::ParseList("#fff", 4, &colors) == 1);
+   CHECK(colors.size() == 6);
+   CHECK(ColorText::ParseList("", 0, &colors) == 0);
+}
+
+TEST_CASE(ColorText, HexAgreesWithScalarParser)
+{
+   // Random runs of hexadecimal digits, other characters, and separators, which exercise the
+   // vectorized path for #rrggbb (and its checks for what follows the sixth digit) against a
+   // character-at-a-time parser. Each list is also parsed as wide text.
+   std::mt19937 random(1);
+   const char   kAlphabet[] = "0123456789abcdefABCDEF0123456789gGxX#/ ,;\n";
+   for (int iTrial = 0; iTrial < (Test::IsExhaustive() ? 200000 : 20000); ++iTrial)
+   {
+      std::string str;
+      for (auto cEntries = random() % 4; cEntries > 0; --cEntries)
+      {
+         str += '#';
+         for (auto cch = random() % 12; cch > 0; --cch)
+         {
+            str += kAlphabet[random() % (ARRAYSIZE(kAlphabet) - 1)];
+         }
+         str += " ,\n"[random() % 3];
+      }
+
+      std::vector<COLORREF>         expectedColors;
+      std::vector<ColorText::Error> expectedErrors;
+      ParseHexListByScalar(str.c_str(), str.length(), &expectedColors, &expectedErrors);
+
+      std::vector<COLORREF>         colors;
+      std::vector<ColorText::Error> errors;
+      ColorText::ParseList(str.c_str(), str.length(), &colors, &errors);
+      CHECK(colors == expectedColors);
+      CHECK(Describe(errors) == Describe(expectedErrors));
+
+      const auto                    wstr = Widen(str);
+      std::vector<COLORREF>         wideColors;
+      std::vector<ColorText::Error> wideErrors;
+      ColorText::ParseList(wstr.c_str(), wstr.length(), &wideColors, &wideErrors);
+      CHECK(wideColors == expectedColors);
+      CHECK(Describe(wideErrors) == Describe(expectedErrors));
+   }
+}
+
+TEST_CASE(ColorText, FormatsLists)
+{
+   const COLORREF colors[] = { RGB(255, 0, 0), RGB(0, 128, 0), RGB(1, 2, 3) };
+   CHECK(ColorText::FormatList(colors, 3)                          == _T("#ff0000, #008000, #010203"));
+   CHECK(ColorText::FormatList(colors, 3, Notation::Name, _T(";")) == _T("red;green;#010203"));
+   CHECK(ColorText::FormatList(colors, 1, Notation::Rgb)           == _T("rgb(255, 0, 0)"));
+   CHECK(ColorText::FormatList(colors, 2, Notation::Hsl)           == _T("hsl(0, 100%, 50%), hsl(120, 100%, 25%)"));
+   CHECK(ColorText::FormatList(nullptr, 0).IsEmpty());
+}
+
+
+BENCHMARK(ColorText, ParseList)
+{
+   // Lists of 65535 colors, as a large palette pasted from the clipboard would be. The hex lists
+   // are also parsed by the character-at-a-time reference parser, as a baseline for the vectorized path.
+   constexpr size_t kcColors = 65535;
+   std::mt19937     random(2);
+   const auto       hex = MakeHexList(kcColors, 3);
+   std::string      names;
+   std::string      functions;
+   for (size_t i = 0; i < kcColors; ++i)
+   {
+      names += kNames[random() % ARRAYSIZE(kNames)];
+      names += ", ";
+      functions += Narrow(ColorText::Format(random() & 0x00FFFFFF, (i % 2) ? Notation::Rgb : Notation::Hsl));
+      functions += "; ";
+   }
+   const auto wideHex = Widen(hex);
+
+   std::vector<COLORREF> colors;
+   colors.reserve(kcColors);
+   const auto run = [&benchmark, &colors](const char* pszCase, const auto& str)
+   {
+      benchmark.Run(pszCase, kcColors, [&colors, &str]
+                    {
+                       colors.clear();
+                       Test::DoNotOptimize(ColorText::ParseList(str.c_str(), str.length(), &colors));
+                    });
+   };
+   run("text=hex/chars=narrow",       hex);
+   run("text=hex/chars=wide",         wideHex);
+   run("text=names/chars=narrow",     names);
+   run("text=functions/chars=narrow", functions);
+   benchmark.Run("text=hex/chars=narrow/method=scalar-reference", kcColors, [&colors, &hex]
+                 {
+                    colors.clear();
+                    Test::DoNotOptimize(ParseHexListByScalar(hex.c_str(), hex.length(), &colors, nullptr));
+                 });
+}
+
+BENCHMARK(ColorText, FormatList)
+{
+   constexpr size_t      kcColors = 65535;
+   std::mt19937          random(4);
+   std::vector<COLORREF> colors(kcColors);
+   for (auto& clr : colors)
+   {
+      clr = random() & 0x00FFFFFF;
+   }
+   for (const auto notation : { Notation::Hex, Notation::Rgb, Notation::Hsl, Notation::Name })
+   {
+      const auto pszNotation = (notation == Notation::Hex) ? "hex"
+                             : (notation == Notation::Rgb) ? "rgb"
+                             : (notation == Notation::Hsl) ? "hsl"
+                                                           : "name";
+      benchmark.Run(benchmark.Case("notation=%s", pszNotation), kcColors, [&colors, notation]
+                    {
+                       Test::DoNotOptimize(ColorText::FormatList(colors.data(), colors.size(), notation));
+                    });
+   }
+}
@@ -0,0 +1,240 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "DisplayOrder.hpp"
+#include "ColorSpace.hpp"
+#include "ColorTableDiff.hpp"
+#include <random>
+
+
+namespace {
+
+using Order = DisplayOrder::Order;
+
+const Order kSortedOrders[] = { Order::HueBands, Order::Hilbert, Order::NearestNeighbor };
+
+std::vector<COLORREF> MakeRandomColors(size_t cColors, unsigned seed)
+{
+   std::mt19937          random(seed);
+   std::vector<COLORREF> colors(cColors);
+   for (auto& clr : colors)
+   {
+      clr = random() & 0x00FFFFFF;
+   }
+   return colors;
+}
+
+// Checks that the order lists every entry exactly once, and that its positions are its inverse.
+bool IsPermutation(const DisplayOrder& displayOrder, size_t cColors)
+{
+   std::vector<bool> seen(cColors);
+   for (size_t position = 0; position < cColors; ++position)
+   {
+      const auto index = displayOrder.IndexFromPosition(position);
+      if ((index >= cColors) || seen[index] || (displayOrder.PositionFromIndex(index) != position))
+      {
+         return false;
+      }
+      seen[index] = true;
+   }
+   return true;
+}
+
+// Makes a diff of random insertions, removals, and recolors (whose indices each refer to the
+// table as the edits before them have left it).
+ColorTableDiff MakeRandomDiff(size_t cColors, size_t cEdits, unsigned seed)
+{
+   std::mt19937   random(seed);
+   ColorTableDiff diff;
+   for (size_t i = 0; i < cEdits; ++i)
+   {
+      const auto clr = random() & 0x00FFFFFF;
+      switch ((cColors > 1) ? (random() % 3) : 0)
+      {
+         case 0:
+            diff.Insert(random() % (cColors + 1), clr, CString());
+            ++cColors;
+            break;
+         case 1:
+            diff.Remove(random() % cColors);
+            --cColors;
+            break;
+         case 2:
+            diff.Recolor(random() % cColors, clr);
+            break;
+      }
+   }
+   return diff;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(DisplayOrder, TableOrderIsIdentity)
+{
+   const auto         colors = MakeRandomColors(100, 1);
+   const DisplayOrder displayOrder(colors, Order::TableOrder, 7);
+   CHECK(displayOrder.GetOrder()   == Order::TableOrder);
+   CHECK(displayOrder.GetVersion() == 7);
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      CHECK(displayOrder.IndexFromPosition(i) == i);
+      CHECK(displayOrder.PositionFromIndex(i) == i);
+   }
+}
+
+TEST_CASE(DisplayOrder, SortedOrdersArePermutations)
+{
+   for (const size_t cColors : { size_t(1), size_t(2), size_t(48), size_t(1000), size_t(65535) })
+   {
+      const auto colors = MakeRandomColors(cColors, 2);
+      for (const auto order : kSortedOrders)
+      {
+         CHECK(IsPermutation(DisplayOrder(colors, order, 0), cColors));
+      }
+   }
+
+   // Duplicate colors must still each be listed once.
+   const std::vector<COLORREF> duplicates(500, RGB(10, 20, 30));
+   for (const auto order : kSortedOrders)
+   {
+      CHECK(IsPermutation(DisplayOrder(duplicates, order, 0), duplicates.size()));
+   }
+}
+
+TEST_CASE(DisplayOrder, HueBandsPutGraysFirstFromLightToDark)
+{
+   const std::vector<COLORREF> colors = { RGB(255,   0,   0),
+                                          RGB( 40,  40,  40),
+                                          RGB(  0,   0, 255),
+                                          RGB(255, 255, 255),
+                                          RGB(128, 128, 128),
+                                          RGB(  0, 128,   0) };
+   const DisplayOrder displayOrder(colors, Order::HueBands, 0);
+   CHECK(displayOrder.IndexFromPosition(0) == 3);
+   CHECK(displayOrder.IndexFromPosition(1) == 4);
+   CHECK(displayOrder.IndexFromPosition(2) == 1);
+   CHECK(displayOrder.PositionFromIndex(0) == 3);  // (red is the first band)
+}
+
+TEST_CASE(DisplayOrder, NearestNeighborChainIsGreedy)
+{
+   // Starting from the darkest color, each step must go to the nearest color in OKLab that has
+   // not been visited yet (the one with the lower index, on a tie), as a brute-force search finds.
+   const auto         colors = MakeRandomColors(400, 3);
+   const DisplayOrder displayOrder(colors, Order::NearestNeighbor, 0);
+   REQUIRE(IsPermutation(displayOrder, colors.size()));
+
+   std::vector<ColorSpace::Lab> points;
+   for (const auto clr : colors)
+   {
+      points.push_back(ColorSpace::ToOKLab(clr));
+   }
+   const auto darkest = std::min_element(points.begin(), points.end(), [](const ColorSpace::Lab& x, const ColorSpace::Lab& y)
+                                         {
+                                            return (x.L < y.L);
+                                         });
+   CHECK(displayOrder.IndexFromPosition(0) == static_cast<size_t>(darkest - points.begin()));
+
+   std::vector<bool> visited(colors.size());
+   for (size_t position = 0; (position + 1) < colors.size(); ++position)
+   {
+      const auto current = displayOrder.IndexFromPosition(position);
+      visited[current] = true;
+
+      auto best  = colors.size();
+      auto dBest = 0.0f;
+      for (size_t i = 0; i < colors.size(); ++i)
+      {
+         const auto d = ColorSpace::DistanceSquared(points[current], points[i]);
+         if (!visited[i] && ((best == colors.size()) || (d < dBest)))
+         {
+            best  = i;
+            dBest = d;
+         }
+      }
+      CHECK(displayOrder.IndexFromPosition(position + 1) == best);
+   }
+}
+
+TEST_CASE(DisplayOrder, AdoptsPrecomputedOrder)
+{
+   const UINT16       indices[] = { 3, 0, 2, 1 };
+   const DisplayOrder displayOrder(indices, ARRAYSIZE(indices), Order::Hilbert, 5);
+   CHECK(displayOrder.GetOrder()   == Order::Hilbert);
+   CHECK(displayOrder.GetVersion() == 5);
+   CHECK(IsPermutation(displayOrder, ARRAYSIZE(indices)));
+   CHECK(displayOrder.IndexFromPosition(0) == 3);
+   CHECK(displayOrder.PositionFromIndex(3) == 0);
+   CHECK(displayOrder.PositionFromIndex(1) == 3);
+}
+
+
+TEST_CASE(DisplayOrder, EditedOrderMatchesRecomputed)
+{
+   // An order that is edited (by moving only the edited entries) must be the same as one that is
+   // computed from scratch for the edited colors.
+   const Order orders[] = { Order::TableOrder, Order::HueBands, Order::Hilbert, Order::NearestNeighbor };
+   unsigned    seed     = 5;
+   for (const size_t cColors : { size_t(1), size_t(48), size_t(1000) })
+   {
+      for (const size_t cEdits : { size_t(1), size_t(10), size_t(200) })
+      {
+         for (const auto order : orders)
+         {
+            auto               colors = MakeRandomColors(cColors, seed);
+            const auto         diff   = MakeRandomDiff(cColors, cEdits, seed++);
+            const DisplayOrder previous(colors, order, 1);
+            diff.ApplyTo(colors);
+
+            const DisplayOrder edited    (previous, diff, colors, 2);
+            const DisplayOrder recomputed(colors, order, 2);
+            CHECK(edited.GetOrder()   == order);
+            CHECK(edited.GetVersion() == 2);
+            REQUIRE(IsPermutation(edited, colors.size()));
+            for (size_t position = 0; position < colors.size(); ++position)
+            {
+               CHECK(edited.IndexFromPosition(position) == recomputed.IndexFromPosition(position));
+            }
+         }
+      }
+   }
+}
+
+BENCHMARK(DisplayOrder, Compute)
+{
+   for (const size_t cColors : { size_t(48), size_t(1024), size_t(16384), size_t(65535) })
+   {
+      const auto colors = MakeRandomColors(cColors, 4);
+      for (const auto order : kSortedOrders)
+      {
+         const auto pszOrder = (order == Order::HueBands) ? "hue-bands"
+                             : (order == Order::Hilbert)  ? "hilbert"
+                                                          : "nearest-neighbor";
+         benchmark.Run(benchmark.Case("order=%s/colors=%zu", pszOrder, cColors), cColors, [&colors, order]
+                       {
+                          Test::DoNotOptimize(DisplayOrder(colors, order, 0));
+                       });
+      }
+   }
+}
+
+BENCHMARK(DisplayOrder, Edit)
+{
+   // Recoloring one entry should only move that entry, rather than sorting the table again.
+   for (const size_t cColors : { size_t(1024), size_t(65535) })
+   {
+      const auto colors = MakeRandomColors(cColors, 6);
+      const auto diff   = MakeRandomDiff(cColors, 1, 7);
+      for (const auto order : { Order::HueBands, Order::Hilbert })
+      {
+         const auto         pszOrder = (order == Order::HueBands) ? "hue-bands" : "hilbert";
+         const DisplayOrder previous(colors, order, 0);
+         auto               edited = colors;
+         diff.ApplyTo(edited);
+         benchmark.Run(benchmark.Case("order=%s/colors=%zu/edits=1", pszOrder, cColors), 1, [&previous, &diff, &edited]
+                       {
+                          Test::DoNotOptimize(DisplayOrder(previous, diff, edited, 1));
+                       });
+      }
+   }
+}
@@ -0,0 +1,166 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "InputLog.hpp"
+#include <random>
+
+
+namespace {
+
+using Type = InputEvent::Type;
+
+bool IsMouseInput(Type type)
+{
+   return (type == Type::MouseMove) || (type == Type::LButtonDown) || (type == Type::LButtonUp);
+}
+
+// Makes a session of random inputs, with the times and positions that a real one might have
+// (including the tick count wrapping around, and the mouse leaving the window).
+InputLog MakeLog(size_t cEvents, unsigned seed)
+{
+   std::mt19937 random(seed);
+   InputLog     log;
+   log.SetInitialColor(random() & 0x00FFFFFF);
+   log.SetOutcome({ (random() % 2) == 0, (random() % 4) == 0, random() & 0x00FFFFFF });
+   DWORD time = static_cast<DWORD>(random());
+   short x    = static_cast<short>(random() % 400);
+   short y    = static_cast<short>(random() % 400);
+   for (size_t i = 0; i < cEvents; ++i)
+   {
+      InputEvent event;
+      event.type  = static_cast<Type>(random() % (static_cast<unsigned>(Type::Char) + 1));
+      event.shift = ((random() % 8) == 0);
+      event.time  = (time += random() % 100);
+      if (IsMouseInput(event.type))
+      {
+         x = static_cast<short>(x + static_cast<int>(random() % 41) - 20);
+         y = static_cast<short>(y + static_cast<int>(random() % 41) - 20);
+         event.wParam = (random() % 2) ? MK_LBUTTON : 0;
+         event.lParam = static_cast<UINT32>(MAKELPARAM(x, y));
+      }
+      else
+      {
+         event.wParam = (event.type == Type::Char) ? (TEXT('a') + (random() % 26)) : (random() % 256);
+         event.lParam = static_cast<UINT32>(random());
+      }
+      log.Append(event);
+   }
+   return log;
+}
+
+// Checks that two logs hold the same session. (Times are only kept relative to the first input.)
+bool AreSameSession(const InputLog& log1, const InputLog& log2)
+{
+   const auto& events1 = log1.GetEvents();
+   const auto& events2 = log2.GetEvents();
+   if ((log1.GetInitialColor()   != log2.GetInitialColor())   ||
+       (log1.GetOutcome().okayed != log2.GetOutcome().okayed) ||
+       (log1.GetOutcome().custom != log2.GetOutcome().custom) ||
+       (log1.GetOutcome().clr    != log2.GetOutcome().clr)    ||
+       (events1.size()           != events2.size()))
+   {
+      return false;
+   }
+   for (size_t i = 0; i < events1.size(); ++i)
+   {
+      const auto time1 = events1[i].time - events1.front().time;
+      const auto time2 = events2[i].time - events2.front().time;
+      if ((events1[i].type   != events2[i].type)   ||
+          (events1[i].shift  != events2[i].shift)  ||
+          (time1             != time2)             ||
+          (events1[i].wParam != events2[i].wParam) ||
+          (events1[i].lParam != events2[i].lParam))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(InputLog, RoundTripsSessions)
+{
+   const auto cTrials = Test::IsExhaustive() ? 2000 : 200;
+   for (int trial = 0; trial < cTrials; ++trial)
+   {
+      const auto log  = MakeLog(trial % 300, trial);
+      const auto data = log.Serialize();
+
+      InputLog decoded;
+      REQUIRE(decoded.Deserialize(data.data(), data.size()) == InputLog::Status::Ok);
+      CHECK(AreSameSession(log, decoded));
+   }
+
+   // An empty session (opened and closed at once) is a header and a count.
+   const InputLog empty;
+   const auto     data = empty.Serialize();
+   InputLog       decoded;
+   CHECK(decoded.Deserialize(data.data(), data.size()) == InputLog::Status::Ok);
+   CHECK(AreSameSession(empty, decoded));
+}
+
+TEST_CASE(InputLog, KeepsSessionsCompact)
+{
+   // Hovering moves the mouse a little at a time, at a steady rate, so each move should take
+   // only a few bytes.
+   InputLog log;
+   for (UINT32 i = 0; i < 1000; ++i)
+   {
+      const InputEvent event = { Type::MouseMove, false, i * 16, 0, static_cast<UINT32>(MAKELPARAM(10 + (i % 50), 10 + (i / 50))) };
+      log.Append(event);
+   }
+   CHECK(log.Serialize().size() < (5 * 1000) + 64);
+}
+
+TEST_CASE(InputLog, RejectsDamagedLogs)
+{
+   const auto log  = MakeLog(50, 1);
+   const auto data = log.Serialize();
+
+   // Every truncation is rejected, and leaves the log as it was.
+   for (size_t cbData = 0; cbData < data.size(); ++cbData)
+   {
+      auto decoded = MakeLog(3, 2);
+      CHECK(decoded.Deserialize(data.data(), cbData) == InputLog::Status::NotInputLog);
+      CHECK(AreSameSession(decoded, MakeLog(3, 2)));
+   }
+
+   // So is a log of another format.
+   auto damaged = data;
+   damaged[0] ^= 0xFF;
+   InputLog decoded;
+   CHECK(decoded.Deserialize(damaged.data(), damaged.size()) == InputLog::Status::NotInputLog);
+
+   // Flipping bits anywhere must never read out of bounds (the result need not be rejected).
+   std::mt19937 random(3);
+   for (int i = 0; i < (Test::IsExhaustive() ? 100000 : 10000); ++i)
+   {
+      damaged = data;
+      damaged[random() % damaged.size()] ^= static_cast<BYTE>(1 << (random() % 8));
+      decoded.Deserialize(damaged.data(), damaged.size());
+   }
+}
+
+TEST_CASE(InputLog, ClearResetsTheSession)
+{
+   auto log = MakeLog(10, 4);
+   log.Clear();
+   CHECK(AreSameSession(log, InputLog()));
+}
+
+
+BENCHMARK(InputLog, Serialize)
+{
+   const auto log  = MakeLog(10000, 5);
+   const auto data = log.Serialize();
+   benchmark.Run("serialize", log.GetEvents().size(), [&log]
+                 {
+                    Test::DoNotOptimize(log.Serialize());
+                 });
+   InputLog decoded;
+   benchmark.Run("deserialize", log.GetEvents().size(), [&decoded, &data]
+                 {
+                    Test::DoNotOptimize(decoded.Deserialize(data.data(), data.size()));
+                 });
+}
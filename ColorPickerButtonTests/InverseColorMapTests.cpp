@@ -0,0 +1,219 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "InverseColorMap.hpp"
+#include <climits>                // for INT_MAX
+#include <random>
+#include <thread>
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Tables
+//////////////////////////////////////////////////
+
+std::vector<COLORREF> MakeRandomColors(size_t cColors, unsigned seed)
+{
+   std::mt19937          random(seed);
+   std::vector<COLORREF> colors(cColors);
+   for (auto& clr : colors)
+   {
+      clr = random() & 0x00FFFFFF;
+   }
+   return colors;
+}
+
+// Makes a table whose colors are all repeated (in a different order), so that every nearest entry is
+// tied with another one, and the lookups must prefer the lower index.
+std::vector<COLORREF> MakeDuplicatedColors(size_t cColors, unsigned seed)
+{
+   auto colors     = MakeRandomColors(cColors, seed);
+   auto duplicates = colors;
+   std::shuffle(duplicates.begin(), duplicates.end(), std::mt19937(seed + 1));
+   colors.insert(colors.end(), duplicates.begin(), duplicates.end());
+   return colors;
+}
+
+
+//////////////////////////////////////////////////
+// Brute Force
+//////////////////////////////////////////////////
+
+// Finds the entry nearest to the color by Euclidean distance in RGB, preferring the lower index on a tie.
+size_t FindNearestByBruteForce(const std::vector<COLORREF>& colors, COLORREF clr)
+{
+   auto best          = InverseColorMap::kInvalidIndex;
+   auto bestDistance  = INT_MAX;
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      const auto dr       = GetRValue(colors[i]) - GetRValue(clr);
+      const auto dg       = GetGValue(colors[i]) - GetGValue(clr);
+      const auto db       = GetBValue(colors[i]) - GetBValue(clr);
+      const auto distance = (dr * dr) + (dg * dg) + (db * db);
+      if (distance < bestDistance)
+      {
+         best         = i;
+         bestDistance = distance;
+      }
+   }
+   return best;
+}
+
+// Checks that FindNearest agrees with a brute-force search for every color (if the exhaustive tests
+// were asked for), or else for every color whose channels are all multiples of 7; and that
+// LookupNearest agrees with it at the center of every cell (where it is meant to be exact).
+void CheckAgreesWithBruteForce(const std::vector<COLORREF>& colors)
+{
+   const InverseColorMap map(colors);
+   REQUIRE(map.GetColorCount() == colors.size());
+
+   const auto step        = Test::IsExhaustive() ? 1 : 7;
+   size_t     cMismatches = 0;
+   for (int r = 0; r < 256; r += step)
+   {
+      for (int g = 0; g < 256; g += step)
+      {
+         for (int b = 0; b < 256; b += step)
+         {
+            const auto clr = RGB(r, g, b);
+            if (map.FindNearest(clr) != FindNearestByBruteForce(colors, clr))
+            {
+               ++cMismatches;
+            }
+         }
+      }
+   }
+   CHECK(cMismatches == 0);
+
+   size_t cCellMismatches = 0;
+   for (int r = 4; r < 256; r += 8)
+   {
+      for (int g = 4; g < 256; g += 8)
+      {
+         for (int b = 4; b < 256; b += 8)
+         {
+            const auto clr = RGB(r, g, b);
+            if (map.LookupNearest(clr) != FindNearestByBruteForce(colors, clr))
+            {
+               ++cCellMismatches;
+            }
+         }
+      }
+   }
+   CHECK(cCellMismatches == 0);
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(InverseColorMap, AgreesWithBruteForce)
+{
+   for (const auto cColors : { 1, 2, 16, 256, 4096 })
+   {
+      CheckAgreesWithBruteForce(MakeRandomColors(cColors, static_cast<unsigned>(cColors)));
+   }
+}
+
+TEST_CASE(InverseColorMap, PrefersTheLowerIndexOnATie)
+{
+   CheckAgreesWithBruteForce(MakeDuplicatedColors(64, 7));
+
+   // Two identical entries: only the lower index may ever be found.
+   const std::vector<COLORREF> colors = { RGB(0, 0, 0), RGB(0, 0, 0), RGB(255, 255, 255) };
+   const InverseColorMap       map(colors);
+   CHECK(map.FindNearest  (RGB(10, 10, 10)) == 0);
+   CHECK(map.LookupNearest(RGB(12, 12, 12)) == 0);
+   CHECK(map.FindNearest  (RGB(250, 250, 250)) == 2);
+}
+
+TEST_CASE(InverseColorMap, FillsBoxesOnlyWhenLookedUp)
+{
+   const auto            colors = MakeRandomColors(256, 11);
+   const InverseColorMap map(colors);
+   const auto            cbEmpty = map.GetByteSize();
+
+   map.FindNearest(RGB(0, 0, 0));
+   const auto cbOneBox = map.GetByteSize();
+   CHECK(cbOneBox > cbEmpty);
+
+   // Another color in the same box fills nothing more.
+   map.LookupNearest(RGB(20, 20, 20));
+   CHECK(map.GetByteSize() == cbOneBox);
+
+   map.FindNearest(RGB(255, 255, 255));
+   CHECK(map.GetByteSize() > cbOneBox);
+}
+
+TEST_CASE(InverseColorMap, FillsBoxesSafelyFromManyThreads)
+{
+   const auto            colors = MakeRandomColors(1024, 13);
+   const InverseColorMap map(colors);
+
+   // Each thread looks up the same colors in a different order, so that they race to fill the boxes.
+   constexpr size_t         kcThreads = 4;
+   std::vector<size_t>      cMismatches(kcThreads);
+   std::vector<std::thread> threads;
+   for (size_t iThread = 0; iThread < kcThreads; ++iThread)
+   {
+      threads.emplace_back([&map, &colors, &cMismatches, iThread]
+                           {
+                              auto queries = MakeRandomColors(4096, 17);
+                              std::shuffle(queries.begin(), queries.end(), std::mt19937(static_cast<unsigned>(iThread)));
+                              for (const auto clr : queries)
+                              {
+                                 if (map.FindNearest(clr) != FindNearestByBruteForce(colors, clr))
+                                 {
+                                    ++cMismatches[iThread];
+                                 }
+                              }
+                           });
+   }
+   for (auto& thread : threads)
+   {
+      thread.join();
+   }
+   for (const auto c : cMismatches)
+   {
+      CHECK(c == 0);
+   }
+}
+
+
+BENCHMARK(InverseColorMap, FindNearest)
+{
+   constexpr size_t kcQueries = 4096;
+   const auto       queries   = MakeRandomColors(kcQueries, 5);
+
+   for (const auto cColors : { 16, 256, 4096 })
+   {
+      const auto            colors = MakeRandomColors(cColors, static_cast<unsigned>(cColors));
+      const InverseColorMap map(colors);
+      benchmark.Run(benchmark.Case("colors=%d/method=lookup", cColors), kcQueries, [&map, &queries]
+                    {
+                       size_t sum = 0;
+                       for (const auto clr : queries)
+                       {
+                          sum += map.LookupNearest(clr);
+                       }
+                       Test::DoNotOptimize(sum);
+                    });
+      benchmark.Run(benchmark.Case("colors=%d/method=find", cColors), kcQueries, [&map, &queries]
+                    {
+                       size_t sum = 0;
+                       for (const auto clr : queries)
+                       {
+                          sum += map.FindNearest(clr);
+                       }
+                       Test::DoNotOptimize(sum);
+                    });
+      benchmark.Run(benchmark.Case("colors=%d/method=brute-force", cColors), kcQueries, [&colors, &queries]
+                    {
+                       size_t sum = 0;
+                       for (const auto clr : queries)
+                       {
+                          sum += FindNearestByBruteForce(colors, clr);
+                       }
+                       Test::DoNotOptimize(sum);
+                    });
+   }
+}
@@ -0,0 +1,163 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "LatencyHistogram.hpp"
+#include <random>
+
+
+namespace {
+
+// Checks that a reported value is the value that was recorded, rounded up by less than the
+// histogram's precision (values below 64 are exact; above that, buckets are 1/32 of their power of two).
+bool IsWithinPrecision(UINT32 reported, UINT32 recorded)
+{
+   return (reported >= recorded) && ((reported - recorded) <= (recorded / 32));
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(LatencyHistogram, EmptyHistogramReportsZero)
+{
+   LatencyHistogram histogram;
+   CHECK(histogram.GetCount()                 == 0);
+   CHECK(histogram.GetMax()                   == 0);
+   CHECK(histogram.GetValueAtPercentile(0.0)  == 0);
+   CHECK(histogram.GetValueAtPercentile(99.0) == 0);
+
+   histogram.Record(1234);
+   histogram.Reset();
+   CHECK(histogram.GetCount()                 == 0);
+   CHECK(histogram.GetMax()                   == 0);
+   CHECK(histogram.GetValueAtPercentile(50.0) == 0);
+}
+
+TEST_CASE(LatencyHistogram, SmallValuesAreExact)
+{
+   LatencyHistogram histogram;
+   for (UINT32 value = 0; value < 64; ++value)
+   {
+      histogram.Record(value);
+   }
+   CHECK(histogram.GetCount() == 64);
+   CHECK(histogram.GetMax()   == 63);
+   for (UINT32 value = 0; value < 64; ++value)
+   {
+      // (The sample of rank n is the value n - 1; this asks for the rank value + 1.)
+      CHECK(histogram.GetValueAtPercentile((value + 0.5) * 100.0 / 64) == value);
+   }
+}
+
+TEST_CASE(LatencyHistogram, BucketsKeepTheirPrecision)
+{
+   // Each value is recorded alone beside the largest possible one, so that its own bucket, rather
+   // than the maximum, decides what the median reports.
+   std::vector<UINT32> values;
+   for (int iBit = 0; iBit < 32; ++iBit)
+   {
+      const auto power = UINT32(1) << iBit;
+      values.insert(values.end(), { power - 1, power, power + 1 });
+   }
+   std::mt19937 random(1);
+   for (int i = 0; i < (Test::IsExhaustive() ? 1000000 : 10000); ++i)
+   {
+      values.push_back(static_cast<UINT32>(random()) >> (random() % 32));
+   }
+
+   LatencyHistogram histogram;
+   for (const auto value : values)
+   {
+      histogram.Reset();
+      histogram.Record(value);
+      histogram.Record(UINT32_MAX);
+      CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(50.0), value));
+      CHECK(histogram.GetValueAtPercentile(100.0) == UINT32_MAX);
+   }
+
+   // A sample alone is reported exactly, because no value is reported above the maximum.
+   for (const auto value : values)
+   {
+      histogram.Reset();
+      histogram.Record(value);
+      CHECK(histogram.GetMax()                   == value);
+      CHECK(histogram.GetValueAtPercentile(50.0) == value);
+   }
+}
+
+TEST_CASE(LatencyHistogram, PercentilesFollowTheRanks)
+{
+   // Record 1 to 1000, in a shuffled order, so that the sample of rank n is the value n.
+   std::vector<UINT32> values(1000);
+   for (UINT32 i = 0; i < values.size(); ++i)
+   {
+      values[i] = i + 1;
+   }
+   std::shuffle(values.begin(), values.end(), std::mt19937(2));
+
+   LatencyHistogram histogram;
+   for (const auto value : values)
+   {
+      histogram.Record(value);
+   }
+   CHECK(histogram.GetCount() == 1000);
+   CHECK(histogram.GetMax()   == 1000);
+   CHECK(histogram.GetValueAtPercentile(0.0)   == 1);     // (the smallest sample)
+   CHECK(histogram.GetValueAtPercentile(-5.0)  == 1);     // (clamped)
+   CHECK(histogram.GetValueAtPercentile(100.0) == 1000);
+   CHECK(histogram.GetValueAtPercentile(250.0) == 1000);  // (clamped)
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(50.0), 500));
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(90.0), 900));
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(99.0), 990));
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(99.9), 999));
+
+   // Percentiles never go down as they go up.
+   UINT32 valueLast = 0;
+   for (double percentile = 0.0; percentile <= 100.0; percentile += 0.1)
+   {
+      const auto value = histogram.GetValueAtPercentile(percentile);
+      CHECK(value >= valueLast);
+      valueLast = value;
+   }
+}
+
+TEST_CASE(LatencyHistogram, OutliersOnlyMoveTheTail)
+{
+   // A session of fast inputs with a few slow ones (a paint that missed the cache, say) keeps its
+   // median, and shows the slow ones only at the top.
+   LatencyHistogram histogram;
+   for (int i = 0; i < 990; ++i)
+   {
+      histogram.Record(200);
+   }
+   for (int i = 0; i < 10; ++i)
+   {
+      histogram.Record(50000);
+   }
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(50.0), 200));
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(99.0), 200));
+   CHECK(IsWithinPrecision(histogram.GetValueAtPercentile(99.1), 50000));
+   CHECK(histogram.GetMax() == 50000);
+}
+
+
+BENCHMARK(LatencyHistogram, Record)
+{
+   // Every input that the pop-up window handles records a sample, so this must stay cheap.
+   std::mt19937        random(3);
+   std::vector<UINT32> values(4096);
+   for (auto& value : values)
+   {
+      value = static_cast<UINT32>(random()) >> (8 + (random() % 24));
+   }
+   LatencyHistogram histogram;
+   benchmark.Run("record", values.size(), [&histogram, &values]
+                 {
+                    for (const auto value : values)
+                    {
+                       histogram.Record(value);
+                    }
+                 });
+   benchmark.Run("percentile", 1, [&histogram]
+                 {
+                    Test::DoNotOptimize(histogram.GetValueAtPercentile(99.0));
+                 });
+}
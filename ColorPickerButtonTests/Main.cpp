@@ -0,0 +1,76 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+
+
+// ColorPickerButtonTests runs the library's tests, or its benchmarks.
+//
+// Usage: ColorPickerButtonTests [<options>] [<filter>...]
+//  - filter:                 a prefix of the names (suite.name) of the tests or benchmarks to run;
+//                            all of them are run if no filter is given
+//  - --exhaustive:           run the exhaustive forms of the tests that otherwise sample their
+//                            inputs (such as checking every one of the 16.7 million colors)
+//  - --bench:                run the benchmarks instead of the tests, writing one line of JSON for
+//                            each case (so that the output can be kept as a baseline)
+//  - --baseline <file>:      compare the benchmarks to the results in a file written by an earlier
+//                            run, failing if any case has become slower than the tolerance allows
+//  - --tolerance <percent>:  the slowdown that is tolerated (10%, by default)
+//  - --min-time <seconds>:   the minimum time to take timing each case (0.1 seconds, by default)
+//
+// The exit code is 0 if every test passed (or no benchmark regressed), 1 if not, and 2 if the
+// command line is invalid. Benchmarks should be run from a Release build.
+
+CWinApp theApp;  // (which MFC needs, to create the windows that the button tests use)
+
+int _tmain(int argc, TCHAR* argv[])
+{
+   if (!AfxWinInit(::GetModuleHandle(nullptr), nullptr, ::GetCommandLine(), 0))
+   {
+      _ftprintf(stderr, _T("Cannot initialize MFC.\n"));
+      return 2;
+   }
+
+   Test::Options options;
+   options.runBenchmarks = false;
+   options.isExhaustive  = false;
+   options.minSeconds    = 0.1;
+   options.pszBaseline   = nullptr;
+   options.tolerance     = 0.10;
+   for (int iArgument = 1; iArgument < argc; ++iArgument)
+   {
+      const auto pszArgument = argv[iArgument];
+      const auto hasValue    = ((iArgument + 1) < argc);
+      if (_tcscmp(pszArgument, _T("--exhaustive")) == 0)
+      {
+         options.isExhaustive = true;
+      }
+      else if (_tcscmp(pszArgument, _T("--bench")) == 0)
+      {
+         options.runBenchmarks = true;
+      }
+      else if ((_tcscmp(pszArgument, _T("--baseline")) == 0) && hasValue)
+      {
+         options.pszBaseline = argv[++iArgument];
+      }
+      else if ((_tcscmp(pszArgument, _T("--tolerance")) == 0) && hasValue)
+      {
+         options.tolerance = _tcstod(argv[++iArgument], nullptr) / 100.0;
+      }
+      else if ((_tcscmp(pszArgument, _T("--min-time")) == 0) && hasValue)
+      {
+         options.minSeconds = _tcstod(argv[++iArgument], nullptr);
+      }
+      else if (_tcsncmp(pszArgument, _T("--"), 2) == 0)
+      {
+         _ftprintf(stderr,
+                   _T("Usage: ColorPickerButtonTests [--exhaustive] [--bench [--baseline <file>] [--tolerance <percent>]")
+                   _T(" [--min-time <seconds>]] [<filter>...]\n"));
+         return 2;
+      }
+      else
+      {
+         options.filters.push_back(CStringA(pszArgument));
+      }
+   }
+
+   return Test::Run(options);
+}
@@ -0,0 +1,152 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "NameSearchIndex.hpp"
+
+
+namespace {
+
+std::vector<CString> MakeNames(std::initializer_list<LPCTSTR> pszNames)
+{
+   return std::vector<CString>(pszNames.begin(), pszNames.end());
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(NameSearchIndex, RanksPrefixesThenWordsThenSubstrings)
+{
+   const NameSearchIndex index(MakeNames({ TEXT("Dark Red"),
+                                           TEXT("Reddish Brown"),
+                                           TEXT("Infrared"),
+                                           TEXT("Red"),
+                                           TEXT("Bored Grey"),
+                                           TEXT("Blue") }),
+                               1);
+   CHECK(index.GetVersion() == 1);
+   CHECK(!index.IsEmpty());
+
+   // Names that start with the query (shortest first), then a name with a word that does, and then
+   // names that contain it. (A name is only found once, in the best tier that it qualifies for.)
+   CHECK((index.Find(TEXT("red")) == std::vector<size_t>{ 3, 1, 0, 2, 4 }));
+   CHECK((index.Find(TEXT("dark red")) == std::vector<size_t>{ 0 }));
+   CHECK((index.Find(TEXT("brown")) == std::vector<size_t>{ 1 }));
+}
+
+TEST_CASE(NameSearchIndex, RanksShorterNamesFirstThenLowerIndices)
+{
+   const NameSearchIndex index(MakeNames({ TEXT("Blue Violet"), TEXT("Blue"), TEXT("Blue"), TEXT("Blues") }), 1);
+   CHECK((index.Find(TEXT("blue")) == std::vector<size_t>{ 1, 2, 3, 0 }));
+}
+
+TEST_CASE(NameSearchIndex, IgnoresCase)
+{
+   const NameSearchIndex index(MakeNames({ TEXT("light SEA green"), TEXT("Sea Shell"), TEXT("SEASHELL") }), 1);
+   const auto            matches = index.Find(TEXT("sea"));
+   CHECK((matches == std::vector<size_t>{ 2, 1, 0 }));
+   CHECK(index.Find(TEXT("SEA"))   == matches);
+   CHECK(index.Find(TEXT("sEa"))   == matches);
+   CHECK((index.Find(TEXT("GREEN")) == std::vector<size_t>{ 0 }));
+}
+
+TEST_CASE(NameSearchIndex, FindsSubstringsOfThreeCharactersOrMore)
+{
+   const NameSearchIndex index(MakeNames({ TEXT("Red"), TEXT("Tan") }), 1);
+   CHECK(index.Find(TEXT("ed")).empty());
+   CHECK((index.Find(TEXT("red")) == std::vector<size_t>{ 0 }));
+   CHECK(index.Find(TEXT("x")).empty());
+   CHECK(index.Find(TEXT("")).empty());
+}
+
+TEST_CASE(NameSearchIndex, FindsMisspellings)
+{
+   // A misspelling that shares at least half of its trigrams with a name finds it, ranked by how
+   // many of the trigrams of either one they share (so that the closer name ranks first, whatever
+   // its index), and after every name that matches exactly.
+   const NameSearchIndex index(MakeNames({ TEXT("Lavender Blush"),
+                                           TEXT("Turquoise"),
+                                           TEXT("Lavender"),
+                                           TEXT("Olive") }),
+                               1);
+   CHECK((index.Find(TEXT("lavendar"))  == std::vector<size_t>{ 2, 0 }));
+   CHECK((index.Find(TEXT("turquoize")) == std::vector<size_t>{ 1 }));
+   CHECK(index.Find(TEXT("purple")).empty());
+
+   // (A query with only one trigram is found exactly, or not at all.)
+   CHECK(index.Find(TEXT("olv")).empty());
+}
+
+TEST_CASE(NameSearchIndex, ReturnsTheBestMatchesOnly)
+{
+   std::vector<CString> names;
+   for (size_t i = 0; i < 100; ++i)
+   {
+      CString strName;
+      strName.Format(TEXT("Gray %zu"), 99 - i);
+      names.push_back(strName);
+   }
+   const NameSearchIndex index(names, 1);
+   const auto            matches = index.Find(TEXT("gray"));
+   REQUIRE(matches.size() == NameSearchIndex::kcMatchesMax);
+
+   // The names of one digit are the shortest, so they come first (by index, "Gray 9" first).
+   CHECK(matches.front() == 90);
+   CHECK(matches[9]      == 99);
+}
+
+TEST_CASE(NameSearchIndex, IsEmptyWithoutNames)
+{
+   const NameSearchIndex index(MakeNames({ TEXT(""), TEXT(""), TEXT("") }), 2);
+   CHECK(index.IsEmpty());
+   CHECK(index.Find(TEXT("red")).empty());
+}
+
+TEST_CASE(NameSearchIndex, GetsEachNameOnceInOrder)
+{
+   const auto          names = MakeNames({ TEXT("Red"), TEXT("Dark Red"), TEXT("Redwood"), TEXT("Green") });
+   std::vector<size_t> gotten;
+   const NameSearchIndex fromGetter(names.size(),
+                                    [&names, &gotten](size_t index)
+                                    {
+                                       gotten.push_back(index);
+                                       return names[index];
+                                    },
+                                    3);
+   CHECK((gotten == std::vector<size_t>{ 0, 1, 2, 3 }));
+   CHECK(fromGetter.GetVersion() == 3);
+
+   const NameSearchIndex fromVector(names, 3);
+   for (const auto pszQuery : { TEXT("red"), TEXT("green"), TEXT("wood"), TEXT("grene") })
+   {
+      CHECK(fromGetter.Find(pszQuery) == fromVector.Find(pszQuery));
+   }
+   CHECK(fromGetter.GetByteSize() == fromVector.GetByteSize());
+}
+
+
+BENCHMARK(NameSearchIndex, Find)
+{
+   for (const size_t cNames : { size_t(48), size_t(4096), size_t(65535) })
+   {
+      std::vector<CString> names;
+      for (size_t i = 0; i < cNames; ++i)
+      {
+         CString strName;
+         strName.Format(TEXT("Color %zu"), i);
+         names.push_back(strName);
+      }
+      const NameSearchIndex                      index(names, 1);
+      const std::pair<const char*, const TCHAR*> queries[] =
+      {
+         { "short",      TEXT("c")       },
+         { "long",       TEXT("color 4") },
+         { "misspelled", TEXT("colr 40") },
+      };
+      for (const auto& query : queries)
+      {
+         benchmark.Run(benchmark.Case("names=%zu/query=%s", cNames, query.first), 1, [&index, &query]
+                       {
+                          Test::DoNotOptimize(index.Find(query.second));
+                       });
+      }
+   }
+}
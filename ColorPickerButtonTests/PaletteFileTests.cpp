@@ -0,0 +1,239 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "PaletteFile.hpp"
+#include "DisplayOrder.hpp"
+#include <cstring>                // for memcpy
+#include <random>
+
+
+namespace {
+
+using ColorTableOrder = ColorPickerButton::ColorTableOrder;
+
+// Offsets of fields in the header (see PaletteFile.cpp).
+constexpr size_t kVersionMajorOffset = 4;
+constexpr size_t kCbHeaderOffset     = 8;
+constexpr size_t kSortOrderOffset    = 32;
+constexpr size_t kcbHeader           = 120;
+
+PaletteFile::ColorTable MakeTable(size_t cColors, unsigned seed)
+{
+   std::mt19937            random(seed);
+   PaletteFile::ColorTable colorTable;
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      CString name;
+      if ((i % 7) != 3)  // (leaving some of the names empty)
+      {
+         name.Format(_T("Color %zu"), i);
+      }
+      colorTable.emplace_back(random() & 0x00FFFFFF, name);
+   }
+   if (cColors > 2)
+   {
+      colorTable[cColors - 1].first = colorTable[0].first;  // (and making a duplicate)
+   }
+   return colorTable;
+}
+
+PaletteFile::WriteOptions MakeOptions(bool includeSearchIndex, ColorTableOrder sortOrder)
+{
+   auto options               = PaletteFile::DefaultWriteOptions();
+   options.cColumns           = 12;
+   options.includeSearchIndex = includeSearchIndex;
+   options.sortOrder          = sortOrder;
+   return options;
+}
+
+void WriteUInt32(std::vector<BYTE>& data, size_t offset, UINT32 value)
+{
+   std::memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+void WriteUInt16(std::vector<BYTE>& data, size_t offset, UINT16 value)
+{
+   std::memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+PaletteFile::Status Validate(const std::vector<BYTE>& data, size_t cbData, bool verifyChecksum)
+{
+   return PaletteFile::Validate(data.data(), cbData, verifyChecksum);
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(PaletteFile, RoundTrips)
+{
+   const ColorTableOrder orders[] = { ColorTableOrder::TableOrder,
+                                      ColorTableOrder::HueBands,
+                                      ColorTableOrder::Hilbert,
+                                      ColorTableOrder::NearestNeighbor };
+   for (const size_t cColors : { size_t(0), size_t(1), size_t(48), size_t(1000) })
+   {
+      const auto colorTable = MakeTable(cColors, 1);
+      for (const auto includeSearchIndex : { false, true })
+      {
+         for (const auto sortOrder : orders)
+         {
+            const auto          data  = PaletteFile::Serialize(colorTable, MakeOptions(includeSearchIndex, sortOrder));
+            PaletteFile::Status status;
+            const auto          pFile = PaletteFile::FromMemory(data.data(), data.size(), true, &status);
+            REQUIRE(status == PaletteFile::Status::Ok);
+            REQUIRE(pFile);
+
+            CHECK(pFile->GetColorCount()  == cColors);
+            CHECK(pFile->GetColumnCount() == 12);
+            CHECK(pFile->HasSearchIndex() == includeSearchIndex);
+            CHECK(pFile->GetSortOrder()   == sortOrder);
+            CHECK(pFile->GetColorTable()  == colorTable);
+            for (size_t i = 0; i < cColors; ++i)
+            {
+               CHECK(pFile->GetColor(i)      == colorTable[i].first);
+               CHECK(colorTable[i].second    == pFile->GetName(i));
+               CHECK(pFile->GetNameLength(i) == static_cast<size_t>(colorTable[i].second.GetLength()));
+
+               const auto iFound = pFile->FindColor(colorTable[i].first);
+               CHECK(iFound <= i);
+               CHECK(colorTable[iFound].first == colorTable[i].first);
+            }
+            CHECK(pFile->FindColor(RGB(1, 2, 3)) == PaletteFile::kInvalidIndex);
+
+            if (sortOrder == ColorTableOrder::TableOrder)
+            {
+               CHECK(pFile->GetSortedIndices() == nullptr);
+            }
+            else
+            {
+               REQUIRE(pFile->GetSortedIndices() != nullptr);
+               std::vector<COLORREF> colors;
+               for (const auto& entry : colorTable)
+               {
+                  colors.push_back(entry.first);
+               }
+               const DisplayOrder displayOrder(colors, sortOrder, 0);
+               for (size_t position = 0; position < cColors; ++position)
+               {
+                  CHECK(pFile->GetSortedIndices()[position] == displayOrder.IndexFromPosition(position));
+               }
+            }
+         }
+      }
+   }
+}
+
+TEST_CASE(PaletteFile, ShortDataIsNotAPaletteFile)
+{
+   // Data too short to hold the magic number is not a palette file (rather than a truncated one),
+   // so that callers can fall back to parsing it as a text palette.
+   const auto data = PaletteFile::Serialize(MakeTable(10, 2), PaletteFile::DefaultWriteOptions());
+   for (size_t cb = 0; cb < sizeof(UINT32); ++cb)
+   {
+      CHECK(Validate(data, cb, true) == PaletteFile::Status::BadMagic);
+   }
+   CHECK(PaletteFile::Validate(nullptr, 0) == PaletteFile::Status::BadMagic);
+
+   const char szText[] = "GIMP Palette\n";
+   CHECK(PaletteFile::Validate(szText, sizeof(szText) - 1) == PaletteFile::Status::BadMagic);
+   CHECK(PaletteFile::Validate(szText, 2)                  == PaletteFile::Status::BadMagic);
+
+   // Data that has the magic number, but is cut off, is truncated.
+   for (const auto cb : { sizeof(UINT32), kcbHeader - 1, kcbHeader, data.size() - 1 })
+   {
+      CHECK(Validate(data, cb, true) == PaletteFile::Status::Truncated);
+   }
+}
+
+TEST_CASE(PaletteFile, RejectsInvalidHeaders)
+{
+   const auto original = PaletteFile::Serialize(MakeTable(10, 3), MakeOptions(true, ColorTableOrder::Hilbert));
+   REQUIRE(Validate(original, original.size(), true) == PaletteFile::Status::Ok);
+
+   auto data = original;
+   WriteUInt16(data, kVersionMajorOffset, PaletteFile::kVersionMajor + 1);
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::UnsupportedVersion);
+
+   data = original;
+   WriteUInt32(data, kCbHeaderOffset, kcbHeader - 8);
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+
+   // The sort order must be one of the sorted orders.
+   for (const auto sortOrder : { UINT32(ColorTableOrder::TableOrder), UINT32(ColorTableOrder::NearestNeighbor) + 1, UINT32(0xFFFFFFFF) })
+   {
+      data = original;
+      WriteUInt32(data, kSortOrderOffset, sortOrder);
+      CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+   }
+   data = original;
+   WriteUInt32(data, kSortOrderOffset, UINT32(ColorTableOrder::NearestNeighbor));
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Ok);
+   CHECK(Validate(data, data.size(), true)  == PaletteFile::Status::BadChecksum);
+
+   // Padding the file makes its size disagree with the header.
+   data = original;
+   data.resize(data.size() + 8);
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+}
+
+TEST_CASE(PaletteFile, DetectsEveryCorruptedByte)
+{
+   // With the checksum verified, changing any single byte must make the file invalid. Without it,
+   // validation itself must still stay within the file (as page heap or a sanitizer will check).
+   const auto original = PaletteFile::Serialize(MakeTable(12, 4), MakeOptions(true, ColorTableOrder::HueBands));
+   for (size_t i = 0; i < original.size(); ++i)
+   {
+      for (const BYTE mask : { BYTE(0x01), BYTE(0x80), BYTE(0xFF) })
+      {
+         auto data = original;
+         data[i] ^= mask;
+         CHECK(Validate(data, data.size(), true) != PaletteFile::Status::Ok);
+         Test::DoNotOptimize(Validate(data, data.size(), false));
+      }
+   }
+}
+
+TEST_CASE(PaletteFile, RejectsInvalidContents)
+{
+   // (These are checked without the checksum, which would otherwise catch them first.)
+   const auto original = PaletteFile::Serialize(MakeTable(5, 5), MakeOptions(true, ColorTableOrder::HueBands));
+   const auto pFile    = PaletteFile::FromMemory(original.data(), original.size());
+   REQUIRE(pFile);
+   const auto colorsOffset = reinterpret_cast<const BYTE*>(pFile->GetColors())        - original.data();
+   const auto sortedOffset = reinterpret_cast<const BYTE*>(pFile->GetSortedIndices()) - original.data();
+
+   auto data = original;
+   data[colorsOffset + 3] = 0x01;  // (the high byte of the first color)
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+
+   data = original;
+   WriteUInt16(data, sortedOffset, pFile->GetSortedIndices()[1]);  // (listing one entry twice)
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+
+   data = original;
+   WriteUInt16(data, sortedOffset, 5);  // (listing an entry that does not exist)
+   CHECK(Validate(data, data.size(), false) == PaletteFile::Status::Corrupt);
+}
+
+
+BENCHMARK(PaletteFile, Load)
+{
+   // Opening a file costs a validation pass (and a checksum, if verified); the color table is only
+   // copied when GetColorTable() is called, which the last case measures for comparison.
+   for (const size_t cColors : { size_t(48), size_t(4096), size_t(65535) })
+   {
+      const auto data = PaletteFile::Serialize(MakeTable(cColors, 6), MakeOptions(true, ColorTableOrder::HueBands));
+      benchmark.Run(benchmark.Case("colors=%zu/checksum=no", cColors), cColors, [&data]
+                    {
+                       Test::DoNotOptimize(PaletteFile::FromMemory(data.data(), data.size(), false));
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/checksum=yes", cColors), cColors, [&data]
+                    {
+                       Test::DoNotOptimize(PaletteFile::FromMemory(data.data(), data.size(), true));
+                    });
+      benchmark.Run(benchmark.Case("colors=%zu/checksum=yes/materialized", cColors), cColors, [&data]
+                    {
+                       const auto pFile = PaletteFile::FromMemory(data.data(), data.size(), true);
+                       Test::DoNotOptimize(pFile->GetColorTable());
+                    });
+   }
+}
@@ -0,0 +1,189 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "PaletteGenerator.hpp"
+#include <cstdlib>                // for abs
+#include <random>
+#include <set>
+
+
+namespace {
+
+RGBQUAD QuadFromColor(COLORREF clr)
+{
+   RGBQUAD quad;
+   quad.rgbRed      = GetRValue(clr);
+   quad.rgbGreen    = GetGValue(clr);
+   quad.rgbBlue     = GetBValue(clr);
+   quad.rgbReserved = 0;
+   return quad;
+}
+
+// Makes an image that consists of the specified colors, each covering the specified number of
+// pixels, with the pixels shuffled (so that sampling every nth pixel sees all of the colors).
+std::vector<RGBQUAD> MakeImage(const std::vector<std::pair<COLORREF, size_t>>& colors)
+{
+   std::vector<RGBQUAD> pixels;
+   for (const auto& color : colors)
+   {
+      pixels.insert(pixels.end(), color.second, QuadFromColor(color.first));
+   }
+   std::shuffle(pixels.begin(), pixels.end(), std::mt19937(1));
+   return pixels;
+}
+
+std::vector<RGBQUAD> MakeNoise(size_t cPixels)
+{
+   std::mt19937         random(2);
+   std::vector<RGBQUAD> pixels(cPixels);
+   for (auto& pixel : pixels)
+   {
+      pixel = QuadFromColor(random() & 0x00FFFFFF);
+   }
+   return pixels;
+}
+
+// Checks whether two colors are within the specified difference in every channel. (The histogram
+// that the generator bins the pixels into has 5 bits per channel, so it only finds colors to
+// within half of a bin, or 4 steps.)
+bool IsNear(COLORREF clr1, COLORREF clr2, int tolerance = 4)
+{
+   return (std::abs(GetRValue(clr1) - GetRValue(clr2)) <= tolerance) &&
+          (std::abs(GetGValue(clr1) - GetGValue(clr2)) <= tolerance) &&
+          (std::abs(GetBValue(clr1) - GetBValue(clr2)) <= tolerance);
+}
+
+PaletteGenerator::Options MakeOptions(size_t cColors, PaletteGenerator::Seeding seeding)
+{
+   auto options    = PaletteGenerator::DefaultOptions(cColors);
+   options.seeding = seeding;
+   return options;
+}
+
+const PaletteGenerator::Seeding kSeedings[] = { PaletteGenerator::Seeding::MedianCut,
+                                                PaletteGenerator::Seeding::KMeansPlusPlus };
+
+}  // anonymous namespace
+
+
+TEST_CASE(PaletteGenerator, EmptyImageGivesEmptyTable)
+{
+   for (const auto seeding : kSeedings)
+   {
+      CHECK(PaletteGenerator::FromPixels(nullptr, 0, MakeOptions(16, seeding)).empty());
+   }
+}
+
+TEST_CASE(PaletteGenerator, FindsDistinctColors)
+{
+   const std::vector<std::pair<COLORREF, size_t>> colors = { { RGB(200,  30,  30), 1000 },
+                                                             { RGB( 30, 180,  40), 1000 },
+                                                             { RGB( 20,  40, 200), 1000 },
+                                                             { RGB(240, 240, 240), 1000 } };
+   const auto pixels = MakeImage(colors);
+   for (const auto seeding : kSeedings)
+   {
+      const auto colorTable = PaletteGenerator::FromPixels(pixels.data(), pixels.size(), MakeOptions(colors.size(), seeding));
+      REQUIRE(colorTable.size() == colors.size());
+      for (const auto& color : colors)
+      {
+         CHECK(std::any_of(colorTable.begin(), colorTable.end(), [&color](const std::pair<COLORREF, CString>& entry)
+                           {
+                              return IsNear(entry.first, color.first);
+                           }));
+      }
+   }
+}
+
+TEST_CASE(PaletteGenerator, OrdersColorsByPopulation)
+{
+   const auto pixels = MakeImage({ { RGB( 20, 40, 200),  100 },
+                                   { RGB(200, 30,  30), 7000 },
+                                   { RGB( 30, 180, 40), 2000 } });
+   for (const auto seeding : kSeedings)
+   {
+      const auto colorTable = PaletteGenerator::FromPixels(pixels.data(), pixels.size(), MakeOptions(3, seeding));
+      REQUIRE(colorTable.size() == 3);
+      CHECK(IsNear(colorTable[0].first, RGB(200, 30,  30)));
+      CHECK(IsNear(colorTable[1].first, RGB( 30, 180, 40)));
+      CHECK(IsNear(colorTable[2].first, RGB( 20, 40, 200)));
+   }
+}
+
+TEST_CASE(PaletteGenerator, GeneratesNoMoreColorsThanAsked)
+{
+   const auto pixels = MakeNoise(64 * 1024);
+   for (const auto seeding : kSeedings)
+   {
+      for (const size_t cColors : { size_t(1), size_t(16), size_t(48), size_t(256) })
+      {
+         const auto colorTable = PaletteGenerator::FromPixels(pixels.data(), pixels.size(), MakeOptions(cColors, seeding));
+         CHECK(!colorTable.empty());
+         CHECK(colorTable.size() <= cColors);
+      }
+   }
+}
+
+TEST_CASE(PaletteGenerator, GeneratesUniqueColorsAndNames)
+{
+   const auto pixels = MakeNoise(64 * 1024);
+   for (const auto seeding : kSeedings)
+   {
+      const auto         colorTable = PaletteGenerator::FromPixels(pixels.data(), pixels.size(), MakeOptions(64, seeding));
+      std::set<COLORREF> colors;
+      std::set<CString>  names;
+      for (const auto& entry : colorTable)
+      {
+         CHECK(!entry.second.IsEmpty());
+         colors.insert(entry.first);
+         names.insert(entry.second);
+      }
+      CHECK(colors.size() == colorTable.size());
+      CHECK(names.size()  == colorTable.size());
+   }
+}
+
+TEST_CASE(PaletteGenerator, IsReproducible)
+{
+   const auto pixels = MakeNoise(64 * 1024);
+   for (const auto seeding : kSeedings)
+   {
+      const auto options = MakeOptions(32, seeding);
+      CHECK(PaletteGenerator::FromPixels(pixels.data(), pixels.size(), options) ==
+            PaletteGenerator::FromPixels(pixels.data(), pixels.size(), options));
+   }
+}
+
+TEST_CASE(PaletteGenerator, SamplesLargeImages)
+{
+   // Sampling only every nth pixel must still find colors that cover most of the image.
+   const auto pixels  = MakeImage({ { RGB(250, 200, 0), 300000 }, { RGB(0, 90, 160), 100000 } });
+   auto       options = PaletteGenerator::DefaultOptions(2);
+   options.cSamplesMax = 1000;
+   const auto colorTable = PaletteGenerator::FromPixels(pixels.data(), pixels.size(), options);
+   REQUIRE(colorTable.size() == 2);
+   CHECK(IsNear(colorTable[0].first, RGB(250, 200, 0)));
+   CHECK(IsNear(colorTable[1].first, RGB(0, 90, 160)));
+}
+
+
+BENCHMARK(PaletteGenerator, FromPixels)
+{
+   // Up to 50 megapixels, which is more than the default sampling limit, so the largest case
+   // measures how well the cost is bounded.
+   for (const size_t cMegapixels : { size_t(1), size_t(12), size_t(50) })
+   {
+      const auto pixels = MakeNoise(cMegapixels * 1024 * 1024);
+      for (const auto seeding : kSeedings)
+      {
+         const auto options = MakeOptions(PaletteGenerator::kcColorsDefault, seeding);
+         benchmark.Run(benchmark.Case("megapixels=%zu/seeding=%s",
+                                      cMegapixels,
+                                      (seeding == PaletteGenerator::Seeding::MedianCut) ? "median-cut" : "k-means++"),
+                       pixels.size(),
+                       [&pixels, &options]
+                       {
+                          Test::DoNotOptimize(PaletteGenerator::FromPixels(pixels.data(), pixels.size(), options));
+                       });
+      }
+   }
+}
@@ -0,0 +1,480 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "PaletteImporter.hpp"
+#include <array>
+#include <cstring>                // for memcpy, strlen
+#include <cwchar>                 // for wcslen
+#include <random>
+#include <string>
+
+
+namespace {
+
+using Format = PaletteImporter::Format;
+using Status = PaletteImporter::Status;
+
+//////////////////////////////////////////////////
+// Inputs
+//////////////////////////////////////////////////
+
+std::vector<BYTE> FromText(const char* psz)
+{
+   return std::vector<BYTE>(psz, psz + std::strlen(psz));
+}
+
+// Writes the big-endian values that both of the Adobe formats use.
+class BigEndianWriter
+{
+public:
+   void UInt16(UINT16 value)
+   {
+      m_data.push_back(static_cast<BYTE>(value >> 8));
+      m_data.push_back(static_cast<BYTE>(value));
+   }
+
+   void UInt32(UINT32 value)
+   {
+      this->UInt16(static_cast<UINT16>(value >> 16));
+      this->UInt16(static_cast<UINT16>(value));
+   }
+
+   void Float(float value)
+   {
+      UINT32 bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      this->UInt32(bits);
+   }
+
+   void Bytes(const char* pch, size_t cch)
+   {
+      m_data.insert(m_data.end(), pch, pch + cch);
+   }
+
+   // Writes a name as UTF-16, including the terminator.
+   void Name(const wchar_t* psz)
+   {
+      for (; *psz; ++psz)
+      {
+         this->UInt16(static_cast<UINT16>(*psz));
+      }
+      this->UInt16(0);
+   }
+
+   std::vector<BYTE> m_data;
+};
+
+// A record in an .aco file: the color space ID and the four components, and the name.
+using AcoRecord = std::pair<std::array<UINT16, 5>, const wchar_t*>;
+
+std::vector<BYTE> MakeAco(const std::vector<AcoRecord>& records, bool includeNames)
+{
+   BigEndianWriter writer;
+   for (UINT16 version = 1; version <= (includeNames ? 2 : 1); ++version)
+   {
+      writer.UInt16(version);
+      writer.UInt16(static_cast<UINT16>(records.size()));
+      for (const auto& record : records)
+      {
+         for (const auto value : record.first)
+         {
+            writer.UInt16(value);
+         }
+         if (version == 2)
+         {
+            writer.UInt32(static_cast<UINT32>(std::wcslen(record.second) + 1));
+            writer.Name(record.second);
+         }
+      }
+   }
+   return writer.m_data;
+}
+
+// Writes a color entry block to an .ase file.
+void WriteAseColor(BigEndianWriter& writer, const wchar_t* pszName, const char* pszModel, std::vector<float> components)
+{
+   writer.UInt16(0x0001);
+   writer.UInt32(static_cast<UINT32>(2 + ((std::wcslen(pszName) + 1) * 2) + 4 + (components.size() * 4) + 2));
+   writer.UInt16(static_cast<UINT16>(std::wcslen(pszName) + 1));
+   writer.Name(pszName);
+   writer.Bytes(pszModel, 4);
+   for (const auto component : components)
+   {
+      writer.Float(component);
+   }
+   writer.UInt16(2);  // (a normal color)
+}
+
+std::vector<BYTE> MakeAse()
+{
+   BigEndianWriter writer;
+   writer.Bytes("ASEF", 4);
+   writer.UInt16(1);
+   writer.UInt16(0);
+   writer.UInt32(7);
+   writer.UInt16(0xC001);        // group start, with a name
+   writer.UInt32(12);
+   writer.UInt16(5);
+   writer.Name(L"Warm");
+   WriteAseColor(writer, L"Red",    "RGB ", { 1.0f, 0.0f, 0.0f });
+   WriteAseColor(writer, L"Yellow", "CMYK", { 0.0f, 0.0f, 1.0f, 0.0f });
+   writer.UInt16(0xC002);        // group end
+   writer.UInt32(0);
+   WriteAseColor(writer, L"Gray",   "Gray", { 0.5f });
+   WriteAseColor(writer, L"White",  "LAB ", { 1.0f, 0.0f, 0.0f });
+   WriteAseColor(writer, L"",       "RGB ", { 0.0f, 0.0f, 2.0f });
+   return writer.m_data;
+}
+
+const char kGpl[] = "\xEF\xBB\xBFGIMP Palette\r\n"
+                    "Name: Test\r\n"
+                    "Columns: 4\r\n"
+                    "# a comment\r\n"
+                    "\r\n"
+                    "255   0   0\tRed\r\n"
+                    "  0 128   0  Dark  green  \r\n"
+                    "  0   0 255\r\n"
+                    " 10  20  30 Caf\xC3\xA9 \xF0\x9F\x8E\xA8 \xFF!\r\n";
+
+const char kJascPal[] = "JASC-PAL\n"
+                        "0100\n"
+                        "3\n"
+                        "255 0 0\n"
+                        "0 255 0 128\n"
+                        "0 0 255\n";
+
+std::vector<BYTE> MakeAcoSample()
+{
+   return MakeAco({ { { 0, 0xFFFF, 0x0000, 0x0000, 0 },      L"Red"   },
+                    { { 1, 0x0000, 0x0000, 0xFFFF, 0 },      L"White" },    // HSB
+                    { { 2, 0xFFFF, 0xFFFF, 0xFFFF, 0x0000 }, L"Black" },    // CMYK (0 is full ink)
+                    { { 8, 5000, 0, 0, 0 },                  L"Gray"  },
+                    { { 9, 0, 0, 0, 0 },                     L""      } },  // wide CMYK (no ink)
+                  true);
+}
+
+// The sample inputs, in every format, and some invalid ones, for the tests that check properties
+// that must hold for any input.
+std::vector<std::vector<BYTE>> GetSamples()
+{
+   return { FromText(kGpl),
+            FromText(kJascPal),
+            MakeAcoSample(),
+            MakeAco({ { { 0, 0x1234, 0x5678, 0x9ABC, 0 }, L"" } }, false),
+            MakeAse(),
+            FromText("GIMP Palette\n1 2 3 x\n4 5\n"),
+            FromText("JASC-PAL\n0100\n2\n1 2 3\n"),
+            FromText("Not a palette at all") };
+}
+
+
+//////////////////////////////////////////////////
+// Results
+//////////////////////////////////////////////////
+
+struct Result
+{
+   Status                      status;
+   UINT64                      ibError;
+   Format                      format;
+   size_t                      cColumns;
+   PaletteImporter::ColorTable colorTable;
+
+   bool operator==(const Result& other) const
+   {
+      return (status     == other.status)
+          && (ibError    == other.ibError)
+          && (format     == other.format)
+          && (cColumns   == other.cColumns)
+          && (colorTable == other.colorTable);
+   }
+};
+
+Result GetResult(const PaletteImporter& importer)
+{
+   return Result{ importer.GetStatus(),
+                  importer.GetErrorOffset(),
+                  importer.GetFormat(),
+                  importer.GetColumnCount(),
+                  importer.GetColorTable() };
+}
+
+Result Import(const std::vector<BYTE>& data)
+{
+   PaletteImporter importer;
+   importer.Import(data.data(), data.size());
+   return GetResult(importer);
+}
+
+// Imports the input in chunks, split at the specified offsets.
+Result ImportInChunks(const std::vector<BYTE>& data, std::vector<size_t> splits)
+{
+   std::sort(splits.begin(), splits.end());
+   PaletteImporter importer;
+   size_t          ib = 0;
+   for (const auto split : splits)
+   {
+      importer.Feed(data.data() + ib, split - ib);
+      ib = split;
+   }
+   importer.Feed(data.data() + ib, data.size() - ib);
+   importer.Finish();
+   return GetResult(importer);
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(PaletteImporter, DetectsFormats)
+{
+   CHECK(PaletteImporter::DetectFormat("GIMP Palette\n", 13)             == Format::Gpl);
+   CHECK(PaletteImporter::DetectFormat("\xEF\xBB\xBFGIMP Palette", 15)   == Format::Gpl);
+   CHECK(PaletteImporter::DetectFormat("JASC-PAL\r\n", 10)               == Format::JascPal);
+   CHECK(PaletteImporter::DetectFormat("ASEF\0\1\0\0", 8)                == Format::Ase);
+   CHECK(PaletteImporter::DetectFormat("\0\1\0\3", 4)                    == Format::Aco);
+   CHECK(PaletteImporter::DetectFormat("\0\2\0\3", 4)                    == Format::Aco);
+   CHECK(PaletteImporter::DetectFormat("\0\3\0\3", 4)                    == Format::Unknown);
+   CHECK(PaletteImporter::DetectFormat("GIMP", 4)                        == Format::Unknown);
+   CHECK(PaletteImporter::DetectFormat(nullptr, 0)                       == Format::Unknown);
+}
+
+TEST_CASE(PaletteImporter, ImportsGpl)
+{
+   const auto result = Import(FromText(kGpl));
+   REQUIRE(result.status == Status::Ok);
+   CHECK(result.format   == Format::Gpl);
+   CHECK(result.cColumns == 4);
+   REQUIRE(result.colorTable.size() == 4);
+   CHECK(result.colorTable[0] == std::make_pair(RGB(255,   0,   0), CString(L"Red")));
+   CHECK(result.colorTable[1] == std::make_pair(RGB(  0, 128,   0), CString(L"Dark  green")));
+   CHECK(result.colorTable[2] == std::make_pair(RGB(  0,   0, 255), CString()));
+   CHECK(result.colorTable[3] == std::make_pair(RGB( 10,  20,  30), CString(L"Caf\x00E9 \xD83C\xDFA8 \xFFFD!")));
+}
+
+TEST_CASE(PaletteImporter, ImportsJascPal)
+{
+   const auto result = Import(FromText(kJascPal));
+   REQUIRE(result.status == Status::Ok);
+   CHECK(result.format == Format::JascPal);
+   CHECK((result.colorTable == PaletteImporter::ColorTable{ { RGB(255, 0, 0), CString() },
+                                                            { RGB(0, 255, 0), CString() },
+                                                            { RGB(0, 0, 255), CString() } }));
+}
+
+TEST_CASE(PaletteImporter, ImportsAco)
+{
+   const auto result = Import(MakeAcoSample());
+   REQUIRE(result.status == Status::Ok);
+   CHECK(result.format == Format::Aco);
+   CHECK((result.colorTable == PaletteImporter::ColorTable{ { RGB(255,   0,   0), CString(L"Red")   },
+                                                            { RGB(255, 255, 255), CString(L"White") },
+                                                            { RGB(  0,   0,   0), CString(L"Black") },
+                                                            { RGB(128, 128, 128), CString(L"Gray")  },
+                                                            { RGB(255, 255, 255), CString()         } }));
+
+   // A file with only the version 1 section has colors, but no names.
+   const auto unnamed = Import(MakeAco({ { { 0, 0x0000, 0x8080, 0xFFFF, 0 }, L"Ignored" } }, false));
+   REQUIRE(unnamed.status == Status::Ok);
+   CHECK((unnamed.colorTable == PaletteImporter::ColorTable{ { RGB(0, 128, 255), CString() } }));
+
+   // Spot colors (from a color library) cannot be converted.
+   CHECK(Import(MakeAco({ { { 3, 1, 2, 3, 4 }, L"Spot" } }, true)).status == Status::UnsupportedColor);
+}
+
+TEST_CASE(PaletteImporter, ImportsAse)
+{
+   const auto result = Import(MakeAse());
+   REQUIRE(result.status == Status::Ok);
+   CHECK(result.format == Format::Ase);
+   CHECK((result.colorTable == PaletteImporter::ColorTable{ { RGB(255,   0,   0), CString(L"Red")    },
+                                                            { RGB(255, 255,   0), CString(L"Yellow") },
+                                                            { RGB(128, 128, 128), CString(L"Gray")   },
+                                                            { RGB(255, 255, 255), CString(L"White")  },
+                                                            { RGB(  0,   0, 255), CString()          } }));
+}
+
+TEST_CASE(PaletteImporter, ReportsErrorsWhereTheyOccur)
+{
+   struct Case
+   {
+      const char* pszInput;
+      Status      status;
+      UINT64      ibError;
+   };
+   const Case cases[] =
+   {
+      { "GIMP Palette\n1 2 3\n1 2 300\n",  Status::Malformed,          19 },
+      { "GIMP Palette\n1 2 3 Name\n4 5\n", Status::Malformed,          24 },
+      { "GIMP Palette\nColumns: x\n",      Status::Malformed,          13 },
+      { "JASC-PAL\n0200\n1\n1 2 3\n",      Status::UnsupportedVersion,  9 },
+      { "JASC-PAL\n0100\n2\n1 2 3\n",      Status::Truncated,          22 },
+      { "JASC-PAL\n0100\n1\n1 2 3\n4 5 6", Status::Malformed,          22 },
+      { "JASC-PAL\n0100\n70000\n",         Status::TooManyColors,      14 },
+      { "Hello, world",                    Status::UnknownFormat,       0 },
+      { "",                                Status::UnknownFormat,       0 },
+   };
+   for (const auto& c : cases)
+   {
+      const auto result = Import(FromText(c.pszInput));
+      CHECK(result.status  == c.status);
+      CHECK(result.ibError == c.ibError);
+   }
+
+   // Binary input that ends in the middle of a record is truncated.
+   auto aco = MakeAcoSample();
+   aco.resize(aco.size() - 3);
+   CHECK(Import(aco).status == Status::Truncated);
+   auto ase = MakeAse();
+   ase.resize(ase.size() - 1);
+   CHECK(Import(ase).status == Status::Truncated);
+}
+
+TEST_CASE(PaletteImporter, ChunkingDoesNotMatter)
+{
+   // Every sample must give the same result however it is split, whether one byte at a time,
+   // at every single point, or at random points.
+   std::mt19937 random(1);
+   for (const auto& data : GetSamples())
+   {
+      const auto expected = Import(data);
+
+      std::vector<size_t> everyByte;
+      for (size_t ib = 1; ib < data.size(); ++ib)
+      {
+         everyByte.push_back(ib);
+      }
+      CHECK(ImportInChunks(data, everyByte) == expected);
+
+      for (size_t split = 0; split <= data.size(); ++split)
+      {
+         CHECK(ImportInChunks(data, { split }) == expected);
+      }
+
+      for (int iTrial = 0; iTrial < 100; ++iTrial)
+      {
+         std::vector<size_t> splits(random() % 8);
+         for (auto& split : splits)
+         {
+            split = random() % (data.size() + 1);
+         }
+         CHECK(ImportInChunks(data, splits) == expected);
+      }
+   }
+}
+
+TEST_CASE(PaletteImporter, SurvivesMutatedInput)
+{
+   // Damaged input must never crash or read out of bounds (as page heap or a sanitizer will check),
+   // must not depend on how it is split, and must give a table with a name for every color.
+   std::mt19937 random(2);
+   const auto   cTrials = Test::IsExhaustive() ? 20000 : 1000;
+   for (const auto& original : GetSamples())
+   {
+      for (int iTrial = 0; iTrial < cTrials; ++iTrial)
+      {
+         auto       data        = original;
+         const auto cMutations  = 1 + (random() % 4);
+         for (UINT32 iMutation = 0; (iMutation < cMutations) && !data.empty(); ++iMutation)
+         {
+            const auto ib = random() % data.size();
+            switch (random() % 4)
+            {
+               case 0:  data[ib] ^= static_cast<BYTE>(1 << (random() % 8));                  break;
+               case 1:  data[ib]  = static_cast<BYTE>(random());                             break;
+               case 2:  data.erase(data.begin() + ib);                                       break;
+               default: data.insert(data.begin() + ib, static_cast<BYTE>(random()));         break;
+            }
+         }
+
+         PaletteImporter importer;
+         importer.Import(data.data(), data.size());
+         CHECK(importer.GetErrorOffset() <= data.size());
+         for (size_t i = 0; i < importer.GetColorCount(); ++i)
+         {
+            CHECK(importer.GetName(i)[importer.GetNameLength(i)] == L'\0');
+         }
+
+         const auto expected = GetResult(importer);
+         CHECK(ImportInChunks(data, { random() % (data.size() + 1), random() % (data.size() + 1) }) == expected);
+      }
+   }
+}
+
+TEST_CASE(PaletteImporter, CanBeReused)
+{
+   PaletteImporter importer;
+   const auto      gpl = FromText(kGpl);
+   const auto      ase = MakeAse();
+   REQUIRE(importer.Import(gpl.data(), gpl.size()) == Status::Ok);
+
+   importer.Reset();
+   CHECK(importer.GetColorCount()  == 0);
+   CHECK(importer.GetColumnCount() == 0);
+   CHECK(importer.GetFormat()      == Format::Unknown);
+   REQUIRE(importer.Import(ase.data(), ase.size()) == Status::Ok);
+   CHECK(GetResult(importer) == Import(ase));
+
+   // An importer that is told the format does not detect it (or accept any other).
+   importer.Reset(Format::JascPal);
+   CHECK(importer.Import(gpl.data(), gpl.size()) == Status::Malformed);
+}
+
+
+BENCHMARK(PaletteImporter, Import)
+{
+   // Large palettes in each format, parsed from memory all at once, and in the 64 KB chunks
+   // that ImportFile() reads. The items are bytes, so the rate is the throughput.
+   std::mt19937 random(3);
+   std::string  gpl  = "GIMP Palette\nName: Benchmark\nColumns: 16\n";
+   std::string  jasc = "JASC-PAL\n0100\n65535\n";
+   for (int i = 0; i < 65535; ++i)
+   {
+      const auto r = random() % 256;
+      const auto g = random() % 256;
+      const auto b = random() % 256;
+      gpl  += std::to_string(r) + " " + std::to_string(g) + " " + std::to_string(b) + "\tColor " + std::to_string(i) + "\n";
+      jasc += std::to_string(r) + " " + std::to_string(g) + " " + std::to_string(b) + "\n";
+   }
+
+   BigEndianWriter aseWriter;
+   aseWriter.Bytes("ASEF", 4);
+   aseWriter.UInt16(1);
+   aseWriter.UInt16(0);
+   aseWriter.UInt32(65535);
+   std::vector<AcoRecord> acoRecords;
+   for (int i = 0; i < 65535; ++i)
+   {
+      const auto r = static_cast<UINT16>(random());
+      const auto g = static_cast<UINT16>(random());
+      const auto b = static_cast<UINT16>(random());
+      WriteAseColor(aseWriter, L"Swatch", "RGB ", { r / 65535.0f, g / 65535.0f, b / 65535.0f });
+      acoRecords.push_back({ { 0, r, g, b, 0 }, L"Swatch" });
+   }
+
+   const std::pair<const char*, std::vector<BYTE>> inputs[] =
+   {
+      { "gpl",  std::vector<BYTE>(gpl.begin(),  gpl.end())  },
+      { "jasc", std::vector<BYTE>(jasc.begin(), jasc.end()) },
+      { "aco",  MakeAco(acoRecords, true)                   },
+      { "ase",  aseWriter.m_data                            },
+   };
+   PaletteImporter importer;
+   for (const auto& input : inputs)
+   {
+      const auto& data = input.second;
+      benchmark.Run(benchmark.Case("format=%s/chunk=all", input.first), data.size(), [&importer, &data]
+                    {
+                       importer.Reset();
+                       Test::DoNotOptimize(importer.Import(data.data(), data.size()));
+                    });
+      benchmark.Run(benchmark.Case("format=%s/chunk=64k", input.first), data.size(), [&importer, &data]
+                    {
+                       constexpr size_t kcbChunk = 64 * 1024;
+                       importer.Reset();
+                       for (size_t ib = 0; ib < data.size(); ib += kcbChunk)
+                       {
+                          importer.Feed(data.data() + ib, std::min(kcbChunk, data.size() - ib));
+                       }
+                       Test::DoNotOptimize(importer.Finish());
+                    });
+   }
+}
@@ -0,0 +1,225 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "SharedPaletteStore.hpp"
+#include <atomic>
+#include <thread>
+
+
+namespace {
+
+// The layout of a store's header (see SharedPaletteStore.cpp), for making broken ones.
+struct RawHeader
+{
+   UINT32        magic;
+   UINT32        version;
+   volatile LONG sequence;
+   UINT32        cbHeader;
+   UINT64        generation;
+   UINT64        cbSection;
+};
+
+constexpr UINT32 kMagic   = 0x53505043;
+constexpr UINT32 kVersion = 2;
+
+// Makes a name that no other test (or test run) is using.
+CString MakeStoreName(LPCTSTR pszTest)
+{
+   static LONG s_cNames = 0;
+   CString     strName;
+   strName.Format(_T("Local\\ColorPickerButtonTests.%s.%lu.%ld"), pszTest, ::GetCurrentProcessId(), ::InterlockedIncrement(&s_cNames));
+   return strName;
+}
+
+// Makes a table whose every entry is the same color, which is derived from the generation that it
+// is published as, so that a reader can tell whether what it sees is consistent.
+SharedPaletteStore::ColorTable MakeTable(UINT64 generation)
+{
+   const auto clr = static_cast<COLORREF>(generation & 0x00FFFFFF);
+   return SharedPaletteStore::ColorTable(16 + static_cast<size_t>(generation % 48), std::make_pair(clr, CString()));
+}
+
+// A named mapping, made by hand, that pretends to be a store.
+class RawMapping
+{
+public:
+   RawMapping(const CString& strName, DWORD cbMapping)
+      : m_hMapping(::CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, cbMapping, strName))
+      , m_pHeader (m_hMapping ? static_cast<RawHeader*>(::MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, 0)) : nullptr)
+   { }
+
+   ~RawMapping()
+   {
+      if (m_pHeader)
+      {
+         VERIFY(::UnmapViewOfFile(m_pHeader));
+      }
+      if (m_hMapping)
+      {
+         VERIFY(::CloseHandle(m_hMapping));
+      }
+   }
+
+   RawHeader* GetHeader() const { return m_pHeader; }
+
+private:
+   HANDLE     m_hMapping;
+   RawHeader* m_pHeader;
+};
+
+}  // anonymous namespace
+
+
+TEST_CASE(SharedPaletteStore, PublishesToReaders)
+{
+   const auto strName = MakeStoreName(_T("Publishes"));
+   auto       status  = SharedPaletteStore::Status::Ok;
+   CHECK(!SharedPaletteStore::Open(strName, &status));
+   CHECK(status == SharedPaletteStore::Status::NotFound);
+
+   const auto pWriter = SharedPaletteStore::Create(strName, &status);
+   REQUIRE(pWriter);
+   const auto pReader = SharedPaletteStore::Open(strName, &status);
+   REQUIRE(pReader);
+   CHECK(status == SharedPaletteStore::Status::Ok);
+   CHECK(pReader->GetGeneration()  == 0);
+   CHECK(pReader->GetPaletteFile() == nullptr);
+
+   for (UINT64 generation = 1; generation <= 5; ++generation)
+   {
+      REQUIRE(pWriter->Publish(MakeTable(generation)) == SharedPaletteStore::Status::Ok);
+      UINT64     generationSeen = 0;
+      const auto pPaletteFile   = pReader->GetPaletteFile(&generationSeen);
+      REQUIRE(pPaletteFile);
+      CHECK(generationSeen                == generation);
+      CHECK(pReader->GetGeneration()      == generation);
+      CHECK(pPaletteFile->GetColorTable() == MakeTable(generation));
+
+      // The same generation is only mapped once.
+      CHECK(pReader->GetPaletteFile() == pPaletteFile);
+   }
+}
+
+TEST_CASE(SharedPaletteStore, RejectsOtherMappings)
+{
+   // A mapping that is smaller than a header still has a whole page in its view, so the size that
+   // the header records is what tells it apart from a store.
+   const auto strSmall = MakeStoreName(_T("Small"));
+   RawMapping small(strSmall, 16);
+   REQUIRE(small.GetHeader());
+   small.GetHeader()->magic   = kMagic;
+   small.GetHeader()->version = kVersion;
+   auto status = SharedPaletteStore::Status::Ok;
+   CHECK(!SharedPaletteStore::Open(strSmall, &status));
+   CHECK(status == SharedPaletteStore::Status::NotStore);
+
+   const auto strOther = MakeStoreName(_T("Other"));
+   RawMapping other(strOther, sizeof(RawHeader));
+   REQUIRE(other.GetHeader());
+   other.GetHeader()->magic    = kMagic;
+   other.GetHeader()->version  = kVersion + 1;
+   other.GetHeader()->cbHeader = sizeof(RawHeader);
+   CHECK(!SharedPaletteStore::Open(strOther, &status));
+   CHECK(status == SharedPaletteStore::Status::NotStore);
+   CHECK(!SharedPaletteStore::Create(strOther, &status));
+   CHECK(status == SharedPaletteStore::Status::NotStore);
+}
+
+TEST_CASE(SharedPaletteStore, ReadersDoNotWaitForAnAbandonedUpdate)
+{
+   // A writer that exits in the middle of an update leaves the sequence number odd. Readers must
+   // give up on the header and keep the table that they have, rather than spin forever.
+   const auto strName = MakeStoreName(_T("Abandoned"));
+   const auto pWriter = SharedPaletteStore::Create(strName);
+   REQUIRE(pWriter);
+   REQUIRE(pWriter->Publish(MakeTable(1)) == SharedPaletteStore::Status::Ok);
+   const auto pReader = SharedPaletteStore::Open(strName);
+   REQUIRE(pReader);
+   const auto pPaletteFile = pReader->GetPaletteFile();
+   REQUIRE(pPaletteFile);
+
+   RawMapping header(strName, sizeof(RawHeader));
+   REQUIRE(header.GetHeader());
+   ::InterlockedIncrement(&header.GetHeader()->sequence);
+   header.GetHeader()->generation = 2;
+
+   UINT64 generation = 0;
+   CHECK(pReader->GetPaletteFile(&generation) == pPaletteFile);
+   CHECK(generation                           == 1);
+   CHECK(pReader->GetGeneration()             == 1);
+
+   // A new writer that takes over the store completes the update, and readers move on.
+   const auto pNewWriter = SharedPaletteStore::Create(strName);
+   REQUIRE(pNewWriter);
+   REQUIRE(pNewWriter->Publish(MakeTable(3)) == SharedPaletteStore::Status::Ok);
+   const auto pNewPaletteFile = pReader->GetPaletteFile(&generation);
+   REQUIRE(pNewPaletteFile);
+   CHECK(generation == 3);
+   CHECK(pNewPaletteFile->GetColorTable() == MakeTable(3));
+}
+
+TEST_CASE(SharedPaletteStore, ReadersSeeConsistentTablesWhileTheWriterPublishes)
+{
+   const auto strName = MakeStoreName(_T("Concurrent"));
+   const auto pWriter = SharedPaletteStore::Create(strName);
+   REQUIRE(pWriter);
+
+   const UINT64             cPublishes = Test::IsExhaustive() ? 5000 : 500;
+   std::atomic<bool>        isDone(false);
+   std::atomic<unsigned>    cFailures(0);
+   std::vector<std::thread> readers;
+   for (int iReader = 0; iReader < 4; ++iReader)
+   {
+      readers.emplace_back([&]
+      {
+         const auto pReader = SharedPaletteStore::Open(strName);
+         if (!pReader)
+         {
+            ++cFailures;
+            return;
+         }
+         UINT64 generationLast = 0;
+         while (!isDone.load())
+         {
+            UINT64     generation   = 0;
+            const auto pPaletteFile = pReader->GetPaletteFile(&generation);
+            if (!pPaletteFile)
+            {
+               continue;
+            }
+            if ((generation < generationLast) || (pPaletteFile->GetColorTable() != MakeTable(generation)))
+            {
+               ++cFailures;
+            }
+            generationLast = generation;
+         }
+      });
+   }
+
+   for (UINT64 generation = 1; generation <= cPublishes; ++generation)
+   {
+      if (pWriter->Publish(MakeTable(generation)) != SharedPaletteStore::Status::Ok)
+      {
+         ++cFailures;
+      }
+   }
+   isDone.store(true);
+   for (auto& reader : readers)
+   {
+      reader.join();
+   }
+   CHECK(cFailures.load() == 0);
+}
+
+
+BENCHMARK(SharedPaletteStore, GetGeneration)
+{
+   // Buttons poll the generation when they paint, so this must stay cheap.
+   const auto strName = MakeStoreName(_T("Bench"));
+   const auto pWriter = SharedPaletteStore::Create(strName);
+   const auto pReader = SharedPaletteStore::Open(strName);
+   pWriter->Publish(MakeTable(1));
+   benchmark.Run("poll", 1, [&pReader]
+                 {
+                    Test::DoNotOptimize(pReader->GetGeneration());
+                 });
+}
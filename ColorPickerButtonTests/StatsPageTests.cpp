@@ -0,0 +1,220 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "StatsPage.hpp"
+#include <atomic>
+#include <thread>
+
+
+namespace {
+
+// The layout of a page (see StatsPage.cpp), for making broken ones.
+struct RawLayout
+{
+   UINT32           magic;
+   UINT32           version;
+   volatile LONG    sequence;
+   UINT32           reserved;
+   StatsPage::Stats stats;
+};
+
+constexpr UINT32 kMagic   = 0x53545043;
+constexpr UINT32 kVersion = 1;
+
+// Makes a name that no other test (or test run) is using.
+CString MakePageName(LPCTSTR pszTest)
+{
+   static LONG s_cNames = 0;
+   CString     strName;
+   strName.Format(_T("Local\\ColorPickerButtonTests.Stats.%s.%lu.%ld"), pszTest, ::GetCurrentProcessId(), ::InterlockedIncrement(&s_cNames));
+   return strName;
+}
+
+// A named mapping, made by hand, that pretends to be a page.
+class RawMapping
+{
+public:
+   explicit RawMapping(const CString& strName)
+      : m_hMapping(::CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(RawLayout), strName))
+      , m_pLayout (m_hMapping ? static_cast<RawLayout*>(::MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, 0)) : nullptr)
+   { }
+
+   ~RawMapping()
+   {
+      if (m_pLayout)
+      {
+         VERIFY(::UnmapViewOfFile(m_pLayout));
+      }
+      if (m_hMapping)
+      {
+         VERIFY(::CloseHandle(m_hMapping));
+      }
+   }
+
+   RawLayout* GetLayout() const { return m_pLayout; }
+
+private:
+   HANDLE     m_hMapping;
+   RawLayout* m_pLayout;
+};
+
+}  // anonymous namespace
+
+
+TEST_CASE(StatsPage, RecordsForReaders)
+{
+   const auto strName = MakePageName(_T("Records"));
+   auto       status  = StatsPage::Status::Ok;
+   CHECK(!StatsPage::Open(strName, &status));
+   CHECK(status == StatsPage::Status::NotFound);
+
+   const auto pWriter = StatsPage::Create(strName, &status);
+   REQUIRE(pWriter);
+   const auto pReader = StatsPage::Open(strName, &status);
+   REQUIRE(pReader);
+   CHECK(status             == StatsPage::Status::Ok);
+   CHECK(pReader->GetName() == strName);
+
+   pWriter->RecordOpen(100);
+   pWriter->RecordOpen(300);
+   for (int i = 0; i < 5; ++i)
+   {
+      pWriter->RecordHoverEvent();
+   }
+   pWriter->RecordKeyEvent();
+   pWriter->RecordNotification();
+   pWriter->RecordNotification();
+   pWriter->RecordCacheLookup(true);
+   pWriter->RecordCacheLookup(true);
+   pWriter->RecordCacheLookup(false);
+   pWriter->SetGdiObjectsHeld(42);
+
+   auto stats = pReader->Read();
+   CHECK(stats.cOpens          == 2);
+   CHECK(stats.openTimeTotal   == 400);
+   CHECK(stats.openTimeMax     == 300);
+   CHECK(stats.cHoverEvents    == 5);
+   CHECK(stats.cKeyEvents      == 1);
+   CHECK(stats.cNotifications  == 2);
+   CHECK(stats.cCacheHits      == 2);
+   CHECK(stats.cCacheMisses    == 1);
+   CHECK(stats.cGdiObjectsHeld == 42);
+
+   pWriter->Reset();
+   stats = pReader->Read();
+   CHECK(stats.cOpens          == 0);
+   CHECK(stats.openTimeMax     == 0);
+   CHECK(stats.cHoverEvents    == 0);
+   CHECK(stats.cCacheHits      == 0);
+   CHECK(stats.cGdiObjectsHeld == 0);
+}
+
+TEST_CASE(StatsPage, TakesOverAnExistingPage)
+{
+   // A writer that is restarted while a tool still has the page open carries on counting.
+   const auto strName = MakePageName(_T("TakesOver"));
+   const auto pReader = [&strName]
+   {
+      const auto pWriter = StatsPage::Create(strName);
+      REQUIRE(pWriter);
+      pWriter->RecordHoverEvent();
+      return StatsPage::Open(strName);
+   }();
+   REQUIRE(pReader);
+
+   const auto pWriter = StatsPage::Create(strName);
+   REQUIRE(pWriter);
+   pWriter->RecordHoverEvent();
+   CHECK(pReader->Read().cHoverEvents == 2);
+
+   // A writer that exited in the middle of an update left the sequence number odd; the next one
+   // must make it even again, or no reader could ever read the page.
+   {
+      RawMapping page(strName);
+      REQUIRE(page.GetLayout());
+      ::InterlockedIncrement(&page.GetLayout()->sequence);
+   }
+   const auto pNewWriter = StatsPage::Create(strName);
+   REQUIRE(pNewWriter);
+   pNewWriter->RecordHoverEvent();
+   CHECK(pReader->Read().cHoverEvents == 3);
+}
+
+TEST_CASE(StatsPage, RejectsOtherMappings)
+{
+   const auto strName = MakePageName(_T("Other"));
+   RawMapping other(strName);
+   REQUIRE(other.GetLayout());
+   other.GetLayout()->magic   = kMagic;
+   other.GetLayout()->version = kVersion + 1;
+
+   auto status = StatsPage::Status::Ok;
+   CHECK(!StatsPage::Open(strName, &status));
+   CHECK(status == StatsPage::Status::NotStatsPage);
+   CHECK(!StatsPage::Create(strName, &status));
+   CHECK(status == StatsPage::Status::NotStatsPage);
+}
+
+TEST_CASE(StatsPage, ReadersSeeConsistentStatsWhileTheWriterRecords)
+{
+   // Every open is recorded as taking the same time, so the total time must always be that
+   // time's multiple of the number of opens that it was read with.
+   const auto strName = MakePageName(_T("Concurrent"));
+   const auto pWriter = StatsPage::Create(strName);
+   REQUIRE(pWriter);
+
+   const UINT64             kOpenTime = 7;
+   const auto               cRecords  = Test::IsExhaustive() ? 1000000 : 100000;
+   std::atomic<bool>        isDone(false);
+   std::atomic<unsigned>    cFailures(0);
+   std::vector<std::thread> readers;
+   for (int iReader = 0; iReader < 4; ++iReader)
+   {
+      readers.emplace_back([&]
+      {
+         const auto pReader = StatsPage::Open(strName);
+         if (!pReader)
+         {
+            ++cFailures;
+            return;
+         }
+         UINT64 cOpensLast = 0;
+         while (!isDone.load())
+         {
+            const auto stats = pReader->Read();
+            if ((stats.openTimeTotal != (stats.cOpens * kOpenTime)) || (stats.cOpens < cOpensLast))
+            {
+               ++cFailures;
+            }
+            cOpensLast = stats.cOpens;
+         }
+      });
+   }
+
+   for (int i = 0; i < cRecords; ++i)
+   {
+      pWriter->RecordOpen(kOpenTime);
+   }
+   isDone.store(true);
+   for (auto& reader : readers)
+   {
+      reader.join();
+   }
+   CHECK(cFailures.load() == 0);
+}
+
+
+BENCHMARK(StatsPage, Record)
+{
+   // The pop-up window records each input that it handles, on the UI thread.
+   const auto strName = MakePageName(_T("Bench"));
+   const auto pWriter = StatsPage::Create(strName);
+   const auto pReader = StatsPage::Open(strName);
+   benchmark.Run("record", 1, [&pWriter]
+                 {
+                    pWriter->RecordHoverEvent();
+                 });
+   benchmark.Run("read", 1, [&pReader]
+                 {
+                    Test::DoNotOptimize(pReader->Read());
+                 });
+}
@@ -0,0 +1,251 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "StructuredLookup.hpp"
+#include <climits>                // for CHAR_BIT
+#include <numeric>                // for iota
+#include <random>
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Tables
+//////////////////////////////////////////////////
+
+// Makes a table of every combination of the specified levels of red, green, and blue,
+// in the order in which the loops visit them, or shuffled.
+std::vector<COLORREF> MakeLattice(const std::vector<BYTE>& reds,
+                                  const std::vector<BYTE>& greens,
+                                  const std::vector<BYTE>& blues,
+                                  bool                     shuffle = false)
+{
+   std::vector<COLORREF> colors;
+   for (const auto r : reds)
+   {
+      for (const auto g : greens)
+      {
+         for (const auto b : blues)
+         {
+            colors.push_back(RGB(r, g, b));
+         }
+      }
+   }
+   if (shuffle)
+   {
+      std::shuffle(colors.begin(), colors.end(), std::mt19937(3));
+   }
+   return colors;
+}
+
+std::vector<BYTE> EvenLevels(size_t cLevels)
+{
+   std::vector<BYTE> levels;
+   for (size_t i = 0; i < cLevels; ++i)
+   {
+      levels.push_back(static_cast<BYTE>((i * 255) / (cLevels - 1)));
+   }
+   return levels;
+}
+
+std::vector<COLORREF> MakeGrayRamp(const std::vector<BYTE>& values, bool shuffle = false)
+{
+   std::vector<COLORREF> colors;
+   for (const auto value : values)
+   {
+      colors.push_back(RGB(value, value, value));
+   }
+   if (shuffle)
+   {
+      std::shuffle(colors.begin(), colors.end(), std::mt19937(4));
+   }
+   return colors;
+}
+
+
+//////////////////////////////////////////////////
+// Brute Force
+//////////////////////////////////////////////////
+
+size_t FindExactByBruteForce(const std::vector<COLORREF>& colors, COLORREF clr)
+{
+   const auto it = std::find(colors.begin(), colors.end(), clr);
+   return (it != colors.end()) ? static_cast<size_t>(it - colors.begin()) : StructuredLookup::kInvalidIndex;
+}
+
+// Finds the entry nearest to the color by Euclidean distance in RGB, preferring the lower index on a tie.
+size_t FindNearestByBruteForce(const std::vector<COLORREF>& colors, COLORREF clr)
+{
+   auto best          = StructuredLookup::kInvalidIndex;
+   auto bestDistance  = INT_MAX;
+   for (size_t i = 0; i < colors.size(); ++i)
+   {
+      const auto dr       = GetRValue(colors[i]) - GetRValue(clr);
+      const auto dg       = GetGValue(colors[i]) - GetGValue(clr);
+      const auto db       = GetBValue(colors[i]) - GetBValue(clr);
+      const auto distance = (dr * dr) + (dg * dg) + (db * db);
+      if (distance < bestDistance)
+      {
+         best         = i;
+         bestDistance = distance;
+      }
+   }
+   return best;
+}
+
+// Checks that the lookup agrees with a brute-force search for every color (if the exhaustive tests
+// were asked for), or else for every color whose channels are all multiples of 3 (a sample of
+// about 636,000 colors, which includes the halfway points between many of the tables' levels).
+void CheckAgreesWithBruteForce(const std::vector<COLORREF>& colors)
+{
+   const StructuredLookup lookup(colors);
+   REQUIRE(lookup.GetKind() != StructuredLookup::Kind::Irregular);
+
+   const auto step        = Test::IsExhaustive() ? 1 : 3;
+   size_t     cMismatches = 0;
+   for (int r = 0; r < 256; r += step)
+   {
+      for (int g = 0; g < 256; g += step)
+      {
+         for (int b = 0; b < 256; b += step)
+         {
+            const auto clr = RGB(r, g, b);
+            if ((lookup.FindNearest(clr) != FindNearestByBruteForce(colors, clr)) ||
+                (lookup.FindExact  (clr) != FindExactByBruteForce  (colors, clr)))
+            {
+               ++cMismatches;
+            }
+         }
+      }
+   }
+   CHECK(cMismatches == 0);
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(StructuredLookup, DetectsLattices)
+{
+   const StructuredLookup webSafe(MakeLattice(EvenLevels(6), EvenLevels(6), EvenLevels(6)));
+   CHECK(webSafe.GetKind() == StructuredLookup::Kind::Lattice);
+   CHECK((webSafe.GetLevelCounts() == std::array<size_t, 3>{ 6, 6, 6 }));
+
+   const StructuredLookup rgb332(MakeLattice(EvenLevels(8), EvenLevels(8), EvenLevels(4), true));
+   CHECK(rgb332.GetKind() == StructuredLookup::Kind::Lattice);
+   CHECK((rgb332.GetLevelCounts() == std::array<size_t, 3>{ 8, 8, 4 }));
+
+   const StructuredLookup uneven(MakeLattice({ 0, 10, 200 }, { 7, 255 }, { 0, 1, 2, 128, 254 }, true));
+   CHECK(uneven.GetKind() == StructuredLookup::Kind::Lattice);
+   CHECK((uneven.GetLevelCounts() == std::array<size_t, 3>{ 3, 2, 5 }));
+}
+
+TEST_CASE(StructuredLookup, DetectsGrayRamps)
+{
+   std::vector<BYTE> allGrays(256);
+   std::iota(allGrays.begin(), allGrays.end(), BYTE(0));
+   const StructuredLookup full(MakeGrayRamp(allGrays, true));
+   CHECK(full.GetKind() == StructuredLookup::Kind::GrayRamp);
+   CHECK((full.GetLevelCounts() == std::array<size_t, 3>{ 256, 256, 256 }));
+
+   const StructuredLookup sparse(MakeGrayRamp({ 255, 0, 17, 128, 129, 200 }));
+   CHECK(sparse.GetKind() == StructuredLookup::Kind::GrayRamp);
+   CHECK((sparse.GetLevelCounts() == std::array<size_t, 3>{ 6, 6, 6 }));
+}
+
+TEST_CASE(StructuredLookup, RejectsIrregularTables)
+{
+   // A lattice with one entry missing, with one entry duplicated, and with one entry moved off of
+   // its levels (so that it has the right number of levels and entries, but two share a cell).
+   auto missing = MakeLattice(EvenLevels(6), EvenLevels(6), EvenLevels(6));
+   missing.pop_back();
+   auto duplicated = MakeLattice(EvenLevels(4), EvenLevels(4), EvenLevels(4));
+   duplicated.back() = duplicated.front();
+   auto moved = MakeLattice({ 0, 255 }, { 0, 255 }, { 0, 255 });
+   moved[0] = RGB(0, 0, 255);
+   moved[1] = RGB(0, 0, 255);
+
+   for (const auto& colors : { missing, duplicated, moved, MakeGrayRamp({ 0, 128, 128, 255 }) })
+   {
+      const StructuredLookup lookup(colors);
+      CHECK(lookup.GetKind() == StructuredLookup::Kind::Irregular);
+      CHECK((lookup.GetLevelCounts() == std::array<size_t, 3>{ 0, 0, 0 }));
+      CHECK(lookup.GetExternalByteSize() == 0);
+   }
+}
+
+TEST_CASE(StructuredLookup, GrayRampKeepsNoLatticeLevels)
+{
+   // A gray ramp is first examined as a lattice (which it is not, having n entries, but n^3
+   // combinations of levels), so the levels found for green and blue must be discarded.
+   std::vector<BYTE> allGrays(256);
+   std::iota(allGrays.begin(), allGrays.end(), BYTE(0));
+   const StructuredLookup lookup(MakeGrayRamp(allGrays));
+   REQUIRE(lookup.GetKind() == StructuredLookup::Kind::GrayRamp);
+
+   // The ramp's own tables: the nearest level (and whether it is tied) for each sum of the
+   // channels, and the levels and table index of each gray, allowing half again for growth.
+   constexpr size_t kcSums       = (255 * 3) + 1;
+   constexpr size_t kcbSums      = (kcSums * sizeof(UINT16)) + ((kcSums + CHAR_BIT - 1) / CHAR_BIT);
+   constexpr size_t kcbPerLevels = 256 * (sizeof(BYTE) + sizeof(UINT16));
+   CHECK(lookup.GetExternalByteSize() <= (kcbSums + sizeof(UINT64) + ((kcbPerLevels * 3) / 2)));
+}
+
+TEST_CASE(StructuredLookup, LatticesAgreeWithBruteForce)
+{
+   CheckAgreesWithBruteForce(MakeLattice(EvenLevels(6), EvenLevels(6), EvenLevels(6)));
+   CheckAgreesWithBruteForce(MakeLattice(EvenLevels(8), EvenLevels(8), EvenLevels(4), true));
+   CheckAgreesWithBruteForce(MakeLattice({ 0, 64, 128, 192 }, { 0, 64, 128, 192 }, { 0, 64, 128, 192 }, true));
+   CheckAgreesWithBruteForce(MakeLattice({ 0, 10, 200 }, { 7, 255 }, { 0, 1, 2, 128, 254 }, true));
+}
+
+TEST_CASE(StructuredLookup, GrayRampsAgreeWithBruteForce)
+{
+   std::vector<BYTE> allGrays(256);
+   std::iota(allGrays.begin(), allGrays.end(), BYTE(0));
+   CheckAgreesWithBruteForce(MakeGrayRamp(allGrays));
+   CheckAgreesWithBruteForce(MakeGrayRamp(allGrays, true));
+   CheckAgreesWithBruteForce(MakeGrayRamp({ 255, 0, 17, 128, 129, 200, 3 }));
+}
+
+
+BENCHMARK(StructuredLookup, FindNearest)
+{
+   std::vector<BYTE> allGrays(256);
+   std::iota(allGrays.begin(), allGrays.end(), BYTE(0));
+   const std::pair<const char*, std::vector<COLORREF>> tables[] =
+   {
+      { "web-safe",  MakeLattice(EvenLevels(6), EvenLevels(6), EvenLevels(6))       },
+      { "rgb-3-3-2", MakeLattice(EvenLevels(8), EvenLevels(8), EvenLevels(4), true) },
+      { "gray-ramp", MakeGrayRamp(allGrays, true)                                   },
+   };
+
+   constexpr size_t kcQueries = 4096;
+   std::mt19937          random(5);
+   std::vector<COLORREF> queries(kcQueries);
+   for (auto& clr : queries)
+   {
+      clr = random() & 0x00FFFFFF;
+   }
+
+   for (const auto& table : tables)
+   {
+      const StructuredLookup lookup(table.second);
+      benchmark.Run(benchmark.Case("table=%s/method=closed-form", table.first), kcQueries, [&lookup, &queries]
+                    {
+                       size_t sum = 0;
+                       for (const auto clr : queries)
+                       {
+                          sum += lookup.FindNearest(clr);
+                       }
+                       Test::DoNotOptimize(sum);
+                    });
+      benchmark.Run(benchmark.Case("table=%s/method=brute-force", table.first), kcQueries, [&table, &queries]
+                    {
+                       size_t sum = 0;
+                       for (const auto clr : queries)
+                       {
+                          sum += FindNearestByBruteForce(table.second, clr);
+                       }
+                       Test::DoNotOptimize(sum);
+                    });
+   }
+}
@@ -0,0 +1,281 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include <atomic>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+namespace {
+
+//////////////////////////////////////////////////
+// Registry
+//////////////////////////////////////////////////
+
+struct Entry
+{
+   const char*             pszSuite;
+   const char*             pszName;
+   Test::TestFunction      pfnTest;       // \ one or the other
+   Test::BenchmarkFunction pfnBenchmark;  // /
+};
+
+// Gets the tests and benchmarks, in the order in which they were registered (which is the order of
+// their definitions within each file). The vector is created on first use, since the registrations
+// are static objects in other translation units, whose order of initialization is unspecified.
+std::vector<Entry>& GetEntries()
+{
+   static std::vector<Entry> entries;
+   return entries;
+}
+
+std::string GetFullName(const Entry& entry)
+{
+   return std::string(entry.pszSuite) + "." + entry.pszName;
+}
+
+bool IsSelected(const Entry& entry, const std::vector<CStringA>& filters)
+{
+   if (filters.empty())
+   {
+      return true;
+   }
+   const auto strName = GetFullName(entry);
+   return std::any_of(filters.begin(), filters.end(), [&strName](const CStringA& strFilter)
+                      {
+                         return (strName.compare(0, strFilter.GetLength(), strFilter.GetString()) == 0);
+                      });
+}
+
+
+//////////////////////////////////////////////////
+// State of the Run
+//////////////////////////////////////////////////
+
+bool             g_isExhaustive = false;
+std::atomic<int> g_cFailures(0);        // failures in the test that is running (checks may be made on any thread)
+std::mutex       g_outputMutex;
+
+// Benchmark results from the baseline, by benchmark and case, in nanoseconds per call.
+std::map<std::string, double> g_baseline;
+double                        g_tolerance = 0.0;
+int                           g_cRegressions = 0;
+
+std::string GetResultKey(const char* pszBenchmark, const char* pszCase)
+{
+   return std::string(pszBenchmark) + "|" + pszCase;
+}
+
+// Finds the value of a string field ("name":"value") or a number field ("name":1.5) in a line
+// of JSON written by Benchmark::Report. (Names and cases never contain quotes or backslashes.)
+bool FindJsonString(const char* pszLine, const char* pszField, std::string* pstrValue)
+{
+   const auto strPattern = std::string("\"") + pszField + "\":\"";
+   const auto pszStart   = std::strstr(pszLine, strPattern.c_str());
+   if (!pszStart)
+   {
+      return false;
+   }
+   const auto pszValue = pszStart + strPattern.length();
+   const auto pszEnd   = std::strchr(pszValue, '"');
+   if (!pszEnd)
+   {
+      return false;
+   }
+   pstrValue->assign(pszValue, pszEnd);
+   return true;
+}
+
+bool FindJsonNumber(const char* pszLine, const char* pszField, double* pValue)
+{
+   const auto strPattern = std::string("\"") + pszField + "\":";
+   const auto pszStart   = std::strstr(pszLine, strPattern.c_str());
+   if (!pszStart)
+   {
+      return false;
+   }
+   *pValue = std::strtod(pszStart + strPattern.length(), nullptr);
+   return true;
+}
+
+bool ReadBaseline(LPCTSTR pszPath)
+{
+   FILE* pFile = nullptr;
+   if ((_tfopen_s(&pFile, pszPath, _T("r")) != 0) || !pFile)
+   {
+      return false;
+   }
+   char szLine[1024];
+   while (std::fgets(szLine, sizeof(szLine), pFile))
+   {
+      std::string strBenchmark;
+      std::string strCase;
+      double      nsPerCall;
+      if (FindJsonString(szLine, "benchmark",   &strBenchmark) &&
+          FindJsonString(szLine, "case",        &strCase)      &&
+          FindJsonNumber(szLine, "ns_per_call", &nsPerCall))
+      {
+         g_baseline[GetResultKey(strBenchmark.c_str(), strCase.c_str())] = nsPerCall;
+      }
+   }
+   std::fclose(pFile);
+   return true;
+}
+
+
+//////////////////////////////////////////////////
+// Running
+//////////////////////////////////////////////////
+
+int RunTests(const Test::Options& options)
+{
+   int cTests       = 0;
+   int cTestsFailed = 0;
+   for (const auto& entry : GetEntries())
+   {
+      if (!entry.pfnTest || !IsSelected(entry, options.filters))
+      {
+         continue;
+      }
+
+      const auto strName = GetFullName(entry);
+      std::printf("[ RUN      ] %s\n", strName.c_str());
+      std::fflush(stdout);
+
+      g_cFailures = 0;
+      const auto started = std::chrono::steady_clock::now();
+      try
+      {
+         entry.pfnTest();
+      }
+      catch (const Test::Abandon&)
+      {
+         // (The failure that abandoned the test has been reported.)
+      }
+      catch (const std::exception& ex)
+      {
+         std::printf("  unexpected exception: %s\n", ex.what());
+         ++g_cFailures;
+      }
+      const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+      ++cTests;
+      if (g_cFailures != 0)
+      {
+         ++cTestsFailed;
+      }
+      std::printf("[ %s ] %s (%.0f ms)\n", ((g_cFailures != 0) ? "  FAILED" : "      OK"), strName.c_str(), ms);
+   }
+
+   std::printf("%d test(s) run, %d failed.\n", cTests, cTestsFailed);
+   return (cTestsFailed != 0) ? 1 : 0;
+}
+
+int RunBenchmarks(const Test::Options& options)
+{
+   if (options.pszBaseline && !ReadBaseline(options.pszBaseline))
+   {
+      _ftprintf(stderr, _T("%s: cannot read the baseline.\n"), options.pszBaseline);
+      return 2;
+   }
+   g_tolerance = options.tolerance;
+
+   for (const auto& entry : GetEntries())
+   {
+      if (!entry.pfnBenchmark || !IsSelected(entry, options.filters))
+      {
+         continue;
+      }
+      const auto      strName = GetFullName(entry);
+      Test::Benchmark benchmark(strName.c_str(), options.minSeconds);
+      entry.pfnBenchmark(benchmark);
+   }
+
+   if (g_cRegressions != 0)
+   {
+      std::fprintf(stderr, "%d case(s) regressed by more than %.0f%%.\n", g_cRegressions, g_tolerance * 100.0);
+      return 1;
+   }
+   return 0;
+}
+
+}  // anonymous namespace
+
+
+namespace Test {
+
+Registration::Registration(const char* pszSuite, const char* pszName, TestFunction pfnTest)
+{
+   GetEntries().push_back(Entry{ pszSuite, pszName, pfnTest, nullptr });
+}
+
+Registration::Registration(const char* pszSuite, const char* pszName, BenchmarkFunction pfnBenchmark)
+{
+   GetEntries().push_back(Entry{ pszSuite, pszName, nullptr, pfnBenchmark });
+}
+
+void ReportFailure(const char* pszFile, int line, const char* pszExpression)
+{
+   std::lock_guard<std::mutex> lock(g_outputMutex);
+   std::printf("%s(%d): check failed: %s\n", pszFile, line, pszExpression);
+   ++g_cFailures;
+}
+
+bool IsExhaustive()
+{
+   return g_isExhaustive;
+}
+
+Benchmark::Benchmark(const char* pszName, double minSeconds)
+   : m_pszName   (pszName)
+   , m_minSeconds(minSeconds)
+   , m_szCase    ()
+{
+}
+
+const char* Benchmark::Case(const char* pszFormat, ...)
+{
+   va_list args;
+   va_start(args, pszFormat);
+   vsnprintf(m_szCase, sizeof(m_szCase), pszFormat, args);
+   va_end(args);
+   return m_szCase;
+}
+
+void Benchmark::Report(const char* pszCase, size_t cItems, size_t cCalls, double seconds)
+{
+   const auto nsPerCall      = (seconds * 1e9) / static_cast<double>(cCalls);
+   const auto itemsPerSecond = (static_cast<double>(cItems) * static_cast<double>(cCalls)) / seconds;
+   std::printf("{\"benchmark\":\"%s\",\"case\":\"%s\",\"calls\":%zu,\"ns_per_call\":%.1f,\"items_per_second\":%.0f",
+               m_pszName,
+               pszCase,
+               cCalls,
+               nsPerCall,
+               itemsPerSecond);
+
+   const auto it = g_baseline.find(GetResultKey(m_pszName, pszCase));
+   if (it != g_baseline.end())
+   {
+      const auto change = (nsPerCall / it->second) - 1.0;
+      std::printf(",\"baseline_ns_per_call\":%.1f,\"change\":%.3f", it->second, change);
+      if (change > g_tolerance)
+      {
+         std::printf(",\"regressed\":true");
+         ++g_cRegressions;
+      }
+   }
+   std::printf("}\n");
+   std::fflush(stdout);
+}
+
+int Run(const Options& options)
+{
+   g_isExhaustive = options.isExhaustive;
+   return options.runBenchmarks ? RunBenchmarks(options)
+                                : RunTests(options);
+}
+
+}  // namespace Test
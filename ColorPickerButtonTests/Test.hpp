@@ -0,0 +1,146 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+
+// A small harness for the library's tests and benchmarks, so that they can be run from the command
+// line (or from a build step) without depending on a test framework.
+//
+// A test is a function defined with TEST_CASE(suite, name), which checks its expectations with
+// CHECK (which records a failure and carries on) and REQUIRE (which records a failure and abandons
+// the test). A benchmark is a function defined with BENCHMARK(suite, name), which times each of the
+// cases that it is given with Benchmark::Run(); each case is reported as one line of JSON, so that
+// the output of one run can be kept as the baseline that a later run is compared against. See
+// Main.cpp for the command line.
+namespace Test {
+
+class Benchmark;
+
+using TestFunction      = void (*)();
+using BenchmarkFunction = void (*)(Benchmark&);
+
+// Registers a test or a benchmark, from the definitions made by the macros below.
+struct Registration
+{
+   Registration(const char* pszSuite, const char* pszName, TestFunction      pfnTest);
+   Registration(const char* pszSuite, const char* pszName, BenchmarkFunction pfnBenchmark);
+};
+
+// Thrown by REQUIRE to abandon the test that is running.
+struct Abandon {};
+
+// Records a failed expectation of the test that is running.
+void ReportFailure(const char* pszFile, int line, const char* pszExpression);
+
+// Gets whether the slow, exhaustive forms of the tests were asked for (with --exhaustive).
+// Tests that cover a large space of inputs sample it otherwise.
+bool IsExhaustive();
+
+// Keeps the compiler from discarding a value that is only computed to be timed.
+template <typename T>
+void DoNotOptimize(const T& value)
+{
+   static const void* volatile s_pSink;
+   s_pSink = &value;
+}
+
+
+// Times the cases of a benchmark. Each case is a function that is called repeatedly, in batches
+// of increasing size, until a batch takes at least the minimum time (0.1 seconds, by default);
+// the time per call is taken from that batch, after one call to warm up.
+class Benchmark
+{
+   Benchmark           (const Benchmark&) = delete;  // not copyable
+   Benchmark& operator=(const Benchmark&) = delete;  // not assignable
+
+public:
+
+   Benchmark(const char* pszName, double minSeconds);
+
+   // Times the specified function, which processes cItems items per call (for reporting the
+   // throughput), and reports it as the specified case of the benchmark (such as "colors=4096").
+   template <typename Function>
+   void Run(const char* pszCase, size_t cItems, Function function)
+   {
+      using Clock = std::chrono::steady_clock;
+
+      function();
+      for (size_t cCalls = 1; ; cCalls *= 2)
+      {
+         const auto started = Clock::now();
+         for (size_t iCall = 0; iCall < cCalls; ++iCall)
+         {
+            function();
+         }
+         const auto seconds = std::chrono::duration<double>(Clock::now() - started).count();
+         if ((seconds >= m_minSeconds) || (cCalls >= kcCallsMax))
+         {
+            this->Report(pszCase, cItems, cCalls, seconds);
+            return;
+         }
+      }
+   }
+
+   // Formats a case name from a printf-style format, for cases that are parameterized.
+   // (The name is kept in the benchmark, and is overwritten by the next call.)
+   const char* Case(const char* pszFormat, ...);
+
+private:
+
+   static constexpr size_t kcCallsMax = size_t(1) << 30;
+
+   void Report(const char* pszCase, size_t cItems, size_t cCalls, double seconds);
+
+private:
+   const char* const m_pszName;
+   const double      m_minSeconds;
+   char              m_szCase[128];
+};
+
+
+// The options for a run of the harness, from the command line.
+struct Options
+{
+   bool                  runBenchmarks;  // true to run the benchmarks, rather than the tests
+   bool                  isExhaustive;   // true to run the exhaustive forms of the tests
+   double                minSeconds;     // the minimum time to take timing each case of a benchmark
+   LPCTSTR               pszBaseline;    // a file of earlier results to compare the benchmarks to (or null)
+   double                tolerance;      // the slowdown (as a fraction) beyond which a case has regressed
+   std::vector<CStringA> filters;        // prefixes of the names of the tests or benchmarks to run (or none, for all)
+};
+
+// Runs the tests, or the benchmarks, whose names match the filters. Returns the exit code for the
+// process: 0 if every test passed (or no benchmark regressed), and 1 otherwise.
+int Run(const Options& options);
+
+}  // namespace Test
+
+
+// Defines a test, named suite.name, to be run by the harness.
+#define TEST_CASE(suite, name)                                                                   \
+   static void suite##_##name();                                                                 \
+   static const Test::Registration suite##_##name##Registration(#suite, #name, suite##_##name);  \
+   static void suite##_##name()
+
+// Defines a benchmark, named suite.name, to be run by the harness when benchmarks are asked for.
+#define BENCHMARK(suite, name)                                                                   \
+   static void suite##_##name(Test::Benchmark& benchmark);                                       \
+   static const Test::Registration suite##_##name##Registration(#suite, #name, suite##_##name);  \
+   static void suite##_##name(Test::Benchmark& benchmark)
+
+// Checks an expectation, recording a failure (and going on) if it is not met.
+#define CHECK(expression)                                                                        \
+   ((expression) ? static_cast<void>(0)                                                          \
+                 : Test::ReportFailure(__FILE__, __LINE__, #expression))
+
+// Checks an expectation that the rest of the test depends on, abandoning the test if it is not met.
+#define REQUIRE(expression)                                                                      \
+   do                                                                                            \
+   {                                                                                             \
+      if (!(expression))                                                                         \
+      {                                                                                          \
+         Test::ReportFailure(__FILE__, __LINE__, #expression);                                   \
+         throw Test::Abandon();                                                                  \
+      }                                                                                          \
+   } while (false)
@@ -0,0 +1,194 @@
+#include "PCH.hpp"
+#include "Test.hpp"
+#include "TraceSink.hpp"
+#include "TraceTimer.hpp"
+#include <cstdio>
+
+
+namespace {
+
+// The fields of an event, as read back from a line of the JSON that ChromeTraceSink writes.
+struct ParsedEvent
+{
+   std::string name;
+   char        ph;
+   double      ts;
+   double      dur;  // (0 for an instant)
+};
+
+// Reads back the events from the JSON, which has one event per line (and nothing else on those lines,
+// but the commas between them).
+// Returns false if a line is not in the expected form.
+bool ParseEvents(const std::string& json, std::vector<ParsedEvent>& events)
+{
+   const std::string kHeader  = "{\"traceEvents\":[\n";
+   const std::string kTrailer = "\n],\"displayTimeUnit\":\"ms\"}\n";
+   if ((json.compare(0, kHeader.size(), kHeader) != 0) ||
+       (json.size() < kHeader.size() + kTrailer.size()) ||
+       (json.compare(json.size() - kTrailer.size(), kTrailer.size(), kTrailer) != 0))
+   {
+      return false;
+   }
+
+   // Every line but the last ends with the comma that separates it from the next.
+   events.clear();
+   const auto last = json.size() - kTrailer.size();
+   for (size_t position = kHeader.size(); position < last; )
+   {
+      const auto end    = json.find('\n', position);
+      const auto isLast = (end == last);
+      auto       line   = json.substr(position, end - position);
+      position = end + 1;
+      if (!isLast)
+      {
+         if (line.back() != ',')
+         {
+            return false;
+         }
+         line.pop_back();
+      }
+
+      // The name is the only field that can contain quotes (escaped), so it is read first.
+      if (line.compare(0, 9, "{\"name\":\"") != 0)
+      {
+         return false;
+      }
+      ParsedEvent event = {};
+      size_t      ich   = 9;
+      for (; (ich < line.size()) && (line[ich] != '"'); ++ich)
+      {
+         event.name += line[ich];
+         if (line[ich] == '\\')
+         {
+            event.name += line[++ich];
+         }
+      }
+      const auto    fields = line.substr(ich + 1);
+      unsigned long pid    = 0;
+      unsigned long tid    = 0;
+      if (std::sscanf(fields.c_str(), ",\"cat\":\"ColorPickerButton\",\"ph\":\"X\",\"ts\":%lf,\"dur\":%lf,\"pid\":%lu,\"tid\":%lu}",
+                      &event.ts, &event.dur, &pid, &tid) == 4)
+      {
+         event.ph = 'X';
+      }
+      else if (std::sscanf(fields.c_str(), ",\"cat\":\"ColorPickerButton\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lf,\"pid\":%lu,\"tid\":%lu}",
+                           &event.ts, &pid, &tid) == 3)
+      {
+         event.ph = 'i';
+      }
+      else
+      {
+         return false;
+      }
+      if ((pid != ::GetCurrentProcessId()) || (tid != ::GetCurrentThreadId()) || (fields.back() != '}'))
+      {
+         return false;
+      }
+      events.push_back(event);
+   }
+   return true;
+}
+
+TraceEvent MakeEvent(const char* pszName, TraceEvent::Type type, double timestamp, double duration)
+{
+   return { pszName, type, timestamp, duration, ::GetCurrentThreadId() };
+}
+
+}  // anonymous namespace
+
+
+TEST_CASE(TraceSink, WritesAnEmptyDocument)
+{
+   ChromeTraceSink sink;
+   CHECK(sink.GetEventCount() == 0);
+   CHECK(sink.ToJson() == "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+TEST_CASE(TraceSink, WritesPhasesAndInstants)
+{
+   ChromeTraceSink sink;
+   sink.OnTraceEvent(MakeEvent("Paint",   TraceEvent::Type::Phase,   1000.25, 12.5));
+   sink.OnTraceEvent(MakeEvent("Changed", TraceEvent::Type::Instant, 1020.0,  0.0));
+   CHECK(sink.GetEventCount() == 2);
+
+   char szExpected[512];
+   std::snprintf(szExpected, sizeof(szExpected),
+                 "{\"traceEvents\":[\n"
+                 "{\"name\":\"Paint\",\"cat\":\"ColorPickerButton\",\"ph\":\"X\",\"ts\":1000.250,\"dur\":12.500,\"pid\":%lu,\"tid\":%lu},\n"
+                 "{\"name\":\"Changed\",\"cat\":\"ColorPickerButton\",\"ph\":\"i\",\"s\":\"t\",\"ts\":1020.000,\"pid\":%lu,\"tid\":%lu}\n"
+                 "],\"displayTimeUnit\":\"ms\"}\n",
+                 static_cast<unsigned long>(::GetCurrentProcessId()), static_cast<unsigned long>(::GetCurrentThreadId()),
+                 static_cast<unsigned long>(::GetCurrentProcessId()), static_cast<unsigned long>(::GetCurrentThreadId()));
+   CHECK(sink.ToJson() == szExpected);
+
+   sink.Clear();
+   CHECK(sink.GetEventCount() == 0);
+   CHECK(sink.ToJson() == "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+TEST_CASE(TraceSink, EscapesNames)
+{
+   // Quotes and backslashes are escaped, control characters are written as \u escapes,
+   // and anything else (including UTF-8) is written as it is.
+   ChromeTraceSink sink;
+   sink.OnTraceEvent(MakeEvent("say \"hi\"",        TraceEvent::Type::Instant, 0.0, 0.0));
+   sink.OnTraceEvent(MakeEvent("C:\\path",          TraceEvent::Type::Instant, 0.0, 0.0));
+   sink.OnTraceEvent(MakeEvent("line\nbreak\ttab",  TraceEvent::Type::Instant, 0.0, 0.0));
+   sink.OnTraceEvent(MakeEvent("caf\xC3\xA9 \x7F", TraceEvent::Type::Instant, 0.0, 0.0));
+
+   std::vector<ParsedEvent> events;
+   REQUIRE(ParseEvents(sink.ToJson(), events));
+   REQUIRE(events.size() == 4);
+   CHECK(events[0].name == "say \\\"hi\\\"");
+   CHECK(events[1].name == "C:\\\\path");
+   CHECK(events[2].name == "line\\u000abreak\\u0009tab");
+   CHECK(events[3].name == "caf\xC3\xA9 \x7F");
+}
+
+TEST_CASE(TraceSink, NestsPhasesWithinTheirParents)
+{
+   // Each phase is one complete event, written when it ends, so the nested phase comes first,
+   // and lies within the span of the phase around it; the instant lies within both.
+   ChromeTraceSink sink;
+   {
+      const TraceTimer outer(&sink, "Outer");
+      {
+         const TraceTimer inner(&sink, "Inner");
+         TraceTimer::Mark(&sink, "Instant");
+      }
+   }
+   {
+      const TraceTimer nothing(nullptr, "Nothing");  // (records nothing without a sink)
+      TraceTimer::Mark(nullptr, "Nothing");
+   }
+
+   std::vector<ParsedEvent> events;
+   REQUIRE(ParseEvents(sink.ToJson(), events));
+   REQUIRE(events.size() == 3);
+   const auto& instant = events[0];
+   const auto& inner   = events[1];
+   const auto& outer   = events[2];
+   CHECK((instant.name == "Instant") && (instant.ph == 'i'));
+   CHECK((inner.name   == "Inner")   && (inner.ph   == 'X'));
+   CHECK((outer.name   == "Outer")   && (outer.ph   == 'X'));
+
+   // (The timestamps are written to the nearest nanosecond, so they are compared with that slack.)
+   constexpr double kSlack = 0.001;
+   CHECK(inner.dur >= 0.0);
+   CHECK(outer.dur >= inner.dur);
+   CHECK(outer.ts  <= inner.ts + kSlack);
+   CHECK((inner.ts + inner.dur) <= (outer.ts + outer.dur + kSlack));
+   CHECK(instant.ts >= inner.ts - kSlack);
+   CHECK(instant.ts <= (inner.ts + inner.dur + kSlack));
+}
+
+TEST_CASE(TraceSink, TimestampsNeverGoBackwards)
+{
+   auto previous = TraceTimer::GetTimestamp();
+   for (int i = 0; i < 10000; ++i)
+   {
+      const auto timestamp = TraceTimer::GetTimestamp();
+      CHECK(timestamp >= previous);
+      previous = timestamp;
+   }
+}
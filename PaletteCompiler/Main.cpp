@@ -0,0 +1,273 @@
+#include "PCH.hpp"
+#include "ColorPickerButton.hpp"
+#include "PaletteFile.hpp"
+#include "PaletteImporter.hpp"
+#include <numeric>                // for iota
+#include <vector>
+
+
+// PaletteCompiler converts a palette into a C++ header that defines a StaticColorTable, so that
+// the palette can be compiled into a program, rather than being read and parsed when it runs.
+//
+// Usage: PaletteCompiler <input> <output> <name> [<columns>]
+//  - input:   a palette file (see PaletteFile), or a palette in any format that PaletteImporter reads
+//  - output:  the header to write (which is only rewritten if its contents would change, so that
+//             the files that include it are not needlessly recompiled)
+//  - name:    the identifier of the StaticColorTable; its arrays are given names derived from it
+//  - columns: the number of columns to lay the table out in; by default, the number that the
+//             palette asks for, if any, or else ColorPickerButton::kcColorTableColumnsDefault
+//
+// Add it to a project as a custom build step for the palette, with the header as the output.
+
+namespace {
+
+//////////////////////////////////////////////////
+// Palette Input
+//////////////////////////////////////////////////
+
+struct Palette
+{
+   std::vector<COLORREF> colors;
+   std::vector<CStringW> names;
+   size_t                cColumns;
+};
+
+bool ReadPalette(LPCTSTR pszPath, Palette* pPalette)
+{
+   // Try the binary palette file format first, since it can be recognized by its header.
+   auto       status       = PaletteFile::Status::Ok;
+   const auto pPaletteFile = PaletteFile::Open(pszPath, true, &status);
+   if (pPaletteFile)
+   {
+      const auto cColors = pPaletteFile->GetColorCount();
+      pPalette->colors.assign(pPaletteFile->GetColors(), pPaletteFile->GetColors() + cColors);
+      pPalette->names.resize(cColors);
+      for (size_t iColor = 0; iColor < cColors; ++iColor)
+      {
+         pPalette->names[iColor] = pPaletteFile->GetName(iColor);
+      }
+      pPalette->cColumns = pPaletteFile->GetColumnCount();
+      return true;
+   }
+   // Only a file that has the magic number is reported as a broken palette file. Anything else
+   // (including a file that could not be mapped, such as an empty one) is handed to the importer,
+   // which reports its own errors.
+   const auto hasMagic = (status != PaletteFile::Status::BadMagic) && (status != PaletteFile::Status::IoError);
+   if (hasMagic)
+   {
+      _ftprintf(stderr, _T("%s: not a valid palette file (status %d).\n"), pszPath, static_cast<int>(status));
+      return false;
+   }
+
+   PaletteImporter importer;
+   const auto      importStatus = importer.ImportFile(pszPath);
+   if (importStatus != PaletteImporter::Status::Ok)
+   {
+      _ftprintf(stderr,
+                _T("%s(offset %I64u): cannot import the palette (status %d).\n"),
+                pszPath,
+                importer.GetErrorOffset(),
+                static_cast<int>(importStatus));
+      return false;
+   }
+   const auto cColors = importer.GetColorCount();
+   pPalette->colors.assign(importer.GetColors(), importer.GetColors() + cColors);
+   pPalette->names.resize(cColors);
+   for (size_t iColor = 0; iColor < cColors; ++iColor)
+   {
+      pPalette->names[iColor] = importer.GetName(iColor);
+   }
+   pPalette->cColumns = importer.GetColumnCount();
+   return true;
+}
+
+//////////////////////////////////////////////////
+// Header Output
+//////////////////////////////////////////////////
+
+bool IsIdentifier(const CString& str)
+{
+   if (str.IsEmpty() || _istdigit(str[0]))
+   {
+      return false;
+   }
+   for (int i = 0; i < str.GetLength(); ++i)
+   {
+      if (!_istalnum(str[i]) && (str[i] != _T('_')))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Quotes a name as a TEXT() literal, which must compile in both Unicode and ANSI builds,
+// so everything but printable ASCII is written as a universal character name (or, for
+// control characters, which cannot be named that way, as an octal escape).
+CStringA QuoteName(const CStringW& strName)
+{
+   CStringA strQuoted("TEXT(\"");
+   for (int i = 0; i < strName.GetLength(); ++i)
+   {
+      const auto ch = static_cast<UINT>(strName[i]);
+      if ((ch == '"') || (ch == '\\'))
+      {
+         strQuoted.AppendFormat("\\%c", ch);
+      }
+      else if ((ch >= 0x20) && (ch < 0x7F))
+      {
+         strQuoted.AppendChar(static_cast<char>(ch));
+      }
+      else if (ch < 0x20)
+      {
+         strQuoted.AppendFormat("\\%03o", ch);
+      }
+      else if (IS_HIGH_SURROGATE(ch) && ((i + 1) < strName.GetLength()) && IS_LOW_SURROGATE(strName[i + 1]))
+      {
+         const auto codePoint = 0x10000 + ((ch - 0xD800) << 10) + (static_cast<UINT>(strName[i + 1]) - 0xDC00);
+         strQuoted.AppendFormat("\\U%08X", codePoint);
+         ++i;
+      }
+      else if (IS_HIGH_SURROGATE(ch) || IS_LOW_SURROGATE(ch))
+      {
+         strQuoted.Append("\\uFFFD");  // an unpaired surrogate cannot be named
+      }
+      else
+      {
+         strQuoted.AppendFormat("\\u%04X", ch);
+      }
+   }
+   strQuoted.Append("\")");
+   return strQuoted;
+}
+
+CStringA GenerateHeader(const Palette& palette, const CStringA& strName, size_t cColumns, const CStringA& strSource)
+{
+   const auto cColors = palette.colors.size();
+
+   // Sort the indices by color (and then by index, since the sort is stable),
+   // which is the order that StaticColorTable's lookups expect.
+   std::vector<UINT16> sortedIndices(cColors);
+   std::iota(sortedIndices.begin(), sortedIndices.end(), UINT16(0));
+   std::stable_sort(sortedIndices.begin(), sortedIndices.end(), [&palette](UINT16 a, UINT16 b)
+   {
+      return palette.colors[a] < palette.colors[b];
+   });
+
+   CStringA str;
+   str.AppendFormat("// Generated by PaletteCompiler from %s; do not edit.\n", strSource.GetString());
+   str.Append      ("// To change this table, edit the palette, and then compile it again.\n");
+   str.Append      ("#pragma once\n\n#include \"StaticColorTable.hpp\"\n\n\n");
+
+   str.AppendFormat("inline constexpr COLORREF %sColors[] =\n{\n", strName.GetString());
+   for (const auto clr : palette.colors)
+   {
+      str.AppendFormat("   RGB(0x%02X, 0x%02X, 0x%02X),\n", GetRValue(clr), GetGValue(clr), GetBValue(clr));
+   }
+   str.Append("};\n\n");
+
+   str.AppendFormat("inline constexpr LPCTSTR %sNames[] =\n{\n", strName.GetString());
+   for (const auto& strColorName : palette.names)
+   {
+      str.AppendFormat("   %s,\n", QuoteName(strColorName).GetString());
+   }
+   str.Append("};\n\n");
+
+   str.AppendFormat("inline constexpr UINT16 %sSortedIndices[] =\n{", strName.GetString());
+   for (size_t i = 0; i < cColors; ++i)
+   {
+      str.Append(((i % 16) == 0) ? "\n   " : " ");
+      str.AppendFormat("%u,", sortedIndices[i]);
+   }
+   str.Append("\n};\n\n");
+
+   str.AppendFormat("inline constexpr StaticColorTable<%Iu, %Iu> %s(%sColors, %sNames, %sSortedIndices);\n",
+                    cColors,
+                    cColumns,
+                    strName.GetString(),
+                    strName.GetString(),
+                    strName.GetString(),
+                    strName.GetString());
+   str.AppendFormat("static_assert(%s.IsValid(), \"The lookup index of %s is out of order.\");\n",
+                    strName.GetString(),
+                    strName.GetString());
+   return str;
+}
+
+bool WriteIfChanged(LPCTSTR pszPath, const CStringA& strContents)
+{
+   // Compare with the existing file, if any, so that an unchanged header keeps its timestamp.
+   CFile file;
+   if (file.Open(pszPath, CFile::modeRead | CFile::shareDenyWrite))
+   {
+      const auto cbExisting = file.GetLength();
+      if (cbExisting == static_cast<ULONGLONG>(strContents.GetLength()))
+      {
+         std::vector<char> existing(static_cast<size_t>(cbExisting));
+         const auto        cbRead = existing.empty() ? 0 : file.Read(existing.data(), static_cast<UINT>(cbExisting));
+         if ((cbRead == cbExisting) &&
+             std::equal(existing.begin(), existing.end(), strContents.GetString()))
+         {
+            return true;
+         }
+      }
+      file.Close();
+   }
+
+   if (!file.Open(pszPath, CFile::modeCreate | CFile::modeWrite | CFile::shareExclusive))
+   {
+      _ftprintf(stderr, _T("%s: cannot write the header.\n"), pszPath);
+      return false;
+   }
+   file.Write(strContents.GetString(), static_cast<UINT>(strContents.GetLength()));
+   file.Close();
+   return true;
+}
+
+}  // anonymous namespace
+
+
+int _tmain(int argc, TCHAR* argv[])
+{
+   if ((argc < 4) || (argc > 5))
+   {
+      _ftprintf(stderr, _T("Usage: PaletteCompiler <input> <output> <name> [<columns>]\n"));
+      return 2;
+   }
+
+   const auto    pszInput  = argv[1];
+   const auto    pszOutput = argv[2];
+   const CString strName(argv[3]);
+   if (!IsIdentifier(strName))
+   {
+      _ftprintf(stderr, _T("%s: the name is not a valid identifier.\n"), strName.GetString());
+      return 2;
+   }
+
+   Palette palette;
+   if (!ReadPalette(pszInput, &palette))
+   {
+      return 1;
+   }
+   if (palette.colors.empty() || (palette.colors.size() > ColorPickerButton::kcColorTableMax))
+   {
+      _ftprintf(stderr, _T("%s: a static color table must have between 1 and %Iu colors.\n"),
+                pszInput,
+                ColorPickerButton::kcColorTableMax);
+      return 1;
+   }
+
+   const auto cColumns = (argc > 4)              ? static_cast<size_t>(_tcstoul(argv[4], nullptr, 10))
+                       : (palette.cColumns != 0) ? palette.cColumns
+                                                 : ColorPickerButton::kcColorTableColumnsDefault;
+   if (cColumns == 0)
+   {
+      _ftprintf(stderr, _T("%s: the number of columns must be a positive number.\n"), argv[4]);
+      return 2;
+   }
+
+   const CString strInput(pszInput);
+   const auto    strSource = strInput.Mid(std::max(strInput.ReverseFind(_T('\\')), strInput.ReverseFind(_T('/'))) + 1);
+   const auto    strHeader = GenerateHeader(palette, CStringA(strName), cColumns, CStringA(strSource));
+   return WriteIfChanged(pszOutput, strHeader) ? 0 : 1;
+}